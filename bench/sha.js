@@ -0,0 +1,52 @@
+// Compares SHA implementations of the module. Usage: node bench/sha.js [size in MB]
+const pkcs11 = require("pkcs11js");
+
+const config = require("../test/config");
+
+const IMPLEMENTATIONS = ["scalar", "avx2", "shani"];
+const MECHANISMS = {
+    "SHA-1": pkcs11.CKM_SHA_1,
+    "SHA-256": pkcs11.CKM_SHA256,
+    "SHA-384": pkcs11.CKM_SHA384,
+    "SHA-512": pkcs11.CKM_SHA512,
+};
+const ITERATIONS = 5;
+
+const size = (parseInt(process.argv[2]) || 64) * 1024 * 1024;
+const data = Buffer.alloc(size, 0x5a);
+
+const mod = new pkcs11.PKCS11();
+mod.load(config.lib);
+
+const results = {};
+IMPLEMENTATIONS.forEach((impl) => {
+    // the implementation is selected by C_Initialize
+    process.env.PV_PKCS11_SHA = impl;
+    mod.C_Initialize();
+    const slot = mod.C_GetSlotList()[0];
+    const session = mod.C_OpenSession(slot, pkcs11.CKF_SERIAL_SESSION);
+
+    for (const name in MECHANISMS) {
+        const mechanism = { mechanism: MECHANISMS[name], parameter: null };
+        // warm up
+        mod.C_DigestInit(session, mechanism);
+        mod.C_Digest(session, data.slice(0, 1024), Buffer.alloc(64));
+
+        const start = process.hrtime();
+        for (let i = 0; i < ITERATIONS; i++) {
+            mod.C_DigestInit(session, mechanism);
+            mod.C_Digest(session, data, Buffer.alloc(64));
+        }
+        const time = process.hrtime(start);
+        const seconds = time[0] + time[1] / 1e9;
+
+        results[name] = results[name] || {};
+        results[name][impl] = (size * ITERATIONS / seconds / 1024 / 1024).toFixed(0) + " MB/s";
+    }
+
+    mod.C_CloseAllSessions(slot);
+    mod.C_Finalize();
+});
+
+console.log(`Digest of ${size / 1024 / 1024} MB, ${ITERATIONS} iterations`);
+console.table ? console.table(results) : console.log(results);
@@ -37,6 +37,7 @@
                 'src/core/crypto_digest.cpp',
                 'src/core/crypto_sign.cpp',
                 'src/core/crypto_encrypt.cpp',
+                'src/core/crypto_message.cpp',
                 'src/core/excep.cpp',
                 'src/core/module.cpp',
                 'src/core/object.cpp',
@@ -45,6 +46,29 @@
                 'src/core/attribute.cpp',
                 'src/core/template.cpp',
                 'src/core/keypair.cpp',
+                'src/core/keypair_pool.cpp',
+                'src/core/store.cpp',
+                # core/crypto
+                'src/core/crypto/cpu.cpp',
+                'src/core/crypto/sha.cpp',
+                'src/core/crypto/hmac.cpp',
+                'src/core/crypto/sha_x86.cpp',
+                'src/core/crypto/aes.cpp',
+                'src/core/crypto/aes_x86.cpp',
+                'src/core/crypto/gcm.cpp',
+                'src/core/crypto/gcm_x86.cpp',
+                'src/core/crypto/chacha.cpp',
+                'src/core/crypto/chacha_x86.cpp',
+                'src/core/crypto/xts.cpp',
+                'src/core/crypto/xts_x86.cpp',
+                'src/core/crypto/drbg.cpp',
+                'src/core/crypto/bn.cpp',
+                'src/core/crypto/bn_x86.cpp',
+                'src/core/crypto/rsa.cpp',
+                'src/core/crypto/rsa_padding.cpp',
+                'src/core/crypto/ec.cpp',
+                'src/core/crypto/curve25519.cpp',
+                'src/core/crypto/workers.cpp',
                 # core/objects
                 'src/core/objects/mechanism.cpp',
                 'src/core/objects/storage.cpp',
@@ -53,6 +77,8 @@
                 'src/core/objects/public_key.cpp',
                 'src/core/objects/secret_key.cpp',
                 'src/core/objects/aes_key.cpp',
+                'src/core/objects/aes_xts_key.cpp',
+                'src/core/objects/generic_secret_key.cpp',
                 'src/core/objects/rsa_private_key.cpp',
                 'src/core/objects/rsa_public_key.cpp',
                 'src/core/objects/ec_key.cpp',
@@ -78,6 +104,7 @@
                         # mscapi
                         'src/mscapi/helper.cpp',
                         'src/mscapi/session.cpp',
+                        'src/mscapi/store.cpp',
                         'src/mscapi/slot.cpp',
                         'src/mscapi/data.cpp',
                         'src/mscapi/key.cpp',
@@ -129,6 +156,7 @@
                         'src/osx/helper.cpp',
                         'src/osx/slot.cpp',
                         'src/osx/session.cpp',
+                        'src/osx/store.cpp',
                         'src/osx/key.cpp',
                         'src/osx/aes.cpp',
                         'src/osx/rsa.cpp',
@@ -142,6 +170,40 @@
                         'src/osx/crypto/ec.cpp',
                     ],
                 }],
+                ['OS=="linux"', {
+                    'cflags_cc': [
+                        '-std=c++11',
+                        '-fexceptions',
+                        '-frtti',
+                    ],
+                    'ldflags': [
+                        '-pthread',
+                    ],
+                    'sources': [
+                        # soft
+                        'src/soft/helper.cpp',
+                        'src/soft/random.cpp',
+                        'src/soft/slot.cpp',
+                        'src/soft/session.cpp',
+                        'src/soft/store.cpp',
+                        'src/soft/certificate.cpp',
+                        'src/soft/data.cpp',
+                        'src/soft/secret_key.cpp',
+                        'src/soft/rsa.cpp',
+                        'src/soft/ec.cpp',
+                        'src/soft/ec_edwards.cpp',
+                        'src/soft/ec_montgomery.cpp',
+                        # soft/crypto
+                        'src/soft/crypto/digest.cpp',
+                        'src/soft/crypto/hmac.cpp',
+                        'src/soft/crypto/aes.cpp',
+                        'src/soft/crypto/xts.cpp',
+                        'src/soft/crypto/chacha.cpp',
+                        'src/soft/crypto/rsa.cpp',
+                        'src/soft/crypto/ec.cpp',
+                        'src/soft/crypto/eddsa.cpp',
+                    ],
+                }],
             ],
         }
     ]
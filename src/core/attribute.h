@@ -69,6 +69,11 @@ namespace core {
         virtual CK_ULONG Size() = 0;
         virtual void GetValue(CK_VOID_PTR pData, CK_ULONG_PTR pulDataLen) = 0;
         virtual void SetValue(CK_VOID_PTR pData, CK_ULONG ulDataLen) = 0;
+        /**
+         * Sets value of the given attribute. The value is shared by both attributes
+         * until one of them is changed
+         */
+        virtual void Assign(Scoped<Attribute> attribute) = 0;
         virtual CK_BBOOL IsEmpty();
 
         std::string Name();
@@ -142,12 +147,32 @@ namespace core {
         {
             try {
                 Check(pData, ulDataLen);
-                value->resize(ulDataLen);
+                if (value.use_count() > 1) {
+                    // value is shared with other attribute, detach it
+                    value = Scoped<std::vector<T> >(new std::vector<T>(ulDataLen));
+                }
+                else {
+                    value->resize(ulDataLen);
+                }
                 memcpy(value->data(), pData, ulDataLen);
             }
             CATCH_EXCEPTION
         }
 
+        void Assign(Scoped<Attribute> attribute)
+        {
+            try {
+                AttributeTemplate<T>* source = dynamic_cast<AttributeTemplate<T>*>(attribute.get());
+                if (source) {
+                    value = source->value;
+                }
+                else {
+                    SetValue(attribute->Get(), attribute->Size());
+                }
+            }
+            CATCH_EXCEPTION
+        }
+
         CK_BBOOL IsEmpty()
         {
             return value->empty();
@@ -37,8 +37,49 @@ namespace core {
             CK_BYTE_PTR       pDigest,      /* gets the message digest */
             CK_ULONG_PTR      pulDigestLen  /* gets byte count of digest */
         );
+
+        /**
+         * Digests independent messages. Default implementation digests them one by one
+         */
+        virtual CK_RV Batch(
+            CK_MECHANISM_PTR  pMechanism,      /* the digesting mechanism */
+            CK_PV_DATA_PTR    pMessages,       /* messages to be digested */
+            CK_ULONG          ulMessageCount,  /* # of messages */
+            CK_BYTE_PTR       pDigests,        /* gets the digests */
+            CK_ULONG_PTR      pulDigestsLen    /* gets size of digests */
+        );
+
+        /**
+         * Serializes state of the active operation
+         */
+        virtual CK_RV GetState(
+            CK_BYTE_PTR       pState,       /* gets state */
+            CK_ULONG_PTR      pulStateLen   /* gets state length */
+        );
+
+        /**
+         * Restores the operation from state returned by GetState
+         */
+        virtual CK_RV SetState(
+            CK_BYTE_PTR       pState,       /* holds state */
+            CK_ULONG          ulStateLen    /* holds state length */
+        );
+
+        bool IsActive();
+
     protected:
         bool active;
+
+        /**
+         * Checks arguments of Batch and returns digest length of the mechanism. Throws
+         * CKR_DATA_LEN_RANGE if the length of all digests doesn't fit CK_ULONG
+         */
+        CK_ULONG BatchInit(
+            CK_MECHANISM_PTR  pMechanism,
+            CK_PV_DATA_PTR    pMessages,
+            CK_ULONG          ulMessageCount,
+            CK_ULONG_PTR      pulDigestsLen
+        );
     };
 
 #define CRYPTO_SIGN    0
@@ -138,6 +179,15 @@ namespace core {
             CK_ULONG_PTR      pulEncryptedPartLen
         );
 
+        /**
+         * Returns output length of Update for ulPartLen bytes of input. The operation
+         * is not changed
+         */
+        virtual CK_ULONG GetUpdateLength
+        (
+            CK_ULONG          ulPartLen
+        );
+
         virtual CK_RV Final
         (
             CK_BYTE_PTR       pLastEncryptedPart,
@@ -152,4 +202,188 @@ namespace core {
         CK_BBOOL    type;
     };
 
+    /**
+     * Message-based encryption (PKCS#11 3.0). Init prepares the key context once,
+     * then each message brings only its own parameters and associated data
+     */
+    class CryptoMessageEncrypt {
+    public:
+        /**
+         * type - CRYPTO_ENCRYPT | CRYPTO_DECRYPT
+         */
+        CryptoMessageEncrypt(CK_BBOOL type);
+
+        virtual CK_RV Init
+        (
+            CK_MECHANISM_PTR  pMechanism,
+            Scoped<Object>    key
+        );
+
+        /**
+         * C_EncryptMessage and C_DecryptMessage
+         */
+        virtual CK_RV Once
+        (
+            CK_VOID_PTR       pParameter,           /* message specific parameter */
+            CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+            CK_BYTE_PTR       pAssociatedData,      /* AEAD Associated data */
+            CK_ULONG          ulAssociatedDataLen,  /* AEAD Associated data length */
+            CK_BYTE_PTR       pData,                /* input text */
+            CK_ULONG          ulDataLen,            /* input text length */
+            CK_BYTE_PTR       pOutput,              /* gets output text */
+            CK_ULONG_PTR      pulOutputLen          /* gets output text length */
+        );
+
+        virtual CK_RV Begin
+        (
+            CK_VOID_PTR       pParameter,           /* message specific parameter */
+            CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+            CK_BYTE_PTR       pAssociatedData,      /* AEAD Associated data */
+            CK_ULONG          ulAssociatedDataLen   /* AEAD Associated data length */
+        );
+
+        /**
+         * Continues the message started by Begin. CKF_END_OF_MESSAGE flag finishes it
+         */
+        virtual CK_RV Next
+        (
+            CK_VOID_PTR       pParameter,           /* message specific parameter */
+            CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+            CK_BYTE_PTR       pPart,                /* input text */
+            CK_ULONG          ulPartLen,            /* input text length */
+            CK_BYTE_PTR       pOutput,              /* gets output text */
+            CK_ULONG_PTR      pulOutputLen,         /* gets output text length */
+            CK_FLAGS          flags                 /* multi mode flag */
+        );
+
+        /**
+         * Finishes the process, unfinished message is abandoned
+         */
+        virtual CK_RV Final();
+
+        bool IsActive();
+
+    protected:
+        bool        active;
+        bool        message;  // message started by Begin is in progress
+        CK_BBOOL    type;
+    };
+
+    /**
+     * CKM_AES_GCM message-based encryption. Checks CK_GCM_MESSAGE_PARAMS, generates
+     * IVs and handles output lengths. Backends implement the Gcm* functions
+     */
+    class CryptoGcmMessageEncrypt : public CryptoMessageEncrypt {
+    public:
+        CryptoGcmMessageEncrypt(CK_BBOOL type);
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR  pMechanism,
+            Scoped<Object>    key
+        );
+
+        CK_RV Once
+        (
+            CK_VOID_PTR       pParameter,
+            CK_ULONG          ulParameterLen,
+            CK_BYTE_PTR       pAssociatedData,
+            CK_ULONG          ulAssociatedDataLen,
+            CK_BYTE_PTR       pData,
+            CK_ULONG          ulDataLen,
+            CK_BYTE_PTR       pOutput,
+            CK_ULONG_PTR      pulOutputLen
+        );
+
+        CK_RV Begin
+        (
+            CK_VOID_PTR       pParameter,
+            CK_ULONG          ulParameterLen,
+            CK_BYTE_PTR       pAssociatedData,
+            CK_ULONG          ulAssociatedDataLen
+        );
+
+        CK_RV Next
+        (
+            CK_VOID_PTR       pParameter,
+            CK_ULONG          ulParameterLen,
+            CK_BYTE_PTR       pPart,
+            CK_ULONG          ulPartLen,
+            CK_BYTE_PTR       pOutput,
+            CK_ULONG_PTR      pulOutputLen,
+            CK_FLAGS          flags
+        );
+
+    protected:
+        // the key keeps the invocation counter of CKG_GENERATE_COUNTER, so IVs
+        // don't repeat between operations and sessions
+        Scoped<SecretKey>   secretKey;
+        // tag length of the message started by Begin
+        CK_ULONG            tagLength;
+
+        /**
+         * Checks message parameters. IV is generated for encryption if generate is true
+         */
+        CK_GCM_MESSAGE_PARAMS_PTR GetParams(
+            CK_VOID_PTR       pParameter,
+            CK_ULONG          ulParameterLen,
+            bool              generate
+        );
+
+        /**
+         * Starts the message with IV and associated data
+         */
+        virtual void GcmBegin(
+            CK_BYTE_PTR       pIv,
+            CK_ULONG          ulIvLen,
+            CK_BYTE_PTR       pAssociatedData,
+            CK_ULONG          ulAssociatedDataLen,
+            CK_ULONG          ulTagLen
+        ) = 0;
+
+        /**
+         * Fills random bits of CKG_GENERATE IVs from the random generator of the backend
+         */
+        virtual void GcmRandom(
+            CK_BYTE_PTR       pbData,
+            CK_ULONG          ulDataLen
+        ) = 0;
+
+        /**
+         * Processes a part of the message, pOutput receives ulDataLen bytes
+         */
+        virtual void GcmUpdate(
+            CK_BYTE_PTR       pData,
+            CK_ULONG          ulDataLen,
+            CK_BYTE_PTR       pOutput
+        ) = 0;
+
+        /**
+         * Processes the last part of the message. Encryption writes the tag,
+         * decryption checks it and returns false if it does not match
+         */
+        virtual bool GcmFinal(
+            CK_BYTE_PTR       pData,
+            CK_ULONG          ulDataLen,
+            CK_BYTE_PTR       pOutput,
+            CK_BYTE_PTR       pTag,
+            CK_ULONG          ulTagLen
+        ) = 0;
+
+        /**
+         * Processes the whole message. Calls GcmBegin and GcmFinal by default
+         */
+        virtual bool GcmOnce(
+            CK_BYTE_PTR       pIv,
+            CK_ULONG          ulIvLen,
+            CK_BYTE_PTR       pAssociatedData,
+            CK_ULONG          ulAssociatedDataLen,
+            CK_BYTE_PTR       pData,
+            CK_ULONG          ulDataLen,
+            CK_BYTE_PTR       pOutput,
+            CK_BYTE_PTR       pTag,
+            CK_ULONG          ulTagLen
+        );
+    };
+
 }
\ No newline at end of file
@@ -0,0 +1,818 @@
+#include "aes.h"
+#include "workers.h"
+
+using namespace core;
+
+static const CK_BYTE AES_SBOX[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static const uint32_t AES_RCON[10] = {
+    0x01000000, 0x02000000, 0x04000000, 0x08000000, 0x10000000,
+    0x20000000, 0x40000000, 0x80000000, 0x1b000000, 0x36000000
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static inline uint32_t LoadBE32(const CK_BYTE* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint64_t LoadBE64(const CK_BYTE* p)
+{
+    return ((uint64_t)LoadBE32(p) << 32) | LoadBE32(p + 4);
+}
+
+static inline void StoreBE32(CK_BYTE* p, uint32_t v)
+{
+    p[0] = (CK_BYTE)(v >> 24);
+    p[1] = (CK_BYTE)(v >> 16);
+    p[2] = (CK_BYTE)(v >> 8);
+    p[3] = (CK_BYTE)v;
+}
+
+static inline void StoreBE64(CK_BYTE* p, uint64_t v)
+{
+    StoreBE32(p, (uint32_t)(v >> 32));
+    StoreBE32(p + 4, (uint32_t)v);
+}
+
+static inline uint32_t SubWord(uint32_t v)
+{
+    return ((uint32_t)AES_SBOX[v >> 24] << 24) |
+        ((uint32_t)AES_SBOX[(v >> 16) & 0xff] << 16) |
+        ((uint32_t)AES_SBOX[(v >> 8) & 0xff] << 8) |
+        AES_SBOX[v & 0xff];
+}
+
+static inline uint32_t GfMul(uint32_t a, uint32_t b)
+{
+    uint32_t res = 0;
+    for (; b; b >>= 1) {
+        if (b & 1) {
+            res ^= a;
+        }
+        a = ((a << 1) ^ ((a & 0x80) ? 0x1b : 0)) & 0xff;
+    }
+    return res;
+}
+
+// Round tables of the portable implementation. Encryption entries are SubBytes and MixColumns
+// of a byte, decryption entries are InvSubBytes and InvMixColumns
+struct AES_TABLES {
+    uint32_t te0[256];
+    uint32_t te1[256];
+    uint32_t te2[256];
+    uint32_t te3[256];
+    uint32_t td0[256];
+    uint32_t td1[256];
+    uint32_t td2[256];
+    uint32_t td3[256];
+    CK_BYTE  invSbox[256];
+
+    AES_TABLES()
+    {
+        for (int i = 0; i < 256; i++) {
+            invSbox[AES_SBOX[i]] = (CK_BYTE)i;
+        }
+        for (int i = 0; i < 256; i++) {
+            uint32_t s = AES_SBOX[i];
+            te0[i] = (GfMul(s, 2) << 24) | (s << 16) | (s << 8) | GfMul(s, 3);
+            te1[i] = ROR32(te0[i], 8);
+            te2[i] = ROR32(te0[i], 16);
+            te3[i] = ROR32(te0[i], 24);
+
+            uint32_t d = invSbox[i];
+            td0[i] = (GfMul(d, 14) << 24) | (GfMul(d, 9) << 16) | (GfMul(d, 13) << 8) | GfMul(d, 11);
+            td1[i] = ROR32(td0[i], 8);
+            td2[i] = ROR32(td0[i], 16);
+            td3[i] = ROR32(td0[i], 24);
+        }
+    }
+};
+
+static const AES_TABLES aesTables;
+
+static void AesEncryptBlock(const uint32_t* rk, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut)
+{
+    const uint32_t* te0 = aesTables.te0;
+    const uint32_t* te1 = aesTables.te1;
+    const uint32_t* te2 = aesTables.te2;
+    const uint32_t* te3 = aesTables.te3;
+
+    uint32_t s0 = LoadBE32(pbIn) ^ rk[0];
+    uint32_t s1 = LoadBE32(pbIn + 4) ^ rk[1];
+    uint32_t s2 = LoadBE32(pbIn + 8) ^ rk[2];
+    uint32_t s3 = LoadBE32(pbIn + 12) ^ rk[3];
+
+    for (CK_ULONG r = 1; r < rounds; r++) {
+        rk += 4;
+        uint32_t t0 = te0[s0 >> 24] ^ te1[(s1 >> 16) & 0xff] ^ te2[(s2 >> 8) & 0xff] ^ te3[s3 & 0xff] ^ rk[0];
+        uint32_t t1 = te0[s1 >> 24] ^ te1[(s2 >> 16) & 0xff] ^ te2[(s3 >> 8) & 0xff] ^ te3[s0 & 0xff] ^ rk[1];
+        uint32_t t2 = te0[s2 >> 24] ^ te1[(s3 >> 16) & 0xff] ^ te2[(s0 >> 8) & 0xff] ^ te3[s1 & 0xff] ^ rk[2];
+        uint32_t t3 = te0[s3 >> 24] ^ te1[(s0 >> 16) & 0xff] ^ te2[(s1 >> 8) & 0xff] ^ te3[s2 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    // The last round has no MixColumns
+    rk += 4;
+    StoreBE32(pbOut, SubWord((s0 & 0xff000000) | (s1 & 0xff0000) | (s2 & 0xff00) | (s3 & 0xff)) ^ rk[0]);
+    StoreBE32(pbOut + 4, SubWord((s1 & 0xff000000) | (s2 & 0xff0000) | (s3 & 0xff00) | (s0 & 0xff)) ^ rk[1]);
+    StoreBE32(pbOut + 8, SubWord((s2 & 0xff000000) | (s3 & 0xff0000) | (s0 & 0xff00) | (s1 & 0xff)) ^ rk[2]);
+    StoreBE32(pbOut + 12, SubWord((s3 & 0xff000000) | (s0 & 0xff0000) | (s1 & 0xff00) | (s2 & 0xff)) ^ rk[3]);
+}
+
+static void AesDecryptBlock(const uint32_t* rk, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut)
+{
+    const uint32_t* td0 = aesTables.td0;
+    const uint32_t* td1 = aesTables.td1;
+    const uint32_t* td2 = aesTables.td2;
+    const uint32_t* td3 = aesTables.td3;
+    const CK_BYTE* inv = aesTables.invSbox;
+
+    uint32_t s0 = LoadBE32(pbIn) ^ rk[0];
+    uint32_t s1 = LoadBE32(pbIn + 4) ^ rk[1];
+    uint32_t s2 = LoadBE32(pbIn + 8) ^ rk[2];
+    uint32_t s3 = LoadBE32(pbIn + 12) ^ rk[3];
+
+    for (CK_ULONG r = 1; r < rounds; r++) {
+        rk += 4;
+        uint32_t t0 = td0[s0 >> 24] ^ td1[(s3 >> 16) & 0xff] ^ td2[(s2 >> 8) & 0xff] ^ td3[s1 & 0xff] ^ rk[0];
+        uint32_t t1 = td0[s1 >> 24] ^ td1[(s0 >> 16) & 0xff] ^ td2[(s3 >> 8) & 0xff] ^ td3[s2 & 0xff] ^ rk[1];
+        uint32_t t2 = td0[s2 >> 24] ^ td1[(s1 >> 16) & 0xff] ^ td2[(s0 >> 8) & 0xff] ^ td3[s3 & 0xff] ^ rk[2];
+        uint32_t t3 = td0[s3 >> 24] ^ td1[(s2 >> 16) & 0xff] ^ td2[(s1 >> 8) & 0xff] ^ td3[s0 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    // The last round has no InvMixColumns
+    rk += 4;
+#define AES_INV_SUB_WORD(a, b, c, d) \
+    (((uint32_t)inv[(a) >> 24] << 24) | ((uint32_t)inv[((b) >> 16) & 0xff] << 16) | ((uint32_t)inv[((c) >> 8) & 0xff] << 8) | inv[(d) & 0xff])
+    StoreBE32(pbOut, AES_INV_SUB_WORD(s0, s3, s2, s1) ^ rk[0]);
+    StoreBE32(pbOut + 4, AES_INV_SUB_WORD(s1, s0, s3, s2) ^ rk[1]);
+    StoreBE32(pbOut + 8, AES_INV_SUB_WORD(s2, s1, s0, s3) ^ rk[2]);
+    StoreBE32(pbOut + 12, AES_INV_SUB_WORD(s3, s2, s1, s0) ^ rk[3]);
+#undef AES_INV_SUB_WORD
+}
+
+static void LoadRoundKeys(uint32_t* rk, const CK_BYTE* roundKeys, CK_ULONG rounds)
+{
+    for (CK_ULONG i = 0; i < (rounds + 1) * 4; i++) {
+        rk[i] = LoadBE32(roundKeys + i * 4);
+    }
+}
+
+void core::AesEncryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    uint32_t rk[AES_MAX_ROUND_KEYS_LENGTH / 4];
+    LoadRoundKeys(rk, roundKeys, rounds);
+
+    for (; blocks; blocks--, pbIn += AES_BLOCK_LENGTH, pbOut += AES_BLOCK_LENGTH) {
+        AesEncryptBlock(rk, rounds, pbIn, pbOut);
+    }
+}
+
+void core::AesDecryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    uint32_t rk[AES_MAX_ROUND_KEYS_LENGTH / 4];
+    LoadRoundKeys(rk, roundKeys, rounds);
+
+    for (; blocks; blocks--, pbIn += AES_BLOCK_LENGTH, pbOut += AES_BLOCK_LENGTH) {
+        AesDecryptBlock(rk, rounds, pbIn, pbOut);
+    }
+}
+
+void core::AesCbcEncryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    uint32_t rk[AES_MAX_ROUND_KEYS_LENGTH / 4];
+    LoadRoundKeys(rk, roundKeys, rounds);
+
+    for (; blocks; blocks--, pbIn += AES_BLOCK_LENGTH, pbOut += AES_BLOCK_LENGTH) {
+        for (int i = 0; i < AES_BLOCK_LENGTH; i++) {
+            pbIv[i] ^= pbIn[i];
+        }
+        AesEncryptBlock(rk, rounds, pbIv, pbIv);
+        memcpy(pbOut, pbIv, AES_BLOCK_LENGTH);
+    }
+}
+
+void core::AesCbcDecryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    uint32_t rk[AES_MAX_ROUND_KEYS_LENGTH / 4];
+    LoadRoundKeys(rk, roundKeys, rounds);
+
+    CK_BYTE cipherText[AES_BLOCK_LENGTH];
+    for (; blocks; blocks--, pbIn += AES_BLOCK_LENGTH, pbOut += AES_BLOCK_LENGTH) {
+        memcpy(cipherText, pbIn, AES_BLOCK_LENGTH);
+        AesDecryptBlock(rk, rounds, cipherText, pbOut);
+        for (int i = 0; i < AES_BLOCK_LENGTH; i++) {
+            pbOut[i] ^= pbIv[i];
+        }
+        memcpy(pbIv, cipherText, AES_BLOCK_LENGTH);
+    }
+}
+
+void core::AesCtrBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbCounter, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    uint32_t rk[AES_MAX_ROUND_KEYS_LENGTH / 4];
+    LoadRoundKeys(rk, roundKeys, rounds);
+
+    CK_BYTE keyStream[AES_BLOCK_LENGTH];
+    for (; blocks; blocks--, pbIn += AES_BLOCK_LENGTH, pbOut += AES_BLOCK_LENGTH) {
+        AesEncryptBlock(rk, rounds, pbCounter, keyStream);
+        for (int i = 0; i < AES_BLOCK_LENGTH; i++) {
+            pbOut[i] = pbIn[i] ^ keyStream[i];
+        }
+        AesAddCounter(pbCounter, 1);
+    }
+}
+
+void core::AesAddCounter(
+    CK_BYTE*            pbCounter,
+    uint64_t            blocks
+)
+{
+    uint64_t lo = LoadBE64(pbCounter + 8);
+    uint64_t hi = LoadBE64(pbCounter);
+    uint64_t sum = lo + blocks;
+    if (sum < lo) {
+        hi++;
+    }
+    StoreBE64(pbCounter, hi);
+    StoreBE64(pbCounter + 8, sum);
+}
+
+// Implementations in use
+static AES_BLOCKS     aesEncryptBlocks = core::AesEncryptBlocks;
+static AES_BLOCKS     aesDecryptBlocks = core::AesDecryptBlocks;
+static AES_CBC_BLOCKS aesCbcEncryptBlocks = core::AesCbcEncryptBlocks;
+static AES_CBC_BLOCKS aesCbcDecryptBlocks = core::AesCbcDecryptBlocks;
+static AES_CTR_BLOCKS aesCtrBlocks = core::AesCtrBlocks;
+static const char*    aesName = "scalar";
+
+void Aes::Setup()
+{
+    const char* limit = getenv("PV_PKCS11_AES");
+    bool allowAesNi = !limit || !strcmp(limit, "aesni") || !strcmp(limit, "vaes");
+    bool allowVaes = !limit || !strcmp(limit, "vaes");
+
+    aesEncryptBlocks = core::AesEncryptBlocks;
+    aesDecryptBlocks = core::AesDecryptBlocks;
+    aesCbcEncryptBlocks = core::AesCbcEncryptBlocks;
+    aesCbcDecryptBlocks = core::AesCbcDecryptBlocks;
+    aesCtrBlocks = core::AesCtrBlocks;
+    aesName = "scalar";
+
+#ifdef PV_X86
+    const CPU_FEATURES& cpu = GetCpuFeatures();
+    if (allowAesNi && cpu.aes && cpu.sse41) {
+        aesEncryptBlocks = core::AesEncryptBlocksAesNi;
+        aesDecryptBlocks = core::AesDecryptBlocksAesNi;
+        aesCbcEncryptBlocks = core::AesCbcEncryptBlocksAesNi;
+        aesCbcDecryptBlocks = core::AesCbcDecryptBlocksAesNi;
+        aesCtrBlocks = core::AesCtrBlocksAesNi;
+        aesName = "aesni";
+
+        // Wide kernels hand incomplete groups to AES-NI ones. CBC encryption stays serial
+        if (allowVaes && cpu.vaes && cpu.avx512f && cpu.avx512bw) {
+            aesEncryptBlocks = core::AesEncryptBlocksVaes512;
+            aesDecryptBlocks = core::AesDecryptBlocksVaes512;
+            aesCbcDecryptBlocks = core::AesCbcDecryptBlocksVaes512;
+            aesCtrBlocks = core::AesCtrBlocksVaes512;
+            aesName = "vaes512";
+        }
+        else if (allowVaes && cpu.vaes) {
+            aesEncryptBlocks = core::AesEncryptBlocksVaes;
+            aesDecryptBlocks = core::AesDecryptBlocksVaes;
+            aesCbcDecryptBlocks = core::AesCbcDecryptBlocksVaes;
+            aesCtrBlocks = core::AesCtrBlocksVaes;
+            aesName = "vaes";
+        }
+    }
+#endif
+}
+
+const char* Aes::GetImplementationName()
+{
+    return aesName;
+}
+
+Aes::Aes(
+    const CK_BYTE*      pbKey,
+    CK_ULONG            ulKeyLen
+)
+{
+    try {
+        if (ulKeyLen != 16 && ulKeyLen != 24 && ulKeyLen != 32) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_SIZE_RANGE, "AES key must be 16, 24 or 32 bytes");
+        }
+
+        CK_ULONG nk = ulKeyLen / 4;
+        keyLength = ulKeyLen;
+        rounds = nk + 6;
+
+        uint32_t w[AES_MAX_ROUND_KEYS_LENGTH / 4];
+        CK_ULONG words = (rounds + 1) * 4;
+        for (CK_ULONG i = 0; i < nk; i++) {
+            w[i] = LoadBE32(pbKey + i * 4);
+        }
+        for (CK_ULONG i = nk; i < words; i++) {
+            uint32_t temp = w[i - 1];
+            if (i % nk == 0) {
+                temp = SubWord((temp << 8) | (temp >> 24)) ^ AES_RCON[i / nk - 1];
+            }
+            else if (nk > 6 && i % nk == 4) {
+                temp = SubWord(temp);
+            }
+            w[i] = w[i - nk] ^ temp;
+        }
+
+        memset(roundKeys, 0, sizeof(roundKeys));
+        for (CK_ULONG i = 0; i < words; i++) {
+            StoreBE32(roundKeys + i * 4, w[i]);
+        }
+
+        // Equivalent inverse cipher: keys in reverse order, InvMixColumns applied to inner ones
+        memset(decRoundKeys, 0, sizeof(decRoundKeys));
+        for (CK_ULONG r = 0; r <= rounds; r++) {
+            for (CK_ULONG c = 0; c < 4; c++) {
+                uint32_t k = w[(rounds - r) * 4 + c];
+                if (r && r < rounds) {
+                    // td tables start with InvSubBytes, S-box cancels it
+                    k = aesTables.td0[AES_SBOX[k >> 24]] ^ aesTables.td1[AES_SBOX[(k >> 16) & 0xff]] ^
+                        aesTables.td2[AES_SBOX[(k >> 8) & 0xff]] ^ aesTables.td3[AES_SBOX[k & 0xff]];
+                }
+                StoreBE32(decRoundKeys + (r * 4 + c) * 4, k);
+            }
+        }
+        memset(w, 0, sizeof(w));
+    }
+    CATCH_EXCEPTION
+}
+
+Aes::~Aes()
+{
+    memset(roundKeys, 0, sizeof(roundKeys));
+    memset(decRoundKeys, 0, sizeof(decRoundKeys));
+}
+
+CK_ULONG Aes::GetKeyLength()
+{
+    return keyLength;
+}
+
+const CK_BYTE* Aes::GetRoundKeys()
+{
+    return roundKeys;
+}
+
+const CK_BYTE* Aes::GetDecryptRoundKeys()
+{
+    return decRoundKeys;
+}
+
+CK_ULONG Aes::GetRounds()
+{
+    return rounds;
+}
+
+void Aes::EncryptBlocks(
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              blocks
+)
+{
+    aesEncryptBlocks(roundKeys, rounds, pbIn, pbOut, blocks);
+}
+
+void Aes::DecryptBlocks(
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              blocks
+)
+{
+    aesDecryptBlocks(decRoundKeys, rounds, pbIn, pbOut, blocks);
+}
+
+void Aes::CbcEncrypt(
+    CK_BYTE*            pbIv,
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              blocks
+)
+{
+    aesCbcEncryptBlocks(roundKeys, rounds, pbIv, pbIn, pbOut, blocks);
+}
+
+void Aes::CbcDecrypt(
+    CK_BYTE*            pbIv,
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              blocks
+)
+{
+    aesCbcDecryptBlocks(decRoundKeys, rounds, pbIv, pbIn, pbOut, blocks);
+}
+
+void Aes::Ctr(
+    CK_BYTE*            pbCounter,
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              len
+)
+{
+    size_t blocks = len / AES_BLOCK_LENGTH;
+    if (blocks) {
+        aesCtrBlocks(roundKeys, rounds, pbCounter, pbIn, pbOut, blocks);
+    }
+
+    size_t rest = len % AES_BLOCK_LENGTH;
+    if (rest) {
+        CK_BYTE keyStream[AES_BLOCK_LENGTH];
+        aesEncryptBlocks(roundKeys, rounds, pbCounter, keyStream, 1);
+        pbIn += blocks * AES_BLOCK_LENGTH;
+        pbOut += blocks * AES_BLOCK_LENGTH;
+        for (size_t i = 0; i < rest; i++) {
+            pbOut[i] = pbIn[i] ^ keyStream[i];
+        }
+        AesAddCounter(pbCounter, 1);
+    }
+}
+
+// Parts of a split call are not smaller than this
+#define AES_MIN_PART_BLOCKS     4096
+
+AesCtr::AesCtr() :
+    keyStreamLen(0),
+    blocksLeft(0)
+{
+}
+
+AesCtr::~AesCtr()
+{
+    memset(keyStream, 0, sizeof(keyStream));
+}
+
+void AesCtr::Init(
+    Scoped<Aes>         aes,
+    const CK_BYTE*      pbCounterBlock,
+    CK_ULONG            ulCounterBits
+)
+{
+    try {
+        if (ulCounterBits == 0 || ulCounterBits > 128) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "ulCounterBits must be from 1 to 128");
+        }
+
+        this->aes = aes;
+        memcpy(counter, pbCounterBlock, AES_BLOCK_LENGTH);
+        keyStreamLen = 0;
+
+        // Number of counter values from the initial one to the wrap, 2^64 and more is saturated
+        uint64_t hi = LoadBE64(counter);
+        uint64_t lo = LoadBE64(counter + 8);
+        if (ulCounterBits < 64) {
+            uint64_t mask = (1ULL << ulCounterBits) - 1;
+            blocksLeft = mask - (lo & mask) + 1;
+        }
+        else {
+            uint64_t hiMask = ulCounterBits == 128 ? ~0ULL : (1ULL << (ulCounterBits - 64)) - 1;
+            if ((hi & hiMask) != hiMask || lo == 0) {
+                blocksLeft = ~0ULL;
+            }
+            else {
+                blocksLeft = 0 - lo;
+            }
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void AesCtr::Update(
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              len
+)
+{
+    try {
+        if (!aes) {
+            THROW_EXCEPTION("AES-CTR is not initialized");
+        }
+
+        // Rest of the previous key stream block
+        size_t used = len < keyStreamLen ? len : keyStreamLen;
+        size_t blocks = (len - used + AES_BLOCK_LENGTH - 1) / AES_BLOCK_LENGTH;
+        if (blocks > blocksLeft) {
+            THROW_PKCS11_EXCEPTION(CKR_DATA_LEN_RANGE, "AES-CTR counter wraps");
+        }
+        blocksLeft -= blocks;
+
+        const CK_BYTE* pbKeyStream = keyStream + AES_BLOCK_LENGTH - keyStreamLen;
+        for (size_t i = 0; i < used; i++) {
+            pbOut[i] = pbIn[i] ^ pbKeyStream[i];
+        }
+        keyStreamLen -= used;
+        pbIn += used;
+        pbOut += used;
+        len -= used;
+
+        size_t fullBlocks = len / AES_BLOCK_LENGTH;
+        size_t threshold = WorkerPool::GetThreshold();
+        if (threshold && len >= threshold && fullBlocks >= 2 * AES_MIN_PART_BLOCKS) {
+            // Each part starts from its own counter block, so parts don't depend on each other
+            WorkerPool& pool = WorkerPool::Get();
+            size_t parts = pool.GetConcurrency();
+            if (parts > fullBlocks / AES_MIN_PART_BLOCKS) {
+                parts = fullBlocks / AES_MIN_PART_BLOCKS;
+            }
+            size_t partBlocks = (fullBlocks + parts - 1) / parts;
+            Aes* cipher = aes.get();
+            const CK_BYTE* pbCounter = counter;
+
+            pool.Run(parts, [=](size_t part) {
+                size_t first = part * partBlocks;
+                size_t count = fullBlocks - first < partBlocks ? fullBlocks - first : partBlocks;
+                CK_BYTE partCounter[AES_BLOCK_LENGTH];
+                memcpy(partCounter, pbCounter, AES_BLOCK_LENGTH);
+                AesAddCounter(partCounter, first);
+                size_t offset = first * AES_BLOCK_LENGTH;
+                cipher->Ctr(partCounter, pbIn + offset, pbOut + offset, count * AES_BLOCK_LENGTH);
+            });
+
+            AesAddCounter(counter, fullBlocks);
+            pbIn += fullBlocks * AES_BLOCK_LENGTH;
+            pbOut += fullBlocks * AES_BLOCK_LENGTH;
+            len -= fullBlocks * AES_BLOCK_LENGTH;
+        }
+        else if (fullBlocks) {
+            aes->Ctr(counter, pbIn, pbOut, fullBlocks * AES_BLOCK_LENGTH);
+            pbIn += fullBlocks * AES_BLOCK_LENGTH;
+            pbOut += fullBlocks * AES_BLOCK_LENGTH;
+            len -= fullBlocks * AES_BLOCK_LENGTH;
+        }
+
+        if (len) {
+            aes->EncryptBlocks(counter, keyStream, 1);
+            AesAddCounter(counter, 1);
+            for (size_t i = 0; i < len; i++) {
+                pbOut[i] = pbIn[i] ^ keyStream[i];
+            }
+            keyStreamLen = AES_BLOCK_LENGTH - len;
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+AesBlockMode::AesBlockMode() :
+    cbc(false),
+    padding(false),
+    decrypt(false),
+    bufferLen(0)
+{
+}
+
+AesBlockMode::~AesBlockMode()
+{
+    memset(buffer, 0, sizeof(buffer));
+}
+
+void AesBlockMode::Init(
+    Scoped<Aes>         aes,
+    CK_MECHANISM_TYPE   mechanism,
+    bool                decrypt,
+    const CK_BYTE*      pbIv
+)
+{
+    try {
+        switch (mechanism) {
+        case CKM_AES_ECB:
+            cbc = false;
+            padding = false;
+            break;
+        case CKM_AES_CBC:
+            cbc = true;
+            padding = false;
+            break;
+        case CKM_AES_CBC_PAD:
+            cbc = true;
+            padding = true;
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        this->aes = aes;
+        this->decrypt = decrypt;
+        if (cbc) {
+            memcpy(iv, pbIv, AES_BLOCK_LENGTH);
+        }
+        bufferLen = 0;
+    }
+    CATCH_EXCEPTION
+}
+
+size_t AesBlockMode::GetUpdateLength(
+    size_t              len
+)
+{
+    size_t blocks = (bufferLen + len) / AES_BLOCK_LENGTH;
+    // Padded decryption keeps the last complete block for Final
+    if (decrypt && padding && blocks && (bufferLen + len) % AES_BLOCK_LENGTH == 0) {
+        blocks--;
+    }
+    return blocks * AES_BLOCK_LENGTH;
+}
+
+size_t AesBlockMode::GetFinalLength()
+{
+    return padding ? AES_BLOCK_LENGTH : 0;
+}
+
+size_t AesBlockMode::Update(
+    const CK_BYTE*      pbIn,
+    size_t              len,
+    CK_BYTE*            pbOut
+)
+{
+    try {
+        if (!aes) {
+            THROW_EXCEPTION("AES block mode is not initialized");
+        }
+
+        // Output is shifted by the kept bytes and would overwrite input which is not read yet
+        if (bufferLen && len && pbOut < pbIn + len && pbIn < pbOut + len + bufferLen) {
+            Buffer copy(pbIn, pbIn + len);
+            return Update(copy.data(), len, pbOut);
+        }
+
+        bool holdBack = decrypt && padding;
+        size_t res = 0;
+
+        if (bufferLen) {
+            size_t n = AES_BLOCK_LENGTH - bufferLen;
+            if (n > len) {
+                n = len;
+            }
+            memcpy(buffer + bufferLen, pbIn, n);
+            bufferLen += n;
+            pbIn += n;
+            len -= n;
+            if (bufferLen < AES_BLOCK_LENGTH || (holdBack && !len)) {
+                return 0;
+            }
+            Blocks(buffer, pbOut, 1);
+            bufferLen = 0;
+            pbOut += AES_BLOCK_LENGTH;
+            res += AES_BLOCK_LENGTH;
+        }
+
+        size_t blocks = len / AES_BLOCK_LENGTH;
+        size_t rest = len % AES_BLOCK_LENGTH;
+        if (holdBack && blocks && !rest) {
+            blocks--;
+            rest = AES_BLOCK_LENGTH;
+        }
+        Blocks(pbIn, pbOut, blocks);
+        memcpy(buffer, pbIn + blocks * AES_BLOCK_LENGTH, rest);
+        bufferLen = rest;
+
+        return res + blocks * AES_BLOCK_LENGTH;
+    }
+    CATCH_EXCEPTION
+}
+
+size_t AesBlockMode::Final(
+    CK_BYTE*            pbOut
+)
+{
+    try {
+        if (!aes) {
+            THROW_EXCEPTION("AES block mode is not initialized");
+        }
+
+        size_t len = bufferLen;
+        bufferLen = 0;
+
+        if (!padding) {
+            if (len) {
+                THROW_PKCS11_EXCEPTION(decrypt ? CKR_ENCRYPTED_DATA_LEN_RANGE : CKR_DATA_LEN_RANGE, "Data is not a multiple of AES block");
+            }
+            return 0;
+        }
+
+        if (!decrypt) {
+            // PKCS#7 padding, a complete block is padded with one more block
+            CK_BYTE pad = (CK_BYTE)(AES_BLOCK_LENGTH - len);
+            memset(buffer + len, pad, pad);
+            Blocks(buffer, pbOut, 1);
+            return AES_BLOCK_LENGTH;
+        }
+
+        if (len != AES_BLOCK_LENGTH) {
+            THROW_PKCS11_EXCEPTION(CKR_ENCRYPTED_DATA_LEN_RANGE, "Encrypted data is not a multiple of AES block");
+        }
+        CK_BYTE block[AES_BLOCK_LENGTH];
+        Blocks(buffer, block, 1);
+        CK_BYTE pad = block[AES_BLOCK_LENGTH - 1];
+        CK_BYTE bad = (CK_BYTE)(pad == 0 || pad > AES_BLOCK_LENGTH);
+        for (size_t i = 0; i < AES_BLOCK_LENGTH; i++) {
+            // Checks all bytes, so the time doesn't depend on the padding
+            CK_BYTE inPad = (CK_BYTE)(i >= AES_BLOCK_LENGTH - (size_t)pad);
+            bad |= inPad & (CK_BYTE)(block[i] != pad);
+        }
+        if (bad) {
+            memset(block, 0, sizeof(block));
+            THROW_PKCS11_EXCEPTION(CKR_ENCRYPTED_DATA_INVALID, "Wrong padding");
+        }
+        memcpy(pbOut, block, AES_BLOCK_LENGTH - pad);
+        memset(block, 0, sizeof(block));
+        return AES_BLOCK_LENGTH - pad;
+    }
+    CATCH_EXCEPTION
+}
+
+void AesBlockMode::Blocks(
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              blocks
+)
+{
+    if (!blocks) {
+        return;
+    }
+
+    // CBC encryption is serial, other modes don't depend on the previous output
+    size_t threshold = WorkerPool::GetThreshold();
+    bool split = (decrypt || !cbc) && threshold &&
+        blocks * AES_BLOCK_LENGTH >= threshold && blocks >= 2 * AES_MIN_PART_BLOCKS;
+
+    if (!split) {
+        if (!cbc) {
+            decrypt ? aes->DecryptBlocks(pbIn, pbOut, blocks) : aes->EncryptBlocks(pbIn, pbOut, blocks);
+        }
+        else {
+            decrypt ? aes->CbcDecrypt(iv, pbIn, pbOut, blocks) : aes->CbcEncrypt(iv, pbIn, pbOut, blocks);
+        }
+        return;
+    }
+
+    WorkerPool& pool = WorkerPool::Get();
+    size_t parts = pool.GetConcurrency();
+    if (parts > blocks / AES_MIN_PART_BLOCKS) {
+        parts = blocks / AES_MIN_PART_BLOCKS;
+    }
+    size_t partBlocks = (blocks + parts - 1) / parts;
+
+    // IV of each CBC part is the ciphertext block before it. It is read before parts run,
+    // because decryption in place overwrites it
+    Buffer ivs;
+    if (cbc) {
+        ivs.resize(parts * AES_BLOCK_LENGTH);
+        memcpy(ivs.data(), iv, AES_BLOCK_LENGTH);
+        for (size_t part = 1; part < parts; part++) {
+            memcpy(ivs.data() + part * AES_BLOCK_LENGTH, pbIn + (part * partBlocks - 1) * AES_BLOCK_LENGTH, AES_BLOCK_LENGTH);
+        }
+        memcpy(iv, pbIn + (blocks - 1) * AES_BLOCK_LENGTH, AES_BLOCK_LENGTH);
+    }
+
+    Aes* cipher = aes.get();
+    bool isCbc = cbc;
+    bool isDecrypt = decrypt;
+    CK_BYTE* pbIvs = ivs.data();
+    pool.Run(parts, [=](size_t part) {
+        size_t first = part * partBlocks;
+        size_t count = blocks - first < partBlocks ? blocks - first : partBlocks;
+        size_t offset = first * AES_BLOCK_LENGTH;
+        if (isCbc) {
+            cipher->CbcDecrypt(pbIvs + part * AES_BLOCK_LENGTH, pbIn + offset, pbOut + offset, count);
+        }
+        else if (isDecrypt) {
+            cipher->DecryptBlocks(pbIn + offset, pbOut + offset, count);
+        }
+        else {
+            cipher->EncryptBlocks(pbIn + offset, pbOut + offset, count);
+        }
+    });
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include "../../stdafx.h"
+#include "../excep.h"
+#include "cpu.h"
+
+namespace core {
+
+#define AES_BLOCK_LENGTH            16
+#define AES_MAX_ROUND_KEYS_LENGTH   (15 * AES_BLOCK_LENGTH)
+
+    // Round keys are bytes of the FIPS-197 key expansion, (rounds + 1) * 16 bytes. Decryption
+    // uses keys of the equivalent inverse cipher
+    typedef void(*AES_BLOCKS)(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    // IV is replaced with the last ciphertext block. Output may be the same buffer as input
+    typedef void(*AES_CBC_BLOCKS)(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    // Counter block is a 128-bit big-endian number, it is advanced by the number of blocks
+    typedef void(*AES_CTR_BLOCKS)(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbCounter, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+
+    // Portable implementations
+    void AesEncryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesDecryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesCbcEncryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesCbcDecryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesCtrBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbCounter, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+
+#ifdef PV_X86
+    // AES-NI, 8 blocks are interleaved. CBC encryption is serial
+    void AesEncryptBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesDecryptBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesCbcEncryptBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesCbcDecryptBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesCtrBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbCounter, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    // VAES with AVX2, 16 blocks in 8 registers
+    void AesEncryptBlocksVaes(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesDecryptBlocksVaes(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesCbcDecryptBlocksVaes(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesCtrBlocksVaes(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbCounter, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    // VAES with AVX-512, 32 blocks in 8 registers
+    void AesEncryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesDecryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesCbcDecryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void AesCtrBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbCounter, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+#endif
+
+    /**
+     * Adds blocks to the big-endian counter block modulo 2^128
+     */
+    void AesAddCounter(
+        CK_BYTE*            pbCounter,
+        uint64_t            blocks
+    );
+
+    /**
+     * AES key schedule. Block functions are selected once by Setup
+     */
+    class Aes {
+    public:
+        /**
+         * Selects the fastest implementations supported by CPU. The choice can be
+         * limited by PV_PKCS11_AES environment variable (scalar, aesni or vaes)
+         */
+        static void Setup();
+
+        /**
+         * Returns name of implementation in use
+         */
+        static const char* GetImplementationName();
+
+        /**
+         * Expands the key. Throws CKR_KEY_SIZE_RANGE if key is not 16, 24 or 32 bytes
+         */
+        Aes(
+            const CK_BYTE*      pbKey,
+            CK_ULONG            ulKeyLen
+        );
+
+        ~Aes();
+
+        CK_ULONG GetKeyLength();
+
+        /**
+         * Encryption round keys for kernels which combine AES with other work
+         */
+        const CK_BYTE* GetRoundKeys();
+
+        /**
+         * Round keys of the equivalent inverse cipher
+         */
+        const CK_BYTE* GetDecryptRoundKeys();
+
+        CK_ULONG GetRounds();
+
+        void EncryptBlocks(
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              blocks
+        );
+
+        void DecryptBlocks(
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              blocks
+        );
+
+        /**
+         * IV is replaced with the last ciphertext block
+         */
+        void CbcEncrypt(
+            CK_BYTE*            pbIv,
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              blocks
+        );
+
+        void CbcDecrypt(
+            CK_BYTE*            pbIv,
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              blocks
+        );
+
+        /**
+         * XORs data with the key stream which starts from the counter block. The counter
+         * block is advanced by the number of blocks, an incomplete block counts as one
+         */
+        void Ctr(
+            CK_BYTE*            pbCounter,
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              len
+        );
+
+    protected:
+        CK_BYTE             roundKeys[AES_MAX_ROUND_KEYS_LENGTH];
+        CK_BYTE             decRoundKeys[AES_MAX_ROUND_KEYS_LENGTH];
+        CK_ULONG            rounds;
+        CK_ULONG            keyLength;
+    };
+
+    /**
+     * CKM_AES_CTR key stream. The counter is the low counterBits of the counter block,
+     * other bits are fixed. Data which needs the counter to wrap is rejected with
+     * CKR_DATA_LEN_RANGE. Large parts are split by counter offset across WorkerPool
+     */
+    class AesCtr {
+    public:
+        AesCtr();
+        ~AesCtr();
+
+        /**
+         * Throws CKR_MECHANISM_PARAM_INVALID if counter bits are not in [1, 128]
+         */
+        void Init(
+            Scoped<Aes>         aes,
+            const CK_BYTE*      pbCounterBlock,
+            CK_ULONG            ulCounterBits
+        );
+
+        /**
+         * Output may be the same buffer as input
+         */
+        void Update(
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              len
+        );
+
+    protected:
+        Scoped<Aes>         aes;
+        CK_BYTE             counter[AES_BLOCK_LENGTH];
+        // Unused bytes of the last key stream block
+        CK_BYTE             keyStream[AES_BLOCK_LENGTH];
+        CK_ULONG            keyStreamLen;
+        // Counter values left before the counter wraps, saturated
+        uint64_t            blocksLeft;
+    };
+
+    /**
+     * CKM_AES_ECB, CKM_AES_CBC and CKM_AES_CBC_PAD over parts of data. Incomplete blocks
+     * are kept until the next part. Decryption with padding keeps the last block for Final.
+     * Large parts of ECB and CBC decryption are split across WorkerPool
+     */
+    class AesBlockMode {
+    public:
+        AesBlockMode();
+        ~AesBlockMode();
+
+        /**
+         * pbIv is 16 bytes for CBC modes and is ignored for ECB
+         */
+        void Init(
+            Scoped<Aes>         aes,
+            CK_MECHANISM_TYPE   mechanism,
+            bool                decrypt,
+            const CK_BYTE*      pbIv
+        );
+
+        /**
+         * Returns number of bytes Update writes for the part
+         */
+        size_t GetUpdateLength(
+            size_t              len
+        );
+
+        /**
+         * Returns the largest number of bytes Final writes
+         */
+        size_t GetFinalLength();
+
+        /**
+         * Returns number of bytes written. Output may be the same buffer as input
+         */
+        size_t Update(
+            const CK_BYTE*      pbIn,
+            size_t              len,
+            CK_BYTE*            pbOut
+        );
+
+        /**
+         * Writes up to 16 bytes and returns their number. Throws CKR_DATA_LEN_RANGE,
+         * CKR_ENCRYPTED_DATA_LEN_RANGE or CKR_ENCRYPTED_DATA_INVALID for wrong padding
+         */
+        size_t Final(
+            CK_BYTE*            pbOut
+        );
+
+    protected:
+        Scoped<Aes>         aes;
+        bool                cbc;
+        bool                padding;
+        bool                decrypt;
+        CK_BYTE             iv[AES_BLOCK_LENGTH];
+        CK_BYTE             buffer[AES_BLOCK_LENGTH];
+        size_t              bufferLen;
+
+        void Blocks(
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              blocks
+        );
+    };
+
+}
@@ -0,0 +1,426 @@
+#include "aes.h"
+
+#ifdef PV_X86
+
+#include <immintrin.h>
+
+using namespace core;
+
+#define AESNI_LOAD_KEYS(rk, roundKeys, rounds)                          \
+    for (CK_ULONG r = 0; r <= rounds; r++) {                            \
+        rk[r] = _mm_loadu_si128((const __m128i*)(roundKeys + r * 16));  \
+    }
+
+// Runs all rounds for 8 registers, one round of each register at a time hides latency of
+// AESENC. The same macro serves 128, 256 and 512-bit registers and decryption
+#define AES_ROUNDS8(B, rk, rounds, XOR, ENC, ENCLAST)                   \
+    B[0] = XOR(B[0], rk[0]);                                            \
+    B[1] = XOR(B[1], rk[0]);                                            \
+    B[2] = XOR(B[2], rk[0]);                                            \
+    B[3] = XOR(B[3], rk[0]);                                            \
+    B[4] = XOR(B[4], rk[0]);                                            \
+    B[5] = XOR(B[5], rk[0]);                                            \
+    B[6] = XOR(B[6], rk[0]);                                            \
+    B[7] = XOR(B[7], rk[0]);                                            \
+    for (CK_ULONG r = 1; r < rounds; r++) {                             \
+        B[0] = ENC(B[0], rk[r]);                                        \
+        B[1] = ENC(B[1], rk[r]);                                        \
+        B[2] = ENC(B[2], rk[r]);                                        \
+        B[3] = ENC(B[3], rk[r]);                                        \
+        B[4] = ENC(B[4], rk[r]);                                        \
+        B[5] = ENC(B[5], rk[r]);                                        \
+        B[6] = ENC(B[6], rk[r]);                                        \
+        B[7] = ENC(B[7], rk[r]);                                        \
+    }                                                                   \
+    B[0] = ENCLAST(B[0], rk[rounds]);                                   \
+    B[1] = ENCLAST(B[1], rk[rounds]);                                   \
+    B[2] = ENCLAST(B[2], rk[rounds]);                                   \
+    B[3] = ENCLAST(B[3], rk[rounds]);                                   \
+    B[4] = ENCLAST(B[4], rk[rounds]);                                   \
+    B[5] = ENCLAST(B[5], rk[rounds]);                                   \
+    B[6] = ENCLAST(B[6], rk[rounds]);                                   \
+    B[7] = ENCLAST(B[7], rk[rounds])
+
+#define AESNI_ENCRYPT8(B, rk, rounds) AES_ROUNDS8(B, rk, rounds, _mm_xor_si128, _mm_aesenc_si128, _mm_aesenclast_si128)
+#define AESNI_DECRYPT8(B, rk, rounds) AES_ROUNDS8(B, rk, rounds, _mm_xor_si128, _mm_aesdec_si128, _mm_aesdeclast_si128)
+
+// Low 64 bits, also available in 32-bit mode
+PV_TARGET("sse4.1")
+static inline uint64_t Low64(__m128i v)
+{
+    uint64_t res;
+    _mm_storel_epi64((__m128i*)&res, v);
+    return res;
+}
+
+PV_TARGET("aes,sse4.1")
+static inline __m128i AesNiEncrypt1(__m128i b, const __m128i* rk, CK_ULONG rounds)
+{
+    b = _mm_xor_si128(b, rk[0]);
+    for (CK_ULONG r = 1; r < rounds; r++) {
+        b = _mm_aesenc_si128(b, rk[r]);
+    }
+    return _mm_aesenclast_si128(b, rk[rounds]);
+}
+
+PV_TARGET("aes,sse4.1")
+void core::AesEncryptBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    __m128i rk[15];
+    AESNI_LOAD_KEYS(rk, roundKeys, rounds);
+
+    for (; blocks >= 8; blocks -= 8, pbIn += 128, pbOut += 128) {
+        __m128i B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = _mm_loadu_si128((const __m128i*)(pbIn + i * 16));
+        }
+        AESNI_ENCRYPT8(B, rk, rounds);
+        for (int i = 0; i < 8; i++) {
+            _mm_storeu_si128((__m128i*)(pbOut + i * 16), B[i]);
+        }
+    }
+    for (; blocks; blocks--, pbIn += 16, pbOut += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i*)pbIn);
+        _mm_storeu_si128((__m128i*)pbOut, AesNiEncrypt1(b, rk, rounds));
+    }
+}
+
+PV_TARGET("aes,sse4.1")
+static inline __m128i AesNiDecrypt1(__m128i b, const __m128i* rk, CK_ULONG rounds)
+{
+    b = _mm_xor_si128(b, rk[0]);
+    for (CK_ULONG r = 1; r < rounds; r++) {
+        b = _mm_aesdec_si128(b, rk[r]);
+    }
+    return _mm_aesdeclast_si128(b, rk[rounds]);
+}
+
+PV_TARGET("aes,sse4.1")
+void core::AesDecryptBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    __m128i rk[15];
+    AESNI_LOAD_KEYS(rk, roundKeys, rounds);
+
+    for (; blocks >= 8; blocks -= 8, pbIn += 128, pbOut += 128) {
+        __m128i B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = _mm_loadu_si128((const __m128i*)(pbIn + i * 16));
+        }
+        AESNI_DECRYPT8(B, rk, rounds);
+        for (int i = 0; i < 8; i++) {
+            _mm_storeu_si128((__m128i*)(pbOut + i * 16), B[i]);
+        }
+    }
+    for (; blocks; blocks--, pbIn += 16, pbOut += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i*)pbIn);
+        _mm_storeu_si128((__m128i*)pbOut, AesNiDecrypt1(b, rk, rounds));
+    }
+}
+
+PV_TARGET("aes,sse4.1")
+void core::AesCbcEncryptBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    __m128i rk[15];
+    AESNI_LOAD_KEYS(rk, roundKeys, rounds);
+
+    __m128i iv = _mm_loadu_si128((const __m128i*)pbIv);
+    for (; blocks; blocks--, pbIn += 16, pbOut += 16) {
+        iv = AesNiEncrypt1(_mm_xor_si128(iv, _mm_loadu_si128((const __m128i*)pbIn)), rk, rounds);
+        _mm_storeu_si128((__m128i*)pbOut, iv);
+    }
+    _mm_storeu_si128((__m128i*)pbIv, iv);
+}
+
+PV_TARGET("aes,sse4.1")
+void core::AesCbcDecryptBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    __m128i rk[15];
+    AESNI_LOAD_KEYS(rk, roundKeys, rounds);
+
+    __m128i iv = _mm_loadu_si128((const __m128i*)pbIv);
+    for (; blocks >= 8; blocks -= 8, pbIn += 128, pbOut += 128) {
+        // Ciphertext is kept in registers, output may overwrite it
+        __m128i C[8], B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = C[i] = _mm_loadu_si128((const __m128i*)(pbIn + i * 16));
+        }
+        AESNI_DECRYPT8(B, rk, rounds);
+        _mm_storeu_si128((__m128i*)pbOut, _mm_xor_si128(B[0], iv));
+        for (int i = 1; i < 8; i++) {
+            _mm_storeu_si128((__m128i*)(pbOut + i * 16), _mm_xor_si128(B[i], C[i - 1]));
+        }
+        iv = C[7];
+    }
+    for (; blocks; blocks--, pbIn += 16, pbOut += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)pbIn);
+        _mm_storeu_si128((__m128i*)pbOut, _mm_xor_si128(AesNiDecrypt1(c, rk, rounds), iv));
+        iv = c;
+    }
+    _mm_storeu_si128((__m128i*)pbIv, iv);
+}
+
+PV_TARGET("aes,sse4.1")
+void core::AesCtrBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbCounter, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    // Reverses bytes of 128-bit number
+    const __m128i BSWAP = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    __m128i rk[15];
+    AESNI_LOAD_KEYS(rk, roundKeys, rounds);
+
+    // Counter as little-endian number, the low 64 bits in the low lane
+    __m128i counter = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbCounter), BSWAP);
+    const __m128i ONE = _mm_set_epi64x(0, 1);
+
+    for (; blocks >= 8; blocks -= 8, pbIn += 128, pbOut += 128) {
+        __m128i B[8];
+        uint64_t lo = Low64(counter);
+        if (lo <= ~0ULL - 8) {
+            // No carry into the high lane within 8 blocks
+            for (int i = 0; i < 8; i++) {
+                B[i] = _mm_shuffle_epi8(counter, BSWAP);
+                counter = _mm_add_epi64(counter, ONE);
+            }
+        }
+        else {
+            for (int i = 0; i < 8; i++) {
+                B[i] = _mm_shuffle_epi8(counter, BSWAP);
+                counter = _mm_add_epi64(counter, ONE);
+                if (!Low64(counter)) {
+                    counter = _mm_add_epi64(counter, _mm_slli_si128(ONE, 8));
+                }
+            }
+        }
+        AESNI_ENCRYPT8(B, rk, rounds);
+        for (int i = 0; i < 8; i++) {
+            __m128i in = _mm_loadu_si128((const __m128i*)(pbIn + i * 16));
+            _mm_storeu_si128((__m128i*)(pbOut + i * 16), _mm_xor_si128(B[i], in));
+        }
+    }
+    for (; blocks; blocks--, pbIn += 16, pbOut += 16) {
+        __m128i b = AesNiEncrypt1(_mm_shuffle_epi8(counter, BSWAP), rk, rounds);
+        counter = _mm_add_epi64(counter, ONE);
+        if (!Low64(counter)) {
+            counter = _mm_add_epi64(counter, _mm_slli_si128(ONE, 8));
+        }
+        __m128i in = _mm_loadu_si128((const __m128i*)pbIn);
+        _mm_storeu_si128((__m128i*)pbOut, _mm_xor_si128(b, in));
+    }
+
+    _mm_storeu_si128((__m128i*)pbCounter, _mm_shuffle_epi8(counter, BSWAP));
+}
+
+// VAES with AVX2. Each register holds 2 blocks
+
+#define VAES_ENCRYPT8(B, rk, rounds) AES_ROUNDS8(B, rk, rounds, _mm256_xor_si256, _mm256_aesenc_epi128, _mm256_aesenclast_epi128)
+#define VAES_DECRYPT8(B, rk, rounds) AES_ROUNDS8(B, rk, rounds, _mm256_xor_si256, _mm256_aesdec_epi128, _mm256_aesdeclast_epi128)
+
+#define VAES_LOAD_KEYS(rk, roundKeys, rounds)                                                           \
+    for (CK_ULONG r = 0; r <= rounds; r++) {                                                            \
+        rk[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(roundKeys + r * 16)));     \
+    }
+
+PV_TARGET("vaes,avx2")
+void core::AesEncryptBlocksVaes(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    __m256i rk[15];
+    VAES_LOAD_KEYS(rk, roundKeys, rounds);
+
+    for (; blocks >= 16; blocks -= 16, pbIn += 256, pbOut += 256) {
+        __m256i B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = _mm256_loadu_si256((const __m256i*)(pbIn + i * 32));
+        }
+        VAES_ENCRYPT8(B, rk, rounds);
+        for (int i = 0; i < 8; i++) {
+            _mm256_storeu_si256((__m256i*)(pbOut + i * 32), B[i]);
+        }
+    }
+    AesEncryptBlocksAesNi(roundKeys, rounds, pbIn, pbOut, blocks);
+}
+
+PV_TARGET("vaes,avx2")
+void core::AesDecryptBlocksVaes(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    __m256i rk[15];
+    VAES_LOAD_KEYS(rk, roundKeys, rounds);
+
+    for (; blocks >= 16; blocks -= 16, pbIn += 256, pbOut += 256) {
+        __m256i B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = _mm256_loadu_si256((const __m256i*)(pbIn + i * 32));
+        }
+        VAES_DECRYPT8(B, rk, rounds);
+        for (int i = 0; i < 8; i++) {
+            _mm256_storeu_si256((__m256i*)(pbOut + i * 32), B[i]);
+        }
+    }
+    AesDecryptBlocksAesNi(roundKeys, rounds, pbIn, pbOut, blocks);
+}
+
+PV_TARGET("vaes,avx2")
+void core::AesCbcDecryptBlocksVaes(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    __m256i rk[15];
+    VAES_LOAD_KEYS(rk, roundKeys, rounds);
+
+    // The previous ciphertext block is in the high lane
+    __m256i prev = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)pbIv));
+    for (; blocks >= 16; blocks -= 16, pbIn += 256, pbOut += 256) {
+        __m256i C[8], B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = C[i] = _mm256_loadu_si256((const __m256i*)(pbIn + i * 32));
+        }
+        VAES_DECRYPT8(B, rk, rounds);
+        // Blocks before C[i] are the high lane of C[i - 1] and the low lane of C[i]
+        _mm256_storeu_si256((__m256i*)pbOut, _mm256_xor_si256(B[0], _mm256_permute2x128_si256(prev, C[0], 0x21)));
+        for (int i = 1; i < 8; i++) {
+            _mm256_storeu_si256((__m256i*)(pbOut + i * 32), _mm256_xor_si256(B[i], _mm256_permute2x128_si256(C[i - 1], C[i], 0x21)));
+        }
+        prev = C[7];
+    }
+    _mm_storeu_si128((__m128i*)pbIv, _mm256_extracti128_si256(prev, 1));
+    AesCbcDecryptBlocksAesNi(roundKeys, rounds, pbIv, pbIn, pbOut, blocks);
+}
+
+PV_TARGET("vaes,avx2")
+void core::AesCtrBlocksVaes(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbCounter, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    const __m256i BSWAP = _mm256_broadcastsi128_si256(_mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    const __m256i TWO = _mm256_set_epi64x(0, 2, 0, 2);
+
+    __m256i rk[15];
+    VAES_LOAD_KEYS(rk, roundKeys, rounds);
+
+    for (; blocks >= 16; blocks -= 16, pbIn += 256, pbOut += 256) {
+        __m128i counter = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbCounter), _mm256_castsi256_si128(BSWAP));
+        if (Low64(counter) > ~0ULL - 16) {
+            // Carry into the high 64 bits is left to AES-NI
+            AesCtrBlocksAesNi(roundKeys, rounds, pbCounter, pbIn, pbOut, 16);
+            continue;
+        }
+        // Little-endian counters, counter + 1 in the high lane
+        __m256i c = _mm256_add_epi64(_mm256_broadcastsi128_si256(counter), _mm256_set_epi64x(0, 1, 0, 0));
+        __m256i B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = _mm256_shuffle_epi8(c, BSWAP);
+            c = _mm256_add_epi64(c, TWO);
+        }
+        VAES_ENCRYPT8(B, rk, rounds);
+        for (int i = 0; i < 8; i++) {
+            __m256i in = _mm256_loadu_si256((const __m256i*)(pbIn + i * 32));
+            _mm256_storeu_si256((__m256i*)(pbOut + i * 32), _mm256_xor_si256(B[i], in));
+        }
+        _mm_storeu_si128((__m128i*)pbCounter, _mm_shuffle_epi8(_mm256_castsi256_si128(c), _mm256_castsi256_si128(BSWAP)));
+    }
+    AesCtrBlocksAesNi(roundKeys, rounds, pbCounter, pbIn, pbOut, blocks);
+}
+
+// VAES with AVX-512. Each register holds 4 blocks
+
+#define VAES512_ENCRYPT8(B, rk, rounds) AES_ROUNDS8(B, rk, rounds, _mm512_xor_si512, _mm512_aesenc_epi128, _mm512_aesenclast_epi128)
+#define VAES512_DECRYPT8(B, rk, rounds) AES_ROUNDS8(B, rk, rounds, _mm512_xor_si512, _mm512_aesdec_epi128, _mm512_aesdeclast_epi128)
+
+#define VAES512_LOAD_KEYS(rk, roundKeys, rounds)                                                        \
+    for (CK_ULONG r = 0; r <= rounds; r++) {                                                            \
+        rk[r] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(roundKeys + r * 16)));          \
+    }
+
+PV_TARGET("vaes,avx512f,avx512bw")
+void core::AesEncryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    __m512i rk[15];
+    VAES512_LOAD_KEYS(rk, roundKeys, rounds);
+
+    for (; blocks >= 32; blocks -= 32, pbIn += 512, pbOut += 512) {
+        __m512i B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = _mm512_loadu_si512((const void*)(pbIn + i * 64));
+        }
+        VAES512_ENCRYPT8(B, rk, rounds);
+        for (int i = 0; i < 8; i++) {
+            _mm512_storeu_si512((void*)(pbOut + i * 64), B[i]);
+        }
+    }
+    AesEncryptBlocksAesNi(roundKeys, rounds, pbIn, pbOut, blocks);
+}
+
+PV_TARGET("vaes,avx512f,avx512bw")
+void core::AesDecryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    __m512i rk[15];
+    VAES512_LOAD_KEYS(rk, roundKeys, rounds);
+
+    for (; blocks >= 32; blocks -= 32, pbIn += 512, pbOut += 512) {
+        __m512i B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = _mm512_loadu_si512((const void*)(pbIn + i * 64));
+        }
+        VAES512_DECRYPT8(B, rk, rounds);
+        for (int i = 0; i < 8; i++) {
+            _mm512_storeu_si512((void*)(pbOut + i * 64), B[i]);
+        }
+    }
+    AesDecryptBlocksAesNi(roundKeys, rounds, pbIn, pbOut, blocks);
+}
+
+PV_TARGET("vaes,avx512f,avx512bw")
+void core::AesCbcDecryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbIv, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    __m512i rk[15];
+    VAES512_LOAD_KEYS(rk, roundKeys, rounds);
+
+    // The previous ciphertext block is in the highest lane
+    __m512i prev = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)pbIv));
+    for (; blocks >= 32; blocks -= 32, pbIn += 512, pbOut += 512) {
+        __m512i C[8], B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = C[i] = _mm512_loadu_si512((const void*)(pbIn + i * 64));
+        }
+        VAES512_DECRYPT8(B, rk, rounds);
+        // Blocks before C[i] are the highest lane of C[i - 1] and 3 low lanes of C[i]
+        _mm512_storeu_si512((void*)pbOut, _mm512_xor_si512(B[0], _mm512_alignr_epi64(C[0], prev, 6)));
+        for (int i = 1; i < 8; i++) {
+            _mm512_storeu_si512((void*)(pbOut + i * 64), _mm512_xor_si512(B[i], _mm512_alignr_epi64(C[i], C[i - 1], 6)));
+        }
+        prev = C[7];
+    }
+    _mm_storeu_si128((__m128i*)pbIv, _mm512_extracti32x4_epi32(prev, 3));
+    AesCbcDecryptBlocksAesNi(roundKeys, rounds, pbIv, pbIn, pbOut, blocks);
+}
+
+PV_TARGET("vaes,avx512f,avx512bw")
+void core::AesCtrBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbCounter, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    const __m128i BSWAP128 = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i BSWAP = _mm512_broadcast_i32x4(BSWAP128);
+    const __m512i FOUR = _mm512_set_epi64(0, 4, 0, 4, 0, 4, 0, 4);
+
+    __m512i rk[15];
+    VAES512_LOAD_KEYS(rk, roundKeys, rounds);
+
+    for (; blocks >= 32; blocks -= 32, pbIn += 512, pbOut += 512) {
+        __m128i counter = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbCounter), BSWAP128);
+        if (Low64(counter) > ~0ULL - 32) {
+            // Carry into the high 64 bits is left to AES-NI
+            AesCtrBlocksAesNi(roundKeys, rounds, pbCounter, pbIn, pbOut, 32);
+            continue;
+        }
+        // Little-endian counters, counter + i in lane i
+        __m512i c = _mm512_add_epi64(_mm512_broadcast_i32x4(counter), _mm512_set_epi64(0, 3, 0, 2, 0, 1, 0, 0));
+        __m512i B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = _mm512_shuffle_epi8(c, BSWAP);
+            c = _mm512_add_epi64(c, FOUR);
+        }
+        VAES512_ENCRYPT8(B, rk, rounds);
+        for (int i = 0; i < 8; i++) {
+            __m512i in = _mm512_loadu_si512((const void*)(pbIn + i * 64));
+            _mm512_storeu_si512((void*)(pbOut + i * 64), _mm512_xor_si512(B[i], in));
+        }
+        _mm_storeu_si128((__m128i*)pbCounter, _mm_shuffle_epi8(_mm512_castsi512_si128(c), BSWAP128));
+    }
+    AesCtrBlocksAesNi(roundKeys, rounds, pbCounter, pbIn, pbOut, blocks);
+}
+
+#endif
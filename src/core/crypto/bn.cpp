@@ -0,0 +1,917 @@
+#include "bn.h"
+
+#include <algorithm>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+using namespace core;
+
+static inline BN_WORD BnMulWords(BN_WORD a, BN_WORD b, BN_WORD* hi)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 res = (unsigned __int128)a * b;
+    *hi = (BN_WORD)(res >> 64);
+    return (BN_WORD)res;
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return _umul128(a, b, hi);
+#else
+    uint64_t aLo = (uint32_t)a, aHi = a >> 32;
+    uint64_t bLo = (uint32_t)b, bHi = b >> 32;
+    uint64_t ll = aLo * bLo;
+    uint64_t lh = aLo * bHi;
+    uint64_t hl = aHi * bLo;
+    uint64_t hh = aHi * bHi;
+    uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+    *hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    return (mid << 32) | (uint32_t)ll;
+#endif
+}
+
+// (hi, lo) / d, hi must be less than d
+static inline BN_WORD BnDivWords(BN_WORD hi, BN_WORD lo, BN_WORD d, BN_WORD* rem)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 num = ((unsigned __int128)hi << 64) | lo;
+    *rem = (BN_WORD)(num % d);
+    return (BN_WORD)(num / d);
+#else
+    BN_WORD q = 0;
+    for (int i = 0; i < BN_WORD_BITS; i++) {
+        BN_WORD top = hi >> 63;
+        hi = (hi << 1) | (lo >> 63);
+        lo <<= 1;
+        q <<= 1;
+        if (top || hi >= d) {
+            hi -= d;
+            q |= 1;
+        }
+    }
+    *rem = hi;
+    return q;
+#endif
+}
+
+static inline size_t BnWordBits(BN_WORD w)
+{
+    size_t bits = 0;
+    while (w) {
+        bits++;
+        w >>= 1;
+    }
+    return bits;
+}
+
+BN_WORD core::BnAddWords(BN_WORD* r, const BN_WORD* a, const BN_WORD* b, size_t n)
+{
+    BN_WORD carry = 0;
+    for (size_t i = 0; i < n; i++) {
+        BN_WORD sum = a[i] + carry;
+        BN_WORD c1 = sum < carry;
+        BN_WORD res = sum + b[i];
+        carry = c1 | (res < sum);
+        r[i] = res;
+    }
+    return carry;
+}
+
+BN_WORD core::BnSubWords(BN_WORD* r, const BN_WORD* a, const BN_WORD* b, size_t n)
+{
+    BN_WORD borrow = 0;
+    for (size_t i = 0; i < n; i++) {
+        BN_WORD diff = a[i] - b[i];
+        BN_WORD b1 = diff > a[i];
+        BN_WORD res = diff - borrow;
+        borrow = b1 | (res > diff);
+        r[i] = res;
+    }
+    return borrow;
+}
+
+BN_WORD core::BnMulAddWord(BN_WORD* r, const BN_WORD* a, size_t n, BN_WORD w)
+{
+    BN_WORD carry = 0;
+    for (size_t i = 0; i < n; i++) {
+        BN_WORD hi;
+        BN_WORD lo = BnMulWords(a[i], w, &hi);
+        lo += carry;
+        hi += lo < carry;
+        lo += r[i];
+        hi += lo < r[i];
+        r[i] = lo;
+        carry = hi;
+    }
+    return carry;
+}
+
+void core::BnMontMul(BN_WORD* r, const BN_WORD* a, const BN_WORD* b, const BN_WORD* m, BN_WORD m0, size_t n)
+{
+    // CIOS, t keeps n + 2 words. Reduction writes t one word lower, so the division by
+    // 2^64 needs no move
+    BN_WORD t[BN_MONT_MAX_WORDS + 2];
+    memset(t, 0, (n + 2) * sizeof(BN_WORD));
+
+    for (size_t i = 0; i < n; i++) {
+        BN_WORD carry = BnMulAddWord(t, a, n, b[i]);
+        BN_WORD top = t[n] + carry;
+        t[n + 1] = top < carry;
+        t[n] = top;
+
+        // t + q * m is divisible by 2^64, the low word is 0 and carries if t[0] isn't 0
+        BN_WORD q = t[0] * m0;
+        BN_WORD hi;
+        BN_WORD lo = BnMulWords(m[0], q, &hi);
+        carry = hi + (t[0] != 0);
+        for (size_t j = 1; j < n; j++) {
+            lo = BnMulWords(m[j], q, &hi);
+            lo += carry;
+            hi += lo < carry;
+            lo += t[j];
+            hi += lo < t[j];
+            t[j - 1] = lo;
+            carry = hi;
+        }
+        top = t[n] + carry;
+        t[n - 1] = top;
+        t[n] = t[n + 1] + (top < carry);
+    }
+
+    // t < 2m, m is subtracted if t >= m
+    BN_WORD u[BN_MONT_MAX_WORDS];
+    BN_WORD borrow = BnSubWords(u, t, m, n);
+    BN_WORD keep = 0 - (borrow & (t[n] ^ 1));
+    for (size_t i = 0; i < n; i++) {
+        r[i] = (t[i] & keep) | (u[i] & ~keep);
+    }
+
+    memset(t, 0, (n + 2) * sizeof(BN_WORD));
+    memset(u, 0, n * sizeof(BN_WORD));
+}
+
+// BigNum
+
+BigNum::BigNum()
+{
+}
+
+BigNum::BigNum(
+    BN_WORD             value
+)
+{
+    if (value) {
+        words.push_back(value);
+    }
+}
+
+BigNum::BigNum(
+    const BigNum&       other
+) :
+    words(other.words)
+{
+}
+
+BigNum::~BigNum()
+{
+    if (!words.empty()) {
+        memset(words.data(), 0, words.size() * sizeof(BN_WORD));
+    }
+}
+
+BigNum& BigNum::operator=(
+    const BigNum&       other
+)
+{
+    if (this != &other) {
+        if (!words.empty()) {
+            memset(words.data(), 0, words.size() * sizeof(BN_WORD));
+        }
+        words = other.words;
+    }
+    return *this;
+}
+
+void BigNum::Normalize()
+{
+    while (!words.empty() && !words.back()) {
+        words.pop_back();
+    }
+}
+
+BigNum BigNum::FromBytes(
+    const CK_BYTE*      pbData,
+    size_t              len
+)
+{
+    BigNum res;
+    res.words.resize((len + BN_WORD_BYTES - 1) / BN_WORD_BYTES);
+    for (size_t i = 0; i < len; i++) {
+        size_t pos = len - 1 - i;
+        res.words[i / BN_WORD_BYTES] |= (BN_WORD)pbData[pos] << (8 * (i % BN_WORD_BYTES));
+    }
+    res.Normalize();
+    return res;
+}
+
+BigNum BigNum::FromWords(
+    const BN_WORD*      words,
+    size_t              count
+)
+{
+    BigNum res;
+    res.words.assign(words, words + count);
+    res.Normalize();
+    return res;
+}
+
+Scoped<Buffer> BigNum::ToBytes() const
+{
+    size_t len = GetByteLength();
+    if (!len) {
+        len = 1;
+    }
+    Scoped<Buffer> res(new Buffer(len));
+    ToBytes(res->data(), len);
+    return res;
+}
+
+void BigNum::ToBytes(
+    CK_BYTE*            pbOut,
+    size_t              len
+) const
+{
+    if (GetByteLength() > len) {
+        THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "Number doesn't fit the buffer");
+    }
+    for (size_t i = 0; i < len; i++) {
+        size_t index = i / BN_WORD_BYTES;
+        CK_BYTE value = index < words.size() ? (CK_BYTE)(words[index] >> (8 * (i % BN_WORD_BYTES))) : 0;
+        pbOut[len - 1 - i] = value;
+    }
+}
+
+void BigNum::ToWords(
+    BN_WORD*            out,
+    size_t              count
+) const
+{
+    if (words.size() > count) {
+        THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "Number doesn't fit the buffer");
+    }
+    memset(out, 0, count * sizeof(BN_WORD));
+    if (!words.empty()) {
+        memcpy(out, words.data(), words.size() * sizeof(BN_WORD));
+    }
+}
+
+size_t BigNum::GetBitLength() const
+{
+    if (words.empty()) {
+        return 0;
+    }
+    return (words.size() - 1) * BN_WORD_BITS + BnWordBits(words.back());
+}
+
+size_t BigNum::GetByteLength() const
+{
+    return (GetBitLength() + 7) / 8;
+}
+
+size_t BigNum::GetWordCount() const
+{
+    return words.size();
+}
+
+const BN_WORD* BigNum::GetWords() const
+{
+    return words.data();
+}
+
+bool BigNum::IsZero() const
+{
+    return words.empty();
+}
+
+bool BigNum::IsOdd() const
+{
+    return !words.empty() && (words[0] & 1);
+}
+
+bool BigNum::GetBit(
+    size_t              index
+) const
+{
+    size_t word = index / BN_WORD_BITS;
+    if (word >= words.size()) {
+        return false;
+    }
+    return (words[word] >> (index % BN_WORD_BITS)) & 1;
+}
+
+BN_WORD BigNum::ModWord(
+    BN_WORD             w
+) const
+{
+    BN_WORD rem = 0;
+    for (size_t i = words.size(); i > 0; i--) {
+        BnDivWords(rem, words[i - 1], w, &rem);
+    }
+    return rem;
+}
+
+BigNum BigNum::DivWord(
+    BN_WORD             w,
+    BN_WORD*            pRemainder
+) const
+{
+    BigNum res;
+    res.words.resize(words.size());
+    BN_WORD rem = 0;
+    for (size_t i = words.size(); i > 0; i--) {
+        res.words[i - 1] = BnDivWords(rem, words[i - 1], w, &rem);
+    }
+    res.Normalize();
+    if (pRemainder) {
+        *pRemainder = rem;
+    }
+    return res;
+}
+
+BigNum BigNum::ShiftLeft(
+    size_t              bits
+) const
+{
+    BigNum res;
+    if (words.empty()) {
+        return res;
+    }
+    size_t wordShift = bits / BN_WORD_BITS;
+    size_t bitShift = bits % BN_WORD_BITS;
+    res.words.assign(words.size() + wordShift + 1, 0);
+    for (size_t i = 0; i < words.size(); i++) {
+        res.words[i + wordShift] |= words[i] << bitShift;
+        if (bitShift) {
+            res.words[i + wordShift + 1] = words[i] >> (BN_WORD_BITS - bitShift);
+        }
+    }
+    res.Normalize();
+    return res;
+}
+
+BigNum BigNum::ShiftRight(
+    size_t              bits
+) const
+{
+    BigNum res;
+    size_t wordShift = bits / BN_WORD_BITS;
+    size_t bitShift = bits % BN_WORD_BITS;
+    if (wordShift >= words.size()) {
+        return res;
+    }
+    res.words.resize(words.size() - wordShift);
+    for (size_t i = 0; i < res.words.size(); i++) {
+        BN_WORD value = words[i + wordShift] >> bitShift;
+        if (bitShift && i + wordShift + 1 < words.size()) {
+            value |= words[i + wordShift + 1] << (BN_WORD_BITS - bitShift);
+        }
+        res.words[i] = value;
+    }
+    res.Normalize();
+    return res;
+}
+
+int BigNum::Compare(
+    const BigNum&       a,
+    const BigNum&       b
+)
+{
+    if (a.words.size() != b.words.size()) {
+        return a.words.size() < b.words.size() ? -1 : 1;
+    }
+    for (size_t i = a.words.size(); i > 0; i--) {
+        if (a.words[i - 1] != b.words[i - 1]) {
+            return a.words[i - 1] < b.words[i - 1] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+BigNum BigNum::Add(
+    const BigNum&       a,
+    const BigNum&       b
+)
+{
+    const BigNum& longer = a.words.size() >= b.words.size() ? a : b;
+    const BigNum& shorter = a.words.size() >= b.words.size() ? b : a;
+
+    BigNum res;
+    res.words.assign(longer.words.size() + 1, 0);
+    BN_WORD carry = BnAddWords(res.words.data(), longer.words.data(), shorter.words.data(), shorter.words.size());
+    for (size_t i = shorter.words.size(); i < longer.words.size(); i++) {
+        BN_WORD sum = longer.words[i] + carry;
+        carry = sum < carry;
+        res.words[i] = sum;
+    }
+    res.words[longer.words.size()] = carry;
+    res.Normalize();
+    return res;
+}
+
+BigNum BigNum::Sub(
+    const BigNum&       a,
+    const BigNum&       b
+)
+{
+    if (Compare(a, b) < 0) {
+        THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "Subtrahend is greater than minuend");
+    }
+
+    BigNum res(a);
+    BN_WORD borrow = BnSubWords(res.words.data(), res.words.data(), b.words.data(), b.words.size());
+    for (size_t i = b.words.size(); borrow && i < res.words.size(); i++) {
+        borrow = res.words[i] == 0;
+        res.words[i]--;
+    }
+    res.Normalize();
+    return res;
+}
+
+BigNum BigNum::Mul(
+    const BigNum&       a,
+    const BigNum&       b
+)
+{
+    BigNum res;
+    if (a.words.empty() || b.words.empty()) {
+        return res;
+    }
+    res.words.assign(a.words.size() + b.words.size(), 0);
+    for (size_t i = 0; i < b.words.size(); i++) {
+        res.words[i + a.words.size()] = BnMulAddWord(res.words.data() + i, a.words.data(), a.words.size(), b.words[i]);
+    }
+    res.Normalize();
+    return res;
+}
+
+void BigNum::DivMod(
+    const BigNum&       a,
+    const BigNum&       b,
+    BigNum*             pQuotient,
+    BigNum*             pRemainder
+)
+{
+    if (b.IsZero()) {
+        THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "Division by zero");
+    }
+
+    if (Compare(a, b) < 0) {
+        if (pRemainder) {
+            *pRemainder = a;
+        }
+        if (pQuotient) {
+            *pQuotient = BigNum();
+        }
+        return;
+    }
+
+    if (b.words.size() == 1) {
+        BN_WORD rem;
+        BigNum quotient = a.DivWord(b.words[0], &rem);
+        if (pRemainder) {
+            *pRemainder = BigNum(rem);
+        }
+        if (pQuotient) {
+            *pQuotient = quotient;
+        }
+        return;
+    }
+
+    // Knuth, TAOCP vol. 2, 4.3.1, algorithm D. The divisor is shifted so its top bit is set
+    size_t n = b.words.size();
+    size_t m = a.words.size() - n;
+    size_t shift = BN_WORD_BITS - BnWordBits(b.words.back());
+
+    BigNum u = a.ShiftLeft(shift);
+    BigNum v = b.ShiftLeft(shift);
+    u.words.resize(a.words.size() + 1, 0);
+
+    BigNum q;
+    q.words.assign(m + 1, 0);
+
+    BN_WORD vTop = v.words[n - 1];
+    BN_WORD vNext = v.words[n - 2];
+    for (size_t j = m + 1; j > 0; j--) {
+        BN_WORD* uj = u.words.data() + j - 1;
+
+        // Estimate of the quotient word is at most 2 greater than the right one
+        BN_WORD qHat;
+        BN_WORD rHat;
+        bool overflow = false;
+        if (uj[n] >= vTop) {
+            qHat = ~(BN_WORD)0;
+            rHat = uj[n - 1] + vTop;
+            overflow = rHat < vTop;
+        }
+        else {
+            qHat = BnDivWords(uj[n], uj[n - 1], vTop, &rHat);
+        }
+        while (!overflow) {
+            BN_WORD hi;
+            BN_WORD lo = BnMulWords(qHat, vNext, &hi);
+            if (hi < rHat || (hi == rHat && lo <= uj[n - 2])) {
+                break;
+            }
+            qHat--;
+            rHat += vTop;
+            overflow = rHat < vTop;
+        }
+
+        // uj -= qHat * v
+        BN_WORD carry = 0;
+        BN_WORD borrow = 0;
+        for (size_t i = 0; i < n; i++) {
+            BN_WORD hi;
+            BN_WORD lo = BnMulWords(qHat, v.words[i], &hi);
+            lo += carry;
+            hi += lo < carry;
+            BN_WORD diff = uj[i] - lo;
+            BN_WORD b1 = diff > uj[i];
+            BN_WORD res = diff - borrow;
+            borrow = b1 | (res > diff);
+            uj[i] = res;
+            carry = hi;
+        }
+        BN_WORD diff = uj[n] - carry;
+        BN_WORD b1 = diff > uj[n];
+        BN_WORD res = diff - borrow;
+        borrow = b1 | (res > diff);
+        uj[n] = res;
+
+        // The estimate was 1 greater
+        if (borrow) {
+            qHat--;
+            uj[n] += BnAddWords(uj, uj, v.words.data(), n);
+        }
+
+        q.words[j - 1] = qHat;
+    }
+
+    if (pQuotient) {
+        q.Normalize();
+        *pQuotient = q;
+    }
+    if (pRemainder) {
+        u.words.resize(n);
+        u.Normalize();
+        *pRemainder = u.ShiftRight(shift);
+    }
+}
+
+BigNum BigNum::Mod(
+    const BigNum&       a,
+    const BigNum&       m
+)
+{
+    BigNum res;
+    DivMod(a, m, NULL, &res);
+    return res;
+}
+
+BigNum BigNum::Gcd(
+    const BigNum&       a,
+    const BigNum&       b
+)
+{
+    BigNum x(a);
+    BigNum y(b);
+    while (!y.IsZero()) {
+        BigNum r = Mod(x, y);
+        x = y;
+        y = r;
+    }
+    return x;
+}
+
+// Radix 2^52, limbs of count are read from n words
+static void BnToLimbs52(uint64_t* limbs, size_t count, const BN_WORD* words, size_t n)
+{
+    for (size_t i = 0; i < count; i++) {
+        size_t bit = i * 52;
+        size_t index = bit / BN_WORD_BITS;
+        size_t shift = bit % BN_WORD_BITS;
+        uint64_t value = 0;
+        if (index < n) {
+            value = words[index] >> shift;
+            if (shift > BN_WORD_BITS - 52 && index + 1 < n) {
+                value |= words[index + 1] << (BN_WORD_BITS - shift);
+            }
+        }
+        limbs[i] = value & 0xFFFFFFFFFFFFFULL;
+    }
+}
+
+// Limbs must be normalized and fit n words
+static void BnFromLimbs52(BN_WORD* words, size_t n, const uint64_t* limbs, size_t count)
+{
+    memset(words, 0, n * sizeof(BN_WORD));
+    for (size_t i = 0; i < count; i++) {
+        size_t bit = i * 52;
+        size_t index = bit / BN_WORD_BITS;
+        size_t shift = bit % BN_WORD_BITS;
+        if (index < n) {
+            words[index] |= limbs[i] << shift;
+        }
+        if (shift > BN_WORD_BITS - 52 && index + 1 < n) {
+            words[index + 1] |= limbs[i] >> (BN_WORD_BITS - shift);
+        }
+    }
+}
+
+// MontContext
+
+static BN_MONT_MUL  bnMontMul = core::BnMontMul;
+static bool         bnIfma = false;
+static const char*  bnName = "scalar";
+
+void MontContext::Setup()
+{
+    const char* limit = getenv("PV_PKCS11_BN");
+    bool allowMulx = !limit || !strcmp(limit, "mulx") || !strcmp(limit, "ifma");
+    bool allowIfma = !limit || !strcmp(limit, "ifma");
+
+    bnMontMul = core::BnMontMul;
+    bnIfma = false;
+    bnName = "scalar";
+
+#ifdef PV_BN_X64
+    const CPU_FEATURES& cpu = GetCpuFeatures();
+#if defined(__GNUC__) || defined(__clang__)
+    if (allowMulx && cpu.bmi2 && cpu.adx) {
+        bnMontMul = core::BnMontMulMulx;
+        bnName = "mulx";
+    }
+#endif
+    // Single multiplications stay on MULX, IFMA runs paired exponentiations
+    if (allowIfma && cpu.avx512ifma) {
+        bnIfma = true;
+        bnName = bnMontMul == core::BnMontMul ? "ifma" : "mulx+ifma";
+    }
+#endif
+}
+
+const char* MontContext::GetImplementationName()
+{
+    return bnName;
+}
+
+MontContext::MontContext(
+    const BigNum&       modulus
+) :
+    modulus(modulus)
+{
+    try {
+        if (!modulus.IsOdd()) {
+            THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "Montgomery modulus must be odd");
+        }
+        size_t n = modulus.GetWordCount();
+        if (n > BN_MONT_MAX_WORDS) {
+            THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "Montgomery modulus is too long");
+        }
+
+        m.assign(modulus.GetWords(), modulus.GetWords() + n);
+
+        // Newton iteration doubles correct low bits of the inverse, an odd word is its own
+        // inverse modulo 8
+        BN_WORD inv = m[0];
+        for (int i = 0; i < 5; i++) {
+            inv *= 2 - m[0] * inv;
+        }
+        m0 = 0 - inv;
+
+        one.resize(n);
+        BigNum::Mod(BigNum(1).ShiftLeft(n * BN_WORD_BITS), modulus).ToWords(one.data(), n);
+        rr.resize(n);
+        BigNum::Mod(BigNum(1).ShiftLeft(2 * n * BN_WORD_BITS), modulus).ToWords(rr.data(), n);
+
+        // Assembly rows are unrolled by 4 words
+        mul = n % 4 ? core::BnMontMul : bnMontMul;
+
+        // Almost Montgomery multiplication keeps numbers below 2m, R must exceed 4m
+        limbs = (modulus.GetBitLength() + 2 + 51) / 52;
+        if (!bnIfma || limbs > BN_IFMA_MAX_LIMBS) {
+            limbs = 0;
+        }
+        else {
+            m52.assign(BN_IFMA_MAX_LIMBS, 0);
+            BnToLimbs52(m52.data(), limbs, m.data(), n);
+            BigNum rr2 = BigNum::Mod(BigNum(1).ShiftLeft(2 * 52 * limbs), modulus);
+            rr52.assign(BN_IFMA_MAX_LIMBS, 0);
+            BnToLimbs52(rr52.data(), limbs, rr2.GetWords(), rr2.GetWordCount());
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+MontContext::~MontContext()
+{
+}
+
+const BigNum& MontContext::GetModulus() const
+{
+    return modulus;
+}
+
+size_t MontContext::GetWordCount() const
+{
+    return m.size();
+}
+
+const BN_WORD* MontContext::GetOne() const
+{
+    return one.data();
+}
+
+void MontContext::Mul(
+    BN_WORD*            r,
+    const BN_WORD*      a,
+    const BN_WORD*      b
+) const
+{
+    mul(r, a, b, m.data(), m0, m.size());
+}
+
+void MontContext::ToMont(
+    BN_WORD*            r,
+    const BigNum&       a
+) const
+{
+    size_t n = m.size();
+    if (BigNum::Compare(a, modulus) >= 0) {
+        BigNum::Mod(a, modulus).ToWords(r, n);
+    }
+    else {
+        a.ToWords(r, n);
+    }
+    Mul(r, r, rr.data());
+}
+
+BigNum MontContext::FromMont(
+    const BN_WORD*      a
+) const
+{
+    size_t n = m.size();
+    BN_WORD unit[BN_MONT_MAX_WORDS];
+    memset(unit, 0, n * sizeof(BN_WORD));
+    unit[0] = 1;
+    BN_WORD res[BN_MONT_MAX_WORDS];
+    Mul(res, a, unit);
+    BigNum num = BigNum::FromWords(res, n);
+    memset(res, 0, n * sizeof(BN_WORD));
+    return num;
+}
+
+BigNum MontContext::ModExp(
+    const BigNum&       base,
+    const BigNum&       exponent
+) const
+{
+    size_t n = m.size();
+    BN_WORD value[BN_MONT_MAX_WORDS];
+    ToMont(value, base);
+    ModExpMont(value, value, exponent);
+    BigNum res = FromMont(value);
+    memset(value, 0, n * sizeof(BN_WORD));
+    return res;
+}
+
+void MontContext::ModExpMont(
+    BN_WORD*            r,
+    const BN_WORD*      base,
+    const BigNum&       exponent
+) const
+{
+    size_t n = m.size();
+    size_t bits = exponent.GetBitLength();
+    if (!bits) {
+        memcpy(r, one.data(), n * sizeof(BN_WORD));
+        return;
+    }
+
+    size_t window = bits > 512 ? 5 : bits > 128 ? 4 : bits > 16 ? 3 : 1;
+    size_t tableSize = (size_t)1 << window;
+
+    // table[i] = base^i
+    std::vector<BN_WORD> table(tableSize * n);
+    memcpy(&table[0], one.data(), n * sizeof(BN_WORD));
+    memcpy(&table[n], base, n * sizeof(BN_WORD));
+    for (size_t i = 2; i < tableSize; i++) {
+        Mul(&table[i * n], &table[(i - 1) * n], base);
+    }
+
+    BN_WORD acc[BN_MONT_MAX_WORDS];
+    BN_WORD entry[BN_MONT_MAX_WORDS];
+    memcpy(acc, one.data(), n * sizeof(BN_WORD));
+
+    size_t windows = (bits + window - 1) / window;
+    for (size_t w = windows; w > 0; w--) {
+        size_t index = 0;
+        for (size_t k = window; k > 0; k--) {
+            if (w != windows) {
+                Mul(acc, acc, acc);
+            }
+            index = (index << 1) | (exponent.GetBit((w - 1) * window + k - 1) ? 1 : 0);
+        }
+
+        // Every entry is read, the one of index is kept by mask
+        memset(entry, 0, n * sizeof(BN_WORD));
+        for (size_t i = 0; i < tableSize; i++) {
+            BN_WORD mask = 0 - ((((BN_WORD)(i ^ index)) - 1) >> (BN_WORD_BITS - 1));
+            const BN_WORD* item = &table[i * n];
+            for (size_t j = 0; j < n; j++) {
+                entry[j] |= item[j] & mask;
+            }
+        }
+        Mul(acc, acc, entry);
+    }
+
+    memcpy(r, acc, n * sizeof(BN_WORD));
+
+    memset(acc, 0, n * sizeof(BN_WORD));
+    memset(entry, 0, n * sizeof(BN_WORD));
+    memset(table.data(), 0, table.size() * sizeof(BN_WORD));
+}
+
+void MontContext::ModExp2(
+    const MontContext&  ctxA,
+    const BigNum&       baseA,
+    const BigNum&       exponentA,
+    BigNum*             pResultA,
+    const MontContext&  ctxB,
+    const BigNum&       baseB,
+    const BigNum&       exponentB,
+    BigNum*             pResultB
+)
+{
+    try {
+#ifdef PV_BN_X64
+        if (ctxA.limbs && ctxA.limbs == ctxB.limbs) {
+            size_t limbs = ctxA.limbs;
+            size_t bits = std::max(exponentA.GetBitLength(), exponentB.GetBitLength());
+            size_t expWords = (bits + BN_WORD_BITS - 1) / BN_WORD_BITS + 1;
+            const MontContext* ctx[2] = { &ctxA, &ctxB };
+            const BigNum* base[2] = { &baseA, &baseB };
+            const BigNum* exponent[2] = { &exponentA, &exponentB };
+            BigNum* result[2] = { pResultA, pResultB };
+
+            std::vector<BN_WORD> words(2 * (BN_MONT_MAX_WORDS + expWords));
+            std::vector<uint64_t> numbers(4 * BN_IFMA_MAX_LIMBS, 0);
+            BN_EXP52 operand[2];
+            for (int i = 0; i < 2; i++) {
+                size_t n = ctx[i]->m.size();
+                BN_WORD* value = &words[i * (BN_MONT_MAX_WORDS + expWords)];
+                BN_WORD* exp = value + BN_MONT_MAX_WORDS;
+                if (BigNum::Compare(*base[i], ctx[i]->modulus) >= 0) {
+                    BigNum::Mod(*base[i], ctx[i]->modulus).ToWords(value, n);
+                }
+                else {
+                    base[i]->ToWords(value, n);
+                }
+                exponent[i]->ToWords(exp, expWords);
+
+                uint64_t* baseLimbs = &numbers[2 * i * BN_IFMA_MAX_LIMBS];
+                BnToLimbs52(baseLimbs, limbs, value, n);
+                operand[i].r = baseLimbs + BN_IFMA_MAX_LIMBS;
+                operand[i].base = baseLimbs;
+                operand[i].exponent = exp;
+                operand[i].m = ctx[i]->m52.data();
+                operand[i].rr = ctx[i]->rr52.data();
+                operand[i].k0 = ctx[i]->m0 & 0xFFFFFFFFFFFFFULL;
+            }
+
+            BnModExp52x2Ifma(&operand[0], &operand[1], bits, limbs);
+
+            for (int i = 0; i < 2; i++) {
+                // The result may be equal to m, it's 0 then
+                size_t n = ctx[i]->m.size();
+                BN_WORD* value = &words[i * (BN_MONT_MAX_WORDS + expWords)];
+                BN_WORD reduced[BN_MONT_MAX_WORDS];
+                BnFromLimbs52(value, n, operand[i].r, limbs);
+                BN_WORD borrow = BnSubWords(reduced, value, ctx[i]->m.data(), n);
+                BN_WORD keep = 0 - borrow;
+                for (size_t j = 0; j < n; j++) {
+                    value[j] = (value[j] & keep) | (reduced[j] & ~keep);
+                }
+                *result[i] = BigNum::FromWords(value, n);
+                memset(reduced, 0, n * sizeof(BN_WORD));
+            }
+
+            memset(words.data(), 0, words.size() * sizeof(BN_WORD));
+            memset(numbers.data(), 0, numbers.size() * sizeof(uint64_t));
+            return;
+        }
+#endif
+        *pResultA = ctxA.ModExp(baseA, exponentA);
+        *pResultB = ctxB.ModExp(baseB, exponentB);
+    }
+    CATCH_EXCEPTION
+}
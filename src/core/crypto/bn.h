@@ -0,0 +1,327 @@
+#pragma once
+
+#include "../../stdafx.h"
+#include "../excep.h"
+#include "cpu.h"
+
+namespace core {
+
+    typedef uint64_t BN_WORD;
+
+    // Fills the buffer with random bytes of a DRBG
+    typedef void(*RANDOM_BYTES)(CK_BYTE_PTR pbData, CK_ULONG ulDataLen);
+
+#define BN_WORD_BITS            64
+#define BN_WORD_BYTES           8
+// Montgomery arithmetic is limited to moduli of 16384 bits
+#define BN_MONT_MAX_WORDS       256
+
+    // Word arrays are little-endian, the first word is the least significant one
+
+    // r = a + b, returns carry. Output may be the same buffer as input
+    BN_WORD BnAddWords(BN_WORD* r, const BN_WORD* a, const BN_WORD* b, size_t n);
+    // r = a - b, returns borrow. Output may be the same buffer as input
+    BN_WORD BnSubWords(BN_WORD* r, const BN_WORD* a, const BN_WORD* b, size_t n);
+    // r += a * w, returns carry
+    BN_WORD BnMulAddWord(BN_WORD* r, const BN_WORD* a, size_t n, BN_WORD w);
+
+    // Montgomery product a * b / 2^(64 * n) mod m of a, b < m. m0 is -m^-1 mod 2^64. Output may
+    // be the same buffer as input. Time doesn't depend on values
+    typedef void(*BN_MONT_MUL)(BN_WORD* r, const BN_WORD* a, const BN_WORD* b, const BN_WORD* m, BN_WORD m0, size_t n);
+
+    // Portable implementation
+    void BnMontMul(BN_WORD* r, const BN_WORD* a, const BN_WORD* b, const BN_WORD* m, BN_WORD m0, size_t n);
+
+#if defined(PV_X86) && (defined(__x86_64__) || defined(_M_X64))
+#define PV_BN_X64 1
+#endif
+
+// Numbers of IFMA exponentiation have up to 8 registers of 8 limbs of 52 bits
+#define BN_IFMA_MAX_LIMBS       64
+
+#ifdef PV_BN_X64
+#if defined(__GNUC__) || defined(__clang__)
+    // MULX with ADCX and ADOX, the product and the reduction of a row are two carry chains.
+    // n must be a multiple of 4. It's inline assembly, so it's built by GCC and Clang only
+    void BnMontMulMulx(BN_WORD* r, const BN_WORD* a, const BN_WORD* b, const BN_WORD* m, BN_WORD m0, size_t n);
+#endif
+
+    // Operand of BnModExp52x2Ifma. Numbers are arrays of BN_IFMA_MAX_LIMBS limbs of 52 bits,
+    // limbs above the count are zero
+    struct BN_EXP52 {
+        // base^exponent mod m, it's not greater than m
+        uint64_t*           r;
+        // Less than m
+        const uint64_t*     base;
+        // Words of the exponent, there are enough of them for bits of BnModExp52x2Ifma
+        const BN_WORD*      exponent;
+        const uint64_t*     m;
+        // 2^(2 * 52 * limbs) mod m
+        const uint64_t*     rr;
+        // -m^-1 mod 2^52
+        uint64_t            k0;
+    };
+
+    // Two fixed window exponentiations modulo numbers of the same limb count with AVX-512 IFMA.
+    // Almost Montgomery multiplications of both numbers are interleaved, so the scalar part of
+    // one hides latency of the other. 4m must be less than 2^(52 * limbs)
+    void BnModExp52x2Ifma(const BN_EXP52* a, const BN_EXP52* b, size_t bits, size_t limbs);
+#endif
+
+    /**
+     * Non-negative integer of any size. Arithmetic is not constant-time, it's used for public
+     * values and for one-time computations of key generation. Words are wiped on destruction
+     */
+    class BigNum {
+    public:
+        BigNum();
+
+        BigNum(
+            BN_WORD             value
+        );
+
+        BigNum(
+            const BigNum&       other
+        );
+
+        ~BigNum();
+
+        BigNum& operator=(
+            const BigNum&       other
+        );
+
+        /**
+         * Reads big-endian bytes
+         */
+        static BigNum FromBytes(
+            const CK_BYTE*      pbData,
+            size_t              len
+        );
+
+        /**
+         * Reads little-endian words
+         */
+        static BigNum FromWords(
+            const BN_WORD*      words,
+            size_t              count
+        );
+
+        /**
+         * Returns big-endian bytes without leading zeros, zero is one byte
+         */
+        Scoped<Buffer> ToBytes() const;
+
+        /**
+         * Writes big-endian bytes padded with zeros to len. Throws CKR_FUNCTION_FAILED if
+         * the number doesn't fit
+         */
+        void ToBytes(
+            CK_BYTE*            pbOut,
+            size_t              len
+        ) const;
+
+        /**
+         * Writes count little-endian words padded with zeros. Throws CKR_FUNCTION_FAILED if
+         * the number doesn't fit
+         */
+        void ToWords(
+            BN_WORD*            words,
+            size_t              count
+        ) const;
+
+        size_t GetBitLength() const;
+
+        size_t GetByteLength() const;
+
+        size_t GetWordCount() const;
+
+        const BN_WORD* GetWords() const;
+
+        bool IsZero() const;
+
+        bool IsOdd() const;
+
+        bool GetBit(
+            size_t              index
+        ) const;
+
+        /**
+         * Returns remainder of division by a word which is not zero
+         */
+        BN_WORD ModWord(
+            BN_WORD             w
+        ) const;
+
+        /**
+         * Returns quotient of division by a word which is not zero
+         */
+        BigNum DivWord(
+            BN_WORD             w,
+            BN_WORD*            pRemainder
+        ) const;
+
+        BigNum ShiftLeft(
+            size_t              bits
+        ) const;
+
+        BigNum ShiftRight(
+            size_t              bits
+        ) const;
+
+        /**
+         * Returns -1, 0 or 1
+         */
+        static int Compare(
+            const BigNum&       a,
+            const BigNum&       b
+        );
+
+        static BigNum Add(
+            const BigNum&       a,
+            const BigNum&       b
+        );
+
+        /**
+         * Throws CKR_FUNCTION_FAILED if b is greater than a
+         */
+        static BigNum Sub(
+            const BigNum&       a,
+            const BigNum&       b
+        );
+
+        static BigNum Mul(
+            const BigNum&       a,
+            const BigNum&       b
+        );
+
+        /**
+         * Quotient and remainder, either pointer may be NULL. Throws CKR_FUNCTION_FAILED if
+         * b is zero
+         */
+        static void DivMod(
+            const BigNum&       a,
+            const BigNum&       b,
+            BigNum*             pQuotient,
+            BigNum*             pRemainder
+        );
+
+        static BigNum Mod(
+            const BigNum&       a,
+            const BigNum&       m
+        );
+
+        static BigNum Gcd(
+            const BigNum&       a,
+            const BigNum&       b
+        );
+
+    protected:
+        std::vector<BN_WORD> words;
+
+        /**
+         * Removes leading zero words
+         */
+        void Normalize();
+    };
+
+    /**
+     * Montgomery arithmetic modulo an odd number. Numbers in Montgomery form are arrays of
+     * GetWordCount() words
+     */
+    class MontContext {
+    public:
+        /**
+         * Selects Montgomery multiplication for this CPU. Environment variable PV_PKCS11_BN
+         * limits it to scalar, mulx or ifma
+         */
+        static void Setup();
+
+        static const char* GetImplementationName();
+
+        /**
+         * Throws CKR_FUNCTION_FAILED if modulus is even or longer than BN_MONT_MAX_WORDS
+         */
+        MontContext(
+            const BigNum&       modulus
+        );
+
+        ~MontContext();
+
+        const BigNum& GetModulus() const;
+
+        size_t GetWordCount() const;
+
+        /**
+         * Montgomery form of 1
+         */
+        const BN_WORD* GetOne() const;
+
+        void Mul(
+            BN_WORD*            r,
+            const BN_WORD*      a,
+            const BN_WORD*      b
+        ) const;
+
+        /**
+         * Converts a number to Montgomery form, it's reduced first if it's not less than
+         * the modulus
+         */
+        void ToMont(
+            BN_WORD*            r,
+            const BigNum&       a
+        ) const;
+
+        BigNum FromMont(
+            const BN_WORD*      a
+        ) const;
+
+        /**
+         * base^exponent mod m. Exponentiation uses fixed windows and reads the table
+         * without secret-dependent addresses, its time depends on the bit length of
+         * exponent only
+         */
+        BigNum ModExp(
+            const BigNum&       base,
+            const BigNum&       exponent
+        ) const;
+
+        /**
+         * ModExp in Montgomery form, r may be the same buffer as base
+         */
+        void ModExpMont(
+            BN_WORD*            r,
+            const BN_WORD*      base,
+            const BigNum&       exponent
+        ) const;
+
+        /**
+         * ModExp of two contexts, e.g. the halves of RSA CRT. With AVX-512 IFMA both run at
+         * the same time if the moduli have the same limb count, time depends on the longer
+         * exponent then. Otherwise it's two calls of ModExp
+         */
+        static void ModExp2(
+            const MontContext&  ctxA,
+            const BigNum&       baseA,
+            const BigNum&       exponentA,
+            BigNum*             pResultA,
+            const MontContext&  ctxB,
+            const BigNum&       baseB,
+            const BigNum&       exponentB,
+            BigNum*             pResultB
+        );
+
+    protected:
+        BigNum                  modulus;
+        std::vector<BN_WORD>    m;
+        BN_WORD                 m0;
+        // R^2 and R mod m, R is 2^(64 * n)
+        std::vector<BN_WORD>    rr;
+        std::vector<BN_WORD>    one;
+        BN_MONT_MUL             mul;
+        // Limb count, modulus and R^2 mod m in radix 2^52 if IFMA is selected, limbs is 0 otherwise
+        size_t                  limbs;
+        std::vector<uint64_t>   m52;
+        std::vector<uint64_t>   rr52;
+    };
+
+}
@@ -0,0 +1,370 @@
+#include "bn.h"
+
+#ifdef PV_BN_X64
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace core;
+
+#define BN_MASK52   0xFFFFFFFFFFFFFULL
+
+// Repeats a statement for registers v < V of a number. Compilers don't always unroll loops over
+// arrays of registers, and the arrays stay in memory then
+#define BN_IFMA_AT(I, ...)  if (I < V) { const size_t v = I; __VA_ARGS__ }
+#define BN_IFMA_EACH(...)                                               \
+    do {                                                                \
+        BN_IFMA_AT(0, __VA_ARGS__) BN_IFMA_AT(1, __VA_ARGS__)           \
+        BN_IFMA_AT(2, __VA_ARGS__) BN_IFMA_AT(3, __VA_ARGS__)           \
+        BN_IFMA_AT(4, __VA_ARGS__) BN_IFMA_AT(5, __VA_ARGS__)           \
+        BN_IFMA_AT(6, __VA_ARGS__) BN_IFMA_AT(7, __VA_ARGS__)           \
+    } while (0)
+
+#if defined(__GNUC__) || defined(__clang__)
+
+// One word of a row: t[j] += lo + CF, t[j + 1] += hi + OF. t[j] is stored at offset S, CUR
+// holds t[j] and NEXT gets t[j + 1], so the registers swap on the next word
+#define MULX_STEP(J, S, CUR, NEXT)                                      \
+        "mulxq " #J "*8(%[a],%[j],8), %[lo], %[hi]\n\t"                 \
+        "movq " #J "*8+8(%[t],%[j],8), %[" NEXT "]\n\t"                 \
+        "adcxq %[lo], %[" CUR "]\n\t"                                   \
+        "movq %[" CUR "], " #J "*8+" #S "(%[t],%[j],8)\n\t"             \
+        "adoxq %[hi], %[" NEXT "]\n\t"
+
+// t[0..n + 1] += a * w, words are stored S bytes lower. The counter is in RCX, JRCXZ and LEA
+// don't change flags of the carry chains
+#define MULX_ROW(S)                                                     \
+        "movq (%[t]), %[cur]\n\t"                                       \
+        "xorl %k[lo], %k[lo]\n\t"                                       \
+        "1:\n\t"                                                        \
+        MULX_STEP(0, S, "cur", "next")                                  \
+        MULX_STEP(1, S, "next", "cur")                                  \
+        MULX_STEP(2, S, "cur", "next")                                  \
+        MULX_STEP(3, S, "next", "cur")                                  \
+        "leaq 4(%[j]), %[j]\n\t"                                        \
+        "leaq -4(%%rcx), %%rcx\n\t"                                     \
+        "jrcxz 2f\n\t"                                                  \
+        "jmp 1b\n\t"                                                    \
+        "2:\n\t"                                                        \
+        "movl $0, %k[lo]\n\t"                                           \
+        "adcxq %[lo], %[cur]\n\t"                                       \
+        "movq %[cur], " #S "(%[t],%[j],8)\n\t"                          \
+        "movq 8(%[t],%[j],8), %[hi]\n\t"                                \
+        "adcxq %[lo], %[hi]\n\t"                                        \
+        "adoxq %[lo], %[hi]\n\t"                                        \
+        "movq %[hi], 8+" #S "(%[t],%[j],8)\n\t"
+
+// t[0..n + 1] += a * w
+PV_TARGET("bmi2,adx")
+static inline void MulxRowMulAdd(BN_WORD* t, const BN_WORD* a, size_t n, BN_WORD w)
+{
+    BN_WORD cur, next, lo, hi, j = 0, count = n;
+    __asm__ __volatile__(
+        MULX_ROW(0)
+        : [cur] "=&r"(cur), [next] "=&r"(next), [lo] "=&r"(lo), [hi] "=&r"(hi), [j] "+r"(j), "+c"(count)
+        : [t] "r"(t), [a] "r"(a), "d"(w)
+        : "cc", "memory");
+}
+
+// t = (t + m * q) / 2^64, words are stored one word lower. t[-1] is scratch
+PV_TARGET("bmi2,adx")
+static inline void MulxRowReduce(BN_WORD* t, const BN_WORD* m, size_t n, BN_WORD q)
+{
+    BN_WORD cur, next, lo, hi, j = 0, count = n;
+    __asm__ __volatile__(
+        MULX_ROW(-8)
+        : [cur] "=&r"(cur), [next] "=&r"(next), [lo] "=&r"(lo), [hi] "=&r"(hi), [j] "+r"(j), "+c"(count)
+        : [t] "r"(t), [a] "r"(m), "d"(q)
+        : "cc", "memory");
+}
+
+PV_TARGET("bmi2,adx")
+void core::BnMontMulMulx(BN_WORD* r, const BN_WORD* a, const BN_WORD* b, const BN_WORD* m, BN_WORD m0, size_t n)
+{
+    // CIOS as BnMontMul, t keeps n + 2 words after a scratch word
+    BN_WORD buf[BN_MONT_MAX_WORDS + 3];
+    BN_WORD* t = buf + 1;
+    memset(buf, 0, (n + 3) * sizeof(BN_WORD));
+
+    for (size_t i = 0; i < n; i++) {
+        MulxRowMulAdd(t, a, n, b[i]);
+        MulxRowReduce(t, m, n, t[0] * m0);
+        t[n + 1] = 0;
+    }
+
+    // t < 2m, m is subtracted if t >= m
+    BN_WORD u[BN_MONT_MAX_WORDS];
+    BN_WORD borrow = BnSubWords(u, t, m, n);
+    BN_WORD keep = 0 - (borrow & (t[n] ^ 1));
+    for (size_t i = 0; i < n; i++) {
+        r[i] = (t[i] & keep) | (u[i] & ~keep);
+    }
+
+    memset(buf, 0, (n + 3) * sizeof(BN_WORD));
+    memset(u, 0, n * sizeof(BN_WORD));
+}
+
+#endif
+
+static inline uint64_t MulWords52(uint64_t a, uint64_t b, uint64_t* hi)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 res = (unsigned __int128)a * b;
+    *hi = (uint64_t)(res >> 64);
+    return (uint64_t)res;
+#else
+    return _umul128(a, b, hi);
+#endif
+}
+
+// Lanes hold up to 64 bits after the multiplication. The first pass moves bits above 52 to
+// the next lane, so a lane exceeds 2^52 - 1 by at most 2^12. The second pass adds the single
+// carries: lanes which are greater than the mask generate one, lanes equal to it propagate
+// one. Both are bit masks of all lanes, so carries are found by one scalar addition
+template <size_t V>
+PV_TARGET("avx512f,avx512ifma")
+static inline void Normalize52(__m512i* x)
+{
+    const __m512i mask = _mm512_set1_epi64(BN_MASK52);
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one = _mm512_set1_epi64(1);
+
+    __m512i hi[V];
+    BN_IFMA_EACH(
+        hi[v] = _mm512_srli_epi64(x[v], 52);
+        x[v] = _mm512_and_si512(x[v], mask);
+    );
+    x[0] = _mm512_add_epi64(x[0], _mm512_alignr_epi64(hi[0], zero, 7));
+    BN_IFMA_EACH(
+        if (v >= 1) {
+            x[v] = _mm512_add_epi64(x[v], _mm512_alignr_epi64(hi[v], hi[v - 1], 7));
+        }
+    );
+
+    uint64_t generate = 0;
+    uint64_t propagate = 0;
+    BN_IFMA_EACH(
+        generate |= (uint64_t)_mm512_cmpgt_epu64_mask(x[v], mask) << (8 * v);
+        propagate |= (uint64_t)_mm512_cmpeq_epu64_mask(x[v], mask) << (8 * v);
+    );
+    uint64_t carries = ((generate << 1) + propagate) ^ propagate;
+    BN_IFMA_EACH(
+        x[v] = _mm512_and_si512(_mm512_mask_add_epi64(x[v], (__mmask8)(carries >> (8 * v)), x[v], one), mask);
+    );
+}
+
+// Almost Montgomery multiplications rA = aA * bA / R mod mA and rB = aB * bB / R mod mB of
+// inputs below 2m, results are below 2m too. Each limb of b adds a * b_i + m * q to the
+// accumulator and shifts it by one lane. The lowest limb is kept by a scalar register, it
+// gives q of the next limb without a read of a vector lane. Outputs may be the same buffers
+// as inputs
+template <size_t V>
+PV_TARGET("avx512f,avx512ifma")
+static void Amm52x2(
+    uint64_t* rA, const uint64_t* aA, const uint64_t* bA, const uint64_t* mA, uint64_t kA,
+    uint64_t* rB, const uint64_t* aB, const uint64_t* bB, const uint64_t* mB, uint64_t kB,
+    size_t limbs)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i xA[V], nA[V], accA[V];
+    __m512i xB[V], nB[V], accB[V];
+    BN_IFMA_EACH(
+        xA[v] = _mm512_loadu_si512((const void*)(aA + 8 * v));
+        nA[v] = _mm512_loadu_si512((const void*)(mA + 8 * v));
+        accA[v] = zero;
+        xB[v] = _mm512_loadu_si512((const void*)(aB + 8 * v));
+        nB[v] = _mm512_loadu_si512((const void*)(mB + 8 * v));
+        accB[v] = zero;
+    );
+
+    uint64_t a0A = aA[0], m0A = mA[0], sA = 0;
+    uint64_t a0B = aB[0], m0B = mB[0], sB = 0;
+    for (size_t i = 0; i < limbs; i++) {
+        uint64_t biA = bA[i];
+        uint64_t biB = bB[i];
+
+        // s + a_0 * b_i + m_0 * q is divisible by 2^52, s gets its quotient
+        uint64_t hiA, hiB, hi2A, hi2B;
+        uint64_t loA = MulWords52(a0A, biA, &hiA);
+        uint64_t loB = MulWords52(a0B, biB, &hiB);
+        loA += sA;
+        hiA += loA < sA;
+        loB += sB;
+        hiB += loB < sB;
+        uint64_t qA = (loA * kA) & BN_MASK52;
+        uint64_t qB = (loB * kB) & BN_MASK52;
+        uint64_t lo2A = MulWords52(m0A, qA, &hi2A);
+        uint64_t lo2B = MulWords52(m0B, qB, &hi2B);
+        loA += lo2A;
+        hiA += hi2A + (loA < lo2A);
+        loB += lo2B;
+        hiB += hi2B + (loB < lo2B);
+        sA = (loA >> 52) | (hiA << 12);
+        sB = (loB >> 52) | (hiB << 12);
+
+        __m512i bvA = _mm512_set1_epi64(biA);
+        __m512i qvA = _mm512_set1_epi64(qA);
+        __m512i bvB = _mm512_set1_epi64(biB);
+        __m512i qvB = _mm512_set1_epi64(qB);
+        BN_IFMA_EACH(
+            accA[v] = _mm512_madd52lo_epu64(accA[v], xA[v], bvA);
+            accB[v] = _mm512_madd52lo_epu64(accB[v], xB[v], bvB);
+            accA[v] = _mm512_madd52lo_epu64(accA[v], nA[v], qvA);
+            accB[v] = _mm512_madd52lo_epu64(accB[v], nB[v], qvB);
+        );
+
+        // Lane 0 is in s already
+        BN_IFMA_EACH(
+            if (v + 1 < V) {
+                accA[v] = _mm512_alignr_epi64(accA[v + 1], accA[v], 1);
+                accB[v] = _mm512_alignr_epi64(accB[v + 1], accB[v], 1);
+            }
+        );
+        accA[V - 1] = _mm512_alignr_epi64(zero, accA[V - 1], 1);
+        accB[V - 1] = _mm512_alignr_epi64(zero, accB[V - 1], 1);
+        sA += (uint64_t)_mm_cvtsi128_si64(_mm512_castsi512_si128(accA[0]));
+        sB += (uint64_t)_mm_cvtsi128_si64(_mm512_castsi512_si128(accB[0]));
+
+        // High halves go one lane up, that is the lane of the low half after the shift
+        BN_IFMA_EACH(
+            accA[v] = _mm512_madd52hi_epu64(accA[v], xA[v], bvA);
+            accB[v] = _mm512_madd52hi_epu64(accB[v], xB[v], bvB);
+            accA[v] = _mm512_madd52hi_epu64(accA[v], nA[v], qvA);
+            accB[v] = _mm512_madd52hi_epu64(accB[v], nB[v], qvB);
+        );
+    }
+
+    accA[0] = _mm512_mask_set1_epi64(accA[0], 1, (long long)sA);
+    accB[0] = _mm512_mask_set1_epi64(accB[0], 1, (long long)sB);
+    Normalize52<V>(accA);
+    Normalize52<V>(accB);
+    BN_IFMA_EACH(
+        _mm512_storeu_si512((void*)(rA + 8 * v), accA[v]);
+        _mm512_storeu_si512((void*)(rB + 8 * v), accB[v]);
+    );
+}
+
+// Every entry is read, the one of index is kept by mask
+template <size_t V>
+PV_TARGET("avx512f,avx512ifma")
+static inline void Select52(uint64_t* r, const uint64_t* table, size_t count, size_t index)
+{
+    const __m512i target = _mm512_set1_epi64((long long)index);
+    __m512i res[V];
+    BN_IFMA_EACH(
+        res[v] = _mm512_setzero_si512();
+    );
+    for (size_t i = 0; i < count; i++) {
+        __mmask8 keep = _mm512_cmpeq_epi64_mask(_mm512_set1_epi64((long long)i), target);
+        BN_IFMA_EACH(
+            res[v] = _mm512_mask_mov_epi64(res[v], keep, _mm512_loadu_si512((const void*)(table + i * 8 * V + 8 * v)));
+        );
+    }
+    BN_IFMA_EACH(
+        _mm512_storeu_si512((void*)(r + 8 * v), res[v]);
+    );
+}
+
+static inline size_t GetWindow52(const BN_WORD* exponent, size_t bit)
+{
+    size_t index = 0;
+    for (size_t k = 5; k > 0; k--) {
+        size_t pos = bit + k - 1;
+        index = (index << 1) | (size_t)((exponent[pos / BN_WORD_BITS] >> (pos % BN_WORD_BITS)) & 1);
+    }
+    return index;
+}
+
+#define BN_IFMA_WINDOW          5
+#define BN_IFMA_TABLE_SIZE      (1 << BN_IFMA_WINDOW)
+
+template <size_t V>
+PV_TARGET("avx512f,avx512ifma")
+static void ModExp52x2(const BN_EXP52* a, const BN_EXP52* b, size_t bits, size_t limbs)
+{
+    const size_t N = 8 * V;
+    // Tables of both numbers, then the accumulators and selected entries
+    std::vector<uint64_t> buf((2 * BN_IFMA_TABLE_SIZE + 4) * N, 0);
+    uint64_t* tableA = &buf[0];
+    uint64_t* tableB = &buf[BN_IFMA_TABLE_SIZE * N];
+    uint64_t* accA = &buf[2 * BN_IFMA_TABLE_SIZE * N];
+    uint64_t* accB = accA + N;
+    uint64_t* entryA = accB + N;
+    uint64_t* entryB = entryA + N;
+    uint64_t unit[BN_IFMA_MAX_LIMBS];
+    memset(unit, 0, sizeof(unit));
+    unit[0] = 1;
+
+#define AMM(rA, xA, yA, rB, xB, yB) \
+    Amm52x2<V>(rA, xA, yA, a->m, a->k0, rB, xB, yB, b->m, b->k0, limbs)
+
+    // table[i] = base^i * R
+    AMM(tableA, a->rr, unit, tableB, b->rr, unit);
+    AMM(tableA + N, a->base, a->rr, tableB + N, b->base, b->rr);
+    for (size_t i = 2; i < BN_IFMA_TABLE_SIZE; i++) {
+        AMM(tableA + i * N, tableA + (i - 1) * N, tableA + N, tableB + i * N, tableB + (i - 1) * N, tableB + N);
+    }
+
+    size_t windows = (bits + BN_IFMA_WINDOW - 1) / BN_IFMA_WINDOW;
+    if (!windows) {
+        memcpy(accA, tableA, N * sizeof(uint64_t));
+        memcpy(accB, tableB, N * sizeof(uint64_t));
+    }
+    else {
+        Select52<V>(accA, tableA, BN_IFMA_TABLE_SIZE, GetWindow52(a->exponent, (windows - 1) * BN_IFMA_WINDOW));
+        Select52<V>(accB, tableB, BN_IFMA_TABLE_SIZE, GetWindow52(b->exponent, (windows - 1) * BN_IFMA_WINDOW));
+    }
+    for (size_t w = windows ? windows - 1 : 0; w > 0; w--) {
+        for (size_t k = 0; k < BN_IFMA_WINDOW; k++) {
+            AMM(accA, accA, accA, accB, accB, accB);
+        }
+        Select52<V>(entryA, tableA, BN_IFMA_TABLE_SIZE, GetWindow52(a->exponent, (w - 1) * BN_IFMA_WINDOW));
+        Select52<V>(entryB, tableB, BN_IFMA_TABLE_SIZE, GetWindow52(b->exponent, (w - 1) * BN_IFMA_WINDOW));
+        AMM(accA, accA, entryA, accB, accB, entryB);
+    }
+
+    // Multiplication by 1 leaves Montgomery form, the result is not greater than m
+    AMM(accA, accA, unit, accB, accB, unit);
+#undef AMM
+
+    memcpy(a->r, accA, N * sizeof(uint64_t));
+    memcpy(b->r, accB, N * sizeof(uint64_t));
+    memset(buf.data(), 0, buf.size() * sizeof(uint64_t));
+}
+
+void core::BnModExp52x2Ifma(const BN_EXP52* a, const BN_EXP52* b, size_t bits, size_t limbs)
+{
+    switch ((limbs + 7) / 8) {
+    case 1:
+        ModExp52x2<1>(a, b, bits, limbs);
+        break;
+    case 2:
+        ModExp52x2<2>(a, b, bits, limbs);
+        break;
+    case 3:
+        ModExp52x2<3>(a, b, bits, limbs);
+        break;
+    case 4:
+        ModExp52x2<4>(a, b, bits, limbs);
+        break;
+    case 5:
+        ModExp52x2<5>(a, b, bits, limbs);
+        break;
+    case 6:
+        ModExp52x2<6>(a, b, bits, limbs);
+        break;
+    case 7:
+        ModExp52x2<7>(a, b, bits, limbs);
+        break;
+    case 8:
+        ModExp52x2<8>(a, b, bits, limbs);
+        break;
+    default:
+        THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "Number is too long for IFMA");
+    }
+}
+
+#endif
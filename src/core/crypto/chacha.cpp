@@ -0,0 +1,436 @@
+#include "chacha.h"
+
+using namespace core;
+
+// RFC 8439 limits data to 2^32 - 1 blocks, the first block of the key stream is Poly1305 key
+#define CHACHA20_POLY1305_MAX_DATA_LENGTH   (((1ULL << 32) - 1) * CHACHA20_BLOCK_LENGTH)
+// Blocks of key stream after which ciphertext is hashed, it is still in L1 cache
+#define CHACHA20_POLY1305_CHUNK_BLOCKS      64
+
+#define POLY1305_MASK26     0x3ffffff
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static inline uint32_t LoadLE32(const CK_BYTE* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void StoreLE32(CK_BYTE* p, uint32_t v)
+{
+    p[0] = (CK_BYTE)v;
+    p[1] = (CK_BYTE)(v >> 8);
+    p[2] = (CK_BYTE)(v >> 16);
+    p[3] = (CK_BYTE)(v >> 24);
+}
+
+#define CHACHA_QR(a, b, c, d)                                           \
+    a += b; d ^= a; d = ROL32(d, 16);                                   \
+    c += d; b ^= c; b = ROL32(b, 12);                                   \
+    a += b; d ^= a; d = ROL32(d, 8);                                    \
+    c += d; b ^= c; b = ROL32(b, 7)
+
+void core::ChaCha20Blocks(const uint32_t* state, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    uint32_t x[16];
+    uint32_t counter = state[12];
+    for (; blocks; blocks--, pbIn += CHACHA20_BLOCK_LENGTH, pbOut += CHACHA20_BLOCK_LENGTH, counter++) {
+        memcpy(x, state, sizeof(x));
+        x[12] = counter;
+        for (int i = 0; i < 10; i++) {
+            CHACHA_QR(x[0], x[4], x[8], x[12]);
+            CHACHA_QR(x[1], x[5], x[9], x[13]);
+            CHACHA_QR(x[2], x[6], x[10], x[14]);
+            CHACHA_QR(x[3], x[7], x[11], x[15]);
+            CHACHA_QR(x[0], x[5], x[10], x[15]);
+            CHACHA_QR(x[1], x[6], x[11], x[12]);
+            CHACHA_QR(x[2], x[7], x[8], x[13]);
+            CHACHA_QR(x[3], x[4], x[9], x[14]);
+        }
+        for (int i = 0; i < 16; i++) {
+            uint32_t k = x[i] + (i == 12 ? counter : state[i]);
+            StoreLE32(pbOut + i * 4, LoadLE32(pbIn + i * 4) ^ k);
+        }
+    }
+    memset(x, 0, sizeof(x));
+}
+
+// h = h * r modulo 2^130 - 5. Limbs of the result are below 2^26 except h[1], which is
+// below 2^27
+static void Poly1305Multiply(uint32_t* h, const uint32_t* r)
+{
+    uint64_t s1 = r[1] * 5ULL;
+    uint64_t s2 = r[2] * 5ULL;
+    uint64_t s3 = r[3] * 5ULL;
+    uint64_t s4 = r[4] * 5ULL;
+
+    uint64_t d0 = (uint64_t)h[0] * r[0] + h[1] * s4 + h[2] * s3 + h[3] * s2 + h[4] * s1;
+    uint64_t d1 = (uint64_t)h[0] * r[1] + (uint64_t)h[1] * r[0] + h[2] * s4 + h[3] * s3 + h[4] * s2;
+    uint64_t d2 = (uint64_t)h[0] * r[2] + (uint64_t)h[1] * r[1] + (uint64_t)h[2] * r[0] + h[3] * s4 + h[4] * s3;
+    uint64_t d3 = (uint64_t)h[0] * r[3] + (uint64_t)h[1] * r[2] + (uint64_t)h[2] * r[1] + (uint64_t)h[3] * r[0] + h[4] * s4;
+    uint64_t d4 = (uint64_t)h[0] * r[4] + (uint64_t)h[1] * r[3] + (uint64_t)h[2] * r[2] + (uint64_t)h[3] * r[1] + (uint64_t)h[4] * r[0];
+
+    d1 += d0 >> 26;
+    d2 += d1 >> 26;
+    d3 += d2 >> 26;
+    d4 += d3 >> 26;
+    d0 = (d0 & POLY1305_MASK26) + (d4 >> 26) * 5;
+    h[0] = (uint32_t)d0 & POLY1305_MASK26;
+    h[1] = ((uint32_t)d1 & POLY1305_MASK26) + (uint32_t)(d0 >> 26);
+    h[2] = (uint32_t)d2 & POLY1305_MASK26;
+    h[3] = (uint32_t)d3 & POLY1305_MASK26;
+    h[4] = (uint32_t)d4 & POLY1305_MASK26;
+}
+
+void core::Poly1305Blocks(POLY1305_STATE* state, const CK_BYTE* pbData, size_t blocks)
+{
+    uint32_t* h = state->h;
+    for (; blocks; blocks--, pbData += POLY1305_BLOCK_LENGTH) {
+        h[0] += LoadLE32(pbData) & POLY1305_MASK26;
+        h[1] += (LoadLE32(pbData + 3) >> 2) & POLY1305_MASK26;
+        h[2] += (LoadLE32(pbData + 6) >> 4) & POLY1305_MASK26;
+        h[3] += (LoadLE32(pbData + 9) >> 6) & POLY1305_MASK26;
+        h[4] += (LoadLE32(pbData + 12) >> 8) | (1 << 24);
+        Poly1305Multiply(h, state->r[0]);
+    }
+}
+
+static void Poly1305Init(POLY1305_STATE* state, const CK_BYTE* pbKey)
+{
+    // r is clamped as RFC 8439 requires
+    uint32_t* r = state->r[0];
+    r[0] = LoadLE32(pbKey) & 0x3ffffff;
+    r[1] = (LoadLE32(pbKey + 3) >> 2) & 0x3ffff03;
+    r[2] = (LoadLE32(pbKey + 6) >> 4) & 0x3ffc0ff;
+    r[3] = (LoadLE32(pbKey + 9) >> 6) & 0x3f03fff;
+    r[4] = (LoadLE32(pbKey + 12) >> 8) & 0x00fffff;
+    for (int i = 1; i < 4; i++) {
+        memcpy(state->r[i], state->r[i - 1], sizeof(state->r[i]));
+        Poly1305Multiply(state->r[i], r);
+    }
+    for (int i = 0; i < 4; i++) {
+        state->s[i] = LoadLE32(pbKey + 16 + i * 4);
+    }
+    memset(state->h, 0, sizeof(state->h));
+}
+
+// tag = (h mod 2^130 - 5) + s mod 2^128
+static void Poly1305Finish(POLY1305_STATE* state, CK_BYTE* pbTag)
+{
+    uint32_t h0 = state->h[0];
+    uint32_t h1 = state->h[1];
+    uint32_t h2 = state->h[2];
+    uint32_t h3 = state->h[3];
+    uint32_t h4 = state->h[4];
+
+    uint32_t c = h1 >> 26; h1 &= POLY1305_MASK26;
+    h2 += c; c = h2 >> 26; h2 &= POLY1305_MASK26;
+    h3 += c; c = h3 >> 26; h3 &= POLY1305_MASK26;
+    h4 += c; c = h4 >> 26; h4 &= POLY1305_MASK26;
+    h0 += c * 5; c = h0 >> 26; h0 &= POLY1305_MASK26;
+    h1 += c;
+
+    // g = h + 5 - 2^130, it replaces h without branches if it is not negative
+    uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= POLY1305_MASK26;
+    uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= POLY1305_MASK26;
+    uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= POLY1305_MASK26;
+    uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= POLY1305_MASK26;
+    uint32_t g4 = h4 + c - (1 << 26);
+
+    uint32_t mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+
+    uint64_t f = (uint64_t)(h0 | (h1 << 26)) + state->s[0];
+    StoreLE32(pbTag, (uint32_t)f);
+    f = (uint64_t)((h1 >> 6) | (h2 << 20)) + state->s[1] + (f >> 32);
+    StoreLE32(pbTag + 4, (uint32_t)f);
+    f = (uint64_t)((h2 >> 12) | (h3 << 14)) + state->s[2] + (f >> 32);
+    StoreLE32(pbTag + 8, (uint32_t)f);
+    f = (uint64_t)((h3 >> 18) | (h4 << 8)) + state->s[3] + (f >> 32);
+    StoreLE32(pbTag + 12, (uint32_t)f);
+}
+
+// Implementations in use
+static CHACHA20_BLOCKS chacha20Blocks = core::ChaCha20Blocks;
+static POLY1305_BLOCKS poly1305Blocks = core::Poly1305Blocks;
+static const char*     chachaName = "scalar";
+
+void ChaCha20Poly1305::Setup()
+{
+    const char* limit = getenv("PV_PKCS11_CHACHA");
+    bool allowSsse3 = !limit || !strcmp(limit, "ssse3") || !strcmp(limit, "avx2") || !strcmp(limit, "avx512");
+    bool allowAvx2 = !limit || !strcmp(limit, "avx2") || !strcmp(limit, "avx512");
+    bool allowAvx512 = !limit || !strcmp(limit, "avx512");
+
+    chacha20Blocks = core::ChaCha20Blocks;
+    poly1305Blocks = core::Poly1305Blocks;
+    chachaName = "scalar";
+
+#ifdef PV_X86
+    const CPU_FEATURES& cpu = GetCpuFeatures();
+    if (allowSsse3 && cpu.ssse3) {
+        chacha20Blocks = core::ChaCha20BlocksSsse3;
+        chachaName = "ssse3";
+
+        // Wide kernels hand incomplete groups to narrower ones
+        if (allowAvx2 && cpu.avx2) {
+            chacha20Blocks = core::ChaCha20BlocksAvx2;
+            poly1305Blocks = core::Poly1305BlocksAvx2;
+            chachaName = "avx2";
+
+            if (allowAvx512 && cpu.avx512f) {
+                chacha20Blocks = core::ChaCha20BlocksAvx512;
+                chachaName = "avx512";
+            }
+        }
+    }
+#endif
+}
+
+const char* ChaCha20Poly1305::GetImplementationName()
+{
+    return chachaName;
+}
+
+ChaCha20Poly1305::ChaCha20Poly1305() :
+    bufferLen(0),
+    keyStreamLen(0),
+    aadLen(0),
+    dataLen(0),
+    initialized(false),
+    data(false)
+{
+}
+
+ChaCha20Poly1305::~ChaCha20Poly1305()
+{
+    memset(state, 0, sizeof(state));
+    memset(&poly, 0, sizeof(poly));
+    memset(keyStream, 0, sizeof(keyStream));
+    memset(buffer, 0, sizeof(buffer));
+}
+
+void ChaCha20Poly1305::Init(
+    const CK_BYTE*      pbKey,
+    const CK_BYTE*      pbNonce,
+    size_t              nonceLen
+)
+{
+    try {
+        if (nonceLen != 12 && nonceLen != 8) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "ChaCha20 nonce must be 8 or 12 bytes");
+        }
+
+        // "expand 32-byte k"
+        state[0] = 0x61707865;
+        state[1] = 0x3320646e;
+        state[2] = 0x79622d32;
+        state[3] = 0x6b206574;
+        for (int i = 0; i < 8; i++) {
+            state[4 + i] = LoadLE32(pbKey + i * 4);
+        }
+        state[12] = 0;
+        state[13] = 0;
+        for (size_t i = 0; i < nonceLen / 4; i++) {
+            state[16 - nonceLen / 4 + i] = LoadLE32(pbNonce + i * 4);
+        }
+
+        // Poly1305 key is the beginning of block 0, data starts from block 1
+        CK_BYTE block[CHACHA20_BLOCK_LENGTH] = { 0 };
+        chacha20Blocks(state, block, block, 1);
+        Poly1305Init(&poly, block);
+        memset(block, 0, sizeof(block));
+        state[12] = 1;
+
+        bufferLen = 0;
+        keyStreamLen = 0;
+        aadLen = 0;
+        dataLen = 0;
+        data = false;
+        initialized = true;
+    }
+    CATCH_EXCEPTION
+}
+
+void ChaCha20Poly1305::Mac(
+    const CK_BYTE*      pbData,
+    size_t              len
+)
+{
+    if (bufferLen) {
+        size_t n = POLY1305_BLOCK_LENGTH - bufferLen;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(buffer + bufferLen, pbData, n);
+        bufferLen += n;
+        pbData += n;
+        len -= n;
+        if (bufferLen < POLY1305_BLOCK_LENGTH) {
+            return;
+        }
+        poly1305Blocks(&poly, buffer, 1);
+        bufferLen = 0;
+    }
+
+    size_t blocks = len / POLY1305_BLOCK_LENGTH;
+    poly1305Blocks(&poly, pbData, blocks);
+    pbData += blocks * POLY1305_BLOCK_LENGTH;
+    len -= blocks * POLY1305_BLOCK_LENGTH;
+
+    memcpy(buffer, pbData, len);
+    bufferLen = len;
+}
+
+void ChaCha20Poly1305::HashBuffer()
+{
+    if (bufferLen) {
+        memset(buffer + bufferLen, 0, POLY1305_BLOCK_LENGTH - bufferLen);
+        poly1305Blocks(&poly, buffer, 1);
+        bufferLen = 0;
+    }
+}
+
+void ChaCha20Poly1305::Aad(
+    const CK_BYTE*      pbData,
+    size_t              len
+)
+{
+    try {
+        if (!initialized) {
+            THROW_EXCEPTION("ChaCha20-Poly1305 is not initialized");
+        }
+        if (data) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+        aadLen += len;
+        Mac(pbData, len);
+    }
+    CATCH_EXCEPTION
+}
+
+void ChaCha20Poly1305::Encrypt(
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              len
+)
+{
+    Crypt(pbIn, pbOut, len, false);
+}
+
+void ChaCha20Poly1305::Decrypt(
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              len
+)
+{
+    Crypt(pbIn, pbOut, len, true);
+}
+
+void ChaCha20Poly1305::Crypt(
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              len,
+    bool                decrypt
+)
+{
+    try {
+        if (!initialized) {
+            THROW_EXCEPTION("ChaCha20-Poly1305 is not initialized");
+        }
+        if (len > CHACHA20_POLY1305_MAX_DATA_LENGTH - dataLen) {
+            THROW_PKCS11_EXCEPTION(CKR_DATA_LEN_RANGE, "ChaCha20-Poly1305 message is too long");
+        }
+        if (!data) {
+            // Associated data ends with the first part of data
+            HashBuffer();
+            data = true;
+        }
+        dataLen += len;
+
+        // Ciphertext is hashed before output overwrites it, so data can be decrypted in place
+        if (keyStreamLen) {
+            size_t n = len < keyStreamLen ? len : keyStreamLen;
+            if (decrypt) {
+                Mac(pbIn, n);
+            }
+            const CK_BYTE* ks = keyStream + CHACHA20_BLOCK_LENGTH - keyStreamLen;
+            for (size_t i = 0; i < n; i++) {
+                pbOut[i] = pbIn[i] ^ ks[i];
+            }
+            if (!decrypt) {
+                Mac(pbOut, n);
+            }
+            keyStreamLen -= n;
+            pbIn += n;
+            pbOut += n;
+            len -= n;
+        }
+
+        size_t blocks = len / CHACHA20_BLOCK_LENGTH;
+        while (blocks) {
+            size_t n = blocks < CHACHA20_POLY1305_CHUNK_BLOCKS ? blocks : CHACHA20_POLY1305_CHUNK_BLOCKS;
+            size_t bytes = n * CHACHA20_BLOCK_LENGTH;
+            if (decrypt) {
+                Mac(pbIn, bytes);
+            }
+            chacha20Blocks(state, pbIn, pbOut, n);
+            state[12] += (uint32_t)n;
+            if (!decrypt) {
+                Mac(pbOut, bytes);
+            }
+            blocks -= n;
+            pbIn += bytes;
+            pbOut += bytes;
+            len -= bytes;
+        }
+
+        if (len) {
+            memset(keyStream, 0, sizeof(keyStream));
+            chacha20Blocks(state, keyStream, keyStream, 1);
+            state[12]++;
+            if (decrypt) {
+                Mac(pbIn, len);
+            }
+            for (size_t i = 0; i < len; i++) {
+                pbOut[i] = pbIn[i] ^ keyStream[i];
+            }
+            if (!decrypt) {
+                Mac(pbOut, len);
+            }
+            keyStreamLen = CHACHA20_BLOCK_LENGTH - len;
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void ChaCha20Poly1305::Final(
+    CK_BYTE*            pbTag
+)
+{
+    try {
+        if (!initialized) {
+            THROW_EXCEPTION("ChaCha20-Poly1305 is not initialized");
+        }
+
+        HashBuffer();
+        CK_BYTE lengths[POLY1305_BLOCK_LENGTH];
+        StoreLE32(lengths, (uint32_t)aadLen);
+        StoreLE32(lengths + 4, (uint32_t)(aadLen >> 32));
+        StoreLE32(lengths + 8, (uint32_t)dataLen);
+        StoreLE32(lengths + 12, (uint32_t)(dataLen >> 32));
+        poly1305Blocks(&poly, lengths, 1);
+        Poly1305Finish(&poly, pbTag);
+
+        memset(state, 0, sizeof(state));
+        memset(&poly, 0, sizeof(poly));
+        memset(keyStream, 0, sizeof(keyStream));
+        keyStreamLen = 0;
+        initialized = false;
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "../../stdafx.h"
+#include "../excep.h"
+#include "cpu.h"
+
+namespace core {
+
+#define CHACHA20_KEY_LENGTH         32
+#define CHACHA20_BLOCK_LENGTH       64
+#define POLY1305_BLOCK_LENGTH       16
+#define POLY1305_TAG_LENGTH         16
+
+    // State is 16 words of RFC 8439: constants, key, block counter and nonce. Data is XORed
+    // with the key stream of blocks which start from the counter in state[12], the counter
+    // wraps modulo 2^32. Output may be the same buffer as input
+    typedef void(*CHACHA20_BLOCKS)(const uint32_t* state, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+
+    /**
+     * Poly1305 accumulator and key with 26-bit limbs
+     */
+    struct POLY1305_STATE {
+        uint32_t            h[5];
+        // r, r^2, r^3 and r^4, vector kernels hash several blocks with one power
+        uint32_t            r[4][5];
+        uint32_t            s[4];
+    };
+
+    // Hashes complete 16-byte blocks
+    typedef void(*POLY1305_BLOCKS)(POLY1305_STATE* state, const CK_BYTE* pbData, size_t blocks);
+
+    // Portable implementations
+    void ChaCha20Blocks(const uint32_t* state, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void Poly1305Blocks(POLY1305_STATE* state, const CK_BYTE* pbData, size_t blocks);
+
+#ifdef PV_X86
+    // Word i of 4, 8 or 16 blocks is kept in one register. Incomplete groups are handed
+    // to the narrower kernel
+    void ChaCha20BlocksSsse3(const uint32_t* state, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void ChaCha20BlocksAvx2(const uint32_t* state, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void ChaCha20BlocksAvx512(const uint32_t* state, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    // AVX2, 4 independent accumulators are multiplied by r^4 and combined at the end
+    void Poly1305BlocksAvx2(POLY1305_STATE* state, const CK_BYTE* pbData, size_t blocks);
+#endif
+
+    /**
+     * ChaCha20-Poly1305 of one message (RFC 8439). Associated data goes before data, both
+     * can be split into parts of any length
+     */
+    class ChaCha20Poly1305 {
+    public:
+        /**
+         * Selects the fastest implementations supported by CPU. The choice can be
+         * limited by PV_PKCS11_CHACHA environment variable (scalar, ssse3, avx2 or avx512)
+         */
+        static void Setup();
+
+        /**
+         * Returns name of implementation in use
+         */
+        static const char* GetImplementationName();
+
+        ChaCha20Poly1305();
+        ~ChaCha20Poly1305();
+
+        /**
+         * Starts a message with 32-byte key. Nonce is 12 bytes, or 8 bytes which are
+         * preceded by zeros. Throws CKR_MECHANISM_PARAM_INVALID for other nonces
+         */
+        void Init(
+            const CK_BYTE*      pbKey,
+            const CK_BYTE*      pbNonce,
+            size_t              nonceLen
+        );
+
+        /**
+         * Adds associated data. Throws CKR_OPERATION_ACTIVE after data was processed
+         */
+        void Aad(
+            const CK_BYTE*      pbData,
+            size_t              len
+        );
+
+        /**
+         * Output may be the same buffer as input. Throws CKR_DATA_LEN_RANGE if the message
+         * needs more than 2^32 - 1 blocks
+         */
+        void Encrypt(
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              len
+        );
+
+        void Decrypt(
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              len
+        );
+
+        /**
+         * Writes the 16-byte tag
+         */
+        void Final(
+            CK_BYTE*            pbTag
+        );
+
+    protected:
+        uint32_t            state[16];
+        POLY1305_STATE      poly;
+        // Incomplete block of associated data or ciphertext
+        CK_BYTE             buffer[POLY1305_BLOCK_LENGTH];
+        size_t              bufferLen;
+        // Unused bytes of the last key stream block
+        CK_BYTE             keyStream[CHACHA20_BLOCK_LENGTH];
+        size_t              keyStreamLen;
+        uint64_t            aadLen;
+        uint64_t            dataLen;
+        bool                initialized;
+        bool                data;
+
+        void Crypt(
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              len,
+            bool                decrypt
+        );
+
+        /**
+         * Adds bytes to Poly1305, an incomplete block is kept in buffer
+         */
+        void Mac(
+            const CK_BYTE*      pbData,
+            size_t              len
+        );
+
+        /**
+         * Hashes the incomplete block padded with zeros
+         */
+        void HashBuffer();
+    };
+
+}
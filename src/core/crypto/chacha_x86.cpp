@@ -0,0 +1,305 @@
+#include "chacha.h"
+
+#ifdef PV_X86
+
+#include <immintrin.h>
+
+using namespace core;
+
+// Quarter rounds over registers which hold the same word of several blocks
+#define CHACHA_QR(a, b, c, d, ADD, XOR, ROL16, ROL12, ROL8, ROL7)       \
+    a = ADD(a, b); d = ROL16(XOR(d, a));                                \
+    c = ADD(c, d); b = ROL12(XOR(b, c));                                \
+    a = ADD(a, b); d = ROL8(XOR(d, a));                                 \
+    c = ADD(c, d); b = ROL7(XOR(b, c))
+
+#define CHACHA_DOUBLE_ROUND(x, ADD, XOR, ROL16, ROL12, ROL8, ROL7)      \
+    CHACHA_QR(x[0], x[4], x[8], x[12], ADD, XOR, ROL16, ROL12, ROL8, ROL7);  \
+    CHACHA_QR(x[1], x[5], x[9], x[13], ADD, XOR, ROL16, ROL12, ROL8, ROL7);  \
+    CHACHA_QR(x[2], x[6], x[10], x[14], ADD, XOR, ROL16, ROL12, ROL8, ROL7); \
+    CHACHA_QR(x[3], x[7], x[11], x[15], ADD, XOR, ROL16, ROL12, ROL8, ROL7); \
+    CHACHA_QR(x[0], x[5], x[10], x[15], ADD, XOR, ROL16, ROL12, ROL8, ROL7); \
+    CHACHA_QR(x[1], x[6], x[11], x[12], ADD, XOR, ROL16, ROL12, ROL8, ROL7); \
+    CHACHA_QR(x[2], x[7], x[8], x[13], ADD, XOR, ROL16, ROL12, ROL8, ROL7);  \
+    CHACHA_QR(x[3], x[4], x[9], x[14], ADD, XOR, ROL16, ROL12, ROL8, ROL7)
+
+// Transposes 4x4 words in each 128-bit lane, then register i holds words of block i
+#define CHACHA_TRANSPOSE4(a, b, c, d, T, LO32, HI32, LO64, HI64) {      \
+    T t0 = LO32(a, b);                                                  \
+    T t1 = LO32(c, d);                                                  \
+    T t2 = HI32(a, b);                                                  \
+    T t3 = HI32(c, d);                                                  \
+    a = LO64(t0, t1);                                                   \
+    b = HI64(t0, t1);                                                   \
+    c = LO64(t2, t3);                                                   \
+    d = HI64(t2, t3);                                                   \
+}
+
+// Rotations by 16 and 8 bits move bytes, rot16 and rot8 are locals of the kernel
+#define CHACHA_ROT16_MASK() _mm_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2)
+#define CHACHA_ROT8_MASK() _mm_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3)
+
+#define SSE_ROL(x, n) _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - (n)))
+#define SSE_ROL16(x) _mm_shuffle_epi8(x, rot16)
+#define SSE_ROL12(x) SSE_ROL(x, 12)
+#define SSE_ROL8(x) _mm_shuffle_epi8(x, rot8)
+#define SSE_ROL7(x) SSE_ROL(x, 7)
+
+#define AVX2_ROL(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define AVX2_ROL16(x) _mm256_shuffle_epi8(x, rot16)
+#define AVX2_ROL12(x) AVX2_ROL(x, 12)
+#define AVX2_ROL8(x) _mm256_shuffle_epi8(x, rot8)
+#define AVX2_ROL7(x) AVX2_ROL(x, 7)
+
+#define AVX512_ROL16(x) _mm512_rol_epi32(x, 16)
+#define AVX512_ROL12(x) _mm512_rol_epi32(x, 12)
+#define AVX512_ROL8(x) _mm512_rol_epi32(x, 8)
+#define AVX512_ROL7(x) _mm512_rol_epi32(x, 7)
+
+// Hands the rest of blocks to the narrower kernel with the advanced counter
+static void ChaCha20Rest(CHACHA20_BLOCKS kernel, const uint32_t* state, uint32_t counter, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    if (blocks) {
+        uint32_t rest[16];
+        memcpy(rest, state, sizeof(rest));
+        rest[12] = counter;
+        kernel(rest, pbIn, pbOut, blocks);
+        memset(rest, 0, sizeof(rest));
+    }
+}
+
+PV_TARGET("ssse3")
+void core::ChaCha20BlocksSsse3(const uint32_t* state, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    const __m128i rot16 = CHACHA_ROT16_MASK();
+    const __m128i rot8 = CHACHA_ROT8_MASK();
+    uint32_t counter = state[12];
+
+    for (; blocks >= 4; blocks -= 4, pbIn += 256, pbOut += 256, counter += 4) {
+        __m128i s[16];
+        __m128i x[16];
+        for (int i = 0; i < 16; i++) {
+            s[i] = _mm_set1_epi32((int)state[i]);
+        }
+        s[12] = _mm_add_epi32(_mm_set1_epi32((int)counter), _mm_set_epi32(3, 2, 1, 0));
+        for (int i = 0; i < 16; i++) {
+            x[i] = s[i];
+        }
+        for (int r = 0; r < 10; r++) {
+            CHACHA_DOUBLE_ROUND(x, _mm_add_epi32, _mm_xor_si128, SSE_ROL16, SSE_ROL12, SSE_ROL8, SSE_ROL7);
+        }
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm_add_epi32(x[i], s[i]);
+        }
+        // Group k holds words 4k..4k+3 of all blocks
+        for (int k = 0; k < 4; k++) {
+            CHACHA_TRANSPOSE4(x[4 * k], x[4 * k + 1], x[4 * k + 2], x[4 * k + 3], __m128i,
+                _mm_unpacklo_epi32, _mm_unpackhi_epi32, _mm_unpacklo_epi64, _mm_unpackhi_epi64);
+            for (int b = 0; b < 4; b++) {
+                const CK_BYTE* in = pbIn + b * 64 + k * 16;
+                _mm_storeu_si128((__m128i*)(pbOut + b * 64 + k * 16), _mm_xor_si128(x[4 * k + b], _mm_loadu_si128((const __m128i*)in)));
+            }
+        }
+    }
+    ChaCha20Rest(core::ChaCha20Blocks, state, counter, pbIn, pbOut, blocks);
+}
+
+PV_TARGET("avx2")
+void core::ChaCha20BlocksAvx2(const uint32_t* state, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    const __m256i rot16 = _mm256_broadcastsi128_si256(CHACHA_ROT16_MASK());
+    const __m256i rot8 = _mm256_broadcastsi128_si256(CHACHA_ROT8_MASK());
+    uint32_t counter = state[12];
+
+    for (; blocks >= 8; blocks -= 8, pbIn += 512, pbOut += 512, counter += 8) {
+        __m256i s[16];
+        __m256i x[16];
+        for (int i = 0; i < 16; i++) {
+            s[i] = _mm256_set1_epi32((int)state[i]);
+        }
+        s[12] = _mm256_add_epi32(_mm256_set1_epi32((int)counter), _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+        for (int i = 0; i < 16; i++) {
+            x[i] = s[i];
+        }
+        for (int r = 0; r < 10; r++) {
+            CHACHA_DOUBLE_ROUND(x, _mm256_add_epi32, _mm256_xor_si256, AVX2_ROL16, AVX2_ROL12, AVX2_ROL8, AVX2_ROL7);
+        }
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm256_add_epi32(x[i], s[i]);
+        }
+        for (int k = 0; k < 4; k++) {
+            CHACHA_TRANSPOSE4(x[4 * k], x[4 * k + 1], x[4 * k + 2], x[4 * k + 3], __m256i,
+                _mm256_unpacklo_epi32, _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64);
+        }
+        // Low lanes of x[4k + b] are words of block b, high lanes are words of block b + 4
+        for (int b = 0; b < 4; b++) {
+            const CK_BYTE* in = pbIn + b * 64;
+            CK_BYTE* out = pbOut + b * 64;
+            _mm256_storeu_si256((__m256i*)out, _mm256_xor_si256(_mm256_permute2x128_si256(x[b], x[4 + b], 0x20), _mm256_loadu_si256((const __m256i*)in)));
+            _mm256_storeu_si256((__m256i*)(out + 32), _mm256_xor_si256(_mm256_permute2x128_si256(x[8 + b], x[12 + b], 0x20), _mm256_loadu_si256((const __m256i*)(in + 32))));
+            _mm256_storeu_si256((__m256i*)(out + 256), _mm256_xor_si256(_mm256_permute2x128_si256(x[b], x[4 + b], 0x31), _mm256_loadu_si256((const __m256i*)(in + 256))));
+            _mm256_storeu_si256((__m256i*)(out + 288), _mm256_xor_si256(_mm256_permute2x128_si256(x[8 + b], x[12 + b], 0x31), _mm256_loadu_si256((const __m256i*)(in + 288))));
+        }
+    }
+    ChaCha20Rest(core::ChaCha20BlocksSsse3, state, counter, pbIn, pbOut, blocks);
+}
+
+PV_TARGET("avx512f")
+void core::ChaCha20BlocksAvx512(const uint32_t* state, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    uint32_t counter = state[12];
+
+    for (; blocks >= 16; blocks -= 16, pbIn += 1024, pbOut += 1024, counter += 16) {
+        __m512i s[16];
+        __m512i x[16];
+        for (int i = 0; i < 16; i++) {
+            s[i] = _mm512_set1_epi32((int)state[i]);
+        }
+        s[12] = _mm512_add_epi32(_mm512_set1_epi32((int)counter), _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+        for (int i = 0; i < 16; i++) {
+            x[i] = s[i];
+        }
+        for (int r = 0; r < 10; r++) {
+            CHACHA_DOUBLE_ROUND(x, _mm512_add_epi32, _mm512_xor_si512, AVX512_ROL16, AVX512_ROL12, AVX512_ROL8, AVX512_ROL7);
+        }
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm512_add_epi32(x[i], s[i]);
+        }
+        for (int k = 0; k < 4; k++) {
+            CHACHA_TRANSPOSE4(x[4 * k], x[4 * k + 1], x[4 * k + 2], x[4 * k + 3], __m512i,
+                _mm512_unpacklo_epi32, _mm512_unpackhi_epi32, _mm512_unpacklo_epi64, _mm512_unpackhi_epi64);
+        }
+        // Lane l of x[4k + b] holds words 4k..4k+3 of block b + 4l
+        for (int b = 0; b < 4; b++) {
+            __m512i lo01 = _mm512_shuffle_i32x4(x[b], x[4 + b], 0x44);
+            __m512i hi01 = _mm512_shuffle_i32x4(x[b], x[4 + b], 0xee);
+            __m512i lo23 = _mm512_shuffle_i32x4(x[8 + b], x[12 + b], 0x44);
+            __m512i hi23 = _mm512_shuffle_i32x4(x[8 + b], x[12 + b], 0xee);
+            const CK_BYTE* in = pbIn + b * 64;
+            CK_BYTE* out = pbOut + b * 64;
+            _mm512_storeu_si512(out, _mm512_xor_si512(_mm512_shuffle_i32x4(lo01, lo23, 0x88), _mm512_loadu_si512(in)));
+            _mm512_storeu_si512(out + 256, _mm512_xor_si512(_mm512_shuffle_i32x4(lo01, lo23, 0xdd), _mm512_loadu_si512(in + 256)));
+            _mm512_storeu_si512(out + 512, _mm512_xor_si512(_mm512_shuffle_i32x4(hi01, hi23, 0x88), _mm512_loadu_si512(in + 512)));
+            _mm512_storeu_si512(out + 768, _mm512_xor_si512(_mm512_shuffle_i32x4(hi01, hi23, 0xdd), _mm512_loadu_si512(in + 768)));
+        }
+    }
+    ChaCha20Rest(core::ChaCha20BlocksAvx2, state, counter, pbIn, pbOut, blocks);
+}
+
+// Blocks from which the vector kernel pays for the final multiplication by powers of r
+#define POLY1305_AVX2_MIN_BLOCKS    16
+
+// Splits blocks p[0], p[2], p[1], p[3] into 26-bit limbs of 4 lanes, unpack works in
+// 128-bit halves and gives this order
+#define POLY1305_LOAD4_AVX2(p, m) {                                     \
+    __m256i t0 = _mm256_loadu_si256((const __m256i*)(p));               \
+    __m256i t1 = _mm256_loadu_si256((const __m256i*)((p) + 32));        \
+    __m256i lo = _mm256_unpacklo_epi64(t0, t1);                         \
+    __m256i hi = _mm256_unpackhi_epi64(t0, t1);                         \
+    m[0] = _mm256_and_si256(lo, mask26);                                \
+    m[1] = _mm256_and_si256(_mm256_srli_epi64(lo, 26), mask26);         \
+    m[2] = _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(lo, 52), _mm256_slli_epi64(hi, 12)), mask26); \
+    m[3] = _mm256_and_si256(_mm256_srli_epi64(hi, 14), mask26);         \
+    m[4] = _mm256_or_si256(_mm256_srli_epi64(hi, 40), hibit);           \
+}
+
+// Products of 4 lanes without carries, s holds limbs of r multiplied by 5
+PV_TARGET("avx2")
+static inline void Poly1305MultiplyAvx2(__m256i* d, const __m256i* h, const __m256i* r, const __m256i* s)
+{
+    d[0] = _mm256_add_epi64(
+        _mm256_add_epi64(_mm256_mul_epu32(h[0], r[0]), _mm256_mul_epu32(h[1], s[4])),
+        _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[2], s[3]), _mm256_mul_epu32(h[3], s[2])), _mm256_mul_epu32(h[4], s[1])));
+    d[1] = _mm256_add_epi64(
+        _mm256_add_epi64(_mm256_mul_epu32(h[0], r[1]), _mm256_mul_epu32(h[1], r[0])),
+        _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[2], s[4]), _mm256_mul_epu32(h[3], s[3])), _mm256_mul_epu32(h[4], s[2])));
+    d[2] = _mm256_add_epi64(
+        _mm256_add_epi64(_mm256_mul_epu32(h[0], r[2]), _mm256_mul_epu32(h[1], r[1])),
+        _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[2], r[0]), _mm256_mul_epu32(h[3], s[4])), _mm256_mul_epu32(h[4], s[3])));
+    d[3] = _mm256_add_epi64(
+        _mm256_add_epi64(_mm256_mul_epu32(h[0], r[3]), _mm256_mul_epu32(h[1], r[2])),
+        _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[2], r[1]), _mm256_mul_epu32(h[3], r[0])), _mm256_mul_epu32(h[4], s[4])));
+    d[4] = _mm256_add_epi64(
+        _mm256_add_epi64(_mm256_mul_epu32(h[0], r[4]), _mm256_mul_epu32(h[1], r[3])),
+        _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[2], r[2]), _mm256_mul_epu32(h[3], r[1])), _mm256_mul_epu32(h[4], r[0])));
+}
+
+PV_TARGET("avx2")
+static inline uint64_t Poly1305SumLanesAvx2(__m256i x)
+{
+    __m128i t = _mm_add_epi64(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+    t = _mm_add_epi64(t, _mm_unpackhi_epi64(t, t));
+    uint64_t sum;
+    _mm_storel_epi64((__m128i*)&sum, t);
+    return sum;
+}
+
+PV_TARGET("avx2")
+void core::Poly1305BlocksAvx2(POLY1305_STATE* state, const CK_BYTE* pbData, size_t blocks)
+{
+    if (blocks >= POLY1305_AVX2_MIN_BLOCKS) {
+        const __m256i mask26 = _mm256_set1_epi64x(0x3ffffff);
+        const __m256i hibit = _mm256_set1_epi64x(1 << 24);
+        __m256i r[5];
+        __m256i s[5];
+        __m256i h[5];
+        __m256i m[5];
+        __m256i d[5];
+        for (int i = 0; i < 5; i++) {
+            r[i] = _mm256_set1_epi64x(state->r[3][i]);
+            s[i] = _mm256_set1_epi64x(state->r[3][i] * 5);
+        }
+
+        // The accumulator joins the first block
+        POLY1305_LOAD4_AVX2(pbData, m);
+        for (int i = 0; i < 5; i++) {
+            h[i] = _mm256_add_epi64(m[i], _mm256_set_epi64x(0, 0, 0, state->h[i]));
+        }
+        pbData += 64;
+        blocks -= 4;
+
+        // h = h * r^4 + m in each lane
+        for (; blocks >= 4; blocks -= 4, pbData += 64) {
+            Poly1305MultiplyAvx2(d, h, r, s);
+            POLY1305_LOAD4_AVX2(pbData, m);
+            d[1] = _mm256_add_epi64(d[1], _mm256_srli_epi64(d[0], 26));
+            d[2] = _mm256_add_epi64(d[2], _mm256_srli_epi64(d[1], 26));
+            d[3] = _mm256_add_epi64(d[3], _mm256_srli_epi64(d[2], 26));
+            d[4] = _mm256_add_epi64(d[4], _mm256_srli_epi64(d[3], 26));
+            __m256i c = _mm256_srli_epi64(d[4], 26);
+            d[0] = _mm256_add_epi64(_mm256_and_si256(d[0], mask26), _mm256_add_epi64(c, _mm256_slli_epi64(c, 2)));
+            h[0] = _mm256_add_epi64(_mm256_and_si256(d[0], mask26), m[0]);
+            h[1] = _mm256_add_epi64(_mm256_add_epi64(_mm256_and_si256(d[1], mask26), _mm256_srli_epi64(d[0], 26)), m[1]);
+            h[2] = _mm256_add_epi64(_mm256_and_si256(d[2], mask26), m[2]);
+            h[3] = _mm256_add_epi64(_mm256_and_si256(d[3], mask26), m[3]);
+            h[4] = _mm256_add_epi64(_mm256_and_si256(d[4], mask26), m[4]);
+        }
+
+        // Lanes hold blocks 0, 2, 1 and 3 of the last group, they are multiplied by
+        // r^4, r^2, r^3 and r
+        for (int i = 0; i < 5; i++) {
+            r[i] = _mm256_set_epi64x(state->r[0][i], state->r[2][i], state->r[1][i], state->r[3][i]);
+            s[i] = _mm256_add_epi64(r[i], _mm256_slli_epi64(r[i], 2));
+        }
+        Poly1305MultiplyAvx2(d, h, r, s);
+
+        uint64_t d0 = Poly1305SumLanesAvx2(d[0]);
+        uint64_t d1 = Poly1305SumLanesAvx2(d[1]);
+        uint64_t d2 = Poly1305SumLanesAvx2(d[2]);
+        uint64_t d3 = Poly1305SumLanesAvx2(d[3]);
+        uint64_t d4 = Poly1305SumLanesAvx2(d[4]);
+        d1 += d0 >> 26;
+        d2 += d1 >> 26;
+        d3 += d2 >> 26;
+        d4 += d3 >> 26;
+        d0 = (d0 & 0x3ffffff) + (d4 >> 26) * 5;
+        state->h[0] = (uint32_t)d0 & 0x3ffffff;
+        state->h[1] = ((uint32_t)d1 & 0x3ffffff) + (uint32_t)(d0 >> 26);
+        state->h[2] = (uint32_t)d2 & 0x3ffffff;
+        state->h[3] = (uint32_t)d3 & 0x3ffffff;
+        state->h[4] = (uint32_t)d4 & 0x3ffffff;
+    }
+    Poly1305Blocks(state, pbData, blocks);
+}
+
+#endif
@@ -0,0 +1,99 @@
+#include "cpu.h"
+
+#ifdef PV_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+using namespace core;
+
+#ifdef PV_X86
+
+static void GetCpuId(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; i++) {
+        regs[i] = (uint32_t)info[i];
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t GetXcr0()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static CPU_FEATURES DetectCpuFeatures()
+{
+    CPU_FEATURES res;
+    memset(&res, 0, sizeof(res));
+
+    uint32_t regs[4];
+    GetCpuId(0, 0, regs);
+    uint32_t maxLeaf = regs[0];
+    if (maxLeaf < 1) {
+        return res;
+    }
+
+    GetCpuId(1, 0, regs);
+    uint32_t ecx1 = regs[2];
+    res.ssse3 = (ecx1 >> 9) & 1;
+    res.sse41 = (ecx1 >> 19) & 1;
+    res.aes = (ecx1 >> 25) & 1;
+    res.pclmul = (ecx1 >> 1) & 1;
+
+    // AVX state must be enabled by OS
+    bool osxsave = (ecx1 >> 27) & 1;
+    uint64_t xcr0 = osxsave ? GetXcr0() : 0;
+    bool ymm = (xcr0 & 0x06) == 0x06;
+    bool zmm = (xcr0 & 0xE6) == 0xE6;
+    res.avx = ((ecx1 >> 28) & 1) && ymm;
+
+    if (maxLeaf >= 7) {
+        GetCpuId(7, 0, regs);
+        uint32_t ebx7 = regs[1];
+        uint32_t ecx7 = regs[2];
+        res.avx2 = ((ebx7 >> 5) & 1) && res.avx;
+        res.bmi2 = (ebx7 >> 8) & 1;
+        res.adx = (ebx7 >> 19) & 1;
+        res.sha = (ebx7 >> 29) & 1;
+        res.vaes = ((ecx7 >> 9) & 1) && res.avx2;
+        res.vpclmul = ((ecx7 >> 10) & 1) && res.avx2;
+        res.avx512f = ((ebx7 >> 16) & 1) && zmm;
+        res.avx512bw = ((ebx7 >> 30) & 1) && res.avx512f;
+        res.avx512vl = ((ebx7 >> 31) & 1) && res.avx512f;
+        res.avx512ifma = ((ebx7 >> 21) & 1) && res.avx512f;
+    }
+
+    return res;
+}
+
+#else
+
+static CPU_FEATURES DetectCpuFeatures()
+{
+    CPU_FEATURES res;
+    memset(&res, 0, sizeof(res));
+    return res;
+}
+
+#endif
+
+const CPU_FEATURES& core::GetCpuFeatures()
+{
+    static CPU_FEATURES features = DetectCpuFeatures();
+    return features;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../../stdafx.h"
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PV_X86 1
+#endif
+
+// Allows to compile a function for the instruction set which is not enabled for the whole module.
+// The function must be called only if GetCpuFeatures reports support of that instruction set
+#if defined(__GNUC__) || defined(__clang__)
+#define PV_TARGET(features) __attribute__((target(features)))
+#else
+#define PV_TARGET(features)
+#endif
+
+namespace core {
+
+    struct CPU_FEATURES {
+        bool ssse3;
+        bool sse41;
+        bool avx;
+        bool avx2;
+        bool bmi2;
+        bool adx;
+        bool aes;
+        bool pclmul;
+        bool sha;
+        bool vaes;
+        bool vpclmul;
+        bool avx512f;
+        bool avx512bw;
+        bool avx512vl;
+        bool avx512ifma;
+    };
+
+    /**
+     * Returns instruction sets supported by CPU and OS. Detected once
+     */
+    const CPU_FEATURES& GetCpuFeatures();
+
+}
@@ -0,0 +1,1401 @@
+#include "curve25519.h"
+#include "sha.h"
+
+using namespace core;
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// Field elements mod p = 2^255 - 19 have 5 limbs of 51 bits, limbs of results of
+// multiplications and subtractions are below 2^52, sums of two of them below 2^53
+
+#define FE_MASK     0x7FFFFFFFFFFFFULL
+
+typedef uint64_t FE[5];
+
+#if defined(__SIZEOF_INT128__)
+
+typedef unsigned __int128 FE_WIDE;
+
+static inline FE_WIDE FeWideMul(uint64_t a, uint64_t b)
+{
+    return (FE_WIDE)a * b;
+}
+
+static inline uint64_t FeWideLo(FE_WIDE a)
+{
+    return (uint64_t)a;
+}
+
+static inline uint64_t FeWideHi(FE_WIDE a)
+{
+    return (uint64_t)(a >> 64);
+}
+
+static inline uint64_t FeWideShr51(FE_WIDE a)
+{
+    return (uint64_t)(a >> 51);
+}
+
+#else
+
+struct FE_WIDE {
+    uint64_t    lo;
+    uint64_t    hi;
+};
+
+static inline FE_WIDE operator+(FE_WIDE a, FE_WIDE b)
+{
+    FE_WIDE r;
+    r.lo = a.lo + b.lo;
+    r.hi = a.hi + b.hi + (r.lo < a.lo);
+    return r;
+}
+
+static inline FE_WIDE operator+(FE_WIDE a, uint64_t b)
+{
+    FE_WIDE r;
+    r.lo = a.lo + b;
+    r.hi = a.hi + (r.lo < a.lo);
+    return r;
+}
+
+static inline FE_WIDE& operator+=(FE_WIDE& a, uint64_t b)
+{
+    a = a + b;
+    return a;
+}
+
+static inline FE_WIDE FeWideMul(uint64_t a, uint64_t b)
+{
+    FE_WIDE r;
+#if defined(_MSC_VER) && defined(_M_X64)
+    r.lo = _umul128(a, b, &r.hi);
+#else
+    uint64_t aLo = (uint32_t)a, aHi = a >> 32;
+    uint64_t bLo = (uint32_t)b, bHi = b >> 32;
+    uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+    uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+    r.lo = (mid << 32) | (uint32_t)ll;
+    r.hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+    return r;
+}
+
+static inline uint64_t FeWideLo(FE_WIDE a)
+{
+    return a.lo;
+}
+
+static inline uint64_t FeWideHi(FE_WIDE a)
+{
+    return a.hi;
+}
+
+static inline uint64_t FeWideShr51(FE_WIDE a)
+{
+    return (a.lo >> 51) | (a.hi << 13);
+}
+
+#endif
+
+static inline uint64_t FeLoad64(const CK_BYTE* p)
+{
+    uint64_t r = 0;
+    for (int i = 7; i >= 0; i--) {
+        r = (r << 8) | p[i];
+    }
+    return r;
+}
+
+static inline void FeStore64(CK_BYTE* p, uint64_t a)
+{
+    for (int i = 0; i < 8; i++) {
+        p[i] = (CK_BYTE)(a >> (8 * i));
+    }
+}
+
+static inline void FeCopy(FE r, const FE a)
+{
+    memcpy(r, a, sizeof(FE));
+}
+
+static inline void FeZero(FE r)
+{
+    memset(r, 0, sizeof(FE));
+}
+
+static inline void FeOne(FE r)
+{
+    FeZero(r);
+    r[0] = 1;
+}
+
+static inline void FeCarry(FE r)
+{
+    uint64_t c;
+    c = r[0] >> 51; r[0] &= FE_MASK; r[1] += c;
+    c = r[1] >> 51; r[1] &= FE_MASK; r[2] += c;
+    c = r[2] >> 51; r[2] &= FE_MASK; r[3] += c;
+    c = r[3] >> 51; r[3] &= FE_MASK; r[4] += c;
+    c = r[4] >> 51; r[4] &= FE_MASK; r[0] += 19 * c;
+}
+
+static inline void FeAdd(FE r, const FE a, const FE b)
+{
+    for (int i = 0; i < 5; i++) {
+        r[i] = a[i] + b[i];
+    }
+}
+
+// a + 4p - b, b limbs must be below 2^53
+static inline void FeSub(FE r, const FE a, const FE b)
+{
+    r[0] = a[0] + 0x1FFFFFFFFFFFB4ULL - b[0];
+    r[1] = a[1] + 0x1FFFFFFFFFFFFCULL - b[1];
+    r[2] = a[2] + 0x1FFFFFFFFFFFFCULL - b[2];
+    r[3] = a[3] + 0x1FFFFFFFFFFFFCULL - b[3];
+    r[4] = a[4] + 0x1FFFFFFFFFFFFCULL - b[4];
+    FeCarry(r);
+}
+
+// a + 2p - b without carries, b must be a result of a multiplication
+static inline void FeSubReduced(FE r, const FE a, const FE b)
+{
+    r[0] = a[0] + 0xFFFFFFFFFFFDAULL - b[0];
+    r[1] = a[1] + 0xFFFFFFFFFFFFEULL - b[1];
+    r[2] = a[2] + 0xFFFFFFFFFFFFEULL - b[2];
+    r[3] = a[3] + 0xFFFFFFFFFFFFEULL - b[3];
+    r[4] = a[4] + 0xFFFFFFFFFFFFEULL - b[4];
+}
+
+static inline void FeNeg(FE r, const FE a)
+{
+    const FE zero = { 0 };
+    FeSub(r, zero, a);
+}
+
+static inline void FeReduceWide(FE r, FE_WIDE t0, FE_WIDE t1, FE_WIDE t2, FE_WIDE t3, FE_WIDE t4)
+{
+    uint64_t r0, r1, r2, r3, r4;
+    r0 = FeWideLo(t0) & FE_MASK; t1 += FeWideShr51(t0);
+    r1 = FeWideLo(t1) & FE_MASK; t2 += FeWideShr51(t1);
+    r2 = FeWideLo(t2) & FE_MASK; t3 += FeWideShr51(t2);
+    r3 = FeWideLo(t3) & FE_MASK; t4 += FeWideShr51(t3);
+    r4 = FeWideLo(t4) & FE_MASK;
+    r0 += 19 * FeWideShr51(t4);
+    r1 += r0 >> 51;
+    r0 &= FE_MASK;
+    r[0] = r0; r[1] = r1; r[2] = r2; r[3] = r3; r[4] = r4;
+}
+
+static void FeMul(FE r, const FE a, const FE b)
+{
+    uint64_t b1 = 19 * b[1], b2 = 19 * b[2], b3 = 19 * b[3], b4 = 19 * b[4];
+    FE_WIDE t0 = FeWideMul(a[0], b[0]) + FeWideMul(a[1], b4) + FeWideMul(a[2], b3) + FeWideMul(a[3], b2) + FeWideMul(a[4], b1);
+    FE_WIDE t1 = FeWideMul(a[0], b[1]) + FeWideMul(a[1], b[0]) + FeWideMul(a[2], b4) + FeWideMul(a[3], b3) + FeWideMul(a[4], b2);
+    FE_WIDE t2 = FeWideMul(a[0], b[2]) + FeWideMul(a[1], b[1]) + FeWideMul(a[2], b[0]) + FeWideMul(a[3], b4) + FeWideMul(a[4], b3);
+    FE_WIDE t3 = FeWideMul(a[0], b[3]) + FeWideMul(a[1], b[2]) + FeWideMul(a[2], b[1]) + FeWideMul(a[3], b[0]) + FeWideMul(a[4], b4);
+    FE_WIDE t4 = FeWideMul(a[0], b[4]) + FeWideMul(a[1], b[3]) + FeWideMul(a[2], b[2]) + FeWideMul(a[3], b[1]) + FeWideMul(a[4], b[0]);
+    FeReduceWide(r, t0, t1, t2, t3, t4);
+}
+
+static void FeSq(FE r, const FE a)
+{
+    uint64_t d0 = 2 * a[0], d1 = 2 * a[1], d2 = 2 * a[2], d3 = 2 * a[3];
+    uint64_t a3 = 19 * a[3], a4 = 19 * a[4];
+    FE_WIDE t0 = FeWideMul(a[0], a[0]) + FeWideMul(d1, a4) + FeWideMul(d2, a3);
+    FE_WIDE t1 = FeWideMul(d0, a[1]) + FeWideMul(d2, a4) + FeWideMul(a[3], a3);
+    FE_WIDE t2 = FeWideMul(d0, a[2]) + FeWideMul(a[1], a[1]) + FeWideMul(d3, a4);
+    FE_WIDE t3 = FeWideMul(d0, a[3]) + FeWideMul(d1, a[2]) + FeWideMul(a[4], a4);
+    FE_WIDE t4 = FeWideMul(d0, a[4]) + FeWideMul(d1, a[3]) + FeWideMul(a[2], a[2]);
+    FeReduceWide(r, t0, t1, t2, t3, t4);
+}
+
+static void FeMulSmall(FE r, const FE a, uint64_t b)
+{
+    FeReduceWide(r, FeWideMul(a[0], b), FeWideMul(a[1], b), FeWideMul(a[2], b), FeWideMul(a[3], b), FeWideMul(a[4], b));
+}
+
+static inline void FeSqN(FE r, const FE a, int n)
+{
+    FeSq(r, a);
+    while (--n) {
+        FeSq(r, r);
+    }
+}
+
+/**
+ * a^(2^250 - 1) and a^11 of the chains of inversion and square root
+ */
+static void FePow250(FE r, FE a11, const FE a)
+{
+    FE t, a9, a2_5, a2_10, a2_20, a2_50, a2_100;
+    FeSq(t, a);                 // 2
+    FeSqN(a9, t, 2);            // 8
+    FeMul(a9, a9, a);           // 9
+    FeMul(a11, a9, t);          // 11
+    FeSq(t, a11);               // 22
+    FeMul(a2_5, t, a9);         // 2^5 - 1
+    FeSqN(t, a2_5, 5);
+    FeMul(a2_10, t, a2_5);      // 2^10 - 1
+    FeSqN(t, a2_10, 10);
+    FeMul(a2_20, t, a2_10);     // 2^20 - 1
+    FeSqN(t, a2_20, 20);
+    FeMul(t, t, a2_20);         // 2^40 - 1
+    FeSqN(t, t, 10);
+    FeMul(a2_50, t, a2_10);     // 2^50 - 1
+    FeSqN(t, a2_50, 50);
+    FeMul(a2_100, t, a2_50);    // 2^100 - 1
+    FeSqN(t, a2_100, 100);
+    FeMul(t, t, a2_100);        // 2^200 - 1
+    FeSqN(t, t, 50);
+    FeMul(r, t, a2_50);         // 2^250 - 1
+}
+
+// a^(p - 2)
+static void FeInvert(FE r, const FE a)
+{
+    FE t, a11;
+    FePow250(t, a11, a);
+    FeSqN(t, t, 5);
+    FeMul(r, t, a11);
+}
+
+// a^((p - 5) / 8)
+static void FePow22523(FE r, const FE a)
+{
+    FE t, a11;
+    FePow250(t, a11, a);
+    FeSqN(t, t, 2);
+    FeMul(r, t, a);
+}
+
+static void FeFromBytes(FE r, const CK_BYTE* s)
+{
+    r[0] = FeLoad64(s) & FE_MASK;
+    r[1] = (FeLoad64(s + 6) >> 3) & FE_MASK;
+    r[2] = (FeLoad64(s + 12) >> 6) & FE_MASK;
+    r[3] = (FeLoad64(s + 19) >> 1) & FE_MASK;
+    r[4] = (FeLoad64(s + 24) >> 12) & FE_MASK;
+}
+
+static void FeToBytes(CK_BYTE* s, const FE a)
+{
+    FE t;
+    FeCopy(t, a);
+    FeCarry(t);
+
+    // q = 1 if t >= p, then t + 19q drops 2^255
+    uint64_t q = (t[0] + 19) >> 51;
+    q = (t[1] + q) >> 51;
+    q = (t[2] + q) >> 51;
+    q = (t[3] + q) >> 51;
+    q = (t[4] + q) >> 51;
+    t[0] += 19 * q;
+    t[1] += t[0] >> 51; t[0] &= FE_MASK;
+    t[2] += t[1] >> 51; t[1] &= FE_MASK;
+    t[3] += t[2] >> 51; t[2] &= FE_MASK;
+    t[4] += t[3] >> 51; t[3] &= FE_MASK;
+    t[4] &= FE_MASK;
+
+    FeStore64(s, t[0] | (t[1] << 51));
+    FeStore64(s + 8, (t[1] >> 13) | (t[2] << 38));
+    FeStore64(s + 16, (t[2] >> 26) | (t[3] << 25));
+    FeStore64(s + 24, (t[3] >> 39) | (t[4] << 12));
+}
+
+static bool FeIsZero(const FE a)
+{
+    CK_BYTE s[32];
+    FeToBytes(s, a);
+    CK_BYTE acc = 0;
+    for (int i = 0; i < 32; i++) {
+        acc |= s[i];
+    }
+    return acc == 0;
+}
+
+static int FeIsNegative(const FE a)
+{
+    CK_BYTE s[32];
+    FeToBytes(s, a);
+    return s[0] & 1;
+}
+
+static inline void FeCMov(FE r, const FE a, uint64_t mask)
+{
+    for (int i = 0; i < 5; i++) {
+        r[i] ^= (r[i] ^ a[i]) & mask;
+    }
+}
+
+static inline void FeCSwap(FE a, FE b, uint64_t mask)
+{
+    for (int i = 0; i < 5; i++) {
+        uint64_t t = (a[i] ^ b[i]) & mask;
+        a[i] ^= t;
+        b[i] ^= t;
+    }
+}
+
+// Points of -x^2 + y^2 = 1 + d x^2 y^2 as in ref10 of SUPERCOP
+
+struct GE_P2 {
+    FE  X, Y, Z;
+};
+
+// Extended coordinates, x = X/Z, y = Y/Z, x y = T/Z
+struct GE_P3 {
+    FE  X, Y, Z, T;
+};
+
+// Completed coordinates, x = X/Z, y = Y/T
+struct GE_P1P1 {
+    FE  X, Y, Z, T;
+};
+
+struct GE_CACHED {
+    FE  YplusX, YminusX, Z, T2d;
+};
+
+// Affine y + x, y - x and 2 d x y
+struct GE_PRECOMP {
+    FE  yplusx, yminusx, xy2d;
+};
+
+#define ED25519_BASE_WINDOWS    32
+#define ED25519_BASE_POINTS     8
+#define ED25519_ODD_POINTS      64
+
+struct ED25519_TABLES {
+    FE          d;
+    FE          d2;
+    FE          sqrtm1;
+    // (j + 1) 256^i B
+    GE_PRECOMP  base[ED25519_BASE_WINDOWS][ED25519_BASE_POINTS];
+    // B, 3B .. 127B for wNAF of 8 bits
+    GE_PRECOMP  odd[ED25519_ODD_POINTS];
+
+    ED25519_TABLES();
+};
+
+static const ED25519_TABLES& GetTables();
+
+static inline void GeP3Zero(GE_P3& r)
+{
+    FeZero(r.X);
+    FeOne(r.Y);
+    FeOne(r.Z);
+    FeZero(r.T);
+}
+
+static inline void GeP2Zero(GE_P2& r)
+{
+    FeZero(r.X);
+    FeOne(r.Y);
+    FeOne(r.Z);
+}
+
+static inline void GePrecompZero(GE_PRECOMP& r)
+{
+    FeOne(r.yplusx);
+    FeOne(r.yminusx);
+    FeZero(r.xy2d);
+}
+
+static inline void GeP1P1ToP2(GE_P2& r, const GE_P1P1& p)
+{
+    FeMul(r.X, p.X, p.T);
+    FeMul(r.Y, p.Y, p.Z);
+    FeMul(r.Z, p.Z, p.T);
+}
+
+static inline void GeP1P1ToP3(GE_P3& r, const GE_P1P1& p)
+{
+    FeMul(r.X, p.X, p.T);
+    FeMul(r.Y, p.Y, p.Z);
+    FeMul(r.Z, p.Z, p.T);
+    FeMul(r.T, p.X, p.Y);
+}
+
+static inline void GeP3ToP2(GE_P2& r, const GE_P3& p)
+{
+    FeCopy(r.X, p.X);
+    FeCopy(r.Y, p.Y);
+    FeCopy(r.Z, p.Z);
+}
+
+static inline void GeP3ToCached(GE_CACHED& r, const GE_P3& p, const FE d2)
+{
+    FeAdd(r.YplusX, p.Y, p.X);
+    FeSub(r.YminusX, p.Y, p.X);
+    FeCopy(r.Z, p.Z);
+    FeMul(r.T2d, p.T, d2);
+}
+
+static void GeP2Dbl(GE_P1P1& r, const GE_P2& p)
+{
+    FE t0;
+    FeSq(r.X, p.X);
+    FeSq(r.Z, p.Y);
+    FeSq(r.T, p.Z);
+    FeAdd(r.T, r.T, r.T);
+    FeAdd(r.Y, p.X, p.Y);
+    FeSq(t0, r.Y);
+    FeAdd(r.Y, r.Z, r.X);
+    FeSub(r.Z, r.Z, r.X);
+    FeSub(r.X, t0, r.Y);
+    FeSub(r.T, r.T, r.Z);
+}
+
+static inline void GeP3Dbl(GE_P1P1& r, const GE_P3& p)
+{
+    GE_P2 q;
+    GeP3ToP2(q, p);
+    GeP2Dbl(r, q);
+}
+
+static void GeAdd(GE_P1P1& r, const GE_P3& p, const GE_CACHED& q)
+{
+    FE t0;
+    FeAdd(r.X, p.Y, p.X);
+    FeSub(r.Y, p.Y, p.X);
+    FeMul(r.Z, r.X, q.YplusX);
+    FeMul(r.Y, r.Y, q.YminusX);
+    FeMul(r.T, q.T2d, p.T);
+    FeMul(r.X, p.Z, q.Z);
+    FeAdd(t0, r.X, r.X);
+    FeSub(r.X, r.Z, r.Y);
+    FeAdd(r.Y, r.Z, r.Y);
+    FeAdd(r.Z, t0, r.T);
+    FeSub(r.T, t0, r.T);
+}
+
+static void GeSub(GE_P1P1& r, const GE_P3& p, const GE_CACHED& q)
+{
+    FE t0;
+    FeAdd(r.X, p.Y, p.X);
+    FeSub(r.Y, p.Y, p.X);
+    FeMul(r.Z, r.X, q.YminusX);
+    FeMul(r.Y, r.Y, q.YplusX);
+    FeMul(r.T, q.T2d, p.T);
+    FeMul(r.X, p.Z, q.Z);
+    FeAdd(t0, r.X, r.X);
+    FeSub(r.X, r.Z, r.Y);
+    FeAdd(r.Y, r.Z, r.Y);
+    FeSub(r.Z, t0, r.T);
+    FeAdd(r.T, t0, r.T);
+}
+
+static void GeMadd(GE_P1P1& r, const GE_P3& p, const GE_PRECOMP& q)
+{
+    FE t0;
+    FeAdd(r.X, p.Y, p.X);
+    FeSub(r.Y, p.Y, p.X);
+    FeMul(r.Z, r.X, q.yplusx);
+    FeMul(r.Y, r.Y, q.yminusx);
+    FeMul(r.T, q.xy2d, p.T);
+    FeAdd(t0, p.Z, p.Z);
+    FeSub(r.X, r.Z, r.Y);
+    FeAdd(r.Y, r.Z, r.Y);
+    FeAdd(r.Z, t0, r.T);
+    FeSub(r.T, t0, r.T);
+}
+
+static void GeMsub(GE_P1P1& r, const GE_P3& p, const GE_PRECOMP& q)
+{
+    FE t0;
+    FeAdd(r.X, p.Y, p.X);
+    FeSub(r.Y, p.Y, p.X);
+    FeMul(r.Z, r.X, q.yminusx);
+    FeMul(r.Y, r.Y, q.yplusx);
+    FeMul(r.T, q.xy2d, p.T);
+    FeAdd(t0, p.Z, p.Z);
+    FeSub(r.X, r.Z, r.Y);
+    FeAdd(r.Y, r.Z, r.Y);
+    FeSub(r.Z, t0, r.T);
+    FeAdd(r.T, t0, r.T);
+}
+
+static void GeToBytes(CK_BYTE* s, const GE_P3& p)
+{
+    FE recip, x, y;
+    FeInvert(recip, p.Z);
+    FeMul(x, p.X, recip);
+    FeMul(y, p.Y, recip);
+    FeToBytes(s, y);
+    s[31] ^= (CK_BYTE)(FeIsNegative(x) << 7);
+}
+
+/**
+ * Decodes the point of RFC 8032 5.1.3. Returns false if y is not canonical or x doesn't exist
+ */
+static bool GeFromBytes(GE_P3& r, const CK_BYTE* s, const ED25519_TABLES& tables)
+{
+    FE u, v, v3, vxx, check;
+    FeFromBytes(r.Y, s);
+
+    CK_BYTE canonical[32];
+    FeToBytes(canonical, r.Y);
+    canonical[31] |= s[31] & 0x80;
+    if (memcmp(canonical, s, sizeof(canonical))) {
+        return false;
+    }
+
+    FeOne(r.Z);
+    FeSq(u, r.Y);
+    FeMul(v, u, tables.d);
+    FeSub(u, u, r.Z);           // y^2 - 1
+    FeAdd(v, v, r.Z);           // d y^2 + 1
+
+    // x = u v^3 (u v^7)^((p - 5) / 8)
+    FeSq(v3, v);
+    FeMul(v3, v3, v);
+    FeSq(r.X, v3);
+    FeMul(r.X, r.X, v);
+    FeMul(r.X, r.X, u);
+    FePow22523(r.X, r.X);
+    FeMul(r.X, r.X, v3);
+    FeMul(r.X, r.X, u);
+
+    FeSq(vxx, r.X);
+    FeMul(vxx, vxx, v);
+    FeSub(check, vxx, u);
+    if (!FeIsZero(check)) {
+        FeAdd(check, vxx, u);
+        if (!FeIsZero(check)) {
+            return false;
+        }
+        FeMul(r.X, r.X, tables.sqrtm1);
+    }
+
+    int sign = s[31] >> 7;
+    if (sign && FeIsZero(r.X)) {
+        return false;
+    }
+    if (FeIsNegative(r.X) != sign) {
+        FeNeg(r.X, r.X);
+    }
+    FeMul(r.T, r.X, r.Y);
+    return true;
+}
+
+static bool GeIsIdentity(const GE_P2& p)
+{
+    FE t;
+    FeSub(t, p.Y, p.Z);
+    return FeIsZero(p.X) && FeIsZero(t);
+}
+
+/**
+ * Affine forms of points by one inversion
+ */
+static void GeBatchToPrecomp(GE_PRECOMP* r, const GE_P3* p, size_t count, const FE d2)
+{
+    std::vector<GE_P2> prefix(count);
+    FE acc;
+    FeOne(acc);
+    for (size_t i = 0; i < count; i++) {
+        FeCopy(prefix[i].Z, acc);
+        FeMul(acc, acc, p[i].Z);
+    }
+    FE inv, zInv, x, y;
+    FeInvert(inv, acc);
+    for (size_t i = count; i--;) {
+        FeMul(zInv, inv, prefix[i].Z);
+        FeMul(inv, inv, p[i].Z);
+        FeMul(x, p[i].X, zInv);
+        FeMul(y, p[i].Y, zInv);
+        FeAdd(r[i].yplusx, y, x);
+        FeCarry(r[i].yplusx);
+        FeSub(r[i].yminusx, y, x);
+        FeMul(r[i].xy2d, x, y);
+        FeMul(r[i].xy2d, r[i].xy2d, d2);
+    }
+}
+
+static const CK_BYTE ED25519_BASE[32] = {
+    0x58, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+    0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66
+};
+
+ED25519_TABLES::ED25519_TABLES()
+{
+    // d = -121665 / 121666
+    FE t;
+    FeZero(t);
+    t[0] = 121666;
+    FeInvert(d, t);
+    t[0] = 121665;
+    FeMul(d, d, t);
+    FeNeg(d, d);
+    FeAdd(d2, d, d);
+    FeCarry(d2);
+
+    // sqrt(-1) = 2^((p - 1) / 4)
+    FeZero(t);
+    t[0] = 2;
+    FePow22523(sqrtm1, t);
+    FeSq(sqrtm1, sqrtm1);
+    FeMul(sqrtm1, sqrtm1, t);
+
+    GE_P3 b;
+    GeFromBytes(b, ED25519_BASE, *this);
+
+    GE_P1P1 sum;
+    GE_CACHED cached;
+    std::vector<GE_P3> points(ED25519_BASE_WINDOWS * ED25519_BASE_POINTS);
+    GE_P3 window = b;
+    for (size_t i = 0; i < ED25519_BASE_WINDOWS; i++) {
+        GE_P3* row = &points[i * ED25519_BASE_POINTS];
+        row[0] = window;
+        GeP3ToCached(cached, window, d2);
+        for (size_t j = 1; j < ED25519_BASE_POINTS; j++) {
+            GeAdd(sum, row[j - 1], cached);
+            GeP1P1ToP3(row[j], sum);
+        }
+        for (int j = 0; j < 8; j++) {
+            GeP3Dbl(sum, window);
+            GeP1P1ToP3(window, sum);
+        }
+    }
+    GeBatchToPrecomp(&base[0][0], points.data(), points.size(), d2);
+
+    GE_P3 oddPoints[ED25519_ODD_POINTS], b2;
+    oddPoints[0] = b;
+    GeP3Dbl(sum, b);
+    GeP1P1ToP3(b2, sum);
+    GeP3ToCached(cached, b2, d2);
+    for (size_t i = 1; i < ED25519_ODD_POINTS; i++) {
+        GeAdd(sum, oddPoints[i - 1], cached);
+        GeP1P1ToP3(oddPoints[i], sum);
+    }
+    GeBatchToPrecomp(odd, oddPoints, ED25519_ODD_POINTS, d2);
+}
+
+// The tables are built on the first use
+static const ED25519_TABLES& GetTables()
+{
+    static const ED25519_TABLES tables;
+    return tables;
+}
+
+static inline uint64_t GeEqualMask(int a, int b)
+{
+    uint64_t diff = (uint64_t)(int64_t)(a ^ b);
+    return ((diff - 1) >> 63) * ~0ULL;
+}
+
+// Reads all entries of the window, the digit is in [-8, 8]
+static void GeSelect(GE_PRECOMP& r, const GE_PRECOMP* row, int digit)
+{
+    uint64_t negative = (uint64_t)digit >> 63;
+    int abs = digit - (int)((0 - negative) & (uint64_t)(2 * digit));
+    GePrecompZero(r);
+    for (int j = 0; j < ED25519_BASE_POINTS; j++) {
+        uint64_t mask = GeEqualMask(abs, j + 1);
+        FeCMov(r.yplusx, row[j].yplusx, mask);
+        FeCMov(r.yminusx, row[j].yminusx, mask);
+        FeCMov(r.xy2d, row[j].xy2d, mask);
+    }
+    GE_PRECOMP minus;
+    FeCopy(minus.yplusx, r.yminusx);
+    FeCopy(minus.yminusx, r.yplusx);
+    FeNeg(minus.xy2d, r.xy2d);
+    uint64_t mask = 0 - negative;
+    FeCMov(r.yplusx, minus.yplusx, mask);
+    FeCMov(r.yminusx, minus.yminusx, mask);
+    FeCMov(r.xy2d, minus.xy2d, mask);
+}
+
+/**
+ * a B of the 32-byte little-endian scalar, a[31] <= 127. Constant-time
+ */
+static void GeScalarMultBase(GE_P3& h, const CK_BYTE* a, const ED25519_TABLES& tables)
+{
+    // Signed digits of 4 bits in [-8, 8]
+    signed char e[64];
+    for (int i = 0; i < 32; i++) {
+        e[2 * i] = a[i] & 15;
+        e[2 * i + 1] = (a[i] >> 4) & 15;
+    }
+    signed char carry = 0;
+    for (int i = 0; i < 63; i++) {
+        e[i] += carry;
+        carry = (e[i] + 8) >> 4;
+        e[i] -= carry << 4;
+    }
+    e[63] += carry;
+
+    GE_P1P1 r;
+    GE_PRECOMP t;
+    GeP3Zero(h);
+    for (int i = 1; i < 64; i += 2) {
+        GeSelect(t, tables.base[i / 2], e[i]);
+        GeMadd(r, h, t);
+        GeP1P1ToP3(h, r);
+    }
+    GE_P2 s;
+    GeP3ToP2(s, h);
+    for (int i = 0; i < 3; i++) {
+        GeP2Dbl(r, s);
+        GeP1P1ToP2(s, r);
+    }
+    GeP2Dbl(r, s);
+    GeP1P1ToP3(h, r);
+    for (int i = 0; i < 64; i += 2) {
+        GeSelect(t, tables.base[i / 2], e[i]);
+        GeMadd(r, h, t);
+        GeP1P1ToP3(h, r);
+    }
+    memset(e, 0, sizeof(e));
+}
+
+/**
+ * Width-w NAF of the 32-byte scalar, digits are odd and their absolute values are less
+ * than 2^(w - 1)
+ */
+static void GeSlide(signed char* r, const CK_BYTE* a, int w)
+{
+    int limit = (1 << (w - 1)) - 1;
+    for (int i = 0; i < 256; i++) {
+        r[i] = 1 & (a[i >> 3] >> (i & 7));
+    }
+    for (int i = 0; i < 256; i++) {
+        if (!r[i]) {
+            continue;
+        }
+        for (int b = 1; b <= w + 1 && i + b < 256; b++) {
+            if (!r[i + b]) {
+                continue;
+            }
+            if (r[i] + (r[i + b] << b) <= limit) {
+                r[i] += r[i + b] << b;
+                r[i + b] = 0;
+            }
+            else if (r[i] - (r[i + b] << b) >= -limit) {
+                r[i] -= r[i + b] << b;
+                for (int k = i + b; k < 256; k++) {
+                    if (!r[k]) {
+                        r[k] = 1;
+                        break;
+                    }
+                    r[k] = 0;
+                }
+            }
+            else {
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Odd multiples p, 3p .. 15p
+ */
+static void GeOddMultiples(GE_CACHED* r, const GE_P3& p, const FE d2)
+{
+    GE_P1P1 t;
+    GE_P3 p2, u;
+    GeP3ToCached(r[0], p, d2);
+    GeP3Dbl(t, p);
+    GeP1P1ToP3(p2, t);
+    for (int i = 1; i < 8; i++) {
+        GeAdd(t, p2, r[i - 1]);
+        GeP1P1ToP3(u, t);
+        GeP3ToCached(r[i], u, d2);
+    }
+}
+
+// Scalars mod L = 2^252 + 27742317777372353535851937790883648493, 4 words
+
+static const uint64_t SC_L[4] = {
+    0x5812631a5cf5d3edULL, 0x14def9dea2f79cd6ULL, 0x0000000000000000ULL, 0x1000000000000000ULL
+};
+
+struct SC_CONSTANTS {
+    uint64_t    k0;
+    // R^2 and R^3 mod L, R = 2^256
+    uint64_t    rr[4];
+    uint64_t    rrr[4];
+
+    SC_CONSTANTS()
+    {
+        // -L^-1 mod 2^64 by Newton iteration
+        uint64_t inv = 1;
+        for (int i = 0; i < 6; i++) {
+            inv *= 2 - SC_L[0] * inv;
+        }
+        k0 = 0 - inv;
+
+        BigNum l = BigNum::FromWords(SC_L, 4);
+        BigNum::Mod(BigNum(1).ShiftLeft(512), l).ToWords(rr, 4);
+        BigNum::Mod(BigNum(1).ShiftLeft(768), l).ToWords(rrr, 4);
+    }
+};
+
+static const SC_CONSTANTS& GetScConstants()
+{
+    static const SC_CONSTANTS constants;
+    return constants;
+}
+
+static void ScFromBytes(uint64_t* r, const CK_BYTE* s)
+{
+    for (int i = 0; i < 4; i++) {
+        r[i] = FeLoad64(s + 8 * i);
+    }
+}
+
+static void ScToBytes(CK_BYTE* s, const uint64_t* a)
+{
+    for (int i = 0; i < 4; i++) {
+        FeStore64(s + 8 * i, a[i]);
+    }
+}
+
+// r = a - L if a >= L, a < 2L
+static inline void ScReduceOnce(uint64_t* r, const uint64_t* a, uint64_t carry)
+{
+    uint64_t t[4], borrow = 0;
+    for (int i = 0; i < 4; i++) {
+        uint64_t d = a[i] - SC_L[i];
+        uint64_t b = (a[i] < SC_L[i]) | ((d < borrow) & 1);
+        t[i] = d - borrow;
+        borrow = b;
+    }
+    uint64_t mask = 0 - (carry | (borrow ^ 1));
+    for (int i = 0; i < 4; i++) {
+        r[i] = (t[i] & mask) | (a[i] & ~mask);
+    }
+}
+
+/**
+ * a b R^-1 mod L by CIOS, a < R and b < L
+ */
+static void ScMontMul(uint64_t* r, const uint64_t* a, const uint64_t* b)
+{
+    uint64_t k0 = GetScConstants().k0;
+    uint64_t t[6] = { 0 };
+    for (int i = 0; i < 4; i++) {
+        uint64_t c = 0;
+        for (int j = 0; j < 4; j++) {
+            FE_WIDE x = FeWideMul(a[i], b[j]) + t[j] + c;
+            t[j] = FeWideLo(x);
+            c = FeWideHi(x);
+        }
+        t[4] += c;
+        t[5] = t[4] < c;
+
+        uint64_t m = t[0] * k0;
+        FE_WIDE x = FeWideMul(m, SC_L[0]) + t[0];
+        c = FeWideHi(x);
+        for (int j = 1; j < 4; j++) {
+            x = FeWideMul(m, SC_L[j]) + t[j] + c;
+            t[j - 1] = FeWideLo(x);
+            c = FeWideHi(x);
+        }
+        t[3] = t[4] + c;
+        t[4] = t[5] + (t[3] < c);
+    }
+    ScReduceOnce(r, t, t[4]);
+}
+
+// a + b mod L, a, b < L
+static void ScAdd(uint64_t* r, const uint64_t* a, const uint64_t* b)
+{
+    uint64_t t[4], carry = 0;
+    for (int i = 0; i < 4; i++) {
+        uint64_t s = a[i] + carry;
+        carry = s < carry;
+        t[i] = s + b[i];
+        carry += t[i] < s;
+    }
+    ScReduceOnce(r, t, carry);
+}
+
+// a b mod L, a < R and b < L
+static void ScMul(uint64_t* r, const uint64_t* a, const uint64_t* b)
+{
+    uint64_t t[4];
+    ScMontMul(t, a, GetScConstants().rr);
+    ScMontMul(r, t, b);
+}
+
+// 64-byte little-endian number mod L
+static void ScReduce64(uint64_t* r, const CK_BYTE* s)
+{
+    const SC_CONSTANTS& constants = GetScConstants();
+    const uint64_t one[4] = { 1 };
+    uint64_t lo[4], hi[4];
+    ScFromBytes(lo, s);
+    ScFromBytes(hi, s + 32);
+    ScMontMul(lo, lo, constants.rr);
+    ScMontMul(hi, hi, constants.rrr);
+    ScAdd(lo, lo, hi);
+    ScMontMul(r, lo, one);
+}
+
+static bool ScIsCanonical(const CK_BYTE* s)
+{
+    uint64_t a[4];
+    ScFromBytes(a, s);
+    for (int i = 4; i--;) {
+        if (a[i] != SC_L[i]) {
+            return a[i] < SC_L[i];
+        }
+    }
+    return false;
+}
+
+/**
+ * SHA-512 of dom || a || b || message mod L
+ */
+static void Ed25519Hash(
+    uint64_t*           r,
+    const CK_BYTE*      pbDom,
+    size_t              domLen,
+    const CK_BYTE*      a,
+    const CK_BYTE*      b,
+    const CK_BYTE*      pbMessage,
+    size_t              messageLen
+)
+{
+    Sha sha;
+    sha.Init(CKM_SHA512);
+    if (domLen) {
+        sha.Update((CK_BYTE_PTR)pbDom, (CK_ULONG)domLen);
+    }
+    if (a) {
+        sha.Update((CK_BYTE_PTR)a, 32);
+    }
+    sha.Update((CK_BYTE_PTR)b, 32);
+    if (messageLen) {
+        sha.Update((CK_BYTE_PTR)pbMessage, (CK_ULONG)messageLen);
+    }
+    CK_BYTE hash[64];
+    sha.Final(hash);
+    ScReduce64(r, hash);
+    memset(hash, 0, sizeof(hash));
+}
+
+// Ed25519
+
+Ed25519::Ed25519() :
+    hasPrivateKey(false)
+{
+    memset(seed, 0, sizeof(seed));
+    memset(scalar, 0, sizeof(scalar));
+    memset(prefix, 0, sizeof(prefix));
+}
+
+Ed25519::~Ed25519()
+{
+    memset(seed, 0, sizeof(seed));
+    memset(scalar, 0, sizeof(scalar));
+    memset(prefix, 0, sizeof(prefix));
+}
+
+Scoped<Ed25519> Ed25519::Generate(
+    RANDOM_BYTES        random
+)
+{
+    CK_BYTE seed[ED25519_KEY_BYTES];
+    random(seed, sizeof(seed));
+    Scoped<Ed25519> res = FromSeed(seed);
+    memset(seed, 0, sizeof(seed));
+    return res;
+}
+
+Scoped<Ed25519> Ed25519::FromSeed(
+    const CK_BYTE*      pbSeed
+)
+{
+    const ED25519_TABLES& tables = GetTables();
+    Scoped<Ed25519> res(new Ed25519());
+    res->hasPrivateKey = true;
+    memcpy(res->seed, pbSeed, ED25519_KEY_BYTES);
+
+    CK_BYTE hash[64];
+    Sha sha;
+    sha.Init(CKM_SHA512);
+    sha.Update(res->seed, ED25519_KEY_BYTES);
+    sha.Final(hash);
+    hash[0] &= 248;
+    hash[31] &= 127;
+    hash[31] |= 64;
+    memcpy(res->prefix, hash + 32, sizeof(res->prefix));
+
+    // The clamped scalar is used mod L, B has order L
+    memset(hash + 32, 0, 32);
+    ScReduce64(res->scalar, hash);
+    ScToBytes(hash, res->scalar);
+
+    GE_P3 a;
+    GeScalarMultBase(a, hash, tables);
+    GeToBytes(res->publicKey, a);
+    GeOddMultiples((GE_CACHED*)res->table, a, tables.d2);
+    memset(hash, 0, sizeof(hash));
+
+    return res;
+}
+
+Scoped<Ed25519> Ed25519::FromPublicKey(
+    const CK_BYTE*      pbPublicKey
+)
+{
+    const ED25519_TABLES& tables = GetTables();
+    GE_P3 a;
+    if (!GeFromBytes(a, pbPublicKey, tables)) {
+        THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Wrong Ed25519 public key");
+    }
+    Scoped<Ed25519> res(new Ed25519());
+    memcpy(res->publicKey, pbPublicKey, ED25519_KEY_BYTES);
+    GeOddMultiples((GE_CACHED*)res->table, a, tables.d2);
+    return res;
+}
+
+bool Ed25519::HasPrivateKey() const
+{
+    return hasPrivateKey;
+}
+
+const CK_BYTE* Ed25519::GetSeed() const
+{
+    return seed;
+}
+
+const CK_BYTE* Ed25519::GetPublicKey() const
+{
+    return publicKey;
+}
+
+void Ed25519::Sign(
+    const CK_BYTE*      pbDom,
+    size_t              domLen,
+    const CK_BYTE*      pbMessage,
+    size_t              messageLen,
+    CK_BYTE*            pbSignature
+) const
+{
+    if (!hasPrivateKey) {
+        THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Ed25519 key is not private");
+    }
+    const ED25519_TABLES& tables = GetTables();
+
+    // r = H(dom || prefix || M), R = r B
+    uint64_t r[4], k[4], s[4];
+    CK_BYTE rBytes[32];
+    Ed25519Hash(r, pbDom, domLen, NULL, prefix, pbMessage, messageLen);
+    ScToBytes(rBytes, r);
+    GE_P3 rPoint;
+    GeScalarMultBase(rPoint, rBytes, tables);
+    GeToBytes(pbSignature, rPoint);
+
+    // S = r + H(dom || R || A || M) a
+    Ed25519Hash(k, pbDom, domLen, pbSignature, publicKey, pbMessage, messageLen);
+    ScMul(s, k, scalar);
+    ScAdd(s, s, r);
+    ScToBytes(pbSignature + 32, s);
+
+    memset(r, 0, sizeof(r));
+    memset(rBytes, 0, sizeof(rBytes));
+    memset(&rPoint, 0, sizeof(rPoint));
+}
+
+bool Ed25519::Verify(
+    const CK_BYTE*      pbDom,
+    size_t              domLen,
+    const CK_BYTE*      pbMessage,
+    size_t              messageLen,
+    const CK_BYTE*      pbSignature
+) const
+{
+    const ED25519_TABLES& tables = GetTables();
+    const GE_CACHED* aTable = (const GE_CACHED*)table;
+
+    GE_P3 rPoint;
+    if (!ScIsCanonical(pbSignature + 32) || !GeFromBytes(rPoint, pbSignature, tables)) {
+        return false;
+    }
+    uint64_t k[4];
+    CK_BYTE kBytes[32];
+    Ed25519Hash(k, pbDom, domLen, pbSignature, publicKey, pbMessage, messageLen);
+    ScToBytes(kBytes, k);
+
+    // S B - k A by wNAF with shared doublings
+    signed char kNaf[256], sNaf[256];
+    GeSlide(kNaf, kBytes, 5);
+    GeSlide(sNaf, pbSignature + 32, 8);
+    int top = 255;
+    while (top >= 0 && !kNaf[top] && !sNaf[top]) {
+        top--;
+    }
+
+    GE_P2 acc;
+    GE_P1P1 t;
+    GE_P3 u;
+    GeP2Zero(acc);
+    GeP3Zero(u);
+    for (int i = top; i >= 0; i--) {
+        GeP2Dbl(t, acc);
+        if (kNaf[i] > 0) {
+            GeP1P1ToP3(u, t);
+            GeSub(t, u, aTable[kNaf[i] / 2]);
+        }
+        else if (kNaf[i] < 0) {
+            GeP1P1ToP3(u, t);
+            GeAdd(t, u, aTable[-kNaf[i] / 2]);
+        }
+        if (sNaf[i] > 0) {
+            GeP1P1ToP3(u, t);
+            GeMadd(t, u, tables.odd[sNaf[i] / 2]);
+        }
+        else if (sNaf[i] < 0) {
+            GeP1P1ToP3(u, t);
+            GeMsub(t, u, tables.odd[-sNaf[i] / 2]);
+        }
+        GeP1P1ToP2(acc, t);
+    }
+    if (top >= 0) {
+        GeP1P1ToP3(u, t);
+    }
+
+    // [8](S B - k A - R) is the identity
+    GE_CACHED rCached;
+    GeP3ToCached(rCached, rPoint, tables.d2);
+    GeSub(t, u, rCached);
+    GeP1P1ToP2(acc, t);
+    for (int i = 0; i < 3; i++) {
+        GeP2Dbl(t, acc);
+        GeP1P1ToP2(acc, t);
+    }
+    return GeIsIdentity(acc);
+}
+
+bool Ed25519::VerifyBatch(
+    const VERIFY_ITEM*  items,
+    size_t              count,
+    RANDOM_BYTES        random
+)
+{
+    if (!count) {
+        return true;
+    }
+    const ED25519_TABLES& tables = GetTables();
+
+    // sum z_i R_i + sum z_i k_i A_i - (sum z_i S_i) B, z_i are random numbers of 128 bits
+    std::vector<GE_CACHED> rTables(8 * count);
+    std::vector<signed char> naf(2 * 256 * count);
+    uint64_t sum[4] = { 0 };
+    for (size_t i = 0; i < count; i++) {
+        const VERIFY_ITEM& item = items[i];
+        GE_P3 rPoint;
+        if (!ScIsCanonical(item.pbSignature + 32) || !GeFromBytes(rPoint, item.pbSignature, tables)) {
+            return false;
+        }
+        GeOddMultiples(&rTables[8 * i], rPoint, tables.d2);
+
+        CK_BYTE zBytes[32] = { 0 };
+        do {
+            random(zBytes, 16);
+        } while (!(FeLoad64(zBytes) | FeLoad64(zBytes + 8)));
+        uint64_t z[4], k[4], s[4];
+        ScFromBytes(z, zBytes);
+        Ed25519Hash(k, item.pbDom, item.domLen, item.pbSignature, item.key->publicKey, item.pbMessage, item.messageLen);
+        ScMul(k, z, k);
+        ScFromBytes(s, item.pbSignature + 32);
+        ScMul(s, z, s);
+        ScAdd(sum, sum, s);
+
+        CK_BYTE kBytes[32];
+        ScToBytes(kBytes, k);
+        GeSlide(&naf[2 * 256 * i], zBytes, 5);
+        GeSlide(&naf[2 * 256 * i + 256], kBytes, 5);
+    }
+    CK_BYTE sumBytes[32];
+    signed char sumNaf[256];
+    ScToBytes(sumBytes, sum);
+    GeSlide(sumNaf, sumBytes, 8);
+
+    int top = 255;
+    while (top >= 0 && !sumNaf[top]) {
+        bool found = false;
+        for (size_t i = 0; i < 2 * count && !found; i++) {
+            found = naf[256 * i + top] != 0;
+        }
+        if (found) {
+            break;
+        }
+        top--;
+    }
+
+    GE_P2 acc;
+    GE_P1P1 t;
+    GE_P3 u;
+    GeP2Zero(acc);
+    GeP3Zero(u);
+    for (int j = top; j >= 0; j--) {
+        GeP2Dbl(t, acc);
+        for (size_t i = 0; i < count; i++) {
+            const GE_CACHED* points[2] = { &rTables[8 * i], (const GE_CACHED*)items[i].key->table };
+            for (int p = 0; p < 2; p++) {
+                int digit = naf[256 * (2 * i + p) + j];
+                if (digit > 0) {
+                    GeP1P1ToP3(u, t);
+                    GeAdd(t, u, points[p][digit / 2]);
+                }
+                else if (digit < 0) {
+                    GeP1P1ToP3(u, t);
+                    GeSub(t, u, points[p][-digit / 2]);
+                }
+            }
+        }
+        if (sumNaf[j] > 0) {
+            GeP1P1ToP3(u, t);
+            GeMsub(t, u, tables.odd[sumNaf[j] / 2]);
+        }
+        else if (sumNaf[j] < 0) {
+            GeP1P1ToP3(u, t);
+            GeMadd(t, u, tables.odd[-sumNaf[j] / 2]);
+        }
+        GeP1P1ToP2(acc, t);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        GeP2Dbl(t, acc);
+        GeP1P1ToP2(acc, t);
+    }
+    return GeIsIdentity(acc);
+}
+
+// X25519
+
+static void X25519Clamp(CK_BYTE* scalar, const CK_BYTE* pbPrivateKey)
+{
+    memcpy(scalar, pbPrivateKey, X25519_KEY_BYTES);
+    scalar[0] &= 248;
+    scalar[31] &= 127;
+    scalar[31] |= 64;
+}
+
+/**
+ * u-coordinate of k u by the ladder of RFC 7748, k is clamped
+ */
+static void X25519Ladder(CK_BYTE* out, const CK_BYTE* k, const CK_BYTE* pbU)
+{
+    FE x1, x2, z2, x3, z3, a, aa, b, bb, e, c, d, da, cb;
+    FeFromBytes(x1, pbU);
+    FeOne(x2);
+    FeZero(z2);
+    FeCopy(x3, x1);
+    FeOne(z3);
+
+    uint64_t swap = 0;
+    for (int t = 254; t >= 0; t--) {
+        uint64_t bit = (k[t >> 3] >> (t & 7)) & 1;
+        swap ^= bit;
+        FeCSwap(x2, x3, 0 - swap);
+        FeCSwap(z2, z3, 0 - swap);
+        swap = bit;
+
+        FeAdd(a, x2, z2);
+        FeSubReduced(b, x2, z2);
+        FeAdd(c, x3, z3);
+        FeSubReduced(d, x3, z3);
+        FeSq(aa, a);
+        FeSq(bb, b);
+        FeMul(da, d, a);
+        FeMul(cb, c, b);
+        FeSubReduced(e, aa, bb);
+
+        FeAdd(x3, da, cb);
+        FeSq(x3, x3);
+        FeSubReduced(z3, da, cb);
+        FeSq(z3, z3);
+        FeMul(z3, z3, x1);
+
+        FeMul(x2, aa, bb);
+        FeMulSmall(z2, e, 121665);
+        FeAdd(z2, z2, aa);
+        FeMul(z2, z2, e);
+    }
+    FeCSwap(x2, x3, 0 - swap);
+    FeCSwap(z2, z3, 0 - swap);
+
+    FeInvert(z2, z2);
+    FeMul(x2, x2, z2);
+    FeToBytes(out, x2);
+}
+
+X25519::X25519()
+{
+    memset(privateKey, 0, sizeof(privateKey));
+    memset(scalar, 0, sizeof(scalar));
+    memset(publicKey, 0, sizeof(publicKey));
+}
+
+X25519::~X25519()
+{
+    memset(privateKey, 0, sizeof(privateKey));
+    memset(scalar, 0, sizeof(scalar));
+}
+
+Scoped<X25519> X25519::Generate(
+    RANDOM_BYTES        random
+)
+{
+    CK_BYTE value[X25519_KEY_BYTES];
+    random(value, sizeof(value));
+    Scoped<X25519> res = FromPrivateKey(value);
+    memset(value, 0, sizeof(value));
+    return res;
+}
+
+Scoped<X25519> X25519::FromPrivateKey(
+    const CK_BYTE*      pbPrivateKey
+)
+{
+    Scoped<X25519> res(new X25519());
+    memcpy(res->privateKey, pbPrivateKey, X25519_KEY_BYTES);
+    X25519Clamp(res->scalar, pbPrivateKey);
+
+    // u = (1 + y) / (1 - y) of the Edwards point, the generator u = 9 maps to B
+    GE_P3 a;
+    FE n, d;
+    GeScalarMultBase(a, res->scalar, GetTables());
+    FeAdd(n, a.Z, a.Y);
+    FeSub(d, a.Z, a.Y);
+    FeInvert(d, d);
+    FeMul(n, n, d);
+    FeToBytes(res->publicKey, n);
+    memset(&a, 0, sizeof(a));
+
+    return res;
+}
+
+const CK_BYTE* X25519::GetPrivateKey() const
+{
+    return privateKey;
+}
+
+const CK_BYTE* X25519::GetPublicKey() const
+{
+    return publicKey;
+}
+
+bool X25519::Derive(
+    const CK_BYTE*      pbPeerKey,
+    CK_BYTE*            pbSecret
+) const
+{
+    X25519Ladder(pbSecret, scalar, pbPeerKey);
+
+    CK_BYTE acc = 0;
+    for (int i = 0; i < X25519_KEY_BYTES; i++) {
+        acc |= pbSecret[i];
+    }
+    return acc != 0;
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "../../stdafx.h"
+#include "../excep.h"
+#include "bn.h"
+
+namespace core {
+
+#define X25519_KEY_BYTES            32
+#define ED25519_KEY_BYTES           32
+#define ED25519_SIGNATURE_BYTES     64
+// Odd multiples A, 3A .. 15A of the public point, 4 field elements of 5 limbs each
+#define ED25519_POINT_TABLE_LIMBS   (8 * 4 * 5)
+
+    /**
+     * Ed25519 of RFC 8032. Field elements have 5 limbs of 51 bits. The generator is multiplied
+     * by a constant-time table of 32 windows of 8 bits, verification shares doublings of the
+     * generator and the public point by wNAF.
+     *
+     * Signatures are checked by the cofactored equation [8][S]B = [8]R + [8][k]A, so single
+     * and batch verification accept the same signatures. S must be less than the group order
+     * and points must be canonical
+     */
+    class Ed25519 {
+    public:
+        /**
+         * Private key of a random seed
+         */
+        static Scoped<Ed25519> Generate(
+            RANDOM_BYTES        random
+        );
+
+        /**
+         * Private key of the 32-byte seed
+         */
+        static Scoped<Ed25519> FromSeed(
+            const CK_BYTE*      pbSeed
+        );
+
+        /**
+         * Public key of the 32-byte encoded point. Throws CKR_ATTRIBUTE_VALUE_INVALID if it's
+         * not a point of the curve
+         */
+        static Scoped<Ed25519> FromPublicKey(
+            const CK_BYTE*      pbPublicKey
+        );
+
+        ~Ed25519();
+
+        bool HasPrivateKey() const;
+        const CK_BYTE* GetSeed() const;
+        const CK_BYTE* GetPublicKey() const;
+
+        /**
+         * Signature R || S of the message. dom is the prefix of both hashes, it's empty for
+         * Ed25519 and dom2(F, C) for Ed25519ctx and Ed25519ph
+         */
+        void Sign(
+            const CK_BYTE*      pbDom,
+            size_t              domLen,
+            const CK_BYTE*      pbMessage,
+            size_t              messageLen,
+            CK_BYTE*            pbSignature
+        ) const;
+
+        bool Verify(
+            const CK_BYTE*      pbDom,
+            size_t              domLen,
+            const CK_BYTE*      pbMessage,
+            size_t              messageLen,
+            const CK_BYTE*      pbSignature
+        ) const;
+
+        struct VERIFY_ITEM {
+            const Ed25519*      key;
+            const CK_BYTE*      pbDom;
+            size_t              domLen;
+            const CK_BYTE*      pbMessage;
+            size_t              messageLen;
+            const CK_BYTE*      pbSignature;
+        };
+
+        /**
+         * Checks a random linear combination of the signatures by one multi-scalar
+         * multiplication. Returns true if all of them are valid, false if any signature is
+         * invalid, then items should be verified one by one
+         */
+        static bool VerifyBatch(
+            const VERIFY_ITEM*  items,
+            size_t              count,
+            RANDOM_BYTES        random
+        );
+
+    protected:
+        bool                hasPrivateKey;
+        CK_BYTE             seed[ED25519_KEY_BYTES];
+        CK_BYTE             publicKey[ED25519_KEY_BYTES];
+        // Clamped scalar mod L and the nonce prefix of the seed hash
+        uint64_t            scalar[4];
+        CK_BYTE             prefix[32];
+        // Odd multiples of the public point for verification
+        uint64_t            table[ED25519_POINT_TABLE_LIMBS];
+
+        Ed25519();
+    };
+
+    /**
+     * X25519 of RFC 7748. The public key is computed by the Edwards generator table, the
+     * shared secret by a constant-time Montgomery ladder of the same field arithmetic
+     */
+    class X25519 {
+    public:
+        /**
+         * Private key of random bytes
+         */
+        static Scoped<X25519> Generate(
+            RANDOM_BYTES        random
+        );
+
+        /**
+         * Private key of the 32-byte private value, it's clamped on use
+         */
+        static Scoped<X25519> FromPrivateKey(
+            const CK_BYTE*      pbPrivateKey
+        );
+
+        ~X25519();
+
+        const CK_BYTE* GetPrivateKey() const;
+        const CK_BYTE* GetPublicKey() const;
+
+        /**
+         * Writes the 32-byte shared secret of the peer's u-coordinate. Returns false if the
+         * secret is all zeros, the peer's point has small order then
+         */
+        bool Derive(
+            const CK_BYTE*      pbPeerKey,
+            CK_BYTE*            pbSecret
+        ) const;
+
+    protected:
+        CK_BYTE             privateKey[X25519_KEY_BYTES];
+        // Clamped private value
+        CK_BYTE             scalar[X25519_KEY_BYTES];
+        CK_BYTE             publicKey[X25519_KEY_BYTES];
+
+        X25519();
+    };
+
+}
@@ -0,0 +1,135 @@
+#include "drbg.h"
+
+using namespace core;
+
+#define CTR_DRBG_KEY_LENGTH     32
+
+CtrDrbg::CtrDrbg() :
+    reseedCounter(0)
+{
+    memset(v, 0, sizeof(v));
+}
+
+CtrDrbg::~CtrDrbg()
+{
+    memset(v, 0, sizeof(v));
+}
+
+void CtrDrbg::Update(
+    const CK_BYTE*      pbProvided
+)
+{
+    CK_BYTE zeros[CTR_DRBG_SEED_LENGTH];
+    if (!pbProvided) {
+        memset(zeros, 0, sizeof(zeros));
+        pbProvided = zeros;
+    }
+
+    // Key stream of V + 1, V + 2 and V + 3 XORed with provided data is the new key and V
+    CK_BYTE temp[CTR_DRBG_SEED_LENGTH];
+    AesAddCounter(v, 1);
+    aes->Ctr(v, pbProvided, temp, CTR_DRBG_SEED_LENGTH);
+
+    aes.reset(new Aes(temp, CTR_DRBG_KEY_LENGTH));
+    memcpy(v, temp + CTR_DRBG_KEY_LENGTH, AES_BLOCK_LENGTH);
+
+    memset(temp, 0, sizeof(temp));
+}
+
+void CtrDrbg::Instantiate(
+    const CK_BYTE*      pbEntropy,
+    const CK_BYTE*      pbPersonalization
+)
+{
+    try {
+        if (pbEntropy == NULL) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pbEntropy is NULL");
+        }
+
+        CK_BYTE seed[CTR_DRBG_SEED_LENGTH];
+        memcpy(seed, pbEntropy, sizeof(seed));
+        if (pbPersonalization) {
+            for (size_t i = 0; i < sizeof(seed); i++) {
+                seed[i] ^= pbPersonalization[i];
+            }
+        }
+
+        CK_BYTE key[CTR_DRBG_KEY_LENGTH];
+        memset(key, 0, sizeof(key));
+        aes.reset(new Aes(key, CTR_DRBG_KEY_LENGTH));
+        memset(v, 0, sizeof(v));
+        Update(seed);
+        reseedCounter = 1;
+
+        memset(seed, 0, sizeof(seed));
+    }
+    CATCH_EXCEPTION
+}
+
+void CtrDrbg::Reseed(
+    const CK_BYTE*      pbEntropy,
+    const CK_BYTE*      pbAdditional
+)
+{
+    try {
+        if (!aes) {
+            THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "CTR_DRBG is not instantiated");
+        }
+        if (pbEntropy == NULL) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pbEntropy is NULL");
+        }
+
+        CK_BYTE seed[CTR_DRBG_SEED_LENGTH];
+        memcpy(seed, pbEntropy, sizeof(seed));
+        if (pbAdditional) {
+            for (size_t i = 0; i < sizeof(seed); i++) {
+                seed[i] ^= pbAdditional[i];
+            }
+        }
+
+        Update(seed);
+        reseedCounter = 1;
+
+        memset(seed, 0, sizeof(seed));
+    }
+    CATCH_EXCEPTION
+}
+
+bool CtrDrbg::NeedsReseed()
+{
+    return !aes || reseedCounter > CTR_DRBG_RESEED_INTERVAL;
+}
+
+void CtrDrbg::Generate(
+    CK_BYTE*            pbOut,
+    size_t              len,
+    const CK_BYTE*      pbAdditional
+)
+{
+    try {
+        if (len > CTR_DRBG_MAX_REQUEST_LENGTH) {
+            THROW_PKCS11_EXCEPTION(CKR_DATA_LEN_RANGE, "Request is longer than CTR_DRBG_MAX_REQUEST_LENGTH");
+        }
+        if (NeedsReseed()) {
+            THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "CTR_DRBG needs reseed");
+        }
+
+        if (pbAdditional) {
+            Update(pbAdditional);
+        }
+
+        // Output is the key stream from V + 1, V is left at the last block used
+        CK_BYTE counter[AES_BLOCK_LENGTH];
+        memcpy(counter, v, sizeof(counter));
+        AesAddCounter(counter, 1);
+        memset(pbOut, 0, len);
+        aes->Ctr(counter, pbOut, pbOut, len);
+        AesAddCounter(v, (len + AES_BLOCK_LENGTH - 1) / AES_BLOCK_LENGTH);
+
+        Update(pbAdditional);
+        reseedCounter++;
+
+        memset(counter, 0, sizeof(counter));
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../../stdafx.h"
+#include "../excep.h"
+#include "aes.h"
+
+namespace core {
+
+// AES-256 key and V block
+#define CTR_DRBG_SEED_LENGTH            48
+// SP 800-90A limits a request of AES CTR_DRBG to 2^19 bits
+#define CTR_DRBG_MAX_REQUEST_LENGTH     (64 * 1024)
+// Requests after which Generate must not be called before Reseed. The limit of
+// SP 800-90A is 2^48, a smaller one keeps the state close to fresh entropy
+#define CTR_DRBG_RESEED_INTERVAL        (1 << 16)
+
+    /**
+     * CTR_DRBG of SP 800-90A with AES-256 and without derivation function. Entropy,
+     * personalization string and additional input are CTR_DRBG_SEED_LENGTH bytes, a
+     * caller with other data hashes it first. The object is not shared between threads
+     */
+    class CtrDrbg {
+    public:
+        CtrDrbg();
+        ~CtrDrbg();
+
+        /**
+         * pbPersonalization may be NULL
+         */
+        void Instantiate(
+            const CK_BYTE*      pbEntropy,
+            const CK_BYTE*      pbPersonalization
+        );
+
+        /**
+         * pbAdditional may be NULL
+         */
+        void Reseed(
+            const CK_BYTE*      pbEntropy,
+            const CK_BYTE*      pbAdditional
+        );
+
+        /**
+         * Returns true if Reseed must be called before Generate
+         */
+        bool NeedsReseed();
+
+        /**
+         * pbAdditional may be NULL. Throws CKR_DATA_LEN_RANGE if len exceeds
+         * CTR_DRBG_MAX_REQUEST_LENGTH and CKR_FUNCTION_FAILED if the state needs reseed
+         */
+        void Generate(
+            CK_BYTE*            pbOut,
+            size_t              len,
+            const CK_BYTE*      pbAdditional
+        );
+
+    protected:
+        Scoped<Aes>         aes;
+        CK_BYTE             v[AES_BLOCK_LENGTH];
+        uint64_t            reseedCounter;
+
+        /**
+         * CTR_DRBG_Update, pbProvided is NULL for zeros
+         */
+        void Update(
+            const CK_BYTE*      pbProvided
+        );
+    };
+
+}
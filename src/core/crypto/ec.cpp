@@ -0,0 +1,1506 @@
+#include "ec.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+using namespace core;
+
+// Bits of a signed window of the comb and of the variable-base multiplication
+#define EC_WINDOW_BITS          5
+// Points of a window, multiples 1 .. 2^(EC_WINDOW_BITS - 1)
+#define EC_WINDOW_POINTS        16
+#define EC_MAX_WORDS            9
+
+// Loops over words of fixed count are unrolled, the words stay in registers
+#if defined(__GNUC__) || defined(__clang__)
+#define EC_UNROLL               _Pragma("GCC unroll 16")
+#else
+#define EC_UNROLL
+#endif
+
+static const CK_BYTE EC_P256_OID[] = { 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07 };
+static const CK_BYTE EC_P384_OID[] = { 0x06, 0x05, 0x2b, 0x81, 0x04, 0x00, 0x22 };
+static const CK_BYTE EC_P521_OID[] = { 0x06, 0x05, 0x2b, 0x81, 0x04, 0x00, 0x23 };
+
+// a * b + c + carry, the high word goes to carry
+static inline uint64_t EcMac(uint64_t a, uint64_t b, uint64_t c, uint64_t* carry)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 t = (unsigned __int128)a * b + c + *carry;
+    *carry = (uint64_t)(t >> 64);
+    return (uint64_t)t;
+#elif defined(_MSC_VER) && defined(_M_X64)
+    uint64_t hi;
+    uint64_t lo = _umul128(a, b, &hi);
+    lo += c;
+    hi += lo < c;
+    lo += *carry;
+    hi += lo < *carry;
+    *carry = hi;
+    return lo;
+#else
+    uint64_t aLo = (uint32_t)a, aHi = a >> 32;
+    uint64_t bLo = (uint32_t)b, bHi = b >> 32;
+    uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+    uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+    uint64_t lo = (mid << 32) | (uint32_t)ll;
+    uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    lo += c;
+    hi += lo < c;
+    lo += *carry;
+    hi += lo < *carry;
+    *carry = hi;
+    return lo;
+#endif
+}
+
+static inline uint64_t EcAdc(uint64_t a, uint64_t b, uint64_t* carry)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 t = (unsigned __int128)a + b + *carry;
+    *carry = (uint64_t)(t >> 64);
+    return (uint64_t)t;
+#else
+    uint64_t t = a + *carry;
+    uint64_t c = t < a;
+    uint64_t r = t + b;
+    *carry = c | (r < b);
+    return r;
+#endif
+}
+
+static inline uint64_t EcSbb(uint64_t a, uint64_t b, uint64_t* borrow)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 t = (unsigned __int128)a - b - *borrow;
+    *borrow = (uint64_t)(t >> 64) & 1;
+    return (uint64_t)t;
+#else
+    uint64_t t = a - b;
+    uint64_t c = a < b;
+    uint64_t r = t - *borrow;
+    *borrow = c | (t < *borrow);
+    return r;
+#endif
+}
+
+// All bits are set if a equals b
+static inline uint64_t EcEqualMask(uint64_t a, uint64_t b)
+{
+    uint64_t diff = a ^ b;
+    return 0 - (((diff | (0 - diff)) >> 63) ^ 1);
+}
+
+static void EcFromBytes(uint64_t* r, size_t n, const CK_BYTE* pbData, size_t len)
+{
+    memset(r, 0, n * sizeof(uint64_t));
+    for (size_t i = 0; i < len; i++) {
+        r[i / 8] |= (uint64_t)pbData[len - 1 - i] << (8 * (i % 8));
+    }
+}
+
+static void EcToBytes(CK_BYTE* pbData, size_t len, const uint64_t* a)
+{
+    for (size_t i = 0; i < len; i++) {
+        pbData[len - 1 - i] = (CK_BYTE)(a[i / 8] >> (8 * (i % 8)));
+    }
+}
+
+static BigNum EcFromHex(const char* hex)
+{
+    Buffer bytes(strlen(hex) / 2);
+    for (size_t i = 0; i < bytes.size(); i++) {
+        char digits[3] = { hex[2 * i], hex[2 * i + 1], 0 };
+        bytes[i] = (CK_BYTE)strtoul(digits, NULL, 16);
+    }
+    return BigNum::FromBytes(bytes.data(), bytes.size());
+}
+
+// Booth recoding of a window of EC_WINDOW_BITS + 1 bits to a digit 0 .. 16 and a sign
+static inline void EcBoothRecode(uint64_t window, uint64_t* pSign, uint64_t* pDigit)
+{
+    uint64_t sign = 0 - (window >> EC_WINDOW_BITS);
+    uint64_t digit = (1 << (EC_WINDOW_BITS + 1)) - window - 1;
+    digit = (digit & sign) | (window & ~sign);
+    *pSign = sign & 1;
+    *pDigit = (digit >> 1) + (digit & 1);
+}
+
+// Bits 5i - 1 .. 5i + 4 of the scalar, bit -1 is zero. Scalar has a zero word above its words
+static inline uint64_t EcGetWindow(const uint64_t* k, size_t i)
+{
+    const uint64_t mask = (1 << (EC_WINDOW_BITS + 1)) - 1;
+    if (!i) {
+        return (k[0] << 1) & mask;
+    }
+    size_t bit = EC_WINDOW_BITS * i - 1;
+    size_t word = bit / 64;
+    size_t shift = bit % 64;
+    uint64_t window = k[word] >> shift;
+    if (shift > 64 - EC_WINDOW_BITS - 1) {
+        window |= k[word + 1] << (64 - shift);
+    }
+    return window & mask;
+}
+
+/**
+ * Modulus of Montgomery arithmetic with numbers of N words
+ */
+template<size_t N>
+struct EC_MODULUS {
+    uint64_t            m[N];
+    // -m^-1 mod 2^64
+    uint64_t            k0;
+    // R^2 and R mod m, R is 2^(64 * N)
+    uint64_t            rr[N];
+    uint64_t            one[N];
+    // m - 2, exponent of the inversion
+    uint64_t            inv[N];
+};
+
+template<size_t N>
+static void EcModulusInit(EC_MODULUS<N>& mod, const BigNum& m)
+{
+    m.ToWords(mod.m, N);
+    // Newton iteration doubles correct bits of m^-1, m is its own inverse mod 8
+    uint64_t x = mod.m[0];
+    for (int i = 0; i < 5; i++) {
+        x *= 2 - mod.m[0] * x;
+    }
+    mod.k0 = 0 - x;
+    BigNum::Mod(BigNum(1).ShiftLeft(128 * N), m).ToWords(mod.rr, N);
+    BigNum::Mod(BigNum(1).ShiftLeft(64 * N), m).ToWords(mod.one, N);
+    BigNum::Sub(m, BigNum(2)).ToWords(mod.inv, N);
+}
+
+/**
+ * Montgomery product of N words, the loops are unrolled by the compiler. a < R, b < m, the
+ * result is less than m. Output may be the same buffer as input
+ */
+template<size_t N>
+static inline void EcMontMul(uint64_t* r, const uint64_t* a, const uint64_t* b, const uint64_t* m, uint64_t k0)
+{
+    uint64_t t[N + 2] = { 0 };
+    EC_UNROLL
+    for (size_t i = 0; i < N; i++) {
+        uint64_t carry = 0;
+        EC_UNROLL
+        for (size_t j = 0; j < N; j++) {
+            t[j] = EcMac(a[j], b[i], t[j], &carry);
+        }
+        uint64_t s = t[N] + carry;
+        t[N + 1] = s < carry;
+        t[N] = s;
+
+        uint64_t q = t[0] * k0;
+        carry = 0;
+        EcMac(q, m[0], t[0], &carry);
+        EC_UNROLL
+        for (size_t j = 1; j < N; j++) {
+            t[j - 1] = EcMac(q, m[j], t[j], &carry);
+        }
+        s = t[N] + carry;
+        t[N - 1] = s;
+        t[N] = t[N + 1] + (s < carry);
+    }
+
+    // t < 2m, m is subtracted if t >= m
+    uint64_t d[N];
+    uint64_t borrow = 0;
+    EC_UNROLL
+    for (size_t j = 0; j < N; j++) {
+        d[j] = EcSbb(t[j], m[j], &borrow);
+    }
+    uint64_t mask = 0 - (t[N] | (borrow ^ 1));
+    EC_UNROLL
+    for (size_t j = 0; j < N; j++) {
+        r[j] = (d[j] & mask) | (t[j] & ~mask);
+    }
+}
+
+// Multiplications of P-256 and P-384 have fixed size
+template<size_t N>
+struct EC_FIXED_MUL {
+    static void Mul(uint64_t* r, const uint64_t* a, const uint64_t* b, const EC_MODULUS<N>& mod)
+    {
+        EcMontMul<N>(r, a, b, mod.m, mod.k0);
+    }
+};
+
+// Multiplication of BigNum for other sizes
+template<size_t N>
+struct EC_GENERIC_MUL {
+    static void Mul(uint64_t* r, const uint64_t* a, const uint64_t* b, const EC_MODULUS<N>& mod)
+    {
+        BnMontMul(r, a, b, mod.m, mod.k0, N);
+    }
+};
+
+template<size_t N>
+static inline void EcModAdd(uint64_t* r, const uint64_t* a, const uint64_t* b, const EC_MODULUS<N>& mod)
+{
+    uint64_t t[N], d[N];
+    uint64_t carry = 0, borrow = 0;
+    EC_UNROLL
+    for (size_t i = 0; i < N; i++) {
+        t[i] = EcAdc(a[i], b[i], &carry);
+    }
+    EC_UNROLL
+    for (size_t i = 0; i < N; i++) {
+        d[i] = EcSbb(t[i], mod.m[i], &borrow);
+    }
+    uint64_t mask = 0 - (carry | (borrow ^ 1));
+    EC_UNROLL
+    for (size_t i = 0; i < N; i++) {
+        r[i] = (d[i] & mask) | (t[i] & ~mask);
+    }
+}
+
+template<size_t N>
+static inline void EcModSub(uint64_t* r, const uint64_t* a, const uint64_t* b, const EC_MODULUS<N>& mod)
+{
+    uint64_t borrow = 0, carry = 0;
+    EC_UNROLL
+    for (size_t i = 0; i < N; i++) {
+        r[i] = EcSbb(a[i], b[i], &borrow);
+    }
+    uint64_t mask = 0 - borrow;
+    EC_UNROLL
+    for (size_t i = 0; i < N; i++) {
+        r[i] = EcAdc(r[i], mod.m[i] & mask, &carry);
+    }
+}
+
+// Returns 1 if a < b
+template<size_t N>
+static inline uint64_t EcLess(const uint64_t* a, const uint64_t* b)
+{
+    uint64_t borrow = 0;
+    EC_UNROLL
+    for (size_t i = 0; i < N; i++) {
+        EcSbb(a[i], b[i], &borrow);
+    }
+    return borrow;
+}
+
+template<size_t N>
+static inline bool EcIsZero(const uint64_t* a)
+{
+    uint64_t bits = 0;
+    EC_UNROLL
+    for (size_t i = 0; i < N; i++) {
+        bits |= a[i];
+    }
+    return !bits;
+}
+
+template<size_t N>
+static inline void EcCopyMasked(uint64_t* r, const uint64_t* a, uint64_t mask)
+{
+    EC_UNROLL
+    for (size_t i = 0; i < N; i++) {
+        r[i] = (a[i] & mask) | (r[i] & ~mask);
+    }
+}
+
+/**
+ * Curve y^2 = x^3 - 3x + b of N words, MUL is the Montgomery multiplication of the field and
+ * of the order
+ */
+template<size_t N, class MUL>
+class EcPrimeCurve : public EcCurve {
+public:
+    EcPrimeCurve(
+        const char*         name,
+        const CK_BYTE*      pbParams,
+        size_t              paramsLen,
+        const char*         p,
+        const char*         n,
+        const char*         b,
+        const char*         gx,
+        const char*         gy
+    );
+
+    bool IsOnCurve(
+        const CK_BYTE*      pbPoint
+    ) const;
+
+    void GenerateKey(
+        CK_BYTE*            pbPrivate,
+        CK_BYTE*            pbPoint,
+        RANDOM_BYTES        random
+    ) const;
+
+    void Sign(
+        const CK_BYTE*      pbPrivate,
+        const CK_BYTE*      pbHash,
+        size_t              hashLen,
+        CK_BYTE*            pbSignature,
+        RANDOM_BYTES        random
+    ) const;
+
+    bool Verify(
+        const CK_BYTE*      pbPoint,
+        const CK_BYTE*      pbHash,
+        size_t              hashLen,
+        const CK_BYTE*      pbSignature
+    ) const;
+
+    size_t GetVerifyTableSize() const;
+
+    Scoped<EcVerifyTable> CreateVerifyTable(
+        const CK_BYTE*      pbPoint
+    ) const;
+
+    bool Verify(
+        const EcVerifyTable* table,
+        const CK_BYTE*      pbHash,
+        size_t              hashLen,
+        const CK_BYTE*      pbSignature
+    ) const;
+
+    bool Derive(
+        const CK_BYTE*      pbPrivate,
+        const CK_BYTE*      pbPoint,
+        CK_BYTE*            pbSecret
+    ) const;
+
+protected:
+    // Field elements are in Montgomery form
+    struct POINT {
+        uint64_t        x[N];
+        uint64_t        y[N];
+        uint64_t        z[N];
+    };
+    struct AFFINE {
+        uint64_t        x[N];
+        uint64_t        y[N];
+    };
+
+    EC_MODULUS<N>       p;
+    EC_MODULUS<N>       n;
+    uint64_t            b[N];
+    AFFINE              g;
+    size_t              windows;
+    // EC_WINDOW_POINTS multiples of 2^(5i) * G for each window i
+    std::vector<AFFINE> comb;
+
+    struct COMB_TABLE : public EcVerifyTable {
+        std::vector<AFFINE> comb;
+    };
+
+    void FieldMul(uint64_t* r, const uint64_t* a, const uint64_t* c) const { MUL::Mul(r, a, c, p); }
+    void FieldAdd(uint64_t* r, const uint64_t* a, const uint64_t* c) const { EcModAdd<N>(r, a, c, p); }
+    void FieldSub(uint64_t* r, const uint64_t* a, const uint64_t* c) const { EcModSub<N>(r, a, c, p); }
+    void OrderMul(uint64_t* r, const uint64_t* a, const uint64_t* c) const { MUL::Mul(r, a, c, n); }
+
+    /**
+     * a^(m - 2) in Montgomery form by fixed windows, the exponent is public
+     */
+    static void Invert(uint64_t* r, const uint64_t* a, const EC_MODULUS<N>& mod);
+
+    void Double(POINT& r, const POINT& a) const;
+    void Add(POINT& r, const POINT& a, const POINT& c) const;
+    // c is not the point at infinity
+    void AddMixed(POINT& r, const POINT& a, const AFFINE& c) const;
+
+    // Fills windows * EC_WINDOW_POINTS multiples of q, the same layout as of the generator
+    void BuildComb(AFFINE* table, const AFFINE& q) const;
+
+    /**
+     * Decodes x || y into Montgomery form. Returns false if a coordinate is not less than p
+     */
+    bool DecodePoint(AFFINE& r, const CK_BYTE* pbPoint) const;
+    // Returns false for the point at infinity
+    bool EncodeX(CK_BYTE* pbX, uint64_t* y, const POINT& a) const;
+
+    /**
+     * Random scalar in [1, n - 1]
+     */
+    void RandomScalar(uint64_t* k, RANDOM_BYTES random) const;
+    bool DecodeScalar(uint64_t* k, const CK_BYTE* pbScalar) const;
+    // Leftmost orderBits of the hash mod n
+    void HashToScalar(uint64_t* e, const CK_BYTE* pbHash, size_t hashLen) const;
+
+    // k * G, k has a zero word above N words. Constant-time
+    void MulBase(POINT& r, const uint64_t* k) const;
+    // k * q, k has a zero word above N words. Constant-time
+    void MulPoint(POINT& r, const AFFINE& q, const uint64_t* k) const;
+    // u1 * G + u2 * q, variable time for verification
+    void MulBaseAdd(POINT& r, const uint64_t* u1, const AFFINE& q, const uint64_t* u2) const;
+    // Adds k * q of the comb of q to r, variable time
+    void AddComb(POINT& r, const AFFINE* table, const uint64_t* k) const;
+
+    /**
+     * Decodes r and computes u1 = e / s, u2 = r / s. Returns false if r or s is not in
+     * [1, n - 1]
+     */
+    bool VerifyScalars(uint64_t* r, uint64_t* u1, uint64_t* u2, const CK_BYTE* pbHash,
+        size_t hashLen, const CK_BYTE* pbSignature) const;
+    // Checks x of the sum against r
+    bool VerifySum(uint64_t* r, const POINT& sum) const;
+};
+
+template<size_t N, class MUL>
+EcPrimeCurve<N, MUL>::EcPrimeCurve(
+    const char*         name,
+    const CK_BYTE*      pbParams,
+    size_t              paramsLen,
+    const char*         p,
+    const char*         n,
+    const char*         b,
+    const char*         gx,
+    const char*         gy
+)
+{
+    BigNum prime = EcFromHex(p);
+    BigNum order = EcFromHex(n);
+    this->name = name;
+    this->params = Buffer(pbParams, pbParams + paramsLen);
+    this->fieldBytes = prime.GetByteLength();
+    this->order = order;
+    this->orderBits = order.GetBitLength();
+    EcModulusInit<N>(this->p, prime);
+    EcModulusInit<N>(this->n, order);
+
+    uint64_t words[N];
+    EcFromHex(b).ToWords(words, N);
+    FieldMul(this->b, words, this->p.rr);
+    EcFromHex(gx).ToWords(words, N);
+    FieldMul(g.x, words, this->p.rr);
+    EcFromHex(gy).ToWords(words, N);
+    FieldMul(g.y, words, this->p.rr);
+
+    // Windows of Booth recoding cover orderBits + 1 bits
+    windows = (orderBits + EC_WINDOW_BITS) / EC_WINDOW_BITS;
+    comb.resize(windows * EC_WINDOW_POINTS);
+    BuildComb(comb.data(), g);
+}
+
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::BuildComb(AFFINE* table, const AFFINE& q) const
+{
+    size_t count = windows * EC_WINDOW_POINTS;
+    std::vector<POINT> points(count);
+    POINT base;
+    memcpy(base.x, q.x, sizeof(base.x));
+    memcpy(base.y, q.y, sizeof(base.y));
+    memcpy(base.z, p.one, sizeof(base.z));
+    for (size_t i = 0; i < windows; i++) {
+        POINT* row = &points[i * EC_WINDOW_POINTS];
+        row[0] = base;
+        for (size_t j = 1; j < EC_WINDOW_POINTS; j++) {
+            Add(row[j], row[j - 1], base);
+        }
+        Double(base, row[EC_WINDOW_POINTS - 1]);
+    }
+
+    // One inversion for the table, x of each entry keeps the product of preceding Z
+    const uint64_t* prefix = p.one;
+    for (size_t i = 0; i < count; i++) {
+        FieldMul(table[i].x, prefix, points[i].z);
+        prefix = table[i].x;
+    }
+    uint64_t inv[N], zInv[N];
+    Invert(inv, table[count - 1].x, p);
+    for (size_t i = count; i--;) {
+        if (i) {
+            FieldMul(zInv, inv, table[i - 1].x);
+            FieldMul(inv, inv, points[i].z);
+        }
+        else {
+            memcpy(zInv, inv, sizeof(zInv));
+        }
+        FieldMul(table[i].x, points[i].x, zInv);
+        FieldMul(table[i].y, points[i].y, zInv);
+    }
+}
+
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::Invert(uint64_t* r, const uint64_t* a, const EC_MODULUS<N>& mod)
+{
+    uint64_t table[16][N];
+    memcpy(table[0], mod.one, sizeof(table[0]));
+    memcpy(table[1], a, sizeof(table[1]));
+    for (size_t i = 2; i < 16; i++) {
+        MUL::Mul(table[i], table[i - 1], a, mod);
+    }
+    uint64_t acc[N];
+    memcpy(acc, mod.one, sizeof(acc));
+    for (size_t bit = 64 * N; bit;) {
+        bit -= 4;
+        for (int i = 0; i < 4; i++) {
+            MUL::Mul(acc, acc, acc, mod);
+        }
+        MUL::Mul(acc, acc, table[(mod.inv[bit / 64] >> (bit % 64)) & 15], mod);
+    }
+    memcpy(r, acc, sizeof(acc));
+}
+
+// Algorithm 6 of Renes, Costello and Batina, complete doubling of a = -3
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::Double(POINT& r, const POINT& a) const
+{
+    uint64_t t0[N], t1[N], t2[N], t3[N], x3[N], y3[N], z3[N];
+    FieldMul(t0, a.x, a.x);
+    FieldMul(t1, a.y, a.y);
+    FieldMul(t2, a.z, a.z);
+    FieldMul(t3, a.x, a.y);
+    FieldAdd(t3, t3, t3);
+    FieldMul(z3, a.x, a.z);
+    FieldAdd(z3, z3, z3);
+    FieldMul(y3, b, t2);
+    FieldSub(y3, y3, z3);
+    FieldAdd(x3, y3, y3);
+    FieldAdd(y3, x3, y3);
+    FieldSub(x3, t1, y3);
+    FieldAdd(y3, t1, y3);
+    FieldMul(y3, x3, y3);
+    FieldMul(x3, x3, t3);
+    FieldAdd(t3, t2, t2);
+    FieldAdd(t2, t2, t3);
+    FieldMul(z3, b, z3);
+    FieldSub(z3, z3, t2);
+    FieldSub(z3, z3, t0);
+    FieldAdd(t3, z3, z3);
+    FieldAdd(z3, z3, t3);
+    FieldAdd(t3, t0, t0);
+    FieldAdd(t0, t3, t0);
+    FieldSub(t0, t0, t2);
+    FieldMul(t0, t0, z3);
+    FieldAdd(y3, y3, t0);
+    FieldMul(t0, a.y, a.z);
+    FieldAdd(t0, t0, t0);
+    FieldMul(z3, t0, z3);
+    FieldSub(x3, x3, z3);
+    FieldMul(z3, t0, t1);
+    FieldAdd(z3, z3, z3);
+    FieldAdd(z3, z3, z3);
+    memcpy(r.x, x3, sizeof(x3));
+    memcpy(r.y, y3, sizeof(y3));
+    memcpy(r.z, z3, sizeof(z3));
+}
+
+// Algorithm 4 of Renes, Costello and Batina, complete addition of a = -3
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::Add(POINT& r, const POINT& a, const POINT& c) const
+{
+    uint64_t t0[N], t1[N], t2[N], t3[N], t4[N], x3[N], y3[N], z3[N];
+    FieldMul(t0, a.x, c.x);
+    FieldMul(t1, a.y, c.y);
+    FieldMul(t2, a.z, c.z);
+    FieldAdd(t3, a.x, a.y);
+    FieldAdd(t4, c.x, c.y);
+    FieldMul(t3, t3, t4);
+    FieldAdd(t4, t0, t1);
+    FieldSub(t3, t3, t4);
+    FieldAdd(t4, a.y, a.z);
+    FieldAdd(x3, c.y, c.z);
+    FieldMul(t4, t4, x3);
+    FieldAdd(x3, t1, t2);
+    FieldSub(t4, t4, x3);
+    FieldAdd(x3, a.x, a.z);
+    FieldAdd(y3, c.x, c.z);
+    FieldMul(x3, x3, y3);
+    FieldAdd(y3, t0, t2);
+    FieldSub(y3, x3, y3);
+    FieldMul(z3, b, t2);
+    FieldSub(x3, y3, z3);
+    FieldAdd(z3, x3, x3);
+    FieldAdd(x3, x3, z3);
+    FieldSub(z3, t1, x3);
+    FieldAdd(x3, t1, x3);
+    FieldMul(y3, b, y3);
+    FieldAdd(t1, t2, t2);
+    FieldAdd(t2, t1, t2);
+    FieldSub(y3, y3, t2);
+    FieldSub(y3, y3, t0);
+    FieldAdd(t1, y3, y3);
+    FieldAdd(y3, t1, y3);
+    FieldAdd(t1, t0, t0);
+    FieldAdd(t0, t1, t0);
+    FieldSub(t0, t0, t2);
+    FieldMul(t1, t4, y3);
+    FieldMul(t2, t0, y3);
+    FieldMul(y3, x3, z3);
+    FieldAdd(y3, y3, t2);
+    FieldMul(x3, t3, x3);
+    FieldSub(x3, x3, t1);
+    FieldMul(z3, t4, z3);
+    FieldMul(t1, t3, t0);
+    FieldAdd(z3, z3, t1);
+    memcpy(r.x, x3, sizeof(x3));
+    memcpy(r.y, y3, sizeof(y3));
+    memcpy(r.z, z3, sizeof(z3));
+}
+
+// Algorithm 5 of Renes, Costello and Batina, mixed addition of a = -3
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::AddMixed(POINT& r, const POINT& a, const AFFINE& c) const
+{
+    uint64_t t0[N], t1[N], t2[N], t3[N], t4[N], x3[N], y3[N], z3[N];
+    FieldMul(t0, a.x, c.x);
+    FieldMul(t1, a.y, c.y);
+    FieldAdd(t3, c.x, c.y);
+    FieldAdd(t4, a.x, a.y);
+    FieldMul(t3, t3, t4);
+    FieldAdd(t4, t0, t1);
+    FieldSub(t3, t3, t4);
+    FieldMul(t4, c.y, a.z);
+    FieldAdd(t4, t4, a.y);
+    FieldMul(y3, c.x, a.z);
+    FieldAdd(y3, y3, a.x);
+    FieldMul(z3, b, a.z);
+    FieldSub(x3, y3, z3);
+    FieldAdd(z3, x3, x3);
+    FieldAdd(x3, x3, z3);
+    FieldSub(z3, t1, x3);
+    FieldAdd(x3, t1, x3);
+    FieldMul(y3, b, y3);
+    FieldAdd(t1, a.z, a.z);
+    FieldAdd(t2, t1, a.z);
+    FieldSub(y3, y3, t2);
+    FieldSub(y3, y3, t0);
+    FieldAdd(t1, y3, y3);
+    FieldAdd(y3, t1, y3);
+    FieldAdd(t1, t0, t0);
+    FieldAdd(t0, t1, t0);
+    FieldSub(t0, t0, t2);
+    FieldMul(t1, t4, y3);
+    FieldMul(t2, t0, y3);
+    FieldMul(y3, x3, z3);
+    FieldAdd(y3, y3, t2);
+    FieldMul(x3, t3, x3);
+    FieldSub(x3, x3, t1);
+    FieldMul(z3, t4, z3);
+    FieldMul(t1, t3, t0);
+    FieldAdd(z3, z3, t1);
+    memcpy(r.x, x3, sizeof(x3));
+    memcpy(r.y, y3, sizeof(y3));
+    memcpy(r.z, z3, sizeof(z3));
+}
+
+template<size_t N, class MUL>
+bool EcPrimeCurve<N, MUL>::DecodePoint(AFFINE& r, const CK_BYTE* pbPoint) const
+{
+    uint64_t x[N], y[N];
+    EcFromBytes(x, N, pbPoint, fieldBytes);
+    EcFromBytes(y, N, pbPoint + fieldBytes, fieldBytes);
+    if (!EcLess<N>(x, p.m) || !EcLess<N>(y, p.m)) {
+        return false;
+    }
+    FieldMul(r.x, x, p.rr);
+    FieldMul(r.y, y, p.rr);
+    return true;
+}
+
+template<size_t N, class MUL>
+bool EcPrimeCurve<N, MUL>::EncodeX(CK_BYTE* pbX, uint64_t* y, const POINT& a) const
+{
+    if (EcIsZero<N>(a.z)) {
+        return false;
+    }
+    uint64_t zInv[N], x[N];
+    const uint64_t unit[N] = { 1 };
+    Invert(zInv, a.z, p);
+    FieldMul(x, a.x, zInv);
+    FieldMul(x, x, unit);
+    EcToBytes(pbX, fieldBytes, x);
+    if (y) {
+        FieldMul(y, a.y, zInv);
+        FieldMul(y, y, unit);
+    }
+    return true;
+}
+
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::RandomScalar(uint64_t* k, RANDOM_BYTES random) const
+{
+    size_t orderBytes = GetOrderBytes();
+    CK_BYTE bytes[EC_MAX_FIELD_BYTES];
+    do {
+        random(bytes, (CK_ULONG)orderBytes);
+        bytes[0] &= (CK_BYTE)(0xFF >> (8 * orderBytes - orderBits));
+        EcFromBytes(k, N, bytes, orderBytes);
+    } while (EcIsZero<N>(k) || !EcLess<N>(k, n.m));
+    memset(bytes, 0, sizeof(bytes));
+    k[N] = 0;
+}
+
+template<size_t N, class MUL>
+bool EcPrimeCurve<N, MUL>::DecodeScalar(uint64_t* k, const CK_BYTE* pbScalar) const
+{
+    EcFromBytes(k, N, pbScalar, GetOrderBytes());
+    k[N] = 0;
+    return !EcIsZero<N>(k) && EcLess<N>(k, n.m);
+}
+
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::HashToScalar(uint64_t* e, const CK_BYTE* pbHash, size_t hashLen) const
+{
+    size_t orderBytes = GetOrderBytes();
+    size_t len = hashLen < orderBytes ? hashLen : orderBytes;
+    EcFromBytes(e, N, pbHash, len);
+    if (8 * len > orderBits) {
+        size_t shift = 8 * len - orderBits;
+        for (size_t i = 0; i < N; i++) {
+            e[i] = (e[i] >> shift) | (i + 1 < N ? e[i + 1] << (64 - shift) : 0);
+        }
+    }
+    if (!EcLess<N>(e, n.m)) {
+        EcModSub<N>(e, e, n.m, n);
+    }
+}
+
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::MulBase(POINT& r, const uint64_t* k) const
+{
+    const uint64_t zero[N] = { 0 };
+    POINT acc, sum;
+    memset(acc.x, 0, sizeof(acc.x));
+    memcpy(acc.y, p.one, sizeof(acc.y));
+    memset(acc.z, 0, sizeof(acc.z));
+    for (size_t i = 0; i < windows; i++) {
+        uint64_t sign, digit;
+        EcBoothRecode(EcGetWindow(k, i), &sign, &digit);
+
+        // All entries are read, the digit selects one of them
+        AFFINE entry;
+        memset(&entry, 0, sizeof(entry));
+        const AFFINE* row = &comb[i * EC_WINDOW_POINTS];
+        for (size_t j = 0; j < EC_WINDOW_POINTS; j++) {
+            uint64_t mask = EcEqualMask(j + 1, digit);
+            EcCopyMasked<N>(entry.x, row[j].x, mask);
+            EcCopyMasked<N>(entry.y, row[j].y, mask);
+        }
+        uint64_t negY[N];
+        FieldSub(negY, zero, entry.y);
+        EcCopyMasked<N>(entry.y, negY, 0 - sign);
+
+        // Digit 0 keeps the sum
+        AddMixed(sum, acc, entry);
+        uint64_t mask = ~EcEqualMask(digit, 0);
+        EcCopyMasked<N>(acc.x, sum.x, mask);
+        EcCopyMasked<N>(acc.y, sum.y, mask);
+        EcCopyMasked<N>(acc.z, sum.z, mask);
+    }
+    r = acc;
+}
+
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::MulPoint(POINT& r, const AFFINE& q, const uint64_t* k) const
+{
+    const uint64_t zero[N] = { 0 };
+    POINT table[EC_WINDOW_POINTS];
+    memcpy(table[0].x, q.x, sizeof(table[0].x));
+    memcpy(table[0].y, q.y, sizeof(table[0].y));
+    memcpy(table[0].z, p.one, sizeof(table[0].z));
+    for (size_t j = 1; j < EC_WINDOW_POINTS; j++) {
+        Add(table[j], table[j - 1], table[0]);
+    }
+
+    POINT acc, sum;
+    memset(acc.x, 0, sizeof(acc.x));
+    memcpy(acc.y, p.one, sizeof(acc.y));
+    memset(acc.z, 0, sizeof(acc.z));
+    for (size_t i = windows; i--;) {
+        if (i != windows - 1) {
+            for (int j = 0; j < EC_WINDOW_BITS; j++) {
+                Double(acc, acc);
+            }
+        }
+
+        uint64_t sign, digit;
+        EcBoothRecode(EcGetWindow(k, i), &sign, &digit);
+        POINT entry;
+        memset(&entry, 0, sizeof(entry));
+        for (size_t j = 0; j < EC_WINDOW_POINTS; j++) {
+            uint64_t mask = EcEqualMask(j + 1, digit);
+            EcCopyMasked<N>(entry.x, table[j].x, mask);
+            EcCopyMasked<N>(entry.y, table[j].y, mask);
+            EcCopyMasked<N>(entry.z, table[j].z, mask);
+        }
+        uint64_t negY[N];
+        FieldSub(negY, zero, entry.y);
+        EcCopyMasked<N>(entry.y, negY, 0 - sign);
+
+        Add(sum, acc, entry);
+        uint64_t mask = ~EcEqualMask(digit, 0);
+        EcCopyMasked<N>(acc.x, sum.x, mask);
+        EcCopyMasked<N>(acc.y, sum.y, mask);
+        EcCopyMasked<N>(acc.z, sum.z, mask);
+    }
+    r = acc;
+    memset(table, 0, sizeof(table));
+}
+
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::MulBaseAdd(POINT& r, const uint64_t* u1, const AFFINE& q, const uint64_t* u2) const
+{
+    const uint64_t zero[N] = { 0 };
+    POINT acc;
+    memset(acc.x, 0, sizeof(acc.x));
+    memcpy(acc.y, p.one, sizeof(acc.y));
+    memset(acc.z, 0, sizeof(acc.z));
+
+    // u2 * q by wNAF of odd digits -15 .. 15, odd multiples are 1q, 3q .. 15q
+    int naf[64 * EC_MAX_WORDS + 2];
+    size_t nafLen = 0;
+    uint64_t t[N + 1];
+    memcpy(t, u2, N * sizeof(uint64_t));
+    t[N] = 0;
+    while (!EcIsZero<N + 1>(t)) {
+        int digit = 0;
+        if (t[0] & 1) {
+            digit = (int)(t[0] & 31);
+            if (digit >= 16) {
+                digit -= 32;
+            }
+            // t - digit, the low bits become zero
+            if (digit > 0) {
+                t[0] -= (uint64_t)digit;
+            }
+            else {
+                uint64_t carry = 0;
+                t[0] = EcAdc(t[0], (uint64_t)-digit, &carry);
+                for (size_t i = 1; i <= N && carry; i++) {
+                    t[i] = EcAdc(t[i], 0, &carry);
+                }
+            }
+        }
+        naf[nafLen++] = digit;
+        for (size_t i = 0; i < N; i++) {
+            t[i] = (t[i] >> 1) | (t[i + 1] << 63);
+        }
+        t[N] >>= 1;
+    }
+
+    POINT odd[EC_WINDOW_POINTS / 2];
+    memcpy(odd[0].x, q.x, sizeof(odd[0].x));
+    memcpy(odd[0].y, q.y, sizeof(odd[0].y));
+    memcpy(odd[0].z, p.one, sizeof(odd[0].z));
+    POINT twice;
+    Double(twice, odd[0]);
+    for (size_t j = 1; j < EC_WINDOW_POINTS / 2; j++) {
+        Add(odd[j], odd[j - 1], twice);
+    }
+    bool started = false;
+    for (size_t i = nafLen; i--;) {
+        if (started) {
+            Double(acc, acc);
+        }
+        int digit = naf[i];
+        if (digit) {
+            POINT entry = odd[(digit > 0 ? digit : -digit) / 2];
+            if (digit < 0) {
+                FieldSub(entry.y, zero, entry.y);
+            }
+            Add(acc, acc, entry);
+            started = true;
+        }
+    }
+
+    // u1 * G by the comb, no doublings
+    AddComb(acc, comb.data(), u1);
+    r = acc;
+}
+
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::AddComb(POINT& r, const AFFINE* table, const uint64_t* k) const
+{
+    const uint64_t zero[N] = { 0 };
+    for (size_t i = 0; i < windows; i++) {
+        uint64_t sign, digit;
+        EcBoothRecode(EcGetWindow(k, i), &sign, &digit);
+        if (digit) {
+            AFFINE entry = table[i * EC_WINDOW_POINTS + digit - 1];
+            if (sign) {
+                FieldSub(entry.y, zero, entry.y);
+            }
+            AddMixed(r, r, entry);
+        }
+    }
+}
+
+template<size_t N, class MUL>
+bool EcPrimeCurve<N, MUL>::IsOnCurve(
+    const CK_BYTE*      pbPoint
+) const
+{
+    AFFINE q;
+    if (!DecodePoint(q, pbPoint)) {
+        return false;
+    }
+    // y^2 = x^3 - 3x + b
+    uint64_t left[N], right[N];
+    FieldMul(left, q.y, q.y);
+    FieldMul(right, q.x, q.x);
+    FieldMul(right, right, q.x);
+    FieldSub(right, right, q.x);
+    FieldSub(right, right, q.x);
+    FieldSub(right, right, q.x);
+    FieldAdd(right, right, b);
+    return !memcmp(left, right, sizeof(left));
+}
+
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::GenerateKey(
+    CK_BYTE*            pbPrivate,
+    CK_BYTE*            pbPoint,
+    RANDOM_BYTES        random
+) const
+{
+    uint64_t d[N + 1], y[N];
+    RandomScalar(d, random);
+    POINT q;
+    MulBase(q, d);
+    EncodeX(pbPoint, y, q);
+    EcToBytes(pbPoint + fieldBytes, fieldBytes, y);
+    EcToBytes(pbPrivate, GetOrderBytes(), d);
+    memset(d, 0, sizeof(d));
+}
+
+template<size_t N, class MUL>
+void EcPrimeCurve<N, MUL>::Sign(
+    const CK_BYTE*      pbPrivate,
+    const CK_BYTE*      pbHash,
+    size_t              hashLen,
+    CK_BYTE*            pbSignature,
+    RANDOM_BYTES        random
+) const
+{
+    size_t orderBytes = GetOrderBytes();
+
+    uint64_t e[N];
+    HashToScalar(e, pbHash, hashLen);
+
+    uint64_t d[N + 1], dMont[N];
+    if (!DecodeScalar(d, pbPrivate)) {
+        THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "Wrong EC private value");
+    }
+    OrderMul(dMont, d, n.rr);
+
+    uint64_t k[N + 1], r[N], s[N], kInv[N];
+    CK_BYTE x[EC_MAX_FIELD_BYTES];
+    for (;;) {
+        RandomScalar(k, random);
+        POINT kG;
+        MulBase(kG, k);
+        EncodeX(x, NULL, kG);
+
+        // r = x mod n, x < p < 2n
+        EcFromBytes(r, N, x, fieldBytes);
+        uint64_t reduced[N];
+        uint64_t borrow = 0;
+        for (size_t i = 0; i < N; i++) {
+            reduced[i] = EcSbb(r[i], n.m[i], &borrow);
+        }
+        EcCopyMasked<N>(r, reduced, 0 - (borrow ^ 1));
+        if (EcIsZero<N>(r)) {
+            continue;
+        }
+
+        // s = k^-1 (e + r d), products of a plain and a Montgomery number are plain
+        OrderMul(kInv, k, n.rr);
+        Invert(kInv, kInv, n);
+        OrderMul(s, r, dMont);
+        EcModAdd<N>(s, s, e, n);
+        OrderMul(s, s, kInv);
+        if (!EcIsZero<N>(s)) {
+            break;
+        }
+    }
+    EcToBytes(pbSignature, orderBytes, r);
+    EcToBytes(pbSignature + orderBytes, orderBytes, s);
+
+    memset(d, 0, sizeof(d));
+    memset(dMont, 0, sizeof(dMont));
+    memset(k, 0, sizeof(k));
+    memset(kInv, 0, sizeof(kInv));
+}
+
+template<size_t N, class MUL>
+bool EcPrimeCurve<N, MUL>::VerifyScalars(
+    uint64_t*           r,
+    uint64_t*           u1,
+    uint64_t*           u2,
+    const CK_BYTE*      pbHash,
+    size_t              hashLen,
+    const CK_BYTE*      pbSignature
+) const
+{
+    uint64_t s[N + 1];
+    if (!DecodeScalar(r, pbSignature) || !DecodeScalar(s, pbSignature + GetOrderBytes())) {
+        return false;
+    }
+
+    uint64_t e[N];
+    HashToScalar(e, pbHash, hashLen);
+
+    uint64_t w[N];
+    OrderMul(w, s, n.rr);
+    Invert(w, w, n);
+    OrderMul(u1, e, w);
+    OrderMul(u2, r, w);
+    u1[N] = 0;
+    u2[N] = 0;
+    return true;
+}
+
+template<size_t N, class MUL>
+bool EcPrimeCurve<N, MUL>::VerifySum(uint64_t* r, const POINT& sum) const
+{
+    if (EcIsZero<N>(sum.z)) {
+        return false;
+    }
+
+    // x of the sum equals r or r + n mod n, X = x Z is compared without an inversion
+    uint64_t rx[N];
+    for (int i = 0; i < 2; i++) {
+        FieldMul(rx, r, p.rr);
+        FieldMul(rx, rx, sum.z);
+        if (!memcmp(rx, sum.x, sizeof(rx))) {
+            return true;
+        }
+        uint64_t carry = 0;
+        for (size_t j = 0; j < N; j++) {
+            r[j] = EcAdc(r[j], n.m[j], &carry);
+        }
+        if (carry || !EcLess<N>(r, p.m)) {
+            break;
+        }
+    }
+    return false;
+}
+
+template<size_t N, class MUL>
+bool EcPrimeCurve<N, MUL>::Verify(
+    const CK_BYTE*      pbPoint,
+    const CK_BYTE*      pbHash,
+    size_t              hashLen,
+    const CK_BYTE*      pbSignature
+) const
+{
+    AFFINE q;
+    uint64_t r[N + 1], u1[N + 1], u2[N + 1];
+    if (!DecodePoint(q, pbPoint) || !VerifyScalars(r, u1, u2, pbHash, hashLen, pbSignature)) {
+        return false;
+    }
+
+    POINT sum;
+    MulBaseAdd(sum, u1, q, u2);
+    return VerifySum(r, sum);
+}
+
+template<size_t N, class MUL>
+size_t EcPrimeCurve<N, MUL>::GetVerifyTableSize() const
+{
+    return sizeof(COMB_TABLE) + windows * EC_WINDOW_POINTS * sizeof(AFFINE);
+}
+
+template<size_t N, class MUL>
+Scoped<EcVerifyTable> EcPrimeCurve<N, MUL>::CreateVerifyTable(
+    const CK_BYTE*      pbPoint
+) const
+{
+    AFFINE q;
+    if (!DecodePoint(q, pbPoint)) {
+        THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "Wrong EC point");
+    }
+    Scoped<COMB_TABLE> table(new COMB_TABLE);
+    table->comb.resize(windows * EC_WINDOW_POINTS);
+    BuildComb(table->comb.data(), q);
+    return table;
+}
+
+template<size_t N, class MUL>
+bool EcPrimeCurve<N, MUL>::Verify(
+    const EcVerifyTable* table,
+    const CK_BYTE*      pbHash,
+    size_t              hashLen,
+    const CK_BYTE*      pbSignature
+) const
+{
+    uint64_t r[N + 1], u1[N + 1], u2[N + 1];
+    if (!VerifyScalars(r, u1, u2, pbHash, hashLen, pbSignature)) {
+        return false;
+    }
+
+    // Both products by combs, no doublings
+    POINT sum;
+    memset(sum.x, 0, sizeof(sum.x));
+    memcpy(sum.y, p.one, sizeof(sum.y));
+    memset(sum.z, 0, sizeof(sum.z));
+    AddComb(sum, comb.data(), u1);
+    AddComb(sum, static_cast<const COMB_TABLE*>(table)->comb.data(), u2);
+    return VerifySum(r, sum);
+}
+
+template<size_t N, class MUL>
+bool EcPrimeCurve<N, MUL>::Derive(
+    const CK_BYTE*      pbPrivate,
+    const CK_BYTE*      pbPoint,
+    CK_BYTE*            pbSecret
+) const
+{
+    AFFINE q;
+    uint64_t d[N + 1];
+    if (!DecodePoint(q, pbPoint) || !DecodeScalar(d, pbPrivate)) {
+        return false;
+    }
+    POINT product;
+    MulPoint(product, q, d);
+    bool res = EncodeX(pbSecret, NULL, product);
+    memset(d, 0, sizeof(d));
+    memset(&product, 0, sizeof(product));
+    return res;
+}
+
+typedef EcPrimeCurve<4, EC_FIXED_MUL<4> >               EcP256;
+typedef EcPrimeCurve<6, EC_FIXED_MUL<6> >               EcP384;
+typedef EcPrimeCurve<EC_MAX_WORDS, EC_GENERIC_MUL<EC_MAX_WORDS> > EcP521;
+
+// Tables are built on the first use of a curve
+static const EcCurve* GetP256()
+{
+    static const EcP256 curve("P-256", EC_P256_OID, sizeof(EC_P256_OID),
+        "ffffffff00000001000000000000000000000000ffffffffffffffffffffffff",
+        "ffffffff00000000ffffffffffffffffbce6faada7179e84f3b9cac2fc632551",
+        "5ac635d8aa3a93e7b3ebbd55769886bc651d06b0cc53b0f63bce3c3e27d2604b",
+        "6b17d1f2e12c4247f8bce6e563a440f277037d812deb33a0f4a13945d898c296",
+        "4fe342e2fe1a7f9b8ee7eb4a7c0f9e162bce33576b315ececbb6406837bf51f5");
+    return &curve;
+}
+
+static const EcCurve* GetP384()
+{
+    static const EcP384 curve("P-384", EC_P384_OID, sizeof(EC_P384_OID),
+        "fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffeffffffff0000000000000000ffffffff",
+        "ffffffffffffffffffffffffffffffffffffffffffffffffc7634d81f4372ddf581a0db248b0a77aecec196accc52973",
+        "b3312fa7e23ee7e4988e056be3f82d19181d9c6efe8141120314088f5013875ac656398d8a2ed19d2a85c8edd3ec2aef",
+        "aa87ca22be8b05378eb1c71ef320ad746e1d3b628ba79b9859f741e082542a385502f25dbf55296c3a545e3872760ab7",
+        "3617de4a96262c6f5d9e98bf9292dc29f8f41dbd289a147ce9da3113b5f0b8c00a60b1ce1d7e819d7a431d7c90ea0e5f");
+    return &curve;
+}
+
+static const EcCurve* GetP521()
+{
+    static const EcP521 curve("P-521", EC_P521_OID, sizeof(EC_P521_OID),
+        "01ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff",
+        "01fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffa51868783bf2f966b7fcc0148f709a5d03bb5c9b8899c47aebb6fb71e91386409",
+        "0051953eb9618e1c9a1f929a21a0b68540eea2da725b99b315f3b8b489918ef109e156193951ec7e937b1652c0bd3bb1bf073573df883d2c34f1ef451fd46b503f00",
+        "00c6858e06b70404e9cd9e3ecb662395b4429c648139053fb521f828af606b4d3dbaa14b5e77efe75928fe1dc127a2ffa8de3348b3c1856a429bf97e7e31c2e5bd66",
+        "011839296a789a3bc0045c8a5fb42c7d1bd998f54449579b446817afbd17273e662c97ee72995ef42640c550b9013fad0761353c7086a272c24088be94769fd16650");
+    return &curve;
+}
+
+const EcCurve* EcCurve::FromParams(
+    const CK_BYTE*      pbParams,
+    size_t              len
+)
+{
+    if (len == sizeof(EC_P256_OID) && !memcmp(pbParams, EC_P256_OID, len)) {
+        return GetP256();
+    }
+    if (len == sizeof(EC_P384_OID) && !memcmp(pbParams, EC_P384_OID, len)) {
+        return GetP384();
+    }
+    if (len == sizeof(EC_P521_OID) && !memcmp(pbParams, EC_P521_OID, len)) {
+        return GetP521();
+    }
+    THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Unsupported EC curve");
+}
+
+const char* EcCurve::GetName() const
+{
+    return name;
+}
+
+const Buffer& EcCurve::GetParams() const
+{
+    return params;
+}
+
+size_t EcCurve::GetFieldBytes() const
+{
+    return fieldBytes;
+}
+
+const BigNum& EcCurve::GetOrder() const
+{
+    return order;
+}
+
+size_t EcCurve::GetOrderBits() const
+{
+    return orderBits;
+}
+
+size_t EcCurve::GetOrderBytes() const
+{
+    return (orderBits + 7) / 8;
+}
+
+// EcVerifyCache
+
+#define EC_VERIFY_CACHE_DEFAULT_BUDGET      (32 * 1024 * 1024)
+#define EC_VERIFY_CACHE_DEFAULT_ADMISSION   4
+#define EC_VERIFY_CACHE_WINDOW              4096
+
+EcVerifyCache& EcVerifyCache::Get()
+{
+    static EcVerifyCache cache(EC_VERIFY_CACHE_DEFAULT_BUDGET);
+    return cache;
+}
+
+/**
+ * Returns decimal value of the environment variable or defaultValue
+ */
+static size_t GetEnvSize(const char* name, size_t defaultValue)
+{
+    const char* value = getenv(name);
+    if (value && *value) {
+        char* end = NULL;
+        unsigned long long res = strtoull(value, &end, 10);
+        if (!*end) {
+            return (size_t)res;
+        }
+    }
+    return defaultValue;
+}
+
+EcVerifyCache::EcVerifyCache(
+    size_t              budget
+) :
+    budget(GetEnvSize("PV_PKCS11_EC_TABLES", budget)),
+    size(0),
+    admission(GetEnvSize("PV_PKCS11_EC_TABLE_USES", EC_VERIFY_CACHE_DEFAULT_ADMISSION)),
+    verifications(0)
+{
+}
+
+uint32_t EcVerifyCache::Use(
+    size_t              hash
+)
+{
+    if (++verifications >= EC_VERIFY_CACHE_WINDOW) {
+        verifications = 0;
+        for (auto it = uses.begin(); it != uses.end();) {
+            it->second >>= 1;
+            if (it->second) {
+                it++;
+            }
+            else {
+                it = uses.erase(it);
+            }
+        }
+    }
+    uint32_t& res = uses[hash];
+    if (res < UINT32_MAX) {
+        res++;
+    }
+    return res;
+}
+
+bool EcVerifyCache::Admit(
+    size_t              tableSize,
+    uint32_t            pointUses
+)
+{
+    size_t freed = budget - size;
+    for (auto it = entries.rbegin(); freed < tableSize && it != entries.rend(); it++) {
+        auto victim = uses.find(it->hash);
+        if (victim != uses.end() && victim->second >= pointUses) {
+            return false;
+        }
+        freed += it->size;
+    }
+    return true;
+}
+
+Scoped<EcVerifyTable> EcVerifyCache::GetTable(
+    const EcCurve*      curve,
+    const Buffer&       point
+)
+{
+    size_t tableSize = curve->GetVerifyTableSize();
+    if (tableSize > budget) {
+        return Scoped<EcVerifyTable>();
+    }
+
+    std::string key(curve->GetName());
+    key.push_back(0);
+    key.append((const char*)point.data(), point.size());
+    size_t hash = std::hash<std::string>()(key);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t pointUses = Use(hash);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            entries.splice(entries.begin(), entries, it->second);
+            return it->second->table;
+        }
+        // Cold points are verified with wNAF
+        if (pointUses < admission || !Admit(tableSize, pointUses)) {
+            return Scoped<EcVerifyTable>();
+        }
+    }
+
+    // Other threads verify while the table is built
+    Scoped<EcVerifyTable> table = curve->CreateVerifyTable(point.data());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it != index.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->table;
+    }
+    while (size + tableSize > budget) {
+        // Tables in use are kept by their callers
+        size -= entries.back().size;
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+    ENTRY entry = { key, hash, table, tableSize };
+    entries.push_front(entry);
+    index[key] = entries.begin();
+    size += tableSize;
+    return table;
+}
+
+size_t EcVerifyCache::GetSize()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return size;
+}
+
+// Ec
+
+Scoped<Ec> Ec::Generate(
+    const EcCurve*      curve,
+    RANDOM_BYTES        random
+)
+{
+    Buffer value(curve->GetOrderBytes());
+    Buffer point(2 * curve->GetFieldBytes());
+    curve->GenerateKey(value.data(), point.data(), random);
+    Scoped<Ec> res(new Ec(curve, value, point));
+    memset(value.data(), 0, value.size());
+    return res;
+}
+
+Ec::Ec(
+    const EcCurve*      curve,
+    const Buffer&       point
+) :
+    curve(curve),
+    hasPrivateKey(false),
+    point(point)
+{
+    if (point.size() != 2 * curve->GetFieldBytes() || !curve->IsOnCurve(point.data())) {
+        THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "EC point is not on the curve");
+    }
+}
+
+Ec::Ec(
+    const EcCurve*      curve,
+    const Buffer&       value,
+    const Buffer&       point
+) :
+    curve(curve),
+    hasPrivateKey(true),
+    point(point)
+{
+    // Leading zeros are allowed, the value is padded to order bytes
+    size_t orderBytes = curve->GetOrderBytes();
+    size_t start = 0;
+    while (start < value.size() && value.size() - start > orderBytes && !value[start]) {
+        start++;
+    }
+    if (value.size() - start > orderBytes) {
+        THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Wrong EC private value");
+    }
+    this->value.assign(orderBytes - (value.size() - start), 0);
+    this->value.insert(this->value.end(), value.begin() + start, value.end());
+
+    BigNum d = BigNum::FromBytes(this->value.data(), orderBytes);
+    if (d.IsZero() || BigNum::Compare(d, curve->GetOrder()) >= 0) {
+        THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Wrong EC private value");
+    }
+    if (point.size() && (point.size() != 2 * curve->GetFieldBytes() || !curve->IsOnCurve(point.data()))) {
+        THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "EC point is not on the curve");
+    }
+}
+
+Ec::~Ec()
+{
+    if (value.size()) {
+        memset(value.data(), 0, value.size());
+    }
+}
+
+const EcCurve* Ec::GetCurve() const
+{
+    return curve;
+}
+
+bool Ec::HasPrivateKey() const
+{
+    return hasPrivateKey;
+}
+
+const Buffer& Ec::GetPoint() const
+{
+    return point;
+}
+
+const Buffer& Ec::GetPrivateValue() const
+{
+    return value;
+}
+
+void Ec::Sign(
+    const CK_BYTE*      pbHash,
+    size_t              hashLen,
+    CK_BYTE*            pbSignature,
+    RANDOM_BYTES        random
+)
+{
+    if (!hasPrivateKey) {
+        THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "EC key is not private");
+    }
+    curve->Sign(value.data(), pbHash, hashLen, pbSignature, random);
+}
+
+bool Ec::Verify(
+    const CK_BYTE*      pbHash,
+    size_t              hashLen,
+    const CK_BYTE*      pbSignature
+)
+{
+    if (point.empty()) {
+        THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "EC key has no public point");
+    }
+    Scoped<EcVerifyTable> table = EcVerifyCache::Get().GetTable(curve, point);
+    if (table) {
+        return curve->Verify(table.get(), pbHash, hashLen, pbSignature);
+    }
+    return curve->Verify(point.data(), pbHash, hashLen, pbSignature);
+}
+
+void Ec::Derive(
+    const CK_BYTE*      pbPoint,
+    CK_BYTE*            pbSecret
+)
+{
+    if (!hasPrivateKey) {
+        THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "EC key is not private");
+    }
+    if (!curve->IsOnCurve(pbPoint)) {
+        THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "EC point is not on the curve");
+    }
+    if (!curve->Derive(value.data(), pbPoint, pbSecret)) {
+        THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "ECDH secret is the point at infinity");
+    }
+}
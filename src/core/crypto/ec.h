@@ -0,0 +1,281 @@
+#pragma once
+
+#include "../../stdafx.h"
+#include "../excep.h"
+#include "bn.h"
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace core {
+
+#define EC_MAX_FIELD_BYTES      66
+// Points are x || y
+#define EC_MAX_POINT_BYTES      (2 * EC_MAX_FIELD_BYTES)
+
+    /**
+     * Precomputed multiples of a public point which make its verifications faster. Tables
+     * are created by the curve of the point
+     */
+    class EcVerifyTable {
+    public:
+        virtual ~EcVerifyTable() {}
+    };
+
+    /**
+     * Prime curve y^2 = x^3 - 3x + b of FIPS 186-4. P-256 and P-384 have Montgomery field
+     * arithmetic of fixed size, P-521 uses the generic Montgomery multiplication of BigNum.
+     * Points are x || y of field bytes each, scalars are big-endian of order bytes.
+     *
+     * Projective points are added by the complete formulas of Renes, Costello and Batina, so
+     * operations of secret scalars have no special cases. The generator is multiplied by a
+     * comb of signed windows of 5 bits, a table of affine multiples per window. Other points
+     * of secret scalars are multiplied by the same windows, points of public scalars by wNAF
+     */
+    class EcCurve {
+    public:
+        /**
+         * Returns curve of DER OID of CKA_EC_PARAMS. Throws CKR_ATTRIBUTE_VALUE_INVALID for
+         * unknown curves
+         */
+        static const EcCurve* FromParams(
+            const CK_BYTE*      pbParams,
+            size_t              len
+        );
+
+        virtual ~EcCurve() {}
+
+        const char* GetName() const;
+
+        /**
+         * Returns DER OID of the curve
+         */
+        const Buffer& GetParams() const;
+
+        size_t GetFieldBytes() const;
+        const BigNum& GetOrder() const;
+        size_t GetOrderBits() const;
+        size_t GetOrderBytes() const;
+
+        /**
+         * Checks that coordinates are less than field prime and satisfy the equation
+         */
+        virtual bool IsOnCurve(
+            const CK_BYTE*      pbPoint
+        ) const = 0;
+
+        /**
+         * Random private key in [1, n - 1] and its public point
+         */
+        virtual void GenerateKey(
+            CK_BYTE*            pbPrivate,
+            CK_BYTE*            pbPoint,
+            RANDOM_BYTES        random
+        ) const = 0;
+
+        /**
+         * ECDSA of SEC 1 4.1.3 with a random nonce, the signature is r || s of order
+         * bytes each. Hash longer than order is truncated
+         */
+        virtual void Sign(
+            const CK_BYTE*      pbPrivate,
+            const CK_BYTE*      pbHash,
+            size_t              hashLen,
+            CK_BYTE*            pbSignature,
+            RANDOM_BYTES        random
+        ) const = 0;
+
+        /**
+         * ECDSA verification of SEC 1 4.1.4. Point must be on the curve
+         */
+        virtual bool Verify(
+            const CK_BYTE*      pbPoint,
+            const CK_BYTE*      pbHash,
+            size_t              hashLen,
+            const CK_BYTE*      pbSignature
+        ) const = 0;
+
+        /**
+         * Returns size in bytes of the verification table of a point
+         */
+        virtual size_t GetVerifyTableSize() const = 0;
+
+        /**
+         * Builds the comb of the point, the same one as of the generator. Point must be on
+         * the curve
+         */
+        virtual Scoped<EcVerifyTable> CreateVerifyTable(
+            const CK_BYTE*      pbPoint
+        ) const = 0;
+
+        /**
+         * ECDSA verification by the table of the point, it needs no doublings
+         */
+        virtual bool Verify(
+            const EcVerifyTable* table,
+            const CK_BYTE*      pbHash,
+            size_t              hashLen,
+            const CK_BYTE*      pbSignature
+        ) const = 0;
+
+        /**
+         * ECDH of SEC 1 3.3.1, the secret is x coordinate of field bytes. Point must be on
+         * the curve. Returns false if the product is the point at infinity
+         */
+        virtual bool Derive(
+            const CK_BYTE*      pbPrivate,
+            const CK_BYTE*      pbPoint,
+            CK_BYTE*            pbSecret
+        ) const = 0;
+
+    protected:
+        const char*         name;
+        Buffer              params;
+        size_t              fieldBytes;
+        BigNum              order;
+        size_t              orderBits;
+    };
+
+    /**
+     * Verification tables of recently used public points. Keys of the same point share a
+     * table. The table costs about three wNAF verifications to build, so a point gets it
+     * on its PV_PKCS11_EC_TABLE_USES verification (4th by default), earlier ones use wNAF.
+     * The least recently used tables are dropped when the total size exceeds
+     * PV_PKCS11_EC_TABLES bytes (32 MB by default, 0 disables tables), but a new table
+     * doesn't evict tables of points used at least as often as its own
+     */
+    class EcVerifyCache {
+    public:
+        static EcVerifyCache& Get();
+
+        /**
+         * Returns table of the point. Returns NULL if tables are disabled or the table
+         * doesn't fit the budget
+         */
+        Scoped<EcVerifyTable> GetTable(
+            const EcCurve*      curve,
+            const Buffer&       point
+        );
+
+        /**
+         * Returns total size of tables in bytes
+         */
+        size_t GetSize();
+
+    protected:
+        struct ENTRY {
+            // Curve name and the point
+            std::string             key;
+            size_t                  hash;
+            Scoped<EcVerifyTable>   table;
+            size_t                  size;
+        };
+        typedef std::list<ENTRY> ENTRIES;
+
+        size_t              budget;
+        size_t              size;
+        // Verification which builds the table of a point
+        size_t              admission;
+        // The most recently used table is the first one
+        ENTRIES             entries;
+        std::unordered_map<std::string, ENTRIES::iterator> index;
+        // Recent verifications by hash of the key, halved every EC_VERIFY_CACHE_WINDOW
+        // verifications so the map holds recently used points only
+        std::unordered_map<size_t, uint32_t> uses;
+        size_t              verifications;
+        std::mutex          mutex;
+
+        EcVerifyCache(
+            size_t              budget
+        );
+
+        /**
+         * Counts the verification of the point and returns its recent verifications
+         */
+        uint32_t Use(
+            size_t              hash
+        );
+
+        /**
+         * Returns true if tables dropped to fit tableSize are used less often than
+         * the point. Called under the lock
+         */
+        bool Admit(
+            size_t              tableSize,
+            uint32_t            pointUses
+        );
+    };
+
+    /**
+     * EC key of a curve. A public key has the point only, a private key has the private
+     * value and the point if it's known
+     */
+    class Ec {
+    public:
+        static Scoped<Ec> Generate(
+            const EcCurve*      curve,
+            RANDOM_BYTES        random
+        );
+
+        /**
+         * Public key. Throws CKR_ATTRIBUTE_VALUE_INVALID if the point is not on the curve
+         */
+        Ec(
+            const EcCurve*      curve,
+            const Buffer&       point
+        );
+
+        /**
+         * Private key, point can be empty. Throws CKR_ATTRIBUTE_VALUE_INVALID if the private
+         * value is not in [1, n - 1]
+         */
+        Ec(
+            const EcCurve*      curve,
+            const Buffer&       value,
+            const Buffer&       point
+        );
+
+        ~Ec();
+
+        const EcCurve* GetCurve() const;
+        bool HasPrivateKey() const;
+        const Buffer& GetPoint() const;
+        const Buffer& GetPrivateValue() const;
+
+        /**
+         * Signature has 2 * order bytes
+         */
+        void Sign(
+            const CK_BYTE*      pbHash,
+            size_t              hashLen,
+            CK_BYTE*            pbSignature,
+            RANDOM_BYTES        random
+        );
+
+        /**
+         * Uses the table of EcVerifyCache for the point if it has one
+         */
+        bool Verify(
+            const CK_BYTE*      pbHash,
+            size_t              hashLen,
+            const CK_BYTE*      pbSignature
+        );
+
+        /**
+         * Secret has field bytes. Throws CKR_MECHANISM_PARAM_INVALID if the point is not on
+         * the curve, and CKR_FUNCTION_FAILED if the secret is the point at infinity
+         */
+        void Derive(
+            const CK_BYTE*      pbPoint,
+            CK_BYTE*            pbSecret
+        );
+
+    protected:
+        const EcCurve*      curve;
+        bool                hasPrivateKey;
+        Buffer              value;
+        Buffer              point;
+    };
+
+}
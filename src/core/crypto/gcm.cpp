@@ -0,0 +1,438 @@
+#include "gcm.h"
+
+using namespace core;
+
+// SP 800-38D limits plaintext to 2^39 - 256 bits
+#define GCM_MAX_DATA_LENGTH     ((1ULL << 36) - 32)
+// Blocks of the portable kernels processed at a time
+#define GCM_SCALAR_BLOCKS       16
+
+static inline uint64_t LoadBE64(const CK_BYTE* p)
+{
+    return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+        ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+}
+
+static inline void StoreBE64(CK_BYTE* p, uint64_t v)
+{
+    for (int i = 7; i >= 0; i--, v >>= 8) {
+        p[i] = (CK_BYTE)v;
+    }
+}
+
+// Increments low 32 bits of the counter block modulo 2^32
+static inline void Inc32(CK_BYTE* pbCounter)
+{
+    for (int i = 15; i >= 12; i--) {
+        if (++pbCounter[i]) {
+            break;
+        }
+    }
+}
+
+static const uint64_t GCM_LAST4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+// X = X * H with 4-bit tables (Shoup's method)
+static void GhashMultiply(const GCM_TABLES* tables, CK_BYTE* x)
+{
+    CK_BYTE lo = x[15] & 0xf;
+    uint64_t zh = tables->hh[lo];
+    uint64_t zl = tables->hl[lo];
+
+    for (int i = 15; i >= 0; i--) {
+        lo = x[i] & 0xf;
+        CK_BYTE hi = x[i] >> 4;
+        CK_BYTE rem;
+
+        if (i != 15) {
+            rem = (CK_BYTE)zl & 0xf;
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ (GCM_LAST4[rem] << 48);
+            zh ^= tables->hh[lo];
+            zl ^= tables->hl[lo];
+        }
+        rem = (CK_BYTE)zl & 0xf;
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ (GCM_LAST4[rem] << 48);
+        zh ^= tables->hh[hi];
+        zl ^= tables->hl[hi];
+    }
+
+    StoreBE64(x, zh);
+    StoreBE64(x + 8, zl);
+}
+
+void core::GhashBlocks(const GCM_TABLES* tables, CK_BYTE* pbHash, const CK_BYTE* pbData, size_t blocks)
+{
+    for (; blocks; blocks--, pbData += 16) {
+        for (int i = 0; i < 16; i++) {
+            pbHash[i] ^= pbData[i];
+        }
+        GhashMultiply(tables, pbHash);
+    }
+}
+
+static void GcmKeyStream(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbCounter, CK_BYTE* pbKeyStream, size_t blocks)
+{
+    for (size_t i = 0; i < blocks; i++) {
+        memcpy(pbKeyStream + i * 16, pbCounter, 16);
+        Inc32(pbCounter);
+    }
+    AesEncryptBlocks(roundKeys, rounds, pbKeyStream, pbKeyStream, blocks);
+}
+
+void core::GcmEncryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    CK_BYTE keyStream[GCM_SCALAR_BLOCKS * 16];
+    while (blocks) {
+        size_t n = blocks < GCM_SCALAR_BLOCKS ? blocks : GCM_SCALAR_BLOCKS;
+        GcmKeyStream(roundKeys, rounds, pbCounter, keyStream, n);
+        for (size_t i = 0; i < n * 16; i++) {
+            pbOut[i] = pbIn[i] ^ keyStream[i];
+        }
+        GhashBlocks(tables, pbHash, pbOut, n);
+        blocks -= n;
+        pbIn += n * 16;
+        pbOut += n * 16;
+    }
+    memset(keyStream, 0, sizeof(keyStream));
+}
+
+void core::GcmDecryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    CK_BYTE keyStream[GCM_SCALAR_BLOCKS * 16];
+    while (blocks) {
+        size_t n = blocks < GCM_SCALAR_BLOCKS ? blocks : GCM_SCALAR_BLOCKS;
+        // Ciphertext is hashed before output overwrites it
+        GhashBlocks(tables, pbHash, pbIn, n);
+        GcmKeyStream(roundKeys, rounds, pbCounter, keyStream, n);
+        for (size_t i = 0; i < n * 16; i++) {
+            pbOut[i] = pbIn[i] ^ keyStream[i];
+        }
+        blocks -= n;
+        pbIn += n * 16;
+        pbOut += n * 16;
+    }
+    memset(keyStream, 0, sizeof(keyStream));
+}
+
+// Implementations in use
+static GHASH_BLOCKS ghashBlocks = core::GhashBlocks;
+static GCM_BLOCKS   gcmEncryptBlocks = core::GcmEncryptBlocks;
+static GCM_BLOCKS   gcmDecryptBlocks = core::GcmDecryptBlocks;
+static const char*  gcmName = "scalar";
+
+void Gcm::Setup()
+{
+    const char* limit = getenv("PV_PKCS11_AES");
+    bool allowClmul = !limit || !strcmp(limit, "aesni") || !strcmp(limit, "vaes");
+    bool allowVaes = !limit || !strcmp(limit, "vaes");
+
+    ghashBlocks = core::GhashBlocks;
+    gcmEncryptBlocks = core::GcmEncryptBlocks;
+    gcmDecryptBlocks = core::GcmDecryptBlocks;
+    gcmName = "scalar";
+
+#ifdef PV_X86
+    const CPU_FEATURES& cpu = GetCpuFeatures();
+    if (allowClmul && cpu.aes && cpu.pclmul && cpu.sse41) {
+        ghashBlocks = core::GhashBlocksClmul;
+        gcmEncryptBlocks = core::GcmEncryptBlocksClmul;
+        gcmDecryptBlocks = core::GcmDecryptBlocksClmul;
+        gcmName = "clmul";
+
+        // The wide kernels hand incomplete groups to PCLMULQDQ ones
+        if (allowVaes && cpu.vaes && cpu.vpclmul && cpu.avx512f && cpu.avx512bw) {
+            gcmEncryptBlocks = core::GcmEncryptBlocksVaes512;
+            gcmDecryptBlocks = core::GcmDecryptBlocksVaes512;
+            gcmName = "vpclmul512";
+        }
+    }
+#endif
+}
+
+const char* Gcm::GetImplementationName()
+{
+    return gcmName;
+}
+
+// GcmKey
+
+GcmKey::GcmKey(
+    Scoped<Aes>         aes
+) :
+    aes(aes)
+{
+    CK_BYTE h[GCM_BLOCK_LENGTH] = { 0 };
+    aes->EncryptBlocks(h, h, 1);
+
+    // 4-bit tables, entry i is H multiplied by polynomial i with reflected bits
+    uint64_t vh = LoadBE64(h);
+    uint64_t vl = LoadBE64(h + 8);
+    tables.hl[8] = vl;
+    tables.hh[8] = vh;
+    tables.hl[0] = 0;
+    tables.hh[0] = 0;
+    for (int i = 4; i > 0; i >>= 1) {
+        uint64_t t = (vl & 1) * 0xe100000000000000ULL;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ t;
+        tables.hl[i] = vl;
+        tables.hh[i] = vh;
+    }
+    for (int i = 2; i <= 8; i *= 2) {
+        for (int j = 1; j < i; j++) {
+            tables.hh[i + j] = tables.hh[i] ^ tables.hh[j];
+            tables.hl[i + j] = tables.hl[i] ^ tables.hl[j];
+        }
+    }
+
+    // Powers for aggregated reduction, the highest goes first
+    CK_BYTE power[GCM_BLOCK_LENGTH];
+    memcpy(power, h, sizeof(power));
+    for (int i = GCM_POWERS - 1; i >= 0; i--) {
+        for (int j = 0; j < GCM_BLOCK_LENGTH; j++) {
+            tables.powers[i * GCM_BLOCK_LENGTH + j] = power[GCM_BLOCK_LENGTH - 1 - j];
+        }
+        GhashMultiply(&tables, power);
+    }
+
+    memset(h, 0, sizeof(h));
+    memset(power, 0, sizeof(power));
+}
+
+GcmKey::~GcmKey()
+{
+    memset(&tables, 0, sizeof(tables));
+}
+
+Scoped<Aes> GcmKey::GetAes()
+{
+    return aes;
+}
+
+const GCM_TABLES* GcmKey::GetTables()
+{
+    return &tables;
+}
+
+// Gcm
+
+Gcm::Gcm() :
+    bufferLen(0),
+    keyStreamLen(0),
+    aadLen(0),
+    dataLen(0),
+    data(false)
+{
+}
+
+Gcm::~Gcm()
+{
+    memset(keyStream, 0, sizeof(keyStream));
+    memset(buffer, 0, sizeof(buffer));
+}
+
+void Gcm::Init(
+    Scoped<GcmKey>      key,
+    const CK_BYTE*      pbIv,
+    size_t              ivLen
+)
+{
+    try {
+        if (!ivLen) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "GCM IV is empty");
+        }
+
+        this->key = key;
+        bufferLen = 0;
+        keyStreamLen = 0;
+        aadLen = 0;
+        dataLen = 0;
+        data = false;
+
+        if (ivLen == 12) {
+            memcpy(j0, pbIv, 12);
+            j0[12] = 0;
+            j0[13] = 0;
+            j0[14] = 0;
+            j0[15] = 1;
+        }
+        else {
+            // J0 = GHASH(IV || 0^s || 0^64 || [len(IV)]64)
+            const GCM_TABLES* tables = key->GetTables();
+            memset(j0, 0, sizeof(j0));
+            ghashBlocks(tables, j0, pbIv, ivLen / GCM_BLOCK_LENGTH);
+            if (ivLen % GCM_BLOCK_LENGTH) {
+                CK_BYTE last[GCM_BLOCK_LENGTH] = { 0 };
+                memcpy(last, pbIv + ivLen - ivLen % GCM_BLOCK_LENGTH, ivLen % GCM_BLOCK_LENGTH);
+                ghashBlocks(tables, j0, last, 1);
+            }
+            CK_BYTE lengths[GCM_BLOCK_LENGTH] = { 0 };
+            StoreBE64(lengths + 8, (uint64_t)ivLen * 8);
+            ghashBlocks(tables, j0, lengths, 1);
+        }
+
+        memcpy(counter, j0, sizeof(counter));
+        Inc32(counter);
+        memset(hash, 0, sizeof(hash));
+    }
+    CATCH_EXCEPTION
+}
+
+void Gcm::Aad(
+    const CK_BYTE*      pbData,
+    size_t              len
+)
+{
+    try {
+        if (!key) {
+            THROW_EXCEPTION("AES-GCM is not initialized");
+        }
+        if (data) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+        aadLen += len;
+
+        if (bufferLen) {
+            size_t n = GCM_BLOCK_LENGTH - bufferLen;
+            if (n > len) {
+                n = len;
+            }
+            memcpy(buffer + bufferLen, pbData, n);
+            bufferLen += n;
+            pbData += n;
+            len -= n;
+            if (bufferLen < GCM_BLOCK_LENGTH) {
+                return;
+            }
+            ghashBlocks(key->GetTables(), hash, buffer, 1);
+            bufferLen = 0;
+        }
+
+        size_t blocks = len / GCM_BLOCK_LENGTH;
+        ghashBlocks(key->GetTables(), hash, pbData, blocks);
+        pbData += blocks * GCM_BLOCK_LENGTH;
+        len -= blocks * GCM_BLOCK_LENGTH;
+
+        memcpy(buffer, pbData, len);
+        bufferLen = len;
+    }
+    CATCH_EXCEPTION
+}
+
+void Gcm::Encrypt(
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              len
+)
+{
+    Crypt(pbIn, pbOut, len, false);
+}
+
+void Gcm::Decrypt(
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              len
+)
+{
+    Crypt(pbIn, pbOut, len, true);
+}
+
+void Gcm::Crypt(
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              len,
+    bool                decrypt
+)
+{
+    try {
+        if (!key) {
+            THROW_EXCEPTION("AES-GCM is not initialized");
+        }
+        if (len > GCM_MAX_DATA_LENGTH - dataLen) {
+            THROW_PKCS11_EXCEPTION(CKR_DATA_LEN_RANGE, "GCM message is too long");
+        }
+        if (!data) {
+            // Associated data ends with the first part of data
+            HashBuffer();
+            data = true;
+        }
+        dataLen += len;
+
+        const GCM_TABLES* tables = key->GetTables();
+
+        // The rest of the last key stream block, ciphertext is collected for GHASH
+        for (; len && keyStreamLen; len--, keyStreamLen--) {
+            CK_BYTE in = *pbIn++;
+            CK_BYTE out = in ^ keyStream[GCM_BLOCK_LENGTH - keyStreamLen];
+            buffer[bufferLen++] = decrypt ? in : out;
+            *pbOut++ = out;
+        }
+        if (bufferLen == GCM_BLOCK_LENGTH) {
+            ghashBlocks(tables, hash, buffer, 1);
+            bufferLen = 0;
+        }
+
+        size_t blocks = len / GCM_BLOCK_LENGTH;
+        if (blocks) {
+            Scoped<Aes> aes = key->GetAes();
+            (decrypt ? gcmDecryptBlocks : gcmEncryptBlocks)(aes->GetRoundKeys(), aes->GetRounds(), tables, counter, hash, pbIn, pbOut, blocks);
+            pbIn += blocks * GCM_BLOCK_LENGTH;
+            pbOut += blocks * GCM_BLOCK_LENGTH;
+            len -= blocks * GCM_BLOCK_LENGTH;
+        }
+
+        if (len) {
+            key->GetAes()->EncryptBlocks(counter, keyStream, 1);
+            Inc32(counter);
+            keyStreamLen = GCM_BLOCK_LENGTH;
+            for (; len; len--, keyStreamLen--) {
+                CK_BYTE in = *pbIn++;
+                CK_BYTE out = in ^ keyStream[GCM_BLOCK_LENGTH - keyStreamLen];
+                buffer[bufferLen++] = decrypt ? in : out;
+                *pbOut++ = out;
+            }
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void Gcm::HashBuffer()
+{
+    if (bufferLen) {
+        memset(buffer + bufferLen, 0, GCM_BLOCK_LENGTH - bufferLen);
+        ghashBlocks(key->GetTables(), hash, buffer, 1);
+        bufferLen = 0;
+    }
+    keyStreamLen = 0;
+}
+
+void Gcm::Final(
+    CK_BYTE*            pbTag
+)
+{
+    try {
+        if (!key) {
+            THROW_EXCEPTION("AES-GCM is not initialized");
+        }
+
+        HashBuffer();
+        data = true;
+
+        CK_BYTE lengths[GCM_BLOCK_LENGTH];
+        StoreBE64(lengths, aadLen * 8);
+        StoreBE64(lengths + 8, dataLen * 8);
+        ghashBlocks(key->GetTables(), hash, lengths, 1);
+
+        // T = E(K, J0) ^ S
+        key->GetAes()->EncryptBlocks(j0, pbTag, 1);
+        for (int i = 0; i < GCM_TAG_LENGTH; i++) {
+            pbTag[i] ^= hash[i];
+        }
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "../../stdafx.h"
+#include "../excep.h"
+#include "cpu.h"
+#include "aes.h"
+
+namespace core {
+
+#define GCM_BLOCK_LENGTH            16
+#define GCM_TAG_LENGTH              16
+// Powers of H kept for aggregated reduction, one per block of the widest kernel
+#define GCM_POWERS                  32
+
+    /**
+     * GHASH tables of a key, they are computed once from H = E(K, 0)
+     */
+    struct GCM_TABLES {
+        // H^32, H^31, ... H^1 with reversed bytes for carry-less multiplication
+        CK_BYTE             powers[GCM_POWERS * GCM_BLOCK_LENGTH];
+        // 4-bit tables of H for the portable multiplication
+        uint64_t            hl[16];
+        uint64_t            hh[16];
+    };
+
+    // Hash is Y of SP 800-38D in its byte order, blocks are folded into it
+    typedef void(*GHASH_BLOCKS)(const GCM_TABLES* tables, CK_BYTE* pbHash, const CK_BYTE* pbData, size_t blocks);
+    // Encrypts or decrypts with the counter and folds ciphertext into the hash. Low 32 bits of
+    // the counter are incremented modulo 2^32. Output may be the same buffer as input
+    typedef void(*GCM_BLOCKS)(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+
+    // Portable implementations, GHASH uses tables and is not constant time
+    void GhashBlocks(const GCM_TABLES* tables, CK_BYTE* pbHash, const CK_BYTE* pbData, size_t blocks);
+    void GcmEncryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void GcmDecryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+
+#ifdef PV_X86
+    // PCLMULQDQ with one reduction per 8 blocks, AES-NI rounds of the next 8 blocks are
+    // interleaved with GHASH of the previous ones
+    void GhashBlocksClmul(const GCM_TABLES* tables, CK_BYTE* pbHash, const CK_BYTE* pbData, size_t blocks);
+    void GcmEncryptBlocksClmul(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void GcmDecryptBlocksClmul(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    // VAES and VPCLMULQDQ with AVX-512, 32 blocks and one reduction per iteration
+    void GcmEncryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void GcmDecryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+#endif
+
+    /**
+     * AES key with GHASH tables, shared by all messages of the key
+     */
+    class GcmKey {
+    public:
+        GcmKey(
+            Scoped<Aes>         aes
+        );
+
+        ~GcmKey();
+
+        Scoped<Aes> GetAes();
+
+        const GCM_TABLES* GetTables();
+
+    protected:
+        Scoped<Aes>         aes;
+        GCM_TABLES          tables;
+    };
+
+    /**
+     * AES-GCM of one message (SP 800-38D). Associated data goes before data, both can be
+     * split into parts of any length
+     */
+    class Gcm {
+    public:
+        /**
+         * Selects the fastest implementations supported by CPU. The choice is limited
+         * by PV_PKCS11_AES environment variable as for Aes
+         */
+        static void Setup();
+
+        /**
+         * Returns name of implementation in use
+         */
+        static const char* GetImplementationName();
+
+        Gcm();
+        ~Gcm();
+
+        /**
+         * Starts a message. Throws CKR_MECHANISM_PARAM_INVALID if IV is empty
+         */
+        void Init(
+            Scoped<GcmKey>      key,
+            const CK_BYTE*      pbIv,
+            size_t              ivLen
+        );
+
+        /**
+         * Adds associated data. Throws CKR_OPERATION_ACTIVE after data was processed
+         */
+        void Aad(
+            const CK_BYTE*      pbData,
+            size_t              len
+        );
+
+        /**
+         * Output may be the same buffer as input. Throws CKR_DATA_LEN_RANGE if the message
+         * exceeds 2^36 - 32 bytes
+         */
+        void Encrypt(
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              len
+        );
+
+        void Decrypt(
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              len
+        );
+
+        /**
+         * Writes the 16-byte tag, shorter tags are its leading bytes
+         */
+        void Final(
+            CK_BYTE*            pbTag
+        );
+
+    protected:
+        Scoped<GcmKey>      key;
+        CK_BYTE             j0[GCM_BLOCK_LENGTH];
+        CK_BYTE             counter[GCM_BLOCK_LENGTH];
+        CK_BYTE             hash[GCM_BLOCK_LENGTH];
+        // Incomplete block of associated data or ciphertext
+        CK_BYTE             buffer[GCM_BLOCK_LENGTH];
+        size_t              bufferLen;
+        // Unused bytes of the last key stream block
+        CK_BYTE             keyStream[GCM_BLOCK_LENGTH];
+        size_t              keyStreamLen;
+        uint64_t            aadLen;
+        uint64_t            dataLen;
+        bool                data;
+
+        void Crypt(
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              len,
+            bool                decrypt
+        );
+
+        /**
+         * Hashes the incomplete block padded with zeros
+         */
+        void HashBuffer();
+    };
+
+}
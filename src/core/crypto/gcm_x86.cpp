@@ -0,0 +1,383 @@
+#include "gcm.h"
+
+#ifdef PV_X86
+
+#include <immintrin.h>
+
+using namespace core;
+
+// GHASH works on blocks with reversed bytes, then bit order of the field matches the order
+// of PCLMULQDQ operands up to a shift of the product by one bit (Intel white paper
+// "Intel Carry-Less Multiplication Instruction and its Usage for Computing the GCM Mode")
+#define GCM_BSWAP_MASK() _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+
+// Accumulates the product of a and b without reduction. Products of several blocks share
+// one reduction, the same macro serves 128 and 512-bit registers
+#define GHASH_MUL_ACC(a, b, lo, mid, hi, XOR, CLMUL)                    \
+    lo = XOR(lo, CLMUL(a, b, 0x00));                                    \
+    hi = XOR(hi, CLMUL(a, b, 0x11));                                    \
+    mid = XOR(mid, XOR(CLMUL(a, b, 0x01), CLMUL(a, b, 0x10)))
+
+#define CLMUL_ACC(a, b, lo, mid, hi) GHASH_MUL_ACC(a, b, lo, mid, hi, _mm_xor_si128, _mm_clmulepi64_si128)
+#define VPCLMUL_ACC(a, b, lo, mid, hi) GHASH_MUL_ACC(a, b, lo, mid, hi, _mm512_xor_si512, _mm512_clmulepi64_epi128)
+
+#define AES_ROUND8(B, k, ENC)                                           \
+    B[0] = ENC(B[0], k);                                                \
+    B[1] = ENC(B[1], k);                                                \
+    B[2] = ENC(B[2], k);                                                \
+    B[3] = ENC(B[3], k);                                                \
+    B[4] = ENC(B[4], k);                                                \
+    B[5] = ENC(B[5], k);                                                \
+    B[6] = ENC(B[6], k);                                                \
+    B[7] = ENC(B[7], k)
+
+// Loads block i of data for GHASH, mask is a local of the kernel
+#define CLMUL_BLOCK(p, i) _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p) + (i)), mask)
+#define VPCLMUL_BLOCK(p, i) _mm512_shuffle_epi8(_mm512_loadu_si512((const __m512i*)(p) + (i)), mask)
+
+// Encrypts 8 registers of counter blocks which are already XORed with the first round key.
+// Each of the first 8 rounds is paired with the product of one register of data, so AESENC
+// and PCLMULQDQ run in parallel. Register 0 carries the hash of the previous group and goes
+// last to shorten the chain between groups. Data is read from memory to leave registers
+// to the counter blocks
+#define GCM_ROUNDS8(B, rk, rounds, ENC, ENCLAST, ACC, BLOCK, XOR, LOAD, pbData, x, hp, lo, mid, hi) \
+    AES_ROUND8(B, rk[1], ENC); ACC(BLOCK(pbData, 1), LOAD(hp + 1), lo, mid, hi); \
+    AES_ROUND8(B, rk[2], ENC); ACC(BLOCK(pbData, 2), LOAD(hp + 2), lo, mid, hi); \
+    AES_ROUND8(B, rk[3], ENC); ACC(BLOCK(pbData, 3), LOAD(hp + 3), lo, mid, hi); \
+    AES_ROUND8(B, rk[4], ENC); ACC(BLOCK(pbData, 4), LOAD(hp + 4), lo, mid, hi); \
+    AES_ROUND8(B, rk[5], ENC); ACC(BLOCK(pbData, 5), LOAD(hp + 5), lo, mid, hi); \
+    AES_ROUND8(B, rk[6], ENC); ACC(BLOCK(pbData, 6), LOAD(hp + 6), lo, mid, hi); \
+    AES_ROUND8(B, rk[7], ENC); ACC(BLOCK(pbData, 7), LOAD(hp + 7), lo, mid, hi); \
+    AES_ROUND8(B, rk[8], ENC); ACC(XOR(BLOCK(pbData, 0), x), LOAD(hp + 0), lo, mid, hi); \
+    for (CK_ULONG r = 9; r < rounds; r++) {                             \
+        AES_ROUND8(B, rk[r], ENC);                                      \
+    }                                                                   \
+    AES_ROUND8(B, rk[rounds], ENCLAST)
+
+#define CLMUL_ROUNDS8(B, rk, rounds, pbData, x, hp, lo, mid, hi)       \
+    GCM_ROUNDS8(B, rk, rounds, _mm_aesenc_si128, _mm_aesenclast_si128, CLMUL_ACC, CLMUL_BLOCK, \
+        _mm_xor_si128, _mm_loadu_si128, pbData, x, hp, lo, mid, hi)
+#define VPCLMUL_ROUNDS8(B, rk, rounds, pbData, x, hp, lo, mid, hi)     \
+    GCM_ROUNDS8(B, rk, rounds, _mm512_aesenc_epi128, _mm512_aesenclast_epi128, VPCLMUL_ACC, VPCLMUL_BLOCK, \
+        _mm512_xor_si512, _mm512_loadu_si512, pbData, x, hp, lo, mid, hi)
+
+#define AESNI_LOAD_KEYS(rk, roundKeys, rounds)                          \
+    for (CK_ULONG r = 0; r <= rounds; r++) {                            \
+        rk[r] = _mm_loadu_si128((const __m128i*)(roundKeys + r * 16));  \
+    }
+
+#define AESNI_ENCRYPT8(B, rk, rounds)                                   \
+    AES_ROUND8(B, rk[0], _mm_xor_si128);                                \
+    for (CK_ULONG r = 1; r < rounds; r++) {                             \
+        AES_ROUND8(B, rk[r], _mm_aesenc_si128);                         \
+    }                                                                   \
+    AES_ROUND8(B, rk[rounds], _mm_aesenclast_si128)
+
+// Reduces the 256-bit product modulo x^128 + x^7 + x^2 + x + 1
+PV_TARGET("pclmul,sse4.1")
+static inline __m128i GhashReduce(__m128i lo, __m128i mid, __m128i hi)
+{
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    // Operands are bit-reflected, so the product is shifted left by one bit
+    __m128i t1 = _mm_srli_epi32(lo, 31);
+    __m128i t2 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    __m128i t3 = _mm_srli_si128(t1, 12);
+    t2 = _mm_slli_si128(t2, 4);
+    t1 = _mm_slli_si128(t1, 4);
+    lo = _mm_or_si128(lo, t1);
+    hi = _mm_or_si128(hi, t2);
+    hi = _mm_or_si128(hi, t3);
+
+    t1 = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+    t2 = _mm_srli_si128(t1, 4);
+    t1 = _mm_slli_si128(t1, 12);
+    lo = _mm_xor_si128(lo, t1);
+    t3 = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+    lo = _mm_xor_si128(lo, _mm_xor_si128(t3, t2));
+
+    return _mm_xor_si128(hi, lo);
+}
+
+PV_TARGET("pclmul,sse4.1")
+static inline __m128i GhashMultiply1(__m128i x, __m128i h)
+{
+    __m128i lo = _mm_setzero_si128();
+    __m128i mid = _mm_setzero_si128();
+    __m128i hi = _mm_setzero_si128();
+    CLMUL_ACC(x, h, lo, mid, hi);
+    return GhashReduce(lo, mid, hi);
+}
+
+PV_TARGET("aes,sse4.1")
+static inline __m128i AesNiEncrypt1(__m128i b, const __m128i* rk, CK_ULONG rounds)
+{
+    b = _mm_xor_si128(b, rk[0]);
+    for (CK_ULONG r = 1; r < rounds; r++) {
+        b = _mm_aesenc_si128(b, rk[r]);
+    }
+    return _mm_aesenclast_si128(b, rk[rounds]);
+}
+
+PV_TARGET("pclmul,sse4.1")
+void core::GhashBlocksClmul(const GCM_TABLES* tables, CK_BYTE* pbHash, const CK_BYTE* pbData, size_t blocks)
+{
+    const __m128i mask = GCM_BSWAP_MASK();
+    const __m128i* powers = (const __m128i*)tables->powers;
+    __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbHash), mask);
+
+    // X = (X ^ D0) * H^8 ^ D1 * H^7 ^ ... ^ D7 * H
+    for (; blocks >= 8; blocks -= 8, pbData += 128) {
+        __m128i lo = _mm_setzero_si128();
+        __m128i mid = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+        for (int i = 0; i < 8; i++) {
+            __m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pbData + i * 16)), mask);
+            if (!i) {
+                d = _mm_xor_si128(d, x);
+            }
+            CLMUL_ACC(d, _mm_loadu_si128(powers + GCM_POWERS - 8 + i), lo, mid, hi);
+        }
+        x = GhashReduce(lo, mid, hi);
+    }
+    __m128i h = _mm_loadu_si128(powers + GCM_POWERS - 1);
+    for (; blocks; blocks--, pbData += 16) {
+        __m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbData), mask);
+        x = GhashMultiply1(_mm_xor_si128(x, d), h);
+    }
+
+    _mm_storeu_si128((__m128i*)pbHash, _mm_shuffle_epi8(x, mask));
+}
+
+// Counter is kept with reversed bytes, so the low 32 bits are the first lane and wrap
+// modulo 2^32 by themselves
+PV_TARGET("aes,pclmul,sse4.1")
+void core::GcmEncryptBlocksClmul(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    __m128i rk[15];
+    AESNI_LOAD_KEYS(rk, roundKeys, rounds);
+    const __m128i mask = GCM_BSWAP_MASK();
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+    // Powers stay in memory, 16 registers are not enough
+    const __m128i* hp = (const __m128i*)tables->powers + GCM_POWERS - 8;
+    __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbHash), mask);
+    __m128i ctr = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbCounter), mask);
+
+    // Ciphertext of the previous group is hashed while the next group is encrypted
+    if (blocks >= 8) {
+        __m128i B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = _mm_shuffle_epi8(ctr, mask);
+            ctr = _mm_add_epi32(ctr, one);
+        }
+        AESNI_ENCRYPT8(B, rk, rounds);
+        for (int i = 0; i < 8; i++) {
+            _mm_storeu_si128((__m128i*)(pbOut + i * 16), _mm_xor_si128(B[i], _mm_loadu_si128((const __m128i*)(pbIn + i * 16))));
+        }
+        blocks -= 8;
+        pbIn += 128;
+        pbOut += 128;
+
+        for (; blocks >= 8; blocks -= 8, pbIn += 128, pbOut += 128) {
+            for (int i = 0; i < 8; i++) {
+                B[i] = _mm_xor_si128(_mm_shuffle_epi8(ctr, mask), rk[0]);
+                ctr = _mm_add_epi32(ctr, one);
+            }
+            __m128i lo = _mm_setzero_si128();
+            __m128i mid = _mm_setzero_si128();
+            __m128i hi = _mm_setzero_si128();
+            CLMUL_ROUNDS8(B, rk, rounds, pbOut - 128, x, hp, lo, mid, hi);
+            x = GhashReduce(lo, mid, hi);
+            for (int i = 0; i < 8; i++) {
+                _mm_storeu_si128((__m128i*)(pbOut + i * 16), _mm_xor_si128(B[i], _mm_loadu_si128((const __m128i*)(pbIn + i * 16))));
+            }
+        }
+
+        __m128i lo = _mm_setzero_si128();
+        __m128i mid = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+        CLMUL_ACC(_mm_xor_si128(CLMUL_BLOCK(pbOut - 128, 0), x), _mm_loadu_si128(hp), lo, mid, hi);
+        for (int i = 1; i < 8; i++) {
+            CLMUL_ACC(CLMUL_BLOCK(pbOut - 128, i), _mm_loadu_si128(hp + i), lo, mid, hi);
+        }
+        x = GhashReduce(lo, mid, hi);
+    }
+    for (; blocks; blocks--, pbIn += 16, pbOut += 16) {
+        __m128i b = AesNiEncrypt1(_mm_shuffle_epi8(ctr, mask), rk, rounds);
+        ctr = _mm_add_epi32(ctr, one);
+        b = _mm_xor_si128(b, _mm_loadu_si128((const __m128i*)pbIn));
+        _mm_storeu_si128((__m128i*)pbOut, b);
+        x = GhashMultiply1(_mm_xor_si128(x, _mm_shuffle_epi8(b, mask)), _mm_loadu_si128(hp + 7));
+    }
+
+    _mm_storeu_si128((__m128i*)pbCounter, _mm_shuffle_epi8(ctr, mask));
+    _mm_storeu_si128((__m128i*)pbHash, _mm_shuffle_epi8(x, mask));
+}
+
+PV_TARGET("aes,pclmul,sse4.1")
+void core::GcmDecryptBlocksClmul(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    __m128i rk[15];
+    AESNI_LOAD_KEYS(rk, roundKeys, rounds);
+    const __m128i mask = GCM_BSWAP_MASK();
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+    // Powers stay in memory, 16 registers are not enough
+    const __m128i* hp = (const __m128i*)tables->powers + GCM_POWERS - 8;
+    __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbHash), mask);
+    __m128i ctr = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbCounter), mask);
+
+    // Ciphertext is known in advance, so it is hashed while the same group is decrypted
+    for (; blocks >= 8; blocks -= 8, pbIn += 128, pbOut += 128) {
+        __m128i B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = _mm_xor_si128(_mm_shuffle_epi8(ctr, mask), rk[0]);
+            ctr = _mm_add_epi32(ctr, one);
+        }
+        __m128i lo = _mm_setzero_si128();
+        __m128i mid = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+        CLMUL_ROUNDS8(B, rk, rounds, pbIn, x, hp, lo, mid, hi);
+        for (int i = 0; i < 8; i++) {
+            _mm_storeu_si128((__m128i*)(pbOut + i * 16), _mm_xor_si128(B[i], _mm_loadu_si128((const __m128i*)(pbIn + i * 16))));
+        }
+        x = GhashReduce(lo, mid, hi);
+    }
+    for (; blocks; blocks--, pbIn += 16, pbOut += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)pbIn);
+        x = GhashMultiply1(_mm_xor_si128(x, _mm_shuffle_epi8(c, mask)), _mm_loadu_si128(hp + 7));
+        __m128i b = AesNiEncrypt1(_mm_shuffle_epi8(ctr, mask), rk, rounds);
+        ctr = _mm_add_epi32(ctr, one);
+        _mm_storeu_si128((__m128i*)pbOut, _mm_xor_si128(b, c));
+    }
+
+    _mm_storeu_si128((__m128i*)pbCounter, _mm_shuffle_epi8(ctr, mask));
+    _mm_storeu_si128((__m128i*)pbHash, _mm_shuffle_epi8(x, mask));
+}
+
+// 128-bit helpers are inlined only if their instruction sets are listed too
+#define VAES512_TARGET "aes,pclmul,sse4.1,vaes,vpclmulqdq,avx512f,avx512bw"
+
+// Sums 4 lanes of the product and reduces it
+PV_TARGET(VAES512_TARGET)
+static inline __m128i GhashReduce512(__m512i lo, __m512i mid, __m512i hi)
+{
+    __m128i l = _mm_xor_si128(
+        _mm_xor_si128(_mm512_extracti32x4_epi32(lo, 0), _mm512_extracti32x4_epi32(lo, 1)),
+        _mm_xor_si128(_mm512_extracti32x4_epi32(lo, 2), _mm512_extracti32x4_epi32(lo, 3)));
+    __m128i m = _mm_xor_si128(
+        _mm_xor_si128(_mm512_extracti32x4_epi32(mid, 0), _mm512_extracti32x4_epi32(mid, 1)),
+        _mm_xor_si128(_mm512_extracti32x4_epi32(mid, 2), _mm512_extracti32x4_epi32(mid, 3)));
+    __m128i h = _mm_xor_si128(
+        _mm_xor_si128(_mm512_extracti32x4_epi32(hi, 0), _mm512_extracti32x4_epi32(hi, 1)),
+        _mm_xor_si128(_mm512_extracti32x4_epi32(hi, 2), _mm512_extracti32x4_epi32(hi, 3)));
+    return GhashReduce(l, m, h);
+}
+
+// 32 blocks in 8 registers, lane j of register i is block 4 * i + j and is multiplied
+// by H^(32 - 4 * i - j)
+PV_TARGET(VAES512_TARGET)
+void core::GcmEncryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    if (blocks >= 32) {
+        __m512i rk[15];
+        for (CK_ULONG r = 0; r <= rounds; r++) {
+            rk[r] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(roundKeys + r * 16)));
+        }
+        const __m512i* hp = (const __m512i*)tables->powers;
+        const __m128i mask128 = GCM_BSWAP_MASK();
+        const __m512i mask = _mm512_broadcast_i32x4(mask128);
+        const __m512i four = _mm512_broadcast_i32x4(_mm_set_epi32(0, 0, 0, 4));
+        __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbHash), mask128);
+        __m512i ctr = _mm512_add_epi32(
+            _mm512_broadcast_i32x4(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbCounter), mask128)),
+            _mm512_set_epi32(0, 0, 0, 3, 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 0));
+
+        __m512i B[8];
+        for (int i = 0; i < 8; i++) {
+            B[i] = _mm512_xor_si512(_mm512_shuffle_epi8(ctr, mask), rk[0]);
+            ctr = _mm512_add_epi32(ctr, four);
+        }
+        for (CK_ULONG r = 1; r < rounds; r++) {
+            AES_ROUND8(B, rk[r], _mm512_aesenc_epi128);
+        }
+        for (int i = 0; i < 8; i++) {
+            B[i] = _mm512_aesenclast_epi128(B[i], rk[rounds]);
+            _mm512_storeu_si512(pbOut + i * 64, _mm512_xor_si512(B[i], _mm512_loadu_si512(pbIn + i * 64)));
+        }
+        blocks -= 32;
+        pbIn += 512;
+        pbOut += 512;
+
+        for (; blocks >= 32; blocks -= 32, pbIn += 512, pbOut += 512) {
+            for (int i = 0; i < 8; i++) {
+                B[i] = _mm512_xor_si512(_mm512_shuffle_epi8(ctr, mask), rk[0]);
+                ctr = _mm512_add_epi32(ctr, four);
+            }
+            __m512i lo = _mm512_setzero_si512();
+            __m512i mid = _mm512_setzero_si512();
+            __m512i hi = _mm512_setzero_si512();
+            VPCLMUL_ROUNDS8(B, rk, rounds, pbOut - 512, _mm512_inserti32x4(_mm512_setzero_si512(), x, 0), hp, lo, mid, hi);
+            x = GhashReduce512(lo, mid, hi);
+            for (int i = 0; i < 8; i++) {
+                _mm512_storeu_si512(pbOut + i * 64, _mm512_xor_si512(B[i], _mm512_loadu_si512(pbIn + i * 64)));
+            }
+        }
+
+        __m512i lo = _mm512_setzero_si512();
+        __m512i mid = _mm512_setzero_si512();
+        __m512i hi = _mm512_setzero_si512();
+        VPCLMUL_ACC(_mm512_xor_si512(VPCLMUL_BLOCK(pbOut - 512, 0), _mm512_inserti32x4(_mm512_setzero_si512(), x, 0)), _mm512_loadu_si512(hp), lo, mid, hi);
+        for (int i = 1; i < 8; i++) {
+            VPCLMUL_ACC(VPCLMUL_BLOCK(pbOut - 512, i), _mm512_loadu_si512(hp + i), lo, mid, hi);
+        }
+        x = GhashReduce512(lo, mid, hi);
+
+        _mm_storeu_si128((__m128i*)pbCounter, _mm_shuffle_epi8(_mm512_extracti32x4_epi32(ctr, 0), mask128));
+        _mm_storeu_si128((__m128i*)pbHash, _mm_shuffle_epi8(x, mask128));
+    }
+    GcmEncryptBlocksClmul(roundKeys, rounds, tables, pbCounter, pbHash, pbIn, pbOut, blocks);
+}
+
+PV_TARGET(VAES512_TARGET)
+void core::GcmDecryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, const GCM_TABLES* tables, CK_BYTE* pbCounter, CK_BYTE* pbHash, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    if (blocks >= 32) {
+        __m512i rk[15];
+        for (CK_ULONG r = 0; r <= rounds; r++) {
+            rk[r] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(roundKeys + r * 16)));
+        }
+        const __m512i* hp = (const __m512i*)tables->powers;
+        const __m128i mask128 = GCM_BSWAP_MASK();
+        const __m512i mask = _mm512_broadcast_i32x4(mask128);
+        const __m512i four = _mm512_broadcast_i32x4(_mm_set_epi32(0, 0, 0, 4));
+        __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbHash), mask128);
+        __m512i ctr = _mm512_add_epi32(
+            _mm512_broadcast_i32x4(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pbCounter), mask128)),
+            _mm512_set_epi32(0, 0, 0, 3, 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 0));
+
+        for (; blocks >= 32; blocks -= 32, pbIn += 512, pbOut += 512) {
+            __m512i B[8];
+            for (int i = 0; i < 8; i++) {
+                B[i] = _mm512_xor_si512(_mm512_shuffle_epi8(ctr, mask), rk[0]);
+                ctr = _mm512_add_epi32(ctr, four);
+            }
+            __m512i lo = _mm512_setzero_si512();
+            __m512i mid = _mm512_setzero_si512();
+            __m512i hi = _mm512_setzero_si512();
+            VPCLMUL_ROUNDS8(B, rk, rounds, pbIn, _mm512_inserti32x4(_mm512_setzero_si512(), x, 0), hp, lo, mid, hi);
+            for (int i = 0; i < 8; i++) {
+                _mm512_storeu_si512(pbOut + i * 64, _mm512_xor_si512(B[i], _mm512_loadu_si512(pbIn + i * 64)));
+            }
+            x = GhashReduce512(lo, mid, hi);
+        }
+
+        _mm_storeu_si128((__m128i*)pbCounter, _mm_shuffle_epi8(_mm512_extracti32x4_epi32(ctr, 0), mask128));
+        _mm_storeu_si128((__m128i*)pbHash, _mm_shuffle_epi8(x, mask128));
+    }
+    GcmDecryptBlocksClmul(roundKeys, rounds, tables, pbCounter, pbHash, pbIn, pbOut, blocks);
+}
+
+#endif
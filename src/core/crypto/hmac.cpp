@@ -0,0 +1,99 @@
+#include "hmac.h"
+
+using namespace core;
+
+#define HMAC_IPAD 0x36
+#define HMAC_OPAD 0x5c
+
+HmacPads::HmacPads(
+    CK_MECHANISM_TYPE   digestMechanism,
+    const CK_BYTE*      pbKey,
+    CK_ULONG            ulKeyLen
+)
+{
+    try {
+        inner.Init(digestMechanism);
+        outer.Init(digestMechanism);
+
+        CK_ULONG blockLen = inner.GetBlockLength();
+        CK_BYTE block[128];
+        memset(block, 0, sizeof(block));
+
+        // Keys longer than block are hashed
+        if (ulKeyLen > blockLen) {
+            inner.Update((CK_BYTE_PTR)pbKey, ulKeyLen);
+            inner.Final(block);
+        }
+        else if (ulKeyLen) {
+            memcpy(block, pbKey, ulKeyLen);
+        }
+
+        for (CK_ULONG i = 0; i < blockLen; i++) {
+            block[i] ^= HMAC_IPAD;
+        }
+        inner.Update(block, blockLen);
+
+        for (CK_ULONG i = 0; i < blockLen; i++) {
+            block[i] ^= HMAC_IPAD ^ HMAC_OPAD;
+        }
+        outer.Update(block, blockLen);
+
+        memset(block, 0, sizeof(block));
+    }
+    CATCH_EXCEPTION
+}
+
+CK_MECHANISM_TYPE Hmac::GetDigestMechanism(
+    CK_MECHANISM_TYPE   mechanism
+)
+{
+    switch (mechanism) {
+    case CKM_SHA_1_HMAC:
+        return CKM_SHA_1;
+    case CKM_SHA256_HMAC:
+        return CKM_SHA256;
+    case CKM_SHA384_HMAC:
+        return CKM_SHA384;
+    case CKM_SHA512_HMAC:
+        return CKM_SHA512;
+    default:
+        return 0;
+    }
+}
+
+void Hmac::Init(
+    Scoped<HmacPads>    pads
+)
+{
+    this->pads = pads;
+    sha = pads->inner;
+}
+
+void Hmac::Update(
+    CK_BYTE_PTR         pbData,
+    CK_ULONG            ulDataLen
+)
+{
+    sha.Update(pbData, ulDataLen);
+}
+
+void Hmac::Final(
+    CK_BYTE_PTR         pbMac
+)
+{
+    CK_BYTE digest[64];
+    CK_ULONG digestLen = sha.GetDigestLength();
+    sha.Final(digest);
+
+    sha = pads->outer;
+    sha.Update(digest, digestLen);
+    sha.Final(pbMac);
+
+    // Ready for the next message with the same key
+    sha = pads->inner;
+}
+
+CK_ULONG Hmac::GetMacLength()
+{
+    return sha.GetDigestLength();
+}
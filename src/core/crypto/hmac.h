@@ -0,0 +1,55 @@
+#pragma once
+
+#include "sha.h"
+
+namespace core {
+
+    /**
+     * Hash states after the inner and the outer padded key blocks. Computed once per
+     * key and hash, each HMAC starts from copies of them
+     */
+    class HmacPads {
+    public:
+        HmacPads(
+            CK_MECHANISM_TYPE   digestMechanism,
+            const CK_BYTE*      pbKey,
+            CK_ULONG            ulKeyLen
+        );
+
+        Sha                 inner;
+        Sha                 outer;
+    };
+
+    class Hmac {
+    public:
+        /**
+         * Returns digest mechanism of HMAC mechanism or 0 if mechanism is not HMAC
+         */
+        static CK_MECHANISM_TYPE GetDigestMechanism(
+            CK_MECHANISM_TYPE   mechanism
+        );
+
+        void Init(
+            Scoped<HmacPads>    pads
+        );
+
+        void Update(
+            CK_BYTE_PTR         pbData,
+            CK_ULONG            ulDataLen
+        );
+
+        /**
+         * Writes GetMacLength() bytes of MAC
+         */
+        void Final(
+            CK_BYTE_PTR         pbMac
+        );
+
+        CK_ULONG GetMacLength();
+
+    protected:
+        Scoped<HmacPads>    pads;
+        Sha                 sha;
+    };
+
+}
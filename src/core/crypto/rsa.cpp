@@ -0,0 +1,634 @@
+#include "rsa.h"
+#include "workers.h"
+
+using namespace core;
+
+// Odd primes below this bound divide candidates before Miller-Rabin
+#define RSA_SMALL_PRIME_BOUND   16384
+// Primes below this bound are sieved by word masks which repeat with the prime
+#define RSA_SIEVE_MASK_BOUND    64
+// Odd candidates start + 2k of one sieve window, k < RSA_SIEVE_WINDOW
+#define RSA_SIEVE_WINDOW        4096
+// Windows of one random start, the start is replaced after them
+#define RSA_SIEVE_WINDOWS       128
+
+// Tables are never freed, background key generation can run while statics are destroyed
+static const std::vector<uint16_t>& GetSmallPrimes()
+{
+    static const std::vector<uint16_t>* primes = []() {
+        std::vector<uint16_t>* res = new std::vector<uint16_t>;
+        std::vector<bool> composite(RSA_SMALL_PRIME_BOUND, false);
+        for (size_t i = 3; i < RSA_SMALL_PRIME_BOUND; i += 2) {
+            if (composite[i]) {
+                continue;
+            }
+            res->push_back((uint16_t)i);
+            for (size_t j = i * i; j < RSA_SMALL_PRIME_BOUND; j += 2 * i) {
+                composite[j] = true;
+            }
+        }
+        return res;
+    }();
+    return *primes;
+}
+
+// For each prime below RSA_SIEVE_MASK_BOUND, p masks of 64 bits. Bit j of mask s is set
+// if p divides s + j, so one OR marks all multiples in a word
+static const std::vector<std::vector<uint64_t> >& GetSieveMasks()
+{
+    static const std::vector<std::vector<uint64_t> >* masks = []() {
+        const std::vector<uint16_t>& primes = GetSmallPrimes();
+        std::vector<std::vector<uint64_t> >* res = new std::vector<std::vector<uint64_t> >;
+        for (size_t i = 0; i < primes.size() && primes[i] < RSA_SIEVE_MASK_BOUND; i++) {
+            size_t p = primes[i];
+            std::vector<uint64_t> primeMasks(p, 0);
+            for (size_t s = 0; s < p; s++) {
+                for (size_t j = (p - s) % p; j < 64; j += p) {
+                    primeMasks[s] |= (uint64_t)1 << j;
+                }
+            }
+            res->push_back(primeMasks);
+        }
+        return res;
+    }();
+    return *masks;
+}
+
+// Rounds of FIPS 186-4 table C.3 for primes of RSA keys
+static size_t GetMillerRabinRounds(size_t bits)
+{
+    if (bits >= 1536) {
+        return 4;
+    }
+    if (bits >= 1024) {
+        return 5;
+    }
+    if (bits >= 512) {
+        return 8;
+    }
+    return 40;
+}
+
+static BN_WORD GcdWord(BN_WORD a, BN_WORD b)
+{
+    while (b) {
+        BN_WORD r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+// a^-1 mod m of coprime a and m, m < 2^32
+static BN_WORD InverseWord(BN_WORD a, BN_WORD m)
+{
+    int64_t t = 0;
+    int64_t newT = 1;
+    int64_t r = (int64_t)m;
+    int64_t newR = (int64_t)(a % m);
+    while (newR) {
+        int64_t q = r / newR;
+        int64_t tmp = t - q * newT;
+        t = newT;
+        newT = tmp;
+        tmp = r - q * newR;
+        r = newR;
+        newR = tmp;
+    }
+    if (t < 0) {
+        t += (int64_t)m;
+    }
+    return (BN_WORD)t;
+}
+
+static BigNum RandomBits(size_t bits, RANDOM_BYTES random)
+{
+    size_t len = (bits + 7) / 8;
+    Buffer bytes(len);
+    random(bytes.data(), (CK_ULONG)len);
+    size_t extra = len * 8 - bits;
+    bytes[0] &= (CK_BYTE)(0xFF >> extra);
+    BigNum res = BigNum::FromBytes(bytes.data(), len);
+    memset(bytes.data(), 0, len);
+    return res;
+}
+
+// Random odd number of bits with two top bits set
+static BigNum RandomCandidate(size_t bits, RANDOM_BYTES random)
+{
+    size_t len = (bits + 7) / 8;
+    Buffer bytes(len);
+    random(bytes.data(), (CK_ULONG)len);
+    bytes[0] &= (CK_BYTE)(0xFF >> (len * 8 - bits));
+    for (size_t bit = bits - 2; bit < bits; bit++) {
+        bytes[len - 1 - bit / 8] |= (CK_BYTE)(1 << (bit % 8));
+    }
+    bytes[len - 1] |= 1;
+    BigNum res = BigNum::FromBytes(bytes.data(), len);
+    memset(bytes.data(), 0, len);
+    return res;
+}
+
+bool core::IsProbablePrime(
+    const BigNum&       candidate,
+    size_t              rounds,
+    RANDOM_BYTES        random
+)
+{
+    try {
+        MontContext ctx(candidate);
+        size_t n = ctx.GetWordCount();
+
+        // candidate - 1 = 2^s * d
+        BigNum minusOne = BigNum::Sub(candidate, BigNum(1));
+        size_t s = 0;
+        while (!minusOne.GetBit(s)) {
+            s++;
+        }
+        BigNum d = minusOne.ShiftRight(s);
+
+        std::vector<BN_WORD> minusOneMont(n);
+        ctx.ToMont(minusOneMont.data(), minusOne);
+        const BN_WORD* oneMont = ctx.GetOne();
+
+        BigNum range = BigNum::Sub(candidate, BigNum(3));
+        std::vector<BN_WORD> x(n);
+        size_t bytesLen = n * sizeof(BN_WORD);
+        for (size_t round = 0; round < rounds; round++) {
+            // base in [2, candidate - 2]
+            BigNum base = BigNum::Add(BigNum::Mod(RandomBits(candidate.GetBitLength() + 64, random), range), BigNum(2));
+            ctx.ToMont(x.data(), base);
+            ctx.ModExpMont(x.data(), x.data(), d);
+
+            if (!memcmp(x.data(), oneMont, bytesLen) || !memcmp(x.data(), minusOneMont.data(), bytesLen)) {
+                continue;
+            }
+            bool passed = false;
+            for (size_t i = 1; i < s; i++) {
+                ctx.Mul(x.data(), x.data(), x.data());
+                if (!memcmp(x.data(), minusOneMont.data(), bytesLen)) {
+                    passed = true;
+                    break;
+                }
+                if (!memcmp(x.data(), oneMont, bytesLen)) {
+                    break;
+                }
+            }
+            if (!passed) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+    CATCH_EXCEPTION
+}
+
+BigNum core::RsaGeneratePrime(
+    size_t                      bits,
+    BN_WORD                     e,
+    RANDOM_BYTES                random,
+    const std::atomic<bool>*    cancel
+)
+{
+    try {
+        const std::vector<uint16_t>& primes = GetSmallPrimes();
+        const std::vector<std::vector<uint64_t> >& masks = GetSieveMasks();
+        // Index of the first multiple of each prime in the window
+        std::vector<uint16_t> offsets(primes.size());
+        std::vector<uint64_t> composite(RSA_SIEVE_WINDOW / 64);
+        size_t rounds = GetMillerRabinRounds(bits);
+
+        BigNum maxDelta(2 * RSA_SIEVE_WINDOWS * RSA_SIEVE_WINDOW);
+
+        for (;;) {
+            BigNum start = RandomCandidate(bits, random);
+            if (BigNum::Add(start, maxDelta).GetBitLength() != bits) {
+                continue;
+            }
+
+            // start + 2k is divisible by p for k = -start / 2 mod p
+            for (size_t i = 0; i < primes.size(); i++) {
+                BN_WORD p = primes[i];
+                offsets[i] = (uint16_t)((p - start.ModWord(p)) * ((p + 1) / 2) % p);
+            }
+            BN_WORD startMinusOneModE = start.ModWord(e) + e - 1;
+
+            for (size_t window = 0; window < RSA_SIEVE_WINDOWS; window++) {
+                if (cancel && cancel->load()) {
+                    return BigNum();
+                }
+
+                std::fill(composite.begin(), composite.end(), 0);
+                size_t i = 0;
+                for (; i < masks.size(); i++) {
+                    size_t p = primes[i];
+                    const uint64_t* primeMasks = masks[i].data();
+                    size_t s = (p - offsets[i]) % p;
+                    size_t step = 64 % p;
+                    for (size_t w = 0; w < composite.size(); w++) {
+                        composite[w] |= primeMasks[s];
+                        s += step;
+                        if (s >= p) {
+                            s -= p;
+                        }
+                    }
+                    offsets[i] = (uint16_t)((offsets[i] + p - RSA_SIEVE_WINDOW % p) % p);
+                }
+                for (; i < primes.size(); i++) {
+                    size_t p = primes[i];
+                    size_t k = offsets[i];
+                    for (; k < RSA_SIEVE_WINDOW; k += p) {
+                        composite[k / 64] |= (uint64_t)1 << (k % 64);
+                    }
+                    offsets[i] = (uint16_t)(k - RSA_SIEVE_WINDOW);
+                }
+
+                for (size_t w = 0; w < composite.size(); w++) {
+                    if (composite[w] == ~(uint64_t)0) {
+                        continue;
+                    }
+                    for (size_t j = 0; j < 64; j++) {
+                        if (composite[w] & ((uint64_t)1 << j)) {
+                            continue;
+                        }
+                        BN_WORD delta = 2 * (window * RSA_SIEVE_WINDOW + w * 64 + j);
+                        if (GcdWord((startMinusOneModE + delta) % e, e) != 1) {
+                            continue;
+                        }
+
+                        BigNum candidate = BigNum::Add(start, BigNum(delta));
+                        if (cancel && cancel->load()) {
+                            return BigNum();
+                        }
+                        if (IsProbablePrime(candidate, rounds, random)) {
+                            return candidate;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+/**
+ * Searches primes of bits[i] for i in [0, count) at the same time. Each prime has
+ * searchers on WorkerPool threads, the first one which finds it cancels the others
+ */
+static void SearchPrimes(
+    const size_t*       bits,
+    BigNum*             primes,
+    size_t              count,
+    BN_WORD             e,
+    RANDOM_BYTES        random
+)
+{
+    WorkerPool& workers = WorkerPool::Get();
+    size_t searchers = WorkerPool::GetThreshold() ? workers.GetConcurrency() : 1;
+    searchers = (searchers + count - 1) / count * count;
+
+    std::mutex mutex;
+    std::vector<Scoped<std::atomic<bool> > > found;
+    for (size_t i = 0; i < count; i++) {
+        found.push_back(Scoped<std::atomic<bool> >(new std::atomic<bool>(false)));
+    }
+
+    workers.Run(searchers, [&](size_t searcher) {
+        size_t index = searcher % count;
+        BigNum prime = RsaGeneratePrime(bits[index], e, random, found[index].get());
+        if (prime.IsZero()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!found[index]->load()) {
+            primes[index] = prime;
+            found[index]->store(true);
+        }
+    });
+}
+
+Scoped<Rsa> Rsa::Generate(
+    size_t              modulusBits,
+    const BigNum&       publicExponent,
+    RANDOM_BYTES        random
+)
+{
+    try {
+        if (modulusBits < RSA_MIN_MODULUS_BITS || modulusBits > RSA_MAX_MODULUS_BITS) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_SIZE_RANGE, "Wrong RSA modulus length");
+        }
+        if (!publicExponent.IsOdd() || publicExponent.GetBitLength() > 32 || BigNum::Compare(publicExponent, BigNum(3)) < 0) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Public exponent must be odd, at least 3 and less than 2^32");
+        }
+        BN_WORD e = publicExponent.GetWords()[0];
+
+        size_t bits[2];
+        bits[0] = (modulusBits + 1) / 2;
+        bits[1] = modulusBits - bits[0];
+        // |p - q| > 2^(modulusBits / 2 - 100)
+        BigNum minDistance = BigNum(1).ShiftLeft(modulusBits / 2 - 100);
+
+        for (;;) {
+            BigNum primes[2];
+            SearchPrimes(bits, primes, 2, e, random);
+            BigNum p = primes[0];
+            BigNum q = primes[1];
+            for (;;) {
+                int cmp = BigNum::Compare(p, q);
+                BigNum distance = cmp >= 0 ? BigNum::Sub(p, q) : BigNum::Sub(q, p);
+                if (BigNum::Compare(distance, minDistance) > 0) {
+                    break;
+                }
+                SearchPrimes(&bits[1], &q, 1, e, random);
+            }
+            if (BigNum::Compare(p, q) < 0) {
+                BigNum tmp = p;
+                p = q;
+                q = tmp;
+            }
+
+            BigNum n = BigNum::Mul(p, q);
+            BigNum p1 = BigNum::Sub(p, BigNum(1));
+            BigNum q1 = BigNum::Sub(q, BigNum(1));
+
+            // d = e^-1 mod lcm(p - 1, q - 1). With k = -lcm^-1 mod e, 1 + k * lcm is
+            // divisible by e, so d is its quotient
+            BigNum lcm;
+            BigNum::DivMod(BigNum::Mul(p1, q1), BigNum::Gcd(p1, q1), &lcm, NULL);
+            BN_WORD k = (e - InverseWord(lcm.ModWord(e), e)) % e;
+            BN_WORD rem;
+            BigNum d = BigNum::Add(BigNum::Mul(lcm, BigNum(k)), BigNum(1)).DivWord(e, &rem);
+            if (rem) {
+                THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "Cannot compute private exponent");
+            }
+            if (d.GetBitLength() <= modulusBits / 2) {
+                continue;
+            }
+
+            BigNum dp = BigNum::Mod(d, p1);
+            BigNum dq = BigNum::Mod(d, q1);
+            // p is prime, q^-1 = q^(p - 2) mod p
+            MontContext pCtx(p);
+            BigNum qInv = pCtx.ModExp(q, BigNum::Sub(p, BigNum(2)));
+
+            return Scoped<Rsa>(new Rsa(n, publicExponent, d, p, q, dp, dq, qInv));
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+Rsa::Rsa(
+    const BigNum&       n,
+    const BigNum&       e
+) :
+    hasPrivateKey(false),
+    n(n),
+    e(e),
+    blindingUses(0)
+{
+}
+
+Rsa::Rsa(
+    const BigNum&       n,
+    const BigNum&       e,
+    const BigNum&       d,
+    const BigNum&       p,
+    const BigNum&       q,
+    const BigNum&       dp,
+    const BigNum&       dq,
+    const BigNum&       qInv
+) :
+    hasPrivateKey(true),
+    n(n),
+    e(e),
+    d(d),
+    p(p),
+    q(q),
+    dp(dp),
+    dq(dq),
+    qInv(qInv),
+    blindingUses(0)
+{
+}
+
+bool Rsa::HasPrivateKey() const
+{
+    return hasPrivateKey;
+}
+
+size_t Rsa::GetModulusBits() const
+{
+    return n.GetBitLength();
+}
+
+const BigNum& Rsa::GetModulus() const
+{
+    return n;
+}
+
+const BigNum& Rsa::GetPublicExponent() const
+{
+    return e;
+}
+
+const BigNum& Rsa::GetPrivateExponent() const
+{
+    return d;
+}
+
+const BigNum& Rsa::GetPrime1() const
+{
+    return p;
+}
+
+const BigNum& Rsa::GetPrime2() const
+{
+    return q;
+}
+
+const BigNum& Rsa::GetExponent1() const
+{
+    return dp;
+}
+
+const BigNum& Rsa::GetExponent2() const
+{
+    return dq;
+}
+
+const BigNum& Rsa::GetCoefficient() const
+{
+    return qInv;
+}
+
+void Rsa::CreateContexts()
+{
+    if (nCtx) {
+        return;
+    }
+    Scoped<MontContext> ctx(new MontContext(n));
+    if (hasPrivateKey) {
+        pCtx = Scoped<MontContext>(new MontContext(p));
+        qCtx = Scoped<MontContext>(new MontContext(q));
+        qInvMont.resize(pCtx->GetWordCount());
+        pCtx->ToMont(qInvMont.data(), qInv);
+    }
+    nCtx = ctx;
+}
+
+BigNum Rsa::Garner(
+    const BigNum&       mp,
+    const BigNum&       mq
+)
+{
+    size_t words = pCtx->GetWordCount();
+    BigNum mqp = BigNum::Mod(mq, p);
+    BigNum diff = BigNum::Compare(mp, mqp) >= 0
+        ? BigNum::Sub(mp, mqp)
+        : BigNum::Sub(BigNum::Add(mp, p), mqp);
+
+    BN_WORD value[BN_MONT_MAX_WORDS];
+    diff.ToWords(value, words);
+    pCtx->Mul(value, value, qInvMont.data());
+    BigNum res = BigNum::FromWords(value, words);
+    memset(value, 0, words * sizeof(BN_WORD));
+    return res;
+}
+
+void Rsa::PublicExp(
+    BN_WORD*            r,
+    const BN_WORD*      base
+)
+{
+    size_t words = nCtx->GetWordCount();
+    BN_WORD acc[BN_MONT_MAX_WORDS];
+    memcpy(acc, base, words * sizeof(BN_WORD));
+    for (size_t bit = e.GetBitLength() - 1; bit > 0; bit--) {
+        nCtx->Mul(acc, acc, acc);
+        if (e.GetBit(bit - 1)) {
+            nCtx->Mul(acc, acc, base);
+        }
+    }
+    memcpy(r, acc, words * sizeof(BN_WORD));
+}
+
+BigNum Rsa::PublicOperation(
+    const BigNum&       input
+)
+{
+    try {
+        if (BigNum::Compare(input, n) >= 0) {
+            THROW_PKCS11_EXCEPTION(CKR_DATA_INVALID, "Input is not less than RSA modulus");
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            CreateContexts();
+        }
+
+        BN_WORD value[BN_MONT_MAX_WORDS];
+        nCtx->ToMont(value, input);
+        PublicExp(value, value);
+        return nCtx->FromMont(value);
+    }
+    CATCH_EXCEPTION
+}
+
+void Rsa::CreateBlinding(
+    BN_WORD*            pBlinding,
+    BN_WORD*            pUnblinding,
+    RANDOM_BYTES        random
+)
+{
+    BigNum r;
+    do {
+        r = BigNum::Mod(RandomBits(n.GetBitLength() + 64, random), n);
+    } while (r.IsZero());
+
+    nCtx->ToMont(pBlinding, r);
+    PublicExp(pBlinding, pBlinding);
+
+    // p and q are prime, r^-1 is r^(p - 2) mod p and r^(q - 2) mod q joined by CRT
+    BigNum rp;
+    BigNum rq;
+    MontContext::ModExp2(
+        *pCtx, r, BigNum::Sub(p, BigNum(2)), &rp,
+        *qCtx, r, BigNum::Sub(q, BigNum(2)), &rq);
+    BigNum inverse = BigNum::Add(rq, BigNum::Mul(Garner(rp, rq), q));
+    nCtx->ToMont(pUnblinding, inverse);
+}
+
+BigNum Rsa::PrivateOperation(
+    const BigNum&       input,
+    RANDOM_BYTES        random
+)
+{
+    try {
+        if (!hasPrivateKey) {
+            THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "RSA key has no private part");
+        }
+        if (BigNum::Compare(input, n) >= 0) {
+            THROW_PKCS11_EXCEPTION(CKR_DATA_INVALID, "Input is not less than RSA modulus");
+        }
+
+        size_t words = n.GetWordCount();
+        BN_WORD blind[BN_MONT_MAX_WORDS];
+        BN_WORD unblind[BN_MONT_MAX_WORDS];
+        bool refresh = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            CreateContexts();
+            if (blinding.empty() || blindingUses >= RSA_BLINDING_REFRESH) {
+                refresh = true;
+            }
+            else {
+                memcpy(blind, blinding.data(), words * sizeof(BN_WORD));
+                memcpy(unblind, unblinding.data(), words * sizeof(BN_WORD));
+                nCtx->Mul(blinding.data(), blinding.data(), blinding.data());
+                nCtx->Mul(unblinding.data(), unblinding.data(), unblinding.data());
+                blindingUses++;
+            }
+        }
+        if (refresh) {
+            // The new pair is made without the lock, other operations keep the old one
+            CreateBlinding(blind, unblind, random);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            blinding.resize(words);
+            unblinding.resize(words);
+            nCtx->Mul(blinding.data(), blind, blind);
+            nCtx->Mul(unblinding.data(), unblind, unblind);
+            blindingUses = 1;
+        }
+
+        // Multiplication by Montgomery form leaves the plain product
+        BN_WORD value[BN_MONT_MAX_WORDS];
+        input.ToWords(value, words);
+        nCtx->Mul(value, value, blind);
+        BigNum blinded = BigNum::FromWords(value, words);
+
+        BigNum mp;
+        BigNum mq;
+        MontContext::ModExp2(*pCtx, blinded, dp, &mp, *qCtx, blinded, dq, &mq);
+        BigNum::Add(mq, BigNum::Mul(Garner(mp, mq), q)).ToWords(value, words);
+        nCtx->Mul(value, value, unblind);
+        BigNum res = BigNum::FromWords(value, words);
+
+        // A fault of CRT halves would reveal a factor of n
+        BN_WORD check[BN_MONT_MAX_WORDS];
+        nCtx->ToMont(check, res);
+        PublicExp(check, check);
+        bool valid = !BigNum::Compare(nCtx->FromMont(check), input);
+
+        memset(blind, 0, words * sizeof(BN_WORD));
+        memset(unblind, 0, words * sizeof(BN_WORD));
+        memset(value, 0, words * sizeof(BN_WORD));
+        if (!valid) {
+            THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "RSA private operation failed the check");
+        }
+
+        return res;
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+#include "../../stdafx.h"
+#include "../excep.h"
+#include "bn.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace core {
+
+#define RSA_MIN_MODULUS_BITS    1024
+#define RSA_MAX_MODULUS_BITS    8192
+// Private operations of one blinding pair, the pair is squared between them
+#define RSA_BLINDING_REFRESH    32
+
+    /**
+     * Miller-Rabin test with rounds of random bases. Candidate must be odd and greater than 3
+     */
+    bool IsProbablePrime(
+        const BigNum&       candidate,
+        size_t              rounds,
+        RANDOM_BYTES        random
+    );
+
+    /**
+     * Returns a probable prime p of bits with two top bits set, so a product of two such
+     * primes has all bits. p - 1 is coprime with the public exponent e. Candidates which
+     * have small factors are removed by a sieve before Miller-Rabin. Returns zero once
+     * cancel is set, it can be NULL
+     */
+    BigNum RsaGeneratePrime(
+        size_t                      bits,
+        BN_WORD                     e,
+        RANDOM_BYTES                random,
+        const std::atomic<bool>*    cancel = NULL
+    );
+
+    /**
+     * DER prefix of DigestInfo for CKM_SHA_1, CKM_SHA256, CKM_SHA384 and CKM_SHA512, the
+     * digest follows it. Throws CKR_MECHANISM_PARAM_INVALID for other mechanisms
+     */
+    void RsaGetDigestInfoPrefix(
+        CK_MECHANISM_TYPE   digestMechanism,
+        const CK_BYTE**     ppPrefix,
+        size_t*             pPrefixLen
+    );
+
+    /**
+     * EMSA-PKCS1-v1_5 of RFC 8017 9.2, 00 01 FF .. FF 00 followed by data of len bytes.
+     * Throws CKR_DATA_LEN_RANGE if data is longer than len - 11
+     */
+    void RsaPkcs1Encode(
+        const CK_BYTE*      pbData,
+        size_t              dataLen,
+        CK_BYTE*            pbEncoded,
+        size_t              len
+    );
+
+    /**
+     * XORs data with MGF1 mask of RFC 8017 B.2.1
+     */
+    void RsaMgf1Xor(
+        CK_MECHANISM_TYPE   digestMechanism,
+        const CK_BYTE*      pbSeed,
+        size_t              seedLen,
+        CK_BYTE*            pbData,
+        size_t              len
+    );
+
+    /**
+     * EMSA-PSS-ENCODE of RFC 8017 9.1.1 for hash of the message. Encoded message has
+     * (emBits + 7) / 8 bytes, emBits is modulus bits - 1. Throws CKR_MECHANISM_PARAM_INVALID
+     * if salt doesn't fit
+     */
+    void RsaPssEncode(
+        CK_MECHANISM_TYPE   digestMechanism,
+        CK_MECHANISM_TYPE   mgfDigestMechanism,
+        const CK_BYTE*      pbHash,
+        size_t              saltLen,
+        CK_BYTE*            pbEncoded,
+        size_t              emBits,
+        RANDOM_BYTES        random
+    );
+
+    /**
+     * EMSA-PSS-VERIFY of RFC 8017 9.1.2
+     */
+    bool RsaPssVerify(
+        CK_MECHANISM_TYPE   digestMechanism,
+        CK_MECHANISM_TYPE   mgfDigestMechanism,
+        const CK_BYTE*      pbHash,
+        size_t              saltLen,
+        const CK_BYTE*      pbEncoded,
+        size_t              emBits
+    );
+
+    /**
+     * EME-OAEP encoding of RFC 8017 7.1.1 to len bytes. Throws CKR_DATA_LEN_RANGE if
+     * message is longer than len - 2 * hLen - 2
+     */
+    void RsaOaepEncode(
+        CK_MECHANISM_TYPE   digestMechanism,
+        CK_MECHANISM_TYPE   mgfDigestMechanism,
+        const CK_BYTE*      pbLabel,
+        size_t              labelLen,
+        const CK_BYTE*      pbMessage,
+        size_t              messageLen,
+        CK_BYTE*            pbEncoded,
+        size_t              len,
+        RANDOM_BYTES        random
+    );
+
+    /**
+     * EME-OAEP decoding of RFC 8017 7.1.2, returns message length. Encoded message is
+     * modified, pbMessage gets up to len bytes. Padding is checked without branches on its
+     * bytes, all failures throw the same CKR_ENCRYPTED_DATA_INVALID
+     */
+    size_t RsaOaepDecode(
+        CK_MECHANISM_TYPE   digestMechanism,
+        CK_MECHANISM_TYPE   mgfDigestMechanism,
+        const CK_BYTE*      pbLabel,
+        size_t              labelLen,
+        CK_BYTE*            pbEncoded,
+        size_t              len,
+        CK_BYTE*            pbMessage
+    );
+
+    /**
+     * RSA key. A public key has modulus and public exponent only, a private key has CRT
+     * parameters too. Montgomery contexts of n, p and q are built on the first operation and
+     * kept by the key, so one object should serve all operations of a key
+     */
+    class Rsa {
+    public:
+        /**
+         * Generates key of FIPS 186-4 B.3.3 with probable primes. p and q are searched at
+         * the same time on WorkerPool threads. Throws CKR_KEY_SIZE_RANGE
+         * if modulusBits is out of [RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS], and
+         * CKR_ATTRIBUTE_VALUE_INVALID if public exponent is even, less than 3 or not less
+         * than 2^32
+         */
+        static Scoped<Rsa> Generate(
+            size_t              modulusBits,
+            const BigNum&       publicExponent,
+            RANDOM_BYTES        random
+        );
+
+        Rsa(
+            const BigNum&       n,
+            const BigNum&       e
+        );
+
+        Rsa(
+            const BigNum&       n,
+            const BigNum&       e,
+            const BigNum&       d,
+            const BigNum&       p,
+            const BigNum&       q,
+            const BigNum&       dp,
+            const BigNum&       dq,
+            const BigNum&       qInv
+        );
+
+        bool HasPrivateKey() const;
+
+        size_t GetModulusBits() const;
+
+        const BigNum& GetModulus() const;
+        const BigNum& GetPublicExponent() const;
+        const BigNum& GetPrivateExponent() const;
+        const BigNum& GetPrime1() const;
+        const BigNum& GetPrime2() const;
+        const BigNum& GetExponent1() const;
+        const BigNum& GetExponent2() const;
+        const BigNum& GetCoefficient() const;
+
+        /**
+         * input^e mod n. Throws CKR_DATA_INVALID if input is not less than modulus
+         */
+        BigNum PublicOperation(
+            const BigNum&       input
+        );
+
+        /**
+         * input^d mod n by CRT, both halves are computed at the same time where the CPU
+         * allows it. Input is blinded by a pair r^e and r^-1 which is squared after each
+         * use and replaced every RSA_BLINDING_REFRESH operations. The result is checked by
+         * the public exponent. Throws CKR_DATA_INVALID if input is not less than modulus,
+         * and CKR_FUNCTION_FAILED if the check fails
+         */
+        BigNum PrivateOperation(
+            const BigNum&       input,
+            RANDOM_BYTES        random
+        );
+
+    protected:
+        bool                hasPrivateKey;
+        BigNum              n;
+        BigNum              e;
+        BigNum              d;
+        BigNum              p;
+        BigNum              q;
+        BigNum              dp;
+        BigNum              dq;
+        BigNum              qInv;
+
+        // Guards contexts and the blinding pair
+        std::mutex              mutex;
+        Scoped<MontContext>     nCtx;
+        Scoped<MontContext>     pCtx;
+        Scoped<MontContext>     qCtx;
+        // qInv in Montgomery form of p
+        std::vector<BN_WORD>    qInvMont;
+        // r^e and r^-1 in Montgomery form of n
+        std::vector<BN_WORD>    blinding;
+        std::vector<BN_WORD>    unblinding;
+        size_t                  blindingUses;
+
+        void CreateContexts();
+
+        /**
+         * (mp - mq) * qInv mod p of Garner's formula
+         */
+        BigNum Garner(
+            const BigNum&       mp,
+            const BigNum&       mq
+        );
+
+        /**
+         * Returns a new blinding pair in Montgomery form of n
+         */
+        void CreateBlinding(
+            BN_WORD*            pBlinding,
+            BN_WORD*            pUnblinding,
+            RANDOM_BYTES        random
+        );
+
+        /**
+         * base^e mod n, Montgomery form of base and result. Public exponent allows
+         * variable time
+         */
+        void PublicExp(
+            BN_WORD*            r,
+            const BN_WORD*      base
+        );
+    };
+
+}
@@ -0,0 +1,282 @@
+#include "rsa.h"
+#include "sha.h"
+
+using namespace core;
+
+#define RSA_MAX_DIGEST_LENGTH   64
+
+// DigestInfo of RFC 8017 9.2 note 1 without the digest
+static const CK_BYTE RSA_SHA1_PREFIX[] = {
+    0x30, 0x21, 0x30, 0x09, 0x06, 0x05, 0x2b, 0x0e, 0x03, 0x02, 0x1a, 0x05, 0x00, 0x04, 0x14
+};
+static const CK_BYTE RSA_SHA256_PREFIX[] = {
+    0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01,
+    0x05, 0x00, 0x04, 0x20
+};
+static const CK_BYTE RSA_SHA384_PREFIX[] = {
+    0x30, 0x41, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x02,
+    0x05, 0x00, 0x04, 0x30
+};
+static const CK_BYTE RSA_SHA512_PREFIX[] = {
+    0x30, 0x51, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x03,
+    0x05, 0x00, 0x04, 0x40
+};
+
+// All bits are set if a equals b
+static inline size_t EqualMask(size_t a, size_t b)
+{
+    size_t diff = a ^ b;
+    return 0 - (((diff | (0 - diff)) >> (sizeof(size_t) * 8 - 1)) ^ 1);
+}
+
+static size_t GetHashLength(CK_MECHANISM_TYPE digestMechanism)
+{
+    size_t len = Sha::GetDigestLength(digestMechanism);
+    if (!len) {
+        THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Wrong digest mechanism");
+    }
+    return len;
+}
+
+void core::RsaGetDigestInfoPrefix(
+    CK_MECHANISM_TYPE   digestMechanism,
+    const CK_BYTE**     ppPrefix,
+    size_t*             pPrefixLen
+)
+{
+    switch (digestMechanism) {
+    case CKM_SHA_1:
+        *ppPrefix = RSA_SHA1_PREFIX;
+        *pPrefixLen = sizeof(RSA_SHA1_PREFIX);
+        break;
+    case CKM_SHA256:
+        *ppPrefix = RSA_SHA256_PREFIX;
+        *pPrefixLen = sizeof(RSA_SHA256_PREFIX);
+        break;
+    case CKM_SHA384:
+        *ppPrefix = RSA_SHA384_PREFIX;
+        *pPrefixLen = sizeof(RSA_SHA384_PREFIX);
+        break;
+    case CKM_SHA512:
+        *ppPrefix = RSA_SHA512_PREFIX;
+        *pPrefixLen = sizeof(RSA_SHA512_PREFIX);
+        break;
+    default:
+        THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Wrong digest mechanism");
+    }
+}
+
+void core::RsaPkcs1Encode(
+    const CK_BYTE*      pbData,
+    size_t              dataLen,
+    CK_BYTE*            pbEncoded,
+    size_t              len
+)
+{
+    if (dataLen + 11 > len) {
+        THROW_PKCS11_EXCEPTION(CKR_DATA_LEN_RANGE, "Data is too long for RSA modulus");
+    }
+    size_t psLen = len - dataLen - 3;
+    pbEncoded[0] = 0x00;
+    pbEncoded[1] = 0x01;
+    memset(pbEncoded + 2, 0xFF, psLen);
+    pbEncoded[2 + psLen] = 0x00;
+    memcpy(pbEncoded + 3 + psLen, pbData, dataLen);
+}
+
+void core::RsaMgf1Xor(
+    CK_MECHANISM_TYPE   digestMechanism,
+    const CK_BYTE*      pbSeed,
+    size_t              seedLen,
+    CK_BYTE*            pbData,
+    size_t              len
+)
+{
+    size_t hLen = GetHashLength(digestMechanism);
+    Sha sha;
+    sha.Init(digestMechanism);
+    CK_BYTE mask[RSA_MAX_DIGEST_LENGTH];
+    for (uint32_t counter = 0; len; counter++) {
+        CK_BYTE c[4] = {
+            (CK_BYTE)(counter >> 24), (CK_BYTE)(counter >> 16), (CK_BYTE)(counter >> 8), (CK_BYTE)counter
+        };
+        sha.Update((CK_BYTE_PTR)pbSeed, (CK_ULONG)seedLen);
+        sha.Update(c, sizeof(c));
+        sha.Final(mask);
+
+        size_t part = len < hLen ? len : hLen;
+        for (size_t i = 0; i < part; i++) {
+            pbData[i] ^= mask[i];
+        }
+        pbData += part;
+        len -= part;
+    }
+    memset(mask, 0, sizeof(mask));
+}
+
+// H = Hash(00 * 8 || mHash || salt) of EMSA-PSS
+static void RsaPssHash(CK_MECHANISM_TYPE digestMechanism, const CK_BYTE* pbHash, size_t hLen, const CK_BYTE* pbSalt, size_t saltLen, CK_BYTE* pbOut)
+{
+    CK_BYTE zeros[8] = { 0 };
+    Sha sha;
+    sha.Init(digestMechanism);
+    sha.Update(zeros, sizeof(zeros));
+    sha.Update((CK_BYTE_PTR)pbHash, (CK_ULONG)hLen);
+    if (saltLen) {
+        sha.Update((CK_BYTE_PTR)pbSalt, (CK_ULONG)saltLen);
+    }
+    sha.Final(pbOut);
+}
+
+void core::RsaPssEncode(
+    CK_MECHANISM_TYPE   digestMechanism,
+    CK_MECHANISM_TYPE   mgfDigestMechanism,
+    const CK_BYTE*      pbHash,
+    size_t              saltLen,
+    CK_BYTE*            pbEncoded,
+    size_t              emBits,
+    RANDOM_BYTES        random
+)
+{
+    size_t hLen = GetHashLength(digestMechanism);
+    size_t emLen = (emBits + 7) / 8;
+    if (emLen < hLen + saltLen + 2) {
+        THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Salt is too long for RSA modulus");
+    }
+
+    // EM = maskedDB || H || BC, DB = 00 .. 00 01 || salt
+    size_t dbLen = emLen - hLen - 1;
+    CK_BYTE* db = pbEncoded;
+    CK_BYTE* h = pbEncoded + dbLen;
+    memset(db, 0, dbLen);
+    db[dbLen - saltLen - 1] = 0x01;
+    CK_BYTE* salt = db + dbLen - saltLen;
+    if (saltLen) {
+        random(salt, (CK_ULONG)saltLen);
+    }
+    RsaPssHash(digestMechanism, pbHash, hLen, salt, saltLen, h);
+    RsaMgf1Xor(mgfDigestMechanism, h, hLen, db, dbLen);
+    db[0] &= (CK_BYTE)(0xFF >> (8 * emLen - emBits));
+    pbEncoded[emLen - 1] = 0xBC;
+}
+
+bool core::RsaPssVerify(
+    CK_MECHANISM_TYPE   digestMechanism,
+    CK_MECHANISM_TYPE   mgfDigestMechanism,
+    const CK_BYTE*      pbHash,
+    size_t              saltLen,
+    const CK_BYTE*      pbEncoded,
+    size_t              emBits
+)
+{
+    size_t hLen = GetHashLength(digestMechanism);
+    size_t emLen = (emBits + 7) / 8;
+    if (emLen < hLen + saltLen + 2 || pbEncoded[emLen - 1] != 0xBC) {
+        return false;
+    }
+    CK_BYTE topMask = (CK_BYTE)(0xFF >> (8 * emLen - emBits));
+    if (pbEncoded[0] & ~topMask) {
+        return false;
+    }
+
+    size_t dbLen = emLen - hLen - 1;
+    const CK_BYTE* h = pbEncoded + dbLen;
+    Buffer db(pbEncoded, pbEncoded + dbLen);
+    RsaMgf1Xor(mgfDigestMechanism, h, hLen, db.data(), dbLen);
+    db[0] &= topMask;
+
+    size_t psLen = dbLen - saltLen - 1;
+    for (size_t i = 0; i < psLen; i++) {
+        if (db[i]) {
+            return false;
+        }
+    }
+    if (db[psLen] != 0x01) {
+        return false;
+    }
+
+    CK_BYTE expected[RSA_MAX_DIGEST_LENGTH];
+    RsaPssHash(digestMechanism, pbHash, hLen, db.data() + dbLen - saltLen, saltLen, expected);
+    return !memcmp(expected, h, hLen);
+}
+
+void core::RsaOaepEncode(
+    CK_MECHANISM_TYPE   digestMechanism,
+    CK_MECHANISM_TYPE   mgfDigestMechanism,
+    const CK_BYTE*      pbLabel,
+    size_t              labelLen,
+    const CK_BYTE*      pbMessage,
+    size_t              messageLen,
+    CK_BYTE*            pbEncoded,
+    size_t              len,
+    RANDOM_BYTES        random
+)
+{
+    size_t hLen = GetHashLength(digestMechanism);
+    if (len < 2 * hLen + 2 || messageLen > len - 2 * hLen - 2) {
+        THROW_PKCS11_EXCEPTION(CKR_DATA_LEN_RANGE, "Data is too long for RSA modulus");
+    }
+
+    // EM = 00 || maskedSeed || maskedDB, DB = lHash || 00 .. 00 || 01 || M
+    size_t dbLen = len - hLen - 1;
+    CK_BYTE* seed = pbEncoded + 1;
+    CK_BYTE* db = seed + hLen;
+    pbEncoded[0] = 0x00;
+    Scoped<Buffer> labelHash = Sha::Digest(digestMechanism, (CK_BYTE_PTR)pbLabel, (CK_ULONG)labelLen);
+    memcpy(db, labelHash->data(), hLen);
+    memset(db + hLen, 0, dbLen - hLen - messageLen - 1);
+    db[dbLen - messageLen - 1] = 0x01;
+    memcpy(db + dbLen - messageLen, pbMessage, messageLen);
+
+    random(seed, (CK_ULONG)hLen);
+    RsaMgf1Xor(mgfDigestMechanism, seed, hLen, db, dbLen);
+    RsaMgf1Xor(mgfDigestMechanism, db, dbLen, seed, hLen);
+}
+
+size_t core::RsaOaepDecode(
+    CK_MECHANISM_TYPE   digestMechanism,
+    CK_MECHANISM_TYPE   mgfDigestMechanism,
+    const CK_BYTE*      pbLabel,
+    size_t              labelLen,
+    CK_BYTE*            pbEncoded,
+    size_t              len,
+    CK_BYTE*            pbMessage
+)
+{
+    size_t hLen = GetHashLength(digestMechanism);
+    if (len < 2 * hLen + 2) {
+        THROW_PKCS11_EXCEPTION(CKR_ENCRYPTED_DATA_INVALID, "Wrong OAEP padding");
+    }
+
+    size_t dbLen = len - hLen - 1;
+    CK_BYTE* seed = pbEncoded + 1;
+    CK_BYTE* db = seed + hLen;
+    RsaMgf1Xor(mgfDigestMechanism, db, dbLen, seed, hLen);
+    RsaMgf1Xor(mgfDigestMechanism, seed, hLen, db, dbLen);
+
+    Scoped<Buffer> labelHash = Sha::Digest(digestMechanism, (CK_BYTE_PTR)pbLabel, (CK_ULONG)labelLen);
+    size_t good = EqualMask(pbEncoded[0], 0);
+    for (size_t i = 0; i < hLen; i++) {
+        good &= EqualMask(db[i], (*labelHash)[i]);
+    }
+
+    // The first nonzero byte after lHash must be 01, it starts the message
+    size_t looking = ~(size_t)0;
+    size_t index = 0;
+    for (size_t i = hLen; i < dbLen; i++) {
+        size_t isOne = EqualMask(db[i], 0x01);
+        size_t isZero = EqualMask(db[i], 0x00);
+        index |= looking & isOne & i;
+        good &= ~(looking & ~isOne & ~isZero);
+        looking &= ~isOne;
+    }
+    good &= ~looking;
+
+    if (!good) {
+        THROW_PKCS11_EXCEPTION(CKR_ENCRYPTED_DATA_INVALID, "Wrong OAEP padding");
+    }
+
+    size_t messageLen = dbLen - index - 1;
+    memcpy(pbMessage, db + index + 1, messageLen);
+    return messageLen;
+}
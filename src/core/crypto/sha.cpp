@@ -0,0 +1,664 @@
+#include "sha.h"
+
+using namespace core;
+
+const uint32_t core::SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint64_t core::SHA512_K[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static const uint32_t SHA1_H[5] = {
+    0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+static const uint32_t SHA256_H[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint64_t SHA384_H[8] = {
+    0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL, 0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+    0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL, 0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL
+};
+
+static const uint64_t SHA512_H[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define ROR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+static inline uint32_t LoadBE32(const CK_BYTE* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint64_t LoadBE64(const CK_BYTE* p)
+{
+    return ((uint64_t)LoadBE32(p) << 32) | LoadBE32(p + 4);
+}
+
+static inline void StoreBE32(CK_BYTE* p, uint32_t v)
+{
+    p[0] = (CK_BYTE)(v >> 24);
+    p[1] = (CK_BYTE)(v >> 16);
+    p[2] = (CK_BYTE)(v >> 8);
+    p[3] = (CK_BYTE)v;
+}
+
+static inline void StoreBE64(CK_BYTE* p, uint64_t v)
+{
+    StoreBE32(p, (uint32_t)(v >> 32));
+    StoreBE32(p + 4, (uint32_t)v);
+}
+
+void core::Sha1Blocks(uint32_t* state, const CK_BYTE* pbData, size_t blocks)
+{
+    uint32_t w[16];
+
+    for (; blocks; blocks--, pbData += 64) {
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+        for (int t = 0; t < 80; t++) {
+            uint32_t wt;
+            if (t < 16) {
+                wt = w[t] = LoadBE32(pbData + t * 4);
+            }
+            else {
+                wt = w[t & 15] = ROL32(w[(t + 13) & 15] ^ w[(t + 8) & 15] ^ w[(t + 2) & 15] ^ w[t & 15], 1);
+            }
+
+            uint32_t f;
+            if (t < 20) {
+                f = ((b & c) | (~b & d)) + 0x5a827999;
+            }
+            else if (t < 40) {
+                f = (b ^ c ^ d) + 0x6ed9eba1;
+            }
+            else if (t < 60) {
+                f = ((b & c) | (b & d) | (c & d)) + 0x8f1bbcdc;
+            }
+            else {
+                f = (b ^ c ^ d) + 0xca62c1d6;
+            }
+
+            uint32_t temp = ROL32(a, 5) + f + e + wt;
+            e = d;
+            d = c;
+            c = ROL32(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+void core::Sha256Blocks(uint32_t* state, const CK_BYTE* pbData, size_t blocks)
+{
+    uint32_t w[64];
+
+    for (; blocks; blocks--, pbData += 64) {
+        for (int t = 0; t < 16; t++) {
+            w[t] = LoadBE32(pbData + t * 4);
+        }
+        for (int t = 16; t < 64; t++) {
+            uint32_t s0 = ROR32(w[t - 15], 7) ^ ROR32(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = ROR32(w[t - 2], 17) ^ ROR32(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int t = 0; t < 64; t++) {
+            uint32_t t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[t] + w[t];
+            uint32_t t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+void core::Sha512Blocks(uint64_t* state, const CK_BYTE* pbData, size_t blocks)
+{
+    uint64_t w[80];
+
+    for (; blocks; blocks--, pbData += 128) {
+        for (int t = 0; t < 16; t++) {
+            w[t] = LoadBE64(pbData + t * 8);
+        }
+        for (int t = 16; t < 80; t++) {
+            uint64_t s0 = ROR64(w[t - 15], 1) ^ ROR64(w[t - 15], 8) ^ (w[t - 15] >> 7);
+            uint64_t s1 = ROR64(w[t - 2], 19) ^ ROR64(w[t - 2], 61) ^ (w[t - 2] >> 6);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int t = 0; t < 80; t++) {
+            uint64_t t1 = h + (ROR64(e, 14) ^ ROR64(e, 18) ^ ROR64(e, 41)) + ((e & f) ^ (~e & g)) + SHA512_K[t] + w[t];
+            uint64_t t2 = (ROR64(a, 28) ^ ROR64(a, 34) ^ ROR64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+// Implementations in use
+static SHA32_BLOCKS sha1Blocks = core::Sha1Blocks;
+static SHA32_BLOCKS sha256Blocks = core::Sha256Blocks;
+static SHA64_BLOCKS sha512Blocks = core::Sha512Blocks;
+static const char*  sha1Name = "scalar";
+static const char*  sha256Name = "scalar";
+static const char*  sha512Name = "scalar";
+// Multi-buffer implementations, NULL if messages are digested one by one
+static SHA32_BLOCKS_X8 sha256BlocksX8 = NULL;
+static SHA64_BLOCKS_X4 sha512BlocksX4 = NULL;
+
+void Sha::Setup()
+{
+    const char* limit = getenv("PV_PKCS11_SHA");
+    bool allowAvx2 = !limit || !strcmp(limit, "avx2") || !strcmp(limit, "shani");
+    bool allowShaNi = !limit || !strcmp(limit, "shani");
+
+    sha1Blocks = core::Sha1Blocks;
+    sha256Blocks = core::Sha256Blocks;
+    sha512Blocks = core::Sha512Blocks;
+    sha1Name = sha256Name = sha512Name = "scalar";
+    sha256BlocksX8 = NULL;
+    sha512BlocksX4 = NULL;
+
+#ifdef PV_X86
+    const CPU_FEATURES& cpu = GetCpuFeatures();
+    if (allowAvx2 && cpu.avx2) {
+        sha256Blocks = core::Sha256BlocksAvx2;
+        sha512Blocks = core::Sha512BlocksAvx2;
+        sha256Name = sha512Name = "avx2";
+        sha256BlocksX8 = core::Sha256BlocksX8Avx2;
+        sha512BlocksX4 = core::Sha512BlocksX4Avx2;
+    }
+    if (allowShaNi && cpu.sha && cpu.sse41) {
+        sha1Blocks = core::Sha1BlocksShaNi;
+        sha256Blocks = core::Sha256BlocksShaNi;
+        sha1Name = sha256Name = "shani";
+        // One SHA-NI stream is faster than 8 AVX2 lanes
+        sha256BlocksX8 = NULL;
+    }
+#endif
+}
+
+const char* Sha::GetImplementationName(
+    CK_MECHANISM_TYPE   mechanism
+)
+{
+    switch (mechanism) {
+    case CKM_SHA_1:
+        return sha1Name;
+    case CKM_SHA256:
+        return sha256Name;
+    case CKM_SHA384:
+    case CKM_SHA512:
+        return sha512Name;
+    default:
+        return "";
+    }
+}
+
+CK_ULONG Sha::GetDigestLength(
+    CK_MECHANISM_TYPE   mechanism
+)
+{
+    switch (mechanism) {
+    case CKM_SHA_1:
+        return 20;
+    case CKM_SHA256:
+        return 32;
+    case CKM_SHA384:
+        return 48;
+    case CKM_SHA512:
+        return 64;
+    default:
+        return 0;
+    }
+}
+
+Scoped<Buffer> Sha::Digest(
+    CK_MECHANISM_TYPE   mechanism,
+    CK_BYTE_PTR         pbData,
+    CK_ULONG            ulDataLen
+)
+{
+    try {
+        Sha sha;
+        sha.Init(mechanism);
+        sha.Update(pbData, ulDataLen);
+
+        Scoped<Buffer> res(new Buffer(sha.GetDigestLength()));
+        sha.Final(res->data());
+        return res;
+    }
+    CATCH_EXCEPTION
+}
+
+static inline void StoreBE(CK_BYTE* p, uint32_t v)
+{
+    StoreBE32(p, v);
+}
+
+static inline void StoreBE(CK_BYTE* p, uint64_t v)
+{
+    StoreBE64(p, v);
+}
+
+template<size_t BLOCK>
+struct SHA_LANE {
+    bool            active;
+    CK_ULONG        index;              // index of the message
+    const CK_BYTE*  pbData;             // next full block of the message
+    size_t          blocks;             // full blocks left
+    CK_BYTE         tail[2 * BLOCK];    // last bytes of the message with padding
+    size_t          tailBlocks;
+    size_t          tailPos;
+};
+
+/**
+ * Digests messages in LANES lanes of the multi-buffer function. When a message is
+ * done, the lane takes the next one. Idle lanes hash a dummy block
+ */
+template<typename WORD, size_t LANES, size_t BLOCK>
+static void DigestLanes(
+    void(*blocksFn)(WORD* state, const CK_BYTE* const* blocks),
+    const WORD*         iv,
+    CK_ULONG            ulDigestLen,
+    CK_PV_DATA_PTR      pMessages,
+    CK_ULONG            ulMessageCount,
+    CK_BYTE_PTR         pbDigests
+)
+{
+    static const CK_BYTE dummy[BLOCK] = { 0 };
+    // Length field is 64 bits for SHA-256 and 128 bits for SHA-512
+    const size_t lengthLen = BLOCK / 8;
+
+    SHA_LANE<BLOCK> lanes[LANES];
+    WORD state[8 * LANES];
+    const CK_BYTE* blocks[LANES];
+    CK_ULONG next = 0;
+    size_t active = 0;
+
+    for (size_t l = 0; l < LANES; l++) {
+        lanes[l].active = false;
+    }
+
+    do {
+        // Load next messages to idle lanes
+        for (size_t l = 0; l < LANES && next < ulMessageCount; l++) {
+            SHA_LANE<BLOCK>& lane = lanes[l];
+            if (lane.active) {
+                continue;
+            }
+            CK_ULONG ulDataLen = pMessages[next].ulDataLen;
+            size_t rem = ulDataLen % BLOCK;
+
+            lane.active = true;
+            lane.index = next++;
+            lane.pbData = pMessages[lane.index].pData;
+            lane.blocks = ulDataLen / BLOCK;
+            lane.tailBlocks = rem + 1 + lengthLen > BLOCK ? 2 : 1;
+            lane.tailPos = 0;
+            memset(lane.tail, 0, sizeof(lane.tail));
+            if (rem) {
+                memcpy(lane.tail, lane.pbData + lane.blocks * BLOCK, rem);
+            }
+            lane.tail[rem] = 0x80;
+            StoreBE64(lane.tail + lane.tailBlocks * BLOCK - 8, (uint64_t)ulDataLen << 3);
+
+            for (size_t i = 0; i < 8; i++) {
+                state[i * LANES + l] = iv[i];
+            }
+            active++;
+        }
+
+        for (size_t l = 0; l < LANES; l++) {
+            SHA_LANE<BLOCK>& lane = lanes[l];
+            if (!lane.active) {
+                blocks[l] = dummy;
+            }
+            else if (lane.blocks) {
+                blocks[l] = lane.pbData;
+                lane.pbData += BLOCK;
+                lane.blocks--;
+            }
+            else {
+                blocks[l] = lane.tail + lane.tailPos++ * BLOCK;
+            }
+        }
+
+        blocksFn(state, blocks);
+
+        for (size_t l = 0; l < LANES; l++) {
+            SHA_LANE<BLOCK>& lane = lanes[l];
+            if (lane.active && !lane.blocks && lane.tailPos == lane.tailBlocks) {
+                CK_BYTE_PTR pbDigest = pbDigests + lane.index * ulDigestLen;
+                for (size_t i = 0; i < ulDigestLen / sizeof(WORD); i++) {
+                    StoreBE(pbDigest + i * sizeof(WORD), state[i * LANES + l]);
+                }
+                lane.active = false;
+                active--;
+            }
+        }
+    } while (active || next < ulMessageCount);
+}
+
+void Sha::DigestMany(
+    CK_MECHANISM_TYPE   mechanism,
+    CK_PV_DATA_PTR      pMessages,
+    CK_ULONG            ulMessageCount,
+    CK_BYTE_PTR         pbDigests
+)
+{
+    try {
+        CK_ULONG ulDigestLen = GetDigestLength(mechanism);
+        if (!ulDigestLen) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+        if (!ulMessageCount) {
+            return;
+        }
+
+        switch (mechanism) {
+        case CKM_SHA256:
+            if (sha256BlocksX8) {
+                DigestLanes<uint32_t, 8, 64>(sha256BlocksX8, SHA256_H, ulDigestLen, pMessages, ulMessageCount, pbDigests);
+                return;
+            }
+            break;
+        case CKM_SHA384:
+        case CKM_SHA512:
+            if (sha512BlocksX4) {
+                DigestLanes<uint64_t, 4, 128>(sha512BlocksX4, mechanism == CKM_SHA384 ? SHA384_H : SHA512_H,
+                    ulDigestLen, pMessages, ulMessageCount, pbDigests);
+                return;
+            }
+            break;
+        }
+
+        Sha sha;
+        sha.Init(mechanism);
+        for (CK_ULONG i = 0; i < ulMessageCount; i++) {
+            sha.Update(pMessages[i].pData, pMessages[i].ulDataLen);
+            sha.Final(pbDigests + i * ulDigestLen);
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+Sha::Sha() :
+    mechanism(0),
+    bufferLen(0),
+    dataLen(0)
+{
+}
+
+void Sha::Init(
+    CK_MECHANISM_TYPE   mechanism
+)
+{
+    try {
+        switch (mechanism) {
+        case CKM_SHA_1:
+            memcpy(state32, SHA1_H, sizeof(SHA1_H));
+            break;
+        case CKM_SHA256:
+            memcpy(state32, SHA256_H, sizeof(SHA256_H));
+            break;
+        case CKM_SHA384:
+            memcpy(state64, SHA384_H, sizeof(SHA384_H));
+            break;
+        case CKM_SHA512:
+            memcpy(state64, SHA512_H, sizeof(SHA512_H));
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        this->mechanism = mechanism;
+        bufferLen = 0;
+        dataLen = 0;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_ULONG Sha::GetStateLength()
+{
+    return SHA_STATE_HEADER_LENGTH + bufferLen;
+}
+
+void Sha::GetState(
+    CK_BYTE_PTR         pbState
+)
+{
+    StoreBE64(pbState, mechanism);
+    StoreBE64(pbState + 8, dataLen);
+    memset(pbState + 16, 0, 64);
+    if (mechanism == CKM_SHA_1 || mechanism == CKM_SHA256) {
+        for (size_t i = 0; i < 8; i++) {
+            StoreBE32(pbState + 16 + i * 4, state32[i]);
+        }
+    }
+    else {
+        for (size_t i = 0; i < 8; i++) {
+            StoreBE64(pbState + 16 + i * 8, state64[i]);
+        }
+    }
+    memcpy(pbState + SHA_STATE_HEADER_LENGTH, buffer, bufferLen);
+}
+
+void Sha::SetState(
+    CK_BYTE_PTR         pbState,
+    CK_ULONG            ulStateLen
+)
+{
+    try {
+        if (ulStateLen < SHA_STATE_HEADER_LENGTH) {
+            THROW_PKCS11_EXCEPTION(CKR_SAVED_STATE_INVALID, "Digest state is too short");
+        }
+        CK_MECHANISM_TYPE mechanism = (CK_MECHANISM_TYPE)LoadBE64(pbState);
+        if (!GetDigestLength(mechanism)) {
+            THROW_PKCS11_EXCEPTION(CKR_SAVED_STATE_INVALID, "Unsupported mechanism of digest state");
+        }
+        Init(mechanism);
+
+        dataLen = LoadBE64(pbState + 8);
+        bufferLen = (CK_ULONG)(dataLen % GetBlockLength());
+        if (ulStateLen != SHA_STATE_HEADER_LENGTH + bufferLen) {
+            Init(mechanism);
+            THROW_PKCS11_EXCEPTION(CKR_SAVED_STATE_INVALID, "Wrong length of digest state");
+        }
+        if (mechanism == CKM_SHA_1 || mechanism == CKM_SHA256) {
+            for (size_t i = 0; i < 8; i++) {
+                state32[i] = LoadBE32(pbState + 16 + i * 4);
+            }
+        }
+        else {
+            for (size_t i = 0; i < 8; i++) {
+                state64[i] = LoadBE64(pbState + 16 + i * 8);
+            }
+        }
+        memcpy(buffer, pbState + SHA_STATE_HEADER_LENGTH, bufferLen);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_MECHANISM_TYPE Sha::GetMechanism()
+{
+    return mechanism;
+}
+
+CK_ULONG Sha::GetDigestLength()
+{
+    return GetDigestLength(mechanism);
+}
+
+CK_ULONG Sha::GetBlockLength()
+{
+    return (mechanism == CKM_SHA384 || mechanism == CKM_SHA512) ? 128 : 64;
+}
+
+void Sha::Blocks(
+    const CK_BYTE*      pbData,
+    size_t              blocks
+)
+{
+    switch (mechanism) {
+    case CKM_SHA_1:
+        sha1Blocks(state32, pbData, blocks);
+        break;
+    case CKM_SHA256:
+        sha256Blocks(state32, pbData, blocks);
+        break;
+    default:
+        sha512Blocks(state64, pbData, blocks);
+    }
+}
+
+void Sha::Update(
+    CK_BYTE_PTR         pbData,
+    CK_ULONG            ulDataLen
+)
+{
+    CK_ULONG blockLen = GetBlockLength();
+
+    dataLen += ulDataLen;
+
+    if (bufferLen) {
+        CK_ULONG len = blockLen - bufferLen;
+        if (len > ulDataLen) {
+            len = ulDataLen;
+        }
+        memcpy(buffer + bufferLen, pbData, len);
+        bufferLen += len;
+        pbData += len;
+        ulDataLen -= len;
+
+        if (bufferLen < blockLen) {
+            return;
+        }
+        Blocks(buffer, 1);
+        bufferLen = 0;
+    }
+
+    size_t blocks = ulDataLen / blockLen;
+    if (blocks) {
+        Blocks(pbData, blocks);
+        pbData += blocks * blockLen;
+        ulDataLen -= (CK_ULONG)(blocks * blockLen);
+    }
+
+    if (ulDataLen) {
+        memcpy(buffer, pbData, ulDataLen);
+        bufferLen = ulDataLen;
+    }
+}
+
+void Sha::Final(
+    CK_BYTE_PTR         pbDigest
+)
+{
+    CK_ULONG blockLen = GetBlockLength();
+    // Length field is 64 bits for SHA-1 and SHA-256 and 128 bits for SHA-384 and SHA-512
+    CK_ULONG lengthLen = blockLen / 8;
+    uint64_t bitLen = dataLen << 3;
+
+    buffer[bufferLen++] = 0x80;
+    if (bufferLen > blockLen - lengthLen) {
+        memset(buffer + bufferLen, 0, blockLen - bufferLen);
+        Blocks(buffer, 1);
+        bufferLen = 0;
+    }
+    memset(buffer + bufferLen, 0, blockLen - bufferLen);
+    if (lengthLen == 16) {
+        StoreBE64(buffer + blockLen - 16, dataLen >> 61);
+    }
+    StoreBE64(buffer + blockLen - 8, bitLen);
+    Blocks(buffer, 1);
+
+    CK_ULONG digestLen = GetDigestLength();
+    if (mechanism == CKM_SHA_1 || mechanism == CKM_SHA256) {
+        for (CK_ULONG i = 0; i < digestLen / 4; i++) {
+            StoreBE32(pbDigest + i * 4, state32[i]);
+        }
+    }
+    else {
+        for (CK_ULONG i = 0; i < digestLen / 8; i++) {
+            StoreBE64(pbDigest + i * 8, state64[i]);
+        }
+    }
+
+    Init(mechanism);
+}
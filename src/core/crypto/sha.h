@@ -0,0 +1,138 @@
+#pragma once
+
+#include "../../stdafx.h"
+#include "../excep.h"
+#include "cpu.h"
+
+namespace core {
+
+    typedef void(*SHA32_BLOCKS)(uint32_t* state, const CK_BYTE* pbData, size_t blocks);
+    typedef void(*SHA64_BLOCKS)(uint64_t* state, const CK_BYTE* pbData, size_t blocks);
+    // Multi-buffer functions process one block of each message, state[word * lanes + lane]
+    typedef void(*SHA32_BLOCKS_X8)(uint32_t* state, const CK_BYTE* const* blocks);
+    typedef void(*SHA64_BLOCKS_X4)(uint64_t* state, const CK_BYTE* const* blocks);
+
+    extern const uint32_t SHA256_K[64];
+    extern const uint64_t SHA512_K[80];
+
+    // Portable implementations
+    void Sha1Blocks(uint32_t* state, const CK_BYTE* pbData, size_t blocks);
+    void Sha256Blocks(uint32_t* state, const CK_BYTE* pbData, size_t blocks);
+    void Sha512Blocks(uint64_t* state, const CK_BYTE* pbData, size_t blocks);
+
+#ifdef PV_X86
+    // SHA extensions
+    void Sha1BlocksShaNi(uint32_t* state, const CK_BYTE* pbData, size_t blocks);
+    void Sha256BlocksShaNi(uint32_t* state, const CK_BYTE* pbData, size_t blocks);
+    // AVX2 message schedule, scalar compression
+    void Sha256BlocksAvx2(uint32_t* state, const CK_BYTE* pbData, size_t blocks);
+    void Sha512BlocksAvx2(uint64_t* state, const CK_BYTE* pbData, size_t blocks);
+    // AVX2 multi-buffer, 8 messages for SHA-256 and 4 messages for SHA-512
+    void Sha256BlocksX8Avx2(uint32_t* state, const CK_BYTE* const* blocks);
+    void Sha512BlocksX4Avx2(uint64_t* state, const CK_BYTE* const* blocks);
+#endif
+
+    // Serialized state: mechanism (8 bytes), message length (8 bytes), chaining value
+    // (64 bytes) and buffered bytes of the incomplete block. All numbers are big-endian
+#define SHA_STATE_HEADER_LENGTH     80
+#define SHA_STATE_MAX_LENGTH        (SHA_STATE_HEADER_LENGTH + 128)
+
+    /**
+     * SHA-1 and SHA-2 engine. Block functions are selected once by Setup
+     */
+    class Sha {
+    public:
+        /**
+         * Selects the fastest implementations supported by CPU. The choice can be
+         * limited by PV_PKCS11_SHA environment variable (scalar, avx2 or shani)
+         */
+        static void Setup();
+
+        /**
+         * Returns name of implementation in use for the mechanism
+         */
+        static const char* GetImplementationName(
+            CK_MECHANISM_TYPE   mechanism
+        );
+
+        /**
+         * Returns digest length of the mechanism or 0 if mechanism is not supported
+         */
+        static CK_ULONG GetDigestLength(
+            CK_MECHANISM_TYPE   mechanism
+        );
+
+        static Scoped<Buffer> Digest(
+            CK_MECHANISM_TYPE   mechanism,
+            CK_BYTE_PTR         pbData,
+            CK_ULONG            ulDataLen
+        );
+
+        /**
+         * Digests independent messages. pbDigests receives GetDigestLength(mechanism) bytes
+         * per message. Messages are hashed in SIMD lanes if multi-buffer functions are available
+         */
+        static void DigestMany(
+            CK_MECHANISM_TYPE   mechanism,
+            CK_PV_DATA_PTR      pMessages,
+            CK_ULONG            ulMessageCount,
+            CK_BYTE_PTR         pbDigests
+        );
+
+        Sha();
+
+        void Init(
+            CK_MECHANISM_TYPE   mechanism
+        );
+
+        void Update(
+            CK_BYTE_PTR         pbData,
+            CK_ULONG            ulDataLen
+        );
+
+        /**
+         * Writes digest and resets the engine to initial state of the same mechanism
+         */
+        void Final(
+            CK_BYTE_PTR         pbDigest
+        );
+
+        /**
+         * Returns length of the serialized state
+         */
+        CK_ULONG GetStateLength();
+
+        /**
+         * Serializes the state, pbState must hold GetStateLength() bytes
+         */
+        void GetState(
+            CK_BYTE_PTR         pbState
+        );
+
+        /**
+         * Restores the state serialized by GetState. Throws CKR_SAVED_STATE_INVALID
+         */
+        void SetState(
+            CK_BYTE_PTR         pbState,
+            CK_ULONG            ulStateLen
+        );
+
+        CK_MECHANISM_TYPE GetMechanism();
+        CK_ULONG GetDigestLength();
+        CK_ULONG GetBlockLength();
+
+    protected:
+        CK_MECHANISM_TYPE   mechanism;
+        uint32_t            state32[8];
+        uint64_t            state64[8];
+        CK_BYTE             buffer[128];
+        CK_ULONG            bufferLen;
+        uint64_t            dataLen;
+
+        void Blocks(
+            const CK_BYTE*      pbData,
+            size_t              blocks
+        );
+    };
+
+}
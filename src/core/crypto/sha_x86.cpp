@@ -0,0 +1,502 @@
+#include "sha.h"
+
+#ifdef PV_X86
+
+#include <immintrin.h>
+
+using namespace core;
+
+// SHA-1 with SHA extensions
+
+#define SHA1NI_ROUNDS(EA, EB, MSG, F)                       \
+    EA = _mm_sha1nexte_epu32(EA, MSG);                      \
+    EB = ABCD;                                              \
+    ABCD = _mm_sha1rnds4_epu32(ABCD, EA, F)
+
+// Computes next message words: msg2 completes NEXT, msg1 and xor start PREV and NEXT2
+#define SHA1NI_SCHEDULE(PREV, MSG, NEXT, NEXT2)             \
+    NEXT = _mm_sha1msg2_epu32(NEXT, MSG);                   \
+    PREV = _mm_sha1msg1_epu32(PREV, MSG);                   \
+    NEXT2 = _mm_xor_si128(NEXT2, MSG)
+
+PV_TARGET("sha,sse4.1")
+void core::Sha1BlocksShaNi(uint32_t* state, const CK_BYTE* pbData, size_t blocks)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    __m128i ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+    __m128i E0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+    __m128i E1, MSG0, MSG1, MSG2, MSG3;
+
+    for (; blocks; blocks--, pbData += 64) {
+        __m128i ABCD_SAVE = ABCD;
+        __m128i E0_SAVE = E0;
+
+        MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pbData + 0)), MASK);
+        MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pbData + 16)), MASK);
+        MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pbData + 32)), MASK);
+        MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pbData + 48)), MASK);
+
+        E0 = _mm_add_epi32(E0, MSG0);
+        E1 = ABCD;
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+        SHA1NI_ROUNDS(E1, E0, MSG1, 0);
+        MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+        SHA1NI_ROUNDS(E0, E1, MSG2, 0);
+        MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+        MSG0 = _mm_xor_si128(MSG0, MSG2);
+        SHA1NI_ROUNDS(E1, E0, MSG3, 0);
+        SHA1NI_SCHEDULE(MSG2, MSG3, MSG0, MSG1);
+        SHA1NI_ROUNDS(E0, E1, MSG0, 0);
+        SHA1NI_SCHEDULE(MSG3, MSG0, MSG1, MSG2);
+        SHA1NI_ROUNDS(E1, E0, MSG1, 1);
+        SHA1NI_SCHEDULE(MSG0, MSG1, MSG2, MSG3);
+        SHA1NI_ROUNDS(E0, E1, MSG2, 1);
+        SHA1NI_SCHEDULE(MSG1, MSG2, MSG3, MSG0);
+        SHA1NI_ROUNDS(E1, E0, MSG3, 1);
+        SHA1NI_SCHEDULE(MSG2, MSG3, MSG0, MSG1);
+        SHA1NI_ROUNDS(E0, E1, MSG0, 1);
+        SHA1NI_SCHEDULE(MSG3, MSG0, MSG1, MSG2);
+        SHA1NI_ROUNDS(E1, E0, MSG1, 1);
+        SHA1NI_SCHEDULE(MSG0, MSG1, MSG2, MSG3);
+        SHA1NI_ROUNDS(E0, E1, MSG2, 2);
+        SHA1NI_SCHEDULE(MSG1, MSG2, MSG3, MSG0);
+        SHA1NI_ROUNDS(E1, E0, MSG3, 2);
+        SHA1NI_SCHEDULE(MSG2, MSG3, MSG0, MSG1);
+        SHA1NI_ROUNDS(E0, E1, MSG0, 2);
+        SHA1NI_SCHEDULE(MSG3, MSG0, MSG1, MSG2);
+        SHA1NI_ROUNDS(E1, E0, MSG1, 2);
+        SHA1NI_SCHEDULE(MSG0, MSG1, MSG2, MSG3);
+        SHA1NI_ROUNDS(E0, E1, MSG2, 2);
+        SHA1NI_SCHEDULE(MSG1, MSG2, MSG3, MSG0);
+        SHA1NI_ROUNDS(E1, E0, MSG3, 3);
+        SHA1NI_SCHEDULE(MSG2, MSG3, MSG0, MSG1);
+        SHA1NI_ROUNDS(E0, E1, MSG0, 3);
+        SHA1NI_SCHEDULE(MSG3, MSG0, MSG1, MSG2);
+        SHA1NI_ROUNDS(E1, E0, MSG1, 3);
+        MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+        MSG3 = _mm_xor_si128(MSG3, MSG1);
+        SHA1NI_ROUNDS(E0, E1, MSG2, 3);
+        MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+        SHA1NI_ROUNDS(E1, E0, MSG3, 3);
+
+        E0 = _mm_sha1nexte_epu32(E0, E0_SAVE);
+        ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+    }
+
+    _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(ABCD, 0x1B));
+    state[4] = (uint32_t)_mm_extract_epi32(E0, 3);
+}
+
+// SHA-256 with SHA extensions
+
+#define SHA256NI_ROUNDS(MSG, t)                                                         \
+    TMP = _mm_add_epi32(MSG, _mm_loadu_si128((const __m128i*)&SHA256_K[t]));            \
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, TMP);                                \
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(TMP, 0x0E))
+
+// W[t..t+3] = MSG0 + s0(MSG1) + W[t-7..t-4] + s1(MSG3), result replaces MSG0
+#define SHA256NI_SCHEDULE(MSG0, MSG1, MSG2, MSG3)                                       \
+    TMP = _mm_add_epi32(_mm_sha256msg1_epu32(MSG0, MSG1), _mm_alignr_epi8(MSG3, MSG2, 4)); \
+    MSG0 = _mm_sha256msg2_epu32(TMP, MSG3)
+
+PV_TARGET("sha,sse4.1")
+void core::Sha256BlocksShaNi(uint32_t* state, const CK_BYTE* pbData, size_t blocks)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // State is kept as ABEF and CDGH
+    __m128i TMP = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    __m128i STATE1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    __m128i STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);
+    STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);
+
+    for (; blocks; blocks--, pbData += 64) {
+        __m128i ABEF_SAVE = STATE0;
+        __m128i CDGH_SAVE = STATE1;
+
+        __m128i MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pbData + 0)), MASK);
+        __m128i MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pbData + 16)), MASK);
+        __m128i MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pbData + 32)), MASK);
+        __m128i MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pbData + 48)), MASK);
+
+        for (int t = 0; t < 48; t += 16) {
+            SHA256NI_ROUNDS(MSG0, t);
+            SHA256NI_SCHEDULE(MSG0, MSG1, MSG2, MSG3);
+            SHA256NI_ROUNDS(MSG1, t + 4);
+            SHA256NI_SCHEDULE(MSG1, MSG2, MSG3, MSG0);
+            SHA256NI_ROUNDS(MSG2, t + 8);
+            SHA256NI_SCHEDULE(MSG2, MSG3, MSG0, MSG1);
+            SHA256NI_ROUNDS(MSG3, t + 12);
+            SHA256NI_SCHEDULE(MSG3, MSG0, MSG1, MSG2);
+        }
+        SHA256NI_ROUNDS(MSG0, 48);
+        SHA256NI_ROUNDS(MSG1, 52);
+        SHA256NI_ROUNDS(MSG2, 56);
+        SHA256NI_ROUNDS(MSG3, 60);
+
+        STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+        STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+    }
+
+    TMP = _mm_shuffle_epi32(STATE0, 0x1B);
+    STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);
+    _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(TMP, STATE1, 0xF0));
+    _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(STATE1, TMP, 8));
+}
+
+// SHA-256 and SHA-512 with AVX2 message schedule. The schedule is vectorized, round
+// function is scalar and reads precomputed W[t] + K[t]
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define ROR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+#define VROR32(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define VROR64(x, n) _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+
+static inline void Sha256Rounds(uint32_t* state, const uint32_t* wk)
+{
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int t = 0; t < 64; t++) {
+        uint32_t t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) + wk[t];
+        uint32_t t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static inline void Sha512Rounds(uint64_t* state, const uint64_t* wk)
+{
+    uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int t = 0; t < 80; t++) {
+        uint64_t t1 = h + (ROR64(e, 14) ^ ROR64(e, 18) ^ ROR64(e, 41)) + ((e & f) ^ (~e & g)) + wk[t];
+        uint64_t t2 = (ROR64(a, 28) ^ ROR64(a, 34) ^ ROR64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+// Each 128-bit lane holds four words of a separate block, two blocks are scheduled at once.
+// X0 = W[t-16..t-13], X1 = W[t-12..t-9], X2 = W[t-8..t-5], X3 = W[t-4..t-1], result replaces X0
+#define SHA256AVX2_SCHEDULE(X0, X1, X2, X3)                                                 \
+    {                                                                                       \
+        __m256i w15 = _mm256_alignr_epi8(X1, X0, 4);                                        \
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(VROR32(w15, 7), VROR32(w15, 18)),    \
+            _mm256_srli_epi32(w15, 3));                                                     \
+        __m256i w = _mm256_add_epi32(_mm256_add_epi32(X0, s0), _mm256_alignr_epi8(X3, X2, 4)); \
+        __m256i w2 = _mm256_shuffle_epi32(X3, 0xEE);                                        \
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(VROR32(w2, 17), VROR32(w2, 19)),     \
+            _mm256_srli_epi32(w2, 10));                                                     \
+        w = _mm256_add_epi32(w, _mm256_and_si256(s1, LOW));                                 \
+        w2 = _mm256_shuffle_epi32(w, 0x44);                                                 \
+        s1 = _mm256_xor_si256(_mm256_xor_si256(VROR32(w2, 17), VROR32(w2, 19)),             \
+            _mm256_srli_epi32(w2, 10));                                                     \
+        X0 = _mm256_add_epi32(w, _mm256_andnot_si256(LOW, s1));                             \
+    }
+
+#define SHA256AVX2_STORE(X, t)                                                              \
+    {                                                                                       \
+        __m256i wk = _mm256_add_epi32(X, _mm256_broadcastsi128_si256(                       \
+            _mm_loadu_si128((const __m128i*)&SHA256_K[t])));                                \
+        _mm_storeu_si128((__m128i*)&wk0[t], _mm256_castsi256_si128(wk));                    \
+        _mm_storeu_si128((__m128i*)&wk1[t], _mm256_extracti128_si256(wk, 1));               \
+    }
+
+#define SHA256AVX2_LOAD(offset)                                                             \
+    _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(                     \
+        _mm_loadu_si128((const __m128i*)(pbData + offset))),                                \
+        _mm_loadu_si128((const __m128i*)(pbSecond + offset)), 1), MASK)
+
+PV_TARGET("avx2")
+void core::Sha256BlocksAvx2(uint32_t* state, const CK_BYTE* pbData, size_t blocks)
+{
+    const __m256i MASK = _mm256_set_epi8(
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    // words 0 and 1 of each lane
+    const __m256i LOW = _mm256_set_epi32(0, 0, -1, -1, 0, 0, -1, -1);
+
+    uint32_t wk0[64];
+    uint32_t wk1[64];
+
+    while (blocks) {
+        size_t count = blocks > 1 ? 2 : 1;
+        const CK_BYTE* pbSecond = pbData + (count - 1) * 64;
+
+        __m256i X0 = SHA256AVX2_LOAD(0);
+        __m256i X1 = SHA256AVX2_LOAD(16);
+        __m256i X2 = SHA256AVX2_LOAD(32);
+        __m256i X3 = SHA256AVX2_LOAD(48);
+
+        for (int t = 0; t < 48; t += 16) {
+            SHA256AVX2_STORE(X0, t);
+            SHA256AVX2_SCHEDULE(X0, X1, X2, X3);
+            SHA256AVX2_STORE(X1, t + 4);
+            SHA256AVX2_SCHEDULE(X1, X2, X3, X0);
+            SHA256AVX2_STORE(X2, t + 8);
+            SHA256AVX2_SCHEDULE(X2, X3, X0, X1);
+            SHA256AVX2_STORE(X3, t + 12);
+            SHA256AVX2_SCHEDULE(X3, X0, X1, X2);
+        }
+        SHA256AVX2_STORE(X0, 48);
+        SHA256AVX2_STORE(X1, 52);
+        SHA256AVX2_STORE(X2, 56);
+        SHA256AVX2_STORE(X3, 60);
+
+        Sha256Rounds(state, wk0);
+        if (count == 2) {
+            Sha256Rounds(state, wk1);
+        }
+
+        pbData += count * 64;
+        blocks -= count;
+    }
+}
+
+// One block, X0 = W[t-16..t-13], X1 = W[t-12..t-9], X2 = W[t-8..t-5], X3 = W[t-4..t-1], result replaces X0
+#define SHA512AVX2_SCHEDULE(X0, X1, X2, X3)                                                 \
+    {                                                                                       \
+        __m256i w15 = _mm256_permute4x64_epi64(_mm256_blend_epi32(X0, X1, 0x03), 0x39);     \
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(VROR64(w15, 1), VROR64(w15, 8)),     \
+            _mm256_srli_epi64(w15, 7));                                                     \
+        __m256i w7 = _mm256_permute4x64_epi64(_mm256_blend_epi32(X2, X3, 0x03), 0x39);      \
+        __m256i w = _mm256_add_epi64(_mm256_add_epi64(X0, s0), w7);                         \
+        __m256i w2 = _mm256_permute4x64_epi64(X3, 0xEE);                                    \
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(VROR64(w2, 19), VROR64(w2, 61)),     \
+            _mm256_srli_epi64(w2, 6));                                                      \
+        w = _mm256_add_epi64(w, _mm256_and_si256(s1, LOW));                                 \
+        w2 = _mm256_permute4x64_epi64(w, 0x44);                                             \
+        s1 = _mm256_xor_si256(_mm256_xor_si256(VROR64(w2, 19), VROR64(w2, 61)),             \
+            _mm256_srli_epi64(w2, 6));                                                      \
+        X0 = _mm256_add_epi64(w, _mm256_andnot_si256(LOW, s1));                             \
+    }
+
+#define SHA512AVX2_STORE(X, t)                                                              \
+    _mm256_storeu_si256((__m256i*)&wk[t], _mm256_add_epi64(X,                               \
+        _mm256_loadu_si256((const __m256i*)&SHA512_K[t])))
+
+#define SHA512AVX2_LOAD(offset)                                                             \
+    _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(pbData + offset)), MASK)
+
+PV_TARGET("avx2")
+void core::Sha512BlocksAvx2(uint64_t* state, const CK_BYTE* pbData, size_t blocks)
+{
+    const __m256i MASK = _mm256_set_epi8(
+        8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+        8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+    // words 0 and 1
+    const __m256i LOW = _mm256_set_epi64x(0, 0, -1, -1);
+
+    uint64_t wk[80];
+
+    for (; blocks; blocks--, pbData += 128) {
+        __m256i X0 = SHA512AVX2_LOAD(0);
+        __m256i X1 = SHA512AVX2_LOAD(32);
+        __m256i X2 = SHA512AVX2_LOAD(64);
+        __m256i X3 = SHA512AVX2_LOAD(96);
+
+        for (int t = 0; t < 64; t += 16) {
+            SHA512AVX2_STORE(X0, t);
+            SHA512AVX2_SCHEDULE(X0, X1, X2, X3);
+            SHA512AVX2_STORE(X1, t + 4);
+            SHA512AVX2_SCHEDULE(X1, X2, X3, X0);
+            SHA512AVX2_STORE(X2, t + 8);
+            SHA512AVX2_SCHEDULE(X2, X3, X0, X1);
+            SHA512AVX2_STORE(X3, t + 12);
+            SHA512AVX2_SCHEDULE(X3, X0, X1, X2);
+        }
+        SHA512AVX2_STORE(X0, 64);
+        SHA512AVX2_STORE(X1, 68);
+        SHA512AVX2_STORE(X2, 72);
+        SHA512AVX2_STORE(X3, 76);
+
+        Sha512Rounds(state, wk);
+    }
+}
+
+// Multi-buffer SHA-256 and SHA-512. Each vector element belongs to a separate message,
+// state is transposed: state[word * lanes + lane]
+
+#define VSHR32(x, n) _mm256_srli_epi32(x, n)
+#define VSHR64(x, n) _mm256_srli_epi64(x, n)
+#define VXOR3(a, b, c) _mm256_xor_si256(_mm256_xor_si256(a, b), c)
+#define VCH(e, f, g) _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g))
+#define VMAJ(a, b, c) _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)))
+
+PV_TARGET("avx2")
+void core::Sha256BlocksX8Avx2(uint32_t* state, const CK_BYTE* const* blocks)
+{
+    const __m256i MASK = _mm256_set_epi8(
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+    __m256i W[16];
+
+    // Transposes 8x8 words, W[i] gets word i of every block
+    for (int half = 0; half < 2; half++) {
+        __m256i r[8];
+        for (int l = 0; l < 8; l++) {
+            r[l] = _mm256_loadu_si256((const __m256i*)(blocks[l] + half * 32));
+        }
+        __m256i t[8];
+        for (int l = 0; l < 8; l += 2) {
+            t[l] = _mm256_unpacklo_epi32(r[l], r[l + 1]);
+            t[l + 1] = _mm256_unpackhi_epi32(r[l], r[l + 1]);
+        }
+        for (int l = 0; l < 8; l += 4) {
+            r[l] = _mm256_unpacklo_epi64(t[l], t[l + 2]);
+            r[l + 1] = _mm256_unpackhi_epi64(t[l], t[l + 2]);
+            r[l + 2] = _mm256_unpacklo_epi64(t[l + 1], t[l + 3]);
+            r[l + 3] = _mm256_unpackhi_epi64(t[l + 1], t[l + 3]);
+        }
+        __m256i* w = W + half * 8;
+        for (int i = 0; i < 4; i++) {
+            w[i] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(r[i], r[i + 4], 0x20), MASK);
+            w[i + 4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(r[i], r[i + 4], 0x31), MASK);
+        }
+    }
+
+    __m256i a = _mm256_loadu_si256((const __m256i*)&state[0]);
+    __m256i b = _mm256_loadu_si256((const __m256i*)&state[8]);
+    __m256i c = _mm256_loadu_si256((const __m256i*)&state[16]);
+    __m256i d = _mm256_loadu_si256((const __m256i*)&state[24]);
+    __m256i e = _mm256_loadu_si256((const __m256i*)&state[32]);
+    __m256i f = _mm256_loadu_si256((const __m256i*)&state[40]);
+    __m256i g = _mm256_loadu_si256((const __m256i*)&state[48]);
+    __m256i h = _mm256_loadu_si256((const __m256i*)&state[56]);
+
+    for (int t = 0; t < 64; t++) {
+        if (t >= 16) {
+            __m256i w15 = W[(t - 15) & 15];
+            __m256i w2 = W[(t - 2) & 15];
+            __m256i s0 = VXOR3(VROR32(w15, 7), VROR32(w15, 18), VSHR32(w15, 3));
+            __m256i s1 = VXOR3(VROR32(w2, 17), VROR32(w2, 19), VSHR32(w2, 10));
+            W[t & 15] = _mm256_add_epi32(_mm256_add_epi32(W[t & 15], s0),
+                _mm256_add_epi32(W[(t - 7) & 15], s1));
+        }
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, VXOR3(VROR32(e, 6), VROR32(e, 11), VROR32(e, 25))),
+            _mm256_add_epi32(VCH(e, f, g), _mm256_add_epi32(W[t & 15], _mm256_set1_epi32((int)SHA256_K[t]))));
+        __m256i t2 = _mm256_add_epi32(VXOR3(VROR32(a, 2), VROR32(a, 13), VROR32(a, 22)), VMAJ(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, t2);
+    }
+
+    __m256i* st = (__m256i*)state;
+    _mm256_storeu_si256(st + 0, _mm256_add_epi32(_mm256_loadu_si256(st + 0), a));
+    _mm256_storeu_si256(st + 1, _mm256_add_epi32(_mm256_loadu_si256(st + 1), b));
+    _mm256_storeu_si256(st + 2, _mm256_add_epi32(_mm256_loadu_si256(st + 2), c));
+    _mm256_storeu_si256(st + 3, _mm256_add_epi32(_mm256_loadu_si256(st + 3), d));
+    _mm256_storeu_si256(st + 4, _mm256_add_epi32(_mm256_loadu_si256(st + 4), e));
+    _mm256_storeu_si256(st + 5, _mm256_add_epi32(_mm256_loadu_si256(st + 5), f));
+    _mm256_storeu_si256(st + 6, _mm256_add_epi32(_mm256_loadu_si256(st + 6), g));
+    _mm256_storeu_si256(st + 7, _mm256_add_epi32(_mm256_loadu_si256(st + 7), h));
+}
+
+PV_TARGET("avx2")
+void core::Sha512BlocksX4Avx2(uint64_t* state, const CK_BYTE* const* blocks)
+{
+    const __m256i MASK = _mm256_set_epi8(
+        8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+        8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+
+    __m256i W[16];
+
+    // Transposes 4x4 words, W[i] gets word i of every block
+    for (int i = 0; i < 16; i += 4) {
+        __m256i r0 = _mm256_loadu_si256((const __m256i*)(blocks[0] + i * 8));
+        __m256i r1 = _mm256_loadu_si256((const __m256i*)(blocks[1] + i * 8));
+        __m256i r2 = _mm256_loadu_si256((const __m256i*)(blocks[2] + i * 8));
+        __m256i r3 = _mm256_loadu_si256((const __m256i*)(blocks[3] + i * 8));
+        __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+        __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+        __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+        __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+        W[i] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t0, t2, 0x20), MASK);
+        W[i + 1] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t1, t3, 0x20), MASK);
+        W[i + 2] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t0, t2, 0x31), MASK);
+        W[i + 3] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t1, t3, 0x31), MASK);
+    }
+
+    __m256i a = _mm256_loadu_si256((const __m256i*)&state[0]);
+    __m256i b = _mm256_loadu_si256((const __m256i*)&state[4]);
+    __m256i c = _mm256_loadu_si256((const __m256i*)&state[8]);
+    __m256i d = _mm256_loadu_si256((const __m256i*)&state[12]);
+    __m256i e = _mm256_loadu_si256((const __m256i*)&state[16]);
+    __m256i f = _mm256_loadu_si256((const __m256i*)&state[20]);
+    __m256i g = _mm256_loadu_si256((const __m256i*)&state[24]);
+    __m256i h = _mm256_loadu_si256((const __m256i*)&state[28]);
+
+    for (int t = 0; t < 80; t++) {
+        if (t >= 16) {
+            __m256i w15 = W[(t - 15) & 15];
+            __m256i w2 = W[(t - 2) & 15];
+            __m256i s0 = VXOR3(VROR64(w15, 1), VROR64(w15, 8), VSHR64(w15, 7));
+            __m256i s1 = VXOR3(VROR64(w2, 19), VROR64(w2, 61), VSHR64(w2, 6));
+            W[t & 15] = _mm256_add_epi64(_mm256_add_epi64(W[t & 15], s0),
+                _mm256_add_epi64(W[(t - 7) & 15], s1));
+        }
+        __m256i t1 = _mm256_add_epi64(_mm256_add_epi64(h, VXOR3(VROR64(e, 14), VROR64(e, 18), VROR64(e, 41))),
+            _mm256_add_epi64(VCH(e, f, g), _mm256_add_epi64(W[t & 15], _mm256_set1_epi64x((long long)SHA512_K[t]))));
+        __m256i t2 = _mm256_add_epi64(VXOR3(VROR64(a, 28), VROR64(a, 34), VROR64(a, 39)), VMAJ(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi64(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi64(t1, t2);
+    }
+
+    __m256i* st = (__m256i*)state;
+    _mm256_storeu_si256(st + 0, _mm256_add_epi64(_mm256_loadu_si256(st + 0), a));
+    _mm256_storeu_si256(st + 1, _mm256_add_epi64(_mm256_loadu_si256(st + 1), b));
+    _mm256_storeu_si256(st + 2, _mm256_add_epi64(_mm256_loadu_si256(st + 2), c));
+    _mm256_storeu_si256(st + 3, _mm256_add_epi64(_mm256_loadu_si256(st + 3), d));
+    _mm256_storeu_si256(st + 4, _mm256_add_epi64(_mm256_loadu_si256(st + 4), e));
+    _mm256_storeu_si256(st + 5, _mm256_add_epi64(_mm256_loadu_si256(st + 5), f));
+    _mm256_storeu_si256(st + 6, _mm256_add_epi64(_mm256_loadu_si256(st + 6), g));
+    _mm256_storeu_si256(st + 7, _mm256_add_epi64(_mm256_loadu_si256(st + 7), h));
+}
+
+#endif // PV_X86
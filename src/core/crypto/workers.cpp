@@ -0,0 +1,273 @@
+#include "workers.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+using namespace core;
+
+#define WORKERS_DEFAULT_THRESHOLD   (1024 * 1024)
+
+static std::atomic<unsigned> workersForkGeneration(0);
+
+static size_t GetEnvSize(const char* name, size_t defaultValue)
+{
+    const char* value = getenv(name);
+    if (!value || !*value) {
+        return defaultValue;
+    }
+    char* end = NULL;
+    unsigned long long res = strtoull(value, &end, 10);
+    if (*end) {
+        return defaultValue;
+    }
+    return (size_t)res;
+}
+
+WorkerPool& WorkerPool::Get()
+{
+    static WorkerPool pool(GetEnvSize("PV_PKCS11_THREADS", std::thread::hardware_concurrency()));
+    return pool;
+}
+
+WorkerPool::WorkerPool(
+    size_t  threadCount
+) :
+    stop(false),
+    threadCount(threadCount),
+    running(0),
+    waiting(0),
+    started(false),
+    forking(false)
+{
+#ifndef _WIN32
+    // The pool is created once, by Get
+    pthread_atfork(ForkPrepare, ForkParent, ForkChild);
+#endif
+}
+
+WorkerPool::~WorkerPool()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    stop = true;
+    wakeup.notify_all();
+    stopped.wait(lock, [this]() { return !running; });
+}
+
+size_t WorkerPool::GetConcurrency()
+{
+    // The calling thread is one of workers
+    return threadCount > 1 ? threadCount : 1;
+}
+
+size_t WorkerPool::GetThreshold()
+{
+    // Read apart from the pool, so small operations don't start threads
+    static size_t threshold = GetEnvSize("PV_PKCS11_PARALLEL_THRESHOLD", WORKERS_DEFAULT_THRESHOLD);
+    return threshold;
+}
+
+void WorkerPool::Run(
+    size_t                              count,
+    const std::function<void(size_t)>&  task
+)
+{
+    if (threadCount < 2 || count < 2) {
+        for (size_t i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    Scoped<Job> job(new Job);
+    job->task = &task;
+    job->count = count;
+    job->next = 0;
+    job->done = 0;
+
+    {
+        // Notified with locked mutex, so fork doesn't find wakeup in the middle of a change
+        std::lock_guard<std::mutex> lock(mutex);
+        Start();
+        jobs.push_back(job);
+        wakeup.notify_all();
+    }
+
+    Help(*job);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::deque<Scoped<Job> >::iterator it = jobs.begin(); it != jobs.end(); it++) {
+            if (*it == job) {
+                jobs.erase(it);
+                break;
+            }
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&job, count]() { return job->done == count; });
+    }
+
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+void WorkerPool::Post(
+    const std::function<void()>&        task
+)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Start();
+    tasks.push_back(task);
+    wakeup.notify_one();
+}
+
+void WorkerPool::Start()
+{
+    if (started) {
+        return;
+    }
+    started = true;
+
+    // The calling thread is one of workers
+    size_t count = threadCount > 1 ? threadCount - 1 : 1;
+    for (size_t i = 0; i < count; i++) {
+        std::thread(&WorkerPool::Work, this).detach();
+        running++;
+    }
+}
+
+unsigned WorkerPool::GetForkGeneration()
+{
+    return workersForkGeneration.load(std::memory_order_relaxed);
+}
+
+#ifndef _WIN32
+void WorkerPool::ForkPrepare()
+{
+    WorkerPool& pool = Get();
+
+    pool.forkMutex.lock();
+    // Queues must not be in the middle of a change in the child
+    pool.mutex.lock();
+
+    // Waiters of wakeup would never leave it in the child, they move to forkMutex
+    pool.forking = true;
+    pool.wakeup.notify_all();
+    while (pool.waiting) {
+        pool.mutex.unlock();
+        std::this_thread::yield();
+        pool.mutex.lock();
+    }
+}
+
+void WorkerPool::ForkParent()
+{
+    WorkerPool& pool = Get();
+
+    pool.forking = false;
+    pool.mutex.unlock();
+    pool.forkMutex.unlock();
+}
+
+void WorkerPool::ForkChild()
+{
+    WorkerPool& pool = Get();
+
+    workersForkGeneration.fetch_add(1, std::memory_order_relaxed);
+
+    // Threads of the parent don't exist, the first Run or Post starts new ones
+    pool.running = 0;
+    pool.started = false;
+    pool.forking = false;
+    // Callers of the jobs are gone, their parts are not needed
+    pool.jobs.clear();
+
+    // Locked by ForkPrepare in the thread which is the child's only one
+    pool.mutex.unlock();
+    pool.forkMutex.unlock();
+}
+#endif
+
+void WorkerPool::Work()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        waiting++;
+        wakeup.wait(lock, [this]() { return stop || forking || !jobs.empty() || !tasks.empty(); });
+        waiting--;
+        if (stop) {
+            if (!--running) {
+                stopped.notify_all();
+            }
+            return;
+        }
+        if (forking) {
+            lock.unlock();
+            forkMutex.lock();
+            forkMutex.unlock();
+            lock.lock();
+            continue;
+        }
+
+        Scoped<Job> job;
+        std::function<void()> task;
+        // Parts of split operations go first, their callers wait
+        if (!jobs.empty()) {
+            job = jobs.front();
+        }
+        else {
+            task = tasks.front();
+            tasks.pop_front();
+        }
+        lock.unlock();
+
+        if (job) {
+            Help(*job);
+        }
+        else {
+            try {
+                task();
+            }
+            catch (...) {
+                // the poster doesn't wait for result
+            }
+        }
+
+        lock.lock();
+        // All parts are taken, other workers must not pick the job up
+        if (job && !jobs.empty() && jobs.front() == job) {
+            jobs.pop_front();
+        }
+    }
+}
+
+void WorkerPool::Help(
+    Job&    job
+)
+{
+    for (;;) {
+        size_t index = job.next++;
+        if (index >= job.count) {
+            return;
+        }
+
+        try {
+            (*job.task)(index);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (!job.error) {
+                job.error = std::current_exception();
+            }
+        }
+
+        if (++job.done == job.count) {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            job.finished.notify_all();
+        }
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "../../stdafx.h"
+#include "../excep.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace core {
+
+    /**
+     * Threads shared by crypto operations which split one large call into independent
+     * parts. The calling thread runs parts too, so a call never waits for a free worker
+     */
+    class WorkerPool {
+    public:
+        /**
+         * Returns the pool of the module. Threads are started by the first Run or Post which
+         * needs them, their number is one less than the number of CPUs or PV_PKCS11_THREADS - 1
+         */
+        static WorkerPool& Get();
+
+        ~WorkerPool();
+
+        /**
+         * Returns number of threads which run parts, the calling thread included
+         */
+        size_t GetConcurrency();
+
+        /**
+         * Returns size of data in bytes from which operations are split. The value is set
+         * by PV_PKCS11_PARALLEL_THRESHOLD, 0 disables splitting
+         */
+        static size_t GetThreshold();
+
+        /**
+         * Calls task for each index in [0, count) and returns when all calls finish.
+         * The first exception thrown by task is rethrown
+         */
+        void Run(
+            size_t                              count,
+            const std::function<void(size_t)>&  task
+        );
+
+        /**
+         * Queues task which runs on a thread that has no parts of split operations to run,
+         * the call doesn't wait for it. Exceptions of task are ignored. A pool without
+         * threads starts one thread for such tasks
+         */
+        void Post(
+            const std::function<void()>&        task
+        );
+
+        /**
+         * Returns number of forks the process is a child of. Posted tasks which were running
+         * in the parent are not finished in the child, callers counting them compare it
+         */
+        static unsigned GetForkGeneration();
+
+    protected:
+        struct Job {
+            const std::function<void(size_t)>*  task;
+            size_t                              count;
+            std::atomic<size_t>                 next;
+            std::atomic<size_t>                 done;
+            std::exception_ptr                  error;
+            std::mutex                          mutex;
+            std::condition_variable             finished;
+        };
+
+        std::deque<Scoped<Job> >    jobs;
+        std::deque<std::function<void()> > tasks;
+        std::mutex                  mutex;
+        std::condition_variable     wakeup;
+        // Notified by the last thread which leaves on stop
+        std::condition_variable     stopped;
+        bool                        stop;
+        size_t                      threadCount;
+        // Threads are detached, so the child of fork has no objects of them to drop
+        size_t                      running;
+        // Threads inside wakeup.wait
+        size_t                      waiting;
+        bool                        started;
+        // Held during fork, threads wait on it apart from wakeup
+        std::mutex                  forkMutex;
+        bool                        forking;
+
+        WorkerPool(
+            size_t  threadCount
+        );
+
+        /**
+         * Starts threads if they don't run. A pool without threads starts one thread for
+         * posted tasks. Called with locked mutex
+         */
+        void Start();
+
+#ifndef _WIN32
+        /**
+         * Handlers of pthread_atfork. Waiting threads leave wakeup before fork, so the child
+         * gets it without waiters. Threads don't survive fork, the child drops unfinished jobs
+         * and the first Run or Post starts new threads, queued tasks stay
+         */
+        static void ForkPrepare();
+        static void ForkParent();
+        static void ForkChild();
+#endif
+
+        void Work();
+
+        /**
+         * Runs parts of the job until all of them are taken
+         */
+        static void Help(
+            Job&    job
+        );
+    };
+
+}
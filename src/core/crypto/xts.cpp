@@ -0,0 +1,498 @@
+#include "xts.h"
+#include "workers.h"
+
+using namespace core;
+
+// Blocks of the portable kernels processed at a time
+#define XTS_SCALAR_BLOCKS       16
+// Parts of a split call are not smaller than this
+#define XTS_MIN_PART_LENGTH     (64 * 1024)
+
+static inline uint64_t LoadLE64(const CK_BYTE* p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static inline void StoreLE64(CK_BYTE* p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++, v >>= 8) {
+        p[i] = (CK_BYTE)v;
+    }
+}
+
+// T = T * x in GF(2^128) of IEEE 1619, T is a little-endian number
+static inline void XtsMultiplyX(uint64_t& lo, uint64_t& hi)
+{
+    uint64_t carry = hi >> 63;
+    hi = (hi << 1) | (lo >> 63);
+    lo = (lo << 1) ^ (0x87 & (0 - carry));
+}
+
+static void XtsMultiply(uint64_t& lo, uint64_t& hi, uint64_t bLo, uint64_t bHi)
+{
+    uint64_t aLo = lo;
+    uint64_t aHi = hi;
+    lo = hi = 0;
+    for (int i = 0; i < 128; i++) {
+        uint64_t bit = (i < 64 ? bLo >> i : bHi >> (i - 64)) & 1;
+        lo ^= aLo & (0 - bit);
+        hi ^= aHi & (0 - bit);
+        XtsMultiplyX(aLo, aHi);
+    }
+}
+
+// Tweak of the block n blocks ahead, T = T * x^n
+static void XtsAdvance(CK_BYTE* pbTweak, uint64_t n)
+{
+    uint64_t lo = LoadLE64(pbTweak);
+    uint64_t hi = LoadLE64(pbTweak + 8);
+    uint64_t pLo = 2;
+    uint64_t pHi = 0;
+    for (; n; n >>= 1) {
+        if (n & 1) {
+            XtsMultiply(lo, hi, pLo, pHi);
+        }
+        uint64_t sLo = pLo;
+        uint64_t sHi = pHi;
+        XtsMultiply(pLo, pHi, sLo, sHi);
+    }
+    StoreLE64(pbTweak, lo);
+    StoreLE64(pbTweak + 8, hi);
+}
+
+// Adds n to the tweak of a data unit, a 128-bit little-endian number
+static void XtsAddTweak(CK_BYTE* pbTweak, uint64_t n)
+{
+    uint64_t lo = LoadLE64(pbTweak);
+    uint64_t sum = lo + n;
+    StoreLE64(pbTweak, sum);
+    if (sum < lo) {
+        StoreLE64(pbTweak + 8, LoadLE64(pbTweak + 8) + 1);
+    }
+}
+
+static void XtsBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks, bool decrypt)
+{
+    CK_BYTE tweaks[XTS_SCALAR_BLOCKS * AES_BLOCK_LENGTH];
+    CK_BYTE data[XTS_SCALAR_BLOCKS * AES_BLOCK_LENGTH];
+    uint64_t lo = LoadLE64(pbTweak);
+    uint64_t hi = LoadLE64(pbTweak + 8);
+
+    while (blocks) {
+        size_t n = blocks < XTS_SCALAR_BLOCKS ? blocks : XTS_SCALAR_BLOCKS;
+        for (size_t i = 0; i < n; i++) {
+            StoreLE64(tweaks + i * AES_BLOCK_LENGTH, lo);
+            StoreLE64(tweaks + i * AES_BLOCK_LENGTH + 8, hi);
+            XtsMultiplyX(lo, hi);
+        }
+        for (size_t i = 0; i < n * AES_BLOCK_LENGTH; i++) {
+            data[i] = pbIn[i] ^ tweaks[i];
+        }
+        if (decrypt) {
+            AesDecryptBlocks(roundKeys, rounds, data, data, n);
+        }
+        else {
+            AesEncryptBlocks(roundKeys, rounds, data, data, n);
+        }
+        for (size_t i = 0; i < n * AES_BLOCK_LENGTH; i++) {
+            pbOut[i] = data[i] ^ tweaks[i];
+        }
+        pbIn += n * AES_BLOCK_LENGTH;
+        pbOut += n * AES_BLOCK_LENGTH;
+        blocks -= n;
+    }
+
+    StoreLE64(pbTweak, lo);
+    StoreLE64(pbTweak + 8, hi);
+    memset(data, 0, sizeof(data));
+}
+
+void core::XtsEncryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    XtsBlocks(roundKeys, rounds, pbTweak, pbIn, pbOut, blocks, false);
+}
+
+void core::XtsDecryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    XtsBlocks(roundKeys, rounds, pbTweak, pbIn, pbOut, blocks, true);
+}
+
+// Implementations in use
+static XTS_BLOCKS     xtsEncryptBlocks = core::XtsEncryptBlocks;
+static XTS_BLOCKS     xtsDecryptBlocks = core::XtsDecryptBlocks;
+static const char*    xtsName = "scalar";
+
+void Xts::Setup()
+{
+    const char* limit = getenv("PV_PKCS11_AES");
+    bool allowAesNi = !limit || !strcmp(limit, "aesni") || !strcmp(limit, "vaes");
+    bool allowVaes = !limit || !strcmp(limit, "vaes");
+
+    xtsEncryptBlocks = core::XtsEncryptBlocks;
+    xtsDecryptBlocks = core::XtsDecryptBlocks;
+    xtsName = "scalar";
+
+#ifdef PV_X86
+    const CPU_FEATURES& cpu = GetCpuFeatures();
+    if (allowAesNi && cpu.aes && cpu.sse41) {
+        xtsEncryptBlocks = core::XtsEncryptBlocksAesNi;
+        xtsDecryptBlocks = core::XtsDecryptBlocksAesNi;
+        xtsName = "aesni";
+
+        // Wide kernels hand incomplete groups to AES-NI ones
+        if (allowVaes && cpu.vaes && cpu.avx512f && cpu.avx512bw) {
+            xtsEncryptBlocks = core::XtsEncryptBlocksVaes512;
+            xtsDecryptBlocks = core::XtsDecryptBlocksVaes512;
+            xtsName = "vaes512";
+        }
+        else if (allowVaes && cpu.vaes && cpu.avx2) {
+            xtsEncryptBlocks = core::XtsEncryptBlocksVaes;
+            xtsDecryptBlocks = core::XtsDecryptBlocksVaes;
+            xtsName = "vaes";
+        }
+    }
+#endif
+}
+
+const char* Xts::GetImplementationName()
+{
+    return xtsName;
+}
+
+static void XtsCrypt(Aes* aes, bool decrypt, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    if (decrypt) {
+        xtsDecryptBlocks(aes->GetDecryptRoundKeys(), aes->GetRounds(), pbTweak, pbIn, pbOut, blocks);
+    }
+    else {
+        xtsEncryptBlocks(aes->GetRoundKeys(), aes->GetRounds(), pbTweak, pbIn, pbOut, blocks);
+    }
+}
+
+// Rest of a data unit of at least 16 bytes. The last complete block and an incomplete
+// one use ciphertext stealing
+static void XtsCryptLast(Aes* aes, bool decrypt, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t len)
+{
+    size_t blocks = len / AES_BLOCK_LENGTH;
+    size_t rest = len % AES_BLOCK_LENGTH;
+    if (!rest) {
+        XtsCrypt(aes, decrypt, pbTweak, pbIn, pbOut, blocks);
+        return;
+    }
+
+    XtsCrypt(aes, decrypt, pbTweak, pbIn, pbOut, blocks - 1);
+    pbIn += (blocks - 1) * AES_BLOCK_LENGTH;
+    pbOut += (blocks - 1) * AES_BLOCK_LENGTH;
+
+    // Decryption of the last complete block needs the tweak of the incomplete one
+    CK_BYTE tweakLast[AES_BLOCK_LENGTH];
+    CK_BYTE tweakNext[AES_BLOCK_LENGTH];
+    memcpy(tweakLast, pbTweak, AES_BLOCK_LENGTH);
+    memcpy(tweakNext, pbTweak, AES_BLOCK_LENGTH);
+    XtsAdvance(tweakNext, 1);
+
+    CK_BYTE block[AES_BLOCK_LENGTH];
+    CK_BYTE stolen[AES_BLOCK_LENGTH];
+    XtsCrypt(aes, decrypt, decrypt ? tweakNext : tweakLast, pbIn, block, 1);
+    memcpy(stolen, pbIn + AES_BLOCK_LENGTH, rest);
+    memcpy(stolen + rest, block + rest, AES_BLOCK_LENGTH - rest);
+    memcpy(pbOut + AES_BLOCK_LENGTH, block, rest);
+    XtsCrypt(aes, decrypt, decrypt ? tweakLast : tweakNext, stolen, pbOut, 1);
+
+    XtsAdvance(tweakNext, 1);
+    memcpy(pbTweak, tweakNext, AES_BLOCK_LENGTH);
+    memset(block, 0, sizeof(block));
+    memset(stolen, 0, sizeof(stolen));
+}
+
+XtsKey::XtsKey(
+    const CK_BYTE*      pbKey,
+    CK_ULONG            ulKeyLen
+)
+{
+    try {
+        if (ulKeyLen != 32 && ulKeyLen != 64) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_SIZE_RANGE, "XTS-AES key must be 32 or 64 bytes");
+        }
+
+        dataAes = Scoped<Aes>(new Aes(pbKey, ulKeyLen / 2));
+        tweakAes = Scoped<Aes>(new Aes(pbKey + ulKeyLen / 2, ulKeyLen / 2));
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<Aes> XtsKey::GetDataAes()
+{
+    return dataAes;
+}
+
+Scoped<Aes> XtsKey::GetTweakAes()
+{
+    return tweakAes;
+}
+
+Xts::Xts() :
+    decrypt(false),
+    dataUnitLen(0),
+    dataLen(0)
+{
+    memset(tweak, 0, sizeof(tweak));
+}
+
+Xts::~Xts()
+{
+    memset(tweak, 0, sizeof(tweak));
+    memset(buffer.data(), 0, buffer.size());
+}
+
+void Xts::Init(
+    Scoped<XtsKey>      key,
+    const CK_BYTE*      pbTweak,
+    size_t              dataUnitLen,
+    bool                decrypt
+)
+{
+    try {
+        if (dataUnitLen && (dataUnitLen < AES_BLOCK_LENGTH || dataUnitLen > XTS_MAX_DATA_UNIT_LENGTH)) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Wrong length of XTS data unit");
+        }
+
+        this->key = key;
+        this->decrypt = decrypt;
+        this->dataUnitLen = dataUnitLen;
+        if (dataUnitLen) {
+            memcpy(tweak, pbTweak, AES_BLOCK_LENGTH);
+        }
+        else {
+            key->GetTweakAes()->EncryptBlocks(pbTweak, tweak, 1);
+        }
+        memset(buffer.data(), 0, buffer.size());
+        buffer.clear();
+        dataLen = 0;
+    }
+    CATCH_EXCEPTION
+}
+
+size_t Xts::GetUpdateLength(
+    size_t              len
+)
+{
+    size_t total = buffer.size() + len;
+    if (dataUnitLen) {
+        return total - total % dataUnitLen;
+    }
+    // The last 17 to 32 bytes are kept for Final
+    return total > 2 * AES_BLOCK_LENGTH ? (total - AES_BLOCK_LENGTH - 1) / AES_BLOCK_LENGTH * AES_BLOCK_LENGTH : 0;
+}
+
+size_t Xts::GetFinalLength()
+{
+    return buffer.size();
+}
+
+size_t Xts::Update(
+    const CK_BYTE*      pbIn,
+    size_t              len,
+    CK_BYTE*            pbOut
+)
+{
+    try {
+        if (!key) {
+            THROW_EXCEPTION("XTS is not initialized");
+        }
+
+        // Output is shifted by the kept bytes and would overwrite input which is not read yet
+        if (!buffer.empty() && len && pbOut < pbIn + len && pbIn < pbOut + len + buffer.size()) {
+            Buffer copy(pbIn, pbIn + len);
+            size_t res = Update(copy.data(), len, pbOut);
+            memset(copy.data(), 0, copy.size());
+            return res;
+        }
+
+        size_t res = GetUpdateLength(len);
+
+        if (dataUnitLen) {
+            if (!buffer.empty()) {
+                size_t n = dataUnitLen - buffer.size();
+                if (n > len) {
+                    n = len;
+                }
+                buffer.insert(buffer.end(), pbIn, pbIn + n);
+                pbIn += n;
+                len -= n;
+                if (buffer.size() < dataUnitLen) {
+                    return 0;
+                }
+                DataUnits(buffer.data(), pbOut, 1);
+                memset(buffer.data(), 0, buffer.size());
+                buffer.clear();
+                pbOut += dataUnitLen;
+            }
+
+            size_t count = len / dataUnitLen;
+            DataUnits(pbIn, pbOut, count);
+            buffer.assign(pbIn + count * dataUnitLen, pbIn + len);
+
+            return res;
+        }
+
+        if (dataLen + buffer.size() + len > XTS_MAX_DATA_UNIT_LENGTH) {
+            THROW_PKCS11_EXCEPTION(CKR_DATA_LEN_RANGE, "XTS data unit is too long");
+        }
+
+        size_t blocks = res / AES_BLOCK_LENGTH;
+        dataLen += res;
+
+        // Kept bytes go first, there are at most two blocks of them
+        while (blocks && !buffer.empty()) {
+            if (buffer.size() < AES_BLOCK_LENGTH) {
+                size_t n = AES_BLOCK_LENGTH - buffer.size();
+                buffer.insert(buffer.end(), pbIn, pbIn + n);
+                pbIn += n;
+                len -= n;
+            }
+            XtsCrypt(key->GetDataAes().get(), decrypt, tweak, buffer.data(), pbOut, 1);
+            memset(buffer.data(), 0, AES_BLOCK_LENGTH);
+            buffer.erase(buffer.begin(), buffer.begin() + AES_BLOCK_LENGTH);
+            pbOut += AES_BLOCK_LENGTH;
+            blocks--;
+        }
+
+        Blocks(pbIn, pbOut, blocks);
+        buffer.insert(buffer.end(), pbIn + blocks * AES_BLOCK_LENGTH, pbIn + len);
+
+        return res;
+    }
+    CATCH_EXCEPTION
+}
+
+size_t Xts::Final(
+    CK_BYTE*            pbOut
+)
+{
+    try {
+        if (!key) {
+            THROW_EXCEPTION("XTS is not initialized");
+        }
+
+        CK_RV rv = decrypt ? CKR_ENCRYPTED_DATA_LEN_RANGE : CKR_DATA_LEN_RANGE;
+        size_t len = buffer.size();
+        if (dataUnitLen) {
+            if (len) {
+                THROW_PKCS11_EXCEPTION(rv, "Data is not a multiple of XTS data unit");
+            }
+            return 0;
+        }
+        if (len < AES_BLOCK_LENGTH) {
+            THROW_PKCS11_EXCEPTION(rv, "XTS data unit is shorter than AES block");
+        }
+
+        XtsCryptLast(key->GetDataAes().get(), decrypt, tweak, buffer.data(), pbOut, len);
+        memset(buffer.data(), 0, len);
+        buffer.clear();
+        dataLen = 0;
+
+        return len;
+    }
+    CATCH_EXCEPTION
+}
+
+void Xts::Blocks(
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              blocks
+)
+{
+    if (!blocks) {
+        return;
+    }
+
+    Aes* aes = key->GetDataAes().get();
+    size_t threshold = WorkerPool::GetThreshold();
+    size_t len = blocks * AES_BLOCK_LENGTH;
+    if (!threshold || len < threshold || len < 2 * XTS_MIN_PART_LENGTH) {
+        XtsCrypt(aes, decrypt, tweak, pbIn, pbOut, blocks);
+        return;
+    }
+
+    // Tweak of each part is computed from the tweak of the first block
+    WorkerPool& pool = WorkerPool::Get();
+    size_t parts = pool.GetConcurrency();
+    if (parts > len / XTS_MIN_PART_LENGTH) {
+        parts = len / XTS_MIN_PART_LENGTH;
+    }
+    size_t partBlocks = (blocks + parts - 1) / parts;
+
+    bool isDecrypt = decrypt;
+    const CK_BYTE* pbTweak = tweak;
+    pool.Run(parts, [=](size_t part) {
+        size_t first = part * partBlocks;
+        size_t count = blocks - first < partBlocks ? blocks - first : partBlocks;
+        CK_BYTE partTweak[AES_BLOCK_LENGTH];
+        memcpy(partTweak, pbTweak, AES_BLOCK_LENGTH);
+        XtsAdvance(partTweak, first);
+        size_t offset = first * AES_BLOCK_LENGTH;
+        XtsCrypt(aes, isDecrypt, partTweak, pbIn + offset, pbOut + offset, count);
+    });
+
+    XtsAdvance(tweak, blocks);
+}
+
+void Xts::DataUnits(
+    const CK_BYTE*      pbIn,
+    CK_BYTE*            pbOut,
+    size_t              count
+)
+{
+    if (!count) {
+        return;
+    }
+
+    Aes* dataAes = key->GetDataAes().get();
+    Aes* tweakAes = key->GetTweakAes().get();
+    bool isDecrypt = decrypt;
+    size_t unitLen = dataUnitLen;
+    const CK_BYTE* pbFirst = tweak;
+
+    auto run = [=](size_t first, size_t units) {
+        CK_BYTE number[AES_BLOCK_LENGTH];
+        CK_BYTE unitTweak[AES_BLOCK_LENGTH];
+        memcpy(number, pbFirst, AES_BLOCK_LENGTH);
+        XtsAddTweak(number, first);
+        for (size_t i = first; i < first + units; i++) {
+            tweakAes->EncryptBlocks(number, unitTweak, 1);
+            XtsCryptLast(dataAes, isDecrypt, unitTweak, pbIn + i * unitLen, pbOut + i * unitLen, unitLen);
+            XtsAddTweak(number, 1);
+        }
+    };
+
+    size_t threshold = WorkerPool::GetThreshold();
+    size_t len = count * unitLen;
+    if (!threshold || len < threshold || len < 2 * XTS_MIN_PART_LENGTH || count < 2) {
+        run(0, count);
+    }
+    else {
+        // Data units don't depend on each other, each part takes a run of them
+        WorkerPool& pool = WorkerPool::Get();
+        size_t parts = pool.GetConcurrency();
+        if (parts > len / XTS_MIN_PART_LENGTH) {
+            parts = len / XTS_MIN_PART_LENGTH;
+        }
+        if (parts > count) {
+            parts = count;
+        }
+        size_t partUnits = (count + parts - 1) / parts;
+        pool.Run(parts, [=](size_t part) {
+            size_t first = part * partUnits;
+            if (first < count) {
+                run(first, count - first < partUnits ? count - first : partUnits);
+            }
+        });
+    }
+
+    XtsAddTweak(tweak, count);
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "../../stdafx.h"
+#include "../excep.h"
+#include "cpu.h"
+#include "aes.h"
+
+namespace core {
+
+// IEEE 1619 limits a data unit to 2^20 blocks
+#define XTS_MAX_DATA_UNIT_LENGTH    (1 << 24)
+
+    // Tweak is T of IEEE 1619 for the first block, it is replaced with T of the block after
+    // the last one. Encryption uses encryption round keys, decryption the keys of the
+    // equivalent inverse cipher. Output may be the same buffer as input
+    typedef void(*XTS_BLOCKS)(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+
+    // Portable implementations
+    void XtsEncryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void XtsDecryptBlocks(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+
+#ifdef PV_X86
+    // AES-NI, 8 blocks are interleaved. Tweaks of a group are computed from the previous
+    // group, so they don't form a chain of multiplications
+    void XtsEncryptBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void XtsDecryptBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    // VAES with AVX2, 16 blocks in 8 registers
+    void XtsEncryptBlocksVaes(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void XtsDecryptBlocksVaes(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    // VAES with AVX-512, 32 blocks in 8 registers
+    void XtsEncryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+    void XtsDecryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks);
+#endif
+
+    /**
+     * XTS-AES key, the first half encrypts data and the second one tweaks
+     */
+    class XtsKey {
+    public:
+        /**
+         * Throws CKR_KEY_SIZE_RANGE if key is not 32 or 64 bytes
+         */
+        XtsKey(
+            const CK_BYTE*      pbKey,
+            CK_ULONG            ulKeyLen
+        );
+
+        Scoped<Aes> GetDataAes();
+
+        Scoped<Aes> GetTweakAes();
+
+    protected:
+        Scoped<Aes>         dataAes;
+        Scoped<Aes>         tweakAes;
+    };
+
+    /**
+     * XTS-AES (IEEE 1619) over parts of data. The message is either one data unit, or a
+     * sequence of data units of the same length whose tweaks are consecutive numbers.
+     * Data units which are not a multiple of AES block use ciphertext stealing. Large
+     * parts are split by data unit or by block across WorkerPool
+     */
+    class Xts {
+    public:
+        /**
+         * Selects the fastest implementations supported by CPU. The choice is limited
+         * by PV_PKCS11_AES environment variable as for Aes
+         */
+        static void Setup();
+
+        /**
+         * Returns name of implementation in use
+         */
+        static const char* GetImplementationName();
+
+        Xts();
+        ~Xts();
+
+        /**
+         * pbTweak is the 16-byte tweak of the first data unit. dataUnitLen is 0 if the
+         * message is one data unit. Throws CKR_MECHANISM_PARAM_INVALID if dataUnitLen is
+         * less than 16 bytes or more than XTS_MAX_DATA_UNIT_LENGTH
+         */
+        void Init(
+            Scoped<XtsKey>      key,
+            const CK_BYTE*      pbTweak,
+            size_t              dataUnitLen,
+            bool                decrypt
+        );
+
+        /**
+         * Returns number of bytes Update writes for the part
+         */
+        size_t GetUpdateLength(
+            size_t              len
+        );
+
+        /**
+         * Returns number of bytes Final writes
+         */
+        size_t GetFinalLength();
+
+        /**
+         * Returns number of bytes written. Output may be the same buffer as input. Throws
+         * CKR_DATA_LEN_RANGE if one data unit exceeds XTS_MAX_DATA_UNIT_LENGTH
+         */
+        size_t Update(
+            const CK_BYTE*      pbIn,
+            size_t              len,
+            CK_BYTE*            pbOut
+        );
+
+        /**
+         * Processes the kept bytes and returns their number. Throws CKR_DATA_LEN_RANGE or
+         * CKR_ENCRYPTED_DATA_LEN_RANGE if a data unit is incomplete or shorter than 16 bytes
+         */
+        size_t Final(
+            CK_BYTE*            pbOut
+        );
+
+    protected:
+        Scoped<XtsKey>      key;
+        bool                decrypt;
+        size_t              dataUnitLen;
+        // Encrypted tweak of the next block of one data unit, or the tweak of the next
+        // data unit of a sequence
+        CK_BYTE             tweak[AES_BLOCK_LENGTH];
+        // Incomplete data unit. A message of one data unit keeps at least 17 bytes,
+        // because the last two blocks may need ciphertext stealing
+        Buffer              buffer;
+        // Bytes of one data unit processed so far
+        size_t              dataLen;
+
+        /**
+         * Complete blocks of one data unit, the tweak is advanced
+         */
+        void Blocks(
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              blocks
+        );
+
+        /**
+         * Complete data units of a sequence, the tweak is advanced
+         */
+        void DataUnits(
+            const CK_BYTE*      pbIn,
+            CK_BYTE*            pbOut,
+            size_t              count
+        );
+    };
+
+}
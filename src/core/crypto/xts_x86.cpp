@@ -0,0 +1,217 @@
+#include "xts.h"
+
+#ifdef PV_X86
+
+#include <immintrin.h>
+
+using namespace core;
+
+#define AESNI_LOAD_KEYS(rk, roundKeys, rounds)                          \
+    for (CK_ULONG r = 0; r <= rounds; r++) {                            \
+        rk[r] = _mm_loadu_si128((const __m128i*)(roundKeys + r * 16));  \
+    }
+
+#define VAES_LOAD_KEYS(rk, roundKeys, rounds)                                                           \
+    for (CK_ULONG r = 0; r <= rounds; r++) {                                                            \
+        rk[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(roundKeys + r * 16)));     \
+    }
+
+#define VAES512_LOAD_KEYS(rk, roundKeys, rounds)                                                        \
+    for (CK_ULONG r = 0; r <= rounds; r++) {                                                            \
+        rk[r] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(roundKeys + r * 16)));          \
+    }
+
+// Runs all rounds for 8 registers, one round of each register at a time hides latency of
+// AESENC. The same macro serves 128, 256 and 512-bit registers and decryption
+#define AES_ROUNDS8(B, rk, rounds, XOR, ENC, ENCLAST)                   \
+    B[0] = XOR(B[0], rk[0]);                                            \
+    B[1] = XOR(B[1], rk[0]);                                            \
+    B[2] = XOR(B[2], rk[0]);                                            \
+    B[3] = XOR(B[3], rk[0]);                                            \
+    B[4] = XOR(B[4], rk[0]);                                            \
+    B[5] = XOR(B[5], rk[0]);                                            \
+    B[6] = XOR(B[6], rk[0]);                                            \
+    B[7] = XOR(B[7], rk[0]);                                            \
+    for (CK_ULONG r = 1; r < rounds; r++) {                             \
+        B[0] = ENC(B[0], rk[r]);                                        \
+        B[1] = ENC(B[1], rk[r]);                                        \
+        B[2] = ENC(B[2], rk[r]);                                        \
+        B[3] = ENC(B[3], rk[r]);                                        \
+        B[4] = ENC(B[4], rk[r]);                                        \
+        B[5] = ENC(B[5], rk[r]);                                        \
+        B[6] = ENC(B[6], rk[r]);                                        \
+        B[7] = ENC(B[7], rk[r]);                                        \
+    }                                                                   \
+    B[0] = ENCLAST(B[0], rk[rounds]);                                   \
+    B[1] = ENCLAST(B[1], rk[rounds]);                                   \
+    B[2] = ENCLAST(B[2], rk[rounds]);                                   \
+    B[3] = ENCLAST(B[3], rk[rounds]);                                   \
+    B[4] = ENCLAST(B[4], rk[rounds]);                                   \
+    B[5] = ENCLAST(B[5], rk[rounds]);                                   \
+    B[6] = ENCLAST(B[6], rk[rounds]);                                   \
+    B[7] = ENCLAST(B[7], rk[rounds])
+
+// Multiplies each 128-bit tweak by x^n, n is below 57. Bits shifted out of the low half go
+// to the high half, bits shifted out of the high half are reduced by x^128 = x^7 + x^2 + x + 1
+// into the low half. lo selects low halves. The same macro serves 128, 256 and 512-bit registers
+#define XTS_MULX(t, n, lo, SLL, SRL, SWAP, SLLI, XOR, AND)              \
+    do {                                                                \
+        auto c = SWAP(SRL(t, _mm_cvtsi32_si128(64 - (n))));             \
+        auto red = XOR(XOR(SLLI(c, 1), SLLI(c, 2)), SLLI(c, 7));        \
+        t = XOR(XOR(SLL(t, _mm_cvtsi32_si128(n)), c), AND(red, lo));    \
+    } while (0)
+
+#define XTS_SWAP128(v) _mm_shuffle_epi32(v, 0x4e)
+#define XTS_SWAP256(v) _mm256_shuffle_epi32(v, 0x4e)
+#define XTS_SWAP512(v) _mm512_shuffle_epi32(v, (_MM_PERM_ENUM)0x4e)
+
+#define XTS_MULX128(t, n, lo) XTS_MULX(t, n, lo, _mm_sll_epi64, _mm_srl_epi64, XTS_SWAP128, _mm_slli_epi64, _mm_xor_si128, _mm_and_si128)
+#define XTS_MULX256(t, n, lo) XTS_MULX(t, n, lo, _mm256_sll_epi64, _mm256_srl_epi64, XTS_SWAP256, _mm256_slli_epi64, _mm256_xor_si256, _mm256_and_si256)
+#define XTS_MULX512(t, n, lo) XTS_MULX(t, n, lo, _mm512_sll_epi64, _mm512_srl_epi64, XTS_SWAP512, _mm512_slli_epi64, _mm512_xor_si512, _mm512_and_si512)
+
+// Kernels only differ by AES direction. T[i] holds tweaks of register i, they are multiplied
+// by x^(blocks per group) for the next group, so all registers advance in parallel
+
+#define XTS_AESNI_KERNEL(ENC, ENCLAST)                                  \
+    __m128i rk[15];                                                     \
+    AESNI_LOAD_KEYS(rk, roundKeys, rounds);                             \
+    const __m128i lo = _mm_set_epi64x(0, -1);                           \
+                                                                        \
+    __m128i T[8];                                                       \
+    T[0] = _mm_loadu_si128((const __m128i*)pbTweak);                    \
+    for (int i = 1; i < 8; i++) {                                       \
+        T[i] = T[i - 1];                                                \
+        XTS_MULX128(T[i], 1, lo);                                       \
+    }                                                                   \
+    for (; blocks >= 8; blocks -= 8, pbIn += 128, pbOut += 128) {       \
+        __m128i B[8];                                                   \
+        for (int i = 0; i < 8; i++) {                                   \
+            B[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(pbIn + i * 16)), T[i]); \
+        }                                                               \
+        AES_ROUNDS8(B, rk, rounds, _mm_xor_si128, ENC, ENCLAST);        \
+        for (int i = 0; i < 8; i++) {                                   \
+            _mm_storeu_si128((__m128i*)(pbOut + i * 16), _mm_xor_si128(B[i], T[i])); \
+            XTS_MULX128(T[i], 8, lo);                                   \
+        }                                                               \
+    }                                                                   \
+    __m128i t = T[0];                                                   \
+    for (; blocks; blocks--, pbIn += 16, pbOut += 16) {                 \
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)pbIn), t); \
+        b = _mm_xor_si128(b, rk[0]);                                    \
+        for (CK_ULONG r = 1; r < rounds; r++) {                         \
+            b = ENC(b, rk[r]);                                          \
+        }                                                               \
+        _mm_storeu_si128((__m128i*)pbOut, _mm_xor_si128(ENCLAST(b, rk[rounds]), t)); \
+        XTS_MULX128(t, 1, lo);                                          \
+    }                                                                   \
+    _mm_storeu_si128((__m128i*)pbTweak, t)
+
+PV_TARGET("aes,sse4.1")
+void core::XtsEncryptBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    XTS_AESNI_KERNEL(_mm_aesenc_si128, _mm_aesenclast_si128);
+}
+
+PV_TARGET("aes,sse4.1")
+void core::XtsDecryptBlocksAesNi(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    XTS_AESNI_KERNEL(_mm_aesdec_si128, _mm_aesdeclast_si128);
+}
+
+// VAES with AVX2. Each register holds 2 blocks, the tweak of the first block is in the low lane
+
+#define XTS_VAES_KERNEL(ENC, ENCLAST, SMALL)                            \
+    if (blocks < 16) {                                                  \
+        SMALL(roundKeys, rounds, pbTweak, pbIn, pbOut, blocks);         \
+        return;                                                         \
+    }                                                                   \
+    __m256i rk[15];                                                     \
+    VAES_LOAD_KEYS(rk, roundKeys, rounds);                              \
+    const __m256i lo = _mm256_set_epi64x(0, -1, 0, -1);                 \
+                                                                        \
+    __m128i t0 = _mm_loadu_si128((const __m128i*)pbTweak);              \
+    __m128i t1 = t0;                                                    \
+    XTS_MULX128(t1, 1, _mm256_castsi256_si128(lo));                     \
+    __m256i T[8];                                                       \
+    T[0] = _mm256_inserti128_si256(_mm256_castsi128_si256(t0), t1, 1);  \
+    for (int i = 1; i < 8; i++) {                                       \
+        T[i] = T[i - 1];                                                \
+        XTS_MULX256(T[i], 2, lo);                                       \
+    }                                                                   \
+    for (; blocks >= 16; blocks -= 16, pbIn += 256, pbOut += 256) {     \
+        __m256i B[8];                                                   \
+        for (int i = 0; i < 8; i++) {                                   \
+            B[i] = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(pbIn + i * 32)), T[i]); \
+        }                                                               \
+        AES_ROUNDS8(B, rk, rounds, _mm256_xor_si256, ENC, ENCLAST);     \
+        for (int i = 0; i < 8; i++) {                                   \
+            _mm256_storeu_si256((__m256i*)(pbOut + i * 32), _mm256_xor_si256(B[i], T[i])); \
+            XTS_MULX256(T[i], 16, lo);                                  \
+        }                                                               \
+    }                                                                   \
+    _mm_storeu_si128((__m128i*)pbTweak, _mm256_castsi256_si128(T[0]));  \
+    SMALL(roundKeys, rounds, pbTweak, pbIn, pbOut, blocks)
+
+PV_TARGET("vaes,avx2,aes")
+void core::XtsEncryptBlocksVaes(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    XTS_VAES_KERNEL(_mm256_aesenc_epi128, _mm256_aesenclast_epi128, XtsEncryptBlocksAesNi);
+}
+
+PV_TARGET("vaes,avx2,aes")
+void core::XtsDecryptBlocksVaes(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    XTS_VAES_KERNEL(_mm256_aesdec_epi128, _mm256_aesdeclast_epi128, XtsDecryptBlocksAesNi);
+}
+
+// VAES with AVX-512. Each register holds 4 blocks, the tweak of the first block is in lane 0
+
+#define XTS_VAES512_KERNEL(ENC, ENCLAST, SMALL)                         \
+    if (blocks < 32) {                                                  \
+        SMALL(roundKeys, rounds, pbTweak, pbIn, pbOut, blocks);         \
+        return;                                                         \
+    }                                                                   \
+    __m512i rk[15];                                                     \
+    VAES512_LOAD_KEYS(rk, roundKeys, rounds);                           \
+    const __m512i lo = _mm512_set_epi64(0, -1, 0, -1, 0, -1, 0, -1);    \
+                                                                        \
+    __m128i t = _mm_loadu_si128((const __m128i*)pbTweak);               \
+    __m512i T[8];                                                       \
+    T[0] = _mm512_castsi128_si512(t);                                   \
+    XTS_MULX128(t, 1, _mm512_castsi512_si128(lo));                      \
+    T[0] = _mm512_inserti32x4(T[0], t, 1);                              \
+    XTS_MULX128(t, 1, _mm512_castsi512_si128(lo));                      \
+    T[0] = _mm512_inserti32x4(T[0], t, 2);                              \
+    XTS_MULX128(t, 1, _mm512_castsi512_si128(lo));                      \
+    T[0] = _mm512_inserti32x4(T[0], t, 3);                              \
+    for (int i = 1; i < 8; i++) {                                       \
+        T[i] = T[i - 1];                                                \
+        XTS_MULX512(T[i], 4, lo);                                       \
+    }                                                                   \
+    for (; blocks >= 32; blocks -= 32, pbIn += 512, pbOut += 512) {     \
+        __m512i B[8];                                                   \
+        for (int i = 0; i < 8; i++) {                                   \
+            B[i] = _mm512_xor_si512(_mm512_loadu_si512((const void*)(pbIn + i * 64)), T[i]); \
+        }                                                               \
+        AES_ROUNDS8(B, rk, rounds, _mm512_xor_si512, ENC, ENCLAST);     \
+        for (int i = 0; i < 8; i++) {                                   \
+            _mm512_storeu_si512((void*)(pbOut + i * 64), _mm512_xor_si512(B[i], T[i])); \
+            XTS_MULX512(T[i], 32, lo);                                  \
+        }                                                               \
+    }                                                                   \
+    _mm_storeu_si128((__m128i*)pbTweak, _mm512_castsi512_si128(T[0]));  \
+    SMALL(roundKeys, rounds, pbTweak, pbIn, pbOut, blocks)
+
+PV_TARGET("vaes,avx512f,avx512bw,aes")
+void core::XtsEncryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    XTS_VAES512_KERNEL(_mm512_aesenc_epi128, _mm512_aesenclast_epi128, XtsEncryptBlocksAesNi);
+}
+
+PV_TARGET("vaes,avx512f,avx512bw,aes")
+void core::XtsDecryptBlocksVaes512(const CK_BYTE* roundKeys, CK_ULONG rounds, CK_BYTE* pbTweak, const CK_BYTE* pbIn, CK_BYTE* pbOut, size_t blocks)
+{
+    XTS_VAES512_KERNEL(_mm512_aesdec_epi128, _mm512_aesdeclast_epi128, XtsDecryptBlocksAesNi);
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include "crypto.h"
 
 #include "excep.h"
+#include "crypto/sha.h"
 
 using namespace core;
 
@@ -90,4 +91,114 @@ CK_RV CryptoDigest::Final(
         return CKR_FUNCTION_NOT_SUPPORTED;
     }
     CATCH_EXCEPTION;
-}
\ No newline at end of file
+}
+CK_RV CryptoDigest::GetState(
+    CK_BYTE_PTR       pState,       /* gets state */
+    CK_ULONG_PTR      pulStateLen   /* gets state length */
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pulStateLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulStateLen is NULL");
+        }
+
+        return CKR_STATE_UNSAVEABLE;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV CryptoDigest::SetState(
+    CK_BYTE_PTR       pState,       /* holds state */
+    CK_ULONG          ulStateLen    /* holds state length */
+)
+{
+    try {
+        if (pState == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pState is NULL");
+        }
+
+        return CKR_SAVED_STATE_INVALID;
+    }
+    CATCH_EXCEPTION;
+}
+
+bool CryptoDigest::IsActive() {
+    return active;
+}
+
+CK_ULONG CryptoDigest::BatchInit(
+    CK_MECHANISM_PTR  pMechanism,
+    CK_PV_DATA_PTR    pMessages,
+    CK_ULONG          ulMessageCount,
+    CK_ULONG_PTR      pulDigestsLen
+)
+{
+    try {
+        if (active) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+        if (pMessages == NULL_PTR && ulMessageCount) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pMessages is NULL");
+        }
+        if (pulDigestsLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulDigestsLen is NULL");
+        }
+
+        if (pMechanism == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pMechanism is NULL");
+        }
+
+        CK_ULONG ulDigestLen = Sha::GetDigestLength(pMechanism->mechanism);
+        if (!ulDigestLen) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+        if (ulMessageCount > (CK_ULONG)-1 / ulDigestLen) {
+            THROW_PKCS11_EXCEPTION(CKR_DATA_LEN_RANGE, "Digests don't fit CK_ULONG");
+        }
+
+        return ulDigestLen;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV CryptoDigest::Batch(
+    CK_MECHANISM_PTR  pMechanism,      /* the digesting mechanism */
+    CK_PV_DATA_PTR    pMessages,       /* messages to be digested */
+    CK_ULONG          ulMessageCount,  /* # of messages */
+    CK_BYTE_PTR       pDigests,        /* gets the digests */
+    CK_ULONG_PTR      pulDigestsLen    /* gets size of digests */
+)
+{
+    try {
+        CK_ULONG ulDigestLen = BatchInit(pMechanism, pMessages, ulMessageCount, pulDigestsLen);
+        CK_ULONG ulDigestsLen = ulDigestLen * ulMessageCount;
+
+        if (pDigests == NULL_PTR) {
+            *pulDigestsLen = ulDigestsLen;
+            return CKR_OK;
+        }
+        if (*pulDigestsLen < ulDigestsLen) {
+            *pulDigestsLen = ulDigestsLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+        *pulDigestsLen = ulDigestsLen;
+
+        for (CK_ULONG i = 0; i < ulMessageCount; i++) {
+            CK_ULONG ulLen = ulDigestLen;
+            CK_RV rv = Init(pMechanism);
+            if (rv == CKR_OK) {
+                rv = Once(pMessages[i].pData, pMessages[i].ulDataLen, pDigests + i * ulDigestLen, &ulLen);
+            }
+            if (rv != CKR_OK) {
+                active = false;
+                THROW_PKCS11_EXCEPTION(rv, "Cannot digest message");
+            }
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION;
+}
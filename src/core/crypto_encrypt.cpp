@@ -71,6 +71,21 @@ CK_RV CryptoEncrypt::Update
     CATCH_EXCEPTION;
 }
 
+CK_ULONG CryptoEncrypt::GetUpdateLength
+(
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        if (!IsActive()) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+
+        THROW_PKCS11_FUNCTION_NOT_SUPPORTED();
+    }
+    CATCH_EXCEPTION;
+}
+
 CK_RV CryptoEncrypt::Final
 (
     CK_BYTE_PTR       pLastEncryptedPart,
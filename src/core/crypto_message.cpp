@@ -0,0 +1,366 @@
+#include "crypto.h"
+
+using namespace core;
+
+CryptoMessageEncrypt::CryptoMessageEncrypt(
+    CK_BBOOL type
+) :
+    active(false),
+    message(false),
+    type(type)
+{
+
+}
+
+CK_RV CryptoMessageEncrypt::Init
+(
+    CK_MECHANISM_PTR  pMechanism,
+    Scoped<Object>    key
+)
+{
+    try {
+        if (IsActive()) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+
+        return CKR_FUNCTION_NOT_SUPPORTED;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV CryptoMessageEncrypt::Once
+(
+    CK_VOID_PTR       pParameter,
+    CK_ULONG          ulParameterLen,
+    CK_BYTE_PTR       pAssociatedData,
+    CK_ULONG          ulAssociatedDataLen,
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pOutput,
+    CK_ULONG_PTR      pulOutputLen
+)
+{
+    try {
+        if (!IsActive()) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (message) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+        if (pParameter == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pParameter is NULL");
+        }
+        if (pAssociatedData == NULL_PTR && ulAssociatedDataLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pAssociatedData is NULL");
+        }
+        if (pData == NULL_PTR && ulDataLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pData is NULL");
+        }
+        if (pulOutputLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulOutputLen is NULL");
+        }
+
+        return CKR_FUNCTION_NOT_SUPPORTED;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV CryptoMessageEncrypt::Begin
+(
+    CK_VOID_PTR       pParameter,
+    CK_ULONG          ulParameterLen,
+    CK_BYTE_PTR       pAssociatedData,
+    CK_ULONG          ulAssociatedDataLen
+)
+{
+    try {
+        if (!IsActive()) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (message) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+        if (pParameter == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pParameter is NULL");
+        }
+        if (pAssociatedData == NULL_PTR && ulAssociatedDataLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pAssociatedData is NULL");
+        }
+
+        return CKR_FUNCTION_NOT_SUPPORTED;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV CryptoMessageEncrypt::Next
+(
+    CK_VOID_PTR       pParameter,
+    CK_ULONG          ulParameterLen,
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen,
+    CK_BYTE_PTR       pOutput,
+    CK_ULONG_PTR      pulOutputLen,
+    CK_FLAGS          flags
+)
+{
+    try {
+        if (!(IsActive() && message)) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pParameter == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pParameter is NULL");
+        }
+        if (pPart == NULL_PTR && ulPartLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pPart is NULL");
+        }
+        if (pulOutputLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulOutputLen is NULL");
+        }
+        if (flags & ~CKF_END_OF_MESSAGE) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "Unsupported flags");
+        }
+
+        return CKR_FUNCTION_NOT_SUPPORTED;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV CryptoMessageEncrypt::Final()
+{
+    try {
+        if (!IsActive()) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+
+        active = false;
+        message = false;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION;
+}
+
+bool CryptoMessageEncrypt::IsActive()
+{
+    return active;
+}
+
+// AES-GCM
+
+CryptoGcmMessageEncrypt::CryptoGcmMessageEncrypt(
+    CK_BBOOL type
+) :
+    CryptoMessageEncrypt(type),
+    tagLength(0)
+{
+
+}
+
+CK_RV CryptoGcmMessageEncrypt::Init
+(
+    CK_MECHANISM_PTR  pMechanism,
+    Scoped<Object>    key
+)
+{
+    try {
+        CryptoMessageEncrypt::Init(pMechanism, key);
+
+        if (pMechanism->mechanism != CKM_AES_GCM) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+        if (!(key && key.get())) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "key is NULL");
+        }
+        secretKey = std::dynamic_pointer_cast<SecretKey>(key);
+        if (!secretKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key is not secret key");
+        }
+
+        message = false;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_GCM_MESSAGE_PARAMS_PTR CryptoGcmMessageEncrypt::GetParams(
+    CK_VOID_PTR       pParameter,
+    CK_ULONG          ulParameterLen,
+    bool              generate
+)
+{
+    if (ulParameterLen != sizeof(CK_GCM_MESSAGE_PARAMS)) {
+        THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Wrong size of CK_GCM_MESSAGE_PARAMS");
+    }
+    CK_GCM_MESSAGE_PARAMS_PTR params = static_cast<CK_GCM_MESSAGE_PARAMS_PTR>(pParameter);
+    if (params->pIv == NULL_PTR || !params->ulIvLen) {
+        THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "IV is empty");
+    }
+    if (params->pTag == NULL_PTR) {
+        THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pTag is NULL");
+    }
+    // SP 800-38D allows 128, 120, 112, 104, 96, 64 and 32 bits
+    CK_ULONG tagBits = params->ulTagBits;
+    if (tagBits % 8 || tagBits > 128 || (tagBits < 96 && tagBits != 64 && tagBits != 32)) {
+        THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Wrong tag length");
+    }
+
+    if (type == CRYPTO_ENCRYPT && generate) {
+        switch (params->ivGenerator) {
+        case CKG_NO_GENERATE:
+            break;
+        case CKG_GENERATE:
+        case CKG_GENERATE_COUNTER: {
+            // leading ulIvFixedBits of IV are kept, the rest is random or a big-endian counter
+            if (params->ulIvFixedBits % 8 || params->ulIvFixedBits > params->ulIvLen * 8) {
+                THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Wrong ulIvFixedBits");
+            }
+            CK_ULONG fixedLen = params->ulIvFixedBits / 8;
+            CK_ULONG generatedLen = params->ulIvLen - fixedLen;
+            if (!generatedLen) {
+                THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "IV has no generated bits");
+            }
+            if (params->ivGenerator == CKG_GENERATE) {
+                GcmRandom(params->pIv + fixedLen, generatedLen);
+                break;
+            }
+            uint64_t counter;
+            uint64_t limit = generatedLen < sizeof(uint64_t) ? (uint64_t)1 << (generatedLen * 8) : 0;
+            if (!secretKey->NextInvocation(limit, &counter)) {
+                THROW_PKCS11_EXCEPTION(CKR_KEY_FUNCTION_NOT_PERMITTED, "IV counter of the key is exhausted");
+            }
+            for (CK_ULONG i = 0; i < generatedLen; i++) {
+                params->pIv[params->ulIvLen - 1 - i] = i < sizeof(uint64_t) ? (CK_BYTE)(counter >> (i * 8)) : 0;
+            }
+            break;
+        }
+        default:
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Unsupported IV generator");
+        }
+    }
+
+    return params;
+}
+
+CK_RV CryptoGcmMessageEncrypt::Once
+(
+    CK_VOID_PTR       pParameter,
+    CK_ULONG          ulParameterLen,
+    CK_BYTE_PTR       pAssociatedData,
+    CK_ULONG          ulAssociatedDataLen,
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pOutput,
+    CK_ULONG_PTR      pulOutputLen
+)
+{
+    try {
+        CryptoMessageEncrypt::Once(pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen, pData, ulDataLen, pOutput, pulOutputLen);
+
+        // tag goes to parameters, so output has the same length as input
+        if (pOutput == NULL_PTR) {
+            GetParams(pParameter, ulParameterLen, false);
+            *pulOutputLen = ulDataLen;
+            return CKR_OK;
+        }
+        if (*pulOutputLen < ulDataLen) {
+            *pulOutputLen = ulDataLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        CK_GCM_MESSAGE_PARAMS_PTR params = GetParams(pParameter, ulParameterLen, true);
+        if (!GcmOnce(params->pIv, params->ulIvLen, pAssociatedData, ulAssociatedDataLen, pData, ulDataLen, pOutput, params->pTag, params->ulTagBits >> 3)) {
+            memset(pOutput, 0, ulDataLen);
+            THROW_PKCS11_EXCEPTION(CKR_AEAD_DECRYPT_FAILED, "Tag does not match");
+        }
+        *pulOutputLen = ulDataLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV CryptoGcmMessageEncrypt::Begin
+(
+    CK_VOID_PTR       pParameter,
+    CK_ULONG          ulParameterLen,
+    CK_BYTE_PTR       pAssociatedData,
+    CK_ULONG          ulAssociatedDataLen
+)
+{
+    try {
+        CryptoMessageEncrypt::Begin(pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen);
+
+        CK_GCM_MESSAGE_PARAMS_PTR params = GetParams(pParameter, ulParameterLen, true);
+        tagLength = params->ulTagBits >> 3;
+        GcmBegin(params->pIv, params->ulIvLen, pAssociatedData, ulAssociatedDataLen, tagLength);
+        message = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV CryptoGcmMessageEncrypt::Next
+(
+    CK_VOID_PTR       pParameter,
+    CK_ULONG          ulParameterLen,
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen,
+    CK_BYTE_PTR       pOutput,
+    CK_ULONG_PTR      pulOutputLen,
+    CK_FLAGS          flags
+)
+{
+    try {
+        CryptoMessageEncrypt::Next(pParameter, ulParameterLen, pPart, ulPartLen, pOutput, pulOutputLen, flags);
+
+        CK_GCM_MESSAGE_PARAMS_PTR params = GetParams(pParameter, ulParameterLen, false);
+        if (pOutput == NULL_PTR) {
+            *pulOutputLen = ulPartLen;
+            return CKR_OK;
+        }
+        if (*pulOutputLen < ulPartLen) {
+            *pulOutputLen = ulPartLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        try {
+            if (flags & CKF_END_OF_MESSAGE) {
+                message = false;
+                if (!GcmFinal(pPart, ulPartLen, pOutput, params->pTag, tagLength)) {
+                    memset(pOutput, 0, ulPartLen);
+                    THROW_PKCS11_EXCEPTION(CKR_AEAD_DECRYPT_FAILED, "Tag does not match");
+                }
+            }
+            else {
+                GcmUpdate(pPart, ulPartLen, pOutput);
+            }
+        }
+        catch (...) {
+            // message cannot be continued after a failure
+            message = false;
+            throw;
+        }
+        *pulOutputLen = ulPartLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION;
+}
+
+bool CryptoGcmMessageEncrypt::GcmOnce(
+    CK_BYTE_PTR       pIv,
+    CK_ULONG          ulIvLen,
+    CK_BYTE_PTR       pAssociatedData,
+    CK_ULONG          ulAssociatedDataLen,
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pOutput,
+    CK_BYTE_PTR       pTag,
+    CK_ULONG          ulTagLen
+)
+{
+    GcmBegin(pIv, ulIvLen, pAssociatedData, ulAssociatedDataLen, ulTagLen);
+    return GcmFinal(pData, ulDataLen, pOutput, pTag, ulTagLen);
+}
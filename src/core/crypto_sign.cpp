@@ -54,7 +54,9 @@ CK_RV CryptoSign::Once(
 )
 {
     try {
-        Update(pData, ulDataLen);
+        if (pData) {
+            Update(pData, ulDataLen);
+        }
         return Final(pSignature, ulSignatureLen);
     }
     CATCH_EXCEPTION
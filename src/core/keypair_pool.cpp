@@ -0,0 +1,159 @@
+#include "keypair_pool.h"
+
+#include "crypto/workers.h"
+
+using namespace core;
+
+KeyPairPool::KeyPairPool() :
+    state(new State)
+{
+    state->hits = 0;
+    state->misses = 0;
+    state->stopped = false;
+}
+
+KeyPairPool::~KeyPairPool()
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->stopped = true;
+    for (std::map<std::string, Scoped<Config> >::iterator it = state->configs.begin(); it != state->configs.end(); it++) {
+        it->second->removed = true;
+    }
+    state->configs.clear();
+}
+
+void KeyPairPool::Configure(
+    const std::string&  name,
+    size_t              size,
+    const Generator&    generator
+)
+{
+    try {
+        std::lock_guard<std::mutex> lock(state->mutex);
+
+        std::map<std::string, Scoped<Config> >::iterator it = state->configs.find(name);
+        if (it != state->configs.end()) {
+            if (size) {
+                // Ready items stay, extra ones are dropped
+                it->second->size = size;
+                while (it->second->items.size() > size) {
+                    it->second->items.pop_back();
+                }
+                Refill(state, it->second);
+                return;
+            }
+            it->second->removed = true;
+            state->configs.erase(it);
+            return;
+        }
+        if (!size) {
+            return;
+        }
+
+        Scoped<Config> config(new Config);
+        config->size = size;
+        config->generator = generator;
+        config->pending = 0;
+        config->generation = WorkerPool::GetForkGeneration();
+        config->removed = false;
+        state->configs[name] = config;
+        Refill(state, config);
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<void> KeyPairPool::Take(
+    const std::string&  name
+)
+{
+    try {
+        std::lock_guard<std::mutex> lock(state->mutex);
+
+        std::map<std::string, Scoped<Config> >::iterator it = state->configs.find(name);
+        if (it == state->configs.end()) {
+            return Scoped<void>();
+        }
+
+        Scoped<Config> config = it->second;
+        Scoped<void> item;
+        if (config->items.empty()) {
+            state->misses++;
+        }
+        else {
+            item = config->items.front();
+            config->items.pop_front();
+            state->hits++;
+        }
+        Refill(state, config);
+
+        return item;
+    }
+    CATCH_EXCEPTION
+}
+
+void KeyPairPool::GetInfo(
+    CK_PV_KEY_PAIR_POOL_INFO_PTR pInfo
+)
+{
+    try {
+        if (pInfo == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pInfo is NULL");
+        }
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+
+        pInfo->ulHits = state->hits;
+        pInfo->ulMisses = state->misses;
+        pInfo->ulReadyCount = 0;
+        pInfo->ulPendingCount = 0;
+        for (std::map<std::string, Scoped<Config> >::iterator it = state->configs.begin(); it != state->configs.end(); it++) {
+            pInfo->ulReadyCount += (CK_ULONG)it->second->items.size();
+            pInfo->ulPendingCount += (CK_ULONG)it->second->pending;
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void KeyPairPool::Refill(
+    Scoped<State>       state,
+    Scoped<Config>      config
+)
+{
+    unsigned generation = WorkerPool::GetForkGeneration();
+    if (config->generation != generation) {
+        // Tasks running in the parent are lost in the child and never finish
+        config->pending = 0;
+        config->generation = generation;
+    }
+
+    while (config->items.size() + config->pending < config->size) {
+        config->pending++;
+        WorkerPool::Get().Post([state, config, generation]() {
+            Scoped<void> item;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->stopped || config->removed) {
+                    if (config->generation == generation) {
+                        config->pending--;
+                    }
+                    return;
+                }
+            }
+
+            try {
+                item = config->generator();
+            }
+            catch (...) {
+                // the configuration is checked by Configure, a failure is not repeated
+            }
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (config->generation == generation) {
+                config->pending--;
+            }
+            if (item && !state->stopped && !config->removed && config->items.size() < config->size) {
+                config->items.push_back(item);
+            }
+        });
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "excep.h"
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+
+namespace core {
+
+#define KEY_PAIR_POOL_MAX_SIZE  64
+
+    /**
+     * Key material generated ahead of C_GenerateKeyPair. Each configuration keeps a number of
+     * ready items, a taken item is replaced by a task of WorkerPool, so generation runs on
+     * threads which have no other work. Items are kept in memory only
+     */
+    class KeyPairPool {
+    public:
+        // Generates one item, it's called on a worker thread
+        typedef std::function<Scoped<void>()> Generator;
+
+        KeyPairPool();
+        ~KeyPairPool();
+
+        /**
+         * Sets number of items kept for the configuration, 0 removes the configuration and
+         * its items. Missing items are generated in background
+         */
+        void Configure(
+            const std::string&  name,
+            size_t              size,
+            const Generator&    generator
+        );
+
+        /**
+         * Returns a ready item of the configuration and starts generation of a new one.
+         * Returns an empty pointer if the configuration is not pooled, or if it has no
+         * ready items, the latter is counted as a miss
+         */
+        Scoped<void> Take(
+            const std::string&  name
+        );
+
+        void GetInfo(
+            CK_PV_KEY_PAIR_POOL_INFO_PTR pInfo
+        );
+
+    protected:
+        struct Config {
+            size_t                      size;
+            Generator                   generator;
+            std::deque<Scoped<void> >   items;
+            // Items being generated
+            size_t                      pending;
+            // Fork generation of WorkerPool the pending tasks were posted in
+            unsigned                    generation;
+            // Set when the configuration is replaced or removed, its tasks drop their items
+            bool                        removed;
+        };
+
+        // Shared with tasks, which may outlive the pool
+        struct State {
+            std::mutex                              mutex;
+            std::map<std::string, Scoped<Config> >  configs;
+            CK_ULONG                                hits;
+            CK_ULONG                                misses;
+            bool                                    stopped;
+        };
+
+        Scoped<State>       state;
+
+        /**
+         * Posts tasks until ready and pending items reach the size. The state must be locked
+         */
+        static void Refill(
+            Scoped<State>       state,
+            Scoped<Config>      config
+        );
+    };
+
+}
@@ -1,5 +1,11 @@
 #include "../stdafx.h"
 #include "module.h"
+#include "crypto/sha.h"
+#include "crypto/aes.h"
+#include "crypto/gcm.h"
+#include "crypto/chacha.h"
+#include "crypto/xts.h"
+#include "crypto/bn.h"
 
 using namespace core;
 
@@ -31,6 +37,13 @@ CK_RV Module::Initialize(
     if (this->initialized) {
         return CKR_CRYPTOKI_ALREADY_INITIALIZED;
     }
+    // Select crypto implementations for this CPU
+    Sha::Setup();
+    Aes::Setup();
+    Gcm::Setup();
+    ChaCha20Poly1305::Setup();
+    Xts::Setup();
+    MontContext::Setup();
     this->initialized = true;
     return CKR_OK;
 }
@@ -275,6 +288,34 @@ CK_RV Module::Login
     return session->Login(userType, pPin, ulPinLen);
 }
 
+CK_RV Module::GetOperationState
+(
+    CK_SESSION_HANDLE hSession,             /* session's handle */
+    CK_BYTE_PTR       pOperationState,      /* gets state */
+    CK_ULONG_PTR      pulOperationStateLen  /* gets state length */
+)
+{
+    CHECK_INITIALIZED();
+    GET_SESSION(hSession);
+
+    return session->GetOperationState(pOperationState, pulOperationStateLen);
+}
+
+CK_RV Module::SetOperationState
+(
+    CK_SESSION_HANDLE hSession,            /* session's handle */
+    CK_BYTE_PTR      pOperationState,      /* holds state */
+    CK_ULONG         ulOperationStateLen,  /* holds state length */
+    CK_OBJECT_HANDLE hEncryptionKey,       /* en/decryption key */
+    CK_OBJECT_HANDLE hAuthenticationKey    /* sign/verify key */
+)
+{
+    CHECK_INITIALIZED();
+    GET_SESSION(hSession);
+
+    return session->SetOperationState(pOperationState, ulOperationStateLen, hEncryptionKey, hAuthenticationKey);
+}
+
 CK_RV Module::GetAttributeValue
 (
     CK_SESSION_HANDLE hSession,   /* the session's handle */
@@ -289,6 +330,23 @@ CK_RV Module::GetAttributeValue
     return session->GetAttributeValue(hObject, pTemplate, ulCount);
 }
 
+CK_RV Module::GetAttributeValues
+(
+    CK_SESSION_HANDLE         hSession,       /* the session's handle */
+    CK_OBJECT_HANDLE_PTR      phObjects,      /* the objects' handles */
+    CK_ULONG                  ulObjectCount,  /* # of objects */
+    CK_PV_ATTRIBUTE_TYPE_PTR  pTypes,         /* attribute types shared by objects */
+    CK_ULONG                  ulTypeCount,    /* # of attribute types */
+    CK_BYTE_PTR               pOutput,        /* gets packed values */
+    CK_ULONG_PTR              pulOutputLen    /* gets size of packed values */
+)
+{
+    CHECK_INITIALIZED();
+    GET_SESSION(hSession);
+
+    return session->GetAttributeValues(phObjects, ulObjectCount, pTypes, ulTypeCount, pOutput, pulOutputLen);
+}
+
 CK_RV Module::SetAttributeValue
 (
     CK_SESSION_HANDLE hSession,   /* the session's handle */
@@ -445,6 +503,37 @@ CK_RV Module::DigestFinal
     CATCH_EXCEPTION;
 }
 
+CK_RV Module::DigestBatch
+(
+    CK_SESSION_HANDLE hSession,        /* the session's handle */
+    CK_MECHANISM_PTR  pMechanism,      /* the digesting mechanism */
+    CK_PV_DATA_PTR    pMessages,       /* messages to be digested */
+    CK_ULONG          ulMessageCount,  /* # of messages */
+    CK_BYTE_PTR       pDigests,        /* gets the digests */
+    CK_ULONG_PTR      pulDigestsLen    /* gets size of digests */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+
+        Scoped<Session> session = getSession(hSession);
+
+        if (pMechanism == NULL) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pMechanism is NULL");
+        }
+        session->CheckMechanismType(pMechanism->mechanism, CKF_DIGEST);
+
+        return session->digest->Batch(
+            pMechanism,
+            pMessages,
+            ulMessageCount,
+            pDigests,
+            pulDigestsLen
+        );
+    }
+    CATCH_EXCEPTION;
+}
+
 /* Signing and MACing */
 
 CK_RV Module::SignInit(
@@ -582,6 +671,33 @@ CK_RV Module::VerifyFinal
     CATCH_EXCEPTION
 }
 
+CK_RV Module::VerifyBatch
+(
+    CK_SESSION_HANDLE     hSession,     /* the session's handle */
+    CK_PV_VERIFY_ITEM_PTR pItems,       /* signatures to be verified */
+    CK_ULONG              ulItemCount,  /* # of items */
+    CK_PV_RV_PTR          pResults      /* gets results of items */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+        GET_SESSION(hSession);
+
+        if (pItems == NULL_PTR && ulItemCount) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pItems is NULL");
+        }
+        if (pResults == NULL_PTR && ulItemCount) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pResults is NULL");
+        }
+        if (session->verify->IsActive()) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+
+        return session->VerifyBatch(pItems, ulItemCount, pResults);
+    }
+    CATCH_EXCEPTION
+}
+
 CK_RV Module::EncryptInit
 (
     CK_SESSION_HANDLE hSession,    /* the session's handle */
@@ -741,6 +857,190 @@ CK_RV Module::DecryptFinal
     CATCH_EXCEPTION
 }
 
+/* Message-based encryption and decryption */
+
+CK_RV Module::MessageEncryptInit
+(
+    CK_SESSION_HANDLE hSession,    /* the session's handle */
+    CK_MECHANISM_PTR  pMechanism,  /* the encryption mechanism */
+    CK_OBJECT_HANDLE  hKey         /* handle of encryption key */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+        GET_SESSION(hSession);
+
+        return session->MessageEncryptInit(pMechanism, hKey);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Module::EncryptMessage
+(
+    CK_SESSION_HANDLE hSession,             /* the session's handle */
+    CK_VOID_PTR       pParameter,           /* message specific parameter */
+    CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+    CK_BYTE_PTR       pAssociatedData,      /* AEAD Associated data */
+    CK_ULONG          ulAssociatedDataLen,  /* AEAD Associated data length */
+    CK_BYTE_PTR       pPlaintext,           /* plain text */
+    CK_ULONG          ulPlaintextLen,       /* plain text length */
+    CK_BYTE_PTR       pCiphertext,          /* gets cipher text */
+    CK_ULONG_PTR      pulCiphertextLen      /* gets cipher text length */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+        GET_SESSION(hSession);
+
+        return session->messageEncrypt->Once(pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen, pPlaintext, ulPlaintextLen, pCiphertext, pulCiphertextLen);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Module::EncryptMessageBegin
+(
+    CK_SESSION_HANDLE hSession,            /* the session's handle */
+    CK_VOID_PTR       pParameter,          /* message specific parameter */
+    CK_ULONG          ulParameterLen,      /* length of message specific parameter */
+    CK_BYTE_PTR       pAssociatedData,     /* AEAD Associated data */
+    CK_ULONG          ulAssociatedDataLen  /* AEAD Associated data length */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+        GET_SESSION(hSession);
+
+        return session->messageEncrypt->Begin(pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Module::EncryptMessageNext
+(
+    CK_SESSION_HANDLE hSession,              /* the session's handle */
+    CK_VOID_PTR       pParameter,            /* message specific parameter */
+    CK_ULONG          ulParameterLen,        /* length of message specific parameter */
+    CK_BYTE_PTR       pPlaintextPart,        /* plain text */
+    CK_ULONG          ulPlaintextPartLen,    /* plain text length */
+    CK_BYTE_PTR       pCiphertextPart,       /* gets cipher text */
+    CK_ULONG_PTR      pulCiphertextPartLen,  /* gets cipher text length */
+    CK_FLAGS          flags                  /* multi mode flag */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+        GET_SESSION(hSession);
+
+        return session->messageEncrypt->Next(pParameter, ulParameterLen, pPlaintextPart, ulPlaintextPartLen, pCiphertextPart, pulCiphertextPartLen, flags);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Module::MessageEncryptFinal
+(
+    CK_SESSION_HANDLE hSession  /* the session's handle */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+        GET_SESSION(hSession);
+
+        return session->messageEncrypt->Final();
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Module::MessageDecryptInit
+(
+    CK_SESSION_HANDLE hSession,    /* the session's handle */
+    CK_MECHANISM_PTR  pMechanism,  /* the decryption mechanism */
+    CK_OBJECT_HANDLE  hKey         /* handle of decryption key */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+        GET_SESSION(hSession);
+
+        return session->MessageDecryptInit(pMechanism, hKey);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Module::DecryptMessage
+(
+    CK_SESSION_HANDLE hSession,             /* the session's handle */
+    CK_VOID_PTR       pParameter,           /* message specific parameter */
+    CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+    CK_BYTE_PTR       pAssociatedData,      /* AEAD Associated data */
+    CK_ULONG          ulAssociatedDataLen,  /* AEAD Associated data length */
+    CK_BYTE_PTR       pCiphertext,          /* cipher text */
+    CK_ULONG          ulCiphertextLen,      /* cipher text length */
+    CK_BYTE_PTR       pPlaintext,           /* gets plain text */
+    CK_ULONG_PTR      pulPlaintextLen       /* gets plain text length */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+        GET_SESSION(hSession);
+
+        return session->messageDecrypt->Once(pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen, pCiphertext, ulCiphertextLen, pPlaintext, pulPlaintextLen);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Module::DecryptMessageBegin
+(
+    CK_SESSION_HANDLE hSession,            /* the session's handle */
+    CK_VOID_PTR       pParameter,          /* message specific parameter */
+    CK_ULONG          ulParameterLen,      /* length of message specific parameter */
+    CK_BYTE_PTR       pAssociatedData,     /* AEAD Associated data */
+    CK_ULONG          ulAssociatedDataLen  /* AEAD Associated data length */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+        GET_SESSION(hSession);
+
+        return session->messageDecrypt->Begin(pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Module::DecryptMessageNext
+(
+    CK_SESSION_HANDLE hSession,             /* the session's handle */
+    CK_VOID_PTR       pParameter,           /* message specific parameter */
+    CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+    CK_BYTE_PTR       pCiphertextPart,      /* cipher text */
+    CK_ULONG          ulCiphertextPartLen,  /* cipher text length */
+    CK_BYTE_PTR       pPlaintextPart,       /* gets plain text */
+    CK_ULONG_PTR      pulPlaintextPartLen,  /* gets plain text length */
+    CK_FLAGS          flags                 /* multi mode flag */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+        GET_SESSION(hSession);
+
+        return session->messageDecrypt->Next(pParameter, ulParameterLen, pCiphertextPart, ulCiphertextPartLen, pPlaintextPart, pulPlaintextPartLen, flags);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Module::MessageDecryptFinal
+(
+    CK_SESSION_HANDLE hSession  /* the session's handle */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+        GET_SESSION(hSession);
+
+        return session->messageDecrypt->Final();
+    }
+    CATCH_EXCEPTION
+}
+
 CK_RV Module::GenerateKey
 (
     CK_SESSION_HANDLE    hSession,    /* the session's handle */
@@ -787,6 +1087,41 @@ CK_RV Module::GenerateKeyPair
     );
 }
 
+CK_RV Module::SetKeyPairPool
+(
+    CK_SLOT_ID           slotID,                      /* the slot's ID */
+    CK_MECHANISM_PTR     pMechanism,                  /* key-gen mechanism */
+    CK_ATTRIBUTE_PTR     pPublicKeyTemplate,          /* template for pub. key */
+    CK_ULONG             ulPublicKeyAttributeCount,   /* # pub. attributes */
+    CK_ULONG             ulPoolSize                   /* # key pairs kept ready */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+
+        Scoped<Slot> slot = getSlot(slotID);
+
+        return slot->SetKeyPairPool(pMechanism, pPublicKeyTemplate, ulPublicKeyAttributeCount, ulPoolSize);
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV Module::GetKeyPairPoolInfo
+(
+    CK_SLOT_ID                    slotID,  /* the slot's ID */
+    CK_PV_KEY_PAIR_POOL_INFO_PTR  pInfo    /* receives the pool information */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+
+        Scoped<Slot> slot = getSlot(slotID);
+
+        return slot->GetKeyPairPoolInfo(pInfo);
+    }
+    CATCH_EXCEPTION;
+}
+
 Scoped<Slot> Module::getSlot(
     CK_SLOT_ID slotID
 )
@@ -800,6 +1135,78 @@ Scoped<Slot> Module::getSlot(
     CATCH_EXCEPTION;
 }
 
+CK_RV Module::DigestEncryptUpdate(
+    CK_SESSION_HANDLE hSession,            /* session's handle */
+    CK_BYTE_PTR       pPart,               /* the plaintext data */
+    CK_ULONG          ulPartLen,           /* plaintext length */
+    CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+    CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text length */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+
+        Scoped<Session> session = getSession(hSession);
+
+        return session->DigestEncryptUpdate(pPart, ulPartLen, pEncryptedPart, pulEncryptedPartLen);
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV Module::DecryptDigestUpdate(
+    CK_SESSION_HANDLE hSession,            /* session's handle */
+    CK_BYTE_PTR       pEncryptedPart,      /* ciphertext */
+    CK_ULONG          ulEncryptedPartLen,  /* ciphertext length */
+    CK_BYTE_PTR       pPart,               /* gets plaintext */
+    CK_ULONG_PTR      pulPartLen           /* gets plaintext length */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+
+        Scoped<Session> session = getSession(hSession);
+
+        return session->DecryptDigestUpdate(pEncryptedPart, ulEncryptedPartLen, pPart, pulPartLen);
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV Module::SignEncryptUpdate(
+    CK_SESSION_HANDLE hSession,            /* session's handle */
+    CK_BYTE_PTR       pPart,               /* the plaintext data */
+    CK_ULONG          ulPartLen,           /* plaintext length */
+    CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+    CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text length */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+
+        Scoped<Session> session = getSession(hSession);
+
+        return session->SignEncryptUpdate(pPart, ulPartLen, pEncryptedPart, pulEncryptedPartLen);
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV Module::DecryptVerifyUpdate(
+    CK_SESSION_HANDLE hSession,            /* session's handle */
+    CK_BYTE_PTR       pEncryptedPart,      /* ciphertext */
+    CK_ULONG          ulEncryptedPartLen,  /* ciphertext length */
+    CK_BYTE_PTR       pPart,               /* gets plaintext */
+    CK_ULONG_PTR      pulPartLen           /* gets plaintext length */
+)
+{
+    try {
+        CHECK_INITIALIZED();
+
+        Scoped<Session> session = getSession(hSession);
+
+        return session->DecryptVerifyUpdate(pEncryptedPart, ulEncryptedPartLen, pPart, pulPartLen);
+    }
+    CATCH_EXCEPTION;
+}
+
 CK_RV Module::SeedRandom(
     CK_SESSION_HANDLE hSession,  /* the session's handle */
     CK_BYTE_PTR       pSeed,     /* the seed material */
@@ -953,6 +1360,9 @@ CK_RV Module::DestroyObject(
         Scoped<Object> object = session->GetObject(hObject);
 
         object->Destroy();
+        if (session->store) {
+            session->store->RemoveObject(object);
+        }
         session->objects.remove(object);
 
         return CKR_OK;
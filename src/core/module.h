@@ -93,6 +93,22 @@ namespace core {
             CK_ULONG          ulPinLen   /* the length of the PIN */
         );
 
+        CK_RV GetOperationState
+        (
+            CK_SESSION_HANDLE hSession,             /* session's handle */
+            CK_BYTE_PTR       pOperationState,      /* gets state */
+            CK_ULONG_PTR      pulOperationStateLen  /* gets state length */
+        );
+
+        CK_RV SetOperationState
+        (
+            CK_SESSION_HANDLE hSession,            /* session's handle */
+            CK_BYTE_PTR      pOperationState,      /* holds state */
+            CK_ULONG         ulOperationStateLen,  /* holds state length */
+            CK_OBJECT_HANDLE hEncryptionKey,       /* en/decryption key */
+            CK_OBJECT_HANDLE hAuthenticationKey    /* sign/verify key */
+        );
+
         /* Object management */
 
         CK_RV GetAttributeValue
@@ -103,6 +119,17 @@ namespace core {
             CK_ULONG          ulCount     /* attributes in template */
         );
 
+        CK_RV GetAttributeValues
+        (
+            CK_SESSION_HANDLE         hSession,       /* the session's handle */
+            CK_OBJECT_HANDLE_PTR      phObjects,      /* the objects' handles */
+            CK_ULONG                  ulObjectCount,  /* # of objects */
+            CK_PV_ATTRIBUTE_TYPE_PTR  pTypes,         /* attribute types shared by objects */
+            CK_ULONG                  ulTypeCount,    /* # of attribute types */
+            CK_BYTE_PTR               pOutput,        /* gets packed values */
+            CK_ULONG_PTR              pulOutputLen    /* gets size of packed values */
+        );
+
         CK_RV SetAttributeValue
         (
             CK_SESSION_HANDLE hSession,   /* the session's handle */
@@ -169,6 +196,16 @@ namespace core {
             CK_ULONG_PTR      pulDigestLen  /* gets byte count of digest */
         );
 
+        CK_RV DigestBatch
+        (
+            CK_SESSION_HANDLE hSession,        /* the session's handle */
+            CK_MECHANISM_PTR  pMechanism,      /* the digesting mechanism */
+            CK_PV_DATA_PTR    pMessages,       /* messages to be digested */
+            CK_ULONG          ulMessageCount,  /* # of messages */
+            CK_BYTE_PTR       pDigests,        /* gets the digests */
+            CK_ULONG_PTR      pulDigestsLen    /* gets size of digests */
+        );
+
         /* Signing and MACing */
 
         CK_RV SignInit(
@@ -227,6 +264,14 @@ namespace core {
             CK_ULONG          ulSignatureLen  /* signature length */
         );
 
+        CK_RV VerifyBatch
+        (
+            CK_SESSION_HANDLE     hSession,     /* the session's handle */
+            CK_PV_VERIFY_ITEM_PTR pItems,       /* signatures to be verified */
+            CK_ULONG              ulItemCount,  /* # of items */
+            CK_PV_RV_PTR          pResults      /* gets results of items */
+        );
+
         /* Encryption and decryption */
 
         CK_RV EncryptInit
@@ -293,6 +338,138 @@ namespace core {
             CK_ULONG_PTR      pulLastPartLen  /* p-text size */
         );
 
+        /* Message-based encryption and decryption */
+
+        CK_RV MessageEncryptInit
+        (
+            CK_SESSION_HANDLE hSession,    /* the session's handle */
+            CK_MECHANISM_PTR  pMechanism,  /* the encryption mechanism */
+            CK_OBJECT_HANDLE  hKey         /* handle of encryption key */
+        );
+
+        CK_RV EncryptMessage
+        (
+            CK_SESSION_HANDLE hSession,             /* the session's handle */
+            CK_VOID_PTR       pParameter,           /* message specific parameter */
+            CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+            CK_BYTE_PTR       pAssociatedData,      /* AEAD Associated data */
+            CK_ULONG          ulAssociatedDataLen,  /* AEAD Associated data length */
+            CK_BYTE_PTR       pPlaintext,           /* plain text */
+            CK_ULONG          ulPlaintextLen,       /* plain text length */
+            CK_BYTE_PTR       pCiphertext,          /* gets cipher text */
+            CK_ULONG_PTR      pulCiphertextLen      /* gets cipher text length */
+        );
+
+        CK_RV EncryptMessageBegin
+        (
+            CK_SESSION_HANDLE hSession,            /* the session's handle */
+            CK_VOID_PTR       pParameter,          /* message specific parameter */
+            CK_ULONG          ulParameterLen,      /* length of message specific parameter */
+            CK_BYTE_PTR       pAssociatedData,     /* AEAD Associated data */
+            CK_ULONG          ulAssociatedDataLen  /* AEAD Associated data length */
+        );
+
+        CK_RV EncryptMessageNext
+        (
+            CK_SESSION_HANDLE hSession,              /* the session's handle */
+            CK_VOID_PTR       pParameter,            /* message specific parameter */
+            CK_ULONG          ulParameterLen,        /* length of message specific parameter */
+            CK_BYTE_PTR       pPlaintextPart,        /* plain text */
+            CK_ULONG          ulPlaintextPartLen,    /* plain text length */
+            CK_BYTE_PTR       pCiphertextPart,       /* gets cipher text */
+            CK_ULONG_PTR      pulCiphertextPartLen,  /* gets cipher text length */
+            CK_FLAGS          flags                  /* multi mode flag */
+        );
+
+        CK_RV MessageEncryptFinal
+        (
+            CK_SESSION_HANDLE hSession  /* the session's handle */
+        );
+
+        CK_RV MessageDecryptInit
+        (
+            CK_SESSION_HANDLE hSession,    /* the session's handle */
+            CK_MECHANISM_PTR  pMechanism,  /* the decryption mechanism */
+            CK_OBJECT_HANDLE  hKey         /* handle of decryption key */
+        );
+
+        CK_RV DecryptMessage
+        (
+            CK_SESSION_HANDLE hSession,             /* the session's handle */
+            CK_VOID_PTR       pParameter,           /* message specific parameter */
+            CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+            CK_BYTE_PTR       pAssociatedData,      /* AEAD Associated data */
+            CK_ULONG          ulAssociatedDataLen,  /* AEAD Associated data length */
+            CK_BYTE_PTR       pCiphertext,          /* cipher text */
+            CK_ULONG          ulCiphertextLen,      /* cipher text length */
+            CK_BYTE_PTR       pPlaintext,           /* gets plain text */
+            CK_ULONG_PTR      pulPlaintextLen       /* gets plain text length */
+        );
+
+        CK_RV DecryptMessageBegin
+        (
+            CK_SESSION_HANDLE hSession,            /* the session's handle */
+            CK_VOID_PTR       pParameter,          /* message specific parameter */
+            CK_ULONG          ulParameterLen,      /* length of message specific parameter */
+            CK_BYTE_PTR       pAssociatedData,     /* AEAD Associated data */
+            CK_ULONG          ulAssociatedDataLen  /* AEAD Associated data length */
+        );
+
+        CK_RV DecryptMessageNext
+        (
+            CK_SESSION_HANDLE hSession,             /* the session's handle */
+            CK_VOID_PTR       pParameter,           /* message specific parameter */
+            CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+            CK_BYTE_PTR       pCiphertextPart,      /* cipher text */
+            CK_ULONG          ulCiphertextPartLen,  /* cipher text length */
+            CK_BYTE_PTR       pPlaintextPart,       /* gets plain text */
+            CK_ULONG_PTR      pulPlaintextPartLen,  /* gets plain text length */
+            CK_FLAGS          flags                 /* multi mode flag */
+        );
+
+        CK_RV MessageDecryptFinal
+        (
+            CK_SESSION_HANDLE hSession  /* the session's handle */
+        );
+
+        /* Dual-function cryptographic operations */
+
+        CK_RV DigestEncryptUpdate
+        (
+            CK_SESSION_HANDLE hSession,            /* session's handle */
+            CK_BYTE_PTR       pPart,               /* the plaintext data */
+            CK_ULONG          ulPartLen,           /* plaintext length */
+            CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text length */
+        );
+
+        CK_RV DecryptDigestUpdate
+        (
+            CK_SESSION_HANDLE hSession,            /* session's handle */
+            CK_BYTE_PTR       pEncryptedPart,      /* ciphertext */
+            CK_ULONG          ulEncryptedPartLen,  /* ciphertext length */
+            CK_BYTE_PTR       pPart,               /* gets plaintext */
+            CK_ULONG_PTR      pulPartLen           /* gets plaintext length */
+        );
+
+        CK_RV SignEncryptUpdate
+        (
+            CK_SESSION_HANDLE hSession,            /* session's handle */
+            CK_BYTE_PTR       pPart,               /* the plaintext data */
+            CK_ULONG          ulPartLen,           /* plaintext length */
+            CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text length */
+        );
+
+        CK_RV DecryptVerifyUpdate
+        (
+            CK_SESSION_HANDLE hSession,            /* session's handle */
+            CK_BYTE_PTR       pEncryptedPart,      /* ciphertext */
+            CK_ULONG          ulEncryptedPartLen,  /* ciphertext length */
+            CK_BYTE_PTR       pPart,               /* gets plaintext */
+            CK_ULONG_PTR      pulPartLen           /* gets p-text length */
+        );
+
         /* Random number generation */
 
         /**
@@ -335,6 +512,21 @@ namespace core {
             CK_OBJECT_HANDLE_PTR phPrivateKey                 /* gets private key handle */
         );
 
+        CK_RV SetKeyPairPool
+        (
+            CK_SLOT_ID           slotID,                      /* the slot's ID */
+            CK_MECHANISM_PTR     pMechanism,                  /* key-gen mechanism */
+            CK_ATTRIBUTE_PTR     pPublicKeyTemplate,          /* template for pub. key */
+            CK_ULONG             ulPublicKeyAttributeCount,   /* # pub. attributes */
+            CK_ULONG             ulPoolSize                   /* # key pairs kept ready */
+        );
+
+        CK_RV GetKeyPairPoolInfo
+        (
+            CK_SLOT_ID                    slotID,  /* the slot's ID */
+            CK_PV_KEY_PAIR_POOL_INFO_PTR  pInfo    /* receives the pool information */
+        );
+
         /**
          * C_DeriveKey derives a key from a base key, creating a new key
          * object.
@@ -34,6 +34,7 @@ CK_RV Object::GetValues
                 THROW_PKCS11_ATTRIBUTE_SENSITIVE();
             }
 
+            Provide(pAttribute->type);
             GetValue(pAttribute);
             ItemByType(pAttribute->type)->GetValue(pAttribute->pValue, &pAttribute->ulValueLen);
         }
@@ -43,6 +44,62 @@ CK_RV Object::GetValues
     CATCH_EXCEPTION
 }
 
+void Object::SetProvider(
+    std::vector<CK_ATTRIBUTE_TYPE>  types,      /* attributes filled by provider */
+    AttributeProvider               provider    /* callback */
+)
+{
+    try {
+        std::lock_guard<std::recursive_mutex> lock(providersMutex);
+
+        Scoped<AttributeProvider> item(new AttributeProvider(provider));
+        for (size_t i = 0; i < types.size(); i++) {
+            providers[types[i]] = item;
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void Object::Provide(
+    CK_ATTRIBUTE_TYPE   type
+)
+{
+    try {
+        std::lock_guard<std::recursive_mutex> lock(providersMutex);
+
+        std::map<CK_ATTRIBUTE_TYPE, Scoped<AttributeProvider> >::iterator it = providers.find(type);
+        if (it == providers.end()) {
+            return;
+        }
+
+        Scoped<AttributeProvider> provider = it->second;
+        (*provider)();
+
+        // Values are cached, remove provider from all its attributes
+        for (it = providers.begin(); it != providers.end();) {
+            if (it->second == provider) {
+                it = providers.erase(it);
+            }
+            else {
+                it++;
+            }
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void Object::ProvideValues()
+{
+    try {
+        std::lock_guard<std::recursive_mutex> lock(providersMutex);
+
+        while (!providers.empty()) {
+            Provide(providers.begin()->first);
+        }
+    }
+    CATCH_EXCEPTION
+}
+
 CK_RV Object::GetValue
 (
     CK_ATTRIBUTE_PTR  attr
@@ -69,6 +126,8 @@ CK_RV Object::SetValues
             if (!(attribute->flags & PVF_8)) {
                 THROW_PKCS11_ATTRIBUTE_READ_ONLY();
             }
+            // Provider must not overwrite new value later
+            Provide(pAttribute->type);
             SetValue(pAttribute);
         }
 
@@ -263,10 +322,12 @@ CK_RV Object::CopyValues
             }
             CopyValue(pAttribute);
         }
-        // Copy data from incoming object to current
+        // Fill pending values of incoming object
+        object->ProvideValues();
+        // Share data of incoming object with current
         for (CK_ULONG i = 0; i < object->Size(); i++) {
             Scoped<Attribute> attr = object->ItemByIndex(i);
-            ItemByType(attr->type)->SetValue(attr->Get(), attr->Size());
+            ItemByType(attr->type)->Assign(attr);
         }
         // Set data
         for (size_t i = 0; i < ulCount; i++) {
@@ -5,8 +5,17 @@
 #include "template.h"
 #include "attribute.h"
 
+#include <functional>
+#include <map>
+#include <mutex>
+
 namespace core {
 
+    /**
+     * Callback which fills values of one or more attributes of the object
+     */
+    typedef std::function<void()> AttributeProvider;
+
     class Object : public Attributes
     {
     public:
@@ -52,6 +61,33 @@ namespace core {
         virtual CK_RV Destroy();
 
     protected:
+        // pending providers indexed by attribute type, a provider shared by a few
+        // attributes is removed for all of them after the first successful call
+        std::map<CK_ATTRIBUTE_TYPE, Scoped<AttributeProvider> > providers;
+        std::recursive_mutex                                    providersMutex;
+
+        /**
+         * Sets provider which computes values of the given attributes on first use.
+         * Allows to postpone expensive calls (key export, parsing, etc) until
+         * the attributes are requested
+         */
+        void SetProvider(
+            std::vector<CK_ATTRIBUTE_TYPE>  types,      /* attributes filled by provider */
+            AttributeProvider               provider    /* callback */
+        );
+
+        /**
+         * Calls pending provider of the attribute
+         */
+        void Provide(
+            CK_ATTRIBUTE_TYPE   type
+        );
+
+        /**
+         * Calls all pending providers
+         */
+        void ProvideValues();
+
         virtual CK_RV CreateValue
         (
             CK_ATTRIBUTE_PTR  attr
@@ -0,0 +1,13 @@
+#include "aes_xts_key.h"
+
+using namespace core;
+
+AesXtsKey::AesXtsKey() :
+    SecretKey()
+{
+    ItemByType(CKA_KEY_TYPE)->To<AttributeNumber>()->Set(CKK_AES_XTS);
+    ItemByType(CKA_KEY_GEN_MECHANISM)->To<AttributeNumber>()->Set(CKM_AES_XTS_KEY_GEN);
+
+    Add(AttributeBytes::New(CKA_VALUE, NULL, 0, PVF_1 | PVF_4 | PVF_6 | PVF_7));
+    Add(AttributeNumber::New(CKA_VALUE_LEN, 0, PVF_2 | PVF_3 | PVF_6));
+}
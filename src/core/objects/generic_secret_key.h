@@ -0,0 +1,14 @@
+#pragma once
+
+#include "secret_key.h"
+
+namespace core {
+
+	class GenericSecretKey : public SecretKey {
+
+	public:
+		GenericSecretKey();
+
+	};
+
+}
@@ -1,9 +1,19 @@
 #include "secret_key.h"
+#include "../crypto/sha.h"
+
+#include <map>
+#include <mutex>
 
 using namespace core;
 
+typedef std::map<Buffer, std::weak_ptr<std::atomic<uint64_t> > > INVOCATION_TABLE;
+
+static INVOCATION_TABLE invocationTable;
+static std::mutex       invocationMutex;
+
 SecretKey::SecretKey() :
-    Key()
+    Key(),
+    invocations(new std::atomic<uint64_t>(0))
 {
 
     ItemByType(CKA_CLASS)->To<AttributeNumber>()->Set(CKO_SECRET_KEY);
@@ -23,4 +33,78 @@ SecretKey::SecretKey() :
     Add(AttributeBool::New(CKA_TRUSTED, false, PVF_10));
     Add(AttributeBytes::New(CKA_WRAP_TEMPLATE, NULL, 0, 0));
     Add(AttributeBytes::New(CKA_UNWRAP_TEMPLATE, NULL, 0, 0));
-}
\ No newline at end of file
+}
+
+CK_RV SecretKey::CopyValues(
+    Scoped<Object>    object,     /* the object which must be copied */
+    CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+    CK_ULONG          ulCount     /* attributes in template */
+)
+{
+    try {
+        Key::CopyValues(object, pTemplate, ulCount);
+
+        SecretKey* secretKey = dynamic_cast<SecretKey*>(object.get());
+        if (secretKey) {
+            std::lock_guard<std::mutex> lock(invocationMutex);
+            invocations = secretKey->invocations;
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+bool SecretKey::NextInvocation(
+    uint64_t          limit,
+    uint64_t*         pulValue
+)
+{
+    uint64_t value = invocations->load();
+    do {
+        if ((limit && value >= limit) || value == UINT64_MAX) {
+            return false;
+        }
+    } while (!invocations->compare_exchange_weak(value, value + 1));
+
+    *pulValue = value;
+    return true;
+}
+
+void SecretKey::ShareInvocations(
+    const CK_BYTE*    pbValue,
+    CK_ULONG          ulValueLen
+)
+{
+    try {
+        Scoped<Buffer> digest = Sha::Digest(CKM_SHA256, (CK_BYTE_PTR)pbValue, ulValueLen);
+
+        std::lock_guard<std::mutex> lock(invocationMutex);
+
+        // drops counters of destroyed keys
+        for (INVOCATION_TABLE::iterator it = invocationTable.begin(); it != invocationTable.end();) {
+            if (it->second.expired()) {
+                it = invocationTable.erase(it);
+            }
+            else {
+                it++;
+            }
+        }
+
+        Scoped<std::atomic<uint64_t> > shared = invocationTable[*digest].lock();
+        if (!shared) {
+            invocationTable[*digest] = invocations;
+            return;
+        }
+        if (shared == invocations) {
+            return;
+        }
+        // the shared counter must not go back for values this key has already used
+        uint64_t used = invocations->load();
+        uint64_t value = shared->load();
+        while (value < used && !shared->compare_exchange_weak(value, used)) {
+        }
+        invocations = shared;
+    }
+    CATCH_EXCEPTION
+}
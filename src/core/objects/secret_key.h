@@ -3,12 +3,48 @@
 #include "../../stdafx.h"
 #include "key.h"
 
+#include <atomic>
+
 namespace core {
 
 	class SecretKey : public Key {
 
 	public:
         SecretKey();
+
+        /**
+         * Shares the invocation counter with the copied key, so the copy can't
+         * repeat IVs generated by the original
+         */
+        CK_RV CopyValues(
+            Scoped<Object>    object,     /* the object which must be copied */
+            CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+            CK_ULONG          ulCount     /* attributes in template */
+        );
+
+        /**
+         * Returns the next value of the invocation counter of the key in pulValue.
+         * Returns false and keeps the counter if the value would reach limit. Zero
+         * limit means the whole 64-bit range. The counter is never reset, it is
+         * shared by all sessions and operations which use the key
+         */
+        bool NextInvocation(
+            uint64_t          limit,
+            uint64_t*         pulValue
+        );
+
+        /**
+         * Switches the key to the invocation counter of all keys with the same value,
+         * so separately created objects of one key don't repeat counter IVs either.
+         * The table keeps SHA-256 of the value while such keys exist
+         */
+        void ShareInvocations(
+            const CK_BYTE*    pbValue,
+            CK_ULONG          ulValueLen
+        );
+
+    protected:
+        Scoped<std::atomic<uint64_t> >  invocations;
 	};
 
 }
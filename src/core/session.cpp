@@ -53,6 +53,9 @@ Session::Session()
     this->find.pTemplate = NULL;
     this->find.ulTemplateSize = 0;
     this->find.index = 0;
+
+    this->messageEncrypt = Scoped<CryptoMessageEncrypt>(new CryptoMessageEncrypt(CRYPTO_ENCRYPT));
+    this->messageDecrypt = Scoped<CryptoMessageEncrypt>(new CryptoMessageEncrypt(CRYPTO_DECRYPT));
 }
 
 Session::~Session()
@@ -140,6 +143,89 @@ CK_RV core::Session::Login
     return CKR_FUNCTION_NOT_SUPPORTED;
 }
 
+CK_RV Session::GetOperationState
+(
+    CK_BYTE_PTR       pOperationState,      /* gets state */
+    CK_ULONG_PTR      pulOperationStateLen  /* gets state length */
+)
+{
+    try {
+        CHECK_ARGUMENT_NULL(pulOperationStateLen);
+
+        // Only digesting can be saved
+        if (sign->IsActive() || verify->IsActive() || encrypt->IsActive() || decrypt->IsActive() ||
+            messageEncrypt->IsActive() || messageDecrypt->IsActive()) {
+            THROW_PKCS11_EXCEPTION(CKR_STATE_UNSAVEABLE, "Only digest operation can be saved");
+        }
+        if (!digest->IsActive()) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+
+        CK_ULONG ulDigestStateLen = 0;
+        CK_RV rv = digest->GetState(NULL_PTR, &ulDigestStateLen);
+        if (rv != CKR_OK) {
+            return rv;
+        }
+        CK_ULONG ulStateLen = sizeof(OPERATION_STATE) + ulDigestStateLen;
+
+        if (pOperationState == NULL_PTR) {
+            *pulOperationStateLen = ulStateLen;
+            return CKR_OK;
+        }
+        if (*pulOperationStateLen < ulStateLen) {
+            *pulOperationStateLen = ulStateLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        OPERATION_STATE header;
+        header.magic = OPERATION_STATE_MAGIC;
+        header.slotID = SlotID;
+        header.operations = CKF_DIGEST;
+        memcpy(pOperationState, &header, sizeof(header));
+
+        rv = digest->GetState(pOperationState + sizeof(header), &ulDigestStateLen);
+        if (rv != CKR_OK) {
+            return rv;
+        }
+        *pulOperationStateLen = ulStateLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Session::SetOperationState
+(
+    CK_BYTE_PTR      pOperationState,      /* holds state */
+    CK_ULONG         ulOperationStateLen,  /* holds state length */
+    CK_OBJECT_HANDLE hEncryptionKey,       /* en/decryption key */
+    CK_OBJECT_HANDLE hAuthenticationKey    /* sign/verify key */
+)
+{
+    try {
+        CHECK_ARGUMENT_NULL(pOperationState);
+
+        OPERATION_STATE header;
+        if (ulOperationStateLen < sizeof(header)) {
+            THROW_PKCS11_EXCEPTION(CKR_SAVED_STATE_INVALID, "Operation state is too short");
+        }
+        memcpy(&header, pOperationState, sizeof(header));
+        if (header.magic != OPERATION_STATE_MAGIC || header.operations != CKF_DIGEST) {
+            THROW_PKCS11_EXCEPTION(CKR_SAVED_STATE_INVALID, "Unknown operation state");
+        }
+        if (header.slotID != SlotID) {
+            THROW_PKCS11_EXCEPTION(CKR_SAVED_STATE_INVALID, "Operation state belongs to another slot");
+        }
+        // Digest doesn't need keys
+        if (hEncryptionKey || hAuthenticationKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_NOT_NEEDED, "Digest state doesn't need keys");
+        }
+
+        return digest->SetState(pOperationState + sizeof(header), ulOperationStateLen - sizeof(header));
+    }
+    CATCH_EXCEPTION
+}
+
 CK_RV Session::GetAttributeValue
 (
     CK_OBJECT_HANDLE  hObject,    /* the object's handle */
@@ -187,6 +273,101 @@ CK_RV Session::SetAttributeValue
     CATCH_EXCEPTION
 }
 
+#define PACKED_ALIGN(size) (((size) + sizeof(CK_ULONG) - 1) & ~(sizeof(CK_ULONG) - 1))
+
+CK_RV Session::GetAttributeValues
+(
+    CK_OBJECT_HANDLE_PTR      phObjects,      /* the objects' handles */
+    CK_ULONG                  ulObjectCount,  /* # of objects */
+    CK_PV_ATTRIBUTE_TYPE_PTR  pTypes,         /* attribute types shared by objects */
+    CK_ULONG                  ulTypeCount,    /* # of attribute types */
+    CK_BYTE_PTR               pOutput,        /* gets packed values */
+    CK_ULONG_PTR              pulOutputLen    /* gets size of packed values */
+)
+{
+    try {
+        if (phObjects == NULL_PTR && ulObjectCount) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "phObjects is NULL");
+        }
+        if (pTypes == NULL_PTR && ulTypeCount) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pTypes is NULL");
+        }
+        if (pulOutputLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulOutputLen is NULL");
+        }
+
+        // values are written while they fit, the size is computed for all objects
+        CK_ULONG ulOutputLen = pOutput ? *pulOutputLen : 0;
+        CK_ULONG offset = 0;
+        for (CK_ULONG i = 0; i < ulObjectCount; i++) {
+            CK_ULONG recordOffset = offset;
+            offset += sizeof(CK_PV_OBJECT_VALUES);
+
+            Scoped<Object> object;
+            CK_RV rv = CKR_OK;
+            try {
+                object = GetObject(phObjects[i]);
+            }
+            catch (Scoped<Exception> e) {
+                rv = CKR_OBJECT_HANDLE_INVALID;
+            }
+
+            for (CK_ULONG j = 0; j < ulTypeCount; j++) {
+                CK_ULONG itemOffset = offset;
+                offset += sizeof(CK_PV_ATTRIBUTE_VALUE);
+
+                CK_ATTRIBUTE attr = { pTypes[j], NULL_PTR, 0 };
+                CK_ULONG ulValueLen = CK_UNAVAILABLE_INFORMATION;
+                if (object && !object->HasAttribute(pTypes[j])) {
+                    if (rv == CKR_OK) {
+                        rv = CKR_ATTRIBUTE_TYPE_INVALID;
+                    }
+                }
+                else if (object) {
+                    try {
+                        object->GetValues(&attr, 1);
+                        ulValueLen = attr.ulValueLen;
+                        if (offset + ulValueLen <= ulOutputLen) {
+                            attr.pValue = pOutput + offset;
+                            object->GetValues(&attr, 1);
+                        }
+                        offset += PACKED_ALIGN(ulValueLen);
+                    }
+                    catch (Scoped<Exception> e) {
+                        Pkcs11Exception* exception = dynamic_cast<Pkcs11Exception*>(e.get());
+                        if (rv == CKR_OK) {
+                            rv = exception && !strcmp(exception->name.c_str(), PKCS11_EXCEPTION_NAME)
+                                ? exception->code
+                                : CKR_FUNCTION_FAILED;
+                        }
+                    }
+                }
+
+                if (offset <= ulOutputLen) {
+                    CK_PV_ATTRIBUTE_VALUE_PTR item = (CK_PV_ATTRIBUTE_VALUE_PTR)(pOutput + itemOffset);
+                    item->type = pTypes[j];
+                    item->ulValueLen = ulValueLen;
+                }
+            }
+
+            if (offset <= ulOutputLen) {
+                CK_PV_OBJECT_VALUES_PTR record = (CK_PV_OBJECT_VALUES_PTR)(pOutput + recordOffset);
+                record->hObject = phObjects[i];
+                record->rv = rv;
+                record->ulRecordLen = offset - recordOffset;
+            }
+        }
+
+        *pulOutputLen = offset;
+        if (pOutput && offset > ulOutputLen) {
+            return CKR_BUFFER_TOO_SMALL;
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
 Scoped<Object> GetObject(CK_OBJECT_HANDLE hObject) {
     THROW_PKCS11_EXCEPTION(CKR_GENERAL_ERROR, "Function is not implemented");
 }
@@ -210,6 +391,22 @@ CK_RV Session::FindObjectsInit
     this->find.ulTemplateSize = ulCount;
     this->find.index = 0;
 
+    // capture objects, changes of the store don't affect the active search
+    this->find.objects.clear();
+    for (size_t i = 0; i < objects.count(); i++) {
+        this->find.objects.push_back(objects.items(i));
+    }
+    if (store) {
+        try {
+            store->Refresh();
+        }
+        catch (...) {
+            // search by objects which were loaded before
+        }
+        std::vector<Scoped<Object> > tokenObjects = store->GetObjects();
+        this->find.objects.insert(this->find.objects.end(), tokenObjects.begin(), tokenObjects.end());
+    }
+
     return CKR_OK;
 }
 
@@ -233,8 +430,8 @@ CK_RV Session::FindObjects
 
         *pulObjectCount = 0;
         CK_RV res;
-        while (this->find.index < objects.count() && *pulObjectCount < ulMaxObjectCount) {
-            Scoped<Object> obj = this->objects.items(this->find.index++);
+        while (this->find.index < this->find.objects.size() && *pulObjectCount < ulMaxObjectCount) {
+            Scoped<Object> obj = this->find.objects.at(this->find.index++);
             size_t i;
             for (i = 0; i < this->find.ulTemplateSize; i++) {
                 CK_ATTRIBUTE_PTR findAttr = &this->find.pTemplate[i];
@@ -289,6 +486,7 @@ CK_RV Session::FindObjectsFinal()
     this->find.ulTemplateSize = 0;
     this->find.active = false;
     this->find.index = 0;
+    this->find.objects.clear();
 
     return CKR_OK;
 }
@@ -351,6 +549,50 @@ CK_RV Session::VerifyInit(
     CATCH_EXCEPTION
 }
 
+CK_RV Session::GetExceptionCode(Scoped<Exception> e)
+{
+    Pkcs11Exception* exception = dynamic_cast<Pkcs11Exception*>(e.get());
+    return exception && !strcmp(exception->name.c_str(), PKCS11_EXCEPTION_NAME)
+        ? exception->code
+        : CKR_FUNCTION_FAILED;
+}
+
+CK_RV Session::VerifyBatch(
+    CK_PV_VERIFY_ITEM_PTR pItems,       /* signatures to be verified */
+    CK_ULONG              ulItemCount,  /* # of items */
+    CK_PV_RV_PTR          pResults      /* gets results of items */
+)
+{
+    try {
+        for (CK_ULONG i = 0; i < ulItemCount; i++) {
+            CK_PV_VERIFY_ITEM& item = pItems[i];
+            // Empty data may come with NULL pointer
+            if ((item.pData == NULL_PTR && item.ulDataLen) || item.pSignature == NULL_PTR) {
+                pResults[i] = CKR_ARGUMENTS_BAD;
+                continue;
+            }
+            CK_RV rv;
+            try {
+                rv = VerifyInit(item.pMechanism, item.hKey);
+                if (rv == CKR_OK) {
+                    rv = verify->Once(item.pData, item.ulDataLen, item.pSignature, item.ulSignatureLen);
+                }
+            }
+            catch (Scoped<Exception> e) {
+                rv = GetExceptionCode(e);
+            }
+            // The operation of a failed item must not block the next one
+            if (verify->IsActive()) {
+                verify = Scoped<CryptoSign>(new CryptoSign(CRYPTO_VERIFY));
+            }
+            pResults[i] = rv;
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
 CK_RV Session::SignInit(
     CK_MECHANISM_PTR  pMechanism,  /* the signature mechanism */
     CK_OBJECT_HANDLE  hKey         /* handle of signature key */
@@ -412,6 +654,168 @@ CK_RV Session::DecryptInit
     CATCH_EXCEPTION
 }
 
+/* Message-based encryption and decryption */
+
+CK_RV Session::MessageEncryptInit
+(
+    CK_MECHANISM_PTR  pMechanism,  /* the encryption mechanism */
+    CK_OBJECT_HANDLE  hKey         /* handle of encryption key */
+)
+{
+    try {
+        if (pMechanism == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_INVALID, "pMechanism is NULL");
+        }
+        CheckMechanismType(pMechanism->mechanism, CKF_MESSAGE_ENCRYPT);
+        if (hKey == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "hKey is NULL");
+        }
+        if (messageEncrypt->IsActive()) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+
+        return CKR_FUNCTION_NOT_SUPPORTED;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Session::MessageDecryptInit
+(
+    CK_MECHANISM_PTR  pMechanism,  /* the decryption mechanism */
+    CK_OBJECT_HANDLE  hKey         /* handle of decryption key */
+)
+{
+    try {
+        if (pMechanism == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_INVALID, "pMechanism is NULL");
+        }
+        CheckMechanismType(pMechanism->mechanism, CKF_MESSAGE_DECRYPT);
+        if (hKey == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "hKey is NULL");
+        }
+        if (messageDecrypt->IsActive()) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+
+        return CKR_FUNCTION_NOT_SUPPORTED;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Session::DualUpdate
+(
+    Scoped<CryptoEncrypt> cipher,
+    Scoped<CryptoDigest>  digest,
+    Scoped<CryptoSign>    mac,
+    CK_BYTE_PTR           pInput,
+    CK_ULONG              ulInputLen,
+    CK_BYTE_PTR           pOutput,
+    CK_ULONG_PTR          pulOutputLen
+)
+{
+    try {
+        if (pInput == NULL_PTR && ulInputLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pInput is NULL");
+        }
+        CHECK_ARGUMENT_NULL(pulOutputLen);
+        if (!cipher->IsActive() || (digest && !digest->IsActive()) || (mac && !mac->IsActive())) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+
+        // Output length of the whole input. Neither operation is touched until the
+        // buffer is known to be large enough, so the call can be repeated
+        CK_ULONG ulRequiredLen = cipher->GetUpdateLength(ulInputLen);
+        if (pOutput == NULL_PTR) {
+            *pulOutputLen = ulRequiredLen;
+            return CKR_OK;
+        }
+        if (*pulOutputLen < ulRequiredLen) {
+            *pulOutputLen = ulRequiredLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        bool encrypting = cipher == encrypt;
+        CK_ULONG ulOutputLen = 0;
+        for (CK_ULONG offset = 0; offset < ulInputLen; offset += DUAL_BLOCK_SIZE) {
+            CK_BYTE_PTR pBlock = pInput + offset;
+            CK_ULONG ulBlockLen = ulInputLen - offset;
+            if (ulBlockLen > DUAL_BLOCK_SIZE) {
+                ulBlockLen = DUAL_BLOCK_SIZE;
+            }
+
+            CK_BYTE_PTR pBlockOutput = pOutput + ulOutputLen;
+            CK_ULONG ulBlockOutputLen = *pulOutputLen - ulOutputLen;
+            CK_RV rv = cipher->Update(pBlock, ulBlockLen, pBlockOutput, &ulBlockOutputLen);
+            if (rv != CKR_OK) {
+                return rv;
+            }
+            ulOutputLen += ulBlockOutputLen;
+
+            // MAC reads plaintext while it is in cache
+            if (!encrypting) {
+                pBlock = pBlockOutput;
+                ulBlockLen = ulBlockOutputLen;
+            }
+            if (!ulBlockLen) {
+                continue;
+            }
+            rv = digest ? digest->Update(pBlock, ulBlockLen) : mac->Update(pBlock, ulBlockLen);
+            if (rv != CKR_OK) {
+                return rv;
+            }
+        }
+
+        *pulOutputLen = ulOutputLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV Session::DigestEncryptUpdate
+(
+    CK_BYTE_PTR       pPart,               /* the plaintext data */
+    CK_ULONG          ulPartLen,           /* plaintext length */
+    CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+    CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text length */
+)
+{
+    return DualUpdate(encrypt, digest, NULL, pPart, ulPartLen, pEncryptedPart, pulEncryptedPartLen);
+}
+
+CK_RV Session::DecryptDigestUpdate
+(
+    CK_BYTE_PTR       pEncryptedPart,      /* ciphertext */
+    CK_ULONG          ulEncryptedPartLen,  /* ciphertext length */
+    CK_BYTE_PTR       pPart,               /* gets plaintext */
+    CK_ULONG_PTR      pulPartLen           /* gets plaintext length */
+)
+{
+    return DualUpdate(decrypt, digest, NULL, pEncryptedPart, ulEncryptedPartLen, pPart, pulPartLen);
+}
+
+CK_RV Session::SignEncryptUpdate
+(
+    CK_BYTE_PTR       pPart,               /* the plaintext data */
+    CK_ULONG          ulPartLen,           /* plaintext length */
+    CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+    CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text length */
+)
+{
+    return DualUpdate(encrypt, NULL, sign, pPart, ulPartLen, pEncryptedPart, pulEncryptedPartLen);
+}
+
+CK_RV Session::DecryptVerifyUpdate
+(
+    CK_BYTE_PTR       pEncryptedPart,      /* ciphertext */
+    CK_ULONG          ulEncryptedPartLen,  /* ciphertext length */
+    CK_BYTE_PTR       pPart,               /* gets plaintext */
+    CK_ULONG_PTR      pulPartLen           /* gets p-text length */
+)
+{
+    return DualUpdate(decrypt, NULL, verify, pEncryptedPart, ulEncryptedPartLen, pPart, pulPartLen);
+}
+
 CK_RV Session::GenerateKey
 (
     CK_MECHANISM_PTR     pMechanism,  /* key generation mech. */
@@ -482,6 +886,12 @@ Scoped<Object> Session::GetObject(
                 return object;
             }
         }
+        if (store) {
+            Scoped<Object> object = store->GetObject(hObject);
+            if (object) {
+                return object;
+            }
+        }
         THROW_PKCS11_EXCEPTION(CKR_OBJECT_HANDLE_INVALID, "Cannot get Object by Handle");
     }
     CATCH_EXCEPTION
@@ -1,6 +1,8 @@
 #pragma once
 #include "../pkcs11.h"
 #include "object.h"
+#include "store.h"
+#include "keypair_pool.h"
 #include "crypto.h"
 #include "collection.h"
 
@@ -16,8 +18,26 @@ namespace core {
         CK_ATTRIBUTE_PTR pTemplate;
         CK_ULONG ulTemplateSize;
         CK_ULONG index;
+        // session and token objects captured by C_FindObjectsInit
+        std::vector<Scoped<Object> > objects;
     } OBJECT_FIND;
 
+#define OPERATION_STATE_MAGIC 0x50565354  /* PVST */
+
+    /**
+     * Header of the state returned by C_GetOperationState, state of the digest follows it
+     */
+    typedef struct OPERATION_STATE
+    {
+        CK_ULONG   magic;
+        CK_SLOT_ID slotID;       // state can be restored into sessions of this slot only
+        CK_FLAGS   operations;   // CKF_DIGEST
+    } OPERATION_STATE;
+
+    // Dual-function operations pass data through both operations in blocks of this size,
+    // so the second operation reads the block from cache
+#define DUAL_BLOCK_SIZE 0x4000
+
     class Session
     {
     public:
@@ -38,8 +58,14 @@ namespace core {
         Scoped<CryptoSign>    verify;
         Scoped<CryptoEncrypt> encrypt;
         Scoped<CryptoEncrypt> decrypt;
+        Scoped<CryptoMessageEncrypt> messageEncrypt;
+        Scoped<CryptoMessageEncrypt> messageDecrypt;
 
         Collection<Scoped<Object> > objects;
+        // token objects of the slot, can be empty
+        Scoped<Store>         store;
+        // key pairs generated ahead by the slot, can be empty
+        Scoped<KeyPairPool>   keyPairPool;
 
         // find
         OBJECT_FIND           find;
@@ -75,6 +101,20 @@ namespace core {
             CK_ULONG          ulPinLen   /* the length of the PIN */
         );
 
+        CK_RV GetOperationState
+        (
+            CK_BYTE_PTR       pOperationState,      /* gets state */
+            CK_ULONG_PTR      pulOperationStateLen  /* gets state length */
+        );
+
+        CK_RV SetOperationState
+        (
+            CK_BYTE_PTR      pOperationState,      /* holds state */
+            CK_ULONG         ulOperationStateLen,  /* holds state length */
+            CK_OBJECT_HANDLE hEncryptionKey,       /* en/decryption key */
+            CK_OBJECT_HANDLE hAuthenticationKey    /* sign/verify key */
+        );
+
         /* Object management */
 
         virtual CK_RV GetAttributeValue
@@ -91,6 +131,19 @@ namespace core {
             CK_ULONG          ulCount     /* attributes in template */
         );
 
+        /**
+         * Vendor defined. Fills packed values of the same attributes for many objects
+         */
+        CK_RV GetAttributeValues
+        (
+            CK_OBJECT_HANDLE_PTR      phObjects,      /* the objects' handles */
+            CK_ULONG                  ulObjectCount,  /* # of objects */
+            CK_PV_ATTRIBUTE_TYPE_PTR  pTypes,         /* attribute types shared by objects */
+            CK_ULONG                  ulTypeCount,    /* # of attribute types */
+            CK_BYTE_PTR               pOutput,        /* gets packed values */
+            CK_ULONG_PTR              pulOutputLen    /* gets size of packed values */
+        );
+
         virtual CK_RV FindObjectsInit
         (
             CK_ATTRIBUTE_PTR  pTemplate,  /* attribute values to match */
@@ -134,6 +187,16 @@ namespace core {
             CK_OBJECT_HANDLE  hKey         /* verification key */
         );
 
+        /**
+         * Verifies items one by one by VerifyInit and the verify object, pResults gets
+         * result of each item
+         */
+        virtual CK_RV VerifyBatch(
+            CK_PV_VERIFY_ITEM_PTR pItems,       /* signatures to be verified */
+            CK_ULONG              ulItemCount,  /* # of items */
+            CK_PV_RV_PTR          pResults      /* gets results of items */
+        );
+
         // Message signing
 
         /**
@@ -161,6 +224,60 @@ namespace core {
             CK_OBJECT_HANDLE  hKey         /* handle of decryption key */
         );
 
+        /* Message-based encryption and decryption */
+
+        /**
+         * Initializes message encryption object
+         * - check pMechanism is NULLs
+         * - check type for pMechanism->mechanism (CKF_MESSAGE_ENCRYPT)
+         * - check hKey is NULL
+         */
+        virtual CK_RV MessageEncryptInit
+        (
+            CK_MECHANISM_PTR  pMechanism,  /* the encryption mechanism */
+            CK_OBJECT_HANDLE  hKey         /* handle of encryption key */
+        );
+
+        virtual CK_RV MessageDecryptInit
+        (
+            CK_MECHANISM_PTR  pMechanism,  /* the decryption mechanism */
+            CK_OBJECT_HANDLE  hKey         /* handle of decryption key */
+        );
+
+        /* Dual-function cryptographic operations */
+
+        CK_RV DigestEncryptUpdate
+        (
+            CK_BYTE_PTR       pPart,               /* the plaintext data */
+            CK_ULONG          ulPartLen,           /* plaintext length */
+            CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text length */
+        );
+
+        CK_RV DecryptDigestUpdate
+        (
+            CK_BYTE_PTR       pEncryptedPart,      /* ciphertext */
+            CK_ULONG          ulEncryptedPartLen,  /* ciphertext length */
+            CK_BYTE_PTR       pPart,               /* gets plaintext */
+            CK_ULONG_PTR      pulPartLen           /* gets plaintext length */
+        );
+
+        CK_RV SignEncryptUpdate
+        (
+            CK_BYTE_PTR       pPart,               /* the plaintext data */
+            CK_ULONG          ulPartLen,           /* plaintext length */
+            CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text length */
+        );
+
+        CK_RV DecryptVerifyUpdate
+        (
+            CK_BYTE_PTR       pEncryptedPart,      /* ciphertext */
+            CK_ULONG          ulEncryptedPartLen,  /* ciphertext length */
+            CK_BYTE_PTR       pPart,               /* gets plaintext */
+            CK_ULONG_PTR      pulPartLen           /* gets p-text length */
+        );
+
         // Key generation
 
         virtual CK_RV GenerateKey
@@ -212,7 +329,28 @@ namespace core {
         virtual Scoped<Object> GetObject(CK_OBJECT_HANDLE hObject);
 
     protected:
+        /**
+         * Returns code of the PKCS#11 exception, CKR_FUNCTION_FAILED for other exceptions
+         */
+        static CK_RV GetExceptionCode(Scoped<Exception> e);
 
+        /**
+         * Runs cipher and MAC (digest, sign or verify) over the data block by block, each
+         * block is passed to the cipher Update and then to the MAC Update. Plaintext is the
+         * input of encryption and the output of decryption. NULL pOutput returns the output
+         * length, a short buffer returns the length with CKR_BUFFER_TOO_SMALL and keeps both
+         * operations unchanged
+         */
+        CK_RV DualUpdate
+        (
+            Scoped<CryptoEncrypt> cipher,
+            Scoped<CryptoDigest>  digest,
+            Scoped<CryptoSign>    mac,
+            CK_BYTE_PTR           pInput,
+            CK_ULONG              ulInputLen,
+            CK_BYTE_PTR           pOutput,
+            CK_ULONG_PTR          pulOutputLen
+        );
     };
 
 }
@@ -159,8 +159,13 @@ CK_RV core::Slot::OpenSession
 {
     try {
         Scoped<Session> session = this->CreateSession();
+        session->store = store;
+        session->keyPairPool = keyPairPool;
         CK_RV res = session->Open(flags, pApplication, Notify, phSession);
         if (res == CKR_OK) {
+            if (store) {
+                store->Refresh();
+            }
             session->SlotID = this->slotID;
             this->sessions.add(session);
         }
@@ -207,4 +212,59 @@ CK_RV Slot::CloseAllSessions()
     }
 
     return CKR_OK;
-}
\ No newline at end of file
+}
+
+CK_RV Slot::SetKeyPairPool
+(
+    CK_MECHANISM_PTR     pMechanism,                  /* key-gen mechanism */
+    CK_ATTRIBUTE_PTR     pPublicKeyTemplate,          /* template for pub. key */
+    CK_ULONG             ulPublicKeyAttributeCount,   /* # pub. attributes */
+    CK_ULONG             ulPoolSize                   /* # key pairs kept ready */
+)
+{
+    try {
+        CheckKeyPairPool(pMechanism, pPublicKeyTemplate, ulPublicKeyAttributeCount, ulPoolSize);
+
+        return CKR_FUNCTION_NOT_SUPPORTED;
+    }
+    CATCH_EXCEPTION;
+}
+
+void Slot::CheckKeyPairPool
+(
+    CK_MECHANISM_PTR     pMechanism,
+    CK_ATTRIBUTE_PTR     pPublicKeyTemplate,
+    CK_ULONG             ulPublicKeyAttributeCount,
+    CK_ULONG             ulPoolSize
+)
+{
+    try {
+        if (pMechanism == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pMechanism is NULL");
+        }
+        if (pPublicKeyTemplate == NULL_PTR && ulPublicKeyAttributeCount) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pPublicKeyTemplate is NULL");
+        }
+        if (ulPoolSize > KEY_PAIR_POOL_MAX_SIZE) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "ulPoolSize is too big");
+        }
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV Slot::GetKeyPairPoolInfo
+(
+    CK_PV_KEY_PAIR_POOL_INFO_PTR  pInfo    /* receives the pool information */
+)
+{
+    try {
+        if (!keyPairPool) {
+            return CKR_FUNCTION_NOT_SUPPORTED;
+        }
+
+        keyPairPool->GetInfo(pInfo);
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION;
+}
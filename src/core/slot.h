@@ -3,6 +3,8 @@
 #include "collection.h"
 #include "objects/mechanism.h"
 #include "session.h"
+#include "store.h"
+#include "keypair_pool.h"
 
 namespace core {
 
@@ -10,6 +12,10 @@ namespace core {
     public:
         Collection<Scoped<Mechanism> > mechanisms;
         Collection<Scoped<Session> > sessions;
+        // token objects shared by sessions of the slot, can be empty
+        Scoped<Store> store;
+        // key pairs generated ahead for C_GenerateKeyPair, can be empty
+        Scoped<KeyPairPool> keyPairPool;
 
         Slot();
         ~Slot();
@@ -72,6 +78,23 @@ namespace core {
 
         CK_RV CloseAllSessions();
 
+        /**
+         * Sets number of key pairs generated ahead for the mechanism and public key template.
+         * Returns CKR_FUNCTION_NOT_SUPPORTED if the slot has no pool
+         */
+        virtual CK_RV SetKeyPairPool
+        (
+            CK_MECHANISM_PTR     pMechanism,                  /* key-gen mechanism */
+            CK_ATTRIBUTE_PTR     pPublicKeyTemplate,          /* template for pub. key */
+            CK_ULONG             ulPublicKeyAttributeCount,   /* # pub. attributes */
+            CK_ULONG             ulPoolSize                   /* # key pairs kept ready */
+        );
+
+        CK_RV GetKeyPairPoolInfo
+        (
+            CK_PV_KEY_PAIR_POOL_INFO_PTR  pInfo    /* receives the pool information */
+        );
+
         bool hasSession(CK_SESSION_HANDLE hSession);
         Scoped<Session> getSession(CK_SESSION_HANDLE hSession);
         CK_TOKEN_INFO tokenInfo;
@@ -80,6 +103,17 @@ namespace core {
         virtual Scoped<Session> CreateSession() = 0;
         bool hasMechanism(CK_MECHANISM_TYPE type);
 
+        /**
+         * Throws CKR_ARGUMENTS_BAD if arguments of SetKeyPairPool are wrong
+         */
+        void CheckKeyPairPool
+        (
+            CK_MECHANISM_PTR     pMechanism,
+            CK_ATTRIBUTE_PTR     pPublicKeyTemplate,
+            CK_ULONG             ulPublicKeyAttributeCount,
+            CK_ULONG             ulPoolSize
+        );
+
     };
 
 }
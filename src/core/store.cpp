@@ -0,0 +1,192 @@
+#include "store.h"
+
+using namespace core;
+
+core::Store::Store() :
+    loaded(false),
+    lastHandle(0)
+{
+}
+
+core::Store::~Store()
+{
+}
+
+void core::Store::Refresh()
+{
+    try {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+
+        if (!loaded) {
+            Load();
+            loaded = true;
+        }
+        else {
+            Update();
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void core::Store::Update()
+{
+}
+
+std::string core::Store::GetObjectId(
+    Scoped<Object>                  object,
+    std::vector<CK_ATTRIBUTE_TYPE>  types
+)
+{
+    try {
+        static const char digits[] = "0123456789abcdef";
+
+        char objectClass[32];
+        snprintf(objectClass, sizeof(objectClass), "%lx", (unsigned long)object->ItemByType(CKA_CLASS)->ToNumber());
+
+        std::string res(objectClass);
+        for (size_t i = 0; i < types.size(); i++) {
+            Scoped<Buffer> value = object->ItemByType(types[i])->ToBytes();
+            res += "/";
+            for (size_t j = 0; j < value->size(); j++) {
+                res += digits[value->at(j) >> 4];
+                res += digits[value->at(j) & 0x0F];
+            }
+        }
+        return res;
+    }
+    CATCH_EXCEPTION
+}
+
+std::string core::Store::GetObjectId(
+    Scoped<Object>                  object,
+    const Buffer&                   reference
+)
+{
+    try {
+        static const char digits[] = "0123456789abcdef";
+
+        char objectClass[32];
+        snprintf(objectClass, sizeof(objectClass), "%lx", (unsigned long)object->ItemByType(CKA_CLASS)->ToNumber());
+
+        std::string res(objectClass);
+        res += "#";
+        for (size_t i = 0; i < reference.size(); i++) {
+            res += digits[reference[i] >> 4];
+            res += digits[reference[i] & 0x0F];
+        }
+        return res;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<Object> core::Store::GetObject(CK_OBJECT_HANDLE hObject)
+{
+    try {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+
+        std::map<CK_OBJECT_HANDLE, Scoped<Object> >::iterator it = handles.find(hObject);
+        if (it == handles.end()) {
+            return Scoped<Object>();
+        }
+        return it->second;
+    }
+    CATCH_EXCEPTION
+}
+
+std::vector<Scoped<Object> > core::Store::GetObjects()
+{
+    try {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+
+        std::vector<Scoped<Object> > res;
+        res.reserve(objects.size());
+        for (std::map<std::string, Scoped<Object> >::iterator it = objects.begin(); it != objects.end(); it++) {
+            res.push_back(it->second);
+        }
+        return res;
+    }
+    CATCH_EXCEPTION
+}
+
+void core::Store::AddObject(
+    const std::string&  id,
+    Scoped<Object>      object
+)
+{
+    try {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+
+        if (!object) {
+            THROW_EXCEPTION("Parameter 'object' is empty");
+        }
+
+        RemoveObject(id);
+
+        std::map<std::string, CK_OBJECT_HANDLE>::iterator it = ids.find(id);
+        if (it == ids.end()) {
+            it = ids.insert(std::make_pair(id, ++lastHandle)).first;
+        }
+        object->handle = it->second;
+
+        objects[id] = object;
+        handles[object->handle] = object;
+    }
+    CATCH_EXCEPTION
+}
+
+void core::Store::RemoveObject(
+    const std::string&  id
+)
+{
+    try {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+
+        std::map<std::string, Scoped<Object> >::iterator it = objects.find(id);
+        if (it != objects.end()) {
+            handles.erase(it->second->handle);
+            objects.erase(it);
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void core::Store::RemoveObject(
+    Scoped<Object>      object
+)
+{
+    try {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+
+        for (std::map<std::string, Scoped<Object> >::iterator it = objects.begin(); it != objects.end(); it++) {
+            if (it->second == object) {
+                std::string id = it->first;
+                RemoveObject(id);
+                return;
+            }
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void core::Store::RemoveObjects()
+{
+    try {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+
+        objects.clear();
+        handles.clear();
+    }
+    CATCH_EXCEPTION
+}
+
+bool core::Store::HasObject(
+    const std::string&  id
+)
+{
+    try {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+
+        return objects.find(id) != objects.end();
+    }
+    CATCH_EXCEPTION
+}
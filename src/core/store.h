@@ -0,0 +1,107 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "excep.h"
+#include "object.h"
+
+#include <map>
+#include <mutex>
+
+#ifdef GetObject
+#undef GetObject
+#endif
+
+namespace core {
+
+    /**
+     * Token objects of a slot. The store is shared by all sessions of the slot,
+     * it is filled once by Load and kept up to date by Update, which applies
+     * changes (added, removed or modified objects) reported by the underlying storage
+     */
+    class Store {
+    public:
+        Store();
+        virtual ~Store();
+
+        /**
+         * Loads the store on first use, then applies pending changes
+         */
+        void Refresh();
+
+        /**
+         * Returns token object by handle or empty pointer if it's not found
+         */
+        Scoped<Object> GetObject(CK_OBJECT_HANDLE hObject);
+
+        /**
+         * Returns snapshot of token objects
+         */
+        std::vector<Scoped<Object> > GetObjects();
+
+        /**
+         * Removes the token object, e.g. after C_DestroyObject. Does nothing if the
+         * object is not in the store
+         */
+        void RemoveObject(
+            Scoped<Object>      object      /* token object */
+        );
+
+        /**
+         * Builds storage identity from the object class and values of the given attributes
+         */
+        static std::string GetObjectId(
+            Scoped<Object>                  object,     /* token object */
+            std::vector<CK_ATTRIBUTE_TYPE>  types       /* attributes which identify the object */
+        );
+
+        /**
+         * Builds storage identity from the object class and a reference of the underlying
+         * storage which is unique per object (container name, hash of the key material, etc)
+         */
+        static std::string GetObjectId(
+            Scoped<Object>                  object,     /* token object */
+            const Buffer&                   reference   /* storage reference of the object */
+        );
+
+    protected:
+        bool                                    loaded;
+        std::recursive_mutex                    mutex;
+        // objects indexed by the storage identity (file name, container name, etc)
+        std::map<std::string, Scoped<Object> >  objects;
+        // objects indexed by handle
+        std::map<CK_OBJECT_HANDLE, Scoped<Object> > handles;
+        // handles assigned to storage identities, kept for the lifetime of the module
+        // so the same object gets the same handle in all sessions and after reload
+        std::map<std::string, CK_OBJECT_HANDLE> ids;
+        CK_OBJECT_HANDLE                        lastHandle;
+
+        /**
+         * Enumerates all objects of the underlying storage
+         */
+        virtual void Load() = 0;
+
+        /**
+         * Applies changes of the underlying storage since the last call
+         */
+        virtual void Update();
+
+        /**
+         * Adds object to the store and sets its handle. Replaces the object with the same identity
+         */
+        void AddObject(
+            const std::string&  id,         /* storage identity of the object */
+            Scoped<Object>      object      /* token object */
+        );
+
+        void RemoveObject(
+            const std::string&  id          /* storage identity of the object */
+        );
+
+        void RemoveObjects();
+
+        bool HasObject(
+            const std::string&  id          /* storage identity of the object */
+        );
+    };
+
+}
@@ -101,7 +101,7 @@ Scoped<Buffer> Template::GetBytes(CK_ULONG ulType, CK_BBOOL bRequired, const cha
             }
         }
         Scoped<Buffer> result(new Buffer);
-        if (attr->ulValueLen) {
+        if (attr && attr->ulValueLen) {
             result->resize(attr->ulValueLen);
             memcpy(result->data(), attr->pValue, attr->ulValueLen);
         }
@@ -173,6 +173,12 @@ CK_RV CryptoAesEncrypt::Update
 )
 {
     try {
+        if (pEncryptedPart == NULL_PTR) {
+            // Length request mustn't move data to buffer
+            *pulEncryptedPartLen = GetUpdateLength(ulPartLen);
+            return CKR_OK;
+        }
+
         std::string data("");
         std::string incomingData((char*)pPart, ulPartLen);
 
@@ -214,6 +220,35 @@ CK_RV CryptoAesEncrypt::Update
     CATCH_EXCEPTION
 }
 
+CK_ULONG CryptoAesEncrypt::GetUpdateLength
+(
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+
+        if (!padding) {
+            if (ulPartLen % blockLength) {
+                THROW_PKCS11_EXCEPTION(CKR_DATA_LEN_RANGE, "Wrong incoming data");
+            }
+            return ulPartLen;
+        }
+
+        // Same split of buffered and incoming data as Update
+        CK_ULONG ulDataLen = buffer.length() + ulPartLen;
+        CK_ULONG ulOutLen = ulDataLen - ulDataLen % blockLength;
+        if (type == CRYPTO_DECRYPT && ulOutLen && ulOutLen == ulDataLen) {
+            // last BLOCK is left for final operation
+            ulOutLen -= blockLength;
+        }
+        return ulOutLen;
+    }
+    CATCH_EXCEPTION
+}
+
 CK_RV CryptoAesEncrypt::Final
 (
     CK_BYTE_PTR       pLastEncryptedPart,
@@ -467,6 +502,14 @@ CK_RV CryptoAesGCMEncrypt::Update
     THROW_PKCS11_MECHANISM_INVALID();
 }
 
+CK_ULONG CryptoAesGCMEncrypt::GetUpdateLength
+(
+    CK_ULONG          ulPartLen
+)
+{
+    THROW_PKCS11_MECHANISM_INVALID();
+}
+
 CK_RV CryptoAesGCMEncrypt::Final
 (
     CK_BYTE_PTR       pLastEncryptedPart,
@@ -474,4 +517,163 @@ CK_RV CryptoAesGCMEncrypt::Final
 )
 {
     THROW_PKCS11_MECHANISM_INVALID();
-}
\ No newline at end of file
+}
+
+// AES-GCM message-based encryption
+
+CryptoAesGCMMessageEncrypt::CryptoAesGCMMessageEncrypt(
+    CK_BBOOL type
+) :
+    core::CryptoGcmMessageEncrypt(type)
+{}
+
+CK_RV CryptoAesGCMMessageEncrypt::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoGcmMessageEncrypt::Init(
+            pMechanism,
+            key
+        );
+
+        auto castKey = dynamic_cast<AesKey*>(key.get());
+        if (!castKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key must be AES");
+        }
+        this->key = castKey->bkey->Duplicate();
+        this->key->SetParam(BCRYPT_CHAINING_MODE, (PUCHAR)BCRYPT_CHAIN_MODE_GCM, lstrlenW(BCRYPT_CHAIN_MODE_GCM));
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+bool CryptoAesGCMMessageEncrypt::Crypt
+(
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO*  pAuthInfo,
+    CK_BYTE_PTR                             pData,
+    CK_ULONG                                ulDataLen,
+    CK_BYTE_PTR                             pOutput,
+    PUCHAR                                  pbIV,
+    ULONG                                   cbIV
+)
+{
+    NTSTATUS status;
+    ULONG ulOutLen;
+
+    if (type == CRYPTO_ENCRYPT) {
+        status = BCryptEncrypt(key->Get(), pData, ulDataLen, pAuthInfo, pbIV, cbIV, pOutput, ulDataLen, &ulOutLen, 0);
+    }
+    else {
+        status = BCryptDecrypt(key->Get(), pData, ulDataLen, pAuthInfo, pbIV, cbIV, pOutput, ulDataLen, &ulOutLen, 0);
+        if (status == STATUS_AUTH_TAG_MISMATCH) {
+            return false;
+        }
+    }
+    if (status) {
+        THROW_NT_EXCEPTION(status);
+    }
+
+    return true;
+}
+
+bool CryptoAesGCMMessageEncrypt::GcmOnce
+(
+    CK_BYTE_PTR       pIv,
+    CK_ULONG          ulIvLen,
+    CK_BYTE_PTR       pAssociatedData,
+    CK_ULONG          ulAssociatedDataLen,
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pOutput,
+    CK_BYTE_PTR       pTag,
+    CK_ULONG          ulTagLen
+)
+{
+    // Single call, buffers of the application are used as is
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+    BCRYPT_INIT_AUTH_MODE_INFO(info);
+    info.pbNonce = pIv;
+    info.cbNonce = ulIvLen;
+    info.pbAuthData = ulAssociatedDataLen ? pAssociatedData : NULL;
+    info.cbAuthData = ulAssociatedDataLen;
+    info.pbTag = pTag;
+    info.cbTag = ulTagLen;
+
+    return Crypt(&info, pData, ulDataLen, pOutput, NULL, 0);
+}
+
+void CryptoAesGCMMessageEncrypt::GcmBegin
+(
+    CK_BYTE_PTR       pIv,
+    CK_ULONG          ulIvLen,
+    CK_BYTE_PTR       pAssociatedData,
+    CK_ULONG          ulAssociatedDataLen,
+    CK_ULONG          ulTagLen
+)
+{
+    // IV and AAD are consumed by the first chained call, which happens in Next
+    iv.assign(pIv, pIv + ulIvLen);
+    aad.assign(pAssociatedData, pAssociatedData + ulAssociatedDataLen);
+    memset(macContext, 0, sizeof(macContext));
+    memset(chainIv, 0, sizeof(chainIv));
+
+    BCRYPT_INIT_AUTH_MODE_INFO(authInfo);
+    authInfo.pbNonce = &iv[0];
+    authInfo.cbNonce = iv.size();
+    authInfo.pbAuthData = aad.size() ? &aad[0] : NULL;
+    authInfo.cbAuthData = aad.size();
+    authInfo.pbTag = tag;
+    authInfo.cbTag = ulTagLen;
+    authInfo.pbMacContext = macContext;
+    authInfo.cbMacContext = sizeof(macContext);
+    authInfo.dwFlags = BCRYPT_AUTH_MODE_CHAIN_CALLS_FLAG;
+}
+
+void CryptoAesGCMMessageEncrypt::GcmRandom
+(
+    CK_BYTE_PTR       pbData,
+    CK_ULONG          ulDataLen
+)
+{
+    NTSTATUS status = BCryptGenRandom(NULL, pbData, ulDataLen, BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+    if (status) {
+        THROW_NT_EXCEPTION(status);
+    }
+}
+
+void CryptoAesGCMMessageEncrypt::GcmUpdate
+(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pOutput
+)
+{
+    // BCrypt accepts whole blocks only until the last call
+    if (ulDataLen % sizeof(chainIv)) {
+        THROW_PKCS11_EXCEPTION(CKR_DATA_LEN_RANGE, "Part of AES-GCM message must be a multiple of 16 bytes");
+    }
+    Crypt(&authInfo, pData, ulDataLen, pOutput, chainIv, sizeof(chainIv));
+}
+
+bool CryptoAesGCMMessageEncrypt::GcmFinal
+(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pOutput,
+    CK_BYTE_PTR       pTag,
+    CK_ULONG          ulTagLen
+)
+{
+    authInfo.dwFlags &= ~BCRYPT_AUTH_MODE_CHAIN_CALLS_FLAG;
+    // Encryption writes the tag, decryption checks it
+    authInfo.pbTag = pTag;
+    authInfo.cbTag = ulTagLen;
+
+    return Crypt(&authInfo, pData, ulDataLen, pOutput, chainIv, sizeof(chainIv));
+}
@@ -49,6 +49,11 @@ namespace mscapi {
             CK_ULONG_PTR      pulEncryptedPartLen
         );
 
+        CK_ULONG GetUpdateLength
+        (
+            CK_ULONG          ulPartLen
+        );
+
         CK_RV Final
         (
             CK_BYTE_PTR       pLastEncryptedPart,
@@ -100,6 +105,11 @@ namespace mscapi {
             CK_ULONG_PTR      pulEncryptedPartLen
         );
 
+        CK_ULONG GetUpdateLength
+        (
+            CK_ULONG          ulPartLen
+        );
+
         CK_RV Final
         (
             CK_BYTE_PTR       pLastEncryptedPart,
@@ -114,4 +124,85 @@ namespace mscapi {
         ULONG                       blockLength;
     };
 
+    class CryptoAesGCMMessageEncrypt : public core::CryptoGcmMessageEncrypt {
+    public:
+        CryptoAesGCMMessageEncrypt(
+            CK_BBOOL type
+        );
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,
+            Scoped<core::Object>    hKey
+        );
+
+    protected:
+        // GCM key is set up once, messages use it without new BCrypt state
+        Scoped<bcrypt::Key>                     key;
+        // State of chained calls for the message started by Begin
+        BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO   authInfo;
+        Buffer                                  iv;
+        Buffer                                  aad;
+        BYTE                                    macContext[16];
+        BYTE                                    chainIv[16];
+        BYTE                                    tag[16];
+
+        void GcmBegin
+        (
+            CK_BYTE_PTR       pIv,
+            CK_ULONG          ulIvLen,
+            CK_BYTE_PTR       pAssociatedData,
+            CK_ULONG          ulAssociatedDataLen,
+            CK_ULONG          ulTagLen
+        );
+
+        void GcmRandom
+        (
+            CK_BYTE_PTR       pbData,
+            CK_ULONG          ulDataLen
+        );
+
+        void GcmUpdate
+        (
+            CK_BYTE_PTR       pData,
+            CK_ULONG          ulDataLen,
+            CK_BYTE_PTR       pOutput
+        );
+
+        bool GcmFinal
+        (
+            CK_BYTE_PTR       pData,
+            CK_ULONG          ulDataLen,
+            CK_BYTE_PTR       pOutput,
+            CK_BYTE_PTR       pTag,
+            CK_ULONG          ulTagLen
+        );
+
+        bool GcmOnce
+        (
+            CK_BYTE_PTR       pIv,
+            CK_ULONG          ulIvLen,
+            CK_BYTE_PTR       pAssociatedData,
+            CK_ULONG          ulAssociatedDataLen,
+            CK_BYTE_PTR       pData,
+            CK_ULONG          ulDataLen,
+            CK_BYTE_PTR       pOutput,
+            CK_BYTE_PTR       pTag,
+            CK_ULONG          ulTagLen
+        );
+
+        /**
+         * Calls BCryptEncrypt or BCryptDecrypt, returns false if tag does not match
+         */
+        bool Crypt
+        (
+            BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO*  pAuthInfo,
+            CK_BYTE_PTR                             pData,
+            CK_ULONG                                ulDataLen,
+            CK_BYTE_PTR                             pOutput,
+            PUCHAR                                  pbIV,
+            ULONG                                   cbIV
+        );
+    };
+
 }
\ No newline at end of file
@@ -6,6 +6,7 @@ CertStore::CertStore()
 {
     try {
         this->hStore = NULL;
+        this->hChange = NULL;
     }
     CATCH_EXCEPTION;
 }
@@ -60,6 +61,29 @@ void CertStore::Close()
             CertCloseStore(this->hStore, 0);
             this->hStore = NULL;
         }
+        if (this->hChange) {
+            CloseHandle(this->hChange);
+            this->hChange = NULL;
+        }
+    }
+    CATCH_EXCEPTION;
+}
+
+bool CertStore::HasChanged()
+{
+    try {
+        if (!this->hChange) {
+            this->hChange = CreateEvent(NULL, FALSE, FALSE, NULL);
+            if (this->hChange == NULL) {
+                THROW_MSCAPI_EXCEPTION();
+            }
+            if (!CertControlStore(this->hStore, 0, CERT_STORE_CTRL_NOTIFY_CHANGE, &this->hChange)) {
+                THROW_MSCAPI_EXCEPTION();
+            }
+            return false;
+        }
+
+        return WaitForSingleObject(this->hChange, 0) == WAIT_OBJECT_0;
     }
     CATCH_EXCEPTION;
 }
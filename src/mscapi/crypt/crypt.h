@@ -186,9 +186,16 @@ namespace crypt {
 
 		void Open(LPCSTR storeName);
 		void Close();
+
+		/**
+		 * Returns true if the store was changed since the previous call. The first
+		 * call registers change notification and returns false
+		 */
+		bool HasChanged();
 	protected:
 		bool opened;
 		HCERTSTORE hStore;
+		HANDLE hChange;
 		LPCSTR name;
 	};
 
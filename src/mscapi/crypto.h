@@ -226,6 +226,11 @@ namespace mscapi {
             CK_ULONG_PTR      pulEncryptedPartLen
         );
 
+        CK_ULONG GetUpdateLength
+        (
+            CK_ULONG          ulPartLen
+        );
+
         CK_RV Final
         (
             CK_BYTE_PTR       pLastEncryptedPart,
@@ -167,6 +167,17 @@ CK_RV CryptoRsaOAEPEncrypt::Update
     CATCH_EXCEPTION
 }
 
+CK_ULONG CryptoRsaOAEPEncrypt::GetUpdateLength
+(
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        THROW_PKCS11_MECHANISM_INVALID();
+    }
+    CATCH_EXCEPTION
+}
+
 CK_RV CryptoRsaOAEPEncrypt::Final
 (
     CK_BYTE_PTR       pLastEncryptedPart,
@@ -151,11 +151,6 @@ CK_RV EcPrivateKey::GetValue(
         core::EcPrivateKey::GetValue(attr);
 
         switch (attr->type) {
-        case CKA_EC_PARAMS:
-            if (ItemByType(attr->type)->IsEmpty()) {
-                FillPublicKeyStruct();
-            }
-            break;
         case CKA_VALUE:
             if (ItemByType(attr->type)->IsEmpty()) {
                 FillPrivateKeyStruct();
@@ -218,7 +213,10 @@ CK_RV mscapi::EcPrivateKey::Destroy()
 void EcPrivateKey::OnKeyAssigned()
 {
     try {
-        FillPublicKeyStruct();
+        SetProvider(
+            { CKA_EC_PARAMS, CKA_SIGN, CKA_DERIVE },
+            std::bind(&EcPrivateKey::FillPublicKeyStruct, this)
+        );
     }
     CATCH_EXCEPTION
 }
@@ -272,27 +270,6 @@ void EcPublicKey::FillKeyStruct()
     CATCH_EXCEPTION;
 }
 
-CK_RV EcPublicKey::GetValue(
-    CK_ATTRIBUTE_PTR attr
-)
-{
-    try {
-        core::EcPublicKey::GetValue(attr);
-
-        switch (attr->type) {
-        case CKA_EC_PARAMS:
-        case CKA_EC_POINT:
-            if (ItemByType(attr->type)->IsEmpty()) {
-                FillKeyStruct();
-            }
-            break;
-        }
-
-        return CKR_OK;
-    }
-    CATCH_EXCEPTION
-}
-
 Scoped<core::Object> EcKey::DeriveKey(
     CK_MECHANISM_PTR        pMechanism,
     Scoped<core::Object>    baseKey,
@@ -418,7 +395,10 @@ CK_RV mscapi::EcPublicKey::Destroy()
 void EcPublicKey::OnKeyAssigned()
 {
     try {
-        FillKeyStruct();
+        SetProvider(
+            { CKA_EC_PARAMS, CKA_EC_POINT, CKA_VERIFY, CKA_DERIVE },
+            std::bind(&EcPublicKey::FillKeyStruct, this)
+        );
     }
     CATCH_EXCEPTION
 }
\ No newline at end of file
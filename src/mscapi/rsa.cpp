@@ -154,14 +154,6 @@ CK_RV RsaPrivateKey::GetValue
 {
     try {
         switch (attr->type) {
-        case CKA_MODULUS:
-        case CKA_PUBLIC_EXPONENT:
-        {
-            if (ItemByType(attr->type)->IsEmpty()) {
-                FillPublicKeyStruct();
-            }
-            break;
-        }
         case CKA_PRIME_1:
         case CKA_PRIME_2:
         case CKA_EXPONENT_1:
@@ -230,7 +222,10 @@ CK_RV RsaPrivateKey::Destroy()
 void RsaPrivateKey::OnKeyAssigned()
 {
     try {
-        FillPublicKeyStruct();
+        SetProvider(
+            { CKA_MODULUS, CKA_PUBLIC_EXPONENT, CKA_SIGN, CKA_DECRYPT, CKA_UNWRAP },
+            std::bind(&RsaPrivateKey::FillPublicKeyStruct, this)
+        );
     }
     CATCH_EXCEPTION
 }
@@ -266,28 +261,6 @@ void RsaPublicKey::FillKeyStruct()
     CATCH_EXCEPTION
 }
 
-CK_RV RsaPublicKey::GetValue
-(
-    CK_ATTRIBUTE_PTR  attr
-)
-{
-    try {
-        switch (attr->type) {
-        case CKA_MODULUS:
-        case CKA_MODULUS_BITS:
-        case CKA_PUBLIC_EXPONENT: {
-            if (ItemByType(attr->type)->IsEmpty()) {
-                FillKeyStruct();
-            }
-            break;
-        }
-        }
-
-        return CKR_OK;
-    }
-    CATCH_EXCEPTION
-}
-
 CK_RV RsaPublicKey::CreateValues
 (
     CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
@@ -363,7 +336,10 @@ CK_RV RsaPublicKey::Destroy()
 void RsaPublicKey::OnKeyAssigned()
 {
     try {
-        FillKeyStruct();
+        SetProvider(
+            { CKA_MODULUS, CKA_MODULUS_BITS, CKA_PUBLIC_EXPONENT, CKA_VERIFY, CKA_ENCRYPT, CKA_WRAP },
+            std::bind(&RsaPublicKey::FillKeyStruct, this)
+        );
     }
     CATCH_EXCEPTION
 }
\ No newline at end of file
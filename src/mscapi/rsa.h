@@ -67,11 +67,6 @@ namespace mscapi {
 
     protected:
         void FillKeyStruct();
-
-        CK_RV GetValue
-        (
-            CK_ATTRIBUTE_PTR  attr
-        );
     };
 
 }
\ No newline at end of file
@@ -26,211 +26,6 @@ Session::~Session()
 {
 }
 
-void Session::LoadMyStore()
-{
-    try {
-        Scoped<crypt::CertStore> store(new crypt::CertStore());
-        this->certStores.push_back(store);
-        store->Open(PV_STORE_NAME_MY);
-        auto certs = store->GetCertificates();
-        for (size_t i = 0; i < certs.size(); i++) {
-            auto cert = certs.at(i);
-
-            if (!cert->HasProperty(CERT_KEY_PROV_INFO_PROP_ID)) {
-                continue;
-            }
-
-            auto propKeyProvInfo = cert->GetPropertyBytes(CERT_KEY_PROV_INFO_PROP_ID);
-            CRYPT_KEY_PROV_INFO* pKeyProvInfo = (CRYPT_KEY_PROV_INFO*)propKeyProvInfo->data();
-
-            Scoped<core::Object> privateKey;
-            Scoped<core::Object> publicKey;
-
-            if (pKeyProvInfo->dwProvType == 0) {
-                // CNG
-                if (!wmemcmp(MS_KEY_STORAGE_PROVIDER, pKeyProvInfo->pwszProvName, lstrlenW(MS_KEY_STORAGE_PROVIDER))) {
-                    // Get all CNG keys via LoadCngKeys
-                }
-            }
-            else if (
-                pKeyProvInfo->dwProvType == PROV_RSA_FULL ||
-                pKeyProvInfo->dwProvType == PROV_RSA_AES ||
-                pKeyProvInfo->dwProvType == PROV_RSA_SIG ||
-                pKeyProvInfo->dwProvType == PROV_EC_ECDSA_FULL ||
-                pKeyProvInfo->dwProvType == PROV_EC_ECDSA_SIG
-                ) {
-                // CAPI
-                Scoped<crypt::Provider> provider(new crypt::Provider());
-                try {
-                    provider->AcquireContextW(
-                        pKeyProvInfo->pwszContainerName,
-                        pKeyProvInfo->pwszProvName,
-                        pKeyProvInfo->dwProvType,
-                        CRYPT_SILENT
-                    );
-                }
-                catch (...) {
-                    // cannot get key. it can be on smart card
-                    continue;
-                }
-                Scoped<ncrypt::Provider> nprov(new ncrypt::Provider());
-
-                nprov->Open(MS_KEY_STORAGE_PROVIDER, 0);
-                auto key = provider->GetUserKey(pKeyProvInfo->dwKeySpec);
-
-                Scoped<ncrypt::Key> nkey;
-                try {
-                    nkey = nprov->TranslateHandle(provider->Get(), key->Get(), 0, 0);
-                }
-                catch (...) {
-                    try {
-                        // Rutoken throws C0000225 error on NCryptTranslateHandle
-                        nprov->Open(MS_SMART_CARD_KEY_STORAGE_PROVIDER, 0);
-                        nkey = nprov->OpenKey(pKeyProvInfo->pwszContainerName, pKeyProvInfo->dwKeySpec, 0);
-                    }
-                    catch (...) {
-                        // Cannot get key. May be wrong Provider
-                        // Don't use this key
-                        continue;
-                    }
-                }
-
-                switch (pKeyProvInfo->dwProvType) {
-                case PROV_RSA_SIG:
-                case PROV_RSA_AES:
-                case PROV_RSA_FULL: {
-                    auto rsaPrivateKey = Scoped<RsaPrivateKey>(new RsaPrivateKey());
-                    rsaPrivateKey->Assign(nkey);
-                    auto rsaPublicKey = Scoped<RsaPublicKey>(new RsaPublicKey());
-                    rsaPublicKey->Assign(nkey);
-                    privateKey = rsaPrivateKey;
-                    publicKey = rsaPublicKey;
-                    break;
-                }
-                case PROV_EC_ECDSA_SIG:
-                case PROV_EC_ECDSA_FULL:
-                    auto ecPrivateKey = Scoped<EcPrivateKey>(new EcPrivateKey());
-                    ecPrivateKey->Assign(nkey);
-                    auto ecPublicKey = Scoped<EcPublicKey>(new EcPublicKey());
-                    ecPublicKey->Assign(nkey);
-                    privateKey = ecPrivateKey;
-                    publicKey = ecPublicKey;
-                    break;
-                }
-            }
-            else {
-                continue;
-            }
-
-            Scoped<X509Certificate> x509(new X509Certificate());
-            x509->Assign(cert);
-
-            x509->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
-            x509->ItemByType(CKA_COPYABLE)->To<core::AttributeBool>()->Set(false);
-            x509->ItemByType(CKA_MODIFIABLE)->To<core::AttributeBool>()->Set(false);
-
-            this->objects.add(x509);
-
-            if (privateKey && publicKey) {
-                auto attrID = x509->ItemByType(CKA_ID)->To<core::AttributeBytes>()->ToValue();
-                privateKey->ItemByType(CKA_ID)->SetValue(attrID->data(), attrID->size());
-                privateKey->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
-                privateKey->ItemByType(CKA_COPYABLE)->To<core::AttributeBool>()->Set(false);
-                privateKey->ItemByType(CKA_MODIFIABLE)->To<core::AttributeBool>()->Set(false);
-
-                publicKey->ItemByType(CKA_ID)->SetValue(attrID->data(), attrID->size());
-                publicKey->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
-                publicKey->ItemByType(CKA_COPYABLE)->To<core::AttributeBool>()->Set(false);
-                publicKey->ItemByType(CKA_MODIFIABLE)->To<core::AttributeBool>()->Set(false);
-
-                this->objects.add(publicKey);
-                this->objects.add(privateKey);
-            }
-        }
-    }
-    CATCH_EXCEPTION
-}
-
-void Session::LoadRequestStore()
-{
-    try {
-        Scoped<crypt::CertStore> requestStore(new crypt::CertStore());
-        requestStore->Open(PV_STORE_NAME_REQUEST);
-
-        auto certs = requestStore->GetCertificates();
-
-        for (ULONG i = 0; i < certs.size(); i++) {
-            auto cert = certs.at(i);
-            if (cert->HasProperty(CERT_PV_REQUEST) && cert->HasProperty(CERT_PV_ID)) {
-                Scoped<X509CertificateRequest> object(new X509CertificateRequest());
-                object->Assign(cert);
-
-                object->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
-                object->ItemByType(CKA_COPYABLE)->To<core::AttributeBool>()->Set(false);
-                object->ItemByType(CKA_MODIFIABLE)->To<core::AttributeBool>()->Set(false);
-
-                objects.add(object);
-            }
-        }
-
-        certStores.push_back(requestStore);
-    }
-    CATCH_EXCEPTION
-}
-
-void Session::LoadCngKeys()
-{
-    try {
-        Scoped<ncrypt::Provider> provider(new ncrypt::Provider());
-        provider->Open(MS_KEY_STORAGE_PROVIDER, 0);
-
-        auto keyNames = provider->GetKeyNames(0);
-        for (ULONG i = 0; i < keyNames->size(); i++) {
-            auto keyName = keyNames->at(i);
-            auto key = provider->OpenKey(keyName->pszName, keyName->dwLegacyKeySpec, keyName->dwFlags);
-            auto propAlgGroup = key->GetBytesW(NCRYPT_ALGORITHM_GROUP_PROPERTY);
-            Scoped<core::Object> privateKey;
-            Scoped<core::Object> publicKey;
-            if (!wmemcmp(propAlgGroup->c_str(), NCRYPT_RSA_ALGORITHM_GROUP, lstrlenW(NCRYPT_RSA_ALGORITHM_GROUP))) {
-                auto rsaPrivateKey = Scoped<RsaPrivateKey>(new RsaPrivateKey());
-                rsaPrivateKey->Assign(key);
-                auto rsaPublicKey = Scoped<RsaPublicKey>(new RsaPublicKey());
-                rsaPublicKey->Assign(key);
-                privateKey = rsaPrivateKey;
-                publicKey = rsaPublicKey;
-            }
-            else if (!wmemcmp(propAlgGroup->c_str(), NCRYPT_ECDH_ALGORITHM_GROUP, lstrlenW(NCRYPT_ECDH_ALGORITHM_GROUP)) ||
-                !wmemcmp(propAlgGroup->c_str(), NCRYPT_ECDSA_ALGORITHM_GROUP, lstrlenW(NCRYPT_ECDSA_ALGORITHM_GROUP))) {
-                auto ecPrivateKey = Scoped<EcPrivateKey>(new EcPrivateKey());
-                ecPrivateKey->Assign(key);
-                auto ecPublicKey = Scoped<EcPublicKey>(new EcPublicKey());
-                ecPublicKey->Assign(key);
-                privateKey = ecPrivateKey;
-                publicKey = ecPublicKey;
-            }
-            else {
-                // Unsupported algorithm
-                continue;
-            }
-
-            auto attrID = key->GetId();
-            privateKey->ItemByType(CKA_ID)->SetValue(attrID->data(), attrID->size());
-            privateKey->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
-            privateKey->ItemByType(CKA_COPYABLE)->To<core::AttributeBool>()->Set(false);
-            privateKey->ItemByType(CKA_MODIFIABLE)->To<core::AttributeBool>()->Set(false);
-
-            publicKey->ItemByType(CKA_ID)->SetValue(attrID->data(), attrID->size());
-            publicKey->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
-            publicKey->ItemByType(CKA_COPYABLE)->To<core::AttributeBool>()->Set(false);
-            publicKey->ItemByType(CKA_MODIFIABLE)->To<core::AttributeBool>()->Set(false);
-
-            objects.add(publicKey);
-            objects.add(privateKey);
-        }
-    }
-    CATCH_EXCEPTION
-}
-
 CK_RV Session::Open
 (
     CK_FLAGS              flags,         /* from CK_SESSION_INFO */
@@ -240,14 +35,7 @@ CK_RV Session::Open
 )
 {
     try {
-        CK_RV res = core::Session::Open(flags, pApplication, Notify, phSession);
-
-        if (res == CKR_OK) {
-            LoadMyStore();
-            LoadRequestStore();
-            LoadCngKeys();
-        }
-        return res;
+        return core::Session::Open(flags, pApplication, Notify, phSession);
     }
     CATCH_EXCEPTION;
 }
@@ -541,6 +329,62 @@ CK_RV Session::DecryptInit
     CATCH_EXCEPTION;
 }
 
+CK_RV Session::MessageEncryptInit
+(
+    CK_MECHANISM_PTR  pMechanism,  /* the encryption mechanism */
+    CK_OBJECT_HANDLE  hKey         /* handle of encryption key */
+)
+{
+    try {
+        core::Session::MessageEncryptInit(
+            pMechanism,
+            hKey
+        );
+
+        switch (pMechanism->mechanism) {
+        case CKM_AES_GCM:
+            messageEncrypt = Scoped<CryptoAesGCMMessageEncrypt>(new CryptoAesGCMMessageEncrypt(CRYPTO_ENCRYPT));
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        return messageEncrypt->Init(
+            pMechanism,
+            GetObject(hKey)
+        );
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV Session::MessageDecryptInit
+(
+    CK_MECHANISM_PTR  pMechanism,  /* the decryption mechanism */
+    CK_OBJECT_HANDLE  hKey         /* handle of decryption key */
+)
+{
+    try {
+        core::Session::MessageDecryptInit(
+            pMechanism,
+            hKey
+        );
+
+        switch (pMechanism->mechanism) {
+        case CKM_AES_GCM:
+            messageDecrypt = Scoped<CryptoAesGCMMessageEncrypt>(new CryptoAesGCMMessageEncrypt(CRYPTO_DECRYPT));
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        return messageDecrypt->Init(
+            pMechanism,
+            GetObject(hKey)
+        );
+    }
+    CATCH_EXCEPTION;
+}
+
 CK_RV Session::DeriveKey
 (
     CK_MECHANISM_PTR     pMechanism,        /* key derivation mechanism */
@@ -74,6 +74,18 @@ namespace mscapi {
             CK_OBJECT_HANDLE  hKey         /* handle of decryption key */
         );
 
+        CK_RV MessageEncryptInit
+        (
+            CK_MECHANISM_PTR  pMechanism,  /* the encryption mechanism */
+            CK_OBJECT_HANDLE  hKey         /* handle of encryption key */
+        );
+
+        CK_RV MessageDecryptInit
+        (
+            CK_MECHANISM_PTR  pMechanism,  /* the decryption mechanism */
+            CK_OBJECT_HANDLE  hKey         /* handle of decryption key */
+        );
+
         CK_RV DeriveKey
         (
             CK_MECHANISM_PTR     pMechanism,        /* key derivation mechanism */
@@ -96,12 +108,6 @@ namespace mscapi {
             CK_ULONG             ulCount      /* attributes in template */
         );
 
-	protected:
-        std::vector<Scoped<crypt::CertStore> > certStores;
-
-		void LoadMyStore();
-        void LoadRequestStore();
-        void LoadCngKeys();
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,303 @@
+#include "../core/excep.h"
+
+#include "helper.h"
+#include "store.h"
+
+#include "rsa.h"
+#include "ec.h"
+
+#include "certificate.h"
+#include "data.h"
+
+using namespace mscapi;
+
+/**
+ * Storage identity of a key. Container name and key spec are unique within the provider,
+ * so keys with the same or empty CKA_ID don't replace each other
+ */
+static std::string GetKeyId(
+    Scoped<core::Object>    key,
+    LPCWSTR                 pszProvider,
+    LPCWSTR                 pszContainer,
+    DWORD                   dwKeySpec
+)
+{
+    Buffer reference;
+    reference.insert(reference.end(), (CK_BYTE*)pszProvider, (CK_BYTE*)(pszProvider + lstrlenW(pszProvider) + 1));
+    reference.insert(reference.end(), (CK_BYTE*)pszContainer, (CK_BYTE*)(pszContainer + lstrlenW(pszContainer) + 1));
+    reference.insert(reference.end(), (CK_BYTE*)&dwKeySpec, (CK_BYTE*)(&dwKeySpec + 1));
+    return core::Store::GetObjectId(key, reference);
+}
+
+mscapi::Store::Store() :
+    core::Store(),
+    keysChange(INVALID_HANDLE_VALUE)
+{
+}
+
+mscapi::Store::~Store()
+{
+    if (keysChange != INVALID_HANDLE_VALUE) {
+        FindCloseChangeNotification(keysChange);
+    }
+}
+
+void mscapi::Store::Load()
+{
+    try {
+        RemoveObjects();
+        certStores.clear();
+
+        LoadMyStore();
+        LoadRequestStore();
+        WatchCngKeys();
+        LoadCngKeys();
+    }
+    CATCH_EXCEPTION
+}
+
+void mscapi::Store::Update()
+{
+    try {
+        bool changed = false;
+        for (size_t i = 0; i < certStores.size(); i++) {
+            if (certStores[i]->HasChanged()) {
+                changed = true;
+            }
+        }
+        if (keysChange != INVALID_HANDLE_VALUE && WaitForSingleObject(keysChange, 0) == WAIT_OBJECT_0) {
+            FindNextChangeNotification(keysChange);
+            changed = true;
+        }
+
+        if (changed) {
+            Load();
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void mscapi::Store::WatchCngKeys()
+{
+    try {
+        if (keysChange != INVALID_HANDLE_VALUE) {
+            return;
+        }
+
+        // Microsoft Software Key Storage Provider keeps keys of the user in this directory
+        WCHAR szPath[MAX_PATH];
+        if (!ExpandEnvironmentStringsW(L"%APPDATA%\\Microsoft\\Crypto\\Keys", szPath, MAX_PATH)) {
+            return;
+        }
+        keysChange = FindFirstChangeNotificationW(szPath, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    }
+    CATCH_EXCEPTION
+}
+
+void mscapi::Store::LoadMyStore()
+{
+    try {
+        Scoped<crypt::CertStore> store(new crypt::CertStore());
+        this->certStores.push_back(store);
+        store->Open(PV_STORE_NAME_MY);
+        // registers change notification before reading, changes are applied by Update
+        store->HasChanged();
+        auto certs = store->GetCertificates();
+        for (size_t i = 0; i < certs.size(); i++) {
+            auto cert = certs.at(i);
+
+            if (!cert->HasProperty(CERT_KEY_PROV_INFO_PROP_ID)) {
+                continue;
+            }
+
+            auto propKeyProvInfo = cert->GetPropertyBytes(CERT_KEY_PROV_INFO_PROP_ID);
+            CRYPT_KEY_PROV_INFO* pKeyProvInfo = (CRYPT_KEY_PROV_INFO*)propKeyProvInfo->data();
+
+            Scoped<core::Object> privateKey;
+            Scoped<core::Object> publicKey;
+
+            if (pKeyProvInfo->dwProvType == 0) {
+                // CNG
+                if (!wmemcmp(MS_KEY_STORAGE_PROVIDER, pKeyProvInfo->pwszProvName, lstrlenW(MS_KEY_STORAGE_PROVIDER))) {
+                    // Get all CNG keys via LoadCngKeys
+                }
+            }
+            else if (
+                pKeyProvInfo->dwProvType == PROV_RSA_FULL ||
+                pKeyProvInfo->dwProvType == PROV_RSA_AES ||
+                pKeyProvInfo->dwProvType == PROV_RSA_SIG ||
+                pKeyProvInfo->dwProvType == PROV_EC_ECDSA_FULL ||
+                pKeyProvInfo->dwProvType == PROV_EC_ECDSA_SIG
+                ) {
+                // CAPI
+                Scoped<crypt::Provider> provider(new crypt::Provider());
+                try {
+                    provider->AcquireContextW(
+                        pKeyProvInfo->pwszContainerName,
+                        pKeyProvInfo->pwszProvName,
+                        pKeyProvInfo->dwProvType,
+                        CRYPT_SILENT
+                    );
+                }
+                catch (...) {
+                    // cannot get key. it can be on smart card
+                    continue;
+                }
+                Scoped<ncrypt::Provider> nprov(new ncrypt::Provider());
+
+                nprov->Open(MS_KEY_STORAGE_PROVIDER, 0);
+                auto key = provider->GetUserKey(pKeyProvInfo->dwKeySpec);
+
+                Scoped<ncrypt::Key> nkey;
+                try {
+                    nkey = nprov->TranslateHandle(provider->Get(), key->Get(), 0, 0);
+                }
+                catch (...) {
+                    try {
+                        // Rutoken throws C0000225 error on NCryptTranslateHandle
+                        nprov->Open(MS_SMART_CARD_KEY_STORAGE_PROVIDER, 0);
+                        nkey = nprov->OpenKey(pKeyProvInfo->pwszContainerName, pKeyProvInfo->dwKeySpec, 0);
+                    }
+                    catch (...) {
+                        // Cannot get key. May be wrong Provider
+                        // Don't use this key
+                        continue;
+                    }
+                }
+
+                switch (pKeyProvInfo->dwProvType) {
+                case PROV_RSA_SIG:
+                case PROV_RSA_AES:
+                case PROV_RSA_FULL: {
+                    auto rsaPrivateKey = Scoped<RsaPrivateKey>(new RsaPrivateKey());
+                    rsaPrivateKey->Assign(nkey);
+                    auto rsaPublicKey = Scoped<RsaPublicKey>(new RsaPublicKey());
+                    rsaPublicKey->Assign(nkey);
+                    privateKey = rsaPrivateKey;
+                    publicKey = rsaPublicKey;
+                    break;
+                }
+                case PROV_EC_ECDSA_SIG:
+                case PROV_EC_ECDSA_FULL:
+                    auto ecPrivateKey = Scoped<EcPrivateKey>(new EcPrivateKey());
+                    ecPrivateKey->Assign(nkey);
+                    auto ecPublicKey = Scoped<EcPublicKey>(new EcPublicKey());
+                    ecPublicKey->Assign(nkey);
+                    privateKey = ecPrivateKey;
+                    publicKey = ecPublicKey;
+                    break;
+                }
+            }
+            else {
+                continue;
+            }
+
+            Scoped<X509Certificate> x509(new X509Certificate());
+            x509->Assign(cert);
+
+            x509->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
+            x509->ItemByType(CKA_COPYABLE)->To<core::AttributeBool>()->Set(false);
+            x509->ItemByType(CKA_MODIFIABLE)->To<core::AttributeBool>()->Set(false);
+
+            AddObject(GetObjectId(x509, { CKA_ISSUER, CKA_SERIAL_NUMBER }), x509);
+
+            if (privateKey && publicKey) {
+                auto attrID = x509->ItemByType(CKA_ID)->To<core::AttributeBytes>()->ToValue();
+                privateKey->ItemByType(CKA_ID)->SetValue(attrID->data(), attrID->size());
+                privateKey->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
+                privateKey->ItemByType(CKA_COPYABLE)->To<core::AttributeBool>()->Set(false);
+                privateKey->ItemByType(CKA_MODIFIABLE)->To<core::AttributeBool>()->Set(false);
+
+                publicKey->ItemByType(CKA_ID)->SetValue(attrID->data(), attrID->size());
+                publicKey->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
+                publicKey->ItemByType(CKA_COPYABLE)->To<core::AttributeBool>()->Set(false);
+                publicKey->ItemByType(CKA_MODIFIABLE)->To<core::AttributeBool>()->Set(false);
+
+                AddObject(GetKeyId(publicKey, pKeyProvInfo->pwszProvName, pKeyProvInfo->pwszContainerName, pKeyProvInfo->dwKeySpec), publicKey);
+                AddObject(GetKeyId(privateKey, pKeyProvInfo->pwszProvName, pKeyProvInfo->pwszContainerName, pKeyProvInfo->dwKeySpec), privateKey);
+            }
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void mscapi::Store::LoadRequestStore()
+{
+    try {
+        Scoped<crypt::CertStore> requestStore(new crypt::CertStore());
+        requestStore->Open(PV_STORE_NAME_REQUEST);
+        requestStore->HasChanged();
+
+        auto certs = requestStore->GetCertificates();
+
+        for (ULONG i = 0; i < certs.size(); i++) {
+            auto cert = certs.at(i);
+            if (cert->HasProperty(CERT_PV_REQUEST) && cert->HasProperty(CERT_PV_ID)) {
+                Scoped<X509CertificateRequest> object(new X509CertificateRequest());
+                object->Assign(cert);
+
+                object->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
+                object->ItemByType(CKA_COPYABLE)->To<core::AttributeBool>()->Set(false);
+                object->ItemByType(CKA_MODIFIABLE)->To<core::AttributeBool>()->Set(false);
+
+                AddObject(GetObjectId(object, { CKA_OBJECT_ID }), object);
+            }
+        }
+
+        certStores.push_back(requestStore);
+    }
+    CATCH_EXCEPTION
+}
+
+void mscapi::Store::LoadCngKeys()
+{
+    try {
+        Scoped<ncrypt::Provider> provider(new ncrypt::Provider());
+        provider->Open(MS_KEY_STORAGE_PROVIDER, 0);
+
+        auto keyNames = provider->GetKeyNames(0);
+        for (ULONG i = 0; i < keyNames->size(); i++) {
+            auto keyName = keyNames->at(i);
+            auto key = provider->OpenKey(keyName->pszName, keyName->dwLegacyKeySpec, keyName->dwFlags);
+            auto propAlgGroup = key->GetBytesW(NCRYPT_ALGORITHM_GROUP_PROPERTY);
+            Scoped<core::Object> privateKey;
+            Scoped<core::Object> publicKey;
+            if (!wmemcmp(propAlgGroup->c_str(), NCRYPT_RSA_ALGORITHM_GROUP, lstrlenW(NCRYPT_RSA_ALGORITHM_GROUP))) {
+                auto rsaPrivateKey = Scoped<RsaPrivateKey>(new RsaPrivateKey());
+                rsaPrivateKey->Assign(key);
+                auto rsaPublicKey = Scoped<RsaPublicKey>(new RsaPublicKey());
+                rsaPublicKey->Assign(key);
+                privateKey = rsaPrivateKey;
+                publicKey = rsaPublicKey;
+            }
+            else if (!wmemcmp(propAlgGroup->c_str(), NCRYPT_ECDH_ALGORITHM_GROUP, lstrlenW(NCRYPT_ECDH_ALGORITHM_GROUP)) ||
+                !wmemcmp(propAlgGroup->c_str(), NCRYPT_ECDSA_ALGORITHM_GROUP, lstrlenW(NCRYPT_ECDSA_ALGORITHM_GROUP))) {
+                auto ecPrivateKey = Scoped<EcPrivateKey>(new EcPrivateKey());
+                ecPrivateKey->Assign(key);
+                auto ecPublicKey = Scoped<EcPublicKey>(new EcPublicKey());
+                ecPublicKey->Assign(key);
+                privateKey = ecPrivateKey;
+                publicKey = ecPublicKey;
+            }
+            else {
+                // Unsupported algorithm
+                continue;
+            }
+
+            auto attrID = key->GetId();
+            privateKey->ItemByType(CKA_ID)->SetValue(attrID->data(), attrID->size());
+            privateKey->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
+            privateKey->ItemByType(CKA_COPYABLE)->To<core::AttributeBool>()->Set(false);
+            privateKey->ItemByType(CKA_MODIFIABLE)->To<core::AttributeBool>()->Set(false);
+
+            publicKey->ItemByType(CKA_ID)->SetValue(attrID->data(), attrID->size());
+            publicKey->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
+            publicKey->ItemByType(CKA_COPYABLE)->To<core::AttributeBool>()->Set(false);
+            publicKey->ItemByType(CKA_MODIFIABLE)->To<core::AttributeBool>()->Set(false);
+
+            AddObject(GetKeyId(publicKey, MS_KEY_STORAGE_PROVIDER, keyName->pszName, keyName->dwLegacyKeySpec), publicKey);
+            AddObject(GetKeyId(privateKey, MS_KEY_STORAGE_PROVIDER, keyName->pszName, keyName->dwLegacyKeySpec), privateKey);
+        }
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "../core/store.h"
+#include "crypt/crypt.h"
+
+namespace mscapi {
+
+	/**
+	 * Certificates of the MY store, certificate requests and CNG keys
+	 */
+	class Store : public core::Store
+	{
+	public:
+		Store();
+		~Store();
+
+	protected:
+		std::vector<Scoped<crypt::CertStore> > certStores;
+		// change notification of the directory with CNG keys of the user
+		HANDLE                                 keysChange;
+
+		void Load();
+
+		/**
+		 * Reloads the store if certificate stores or CNG keys were changed
+		 */
+		void Update();
+
+		void WatchCngKeys();
+
+		void LoadMyStore();
+		void LoadRequestStore();
+		void LoadCngKeys();
+	};
+
+}
@@ -75,6 +75,11 @@ namespace osx {
          CK_ULONG_PTR      pulEncryptedPartLen
          );
         
+        CK_ULONG GetUpdateLength
+        (
+         CK_ULONG          ulPartLen
+         );
+        
         CK_RV Final
         (
          CK_BYTE_PTR       pLastEncryptedPart,
@@ -112,6 +117,11 @@ namespace osx {
          CK_ULONG_PTR      pulEncryptedPartLen
          );
         
+        CK_ULONG GetUpdateLength
+        (
+         CK_ULONG          ulPartLen
+         );
+        
         CK_RV Final
         (
          CK_BYTE_PTR       pLastEncryptedPart,
@@ -126,6 +136,60 @@ namespace osx {
         CK_ULONG               blockLength;
     };
     
+    class CryptoAesGCMMessageEncrypt : public core::CryptoGcmMessageEncrypt {
+    public:
+        CryptoAesGCMMessageEncrypt(
+                                   CK_BBOOL type
+                                   );
+        
+        ~CryptoAesGCMMessageEncrypt();
+        
+        CK_RV Init
+        (
+         CK_MECHANISM_PTR        pMechanism,
+         Scoped<core::Object>    hKey
+         );
+        
+        CK_RV Final();
+        
+    protected:
+        // GCM context with the expanded key, it is reset for each message
+        CCCryptorRef           cryptor;
+        
+        void GcmBegin
+        (
+         CK_BYTE_PTR       pIv,
+         CK_ULONG          ulIvLen,
+         CK_BYTE_PTR       pAssociatedData,
+         CK_ULONG          ulAssociatedDataLen,
+         CK_ULONG          ulTagLen
+         );
+        
+        void GcmRandom
+        (
+         CK_BYTE_PTR       pbData,
+         CK_ULONG          ulDataLen
+         );
+        
+        void GcmUpdate
+        (
+         CK_BYTE_PTR       pData,
+         CK_ULONG          ulDataLen,
+         CK_BYTE_PTR       pOutput
+         );
+        
+        bool GcmFinal
+        (
+         CK_BYTE_PTR       pData,
+         CK_ULONG          ulDataLen,
+         CK_BYTE_PTR       pOutput,
+         CK_BYTE_PTR       pTag,
+         CK_ULONG          ulTagLen
+         );
+        
+        void Release();
+    };
+    
     class RsaPKCS1Sign : public core::CryptoSign {
     public:
         RsaPKCS1Sign(CK_BBOOL type);
@@ -1,6 +1,7 @@
 #include "../crypto.h"
 
 #include "CommonCryptoSPI.h"
+#include <CommonCrypto/CommonRandom.h>
 
 using namespace osx;
 
@@ -94,6 +95,21 @@ CK_RV osx::CryptoAesEncrypt::Update
     CATCH_EXCEPTION
 }
 
+CK_ULONG osx::CryptoAesEncrypt::GetUpdateLength
+(
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        
+        return (CK_ULONG)CCCryptorGetOutputLength(cryptor, ulPartLen, false);
+    }
+    CATCH_EXCEPTION
+}
+
 CK_RV osx::CryptoAesEncrypt::Final
 (
     CK_BYTE_PTR       pLastEncryptedPart,
@@ -258,6 +274,14 @@ CK_RV CryptoAesGCMEncrypt::Update
     THROW_PKCS11_MECHANISM_INVALID();
 }
 
+CK_ULONG CryptoAesGCMEncrypt::GetUpdateLength
+(
+ CK_ULONG          ulPartLen
+ )
+{
+    THROW_PKCS11_MECHANISM_INVALID();
+}
+
 CK_RV CryptoAesGCMEncrypt::Final
 (
  CK_BYTE_PTR       pLastEncryptedPart,
@@ -267,3 +291,148 @@ CK_RV CryptoAesGCMEncrypt::Final
     THROW_PKCS11_MECHANISM_INVALID();
 }
 
+// AES-GCM message-based encryption
+
+CryptoAesGCMMessageEncrypt::CryptoAesGCMMessageEncrypt
+(
+ CK_BBOOL type
+ ) :
+core::CryptoGcmMessageEncrypt(type),
+cryptor(NULL)
+{}
+
+CryptoAesGCMMessageEncrypt::~CryptoAesGCMMessageEncrypt()
+{
+    Release();
+}
+
+void CryptoAesGCMMessageEncrypt::Release()
+{
+    if (cryptor) {
+        CCCryptorRelease(cryptor);
+        cryptor = NULL;
+    }
+}
+
+CK_RV CryptoAesGCMMessageEncrypt::Init
+(
+ CK_MECHANISM_PTR        pMechanism,
+ Scoped<core::Object>    key
+ )
+{
+    try {
+        core::CryptoGcmMessageEncrypt::Init(pMechanism, key);
+        
+        AesKey* aesKey = dynamic_cast<AesKey*>(key.get());
+        if (!aesKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key must be AES");
+        }
+        
+        // Key schedule and GHASH key are computed once for all messages
+        Scoped<Buffer> keyData = aesKey->ItemByType(CKA_VALUE)->To<core::AttributeBytes>()->ToValue();
+        Release();
+        CCCryptorStatus status = CCCryptorCreateWithMode(
+            type == CRYPTO_ENCRYPT ? kCCEncrypt : kCCDecrypt,
+            (CCMode)kCCModeGCM,
+            kCCAlgorithmAES,
+            ccNoPadding,
+            NULL,
+            keyData->data(),
+            keyData->size(),
+            NULL, 0, 0, 0, &cryptor
+        );
+        if (status) {
+            THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "Error on CCCryptorCreateWithMode");
+        }
+        
+        active = true;
+        
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV CryptoAesGCMMessageEncrypt::Final()
+{
+    try {
+        core::CryptoGcmMessageEncrypt::Final();
+        
+        Release();
+        
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+void CryptoAesGCMMessageEncrypt::GcmBegin
+(
+ CK_BYTE_PTR       pIv,
+ CK_ULONG          ulIvLen,
+ CK_BYTE_PTR       pAssociatedData,
+ CK_ULONG          ulAssociatedDataLen,
+ CK_ULONG          ulTagLen
+ )
+{
+    if (CCCryptorGCMReset(cryptor)) {
+        THROW_EXCEPTION("Error on CCCryptorGCMReset");
+    }
+    if (CCCryptorGCMAddIV(cryptor, pIv, ulIvLen)) {
+        THROW_EXCEPTION("Error on CCCryptorGCMAddIV");
+    }
+    if (ulAssociatedDataLen && CCCryptorGCMAddAAD(cryptor, pAssociatedData, ulAssociatedDataLen)) {
+        THROW_EXCEPTION("Error on CCCryptorGCMAddAAD");
+    }
+}
+
+void CryptoAesGCMMessageEncrypt::GcmRandom
+(
+ CK_BYTE_PTR       pbData,
+ CK_ULONG          ulDataLen
+ )
+{
+    if (CCRandomGenerateBytes(pbData, ulDataLen) != kCCSuccess) {
+        THROW_EXCEPTION("Error on CCRandomGenerateBytes");
+    }
+}
+
+void CryptoAesGCMMessageEncrypt::GcmUpdate
+(
+ CK_BYTE_PTR       pData,
+ CK_ULONG          ulDataLen,
+ CK_BYTE_PTR       pOutput
+ )
+{
+    if (!ulDataLen) {
+        return;
+    }
+    CCCryptorStatus status = type == CRYPTO_ENCRYPT
+        ? CCCryptorGCMEncrypt(cryptor, pData, ulDataLen, pOutput)
+        : CCCryptorGCMDecrypt(cryptor, pData, ulDataLen, pOutput);
+    if (status) {
+        THROW_EXCEPTION("Error on CCCryptorGCMEncrypt");
+    }
+}
+
+bool CryptoAesGCMMessageEncrypt::GcmFinal
+(
+ CK_BYTE_PTR       pData,
+ CK_ULONG          ulDataLen,
+ CK_BYTE_PTR       pOutput,
+ CK_BYTE_PTR       pTag,
+ CK_ULONG          ulTagLen
+ )
+{
+    GcmUpdate(pData, ulDataLen, pOutput);
+    
+    CK_BYTE tag[16];
+    size_t tagLen = ulTagLen;
+    if (CCCryptorGCMFinal(cryptor, tag, &tagLen)) {
+        THROW_EXCEPTION("Error on CCCryptorGCMFinal");
+    }
+    
+    if (type == CRYPTO_ENCRYPT) {
+        memcpy(pTag, tag, ulTagLen);
+        return true;
+    }
+    return timingsafe_bcmp(tag, pTag, ulTagLen) == 0;
+}
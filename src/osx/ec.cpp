@@ -351,6 +351,11 @@ void osx::EcPrivateKey::Assign(SecKeyRef key)
     if (CFBooleanGetValue(cfExtractable)) {
         ItemByType(CKA_EXTRACTABLE)->To<core::AttributeBool>()->Set(true);
     }
+    
+    SetProvider(
+        { CKA_EC_PARAMS },
+        std::bind(&EcPrivateKey::FillPublicKeyStruct, this)
+    );
 }
 
 CK_RV osx::EcPrivateKey::CopyValues
@@ -389,14 +394,6 @@ void osx::EcPrivateKey::FillPublicKeyStruct()
             THROW_EXCEPTION("Error on SecKeyCopyAttributes");
         }
         
-        CFDataRef cfLabel = (CFDataRef)CFDictionaryGetValue(&cfAttributes, kSecAttrApplicationLabel);
-        if (cfLabel) {
-            ItemByType(CKA_LABEL)->To<core::AttributeBytes>()->SetValue(
-                                                                        (CK_BYTE_PTR)CFDataGetBytePtr(cfLabel),
-                                                                        CFDataGetLength(cfLabel)
-                                                                        );
-        }
-        
         CFNumberRef cfKeySizeInBits = (CFNumberRef)CFDictionaryGetValue(&cfAttributes, kSecAttrKeySizeInBits);
         if (!cfKeySizeInBits) {
             THROW_EXCEPTION("Cannot get size of key");
@@ -464,11 +461,6 @@ CK_RV osx::EcPrivateKey::GetValue
 {
     try {
         switch (attr->type) {
-            case CKA_EC_PARAMS:
-                if (ItemByType(attr->type)->IsEmpty()) {
-                    FillPublicKeyStruct();
-                }
-                break;
             case CKA_VALUE:
                 if (ItemByType(attr->type)->IsEmpty()) {
                     FillPrivateKeyStruct();
@@ -578,6 +570,14 @@ void osx::EcPublicKey::Assign(SecKeyRef key)
             THROW_EXCEPTION("Error on SecKeyCopyAttributes");
         }
         
+        CFDataRef cfLabel = (CFDataRef)CFDictionaryGetValue(&cfAttributes, kSecAttrApplicationLabel);
+        if (cfLabel) {
+            ItemByType(CKA_LABEL)->To<core::AttributeBytes>()->SetValue(
+                                                                        (CK_BYTE_PTR)CFDataGetBytePtr(cfLabel),
+                                                                        CFDataGetLength(cfLabel)
+                                                                        );
+        }
+        
         CFDataRef cfAppLabel = (CFDataRef)CFDictionaryGetValue(&cfAttributes, kSecAttrApplicationLabel);
         if (cfAppLabel) {
             ItemByType(CKA_ID)->To<core::AttributeBytes>()->Set((CK_BYTE_PTR)CFDataGetBytePtr(cfAppLabel),
@@ -596,7 +596,10 @@ void osx::EcPublicKey::Assign(SecKeyRef key)
             ItemByType(CKA_WRAP)->To<core::AttributeBool>()->Set(true);
         }
         
-        FillKeyStruct();
+        SetProvider(
+            { CKA_EC_PARAMS, CKA_EC_POINT },
+            std::bind(&EcPublicKey::FillKeyStruct, this)
+        );
     }
     CATCH_EXCEPTION
 }
@@ -609,14 +612,6 @@ void osx::EcPublicKey::FillKeyStruct()
             THROW_EXCEPTION("Error on SecKeyCopyAttributes");
         }
         
-        CFDataRef cfLabel = (CFDataRef)CFDictionaryGetValue(&cfAttributes, kSecAttrApplicationLabel);
-        if (cfLabel) {
-            ItemByType(CKA_LABEL)->To<core::AttributeBytes>()->SetValue(
-                                                                        (CK_BYTE_PTR)CFDataGetBytePtr(cfLabel),
-                                                                        CFDataGetLength(cfLabel)
-                                                                        );
-        }
-        
         // Get key size
         CFNumberRef cfKeySizeInBits = (CFNumberRef)CFDictionaryGetValue(&cfAttributes, kSecAttrKeySizeInBits);
         if (!cfKeySizeInBits) {
@@ -652,25 +647,3 @@ void osx::EcPublicKey::FillKeyStruct()
     }
     CATCH_EXCEPTION
 }
-
-CK_RV osx::EcPublicKey::GetValue
-(
- CK_ATTRIBUTE_PTR  attr
- )
-{
-    try {
-        switch (attr->type) {
-            case CKA_EC_PARAMS:
-            case CKA_EC_POINT:
-                if (ItemByType(attr->type)->IsEmpty()) {
-                    FillKeyStruct();
-                }
-                break;
-            default:
-                return core::EcPublicKey::GetValue(attr);
-        }
-        
-        return CKR_OK;
-    }
-    CATCH_EXCEPTION
-}
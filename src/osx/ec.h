@@ -69,11 +69,6 @@ namespace osx {
         
     protected:
         void FillKeyStruct();
-        
-        CK_RV GetValue
-        (
-         CK_ATTRIBUTE_PTR  attr
-         );
     };
     
 }
@@ -160,6 +160,11 @@ void osx::RsaPrivateKey::Assign(SecKeyRef key)
     if (CFBooleanGetValue(cfExtractable)) {
         ItemByType(CKA_EXTRACTABLE)->To<core::AttributeBool>()->Set(true);
     }
+    
+    SetProvider(
+        { CKA_MODULUS, CKA_PUBLIC_EXPONENT },
+        std::bind(&RsaPrivateKey::FillPublicKeyStruct, this)
+    );
 }
 
 CK_RV osx::RsaPrivateKey::CopyValues
@@ -285,14 +290,6 @@ CK_RV osx::RsaPrivateKey::GetValue
 {
     try {
         switch (attr->type) {
-            case CKA_MODULUS:
-            case CKA_PUBLIC_EXPONENT:
-            {
-                if (ItemByType(attr->type)->IsEmpty()) {
-                    FillPublicKeyStruct();
-                }
-                break;
-            }
             case CKA_PRIME_1:
             case CKA_PRIME_2:
             case CKA_EXPONENT_1:
@@ -401,6 +398,14 @@ void osx::RsaPublicKey::Assign(SecKeyRef key)
         if (cfAttributes.IsEmpty()) {
             THROW_EXCEPTION("Error on SecKeyCopyAttributes");
         }
+        CFDataRef cfLabel = (CFDataRef)CFDictionaryGetValue(&cfAttributes, kSecAttrApplicationLabel);
+        if (cfLabel) {
+            ItemByType(CKA_LABEL)->To<core::AttributeBytes>()->SetValue(
+                                                                        (CK_BYTE_PTR)CFDataGetBytePtr(cfLabel),
+                                                                        CFDataGetLength(cfLabel)
+                                                                        );
+        }
+        
         CFDataRef cfAppLabel = (CFDataRef)CFDictionaryGetValue(&cfAttributes, kSecAttrApplicationLabel);
         if (cfAppLabel) {
             ItemByType(CKA_ID)->To<core::AttributeBytes>()->Set((CK_BYTE_PTR)CFDataGetBytePtr(cfAppLabel),
@@ -419,7 +424,10 @@ void osx::RsaPublicKey::Assign(SecKeyRef key)
             ItemByType(CKA_WRAP)->To<core::AttributeBool>()->Set(true);
         }
         
-        FillKeyStruct();
+        SetProvider(
+            { CKA_MODULUS, CKA_MODULUS_BITS, CKA_PUBLIC_EXPONENT },
+            std::bind(&RsaPublicKey::FillKeyStruct, this)
+        );
     }
     CATCH_EXCEPTION
 }
@@ -432,14 +440,6 @@ void osx::RsaPublicKey::FillKeyStruct()
             THROW_EXCEPTION("Error on SecKeyCopyAttributes");
         }
         
-        CFDataRef cfLabel = (CFDataRef)CFDictionaryGetValue(&cfAttributes, kSecAttrApplicationLabel);
-        if (cfLabel) {
-            ItemByType(CKA_LABEL)->To<core::AttributeBytes>()->SetValue(
-                                                                        (CK_BYTE_PTR)CFDataGetBytePtr(cfLabel),
-                                                                        CFDataGetLength(cfLabel)
-                                                                        );
-        }
-        
         // Get public key SEQUENCE
         CFRef<CFDataRef> cfKeyData = SecKeyCopyExternalRepresentation(&value, NULL);
         if (cfKeyData.IsEmpty()) {
@@ -476,25 +476,3 @@ void osx::RsaPublicKey::FillKeyStruct()
     }
     CATCH_EXCEPTION
 }
-
-CK_RV osx::RsaPublicKey::GetValue
-(
- CK_ATTRIBUTE_PTR  attr
- )
-{
-    try {
-        switch (attr->type) {
-            case CKA_MODULUS:
-            case CKA_MODULUS_BITS:
-            case CKA_PUBLIC_EXPONENT: {
-                if (ItemByType(attr->type)->IsEmpty()) {
-                    FillKeyStruct();
-                }
-                break;
-            }
-        }
-        
-        return CKR_OK;
-    }
-    CATCH_EXCEPTION
-}
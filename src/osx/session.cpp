@@ -16,84 +16,6 @@
 
 using namespace osx;
 
-/*
- Creates copy for SecKeyRef by getting the same SecKeyRef from Keychain
- If it cannot get SecKeyRef from chain it returns NULL
- */
-SecKeyRef SecKeyCopyRef(SecKeyRef key) {
-    CFRef<CFDictionaryRef> attrs = SecKeyCopyAttributes(key);
-    CFDataRef klbl = (CFDataRef)CFDictionaryGetValue(&attrs, kSecAttrApplicationLabel);
-    if (klbl == NULL) {
-        return NULL;
-    }
-    CFStringRef kcls = (CFStringRef) CFDictionaryGetValue(&attrs, kSecAttrKeyClass);
-    if (kcls == NULL) {
-        return NULL;
-    }
-    
-    // create query
-    CFRef<CFMutableDictionaryRef> matchAttr = CFDictionaryCreateMutable(kCFAllocatorDefault,
-                                                                        0,
-                                                                        &kCFTypeDictionaryKeyCallBacks,
-                                                                        &kCFTypeDictionaryValueCallBacks);
-    CFDictionaryAddValue(&matchAttr, kSecClass, kSecClassKey);
-    CFDictionaryAddValue(&matchAttr, kSecAttrApplicationLabel, klbl);
-    CFDictionaryAddValue(&matchAttr, kSecReturnRef, kCFBooleanTrue);
-    
-    SecKeyRef result = NULL;
-    OSStatus status = SecItemCopyMatching(&matchAttr, (CFTypeRef*)&result);
-    if (status) {
-        return NULL;
-    }
-    return result;
-}
-
-/*
- Copies SecKeyRef to core::Objecte
- */
-Scoped<core::Object> SecKeyCopyObject(SecKeyRef key) {
-    try {
-        if (key == NULL) {
-            THROW_EXCEPTION("Parameter 'key' is empry");
-        }
-        Scoped<core::Object> result;
-        SecKeyRef copyKey = SecKeyCopyRef(key);
-        if (copyKey == NULL){
-            THROW_EXCEPTION("Cannot copy SekKeyRef");
-        }
-        CFRef<CFDictionaryRef> attrs = SecKeyCopyAttributes(copyKey);
-        CFStringRef keyType  = (CFStringRef)CFDictionaryGetValue(&attrs, kSecAttrKeyType);
-        CFStringRef keyClass  = (CFStringRef)CFDictionaryGetValue(&attrs, kSecAttrKeyClass);
-        if (CFStringCompare(keyType, kSecAttrKeyTypeRSA, kCFCompareCaseInsensitive) == kCFCompareEqualTo) {
-            if (CFStringCompare(keyClass, kSecAttrKeyClassPrivate, kCFCompareCaseInsensitive) == kCFCompareEqualTo) {
-                Scoped<RsaPrivateKey> rsaKey(new RsaPrivateKey);
-                rsaKey->Assign(copyKey);
-                result = rsaKey;
-            } else {
-                Scoped<RsaPublicKey> rsaKey(new RsaPublicKey);
-                rsaKey->Assign(copyKey);
-                result = rsaKey;
-            }
-        } else if (CFStringCompare(keyType, kSecAttrKeyTypeEC, kCFCompareCaseInsensitive) == kCFCompareEqualTo) {
-            if (CFStringCompare(keyClass, kSecAttrKeyClassPrivate, kCFCompareCaseInsensitive) == kCFCompareEqualTo) {
-                Scoped<EcPrivateKey> ecKey(new EcPrivateKey);
-                ecKey->Assign(copyKey);
-                result = ecKey;
-            } else {
-                Scoped<EcPublicKey> ecKey(new EcPublicKey);
-                ecKey->Assign(copyKey);
-                result = ecKey;
-            }
-        } else {
-            THROW_EXCEPTION("Unsupported key type in use");
-        }
-        
-        return result;
-    }
-    CATCH_EXCEPTION
-}
-
-
 Scoped<core::Object> osx::Session::CreateObject
 (
  CK_ATTRIBUTE_PTR        pTemplate,   /* the object's template */
@@ -197,114 +119,6 @@ CK_RV osx::Session::Open
         sign = Scoped<core::CryptoSign>(new core::CryptoSign(CRYPTO_SIGN));
         verify = Scoped<core::CryptoSign>(new core::CryptoSign(CRYPTO_VERIFY));
         
-        OSStatus status;
-        
-        // Get keychain certificates and linked keys
-        {
-            SecKeychainRef loginKeychain;
-            const char* HOME = getenv("HOME");
-            std::string loginKeyChainPath("");
-            loginKeyChainPath += HOME;
-            loginKeyChainPath += "/Library/Keychains/login.keychain";
-            OSStatus status = SecKeychainOpen(loginKeyChainPath.c_str(), &loginKeychain);
-            if (status) {
-                printf("Error SecKeychainOpen\n");
-            }
-            CFRef<SecKeychainRef> scopedLoginKeychain(loginKeychain);
-            
-            CFRef<CFMutableDictionaryRef> matchAttr = CFDictionaryCreateMutable(kCFAllocatorDefault,
-                                                                                0,
-                                                                                &kCFTypeDictionaryKeyCallBacks,
-                                                                                &kCFTypeDictionaryValueCallBacks);
-            CFDictionaryAddValue(&matchAttr, kSecClass, kSecClassCertificate);
-            CFDictionaryAddValue(&matchAttr, kSecMatchLimit, kSecMatchLimitAll);
-            CFDictionaryAddValue(&matchAttr, kSecReturnRef, kCFBooleanTrue);
-            
-            // Add loging keychain to limit list
-            CFRef<CFArrayRef> matchSearchList;
-            if (loginKeychain){
-                SecKeychainRef keychainArray[] = {loginKeychain};
-                matchSearchList = CFArrayCreate(NULL, (const void**)keychainArray, 1, &kCFTypeArrayCallBacks);
-                CFDictionaryAddValue(&matchAttr, kSecMatchSearchList, &matchSearchList);
-            }
-            
-            CFArrayRef result;
-            status = SecItemCopyMatching(&matchAttr, (CFTypeRef*)&result);
-            if (status) {
-                THROW_OSX_EXCEPTION(status, "SecItemCopyMatching");
-            }
-            CFRef<CFArrayRef> scopedResult(result);
-            CFIndex certCount = CFArrayGetCount(result);
-            
-            CFIndex index = 0;
-            while (index < certCount) {
-                SecCertificateRef cert = (SecCertificateRef)CFArrayGetValueAtIndex(result, index++);
-                CFRef<CFDataRef> certData = SecCertificateCopyData(cert);
-                SecCertificateRef certCopy = SecCertificateCreateWithData(NULL, &certData);
-                
-                Scoped<X509Certificate> x509(new X509Certificate);
-                x509->Assign(certCopy);
-                x509->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
-                
-                try {
-                    
-                    Scoped<core::PublicKey> publicKey = x509->GetPublicKey();
-                    
-                    // don't add keys with specific label. They will be added in the next step
-                    Key* pKey = dynamic_cast<Key*>(publicKey.get());
-                    if (pKey == NULL) {
-                        THROW_EXCEPTION("Cannot convert PublicKey to Key");
-                    }
-                    SecKeyRef secKey = pKey->Get();
-                    CFRef<CFDictionaryRef> attrs = SecKeyCopyAttributes(secKey);
-                    CFStringRef keyLabel = (CFStringRef)CFDictionaryGetValue(&attrs, kSecAttrLabel);
-                    if (!(keyLabel &&
-                          CFStringCompare(keyLabel, kSecAttrLabelModule, kCFCompareCaseInsensitive) == kCFCompareEqualTo)) {
-                        
-                        publicKey->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
-                    
-                        if (x509->HasPrivateKey()) {
-                            Scoped<core::PrivateKey> privateKey = x509->GetPrivateKey();
-                            privateKey->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
-                            objects.add(privateKey);
-                        }
-                        objects.add(publicKey);
-                    }
-                    
-                    objects.add(x509);
-                }
-                catch(...) {
-                    puts("Error: Cannot get keys for certificate");
-                }
-            }
-        }
-
-        // Get all keys from keychain matching to label
-        {
-            CFRef<CFMutableDictionaryRef> matchAttr = CFDictionaryCreateMutable(kCFAllocatorDefault,
-                                                                                0,
-                                                                                &kCFTypeDictionaryKeyCallBacks,
-                                                                                &kCFTypeDictionaryValueCallBacks);
-            CFDictionaryAddValue(&matchAttr, kSecClass, kSecClassKey);
-            CFDictionaryAddValue(&matchAttr, kSecMatchLimit, kSecMatchLimitAll);
-            CFDictionaryAddValue(&matchAttr, kSecAttrLabel, kSecAttrLabelModule);
-            CFDictionaryAddValue(&matchAttr, kSecReturnRef, kCFBooleanTrue);
-            
-            CFArrayRef result;
-            status = SecItemCopyMatching(&matchAttr, (CFTypeRef*)&result);
-            if (!status) {
-                CFRef<CFArrayRef> scopedResult(result);
-                CFIndex arrayCount = CFArrayGetCount(result);
-                
-                CFIndex index = 0;
-                while (index < arrayCount) {
-                    SecKeyRef secKey = (SecKeyRef)CFArrayGetValueAtIndex(result, index++);
-                    Scoped<core::Object> key = SecKeyCopyObject(secKey);
-                    key->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
-                    objects.add(key);
-                }
-            }
-        }
         return CKR_OK;
     }
     CATCH_EXCEPTION
@@ -560,6 +374,62 @@ CK_RV osx::Session::DecryptInit
     CATCH_EXCEPTION;
 }
 
+CK_RV osx::Session::MessageEncryptInit
+(
+ CK_MECHANISM_PTR  pMechanism,
+ CK_OBJECT_HANDLE  hKey
+ )
+{
+    try {
+        core::Session::MessageEncryptInit(
+                                          pMechanism,
+                                          hKey
+                                          );
+        
+        switch (pMechanism->mechanism) {
+            case CKM_AES_GCM:
+                messageEncrypt = Scoped<CryptoAesGCMMessageEncrypt>(new CryptoAesGCMMessageEncrypt(CRYPTO_ENCRYPT));
+                break;
+            default:
+                THROW_PKCS11_MECHANISM_INVALID();
+        }
+        
+        return messageEncrypt->Init(
+                                    pMechanism,
+                                    GetObject(hKey)
+                                    );
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV osx::Session::MessageDecryptInit
+(
+ CK_MECHANISM_PTR  pMechanism,
+ CK_OBJECT_HANDLE  hKey
+ )
+{
+    try {
+        core::Session::MessageDecryptInit(
+                                          pMechanism,
+                                          hKey
+                                          );
+        
+        switch (pMechanism->mechanism) {
+            case CKM_AES_GCM:
+                messageDecrypt = Scoped<CryptoAesGCMMessageEncrypt>(new CryptoAesGCMMessageEncrypt(CRYPTO_DECRYPT));
+                break;
+            default:
+                THROW_PKCS11_MECHANISM_INVALID();
+        }
+        
+        return messageDecrypt->Init(
+                                    pMechanism,
+                                    GetObject(hKey)
+                                    );
+    }
+    CATCH_EXCEPTION;
+}
+
 CK_RV osx::Session::SignInit
 (
  CK_MECHANISM_PTR  pMechanism,
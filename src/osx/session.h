@@ -78,6 +78,18 @@ namespace osx {
          CK_OBJECT_HANDLE  hKey       
          );
         
+        CK_RV MessageEncryptInit
+        (
+         CK_MECHANISM_PTR  pMechanism,
+         CK_OBJECT_HANDLE  hKey
+         );
+        
+        CK_RV MessageDecryptInit
+        (
+         CK_MECHANISM_PTR  pMechanism,
+         CK_OBJECT_HANDLE  hKey
+         );
+        
         CK_RV SignInit
         (
          CK_MECHANISM_PTR  pMechanism,
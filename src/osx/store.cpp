@@ -0,0 +1,271 @@
+#include "store.h"
+
+#include "crypto.h"
+#include "rsa.h"
+#include "ec.h"
+
+#include "certificate.h"
+#include "helper.h"
+
+#include <sys/stat.h>
+#include <CommonCrypto/CommonDigest.h>
+
+using namespace osx;
+
+/*
+ Returns storage identity of the key. Keychain identifies key pair by kSecAttrApplicationLabel,
+ which is the hash of the public key, so keys with the same or empty CKA_ID don't collide.
+ SHA-256 of the key data is used for keys without the label (public keys of certificates)
+ */
+static std::string GetKeyId(Scoped<core::Object> object) {
+    try {
+        Key* key = dynamic_cast<Key*>(object.get());
+        if (key == NULL) {
+            THROW_EXCEPTION("Cannot convert Object to Key");
+        }
+        
+        Buffer reference;
+        CFRef<CFDictionaryRef> attrs = SecKeyCopyAttributes(key->Get());
+        CFDataRef label = attrs.IsEmpty() ? NULL : (CFDataRef)CFDictionaryGetValue(&attrs, kSecAttrApplicationLabel);
+        if (label && CFDataGetLength(label)) {
+            reference.assign(CFDataGetBytePtr(label), CFDataGetBytePtr(label) + CFDataGetLength(label));
+        }
+        else {
+            CFRef<CFDataRef> data = SecKeyCopyExternalRepresentation(key->Get(), NULL);
+            if (data.IsEmpty()) {
+                THROW_EXCEPTION("Error on SecKeyCopyExternalRepresentation");
+            }
+            reference.resize(CC_SHA256_DIGEST_LENGTH);
+            CC_SHA256(CFDataGetBytePtr(&data), (CC_LONG)CFDataGetLength(&data), reference.data());
+        }
+        
+        return core::Store::GetObjectId(object, reference);
+    }
+    CATCH_EXCEPTION
+}
+
+/*
+ Returns modification time and size of the login keychain files. Keychain has no change
+ notifications without a run loop, so writes are detected by the files
+ */
+static std::string GetKeychainStamp() {
+    const char* HOME = getenv("HOME");
+    const char* names[] = { "/Library/Keychains/login.keychain-db", "/Library/Keychains/login.keychain" };
+    std::string res;
+    for (size_t i = 0; HOME && i < sizeof(names) / sizeof(names[0]); i++) {
+        std::string path(HOME);
+        path += names[i];
+        struct stat st;
+        if (!stat(path.c_str(), &st)) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%ld.%ld/%lld;", (long)st.st_mtimespec.tv_sec, (long)st.st_mtimespec.tv_nsec, (long long)st.st_size);
+            res += buf;
+        }
+    }
+    return res;
+}
+
+/*
+ Creates copy for SecKeyRef by getting the same SecKeyRef from Keychain
+ If it cannot get SecKeyRef from chain it returns NULL
+ */
+SecKeyRef SecKeyCopyRef(SecKeyRef key) {
+    CFRef<CFDictionaryRef> attrs = SecKeyCopyAttributes(key);
+    CFDataRef klbl = (CFDataRef)CFDictionaryGetValue(&attrs, kSecAttrApplicationLabel);
+    if (klbl == NULL) {
+        return NULL;
+    }
+    CFStringRef kcls = (CFStringRef) CFDictionaryGetValue(&attrs, kSecAttrKeyClass);
+    if (kcls == NULL) {
+        return NULL;
+    }
+    
+    // create query
+    CFRef<CFMutableDictionaryRef> matchAttr = CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                                                        0,
+                                                                        &kCFTypeDictionaryKeyCallBacks,
+                                                                        &kCFTypeDictionaryValueCallBacks);
+    CFDictionaryAddValue(&matchAttr, kSecClass, kSecClassKey);
+    CFDictionaryAddValue(&matchAttr, kSecAttrApplicationLabel, klbl);
+    CFDictionaryAddValue(&matchAttr, kSecReturnRef, kCFBooleanTrue);
+    
+    SecKeyRef result = NULL;
+    OSStatus status = SecItemCopyMatching(&matchAttr, (CFTypeRef*)&result);
+    if (status) {
+        return NULL;
+    }
+    return result;
+}
+
+/*
+ Copies SecKeyRef to core::Objecte
+ */
+Scoped<core::Object> SecKeyCopyObject(SecKeyRef key) {
+    try {
+        if (key == NULL) {
+            THROW_EXCEPTION("Parameter 'key' is empry");
+        }
+        Scoped<core::Object> result;
+        SecKeyRef copyKey = SecKeyCopyRef(key);
+        if (copyKey == NULL){
+            THROW_EXCEPTION("Cannot copy SekKeyRef");
+        }
+        CFRef<CFDictionaryRef> attrs = SecKeyCopyAttributes(copyKey);
+        CFStringRef keyType  = (CFStringRef)CFDictionaryGetValue(&attrs, kSecAttrKeyType);
+        CFStringRef keyClass  = (CFStringRef)CFDictionaryGetValue(&attrs, kSecAttrKeyClass);
+        if (CFStringCompare(keyType, kSecAttrKeyTypeRSA, kCFCompareCaseInsensitive) == kCFCompareEqualTo) {
+            if (CFStringCompare(keyClass, kSecAttrKeyClassPrivate, kCFCompareCaseInsensitive) == kCFCompareEqualTo) {
+                Scoped<RsaPrivateKey> rsaKey(new RsaPrivateKey);
+                rsaKey->Assign(copyKey);
+                result = rsaKey;
+            } else {
+                Scoped<RsaPublicKey> rsaKey(new RsaPublicKey);
+                rsaKey->Assign(copyKey);
+                result = rsaKey;
+            }
+        } else if (CFStringCompare(keyType, kSecAttrKeyTypeEC, kCFCompareCaseInsensitive) == kCFCompareEqualTo) {
+            if (CFStringCompare(keyClass, kSecAttrKeyClassPrivate, kCFCompareCaseInsensitive) == kCFCompareEqualTo) {
+                Scoped<EcPrivateKey> ecKey(new EcPrivateKey);
+                ecKey->Assign(copyKey);
+                result = ecKey;
+            } else {
+                Scoped<EcPublicKey> ecKey(new EcPublicKey);
+                ecKey->Assign(copyKey);
+                result = ecKey;
+            }
+        } else {
+            THROW_EXCEPTION("Unsupported key type in use");
+        }
+        
+        return result;
+    }
+    CATCH_EXCEPTION
+}
+
+void osx::Store::Update()
+{
+    try {
+        if (GetKeychainStamp() != keychainStamp) {
+            Load();
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void osx::Store::Load()
+{
+    try {
+        RemoveObjects();
+        keychainStamp = GetKeychainStamp();
+        
+        OSStatus status;
+        
+        // Get keychain certificates and linked keys
+        {
+            SecKeychainRef loginKeychain;
+            const char* HOME = getenv("HOME");
+            std::string loginKeyChainPath("");
+            loginKeyChainPath += HOME;
+            loginKeyChainPath += "/Library/Keychains/login.keychain";
+            OSStatus status = SecKeychainOpen(loginKeyChainPath.c_str(), &loginKeychain);
+            if (status) {
+                printf("Error SecKeychainOpen\n");
+            }
+            CFRef<SecKeychainRef> scopedLoginKeychain(loginKeychain);
+            
+            CFRef<CFMutableDictionaryRef> matchAttr = CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                                                                0,
+                                                                                &kCFTypeDictionaryKeyCallBacks,
+                                                                                &kCFTypeDictionaryValueCallBacks);
+            CFDictionaryAddValue(&matchAttr, kSecClass, kSecClassCertificate);
+            CFDictionaryAddValue(&matchAttr, kSecMatchLimit, kSecMatchLimitAll);
+            CFDictionaryAddValue(&matchAttr, kSecReturnRef, kCFBooleanTrue);
+            
+            // Add loging keychain to limit list
+            CFRef<CFArrayRef> matchSearchList;
+            if (loginKeychain){
+                SecKeychainRef keychainArray[] = {loginKeychain};
+                matchSearchList = CFArrayCreate(NULL, (const void**)keychainArray, 1, &kCFTypeArrayCallBacks);
+                CFDictionaryAddValue(&matchAttr, kSecMatchSearchList, &matchSearchList);
+            }
+            
+            CFArrayRef result;
+            status = SecItemCopyMatching(&matchAttr, (CFTypeRef*)&result);
+            if (status) {
+                THROW_OSX_EXCEPTION(status, "SecItemCopyMatching");
+            }
+            CFRef<CFArrayRef> scopedResult(result);
+            CFIndex certCount = CFArrayGetCount(result);
+            
+            CFIndex index = 0;
+            while (index < certCount) {
+                SecCertificateRef cert = (SecCertificateRef)CFArrayGetValueAtIndex(result, index++);
+                CFRef<CFDataRef> certData = SecCertificateCopyData(cert);
+                SecCertificateRef certCopy = SecCertificateCreateWithData(NULL, &certData);
+                
+                Scoped<X509Certificate> x509(new X509Certificate);
+                x509->Assign(certCopy);
+                x509->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
+                
+                try {
+                    
+                    Scoped<core::PublicKey> publicKey = x509->GetPublicKey();
+                    
+                    // don't add keys with specific label. They will be added in the next step
+                    Key* pKey = dynamic_cast<Key*>(publicKey.get());
+                    if (pKey == NULL) {
+                        THROW_EXCEPTION("Cannot convert PublicKey to Key");
+                    }
+                    SecKeyRef secKey = pKey->Get();
+                    CFRef<CFDictionaryRef> attrs = SecKeyCopyAttributes(secKey);
+                    CFStringRef keyLabel = (CFStringRef)CFDictionaryGetValue(&attrs, kSecAttrLabel);
+                    if (!(keyLabel &&
+                          CFStringCompare(keyLabel, kSecAttrLabelModule, kCFCompareCaseInsensitive) == kCFCompareEqualTo)) {
+                        
+                        publicKey->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
+                    
+                        if (x509->HasPrivateKey()) {
+                            Scoped<core::PrivateKey> privateKey = x509->GetPrivateKey();
+                            privateKey->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
+                            AddObject(GetKeyId(privateKey), privateKey);
+                        }
+                        AddObject(GetKeyId(publicKey), publicKey);
+                    }
+                    
+                    AddObject(GetObjectId(x509, { CKA_ISSUER, CKA_SERIAL_NUMBER }), x509);
+                }
+                catch(...) {
+                    puts("Error: Cannot get keys for certificate");
+                }
+            }
+        }
+
+        // Get all keys from keychain matching to label
+        {
+            CFRef<CFMutableDictionaryRef> matchAttr = CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                                                                0,
+                                                                                &kCFTypeDictionaryKeyCallBacks,
+                                                                                &kCFTypeDictionaryValueCallBacks);
+            CFDictionaryAddValue(&matchAttr, kSecClass, kSecClassKey);
+            CFDictionaryAddValue(&matchAttr, kSecMatchLimit, kSecMatchLimitAll);
+            CFDictionaryAddValue(&matchAttr, kSecAttrLabel, kSecAttrLabelModule);
+            CFDictionaryAddValue(&matchAttr, kSecReturnRef, kCFBooleanTrue);
+            
+            CFArrayRef result;
+            status = SecItemCopyMatching(&matchAttr, (CFTypeRef*)&result);
+            if (!status) {
+                CFRef<CFArrayRef> scopedResult(result);
+                CFIndex arrayCount = CFArrayGetCount(result);
+                
+                CFIndex index = 0;
+                while (index < arrayCount) {
+                    SecKeyRef secKey = (SecKeyRef)CFArrayGetValueAtIndex(result, index++);
+                    Scoped<core::Object> key = SecKeyCopyObject(secKey);
+                    key->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
+                    AddObject(GetKeyId(key), key);
+                }
+            }
+        }
+    }
+    CATCH_EXCEPTION
+}
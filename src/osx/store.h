@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../core/store.h"
+
+namespace osx {
+    
+    /**
+     * Certificates and keys of the login keychain
+     */
+    class Store : public core::Store {
+    protected:
+        // modification time and size of the login keychain files at the last Load
+        std::string keychainStamp;
+        
+        void Load();
+        
+        /**
+         * Reloads the store if the login keychain was written since the last Load
+         */
+        void Update();
+    };
+    
+}
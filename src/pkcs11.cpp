@@ -12,6 +12,10 @@
 // #endif // TARGET_OS_MAC
 #endif // __APPLE__
 
+#ifdef __linux__
+#include "soft/slot.h"
+#endif // __linux__
+
 #define PV_ENV_ERROR "PV_PKCS11_ERROR"
 /*
 #ifdef _WIN32
@@ -161,11 +165,137 @@ public:
         osxSlot->slotID = pkcs11.slots.count() - 1;
 // #endif // TARGET_OS_MAC
 #endif // __APPLE__
+#ifdef __linux__
+        Scoped<core::Slot> softSlot(new soft::Slot());
+        pkcs11.slots.add(softSlot);
+        softSlot->slotID = pkcs11.slots.count() - 1;
+#endif // __linux__
     }
 };
 
 App app = App();
 
+static CK_PV_FUNCTION_LIST pvFunctionList =
+{
+    // Version information
+    { CK_PV_VERSION_MAJOR, CK_PV_VERSION_MINOR },
+    // Function pointers
+    C_PV_GetAttributeValues,
+    C_PV_DigestBatch,
+    C_PV_SetKeyPairPool,
+    C_PV_GetKeyPairPoolInfo,
+    C_PV_VerifyBatch
+};
+
+static CK_FUNCTION_LIST_3_0 functionList30 =
+{
+    // Version information
+    { 3, 0 },
+    // Function pointers
+    C_Initialize,
+    C_Finalize,
+    C_GetInfo,
+    C_GetFunctionList,
+    C_GetSlotList,
+    C_GetSlotInfo,
+    C_GetTokenInfo,
+    C_GetMechanismList,
+    C_GetMechanismInfo,
+    C_InitToken,
+    C_InitPIN,
+    C_SetPIN,
+    C_OpenSession,
+    C_CloseSession,
+    C_CloseAllSessions,
+    C_GetSessionInfo,
+    C_GetOperationState,
+    C_SetOperationState,
+    C_Login,
+    C_Logout,
+    C_CreateObject,
+    C_CopyObject,
+    C_DestroyObject,
+    C_GetObjectSize,
+    C_GetAttributeValue,
+    C_SetAttributeValue,
+    C_FindObjectsInit,
+    C_FindObjects,
+    C_FindObjectsFinal,
+    C_EncryptInit,
+    C_Encrypt,
+    C_EncryptUpdate,
+    C_EncryptFinal,
+    C_DecryptInit,
+    C_Decrypt,
+    C_DecryptUpdate,
+    C_DecryptFinal,
+    C_DigestInit,
+    C_Digest,
+    C_DigestUpdate,
+    C_DigestKey,
+    C_DigestFinal,
+    C_SignInit,
+    C_Sign,
+    C_SignUpdate,
+    C_SignFinal,
+    C_SignRecoverInit,
+    C_SignRecover,
+    C_VerifyInit,
+    C_Verify,
+    C_VerifyUpdate,
+    C_VerifyFinal,
+    C_VerifyRecoverInit,
+    C_VerifyRecover,
+    C_DigestEncryptUpdate,
+    C_DecryptDigestUpdate,
+    C_SignEncryptUpdate,
+    C_DecryptVerifyUpdate,
+    C_GenerateKey,
+    C_GenerateKeyPair,
+    C_WrapKey,
+    C_UnwrapKey,
+    C_DeriveKey,
+    C_SeedRandom,
+    C_GenerateRandom,
+    C_GetFunctionStatus,
+    C_CancelFunction,
+    C_WaitForSlotEvent,
+    C_GetInterfaceList,
+    C_GetInterface,
+    C_LoginUser,
+    C_SessionCancel,
+    C_MessageEncryptInit,
+    C_EncryptMessage,
+    C_EncryptMessageBegin,
+    C_EncryptMessageNext,
+    C_MessageEncryptFinal,
+    C_MessageDecryptInit,
+    C_DecryptMessage,
+    C_DecryptMessageBegin,
+    C_DecryptMessageNext,
+    C_MessageDecryptFinal,
+    C_MessageSignInit,
+    C_SignMessage,
+    C_SignMessageBegin,
+    C_SignMessageNext,
+    C_MessageSignFinal,
+    C_MessageVerifyInit,
+    C_VerifyMessage,
+    C_VerifyMessageBegin,
+    C_VerifyMessageNext,
+    C_MessageVerifyFinal
+};
+
+static CK_INTERFACE interfaces[] =
+{
+    // the first interface is the default one
+    { (CK_CHAR*)"PKCS 11", &functionList30, 0 },
+    { (CK_CHAR*)"PKCS 11", &functionList, 0 },
+    { (CK_CHAR*)CK_PV_INTERFACE_NAME, &pvFunctionList, 0 }
+};
+
+#define INTERFACE_COUNT (sizeof(interfaces) / sizeof(interfaces[0]))
+
 CK_RV C_GetFunctionList(CK_FUNCTION_LIST_PTR_PTR ppFunctionList)
 {
     INIT_LOG();
@@ -181,6 +311,78 @@ CK_RV C_GetFunctionList(CK_FUNCTION_LIST_PTR_PTR ppFunctionList)
     return CKR_FUNCTION_FAILED;
 }
 
+CK_RV C_PV_GetFunctionList(CK_PV_FUNCTION_LIST_PTR_PTR ppFunctionList)
+{
+    INIT_LOG();
+    try {
+        CHECK_ARGUMENT_NULL(ppFunctionList);
+
+        *ppFunctionList = &pvFunctionList;
+
+        return CKR_OK;
+    }
+    CATCH("C_PV_GetFunctionList");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+CK_RV C_GetInterfaceList(CK_INTERFACE_PTR pInterfacesList, CK_ULONG_PTR pulCount)
+{
+    INIT_LOG();
+    try {
+        CHECK_ARGUMENT_NULL(pulCount);
+
+        if (pInterfacesList == NULL_PTR) {
+            *pulCount = INTERFACE_COUNT;
+            return CKR_OK;
+        }
+        if (*pulCount < INTERFACE_COUNT) {
+            *pulCount = INTERFACE_COUNT;
+            return CKR_BUFFER_TOO_SMALL;
+        }
+
+        memcpy(pInterfacesList, interfaces, sizeof(interfaces));
+        *pulCount = INTERFACE_COUNT;
+
+        return CKR_OK;
+    }
+    CATCH("C_GetInterfaceList");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+CK_RV C_GetInterface(CK_UTF8CHAR_PTR pInterfaceName, CK_VERSION_PTR pVersion, CK_INTERFACE_PTR_PTR ppInterface, CK_FLAGS flags)
+{
+    INIT_LOG();
+    try {
+        CHECK_ARGUMENT_NULL(ppInterface);
+
+        for (size_t i = 0; i < INTERFACE_COUNT; i++) {
+            CK_INTERFACE_PTR pInterface = &interfaces[i];
+            // each function list starts with CK_VERSION
+            CK_VERSION_PTR pListVersion = (CK_VERSION_PTR)pInterface->pFunctionList;
+
+            if (pInterfaceName && strcmp((char*)pInterfaceName, (char*)pInterface->pInterfaceName)) {
+                continue;
+            }
+            if (pVersion && (pVersion->major != pListVersion->major || pVersion->minor != pListVersion->minor)) {
+                continue;
+            }
+            if ((pInterface->flags & flags) != flags) {
+                continue;
+            }
+
+            *ppInterface = pInterface;
+            return CKR_OK;
+        }
+
+        return CKR_ARGUMENTS_BAD;
+    }
+    CATCH("C_GetInterface");
+
+    return CKR_FUNCTION_FAILED;
+}
+
 // PKCS #11 initialization function
 CK_RV C_Initialize(CK_VOID_PTR pInitArgs)
 {
@@ -425,7 +627,12 @@ CK_RV C_GetOperationState
 )
 {
     INIT_LOG();
-    return CKR_FUNCTION_NOT_SUPPORTED;
+    try {
+        return pkcs11.GetOperationState(hSession, pOperationState, pulOperationStateLen);
+    }
+    CATCH("C_GetOperationState");
+
+    return CKR_FUNCTION_FAILED;
 }
 
 CK_RV C_SetOperationState
@@ -438,7 +645,12 @@ CK_RV C_SetOperationState
 )
 {
     INIT_LOG();
-    return CKR_FUNCTION_NOT_SUPPORTED;
+    try {
+        return pkcs11.SetOperationState(hSession, pOperationState, ulOperationStateLen, hEncryptionKey, hAuthenticationKey);
+    }
+    CATCH("C_SetOperationState");
+
+    return CKR_FUNCTION_FAILED;
 }
 
 CK_RV C_Login
@@ -563,6 +775,29 @@ CK_RV C_GetAttributeValue
 }
 
 
+/* C_PV_GetAttributeValues obtains the values of the same attributes
+* for many objects. */
+CK_RV C_PV_GetAttributeValues
+(
+    CK_SESSION_HANDLE         hSession,       /* the session's handle */
+    CK_OBJECT_HANDLE_PTR      phObjects,      /* the objects' handles */
+    CK_ULONG                  ulObjectCount,  /* # of objects */
+    CK_PV_ATTRIBUTE_TYPE_PTR  pTypes,         /* attribute types shared by objects */
+    CK_ULONG                  ulTypeCount,    /* # of attribute types */
+    CK_BYTE_PTR               pOutput,        /* gets packed values */
+    CK_ULONG_PTR              pulOutputLen    /* gets size of packed values */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.GetAttributeValues(hSession, phObjects, ulObjectCount, pTypes, ulTypeCount, pOutput, pulOutputLen);
+    }
+    CATCH("C_PV_GetAttributeValues");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+
 /* C_SetAttributeValue modifies the value of one or more object
 * attributes */
 CK_RV C_SetAttributeValue
@@ -931,6 +1166,28 @@ CK_RV C_DigestFinal
 }
 
 
+/* C_PV_DigestBatch digests independent messages with the same
+* mechanism. */
+CK_RV C_PV_DigestBatch
+(
+    CK_SESSION_HANDLE hSession,        /* the session's handle */
+    CK_MECHANISM_PTR  pMechanism,      /* the digesting mechanism */
+    CK_PV_DATA_PTR    pMessages,       /* messages to be digested */
+    CK_ULONG          ulMessageCount,  /* # of messages */
+    CK_BYTE_PTR       pDigests,        /* gets the digests */
+    CK_ULONG_PTR      pulDigestsLen    /* gets size of digests */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.DigestBatch(hSession, pMechanism, pMessages, ulMessageCount, pDigests, pulDigestsLen);
+    }
+    CATCH("C_PV_DigestBatch");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+
 
 /* Signing and MACing */
 
@@ -1091,6 +1348,26 @@ CK_RV C_Verify
 }
 
 
+/* C_PV_VerifyBatch verifies independent signatures, each with
+* its own mechanism and key. */
+CK_RV C_PV_VerifyBatch
+(
+    CK_SESSION_HANDLE     hSession,     /* the session's handle */
+    CK_PV_VERIFY_ITEM_PTR pItems,       /* signatures to be verified */
+    CK_ULONG              ulItemCount,  /* # of items */
+    CK_PV_RV_PTR          pResults      /* gets results of items */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.VerifyBatch(hSession, pItems, ulItemCount, pResults);
+    }
+    CATCH("C_PV_VerifyBatch");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+
 /* C_VerifyUpdate continues a multiple-part verification
 * operation, where the signature is an appendix to the data,
 * and plaintext cannot be recovered from the signature. */
@@ -1175,7 +1452,12 @@ CK_RV C_DigestEncryptUpdate
     )
 {
     INIT_LOG();
-    return CKR_FUNCTION_NOT_SUPPORTED;
+    try {
+        return pkcs11.DigestEncryptUpdate(hSession, pPart, ulPartLen, pEncryptedPart, pulEncryptedPartLen);
+    }
+    CATCH("C_DigestEncryptUpdate");
+
+    return CKR_FUNCTION_FAILED;
 }
 
 
@@ -1191,7 +1473,12 @@ CK_RV C_DecryptDigestUpdate
     )
 {
     INIT_LOG();
-    return CKR_FUNCTION_NOT_SUPPORTED;
+    try {
+        return pkcs11.DecryptDigestUpdate(hSession, pEncryptedPart, ulEncryptedPartLen, pPart, pulPartLen);
+    }
+    CATCH("C_DecryptDigestUpdate");
+
+    return CKR_FUNCTION_FAILED;
 }
 
 
@@ -1207,7 +1494,12 @@ CK_RV C_SignEncryptUpdate
     )
 {
     INIT_LOG();
-    return CKR_FUNCTION_NOT_SUPPORTED;
+    try {
+        return pkcs11.SignEncryptUpdate(hSession, pPart, ulPartLen, pEncryptedPart, pulEncryptedPartLen);
+    }
+    CATCH("C_SignEncryptUpdate");
+
+    return CKR_FUNCTION_FAILED;
 }
 
 
@@ -1223,7 +1515,12 @@ CK_RV C_DecryptVerifyUpdate
     )
 {
     INIT_LOG();
-    return CKR_FUNCTION_NOT_SUPPORTED;
+    try {
+        return pkcs11.DecryptVerifyUpdate(hSession, pEncryptedPart, ulEncryptedPartLen, pPart, pulPartLen);
+    }
+    CATCH("C_DecryptVerifyUpdate");
+
+    return CKR_FUNCTION_FAILED;
 }
 
 
@@ -1290,6 +1587,44 @@ CK_RV C_GenerateKeyPair
 }
 
 
+/* C_PV_SetKeyPairPool sets the number of key pairs generated ahead
+* for a configuration. */
+CK_RV C_PV_SetKeyPairPool
+(
+    CK_SLOT_ID                slotID,                     /* the slot's ID */
+    CK_MECHANISM_PTR          pMechanism,                 /* key-gen mechanism */
+    CK_ATTRIBUTE_PTR          pPublicKeyTemplate,         /* template for pub. key */
+    CK_ULONG                  ulPublicKeyAttributeCount,  /* # pub. attributes */
+    CK_ULONG                  ulPoolSize                  /* # key pairs kept ready */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.SetKeyPairPool(slotID, pMechanism, pPublicKeyTemplate, ulPublicKeyAttributeCount, ulPoolSize);
+    }
+    CATCH("C_PV_SetKeyPairPool");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+
+/* C_PV_GetKeyPairPoolInfo obtains counters of the key pair pool. */
+CK_RV C_PV_GetKeyPairPoolInfo
+(
+    CK_SLOT_ID                    slotID,  /* the slot's ID */
+    CK_PV_KEY_PAIR_POOL_INFO_PTR  pInfo    /* receives the pool information */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.GetKeyPairPoolInfo(slotID, pInfo);
+    }
+    CATCH("C_PV_GetKeyPairPoolInfo");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+
 /* C_WrapKey wraps (i.e., encrypts) a key. */
 CK_RV C_WrapKey
 (
@@ -1431,3 +1766,373 @@ CK_RV C_WaitForSlotEvent
     INIT_LOG();
     return CKR_FUNCTION_NOT_SUPPORTED;
 }
+
+
+/* Functions added in for PKCS #11 3.0 */
+
+/* C_LoginUser logs a user into a token. */
+CK_RV C_LoginUser
+(
+    CK_SESSION_HANDLE hSession,      /* the session's handle */
+    CK_USER_TYPE      userType,      /* the user type */
+    CK_UTF8CHAR_PTR   pPin,          /* the user's PIN */
+    CK_ULONG          ulPinLen,      /* the length of the PIN */
+    CK_UTF8CHAR_PTR   pUsername,     /* the user's name */
+    CK_ULONG          ulUsernameLen  /* the length of the user's name */
+    )
+{
+    INIT_LOG();
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+/* C_SessionCancel terminates active session based operations. */
+CK_RV C_SessionCancel
+(
+    CK_SESSION_HANDLE hSession,  /* the session's handle */
+    CK_FLAGS          flags      /* flags control which sessions are cancelled */
+    )
+{
+    INIT_LOG();
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+/* C_MessageEncryptInit initializes a message-based encryption
+* process. */
+CK_RV C_MessageEncryptInit
+(
+    CK_SESSION_HANDLE hSession,    /* the session's handle */
+    CK_MECHANISM_PTR  pMechanism,  /* the encryption mechanism */
+    CK_OBJECT_HANDLE  hKey         /* handle of encryption key */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.MessageEncryptInit(hSession, pMechanism, hKey);
+    }
+    CATCH("C_MessageEncryptInit");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+/* C_EncryptMessage encrypts a message in a single part. */
+CK_RV C_EncryptMessage
+(
+    CK_SESSION_HANDLE hSession,             /* the session's handle */
+    CK_VOID_PTR       pParameter,           /* message specific parameter */
+    CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+    CK_BYTE_PTR       pAssociatedData,      /* AEAD Associated data */
+    CK_ULONG          ulAssociatedDataLen,  /* AEAD Associated data length */
+    CK_BYTE_PTR       pPlaintext,           /* plain text */
+    CK_ULONG          ulPlaintextLen,       /* plain text length */
+    CK_BYTE_PTR       pCiphertext,          /* gets cipher text */
+    CK_ULONG_PTR      pulCiphertextLen      /* gets cipher text length */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.EncryptMessage(hSession, pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen, pPlaintext, ulPlaintextLen, pCiphertext, pulCiphertextLen);
+    }
+    CATCH("C_EncryptMessage");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+/* C_EncryptMessageBegin begins a multiple-part message
+* encryption operation. */
+CK_RV C_EncryptMessageBegin
+(
+    CK_SESSION_HANDLE hSession,            /* the session's handle */
+    CK_VOID_PTR       pParameter,          /* message specific parameter */
+    CK_ULONG          ulParameterLen,      /* length of message specific parameter */
+    CK_BYTE_PTR       pAssociatedData,     /* AEAD Associated data */
+    CK_ULONG          ulAssociatedDataLen  /* AEAD Associated data length */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.EncryptMessageBegin(hSession, pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen);
+    }
+    CATCH("C_EncryptMessageBegin");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+/* C_EncryptMessageNext continues a multiple-part message
+* encryption operation. */
+CK_RV C_EncryptMessageNext
+(
+    CK_SESSION_HANDLE hSession,              /* the session's handle */
+    CK_VOID_PTR       pParameter,            /* message specific parameter */
+    CK_ULONG          ulParameterLen,        /* length of message specific parameter */
+    CK_BYTE_PTR       pPlaintextPart,        /* plain text */
+    CK_ULONG          ulPlaintextPartLen,    /* plain text length */
+    CK_BYTE_PTR       pCiphertextPart,       /* gets cipher text */
+    CK_ULONG_PTR      pulCiphertextPartLen,  /* gets cipher text length */
+    CK_FLAGS          flags                  /* multi mode flag */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.EncryptMessageNext(hSession, pParameter, ulParameterLen, pPlaintextPart, ulPlaintextPartLen, pCiphertextPart, pulCiphertextPartLen, flags);
+    }
+    CATCH("C_EncryptMessageNext");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+/* C_MessageEncryptFinal finishes a message-based encryption
+* process. */
+CK_RV C_MessageEncryptFinal
+(
+    CK_SESSION_HANDLE hSession  /* the session's handle */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.MessageEncryptFinal(hSession);
+    }
+    CATCH("C_MessageEncryptFinal");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+/* C_MessageEncryptInit initializes a message-based decryption
+* process. */
+CK_RV C_MessageDecryptInit
+(
+    CK_SESSION_HANDLE hSession,    /* the session's handle */
+    CK_MECHANISM_PTR  pMechanism,  /* the decryption mechanism */
+    CK_OBJECT_HANDLE  hKey         /* handle of decryption key */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.MessageDecryptInit(hSession, pMechanism, hKey);
+    }
+    CATCH("C_MessageDecryptInit");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+/* C_EncryptMessage decrypts a message in a single part. */
+CK_RV C_DecryptMessage
+(
+    CK_SESSION_HANDLE hSession,             /* the session's handle */
+    CK_VOID_PTR       pParameter,           /* message specific parameter */
+    CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+    CK_BYTE_PTR       pAssociatedData,      /* AEAD Associated data */
+    CK_ULONG          ulAssociatedDataLen,  /* AEAD Associated data length */
+    CK_BYTE_PTR       pCiphertext,          /* cipher text */
+    CK_ULONG          ulCiphertextLen,      /* cipher text length */
+    CK_BYTE_PTR       pPlaintext,           /* gets plain text */
+    CK_ULONG_PTR      pulPlaintextLen       /* gets plain text length */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.DecryptMessage(hSession, pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen, pCiphertext, ulCiphertextLen, pPlaintext, pulPlaintextLen);
+    }
+    CATCH("C_DecryptMessage");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+/* C_EncryptMessageBegin begins a multiple-part message
+* decryption operation. */
+CK_RV C_DecryptMessageBegin
+(
+    CK_SESSION_HANDLE hSession,            /* the session's handle */
+    CK_VOID_PTR       pParameter,          /* message specific parameter */
+    CK_ULONG          ulParameterLen,      /* length of message specific parameter */
+    CK_BYTE_PTR       pAssociatedData,     /* AEAD Associated data */
+    CK_ULONG          ulAssociatedDataLen  /* AEAD Associated data length */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.DecryptMessageBegin(hSession, pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen);
+    }
+    CATCH("C_DecryptMessageBegin");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+/* C_EncryptMessageNext continues a multiple-part message
+* decryption operation. */
+CK_RV C_DecryptMessageNext
+(
+    CK_SESSION_HANDLE hSession,             /* the session's handle */
+    CK_VOID_PTR       pParameter,           /* message specific parameter */
+    CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+    CK_BYTE_PTR       pCiphertextPart,      /* cipher text */
+    CK_ULONG          ulCiphertextPartLen,  /* cipher text length */
+    CK_BYTE_PTR       pPlaintextPart,       /* gets plain text */
+    CK_ULONG_PTR      pulPlaintextPartLen,  /* gets plain text length */
+    CK_FLAGS          flags                 /* multi mode flag */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.DecryptMessageNext(hSession, pParameter, ulParameterLen, pCiphertextPart, ulCiphertextPartLen, pPlaintextPart, pulPlaintextPartLen, flags);
+    }
+    CATCH("C_DecryptMessageNext");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+/* C_MessageEncryptFinal finishes a message-based decryption
+* process. */
+CK_RV C_MessageDecryptFinal
+(
+    CK_SESSION_HANDLE hSession  /* the session's handle */
+    )
+{
+    INIT_LOG();
+    try {
+        return pkcs11.MessageDecryptFinal(hSession);
+    }
+    CATCH("C_MessageDecryptFinal");
+
+    return CKR_FUNCTION_FAILED;
+}
+
+/* C_MessageSignInit initializes a message-based signature
+* process. */
+CK_RV C_MessageSignInit
+(
+    CK_SESSION_HANDLE hSession,    /* the session's handle */
+    CK_MECHANISM_PTR  pMechanism,  /* the signing mechanism */
+    CK_OBJECT_HANDLE  hKey         /* handle of signing key */
+    )
+{
+    INIT_LOG();
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+/* C_SignMessage signs a message in a single part. */
+CK_RV C_SignMessage
+(
+    CK_SESSION_HANDLE hSession,        /* the session's handle */
+    CK_VOID_PTR       pParameter,      /* message specific parameter */
+    CK_ULONG          ulParameterLen,  /* length of message specific parameter */
+    CK_BYTE_PTR       pData,           /* data to sign */
+    CK_ULONG          ulDataLen,       /* data to sign length */
+    CK_BYTE_PTR       pSignature,      /* gets signature */
+    CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+    )
+{
+    INIT_LOG();
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+/* C_SignMessageBegin begins a multiple-part message signature
+* operation. */
+CK_RV C_SignMessageBegin
+(
+    CK_SESSION_HANDLE hSession,       /* the session's handle */
+    CK_VOID_PTR       pParameter,     /* message specific parameter */
+    CK_ULONG          ulParameterLen  /* length of message specific parameter */
+    )
+{
+    INIT_LOG();
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+/* C_SignMessageNext continues a multiple-part message
+* signature operation. */
+CK_RV C_SignMessageNext
+(
+    CK_SESSION_HANDLE hSession,        /* the session's handle */
+    CK_VOID_PTR       pParameter,      /* message specific parameter */
+    CK_ULONG          ulParameterLen,  /* length of message specific parameter */
+    CK_BYTE_PTR       pData,           /* data to sign */
+    CK_ULONG          ulDataLen,       /* data to sign length */
+    CK_BYTE_PTR       pSignature,      /* gets signature */
+    CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+    )
+{
+    INIT_LOG();
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+/* C_MessageSignFinal finishes a message-based signature
+* process. */
+CK_RV C_MessageSignFinal
+(
+    CK_SESSION_HANDLE hSession  /* the session's handle */
+    )
+{
+    INIT_LOG();
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+/* C_MessageVerifyInit initializes a message-based verification
+* process. */
+CK_RV C_MessageVerifyInit
+(
+    CK_SESSION_HANDLE hSession,    /* the session's handle */
+    CK_MECHANISM_PTR  pMechanism,  /* the verification mechanism */
+    CK_OBJECT_HANDLE  hKey         /* handle of verification key */
+    )
+{
+    INIT_LOG();
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+/* C_VerifyMessage verifies a signature on a message in a
+* single part operation. */
+CK_RV C_VerifyMessage
+(
+    CK_SESSION_HANDLE hSession,        /* the session's handle */
+    CK_VOID_PTR       pParameter,      /* message specific parameter */
+    CK_ULONG          ulParameterLen,  /* length of message specific parameter */
+    CK_BYTE_PTR       pData,           /* signed data */
+    CK_ULONG          ulDataLen,       /* signed data length */
+    CK_BYTE_PTR       pSignature,      /* signature */
+    CK_ULONG          ulSignatureLen   /* signature length */
+    )
+{
+    INIT_LOG();
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+/* C_VerifyMessageBegin begins a multiple-part message
+* verification operation. */
+CK_RV C_VerifyMessageBegin
+(
+    CK_SESSION_HANDLE hSession,       /* the session's handle */
+    CK_VOID_PTR       pParameter,     /* message specific parameter */
+    CK_ULONG          ulParameterLen  /* length of message specific parameter */
+    )
+{
+    INIT_LOG();
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+/* C_VerifyMessageNext continues a multiple-part message
+* verification operation. */
+CK_RV C_VerifyMessageNext
+(
+    CK_SESSION_HANDLE hSession,        /* the session's handle */
+    CK_VOID_PTR       pParameter,      /* message specific parameter */
+    CK_ULONG          ulParameterLen,  /* length of message specific parameter */
+    CK_BYTE_PTR       pData,           /* signed data */
+    CK_ULONG          ulDataLen,       /* signed data length */
+    CK_BYTE_PTR       pSignature,      /* signature */
+    CK_ULONG          ulSignatureLen   /* signature length */
+    )
+{
+    INIT_LOG();
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+/* C_MessageVerifyFinal finishes a message-based verification
+* process. */
+CK_RV C_MessageVerifyFinal
+(
+    CK_SESSION_HANDLE hSession  /* the session's handle */
+    )
+{
+    INIT_LOG();
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
@@ -304,6 +304,19 @@ extern "C" {
 #define CK_PKCS11_FUNCTION_INFO(name) \
   __PASTE(CK_,name) name;
 
+	/* CK_FUNCTION_LIST_3_0 holds all the functions including those
+	* added in PKCS #11 3.0. It is returned by C_GetInterface. */
+	struct CK_FUNCTION_LIST_3_0 {
+
+		CK_VERSION    version;  /* Cryptoki version */
+
+#include "pkcs11f.h"
+
+	};
+
+	/* CK_FUNCTION_LIST holds Cryptoki 2.x functions only */
+#define CK_PKCS11_2_0_ONLY 1
+
 	struct CK_FUNCTION_LIST {
 
 		CK_VERSION    version;  /* Cryptoki version */
@@ -315,6 +328,7 @@ extern "C" {
 
 	};
 
+#undef CK_PKCS11_2_0_ONLY
 #undef CK_PKCS11_FUNCTION_INFO
 
 
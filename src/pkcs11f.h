@@ -909,4 +909,305 @@ CK_PKCS11_FUNCTION_INFO(C_WaitForSlotEvent)
 	CK_SLOT_ID_PTR pSlot,  /* location that receives the slot ID */
 	CK_VOID_PTR pRserved   /* reserved.  Should be NULL_PTR */
 );
-#endif
\ No newline at end of file
+#endif
+
+
+#ifndef CK_PKCS11_2_0_ONLY
+
+/* Functions added in for PKCS #11 3.0 */
+
+/* C_GetInterfaceList returns all the interfaces supported by
+* the module. */
+CK_PKCS11_FUNCTION_INFO(C_GetInterfaceList)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_INTERFACE_PTR pInterfacesList,  /* returned interfaces */
+	CK_ULONG_PTR     pulCount          /* number of interfaces returned */
+);
+#endif
+
+/* C_GetInterface returns a specific interface from the module. */
+CK_PKCS11_FUNCTION_INFO(C_GetInterface)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_UTF8CHAR_PTR      pInterfaceName,  /* name of the interface */
+	CK_VERSION_PTR       pVersion,        /* version of the interface */
+	CK_INTERFACE_PTR_PTR ppInterface,     /* returned interface */
+	CK_FLAGS             flags            /* flags controlling the semantics of the interface */
+);
+#endif
+
+/* C_LoginUser logs a user into a token. */
+CK_PKCS11_FUNCTION_INFO(C_LoginUser)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,      /* the session's handle */
+	CK_USER_TYPE      userType,      /* the user type */
+	CK_UTF8CHAR_PTR   pPin,          /* the user's PIN */
+	CK_ULONG          ulPinLen,      /* the length of the PIN */
+	CK_UTF8CHAR_PTR   pUsername,     /* the user's name */
+	CK_ULONG          ulUsernameLen  /* the length of the user's name */
+);
+#endif
+
+/* C_SessionCancel terminates active session based operations. */
+CK_PKCS11_FUNCTION_INFO(C_SessionCancel)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,  /* the session's handle */
+	CK_FLAGS          flags      /* flags control which sessions are cancelled */
+);
+#endif
+
+/* C_MessageEncryptInit initializes a message-based encryption
+* process. */
+CK_PKCS11_FUNCTION_INFO(C_MessageEncryptInit)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,    /* the session's handle */
+	CK_MECHANISM_PTR  pMechanism,  /* the mechanism */
+	CK_OBJECT_HANDLE  hKey         /* handle of the key */
+);
+#endif
+
+/* C_EncryptMessage encrypts a message in a single part. */
+CK_PKCS11_FUNCTION_INFO(C_EncryptMessage)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,             /* the session's handle */
+	CK_VOID_PTR       pParameter,           /* message specific parameter */
+	CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+	CK_BYTE_PTR       pAssociatedData,      /* AEAD Associated data */
+	CK_ULONG          ulAssociatedDataLen,  /* AEAD Associated data length */
+	CK_BYTE_PTR       pPlaintext,           /* plain text */
+	CK_ULONG          ulPlaintextLen,       /* plain text length */
+	CK_BYTE_PTR       pCiphertext,          /* gets cipher text */
+	CK_ULONG_PTR      pulCiphertextLen      /* gets cipher text length */
+);
+#endif
+
+/* C_EncryptMessageBegin begins a multiple-part message
+* encryption operation. */
+CK_PKCS11_FUNCTION_INFO(C_EncryptMessageBegin)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,            /* the session's handle */
+	CK_VOID_PTR       pParameter,          /* message specific parameter */
+	CK_ULONG          ulParameterLen,      /* length of message specific parameter */
+	CK_BYTE_PTR       pAssociatedData,     /* AEAD Associated data */
+	CK_ULONG          ulAssociatedDataLen  /* AEAD Associated data length */
+);
+#endif
+
+/* C_EncryptMessageNext continues a multiple-part message
+* encryption operation. */
+CK_PKCS11_FUNCTION_INFO(C_EncryptMessageNext)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,              /* the session's handle */
+	CK_VOID_PTR       pParameter,            /* message specific parameter */
+	CK_ULONG          ulParameterLen,        /* length of message specific parameter */
+	CK_BYTE_PTR       pPlaintextPart,        /* plain text */
+	CK_ULONG          ulPlaintextPartLen,    /* plain text length */
+	CK_BYTE_PTR       pCiphertextPart,       /* gets cipher text */
+	CK_ULONG_PTR      pulCiphertextPartLen,  /* gets cipher text length */
+	CK_FLAGS          flags                  /* multi mode flag */
+);
+#endif
+
+/* C_MessageEncryptFinal finishes a message-based encryption
+* process. */
+CK_PKCS11_FUNCTION_INFO(C_MessageEncryptFinal)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession  /* the session's handle */
+);
+#endif
+
+/* C_MessageDecryptInit initializes a message-based decryption
+* process. */
+CK_PKCS11_FUNCTION_INFO(C_MessageDecryptInit)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,    /* the session's handle */
+	CK_MECHANISM_PTR  pMechanism,  /* the mechanism */
+	CK_OBJECT_HANDLE  hKey         /* handle of the key */
+);
+#endif
+
+/* C_DecryptMessage decrypts a message in a single part. */
+CK_PKCS11_FUNCTION_INFO(C_DecryptMessage)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,             /* the session's handle */
+	CK_VOID_PTR       pParameter,           /* message specific parameter */
+	CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+	CK_BYTE_PTR       pAssociatedData,      /* AEAD Associated data */
+	CK_ULONG          ulAssociatedDataLen,  /* AEAD Associated data length */
+	CK_BYTE_PTR       pCiphertext,          /* cipher text */
+	CK_ULONG          ulCiphertextLen,      /* cipher text length */
+	CK_BYTE_PTR       pPlaintext,           /* gets plain text */
+	CK_ULONG_PTR      pulPlaintextLen       /* gets plain text length */
+);
+#endif
+
+/* C_DecryptMessageBegin begins a multiple-part message
+* decryption operation. */
+CK_PKCS11_FUNCTION_INFO(C_DecryptMessageBegin)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,            /* the session's handle */
+	CK_VOID_PTR       pParameter,          /* message specific parameter */
+	CK_ULONG          ulParameterLen,      /* length of message specific parameter */
+	CK_BYTE_PTR       pAssociatedData,     /* AEAD Associated data */
+	CK_ULONG          ulAssociatedDataLen  /* AEAD Associated data length */
+);
+#endif
+
+/* C_DecryptMessageNext continues a multiple-part message
+* decryption operation. */
+CK_PKCS11_FUNCTION_INFO(C_DecryptMessageNext)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,             /* the session's handle */
+	CK_VOID_PTR       pParameter,           /* message specific parameter */
+	CK_ULONG          ulParameterLen,       /* length of message specific parameter */
+	CK_BYTE_PTR       pCiphertextPart,      /* cipher text */
+	CK_ULONG          ulCiphertextPartLen,  /* cipher text length */
+	CK_BYTE_PTR       pPlaintextPart,       /* gets plain text */
+	CK_ULONG_PTR      pulPlaintextPartLen,  /* gets plain text length */
+	CK_FLAGS          flags                 /* multi mode flag */
+);
+#endif
+
+/* C_MessageDecryptFinal finishes a message-based decryption
+* process. */
+CK_PKCS11_FUNCTION_INFO(C_MessageDecryptFinal)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession  /* the session's handle */
+);
+#endif
+
+/* C_MessageSignInit initializes a message-based signature
+* process. */
+CK_PKCS11_FUNCTION_INFO(C_MessageSignInit)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,    /* the session's handle */
+	CK_MECHANISM_PTR  pMechanism,  /* the mechanism */
+	CK_OBJECT_HANDLE  hKey         /* handle of the key */
+);
+#endif
+
+/* C_SignMessage signs a message in a single part. */
+CK_PKCS11_FUNCTION_INFO(C_SignMessage)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,        /* the session's handle */
+	CK_VOID_PTR       pParameter,      /* message specific parameter */
+	CK_ULONG          ulParameterLen,  /* length of message specific parameter */
+	CK_BYTE_PTR       pData,           /* data to sign */
+	CK_ULONG          ulDataLen,       /* data to sign length */
+	CK_BYTE_PTR       pSignature,      /* gets signature */
+	CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+);
+#endif
+
+/* C_SignMessageBegin begins a multiple-part message signature
+* operation. */
+CK_PKCS11_FUNCTION_INFO(C_SignMessageBegin)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,       /* the session's handle */
+	CK_VOID_PTR       pParameter,     /* message specific parameter */
+	CK_ULONG          ulParameterLen  /* length of message specific parameter */
+);
+#endif
+
+/* C_SignMessageNext continues a multiple-part message
+* signature operation. */
+CK_PKCS11_FUNCTION_INFO(C_SignMessageNext)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,        /* the session's handle */
+	CK_VOID_PTR       pParameter,      /* message specific parameter */
+	CK_ULONG          ulParameterLen,  /* length of message specific parameter */
+	CK_BYTE_PTR       pData,           /* data to sign */
+	CK_ULONG          ulDataLen,       /* data to sign length */
+	CK_BYTE_PTR       pSignature,      /* gets signature */
+	CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+);
+#endif
+
+/* C_MessageSignFinal finishes a message-based signature
+* process. */
+CK_PKCS11_FUNCTION_INFO(C_MessageSignFinal)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession  /* the session's handle */
+);
+#endif
+
+/* C_MessageVerifyInit initializes a message-based verification
+* process. */
+CK_PKCS11_FUNCTION_INFO(C_MessageVerifyInit)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,    /* the session's handle */
+	CK_MECHANISM_PTR  pMechanism,  /* the mechanism */
+	CK_OBJECT_HANDLE  hKey         /* handle of the key */
+);
+#endif
+
+/* C_VerifyMessage verifies a signature on a message in a
+* single part operation. */
+CK_PKCS11_FUNCTION_INFO(C_VerifyMessage)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,        /* the session's handle */
+	CK_VOID_PTR       pParameter,      /* message specific parameter */
+	CK_ULONG          ulParameterLen,  /* length of message specific parameter */
+	CK_BYTE_PTR       pData,           /* data to sign */
+	CK_ULONG          ulDataLen,       /* data to sign length */
+	CK_BYTE_PTR       pSignature,      /* signature */
+	CK_ULONG          ulSignatureLen   /* signature length */
+);
+#endif
+
+/* C_VerifyMessageBegin begins a multiple-part message
+* verification operation. */
+CK_PKCS11_FUNCTION_INFO(C_VerifyMessageBegin)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,       /* the session's handle */
+	CK_VOID_PTR       pParameter,     /* message specific parameter */
+	CK_ULONG          ulParameterLen  /* length of message specific parameter */
+);
+#endif
+
+/* C_VerifyMessageNext continues a multiple-part message
+* verification operation. */
+CK_PKCS11_FUNCTION_INFO(C_VerifyMessageNext)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession,        /* the session's handle */
+	CK_VOID_PTR       pParameter,      /* message specific parameter */
+	CK_ULONG          ulParameterLen,  /* length of message specific parameter */
+	CK_BYTE_PTR       pData,           /* data to sign */
+	CK_ULONG          ulDataLen,       /* data to sign length */
+	CK_BYTE_PTR       pSignature,      /* signature */
+	CK_ULONG          ulSignatureLen   /* signature length */
+);
+#endif
+
+/* C_MessageVerifyFinal finishes a message-based verification
+* process. */
+CK_PKCS11_FUNCTION_INFO(C_MessageVerifyFinal)
+#ifdef CK_NEED_ARG_LIST
+(
+	CK_SESSION_HANDLE hSession  /* the session's handle */
+);
+#endif
+
+#endif /* CK_PKCS11_2_0_ONLY */
@@ -386,6 +386,12 @@ typedef CK_ULONG          CK_KEY_TYPE;
 #define CKK_GOSTR3411       0x00000031
 #define CKK_GOST28147       0x00000032
 
+/* Key types added in PKCS #11 3.0 */
+#define CKK_CHACHA20        0x00000033
+#define CKK_AES_XTS         0x00000035
+#define CKK_EC_EDWARDS      0x00000040
+#define CKK_EC_MONTGOMERY   0x00000041
+
 #define CKK_VENDOR_DEFINED  0x80000000
 
 
@@ -928,6 +934,16 @@ typedef CK_ULONG          CK_MECHANISM_TYPE;
 #define CKM_RSA_PKCS_TPM_1_1           0x00004001
 #define CKM_RSA_PKCS_OAEP_TPM_1_1      0x00004002
 
+/* Mechanisms added in PKCS #11 3.0 */
+#define CKM_EC_EDWARDS_KEY_PAIR_GEN    0x00001055
+#define CKM_EC_MONTGOMERY_KEY_PAIR_GEN 0x00001056
+#define CKM_EDDSA                      0x00001057
+#define CKM_AES_XTS                    0x00001071
+#define CKM_AES_XTS_KEY_GEN            0x00001072
+#define CKM_CHACHA20_KEY_GEN           0x00001225
+#define CKM_CHACHA20                   0x00001226
+#define CKM_CHACHA20_POLY1305          0x00004021
+
 #define CKM_VENDOR_DEFINED             0x80000000
 
 typedef CK_MECHANISM_TYPE CK_PTR CK_MECHANISM_TYPE_PTR;
@@ -981,6 +997,14 @@ typedef struct CK_MECHANISM_INFO {
 
 #define CKF_EXTENSION          0x80000000 /* FALSE for this version */
 
+/* Flags added in PKCS #11 3.0 */
+#define CKF_MESSAGE_ENCRYPT    0x00000002
+#define CKF_MESSAGE_DECRYPT    0x00000004
+#define CKF_MESSAGE_SIGN       0x00000008
+#define CKF_MESSAGE_VERIFY     0x00000010
+#define CKF_MULTI_MESSAGE      0x00000020
+#define CKF_FIND_OBJECTS       0x00000040
+
 typedef CK_MECHANISM_INFO CK_PTR CK_MECHANISM_INFO_PTR;
 
 
@@ -1107,6 +1131,11 @@ typedef CK_ULONG          CK_RV;
 #define CKR_PUBLIC_KEY_INVALID                0x000001B9
 
 #define CKR_FUNCTION_REJECTED                 0x00000200
+#define CKR_TOKEN_RESOURCE_EXCEEDED           0x00000201
+#define CKR_OPERATION_CANCEL_FAILED           0x00000202
+
+/* Return values added in PKCS #11 3.0 */
+#define CKR_AEAD_DECRYPT_FAILED               0x00000035
 
 #define CKR_VENDOR_DEFINED                    0x80000000
 
@@ -1128,6 +1157,26 @@ typedef CK_FUNCTION_LIST CK_PTR CK_FUNCTION_LIST_PTR;
 
 typedef CK_FUNCTION_LIST_PTR CK_PTR CK_FUNCTION_LIST_PTR_PTR;
 
+typedef struct CK_FUNCTION_LIST_3_0 CK_FUNCTION_LIST_3_0;
+
+typedef CK_FUNCTION_LIST_3_0 CK_PTR CK_FUNCTION_LIST_3_0_PTR;
+
+typedef CK_FUNCTION_LIST_3_0_PTR CK_PTR CK_FUNCTION_LIST_3_0_PTR_PTR;
+
+/* CK_INTERFACE describes a function list returned by
+* C_GetInterface and C_GetInterfaceList (PKCS #11 3.0) */
+typedef struct CK_INTERFACE {
+	CK_CHAR     *pInterfaceName;
+	CK_VOID_PTR pFunctionList;
+	CK_FLAGS    flags;
+} CK_INTERFACE;
+
+typedef CK_INTERFACE CK_PTR CK_INTERFACE_PTR;
+
+typedef CK_INTERFACE_PTR CK_PTR CK_INTERFACE_PTR_PTR;
+
+#define CKF_INTERFACE_FORK_SAFE  0x00000001
+
 
 /* CK_CREATEMUTEX is an application callback for creating a
 * mutex object */
@@ -1765,6 +1814,46 @@ typedef struct CK_AES_CCM_PARAMS {
 
 typedef CK_AES_CCM_PARAMS CK_PTR CK_AES_CCM_PARAMS_PTR;
 
+/* Message-based encryption (PKCS #11 3.0) */
+typedef CK_ULONG CK_GENERATOR_FUNCTION;
+
+#define CKG_NO_GENERATE           0x00000000
+#define CKG_GENERATE              0x00000001
+#define CKG_GENERATE_COUNTER      0x00000002
+#define CKG_GENERATE_RANDOM       0x00000003
+#define CKG_GENERATE_COUNTER_XOR  0x00000004
+
+typedef struct CK_GCM_MESSAGE_PARAMS {
+	CK_BYTE_PTR           pIv;
+	CK_ULONG              ulIvLen;
+	CK_ULONG              ulIvFixedBits;
+	CK_GENERATOR_FUNCTION ivGenerator;
+	CK_BYTE_PTR           pTag;
+	CK_ULONG              ulTagBits;
+} CK_GCM_MESSAGE_PARAMS;
+
+typedef CK_GCM_MESSAGE_PARAMS CK_PTR CK_GCM_MESSAGE_PARAMS_PTR;
+
+/* CKF_END_OF_MESSAGE is for C_EncryptMessageNext and C_DecryptMessageNext */
+#define CKF_END_OF_MESSAGE        0x00000001
+
+typedef struct CK_SALSA20_CHACHA20_POLY1305_PARAMS {
+	CK_BYTE_PTR pNonce;
+	CK_ULONG    ulNonceLen;
+	CK_BYTE_PTR pAAD;
+	CK_ULONG    ulAADLen;
+} CK_SALSA20_CHACHA20_POLY1305_PARAMS;
+
+typedef CK_SALSA20_CHACHA20_POLY1305_PARAMS CK_PTR CK_SALSA20_CHACHA20_POLY1305_PARAMS_PTR;
+
+typedef struct CK_EDDSA_PARAMS {
+	CK_BBOOL    phFlag;
+	CK_ULONG    ulContextDataLen;
+	CK_BYTE_PTR pContextData;
+} CK_EDDSA_PARAMS;
+
+typedef CK_EDDSA_PARAMS CK_PTR CK_EDDSA_PARAMS_PTR;
+
 typedef struct CK_CAMELLIA_CTR_PARAMS {
 	CK_ULONG ulCounterBits;
 	CK_BYTE cb[16];
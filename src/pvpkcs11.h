@@ -0,0 +1,227 @@
+/*
+ * Vendor extensions of pvpkcs11
+ *
+ * The extensions are available via C_PV_GetFunctionList, which is exported
+ * alongside C_GetFunctionList. This file must be included after pkcs11.h
+ */
+
+#ifndef _PVPKCS11_H_
+#define _PVPKCS11_H_ 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CK_PV_VERSION_MAJOR 1
+#define CK_PV_VERSION_MINOR 3
+
+/* Name of the interface returned by C_GetInterface for CK_PV_FUNCTION_LIST */
+#define CK_PV_INTERFACE_NAME "Vendor pvpkcs11"
+
+    typedef CK_ATTRIBUTE_TYPE CK_PTR CK_PV_ATTRIBUTE_TYPE_PTR;
+
+    /* C_PV_GetAttributeValues fills a packed buffer. For each requested object
+     * the buffer holds CK_PV_OBJECT_VALUES followed by one CK_PV_ATTRIBUTE_VALUE
+     * per attribute type. Each CK_PV_ATTRIBUTE_VALUE is followed by ulValueLen
+     * bytes of the value, padded to sizeof(CK_ULONG). ulValueLen is
+     * CK_UNAVAILABLE_INFORMATION if the value cannot be revealed, no value bytes
+     * follow in that case. */
+    typedef struct CK_PV_OBJECT_VALUES {
+        CK_OBJECT_HANDLE  hObject;
+        CK_RV             rv;           /* the same codes as C_GetAttributeValue returns */
+        CK_ULONG          ulRecordLen;  /* bytes to the next CK_PV_OBJECT_VALUES */
+    } CK_PV_OBJECT_VALUES;
+
+    typedef CK_PV_OBJECT_VALUES CK_PTR CK_PV_OBJECT_VALUES_PTR;
+
+    typedef struct CK_PV_ATTRIBUTE_VALUE {
+        CK_ATTRIBUTE_TYPE type;
+        CK_ULONG          ulValueLen;
+    } CK_PV_ATTRIBUTE_VALUE;
+
+    typedef CK_PV_ATTRIBUTE_VALUE CK_PTR CK_PV_ATTRIBUTE_VALUE_PTR;
+
+    /* C_PV_GetAttributeValues obtains values of the same attributes for many
+     * objects in one call. If pOutput is NULL_PTR, *pulOutputLen receives the
+     * size of the buffer. If the buffer is too small, *pulOutputLen receives the
+     * size and CKR_BUFFER_TOO_SMALL is returned. */
+    extern CK_DECLARE_FUNCTION(CK_RV, C_PV_GetAttributeValues)
+    (
+        CK_SESSION_HANDLE         hSession,       /* the session's handle */
+        CK_OBJECT_HANDLE_PTR      phObjects,      /* the objects' handles */
+        CK_ULONG                  ulObjectCount,  /* # of objects */
+        CK_PV_ATTRIBUTE_TYPE_PTR  pTypes,         /* attribute types shared by objects */
+        CK_ULONG                  ulTypeCount,    /* # of attribute types */
+        CK_BYTE_PTR               pOutput,        /* gets packed values */
+        CK_ULONG_PTR              pulOutputLen    /* gets size of packed values */
+    );
+
+    typedef CK_DECLARE_FUNCTION_POINTER(CK_RV, CK_C_PV_GetAttributeValues)
+    (
+        CK_SESSION_HANDLE         hSession,
+        CK_OBJECT_HANDLE_PTR      phObjects,
+        CK_ULONG                  ulObjectCount,
+        CK_PV_ATTRIBUTE_TYPE_PTR  pTypes,
+        CK_ULONG                  ulTypeCount,
+        CK_BYTE_PTR               pOutput,
+        CK_ULONG_PTR              pulOutputLen
+    );
+
+    typedef struct CK_PV_DATA {
+        CK_BYTE_PTR       pData;
+        CK_ULONG          ulDataLen;
+    } CK_PV_DATA;
+
+    typedef CK_PV_DATA CK_PTR CK_PV_DATA_PTR;
+
+    /* C_PV_DigestBatch digests independent messages with the same
+     * mechanism. pDigests receives ulMessageCount digests of the mechanism's
+     * fixed size, in the order of messages. If pDigests is NULL_PTR,
+     * *pulDigestsLen receives the size of the buffer. The session's digest
+     * operation must not be active. (since 1.1) */
+    extern CK_DECLARE_FUNCTION(CK_RV, C_PV_DigestBatch)
+    (
+        CK_SESSION_HANDLE         hSession,        /* the session's handle */
+        CK_MECHANISM_PTR          pMechanism,      /* the digesting mechanism */
+        CK_PV_DATA_PTR            pMessages,       /* messages to be digested */
+        CK_ULONG                  ulMessageCount,  /* # of messages */
+        CK_BYTE_PTR               pDigests,        /* gets the digests */
+        CK_ULONG_PTR              pulDigestsLen    /* gets size of digests */
+    );
+
+    typedef CK_DECLARE_FUNCTION_POINTER(CK_RV, CK_C_PV_DigestBatch)
+    (
+        CK_SESSION_HANDLE         hSession,
+        CK_MECHANISM_PTR          pMechanism,
+        CK_PV_DATA_PTR            pMessages,
+        CK_ULONG                  ulMessageCount,
+        CK_BYTE_PTR               pDigests,
+        CK_ULONG_PTR              pulDigestsLen
+    );
+
+    /* CKM_AES_XTS takes either the 16-byte tweak of one data unit, which is
+     * the whole message, or CK_PV_AES_XTS_PARAMS. With CK_PV_AES_XTS_PARAMS
+     * the message is a sequence of data units of ulDataUnitLen bytes (at
+     * least 16). The first unit uses tweak, the next ones tweak + 1, tweak + 2
+     * and so on, where tweak is a 128-bit little-endian number as the sector
+     * number of IEEE 1619. The message length must be a multiple of
+     * ulDataUnitLen. */
+    typedef struct CK_PV_AES_XTS_PARAMS {
+        CK_BYTE           tweak[16];      /* tweak of the first data unit */
+        CK_ULONG          ulDataUnitLen;  /* bytes of each data unit */
+    } CK_PV_AES_XTS_PARAMS;
+
+    typedef CK_PV_AES_XTS_PARAMS CK_PTR CK_PV_AES_XTS_PARAMS_PTR;
+
+    /* C_PV_SetKeyPairPool sets the number of key pairs which the slot keeps
+     * generated ahead for the configuration of pMechanism and the public key
+     * template: CKA_MODULUS_BITS and CKA_PUBLIC_EXPONENT (65537 by default)
+     * for CKM_RSA_PKCS_KEY_PAIR_GEN, CKA_EC_PARAMS of the curve for
+     * CKM_EC_KEY_PAIR_GEN. Missing key pairs are generated in background.
+     * C_GenerateKeyPair takes a ready key pair of the configuration if there
+     * is one. ulPoolSize 0 removes the configuration. (since 1.2) */
+    extern CK_DECLARE_FUNCTION(CK_RV, C_PV_SetKeyPairPool)
+    (
+        CK_SLOT_ID                slotID,                     /* the slot's ID */
+        CK_MECHANISM_PTR          pMechanism,                 /* key-gen mechanism */
+        CK_ATTRIBUTE_PTR          pPublicKeyTemplate,         /* template for pub. key */
+        CK_ULONG                  ulPublicKeyAttributeCount,  /* # pub. attributes */
+        CK_ULONG                  ulPoolSize                  /* # key pairs kept ready */
+    );
+
+    typedef CK_DECLARE_FUNCTION_POINTER(CK_RV, CK_C_PV_SetKeyPairPool)
+    (
+        CK_SLOT_ID                slotID,
+        CK_MECHANISM_PTR          pMechanism,
+        CK_ATTRIBUTE_PTR          pPublicKeyTemplate,
+        CK_ULONG                  ulPublicKeyAttributeCount,
+        CK_ULONG                  ulPoolSize
+    );
+
+    typedef struct CK_PV_KEY_PAIR_POOL_INFO {
+        CK_ULONG          ulHits;          /* C_GenerateKeyPair calls served by the pool */
+        CK_ULONG          ulMisses;        /* calls of pooled configurations with no ready key pair */
+        CK_ULONG          ulReadyCount;    /* key pairs ready */
+        CK_ULONG          ulPendingCount;  /* key pairs being generated */
+    } CK_PV_KEY_PAIR_POOL_INFO;
+
+    typedef CK_PV_KEY_PAIR_POOL_INFO CK_PTR CK_PV_KEY_PAIR_POOL_INFO_PTR;
+
+    /* C_PV_GetKeyPairPoolInfo obtains counters of the slot's key pair pool
+     * (since 1.2) */
+    extern CK_DECLARE_FUNCTION(CK_RV, C_PV_GetKeyPairPoolInfo)
+    (
+        CK_SLOT_ID                    slotID,  /* the slot's ID */
+        CK_PV_KEY_PAIR_POOL_INFO_PTR  pInfo    /* receives the pool information */
+    );
+
+    typedef CK_DECLARE_FUNCTION_POINTER(CK_RV, CK_C_PV_GetKeyPairPoolInfo)
+    (
+        CK_SLOT_ID                    slotID,
+        CK_PV_KEY_PAIR_POOL_INFO_PTR  pInfo
+    );
+
+    typedef struct CK_PV_VERIFY_ITEM {
+        CK_MECHANISM_PTR  pMechanism;      /* the verification mechanism */
+        CK_OBJECT_HANDLE  hKey;            /* verification key */
+        CK_BYTE_PTR       pData;           /* signed data */
+        CK_ULONG          ulDataLen;       /* length of signed data */
+        CK_BYTE_PTR       pSignature;      /* signature */
+        CK_ULONG          ulSignatureLen;  /* signature length */
+    } CK_PV_VERIFY_ITEM;
+
+    typedef CK_PV_VERIFY_ITEM CK_PTR CK_PV_VERIFY_ITEM_PTR;
+
+    typedef CK_RV CK_PTR CK_PV_RV_PTR;
+
+    /* C_PV_VerifyBatch verifies independent single-part signatures, each
+     * with its own mechanism and key. pResults receives ulItemCount codes in
+     * the order of items, the same ones as C_VerifyInit or C_Verify returns
+     * for the item. The function returns CKR_OK if all items were processed,
+     * whether their signatures are valid or not. The session's verify
+     * operation must not be active. (since 1.3) */
+    extern CK_DECLARE_FUNCTION(CK_RV, C_PV_VerifyBatch)
+    (
+        CK_SESSION_HANDLE         hSession,     /* the session's handle */
+        CK_PV_VERIFY_ITEM_PTR     pItems,       /* signatures to be verified */
+        CK_ULONG                  ulItemCount,  /* # of items */
+        CK_PV_RV_PTR              pResults      /* gets results of items */
+    );
+
+    typedef CK_DECLARE_FUNCTION_POINTER(CK_RV, CK_C_PV_VerifyBatch)
+    (
+        CK_SESSION_HANDLE         hSession,
+        CK_PV_VERIFY_ITEM_PTR     pItems,
+        CK_ULONG                  ulItemCount,
+        CK_PV_RV_PTR              pResults
+    );
+
+    typedef struct CK_PV_FUNCTION_LIST {
+        CK_VERSION                  version;  /* version of the extensions */
+        CK_C_PV_GetAttributeValues  C_PV_GetAttributeValues;
+        CK_C_PV_DigestBatch         C_PV_DigestBatch;         /* since 1.1 */
+        CK_C_PV_SetKeyPairPool      C_PV_SetKeyPairPool;      /* since 1.2 */
+        CK_C_PV_GetKeyPairPoolInfo  C_PV_GetKeyPairPoolInfo;  /* since 1.2 */
+        CK_C_PV_VerifyBatch         C_PV_VerifyBatch;         /* since 1.3 */
+    } CK_PV_FUNCTION_LIST;
+
+    typedef CK_PV_FUNCTION_LIST CK_PTR CK_PV_FUNCTION_LIST_PTR;
+
+    typedef CK_PV_FUNCTION_LIST_PTR CK_PTR CK_PV_FUNCTION_LIST_PTR_PTR;
+
+    /* C_PV_GetFunctionList returns the function list of the vendor extensions */
+    extern CK_DECLARE_FUNCTION(CK_RV, C_PV_GetFunctionList)
+    (
+        CK_PV_FUNCTION_LIST_PTR_PTR ppFunctionList  /* receives pointer to function list */
+    );
+
+    typedef CK_DECLARE_FUNCTION_POINTER(CK_RV, CK_C_PV_GetFunctionList)
+    (
+        CK_PV_FUNCTION_LIST_PTR_PTR ppFunctionList
+    );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PVPKCS11_H_ */
@@ -0,0 +1,75 @@
+#include "certificate.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include "helper.h"
+
+using namespace soft;
+
+soft::X509Certificate::X509Certificate()
+    : core::X509Certificate()
+{
+}
+
+void soft::X509Certificate::Assign(
+    Scoped<Buffer>      der
+)
+{
+    try {
+        // Certificate ::= SEQUENCE { tbsCertificate, signatureAlgorithm, signatureValue }
+        ASN1_ITEM cert;
+        ASN1_ITEM tbs;
+        if (!Asn1Read(der->data(), der->size(), &cert) ||
+            !Asn1Read(cert.pValue, cert.ulValueLen, &tbs)) {
+            THROW_EXCEPTION("Cannot parse certificate");
+        }
+
+        // TBSCertificate ::= SEQUENCE { [0] version OPTIONAL, serialNumber, signature, issuer, validity, subject, ... }
+        ASN1_ITEM items[5];
+        CK_BYTE_PTR pItem = tbs.pValue;
+        CK_ULONG ulItemLen = tbs.ulValueLen;
+        for (int i = 0; i < 5;) {
+            ASN1_ITEM item;
+            if (!Asn1Read(pItem, ulItemLen, &item)) {
+                THROW_EXCEPTION("Cannot parse TBSCertificate");
+            }
+            pItem += item.ulItemLen;
+            ulItemLen -= item.ulItemLen;
+            if (i == 0 && item.tag == 0xA0) {
+                // skip version
+                continue;
+            }
+            items[i++] = item;
+        }
+
+        ASN1_ITEM* serialNumber = &items[0];
+        ASN1_ITEM* issuer = &items[2];
+        ASN1_ITEM* subject = &items[4];
+
+        ItemByType(CKA_SERIAL_NUMBER)->To<core::AttributeBytes>()->Set(serialNumber->pItem, serialNumber->ulItemLen);
+        ItemByType(CKA_ISSUER)->To<core::AttributeBytes>()->Set(issuer->pItem, issuer->ulItemLen);
+        ItemByType(CKA_SUBJECT)->To<core::AttributeBytes>()->Set(subject->pItem, subject->ulItemLen);
+        ItemByType(CKA_VALUE)->To<core::AttributeBytes>()->Set(cert.pItem, cert.ulItemLen);
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::X509Certificate::SetPath(const std::string& path)
+{
+    this->path = path;
+}
+
+CK_RV soft::X509Certificate::Destroy()
+{
+    try {
+        if (path.empty()) {
+            return CKR_OK;
+        }
+        if (unlink(path.c_str())) {
+            THROW_SOFT_EXCEPTION(errno, "unlink");
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "../core/objects/x509_certificate.h"
+
+namespace soft {
+
+    class X509Certificate : public core::X509Certificate {
+    public:
+        X509Certificate();
+
+        /**
+         * Fills attributes from DER encoded certificate
+         */
+        void Assign
+        (
+            Scoped<Buffer>      der         /* DER encoded certificate */
+        );
+
+        /**
+         * Links certificate to the file of the token store
+         */
+        void SetPath(const std::string& path);
+
+        CK_RV Destroy();
+
+    protected:
+        std::string path;
+    };
+
+}
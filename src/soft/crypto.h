@@ -0,0 +1,691 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "../core/crypto.h"
+#include "../core/crypto/sha.h"
+#include "../core/crypto/hmac.h"
+#include "../core/crypto/aes.h"
+#include "../core/crypto/gcm.h"
+#include "../core/crypto/xts.h"
+#include "../core/crypto/chacha.h"
+#include "../core/crypto/rsa.h"
+#include "../core/crypto/ec.h"
+#include "../core/crypto/curve25519.h"
+
+namespace soft {
+
+    class CryptoDigest : public core::CryptoDigest {
+    public:
+        CryptoDigest() : core::CryptoDigest() {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR  pMechanism  /* the digesting mechanism */
+        );
+
+        CK_RV Once(
+            CK_BYTE_PTR       pData,        /* data to be digested */
+            CK_ULONG          ulDataLen,    /* bytes of data to digest */
+            CK_BYTE_PTR       pDigest,      /* gets the message digest */
+            CK_ULONG_PTR      pulDigestLen  /* gets digest length */
+        );
+
+        CK_RV Update
+        (
+            CK_BYTE_PTR       pPart,     /* data to be digested */
+            CK_ULONG          ulPartLen  /* bytes of data to be digested */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pDigest,      /* gets the message digest */
+            CK_ULONG_PTR      pulDigestLen  /* gets byte count of digest */
+        );
+
+        CK_RV Batch(
+            CK_MECHANISM_PTR  pMechanism,      /* the digesting mechanism */
+            CK_PV_DATA_PTR    pMessages,       /* messages to be digested */
+            CK_ULONG          ulMessageCount,  /* # of messages */
+            CK_BYTE_PTR       pDigests,        /* gets the digests */
+            CK_ULONG_PTR      pulDigestsLen    /* gets size of digests */
+        );
+
+        CK_RV GetState(
+            CK_BYTE_PTR       pState,       /* gets state */
+            CK_ULONG_PTR      pulStateLen   /* gets state length */
+        );
+
+        CK_RV SetState(
+            CK_BYTE_PTR       pState,       /* holds state */
+            CK_ULONG          ulStateLen    /* holds state length */
+        );
+
+    protected:
+        core::Sha           sha;
+    };
+
+    class CryptoHmacSign : public core::CryptoSign {
+    public:
+        CryptoHmacSign(CK_BBOOL type) : core::CryptoSign(type) {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,  /* the signature mechanism */
+            Scoped<core::Object>    key          /* signature key */
+        );
+
+        using core::CryptoSign::Once;
+
+        CK_RV Once(
+            CK_BYTE_PTR       pData,           /* the data to sign */
+            CK_ULONG          ulDataLen,       /* count of bytes to sign */
+            CK_BYTE_PTR       pSignature,      /* gets the signature */
+            CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+        );
+
+        CK_RV Update
+        (
+            CK_BYTE_PTR       pPart,     /* the data to sign/verify */
+            CK_ULONG          ulPartLen  /* count of bytes to sign/verify */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pSignature,      /* gets the signature */
+            CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pSignature,     /* signature to verify */
+            CK_ULONG          ulSignatureLen  /* signature length */
+        );
+
+    protected:
+        core::Hmac          hmac;
+    };
+
+    /**
+     * CKM_AES_ECB, CKM_AES_CBC and CKM_AES_CBC_PAD
+     */
+    class CryptoAesEncrypt : public core::CryptoEncrypt {
+    public:
+        CryptoAesEncrypt(CK_BBOOL type) : core::CryptoEncrypt(type) {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,  /* the encryption mechanism */
+            Scoped<core::Object>    key          /* encryption key */
+        );
+
+        CK_RV Once
+        (
+            CK_BYTE_PTR       pData,               /* the plaintext data */
+            CK_ULONG          ulDataLen,           /* bytes of plaintext */
+            CK_BYTE_PTR       pEncryptedData,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedDataLen  /* gets c-text size */
+        );
+
+        CK_RV Update
+        (
+            CK_BYTE_PTR       pPart,               /* the plaintext data */
+            CK_ULONG          ulPartLen,           /* plaintext data len */
+            CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text size */
+        );
+
+        CK_ULONG GetUpdateLength
+        (
+            CK_ULONG          ulPartLen            /* plaintext data len */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pLastEncryptedPart,      /* last c-text */
+            CK_ULONG_PTR      pulLastEncryptedPartLen  /* gets last size */
+        );
+
+    protected:
+        core::AesBlockMode  mode;
+    };
+
+    class CryptoAesCtrEncrypt : public core::CryptoEncrypt {
+    public:
+        CryptoAesCtrEncrypt(CK_BBOOL type) : core::CryptoEncrypt(type) {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,  /* the encryption mechanism */
+            Scoped<core::Object>    key          /* encryption key */
+        );
+
+        CK_RV Once
+        (
+            CK_BYTE_PTR       pData,               /* the plaintext data */
+            CK_ULONG          ulDataLen,           /* bytes of plaintext */
+            CK_BYTE_PTR       pEncryptedData,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedDataLen  /* gets c-text size */
+        );
+
+        CK_RV Update
+        (
+            CK_BYTE_PTR       pPart,               /* the plaintext data */
+            CK_ULONG          ulPartLen,           /* plaintext data len */
+            CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text size */
+        );
+
+        CK_ULONG GetUpdateLength
+        (
+            CK_ULONG          ulPartLen            /* plaintext data len */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pLastEncryptedPart,      /* last c-text */
+            CK_ULONG_PTR      pulLastEncryptedPartLen  /* gets last size */
+        );
+
+    protected:
+        core::AesCtr        ctr;
+    };
+
+    /**
+     * CKM_AES_XTS with the tweak of one data unit or CK_PV_AES_XTS_PARAMS
+     */
+    class CryptoAesXtsEncrypt : public core::CryptoEncrypt {
+    public:
+        CryptoAesXtsEncrypt(CK_BBOOL type) : core::CryptoEncrypt(type) {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,  /* the encryption mechanism */
+            Scoped<core::Object>    key          /* encryption key */
+        );
+
+        CK_RV Once
+        (
+            CK_BYTE_PTR       pData,               /* the plaintext data */
+            CK_ULONG          ulDataLen,           /* bytes of plaintext */
+            CK_BYTE_PTR       pEncryptedData,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedDataLen  /* gets c-text size */
+        );
+
+        CK_RV Update
+        (
+            CK_BYTE_PTR       pPart,               /* the plaintext data */
+            CK_ULONG          ulPartLen,           /* plaintext data len */
+            CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text size */
+        );
+
+        CK_ULONG GetUpdateLength
+        (
+            CK_ULONG          ulPartLen            /* plaintext data len */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pLastEncryptedPart,      /* last c-text */
+            CK_ULONG_PTR      pulLastEncryptedPartLen  /* gets last size */
+        );
+
+    protected:
+        core::Xts           xts;
+    };
+
+    /**
+     * CKM_AES_GCM. The tag follows ciphertext. Decryption keeps all parts until Final,
+     * so no plaintext is returned before the tag is checked
+     */
+    class CryptoAesGCMEncrypt : public core::CryptoEncrypt {
+    public:
+        CryptoAesGCMEncrypt(CK_BBOOL type) : core::CryptoEncrypt(type), tagLength(0) {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,  /* the encryption mechanism */
+            Scoped<core::Object>    key          /* encryption key */
+        );
+
+        CK_RV Once
+        (
+            CK_BYTE_PTR       pData,               /* the plaintext data */
+            CK_ULONG          ulDataLen,           /* bytes of plaintext */
+            CK_BYTE_PTR       pEncryptedData,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedDataLen  /* gets c-text size */
+        );
+
+        CK_RV Update
+        (
+            CK_BYTE_PTR       pPart,               /* the plaintext data */
+            CK_ULONG          ulPartLen,           /* plaintext data len */
+            CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text size */
+        );
+
+        CK_ULONG GetUpdateLength
+        (
+            CK_ULONG          ulPartLen            /* plaintext data len */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pLastEncryptedPart,      /* last c-text */
+            CK_ULONG_PTR      pulLastEncryptedPartLen  /* gets last size */
+        );
+
+    protected:
+        core::Gcm           gcm;
+        CK_ULONG            tagLength;
+        // Ciphertext and tag of decryption
+        Buffer              encrypted;
+
+        /**
+         * Decrypts ciphertext followed by the tag. Output is cleared and
+         * CKR_ENCRYPTED_DATA_INVALID is thrown if the tag does not match
+         */
+        void Decrypt(
+            CK_BYTE_PTR       pData,
+            CK_ULONG          ulDataLen,
+            CK_BYTE_PTR       pOutput
+        );
+    };
+
+    class CryptoAesGCMMessageEncrypt : public core::CryptoGcmMessageEncrypt {
+    public:
+        CryptoAesGCMMessageEncrypt(CK_BBOOL type) : core::CryptoGcmMessageEncrypt(type) {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,
+            Scoped<core::Object>    key
+        );
+
+    protected:
+        Scoped<core::GcmKey>    gcmKey;
+        core::Gcm               gcm;
+
+        void GcmBegin
+        (
+            CK_BYTE_PTR       pIv,
+            CK_ULONG          ulIvLen,
+            CK_BYTE_PTR       pAssociatedData,
+            CK_ULONG          ulAssociatedDataLen,
+            CK_ULONG          ulTagLen
+        );
+
+        void GcmRandom
+        (
+            CK_BYTE_PTR       pbData,
+            CK_ULONG          ulDataLen
+        );
+
+        void GcmUpdate
+        (
+            CK_BYTE_PTR       pData,
+            CK_ULONG          ulDataLen,
+            CK_BYTE_PTR       pOutput
+        );
+
+        bool GcmFinal
+        (
+            CK_BYTE_PTR       pData,
+            CK_ULONG          ulDataLen,
+            CK_BYTE_PTR       pOutput,
+            CK_BYTE_PTR       pTag,
+            CK_ULONG          ulTagLen
+        );
+    };
+
+    /**
+     * CKM_CHACHA20_POLY1305 with a 32-byte generic secret key. The tag follows ciphertext.
+     * Decryption keeps all parts until Final, so no plaintext is returned before the tag
+     * is checked
+     */
+    class CryptoChaCha20Poly1305Encrypt : public core::CryptoEncrypt {
+    public:
+        CryptoChaCha20Poly1305Encrypt(CK_BBOOL type) : core::CryptoEncrypt(type) {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,  /* the encryption mechanism */
+            Scoped<core::Object>    key          /* encryption key */
+        );
+
+        CK_RV Once
+        (
+            CK_BYTE_PTR       pData,               /* the plaintext data */
+            CK_ULONG          ulDataLen,           /* bytes of plaintext */
+            CK_BYTE_PTR       pEncryptedData,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedDataLen  /* gets c-text size */
+        );
+
+        CK_RV Update
+        (
+            CK_BYTE_PTR       pPart,               /* the plaintext data */
+            CK_ULONG          ulPartLen,           /* plaintext data len */
+            CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text size */
+        );
+
+        CK_ULONG GetUpdateLength
+        (
+            CK_ULONG          ulPartLen            /* plaintext data len */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pLastEncryptedPart,      /* last c-text */
+            CK_ULONG_PTR      pulLastEncryptedPartLen  /* gets last size */
+        );
+
+    protected:
+        core::ChaCha20Poly1305  aead;
+        // Ciphertext and tag of decryption
+        Buffer                  encrypted;
+
+        /**
+         * Decrypts ciphertext followed by the tag. Output is cleared and
+         * CKR_ENCRYPTED_DATA_INVALID is thrown if the tag does not match
+         */
+        void Decrypt(
+            CK_BYTE_PTR       pData,
+            CK_ULONG          ulDataLen,
+            CK_BYTE_PTR       pOutput
+        );
+    };
+
+    /**
+     * CKM_RSA_PKCS for DigestInfo of the caller, CKM_SHA1_RSA_PKCS, CKM_SHA256_RSA_PKCS,
+     * CKM_SHA384_RSA_PKCS and CKM_SHA512_RSA_PKCS
+     */
+    class CryptoRsaPKCS1Sign : public core::CryptoSign {
+    public:
+        CryptoRsaPKCS1Sign(CK_BBOOL type) : core::CryptoSign(type), digestMechanism(0) {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,  /* the signature mechanism */
+            Scoped<core::Object>    key          /* signature key */
+        );
+
+        using core::CryptoSign::Once;
+
+        CK_RV Once(
+            CK_BYTE_PTR       pData,           /* the data to sign */
+            CK_ULONG          ulDataLen,       /* count of bytes to sign */
+            CK_BYTE_PTR       pSignature,      /* gets the signature */
+            CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+        );
+
+        CK_RV Update
+        (
+            CK_BYTE_PTR       pPart,     /* the data to sign/verify */
+            CK_ULONG          ulPartLen  /* count of bytes to sign/verify */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pSignature,      /* gets the signature */
+            CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pSignature,     /* signature to verify */
+            CK_ULONG          ulSignatureLen  /* signature length */
+        );
+
+    protected:
+        Scoped<core::Rsa>   rsa;
+        // Zero for CKM_RSA_PKCS
+        CK_MECHANISM_TYPE   digestMechanism;
+        core::Sha           sha;
+        // Data of CKM_RSA_PKCS
+        Buffer              data;
+
+        /**
+         * EMSA-PKCS1-v1_5 of the data to the modulus length
+         */
+        void Encode(
+            CK_BYTE_PTR       pbEncoded,
+            size_t            len
+        );
+    };
+
+    /**
+     * CKM_RSA_PKCS_PSS for the hash of the caller, CKM_SHA1_RSA_PKCS_PSS,
+     * CKM_SHA256_RSA_PKCS_PSS, CKM_SHA384_RSA_PKCS_PSS and CKM_SHA512_RSA_PKCS_PSS
+     */
+    class CryptoRsaPSSSign : public core::CryptoSign {
+    public:
+        CryptoRsaPSSSign(CK_BBOOL type) : core::CryptoSign(type), prehashed(false), digestMechanism(0), mgfDigestMechanism(0), saltLength(0) {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,  /* the signature mechanism */
+            Scoped<core::Object>    key          /* signature key */
+        );
+
+        using core::CryptoSign::Once;
+
+        CK_RV Once(
+            CK_BYTE_PTR       pData,           /* the data to sign */
+            CK_ULONG          ulDataLen,       /* count of bytes to sign */
+            CK_BYTE_PTR       pSignature,      /* gets the signature */
+            CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+        );
+
+        CK_RV Update
+        (
+            CK_BYTE_PTR       pPart,     /* the data to sign/verify */
+            CK_ULONG          ulPartLen  /* count of bytes to sign/verify */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pSignature,      /* gets the signature */
+            CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pSignature,     /* signature to verify */
+            CK_ULONG          ulSignatureLen  /* signature length */
+        );
+
+    protected:
+        Scoped<core::Rsa>   rsa;
+        // CKM_RSA_PKCS_PSS gets the hash in data
+        bool                prehashed;
+        CK_MECHANISM_TYPE   digestMechanism;
+        CK_MECHANISM_TYPE   mgfDigestMechanism;
+        size_t              saltLength;
+        core::Sha           sha;
+        Buffer              data;
+
+        /**
+         * Returns the hash of the message
+         */
+        Buffer GetHash();
+    };
+
+    /**
+     * CKM_RSA_PKCS_OAEP, single-part only
+     */
+    class CryptoRsaOAEPEncrypt : public core::CryptoEncrypt {
+    public:
+        CryptoRsaOAEPEncrypt(CK_BBOOL type) : core::CryptoEncrypt(type), digestMechanism(0), mgfDigestMechanism(0) {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,  /* the encryption mechanism */
+            Scoped<core::Object>    key          /* encryption key */
+        );
+
+        CK_RV Once
+        (
+            CK_BYTE_PTR       pData,               /* the plaintext data */
+            CK_ULONG          ulDataLen,           /* bytes of plaintext */
+            CK_BYTE_PTR       pEncryptedData,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedDataLen  /* gets c-text size */
+        );
+
+        CK_RV Update
+        (
+            CK_BYTE_PTR       pPart,               /* the plaintext data */
+            CK_ULONG          ulPartLen,           /* plaintext data len */
+            CK_BYTE_PTR       pEncryptedPart,      /* gets ciphertext */
+            CK_ULONG_PTR      pulEncryptedPartLen  /* gets c-text size */
+        );
+
+        CK_ULONG GetUpdateLength
+        (
+            CK_ULONG          ulPartLen            /* plaintext data len */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pLastEncryptedPart,      /* last c-text */
+            CK_ULONG_PTR      pulLastEncryptedPartLen  /* gets last size */
+        );
+
+    protected:
+        Scoped<core::Rsa>   rsa;
+        CK_MECHANISM_TYPE   digestMechanism;
+        CK_MECHANISM_TYPE   mgfDigestMechanism;
+        Buffer              label;
+    };
+
+    /**
+     * CKM_ECDSA for the hash of the caller, CKM_ECDSA_SHA1, CKM_ECDSA_SHA256, CKM_ECDSA_SHA384
+     * and CKM_ECDSA_SHA512. Signature is r || s
+     */
+    class CryptoEcDsaSign : public core::CryptoSign {
+    public:
+        CryptoEcDsaSign(CK_BBOOL type) : core::CryptoSign(type), digestMechanism(0) {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,  /* the signature mechanism */
+            Scoped<core::Object>    key          /* signature key */
+        );
+
+        using core::CryptoSign::Once;
+
+        CK_RV Once(
+            CK_BYTE_PTR       pData,           /* the data to sign */
+            CK_ULONG          ulDataLen,       /* count of bytes to sign */
+            CK_BYTE_PTR       pSignature,      /* gets the signature */
+            CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+        );
+
+        CK_RV Update
+        (
+            CK_BYTE_PTR       pPart,     /* the data to sign/verify */
+            CK_ULONG          ulPartLen  /* count of bytes to sign/verify */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pSignature,      /* gets the signature */
+            CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pSignature,     /* signature to verify */
+            CK_ULONG          ulSignatureLen  /* signature length */
+        );
+
+    protected:
+        Scoped<core::Ec>    ec;
+        // Zero for CKM_ECDSA
+        CK_MECHANISM_TYPE   digestMechanism;
+        core::Sha           sha;
+        // Hash of CKM_ECDSA
+        Buffer              data;
+
+        size_t GetSignatureLength();
+
+        /**
+         * Returns the hash of the message
+         */
+        Buffer GetHash();
+    };
+
+    /**
+     * CKM_EDDSA of Ed25519. CK_EDDSA_PARAMS selects Ed25519ctx or Ed25519ph, the message
+     * is buffered for pure Ed25519 and hashed by SHA-512 for Ed25519ph
+     */
+    class CryptoEdDsaSign : public core::CryptoSign {
+    public:
+        CryptoEdDsaSign(CK_BBOOL type) : core::CryptoSign(type), preHash(false) {}
+
+        CK_RV Init
+        (
+            CK_MECHANISM_PTR        pMechanism,  /* the signature mechanism */
+            Scoped<core::Object>    key          /* signature key */
+        );
+
+        using core::CryptoSign::Once;
+
+        CK_RV Once(
+            CK_BYTE_PTR       pData,           /* the data to sign */
+            CK_ULONG          ulDataLen,       /* count of bytes to sign */
+            CK_BYTE_PTR       pSignature,      /* gets the signature */
+            CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+        );
+
+        CK_RV Update
+        (
+            CK_BYTE_PTR       pPart,     /* the data to sign/verify */
+            CK_ULONG          ulPartLen  /* count of bytes to sign/verify */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pSignature,      /* gets the signature */
+            CK_ULONG_PTR      pulSignatureLen  /* gets signature length */
+        );
+
+        CK_RV Final
+        (
+            CK_BYTE_PTR       pSignature,     /* signature to verify */
+            CK_ULONG          ulSignatureLen  /* signature length */
+        );
+
+        /**
+         * Fills the item of Ed25519::VerifyBatch for the message and the signature of
+         * the initialized verification. Returns false if the signature can't be batched,
+         * then Once verifies it. The item refers to the operation and the arguments
+         */
+        bool GetBatchItem(
+            CK_BYTE_PTR                     pData,
+            CK_ULONG                        ulDataLen,
+            CK_BYTE_PTR                     pSignature,
+            CK_ULONG                        ulSignatureLen,
+            core::Ed25519::VERIFY_ITEM*     item
+        );
+
+    protected:
+        Scoped<core::Ed25519>   key;
+        // dom2(F, C) of Ed25519ctx and Ed25519ph, empty for Ed25519
+        Buffer                  dom;
+        bool                    preHash;
+        core::Sha               sha;
+        Buffer                  data;
+
+        /**
+         * Returns the message of the signature, it's the hash for Ed25519ph
+         */
+        const Buffer& GetMessage();
+    };
+
+#define DIGEST_SHA1(pbData, ulDataLen) core::Sha::Digest(CKM_SHA_1, pbData, ulDataLen)
+#define DIGEST_SHA256(pbData, ulDataLen) core::Sha::Digest(CKM_SHA256, pbData, ulDataLen)
+#define DIGEST_SHA384(pbData, ulDataLen) core::Sha::Digest(CKM_SHA384, pbData, ulDataLen)
+#define DIGEST_SHA512(pbData, ulDataLen) core::Sha::Digest(CKM_SHA512, pbData, ulDataLen)
+
+}
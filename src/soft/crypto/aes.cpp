@@ -0,0 +1,663 @@
+#include "../crypto.h"
+#include "../secret_key.h"
+#include "../random.h"
+
+using namespace soft;
+
+static AesKey* GetAesKey(Scoped<core::Object> key, CK_BBOOL type)
+{
+    AesKey* aesKey = dynamic_cast<AesKey*>(key.get());
+    if (!aesKey) {
+        THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key is not AES");
+    }
+    if (!aesKey->ItemByType(type == CRYPTO_ENCRYPT ? CKA_ENCRYPT : CKA_DECRYPT)->ToBool()) {
+        THROW_PKCS11_EXCEPTION(CKR_KEY_FUNCTION_NOT_PERMITTED, "Key doesn't support encryption/decryption");
+    }
+    return aesKey;
+}
+
+CK_RV soft::CryptoAesEncrypt::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoEncrypt::Init(pMechanism, key);
+
+        switch (pMechanism->mechanism) {
+        case CKM_AES_CBC:
+        case CKM_AES_CBC_PAD:
+            // IV
+            if (pMechanism->pParameter == NULL_PTR) {
+                THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is NULL");
+            }
+            if (pMechanism->ulParameterLen != AES_BLOCK_LENGTH) {
+                THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "AES-CBC IV must be 16 bytes");
+            }
+            break;
+        case CKM_AES_ECB:
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        AesKey* aesKey = GetAesKey(key, type);
+        mode.Init(aesKey->GetAes(), pMechanism->mechanism, type == CRYPTO_DECRYPT, (CK_BYTE_PTR)pMechanism->pParameter);
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesEncrypt::Once
+(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pEncryptedData,
+    CK_ULONG_PTR      pulEncryptedDataLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pData == NULL_PTR && ulDataLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pData is NULL");
+        }
+        if (pulEncryptedDataLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulEncryptedDataLen is NULL");
+        }
+        // Padded decryption gets the exact size only after the last block is decrypted
+        CK_ULONG ulUpdateLen = (CK_ULONG)mode.GetUpdateLength(ulDataLen);
+        CK_ULONG ulMaxLen = ulUpdateLen + (CK_ULONG)mode.GetFinalLength();
+        if (pEncryptedData == NULL_PTR) {
+            *pulEncryptedDataLen = ulMaxLen;
+            return CKR_OK;
+        }
+        if (*pulEncryptedDataLen < ulUpdateLen) {
+            *pulEncryptedDataLen = ulMaxLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        // The operation stays as it was if the last block doesn't fit
+        core::AesBlockMode once = mode;
+        CK_BYTE last[AES_BLOCK_LENGTH];
+        size_t lastLen;
+        try {
+            once.Update(pData, ulDataLen, pEncryptedData);
+            lastLen = once.Final(last);
+        }
+        catch (...) {
+            active = false;
+            throw;
+        }
+        if (*pulEncryptedDataLen - ulUpdateLen < lastLen) {
+            *pulEncryptedDataLen = ulUpdateLen + (CK_ULONG)lastLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+        memcpy(pEncryptedData + ulUpdateLen, last, lastLen);
+        memset(last, 0, sizeof(last));
+        *pulEncryptedDataLen = ulUpdateLen + (CK_ULONG)lastLen;
+        active = false;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesEncrypt::Update
+(
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen,
+    CK_BYTE_PTR       pEncryptedPart,
+    CK_ULONG_PTR      pulEncryptedPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pPart == NULL_PTR && ulPartLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pPart is NULL");
+        }
+        if (pulEncryptedPartLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulEncryptedPartLen is NULL");
+        }
+        CK_ULONG ulOutLen = GetUpdateLength(ulPartLen);
+        if (pEncryptedPart == NULL_PTR) {
+            *pulEncryptedPartLen = ulOutLen;
+            return CKR_OK;
+        }
+        if (*pulEncryptedPartLen < ulOutLen) {
+            *pulEncryptedPartLen = ulOutLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        try {
+            *pulEncryptedPartLen = (CK_ULONG)mode.Update(pPart, ulPartLen, pEncryptedPart);
+        }
+        catch (...) {
+            active = false;
+            throw;
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_ULONG soft::CryptoAesEncrypt::GetUpdateLength
+(
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+
+        return (CK_ULONG)mode.GetUpdateLength(ulPartLen);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesEncrypt::Final
+(
+    CK_BYTE_PTR       pLastEncryptedPart,
+    CK_ULONG_PTR      pulLastEncryptedPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pulLastEncryptedPartLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulLastEncryptedPartLen is NULL");
+        }
+
+        // The size is known after the last block is processed, so it is processed on a copy
+        core::AesBlockMode rest = mode;
+        CK_BYTE last[AES_BLOCK_LENGTH];
+        size_t lastLen;
+        try {
+            lastLen = rest.Final(last);
+        }
+        catch (...) {
+            active = false;
+            throw;
+        }
+        if (pLastEncryptedPart == NULL_PTR) {
+            *pulLastEncryptedPartLen = (CK_ULONG)lastLen;
+            return CKR_OK;
+        }
+        if (*pulLastEncryptedPartLen < lastLen) {
+            *pulLastEncryptedPartLen = (CK_ULONG)lastLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+        memcpy(pLastEncryptedPart, last, lastLen);
+        memset(last, 0, sizeof(last));
+        *pulLastEncryptedPartLen = (CK_ULONG)lastLen;
+        active = false;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesCtrEncrypt::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoEncrypt::Init(pMechanism, key);
+
+        if (pMechanism->mechanism != CKM_AES_CTR) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+        if (pMechanism->pParameter == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is NULL");
+        }
+        if (pMechanism->ulParameterLen != sizeof(CK_AES_CTR_PARAMS)) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is not CK_AES_CTR_PARAMS");
+        }
+        CK_AES_CTR_PARAMS_PTR params = (CK_AES_CTR_PARAMS_PTR)pMechanism->pParameter;
+
+        AesKey* aesKey = GetAesKey(key, type);
+        ctr.Init(aesKey->GetAes(), params->cb, params->ulCounterBits);
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesCtrEncrypt::Once
+(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pEncryptedData,
+    CK_ULONG_PTR      pulEncryptedDataLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pData == NULL_PTR && ulDataLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pData is NULL");
+        }
+        if (pulEncryptedDataLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulEncryptedDataLen is NULL");
+        }
+        // CTR output has the same size as input
+        if (pEncryptedData == NULL_PTR) {
+            *pulEncryptedDataLen = ulDataLen;
+            return CKR_OK;
+        }
+        if (*pulEncryptedDataLen < ulDataLen) {
+            *pulEncryptedDataLen = ulDataLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        active = false;
+        ctr.Update(pData, pEncryptedData, ulDataLen);
+        *pulEncryptedDataLen = ulDataLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesCtrEncrypt::Update
+(
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen,
+    CK_BYTE_PTR       pEncryptedPart,
+    CK_ULONG_PTR      pulEncryptedPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pPart == NULL_PTR && ulPartLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pPart is NULL");
+        }
+        if (pulEncryptedPartLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulEncryptedPartLen is NULL");
+        }
+        if (pEncryptedPart == NULL_PTR) {
+            *pulEncryptedPartLen = ulPartLen;
+            return CKR_OK;
+        }
+        if (*pulEncryptedPartLen < ulPartLen) {
+            *pulEncryptedPartLen = ulPartLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        try {
+            ctr.Update(pPart, pEncryptedPart, ulPartLen);
+        }
+        catch (...) {
+            active = false;
+            throw;
+        }
+        *pulEncryptedPartLen = ulPartLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_ULONG soft::CryptoAesCtrEncrypt::GetUpdateLength
+(
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+
+        // CTR output has the same size as input
+        return ulPartLen;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesCtrEncrypt::Final
+(
+    CK_BYTE_PTR       pLastEncryptedPart,
+    CK_ULONG_PTR      pulLastEncryptedPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pulLastEncryptedPartLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulLastEncryptedPartLen is NULL");
+        }
+
+        // All data is processed by Update, the call with NULL only gets the size
+        *pulLastEncryptedPartLen = 0;
+        if (pLastEncryptedPart != NULL_PTR) {
+            active = false;
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesGCMEncrypt::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoEncrypt::Init(pMechanism, key);
+
+        if (pMechanism->mechanism != CKM_AES_GCM) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+        if (pMechanism->pParameter == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is NULL");
+        }
+        if (pMechanism->ulParameterLen != sizeof(CK_AES_GCM_PARAMS)) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is not CK_AES_GCM_PARAMS");
+        }
+        CK_AES_GCM_PARAMS_PTR params = (CK_AES_GCM_PARAMS_PTR)pMechanism->pParameter;
+        if (params->pIv == NULL_PTR || !params->ulIvLen) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "IV is empty");
+        }
+        if (params->pAAD == NULL_PTR && params->ulAADLen) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pAAD is NULL");
+        }
+        // SP 800-38D allows 128, 120, 112, 104, 96, 64 and 32 bits
+        CK_ULONG tagBits = params->ulTagBits;
+        if (tagBits % 8 || tagBits > 128 || (tagBits < 96 && tagBits != 64 && tagBits != 32)) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Wrong tag length");
+        }
+
+        AesKey* aesKey = GetAesKey(key, type);
+        gcm.Init(aesKey->GetGcmKey(), params->pIv, params->ulIvLen);
+        gcm.Aad(params->pAAD, params->ulAADLen);
+        tagLength = tagBits >> 3;
+        encrypted.clear();
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::CryptoAesGCMEncrypt::Decrypt
+(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pOutput
+)
+{
+    CK_ULONG ulOutLen = ulDataLen - tagLength;
+    gcm.Decrypt(pData, pOutput, ulOutLen);
+
+    CK_BYTE tag[GCM_TAG_LENGTH];
+    gcm.Final(tag);
+    CK_BYTE diff = 0;
+    for (CK_ULONG i = 0; i < tagLength; i++) {
+        diff |= tag[i] ^ pData[ulOutLen + i];
+    }
+    if (diff) {
+        memset(pOutput, 0, ulOutLen);
+        THROW_PKCS11_EXCEPTION(CKR_ENCRYPTED_DATA_INVALID, "Tag does not match");
+    }
+}
+
+CK_RV soft::CryptoAesGCMEncrypt::Once
+(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pEncryptedData,
+    CK_ULONG_PTR      pulEncryptedDataLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pData == NULL_PTR && ulDataLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pData is NULL");
+        }
+        if (pulEncryptedDataLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulEncryptedDataLen is NULL");
+        }
+        if (type == CRYPTO_DECRYPT && ulDataLen < tagLength) {
+            active = false;
+            THROW_PKCS11_EXCEPTION(CKR_ENCRYPTED_DATA_LEN_RANGE, "Encrypted data is shorter than the tag");
+        }
+        CK_ULONG ulOutLen = type == CRYPTO_ENCRYPT ? ulDataLen + tagLength : ulDataLen - tagLength;
+        if (pEncryptedData == NULL_PTR) {
+            *pulEncryptedDataLen = ulOutLen;
+            return CKR_OK;
+        }
+        if (*pulEncryptedDataLen < ulOutLen) {
+            *pulEncryptedDataLen = ulOutLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        active = false;
+        if (type == CRYPTO_ENCRYPT) {
+            CK_BYTE tag[GCM_TAG_LENGTH];
+            gcm.Encrypt(pData, pEncryptedData, ulDataLen);
+            gcm.Final(tag);
+            memcpy(pEncryptedData + ulDataLen, tag, tagLength);
+        }
+        else {
+            Decrypt(pData, ulDataLen, pEncryptedData);
+        }
+        *pulEncryptedDataLen = ulOutLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesGCMEncrypt::Update
+(
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen,
+    CK_BYTE_PTR       pEncryptedPart,
+    CK_ULONG_PTR      pulEncryptedPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pPart == NULL_PTR && ulPartLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pPart is NULL");
+        }
+        if (pulEncryptedPartLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulEncryptedPartLen is NULL");
+        }
+        CK_ULONG ulOutLen = GetUpdateLength(ulPartLen);
+        if (pEncryptedPart == NULL_PTR) {
+            *pulEncryptedPartLen = ulOutLen;
+            return CKR_OK;
+        }
+        if (*pulEncryptedPartLen < ulOutLen) {
+            *pulEncryptedPartLen = ulOutLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        try {
+            if (type == CRYPTO_ENCRYPT) {
+                gcm.Encrypt(pPart, pEncryptedPart, ulPartLen);
+            }
+            else {
+                encrypted.insert(encrypted.end(), pPart, pPart + ulPartLen);
+            }
+        }
+        catch (...) {
+            active = false;
+            throw;
+        }
+        *pulEncryptedPartLen = ulOutLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_ULONG soft::CryptoAesGCMEncrypt::GetUpdateLength
+(
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+
+        // Decryption returns plaintext from Final only
+        return type == CRYPTO_ENCRYPT ? ulPartLen : 0;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesGCMEncrypt::Final
+(
+    CK_BYTE_PTR       pLastEncryptedPart,
+    CK_ULONG_PTR      pulLastEncryptedPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pulLastEncryptedPartLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulLastEncryptedPartLen is NULL");
+        }
+        if (type == CRYPTO_DECRYPT && encrypted.size() < tagLength) {
+            active = false;
+            THROW_PKCS11_EXCEPTION(CKR_ENCRYPTED_DATA_LEN_RANGE, "Encrypted data is shorter than the tag");
+        }
+        CK_ULONG ulOutLen = type == CRYPTO_ENCRYPT ? tagLength : (CK_ULONG)encrypted.size() - tagLength;
+        if (pLastEncryptedPart == NULL_PTR) {
+            *pulLastEncryptedPartLen = ulOutLen;
+            return CKR_OK;
+        }
+        if (*pulLastEncryptedPartLen < ulOutLen) {
+            *pulLastEncryptedPartLen = ulOutLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        active = false;
+        if (type == CRYPTO_ENCRYPT) {
+            CK_BYTE tag[GCM_TAG_LENGTH];
+            gcm.Final(tag);
+            memcpy(pLastEncryptedPart, tag, tagLength);
+        }
+        else {
+            Buffer data;
+            data.swap(encrypted);
+            Decrypt(data.data(), (CK_ULONG)data.size(), pLastEncryptedPart);
+        }
+        *pulLastEncryptedPartLen = ulOutLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+// AES-GCM message-based encryption
+
+CK_RV soft::CryptoAesGCMMessageEncrypt::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoGcmMessageEncrypt::Init(pMechanism, key);
+
+        // GHASH tables are computed once for all messages
+        gcmKey = GetAesKey(key, type)->GetGcmKey();
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::CryptoAesGCMMessageEncrypt::GcmBegin
+(
+    CK_BYTE_PTR       pIv,
+    CK_ULONG          ulIvLen,
+    CK_BYTE_PTR       pAssociatedData,
+    CK_ULONG          ulAssociatedDataLen,
+    CK_ULONG          ulTagLen
+)
+{
+    gcm.Init(gcmKey, pIv, ulIvLen);
+    gcm.Aad(pAssociatedData, ulAssociatedDataLen);
+}
+
+void soft::CryptoAesGCMMessageEncrypt::GcmRandom
+(
+    CK_BYTE_PTR       pbData,
+    CK_ULONG          ulDataLen
+)
+{
+    soft::GenerateRandom(pbData, ulDataLen);
+}
+
+void soft::CryptoAesGCMMessageEncrypt::GcmUpdate
+(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pOutput
+)
+{
+    if (type == CRYPTO_ENCRYPT) {
+        gcm.Encrypt(pData, pOutput, ulDataLen);
+    }
+    else {
+        gcm.Decrypt(pData, pOutput, ulDataLen);
+    }
+}
+
+bool soft::CryptoAesGCMMessageEncrypt::GcmFinal
+(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pOutput,
+    CK_BYTE_PTR       pTag,
+    CK_ULONG          ulTagLen
+)
+{
+    GcmUpdate(pData, ulDataLen, pOutput);
+
+    CK_BYTE tag[GCM_TAG_LENGTH];
+    gcm.Final(tag);
+
+    if (type == CRYPTO_ENCRYPT) {
+        memcpy(pTag, tag, ulTagLen);
+        return true;
+    }
+    CK_BYTE diff = 0;
+    for (CK_ULONG i = 0; i < ulTagLen; i++) {
+        diff |= tag[i] ^ pTag[i];
+    }
+    return !diff;
+}
@@ -0,0 +1,228 @@
+#include "../crypto.h"
+#include "../secret_key.h"
+
+using namespace soft;
+
+CK_RV soft::CryptoChaCha20Poly1305Encrypt::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoEncrypt::Init(pMechanism, key);
+
+        if (pMechanism->mechanism != CKM_CHACHA20_POLY1305) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+        if (pMechanism->pParameter == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is NULL");
+        }
+        if (pMechanism->ulParameterLen != sizeof(CK_SALSA20_CHACHA20_POLY1305_PARAMS)) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is not CK_SALSA20_CHACHA20_POLY1305_PARAMS");
+        }
+        CK_SALSA20_CHACHA20_POLY1305_PARAMS_PTR params = (CK_SALSA20_CHACHA20_POLY1305_PARAMS_PTR)pMechanism->pParameter;
+        if (params->pNonce == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pNonce is NULL");
+        }
+        if (params->pAAD == NULL_PTR && params->ulAADLen) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pAAD is NULL");
+        }
+
+        GenericSecretKey* secretKey = dynamic_cast<GenericSecretKey*>(key.get());
+        if (!secretKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key is not a generic secret");
+        }
+        if (!secretKey->ItemByType(type == CRYPTO_ENCRYPT ? CKA_ENCRYPT : CKA_DECRYPT)->ToBool()) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_FUNCTION_NOT_PERMITTED, "Key doesn't support encryption/decryption");
+        }
+        Scoped<Buffer> value = secretKey->ItemByType(CKA_VALUE)->ToBytes();
+        if (value->size() != CHACHA20_KEY_LENGTH) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_SIZE_RANGE, "ChaCha20 key must be 32 bytes");
+        }
+
+        aead.Init(value->data(), params->pNonce, params->ulNonceLen);
+        aead.Aad(params->pAAD, params->ulAADLen);
+        encrypted.clear();
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::CryptoChaCha20Poly1305Encrypt::Decrypt
+(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pOutput
+)
+{
+    CK_ULONG ulOutLen = ulDataLen - POLY1305_TAG_LENGTH;
+    aead.Decrypt(pData, pOutput, ulOutLen);
+
+    CK_BYTE tag[POLY1305_TAG_LENGTH];
+    aead.Final(tag);
+    CK_BYTE diff = 0;
+    for (CK_ULONG i = 0; i < POLY1305_TAG_LENGTH; i++) {
+        diff |= tag[i] ^ pData[ulOutLen + i];
+    }
+    if (diff) {
+        memset(pOutput, 0, ulOutLen);
+        THROW_PKCS11_EXCEPTION(CKR_ENCRYPTED_DATA_INVALID, "Tag does not match");
+    }
+}
+
+CK_RV soft::CryptoChaCha20Poly1305Encrypt::Once
+(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pEncryptedData,
+    CK_ULONG_PTR      pulEncryptedDataLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pData == NULL_PTR && ulDataLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pData is NULL");
+        }
+        if (pulEncryptedDataLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulEncryptedDataLen is NULL");
+        }
+        if (type == CRYPTO_DECRYPT && ulDataLen < POLY1305_TAG_LENGTH) {
+            active = false;
+            THROW_PKCS11_EXCEPTION(CKR_ENCRYPTED_DATA_LEN_RANGE, "Encrypted data is shorter than the tag");
+        }
+        CK_ULONG ulOutLen = type == CRYPTO_ENCRYPT ? ulDataLen + POLY1305_TAG_LENGTH : ulDataLen - POLY1305_TAG_LENGTH;
+        if (pEncryptedData == NULL_PTR) {
+            *pulEncryptedDataLen = ulOutLen;
+            return CKR_OK;
+        }
+        if (*pulEncryptedDataLen < ulOutLen) {
+            *pulEncryptedDataLen = ulOutLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        active = false;
+        if (type == CRYPTO_ENCRYPT) {
+            aead.Encrypt(pData, pEncryptedData, ulDataLen);
+            aead.Final(pEncryptedData + ulDataLen);
+        }
+        else {
+            Decrypt(pData, ulDataLen, pEncryptedData);
+        }
+        *pulEncryptedDataLen = ulOutLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoChaCha20Poly1305Encrypt::Update
+(
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen,
+    CK_BYTE_PTR       pEncryptedPart,
+    CK_ULONG_PTR      pulEncryptedPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pPart == NULL_PTR && ulPartLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pPart is NULL");
+        }
+        if (pulEncryptedPartLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulEncryptedPartLen is NULL");
+        }
+        CK_ULONG ulOutLen = GetUpdateLength(ulPartLen);
+        if (pEncryptedPart == NULL_PTR) {
+            *pulEncryptedPartLen = ulOutLen;
+            return CKR_OK;
+        }
+        if (*pulEncryptedPartLen < ulOutLen) {
+            *pulEncryptedPartLen = ulOutLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        try {
+            if (type == CRYPTO_ENCRYPT) {
+                aead.Encrypt(pPart, pEncryptedPart, ulPartLen);
+            }
+            else {
+                encrypted.insert(encrypted.end(), pPart, pPart + ulPartLen);
+            }
+        }
+        catch (...) {
+            active = false;
+            throw;
+        }
+        *pulEncryptedPartLen = ulOutLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_ULONG soft::CryptoChaCha20Poly1305Encrypt::GetUpdateLength
+(
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+
+        // Decryption returns plaintext from Final only
+        return type == CRYPTO_ENCRYPT ? ulPartLen : 0;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoChaCha20Poly1305Encrypt::Final
+(
+    CK_BYTE_PTR       pLastEncryptedPart,
+    CK_ULONG_PTR      pulLastEncryptedPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pulLastEncryptedPartLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulLastEncryptedPartLen is NULL");
+        }
+        if (type == CRYPTO_DECRYPT && encrypted.size() < POLY1305_TAG_LENGTH) {
+            active = false;
+            THROW_PKCS11_EXCEPTION(CKR_ENCRYPTED_DATA_LEN_RANGE, "Encrypted data is shorter than the tag");
+        }
+        CK_ULONG ulOutLen = type == CRYPTO_ENCRYPT ? POLY1305_TAG_LENGTH : (CK_ULONG)encrypted.size() - POLY1305_TAG_LENGTH;
+        if (pLastEncryptedPart == NULL_PTR) {
+            *pulLastEncryptedPartLen = ulOutLen;
+            return CKR_OK;
+        }
+        if (*pulLastEncryptedPartLen < ulOutLen) {
+            *pulLastEncryptedPartLen = ulOutLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        active = false;
+        if (type == CRYPTO_ENCRYPT) {
+            aead.Final(pLastEncryptedPart);
+        }
+        else {
+            Buffer data;
+            data.swap(encrypted);
+            Decrypt(data.data(), (CK_ULONG)data.size(), pLastEncryptedPart);
+        }
+        *pulLastEncryptedPartLen = ulOutLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
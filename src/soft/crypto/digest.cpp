@@ -0,0 +1,179 @@
+#include "../crypto.h"
+
+using namespace soft;
+
+CK_RV soft::CryptoDigest::Init
+(
+    CK_MECHANISM_PTR  pMechanism  /* the digesting mechanism */
+)
+{
+    try {
+        core::CryptoDigest::Init(pMechanism);
+
+        sha.Init(pMechanism->mechanism);
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoDigest::Once(
+    CK_BYTE_PTR       pData,        /* data to be digested */
+    CK_ULONG          ulDataLen,    /* bytes of data to digest */
+    CK_BYTE_PTR       pDigest,      /* gets the message digest */
+    CK_ULONG_PTR      pulDigestLen  /* gets digest length */
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pData == NULL_PTR && ulDataLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pData is NULL");
+        }
+        if (pulDigestLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulDigestLen is NULL");
+        }
+        // Data must not be digested if the call is repeated with a larger buffer
+        CK_ULONG ulDigestLen = sha.GetDigestLength();
+        if (pDigest == NULL_PTR) {
+            *pulDigestLen = ulDigestLen;
+            return CKR_OK;
+        }
+        if (*pulDigestLen < ulDigestLen) {
+            *pulDigestLen = ulDigestLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        active = false;
+
+        // Empty data may come with NULL pointer
+        if (ulDataLen) {
+            sha.Update(pData, ulDataLen);
+        }
+        *pulDigestLen = ulDigestLen;
+        sha.Final(pDigest);
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoDigest::Update(
+    CK_BYTE_PTR       pPart,     /* data to be digested */
+    CK_ULONG          ulPartLen  /* bytes of data to be digested */
+)
+{
+    try {
+        core::CryptoDigest::Update(pPart, ulPartLen);
+
+        sha.Update(pPart, ulPartLen);
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoDigest::Final(
+    CK_BYTE_PTR       pDigest,      /* gets the message digest */
+    CK_ULONG_PTR      pulDigestLen  /* gets byte count of digest */
+)
+{
+    try {
+        core::CryptoDigest::Final(pDigest, pulDigestLen);
+
+        CK_ULONG ulDigestLen = sha.GetDigestLength();
+        if (!pDigest) {
+            *pulDigestLen = ulDigestLen;
+            return CKR_OK;
+        }
+        if (*pulDigestLen < ulDigestLen) {
+            *pulDigestLen = ulDigestLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        *pulDigestLen = ulDigestLen;
+        sha.Final(pDigest);
+
+        active = false;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoDigest::Batch(
+    CK_MECHANISM_PTR  pMechanism,      /* the digesting mechanism */
+    CK_PV_DATA_PTR    pMessages,       /* messages to be digested */
+    CK_ULONG          ulMessageCount,  /* # of messages */
+    CK_BYTE_PTR       pDigests,        /* gets the digests */
+    CK_ULONG_PTR      pulDigestsLen    /* gets size of digests */
+)
+{
+    try {
+        CK_ULONG ulDigestLen = BatchInit(pMechanism, pMessages, ulMessageCount, pulDigestsLen);
+        CK_ULONG ulDigestsLen = ulDigestLen * ulMessageCount;
+
+        if (pDigests == NULL_PTR) {
+            *pulDigestsLen = ulDigestsLen;
+            return CKR_OK;
+        }
+        if (*pulDigestsLen < ulDigestsLen) {
+            *pulDigestsLen = ulDigestsLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+        *pulDigestsLen = ulDigestsLen;
+
+        core::Sha::DigestMany(pMechanism->mechanism, pMessages, ulMessageCount, pDigests);
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoDigest::GetState(
+    CK_BYTE_PTR       pState,       /* gets state */
+    CK_ULONG_PTR      pulStateLen   /* gets state length */
+)
+{
+    try {
+        core::CryptoDigest::GetState(pState, pulStateLen);
+
+        CK_ULONG ulStateLen = sha.GetStateLength();
+        if (pState == NULL_PTR) {
+            *pulStateLen = ulStateLen;
+            return CKR_OK;
+        }
+        if (*pulStateLen < ulStateLen) {
+            *pulStateLen = ulStateLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        *pulStateLen = ulStateLen;
+        sha.GetState(pState);
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoDigest::SetState(
+    CK_BYTE_PTR       pState,       /* holds state */
+    CK_ULONG          ulStateLen    /* holds state length */
+)
+{
+    try {
+        core::CryptoDigest::SetState(pState, ulStateLen);
+
+        // State is checked on a copy, so the digest in progress survives a rejected state
+        core::Sha restored;
+        restored.SetState(pState, ulStateLen);
+        sha = restored;
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,203 @@
+#include "../crypto.h"
+#include "../ec.h"
+#include "../random.h"
+
+using namespace soft;
+
+/**
+ * Returns EC key of the private key for CRYPTO_SIGN and of the public key otherwise. Key must
+ * allow usage
+ */
+static Scoped<core::Ec> GetEcKey(Scoped<core::Object> key, bool privateKey, CK_ATTRIBUTE_TYPE usage)
+{
+    Scoped<core::Ec> ec;
+    if (privateKey) {
+        EcPrivateKey* ecKey = dynamic_cast<EcPrivateKey*>(key.get());
+        if (!ecKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key is not EC private key");
+        }
+        if (!ecKey->ItemByType(usage)->ToBool()) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_FUNCTION_NOT_PERMITTED, "Key doesn't support the operation");
+        }
+        ec = ecKey->GetEc();
+    }
+    else {
+        EcPublicKey* ecKey = dynamic_cast<EcPublicKey*>(key.get());
+        if (!ecKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key is not EC public key");
+        }
+        if (!ecKey->ItemByType(usage)->ToBool()) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_FUNCTION_NOT_PERMITTED, "Key doesn't support the operation");
+        }
+        ec = ecKey->GetEc();
+    }
+    return ec;
+}
+
+CK_RV soft::CryptoEcDsaSign::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoSign::Init(pMechanism, key);
+
+        switch (pMechanism->mechanism) {
+        case CKM_ECDSA:
+            digestMechanism = 0;
+            break;
+        case CKM_ECDSA_SHA1:
+            digestMechanism = CKM_SHA_1;
+            break;
+        case CKM_ECDSA_SHA256:
+            digestMechanism = CKM_SHA256;
+            break;
+        case CKM_ECDSA_SHA384:
+            digestMechanism = CKM_SHA384;
+            break;
+        case CKM_ECDSA_SHA512:
+            digestMechanism = CKM_SHA512;
+            break;
+        default:
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_INVALID, "Wrong Mechanism in use");
+        }
+
+        ec = type == CRYPTO_SIGN
+            ? GetEcKey(key, true, CKA_SIGN)
+            : GetEcKey(key, false, CKA_VERIFY);
+
+        if (digestMechanism) {
+            sha.Init(digestMechanism);
+        }
+        data.clear();
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+size_t soft::CryptoEcDsaSign::GetSignatureLength()
+{
+    return 2 * ec->GetCurve()->GetOrderBytes();
+}
+
+CK_RV soft::CryptoEcDsaSign::Once(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG_PTR      pulSignatureLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pulSignatureLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulSignatureLen is NULL");
+        }
+        // Data must not be signed if the call is repeated with a buffer
+        CK_ULONG ulSignatureLen = (CK_ULONG)GetSignatureLength();
+        if (pSignature == NULL_PTR) {
+            *pulSignatureLen = ulSignatureLen;
+            return CKR_OK;
+        }
+        if (*pulSignatureLen < ulSignatureLen) {
+            *pulSignatureLen = ulSignatureLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        return core::CryptoSign::Once(pData, ulDataLen, pSignature, pulSignatureLen);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoEcDsaSign::Update
+(
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        core::CryptoSign::Update(pPart, ulPartLen);
+
+        if (digestMechanism) {
+            sha.Update(pPart, ulPartLen);
+        }
+        else {
+            data.insert(data.end(), pPart, pPart + ulPartLen);
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Buffer soft::CryptoEcDsaSign::GetHash()
+{
+    if (!digestMechanism) {
+        if (data.empty()) {
+            THROW_PKCS11_EXCEPTION(CKR_DATA_LEN_RANGE, "Data is empty");
+        }
+        return data;
+    }
+
+    Buffer hash(core::Sha::GetDigestLength(digestMechanism));
+    sha.Final(hash.data());
+    return hash;
+}
+
+CK_RV soft::CryptoEcDsaSign::Final
+(
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG_PTR      pulSignatureLen
+)
+{
+    try {
+        core::CryptoSign::Final(pSignature, pulSignatureLen);
+
+        size_t signatureLen = GetSignatureLength();
+        if (pSignature == NULL_PTR) {
+            *pulSignatureLen = (CK_ULONG)signatureLen;
+            return CKR_OK;
+        }
+        if (*pulSignatureLen < signatureLen) {
+            *pulSignatureLen = (CK_ULONG)signatureLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        active = false;
+
+        Buffer hash = GetHash();
+        ec->Sign(hash.data(), hash.size(), pSignature, soft::GenerateRandom);
+        *pulSignatureLen = (CK_ULONG)signatureLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoEcDsaSign::Final
+(
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG          ulSignatureLen
+)
+{
+    try {
+        core::CryptoSign::Final(pSignature, ulSignatureLen);
+
+        active = false;
+
+        if (ulSignatureLen != GetSignatureLength()) {
+            THROW_PKCS11_EXCEPTION(CKR_SIGNATURE_LEN_RANGE, "Wrong ECDSA signature length");
+        }
+
+        Buffer hash = GetHash();
+        return ec->Verify(hash.data(), hash.size(), pSignature)
+            ? CKR_OK
+            : CKR_SIGNATURE_INVALID;
+    }
+    CATCH_EXCEPTION
+}
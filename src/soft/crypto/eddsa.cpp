@@ -0,0 +1,221 @@
+#include "../crypto.h"
+#include "../ec_edwards.h"
+
+using namespace soft;
+
+#define ED25519_DOM_PREFIX      "SigEd25519 no Ed25519 collisions"
+
+/**
+ * Returns Ed25519 key of the private key for CRYPTO_SIGN and of the public key otherwise. Key
+ * must allow usage
+ */
+static Scoped<core::Ed25519> GetEdKey(Scoped<core::Object> key, bool privateKey, CK_ATTRIBUTE_TYPE usage)
+{
+    Scoped<core::Ed25519> ed;
+    if (privateKey) {
+        EdPrivateKey* edKey = dynamic_cast<EdPrivateKey*>(key.get());
+        if (!edKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key is not Edwards private key");
+        }
+        if (!edKey->ItemByType(usage)->ToBool()) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_FUNCTION_NOT_PERMITTED, "Key doesn't support the operation");
+        }
+        ed = edKey->GetKey();
+    }
+    else {
+        EdPublicKey* edKey = dynamic_cast<EdPublicKey*>(key.get());
+        if (!edKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key is not Edwards public key");
+        }
+        if (!edKey->ItemByType(usage)->ToBool()) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_FUNCTION_NOT_PERMITTED, "Key doesn't support the operation");
+        }
+        ed = edKey->GetKey();
+    }
+    return ed;
+}
+
+CK_RV soft::CryptoEdDsaSign::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoSign::Init(pMechanism, key);
+
+        if (pMechanism->mechanism != CKM_EDDSA) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_INVALID, "Wrong Mechanism in use");
+        }
+
+        // Ed25519 without parameters, dom2(F, C) of Ed25519ctx and Ed25519ph otherwise
+        preHash = false;
+        dom.clear();
+        if (pMechanism->pParameter) {
+            if (pMechanism->ulParameterLen != sizeof(CK_EDDSA_PARAMS)) {
+                THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is not CK_EDDSA_PARAMS");
+            }
+            CK_EDDSA_PARAMS_PTR params = static_cast<CK_EDDSA_PARAMS_PTR>(pMechanism->pParameter);
+            if (params->ulContextDataLen > 255 ||
+                (params->ulContextDataLen && params->pContextData == NULL_PTR)) {
+                THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Wrong EdDSA context");
+            }
+            preHash = params->phFlag != CK_FALSE;
+            if (preHash || params->ulContextDataLen) {
+                const char* prefix = ED25519_DOM_PREFIX;
+                dom.assign(prefix, prefix + strlen(prefix));
+                dom.push_back(preHash ? 1 : 0);
+                dom.push_back((CK_BYTE)params->ulContextDataLen);
+                dom.insert(dom.end(), params->pContextData, params->pContextData + params->ulContextDataLen);
+            }
+        }
+
+        this->key = type == CRYPTO_SIGN
+            ? GetEdKey(key, true, CKA_SIGN)
+            : GetEdKey(key, false, CKA_VERIFY);
+
+        if (preHash) {
+            sha.Init(CKM_SHA512);
+        }
+        data.clear();
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoEdDsaSign::Once(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG_PTR      pulSignatureLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pulSignatureLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulSignatureLen is NULL");
+        }
+        // Data must not be signed if the call is repeated with a buffer
+        if (pSignature == NULL_PTR) {
+            *pulSignatureLen = ED25519_SIGNATURE_BYTES;
+            return CKR_OK;
+        }
+        if (*pulSignatureLen < ED25519_SIGNATURE_BYTES) {
+            *pulSignatureLen = ED25519_SIGNATURE_BYTES;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        return core::CryptoSign::Once(pData, ulDataLen, pSignature, pulSignatureLen);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoEdDsaSign::Update
+(
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        core::CryptoSign::Update(pPart, ulPartLen);
+
+        if (preHash) {
+            sha.Update(pPart, ulPartLen);
+        }
+        else {
+            data.insert(data.end(), pPart, pPart + ulPartLen);
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+const Buffer& soft::CryptoEdDsaSign::GetMessage()
+{
+    if (preHash) {
+        data.resize(core::Sha::GetDigestLength(CKM_SHA512));
+        sha.Final(data.data());
+    }
+    return data;
+}
+
+CK_RV soft::CryptoEdDsaSign::Final
+(
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG_PTR      pulSignatureLen
+)
+{
+    try {
+        core::CryptoSign::Final(pSignature, pulSignatureLen);
+
+        if (pSignature == NULL_PTR) {
+            *pulSignatureLen = ED25519_SIGNATURE_BYTES;
+            return CKR_OK;
+        }
+        if (*pulSignatureLen < ED25519_SIGNATURE_BYTES) {
+            *pulSignatureLen = ED25519_SIGNATURE_BYTES;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        active = false;
+
+        const Buffer& message = GetMessage();
+        key->Sign(dom.data(), dom.size(), message.data(), message.size(), pSignature);
+        *pulSignatureLen = ED25519_SIGNATURE_BYTES;
+        data.clear();
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoEdDsaSign::Final
+(
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG          ulSignatureLen
+)
+{
+    try {
+        core::CryptoSign::Final(pSignature, ulSignatureLen);
+
+        active = false;
+
+        if (ulSignatureLen != ED25519_SIGNATURE_BYTES) {
+            THROW_PKCS11_EXCEPTION(CKR_SIGNATURE_LEN_RANGE, "Wrong EdDSA signature length");
+        }
+
+        const Buffer& message = GetMessage();
+        bool valid = key->Verify(dom.data(), dom.size(), message.data(), message.size(), pSignature);
+        data.clear();
+        return valid
+            ? CKR_OK
+            : CKR_SIGNATURE_INVALID;
+    }
+    CATCH_EXCEPTION
+}
+
+bool soft::CryptoEdDsaSign::GetBatchItem(
+    CK_BYTE_PTR                     pData,
+    CK_ULONG                        ulDataLen,
+    CK_BYTE_PTR                     pSignature,
+    CK_ULONG                        ulSignatureLen,
+    core::Ed25519::VERIFY_ITEM*     item
+)
+{
+    if (!active || type != CRYPTO_VERIFY || preHash || ulSignatureLen != ED25519_SIGNATURE_BYTES) {
+        return false;
+    }
+    item->key = key.get();
+    item->pbDom = dom.data();
+    item->domLen = dom.size();
+    item->pbMessage = pData;
+    item->messageLen = ulDataLen;
+    item->pbSignature = pSignature;
+    return true;
+}
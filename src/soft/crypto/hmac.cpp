@@ -0,0 +1,140 @@
+#include "../crypto.h"
+#include "../secret_key.h"
+
+using namespace soft;
+
+CK_RV soft::CryptoHmacSign::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoSign::Init(pMechanism, key);
+
+        CK_MECHANISM_TYPE digestMechanism = core::Hmac::GetDigestMechanism(pMechanism->mechanism);
+        if (!digestMechanism) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_INVALID, "Wrong Mechanism in use");
+        }
+
+        GenericSecretKey* secretKey = dynamic_cast<GenericSecretKey*>(key.get());
+        if (!secretKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key is not generic secret key");
+        }
+        if (!secretKey->ItemByType(type == CRYPTO_SIGN ? CKA_SIGN : CKA_VERIFY)->ToBool()) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_FUNCTION_NOT_PERMITTED, "Key doesn't support signing/verifying");
+        }
+
+        hmac.Init(secretKey->GetHmacPads(digestMechanism));
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoHmacSign::Once(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG_PTR      pulSignatureLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pulSignatureLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulSignatureLen is NULL");
+        }
+        // Data must not be signed if the call is repeated with a buffer
+        CK_ULONG ulMacLen = hmac.GetMacLength();
+        if (pSignature == NULL_PTR) {
+            *pulSignatureLen = ulMacLen;
+            return CKR_OK;
+        }
+        if (*pulSignatureLen < ulMacLen) {
+            *pulSignatureLen = ulMacLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        return core::CryptoSign::Once(pData, ulDataLen, pSignature, pulSignatureLen);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoHmacSign::Update
+(
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        core::CryptoSign::Update(pPart, ulPartLen);
+
+        hmac.Update(pPart, ulPartLen);
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoHmacSign::Final
+(
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG_PTR      pulSignatureLen
+)
+{
+    try {
+        core::CryptoSign::Final(pSignature, pulSignatureLen);
+
+        CK_ULONG ulMacLen = hmac.GetMacLength();
+        if (pSignature == NULL_PTR) {
+            *pulSignatureLen = ulMacLen;
+            return CKR_OK;
+        }
+        if (*pulSignatureLen < ulMacLen) {
+            *pulSignatureLen = ulMacLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        *pulSignatureLen = ulMacLen;
+        hmac.Final(pSignature);
+
+        active = false;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoHmacSign::Final
+(
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG          ulSignatureLen
+)
+{
+    try {
+        core::CryptoSign::Final(pSignature, ulSignatureLen);
+
+        active = false;
+
+        CK_ULONG ulMacLen = hmac.GetMacLength();
+        if (ulSignatureLen != ulMacLen) {
+            THROW_PKCS11_EXCEPTION(CKR_SIGNATURE_LEN_RANGE, "Wrong HMAC length");
+        }
+
+        CK_BYTE mac[64];
+        hmac.Final(mac);
+
+        // Constant time comparison
+        CK_BYTE diff = 0;
+        for (CK_ULONG i = 0; i < ulMacLen; i++) {
+            diff |= mac[i] ^ pSignature[i];
+        }
+
+        return diff ? CKR_SIGNATURE_INVALID : CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
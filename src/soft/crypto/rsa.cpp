@@ -0,0 +1,633 @@
+#include "../crypto.h"
+#include "../rsa.h"
+#include "../random.h"
+
+using namespace soft;
+
+/**
+ * Returns RSA key of the private key for CRYPTO_SIGN and CRYPTO_DECRYPT, and of the
+ * public key otherwise. Key must allow usage
+ */
+static Scoped<core::Rsa> GetRsaKey(Scoped<core::Object> key, bool privateKey, CK_ATTRIBUTE_TYPE usage)
+{
+    Scoped<core::Rsa> rsa;
+    if (privateKey) {
+        RsaPrivateKey* rsaKey = dynamic_cast<RsaPrivateKey*>(key.get());
+        if (!rsaKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key is not RSA private key");
+        }
+        if (!rsaKey->ItemByType(usage)->ToBool()) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_FUNCTION_NOT_PERMITTED, "Key doesn't support the operation");
+        }
+        rsa = rsaKey->GetRsa();
+    }
+    else {
+        RsaPublicKey* rsaKey = dynamic_cast<RsaPublicKey*>(key.get());
+        if (!rsaKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key is not RSA public key");
+        }
+        if (!rsaKey->ItemByType(usage)->ToBool()) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_FUNCTION_NOT_PERMITTED, "Key doesn't support the operation");
+        }
+        rsa = rsaKey->GetRsa();
+    }
+    return rsa;
+}
+
+static CK_MECHANISM_TYPE GetHashMechanism(CK_MECHANISM_TYPE hashAlg)
+{
+    switch (hashAlg) {
+    case CKM_SHA_1:
+    case CKM_SHA256:
+    case CKM_SHA384:
+    case CKM_SHA512:
+        return hashAlg;
+    default:
+        THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Wrong hashAlg");
+    }
+}
+
+static CK_MECHANISM_TYPE GetMgfMechanism(CK_RSA_PKCS_MGF_TYPE mgf)
+{
+    switch (mgf) {
+    case CKG_MGF1_SHA1:
+        return CKM_SHA_1;
+    case CKG_MGF1_SHA256:
+        return CKM_SHA256;
+    case CKG_MGF1_SHA384:
+        return CKM_SHA384;
+    case CKG_MGF1_SHA512:
+        return CKM_SHA512;
+    default:
+        THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Wrong mgf");
+    }
+}
+
+static size_t GetModulusLength(Scoped<core::Rsa> rsa)
+{
+    return (rsa->GetModulusBits() + 7) / 8;
+}
+
+// Signature or ciphertext of len bytes for the encoded message
+static void RsaPrivate(Scoped<core::Rsa> rsa, const CK_BYTE* pbEncoded, CK_BYTE_PTR pbOutput, size_t len)
+{
+    core::BigNum input = core::BigNum::FromBytes(pbEncoded, len);
+    rsa->PrivateOperation(input, soft::GenerateRandom).ToBytes(pbOutput, len);
+}
+
+// Returns false if the signature is not less than modulus
+static bool RsaRecover(Scoped<core::Rsa> rsa, const CK_BYTE* pbSignature, CK_BYTE_PTR pbEncoded, size_t len)
+{
+    core::BigNum signature = core::BigNum::FromBytes(pbSignature, len);
+    if (core::BigNum::Compare(signature, rsa->GetModulus()) >= 0) {
+        return false;
+    }
+    rsa->PublicOperation(signature).ToBytes(pbEncoded, len);
+    return true;
+}
+
+// RSA PKCS#1 v1.5 signature
+
+CK_RV soft::CryptoRsaPKCS1Sign::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoSign::Init(pMechanism, key);
+
+        switch (pMechanism->mechanism) {
+        case CKM_RSA_PKCS:
+            digestMechanism = 0;
+            break;
+        case CKM_SHA1_RSA_PKCS:
+            digestMechanism = CKM_SHA_1;
+            break;
+        case CKM_SHA256_RSA_PKCS:
+            digestMechanism = CKM_SHA256;
+            break;
+        case CKM_SHA384_RSA_PKCS:
+            digestMechanism = CKM_SHA384;
+            break;
+        case CKM_SHA512_RSA_PKCS:
+            digestMechanism = CKM_SHA512;
+            break;
+        default:
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_INVALID, "Wrong Mechanism in use");
+        }
+
+        rsa = type == CRYPTO_SIGN
+            ? GetRsaKey(key, true, CKA_SIGN)
+            : GetRsaKey(key, false, CKA_VERIFY);
+
+        if (digestMechanism) {
+            sha.Init(digestMechanism);
+        }
+        data.clear();
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoRsaPKCS1Sign::Once(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG_PTR      pulSignatureLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pulSignatureLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulSignatureLen is NULL");
+        }
+        // Data must not be signed if the call is repeated with a buffer
+        CK_ULONG ulModulusLen = (CK_ULONG)GetModulusLength(rsa);
+        if (pSignature == NULL_PTR) {
+            *pulSignatureLen = ulModulusLen;
+            return CKR_OK;
+        }
+        if (*pulSignatureLen < ulModulusLen) {
+            *pulSignatureLen = ulModulusLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        return core::CryptoSign::Once(pData, ulDataLen, pSignature, pulSignatureLen);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoRsaPKCS1Sign::Update
+(
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        core::CryptoSign::Update(pPart, ulPartLen);
+
+        if (digestMechanism) {
+            sha.Update(pPart, ulPartLen);
+        }
+        else {
+            data.insert(data.end(), pPart, pPart + ulPartLen);
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::CryptoRsaPKCS1Sign::Encode(
+    CK_BYTE_PTR       pbEncoded,
+    size_t            len
+)
+{
+    if (!digestMechanism) {
+        core::RsaPkcs1Encode(data.data(), data.size(), pbEncoded, len);
+        return;
+    }
+
+    const CK_BYTE* prefix;
+    size_t prefixLen;
+    core::RsaGetDigestInfoPrefix(digestMechanism, &prefix, &prefixLen);
+
+    CK_BYTE digestInfo[32 + 64];
+    memcpy(digestInfo, prefix, prefixLen);
+    sha.Final(digestInfo + prefixLen);
+    core::RsaPkcs1Encode(digestInfo, prefixLen + core::Sha::GetDigestLength(digestMechanism), pbEncoded, len);
+}
+
+CK_RV soft::CryptoRsaPKCS1Sign::Final
+(
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG_PTR      pulSignatureLen
+)
+{
+    try {
+        core::CryptoSign::Final(pSignature, pulSignatureLen);
+
+        size_t modulusLen = GetModulusLength(rsa);
+        if (pSignature == NULL_PTR) {
+            *pulSignatureLen = (CK_ULONG)modulusLen;
+            return CKR_OK;
+        }
+        if (*pulSignatureLen < modulusLen) {
+            *pulSignatureLen = (CK_ULONG)modulusLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        active = false;
+
+        Buffer encoded(modulusLen);
+        Encode(encoded.data(), modulusLen);
+        RsaPrivate(rsa, encoded.data(), pSignature, modulusLen);
+        *pulSignatureLen = (CK_ULONG)modulusLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoRsaPKCS1Sign::Final
+(
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG          ulSignatureLen
+)
+{
+    try {
+        core::CryptoSign::Final(pSignature, ulSignatureLen);
+
+        active = false;
+
+        size_t modulusLen = GetModulusLength(rsa);
+        if (ulSignatureLen != modulusLen) {
+            THROW_PKCS11_EXCEPTION(CKR_SIGNATURE_LEN_RANGE, "Wrong RSA signature length");
+        }
+
+        Buffer expected(modulusLen);
+        Encode(expected.data(), modulusLen);
+
+        Buffer encoded(modulusLen);
+        if (!RsaRecover(rsa, pSignature, encoded.data(), modulusLen)) {
+            return CKR_SIGNATURE_INVALID;
+        }
+
+        return memcmp(expected.data(), encoded.data(), modulusLen) ? CKR_SIGNATURE_INVALID : CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+// RSA-PSS
+
+CK_RV soft::CryptoRsaPSSSign::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoSign::Init(pMechanism, key);
+
+        if (pMechanism->pParameter == NULL_PTR || pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS)) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is not CK_RSA_PKCS_PSS_PARAMS");
+        }
+        CK_RSA_PKCS_PSS_PARAMS_PTR params = static_cast<CK_RSA_PKCS_PSS_PARAMS_PTR>(pMechanism->pParameter);
+
+        CK_MECHANISM_TYPE mechanismDigest;
+        switch (pMechanism->mechanism) {
+        case CKM_RSA_PKCS_PSS:
+            mechanismDigest = 0;
+            break;
+        case CKM_SHA1_RSA_PKCS_PSS:
+            mechanismDigest = CKM_SHA_1;
+            break;
+        case CKM_SHA256_RSA_PKCS_PSS:
+            mechanismDigest = CKM_SHA256;
+            break;
+        case CKM_SHA384_RSA_PKCS_PSS:
+            mechanismDigest = CKM_SHA384;
+            break;
+        case CKM_SHA512_RSA_PKCS_PSS:
+            mechanismDigest = CKM_SHA512;
+            break;
+        default:
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_INVALID, "Wrong Mechanism in use");
+        }
+
+        digestMechanism = GetHashMechanism(params->hashAlg);
+        if (mechanismDigest && mechanismDigest != digestMechanism) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "hashAlg doesn't match the mechanism");
+        }
+        mgfDigestMechanism = GetMgfMechanism(params->mgf);
+        saltLength = params->sLen;
+        prehashed = !mechanismDigest;
+
+        rsa = type == CRYPTO_SIGN
+            ? GetRsaKey(key, true, CKA_SIGN)
+            : GetRsaKey(key, false, CKA_VERIFY);
+
+        size_t emLen = (rsa->GetModulusBits() + 6) / 8;
+        if (emLen < core::Sha::GetDigestLength(digestMechanism) + saltLength + 2) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Salt is too long for RSA modulus");
+        }
+
+        if (!prehashed) {
+            sha.Init(digestMechanism);
+        }
+        data.clear();
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoRsaPSSSign::Once(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG_PTR      pulSignatureLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pulSignatureLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulSignatureLen is NULL");
+        }
+        // Data must not be signed if the call is repeated with a buffer
+        CK_ULONG ulModulusLen = (CK_ULONG)GetModulusLength(rsa);
+        if (pSignature == NULL_PTR) {
+            *pulSignatureLen = ulModulusLen;
+            return CKR_OK;
+        }
+        if (*pulSignatureLen < ulModulusLen) {
+            *pulSignatureLen = ulModulusLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        return core::CryptoSign::Once(pData, ulDataLen, pSignature, pulSignatureLen);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoRsaPSSSign::Update
+(
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        core::CryptoSign::Update(pPart, ulPartLen);
+
+        if (prehashed) {
+            data.insert(data.end(), pPart, pPart + ulPartLen);
+        }
+        else {
+            sha.Update(pPart, ulPartLen);
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Buffer soft::CryptoRsaPSSSign::GetHash()
+{
+    size_t hashLen = core::Sha::GetDigestLength(digestMechanism);
+    if (prehashed) {
+        if (data.size() != hashLen) {
+            THROW_PKCS11_EXCEPTION(CKR_DATA_LEN_RANGE, "Data is not a hash of hashAlg");
+        }
+        return data;
+    }
+
+    Buffer hash(hashLen);
+    sha.Final(hash.data());
+    return hash;
+}
+
+CK_RV soft::CryptoRsaPSSSign::Final
+(
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG_PTR      pulSignatureLen
+)
+{
+    try {
+        core::CryptoSign::Final(pSignature, pulSignatureLen);
+
+        size_t modulusLen = GetModulusLength(rsa);
+        if (pSignature == NULL_PTR) {
+            *pulSignatureLen = (CK_ULONG)modulusLen;
+            return CKR_OK;
+        }
+        if (*pulSignatureLen < modulusLen) {
+            *pulSignatureLen = (CK_ULONG)modulusLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        active = false;
+
+        // Encoded message has modulus bits - 1, so it is shorter by a byte for 8k + 1 bits
+        size_t emBits = rsa->GetModulusBits() - 1;
+        size_t emLen = (emBits + 7) / 8;
+        Buffer hash = GetHash();
+        Buffer encoded(modulusLen, 0);
+        core::RsaPssEncode(digestMechanism, mgfDigestMechanism, hash.data(), saltLength,
+            encoded.data() + modulusLen - emLen, emBits, soft::GenerateRandom);
+        RsaPrivate(rsa, encoded.data(), pSignature, modulusLen);
+        *pulSignatureLen = (CK_ULONG)modulusLen;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoRsaPSSSign::Final
+(
+    CK_BYTE_PTR       pSignature,
+    CK_ULONG          ulSignatureLen
+)
+{
+    try {
+        core::CryptoSign::Final(pSignature, ulSignatureLen);
+
+        active = false;
+
+        size_t modulusLen = GetModulusLength(rsa);
+        if (ulSignatureLen != modulusLen) {
+            THROW_PKCS11_EXCEPTION(CKR_SIGNATURE_LEN_RANGE, "Wrong RSA signature length");
+        }
+
+        size_t emBits = rsa->GetModulusBits() - 1;
+        size_t emLen = (emBits + 7) / 8;
+        Buffer hash = GetHash();
+        Buffer encoded(modulusLen);
+        if (!RsaRecover(rsa, pSignature, encoded.data(), modulusLen)) {
+            return CKR_SIGNATURE_INVALID;
+        }
+        if (emLen < modulusLen && encoded[0]) {
+            return CKR_SIGNATURE_INVALID;
+        }
+
+        return core::RsaPssVerify(digestMechanism, mgfDigestMechanism, hash.data(), saltLength,
+            encoded.data() + modulusLen - emLen, emBits)
+            ? CKR_OK
+            : CKR_SIGNATURE_INVALID;
+    }
+    CATCH_EXCEPTION
+}
+
+// RSA-OAEP
+
+CK_RV soft::CryptoRsaOAEPEncrypt::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoEncrypt::Init(pMechanism, key);
+
+        if (pMechanism->mechanism != CKM_RSA_PKCS_OAEP) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+        if (pMechanism->pParameter == NULL_PTR || pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_OAEP_PARAMS)) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is not CK_RSA_PKCS_OAEP_PARAMS");
+        }
+        CK_RSA_PKCS_OAEP_PARAMS_PTR params = static_cast<CK_RSA_PKCS_OAEP_PARAMS_PTR>(pMechanism->pParameter);
+
+        digestMechanism = GetHashMechanism(params->hashAlg);
+        mgfDigestMechanism = GetMgfMechanism(params->mgf);
+        if (params->source == CKZ_DATA_SPECIFIED && params->pSourceData) {
+            label = Buffer((CK_BYTE_PTR)params->pSourceData, (CK_BYTE_PTR)params->pSourceData + params->ulSourceDataLen);
+        }
+        else if (params->source == CKZ_DATA_SPECIFIED || (!params->source && !params->ulSourceDataLen)) {
+            label.clear();
+        }
+        else {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Wrong source");
+        }
+
+        rsa = type == CRYPTO_ENCRYPT
+            ? GetRsaKey(key, false, CKA_ENCRYPT)
+            : GetRsaKey(key, true, CKA_DECRYPT);
+
+        if (GetModulusLength(rsa) < 2 * core::Sha::GetDigestLength(digestMechanism) + 2) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_SIZE_RANGE, "RSA modulus is too short for hashAlg");
+        }
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoRsaOAEPEncrypt::Once
+(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pEncryptedData,
+    CK_ULONG_PTR      pulEncryptedDataLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pData == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pData is NULL");
+        }
+        if (pulEncryptedDataLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulEncryptedDataLen is NULL");
+        }
+
+        size_t modulusLen = GetModulusLength(rsa);
+        Buffer encoded(modulusLen);
+
+        if (type == CRYPTO_ENCRYPT) {
+            if (pEncryptedData == NULL_PTR) {
+                *pulEncryptedDataLen = (CK_ULONG)modulusLen;
+                return CKR_OK;
+            }
+            if (*pulEncryptedDataLen < modulusLen) {
+                *pulEncryptedDataLen = (CK_ULONG)modulusLen;
+                THROW_PKCS11_BUFFER_TOO_SMALL();
+            }
+
+            active = false;
+
+            core::RsaOaepEncode(digestMechanism, mgfDigestMechanism, label.data(), label.size(),
+                pData, ulDataLen, encoded.data(), modulusLen, soft::GenerateRandom);
+            core::BigNum message = core::BigNum::FromBytes(encoded.data(), modulusLen);
+            rsa->PublicOperation(message).ToBytes(pEncryptedData, modulusLen);
+            *pulEncryptedDataLen = (CK_ULONG)modulusLen;
+
+            return CKR_OK;
+        }
+
+        if (pEncryptedData == NULL_PTR) {
+            *pulEncryptedDataLen = (CK_ULONG)(modulusLen - 2 * core::Sha::GetDigestLength(digestMechanism) - 2);
+            return CKR_OK;
+        }
+
+        active = false;
+
+        if (ulDataLen != modulusLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ENCRYPTED_DATA_LEN_RANGE, "Wrong RSA ciphertext length");
+        }
+        core::BigNum ciphertext = core::BigNum::FromBytes(pData, modulusLen);
+        if (core::BigNum::Compare(ciphertext, rsa->GetModulus()) >= 0) {
+            THROW_PKCS11_EXCEPTION(CKR_ENCRYPTED_DATA_INVALID, "Ciphertext is not less than RSA modulus");
+        }
+        rsa->PrivateOperation(ciphertext, soft::GenerateRandom).ToBytes(encoded.data(), modulusLen);
+
+        Buffer message(modulusLen);
+        size_t messageLen = core::RsaOaepDecode(digestMechanism, mgfDigestMechanism, label.data(), label.size(),
+            encoded.data(), modulusLen, message.data());
+        memset(encoded.data(), 0, modulusLen);
+
+        bool fits = *pulEncryptedDataLen >= messageLen;
+        if (fits) {
+            memcpy(pEncryptedData, message.data(), messageLen);
+        }
+        memset(message.data(), 0, modulusLen);
+        *pulEncryptedDataLen = (CK_ULONG)messageLen;
+        if (!fits) {
+            // The call can be repeated with a larger buffer
+            active = true;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoRsaOAEPEncrypt::Update
+(
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen,
+    CK_BYTE_PTR       pEncryptedPart,
+    CK_ULONG_PTR      pulEncryptedPartLen
+)
+{
+    try {
+        THROW_PKCS11_MECHANISM_INVALID();
+    }
+    CATCH_EXCEPTION
+}
+
+CK_ULONG soft::CryptoRsaOAEPEncrypt::GetUpdateLength
+(
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        THROW_PKCS11_MECHANISM_INVALID();
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoRsaOAEPEncrypt::Final
+(
+    CK_BYTE_PTR       pLastEncryptedPart,
+    CK_ULONG_PTR      pulLastEncryptedPartLen
+)
+{
+    try {
+        active = false;
+        THROW_PKCS11_MECHANISM_INVALID();
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,177 @@
+#include "../crypto.h"
+#include "../secret_key.h"
+
+using namespace soft;
+
+CK_RV soft::CryptoAesXtsEncrypt::Init
+(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Object>    key
+)
+{
+    try {
+        core::CryptoEncrypt::Init(pMechanism, key);
+
+        if (pMechanism->mechanism != CKM_AES_XTS) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+        if (pMechanism->pParameter == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is NULL");
+        }
+        CK_BYTE_PTR pTweak;
+        CK_ULONG ulDataUnitLen;
+        if (pMechanism->ulParameterLen == AES_BLOCK_LENGTH) {
+            // The message is one data unit
+            pTweak = (CK_BYTE_PTR)pMechanism->pParameter;
+            ulDataUnitLen = 0;
+        }
+        else if (pMechanism->ulParameterLen == sizeof(CK_PV_AES_XTS_PARAMS)) {
+            CK_PV_AES_XTS_PARAMS_PTR params = (CK_PV_AES_XTS_PARAMS_PTR)pMechanism->pParameter;
+            pTweak = params->tweak;
+            ulDataUnitLen = params->ulDataUnitLen;
+        }
+        else {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is not a 16-byte tweak or CK_PV_AES_XTS_PARAMS");
+        }
+
+        AesXtsKey* xtsKey = dynamic_cast<AesXtsKey*>(key.get());
+        if (!xtsKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "Key is not XTS-AES");
+        }
+        if (!xtsKey->ItemByType(type == CRYPTO_ENCRYPT ? CKA_ENCRYPT : CKA_DECRYPT)->ToBool()) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_FUNCTION_NOT_PERMITTED, "Key doesn't support encryption/decryption");
+        }
+
+        xts.Init(xtsKey->GetXtsKey(), pTweak, ulDataUnitLen, type == CRYPTO_DECRYPT);
+
+        active = true;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesXtsEncrypt::Once
+(
+    CK_BYTE_PTR       pData,
+    CK_ULONG          ulDataLen,
+    CK_BYTE_PTR       pEncryptedData,
+    CK_ULONG_PTR      pulEncryptedDataLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pData == NULL_PTR && ulDataLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pData is NULL");
+        }
+        if (pulEncryptedDataLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulEncryptedDataLen is NULL");
+        }
+        // XTS doesn't change the length of data
+        if (pEncryptedData == NULL_PTR) {
+            *pulEncryptedDataLen = ulDataLen;
+            return CKR_OK;
+        }
+        if (*pulEncryptedDataLen < ulDataLen) {
+            *pulEncryptedDataLen = ulDataLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        active = false;
+        size_t len = xts.Update(pData, ulDataLen, pEncryptedData);
+        len += xts.Final(pEncryptedData + len);
+        *pulEncryptedDataLen = (CK_ULONG)len;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesXtsEncrypt::Update
+(
+    CK_BYTE_PTR       pPart,
+    CK_ULONG          ulPartLen,
+    CK_BYTE_PTR       pEncryptedPart,
+    CK_ULONG_PTR      pulEncryptedPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pPart == NULL_PTR && ulPartLen) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pPart is NULL");
+        }
+        if (pulEncryptedPartLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulEncryptedPartLen is NULL");
+        }
+        CK_ULONG ulOutLen = GetUpdateLength(ulPartLen);
+        if (pEncryptedPart == NULL_PTR) {
+            *pulEncryptedPartLen = ulOutLen;
+            return CKR_OK;
+        }
+        if (*pulEncryptedPartLen < ulOutLen) {
+            *pulEncryptedPartLen = ulOutLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        try {
+            *pulEncryptedPartLen = (CK_ULONG)xts.Update(pPart, ulPartLen, pEncryptedPart);
+        }
+        catch (...) {
+            active = false;
+            throw;
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_ULONG soft::CryptoAesXtsEncrypt::GetUpdateLength
+(
+    CK_ULONG          ulPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+
+        return (CK_ULONG)xts.GetUpdateLength(ulPartLen);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::CryptoAesXtsEncrypt::Final
+(
+    CK_BYTE_PTR       pLastEncryptedPart,
+    CK_ULONG_PTR      pulLastEncryptedPartLen
+)
+{
+    try {
+        if (!active) {
+            THROW_PKCS11_OPERATION_NOT_INITIALIZED();
+        }
+        if (pulLastEncryptedPartLen == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pulLastEncryptedPartLen is NULL");
+        }
+        CK_ULONG ulOutLen = (CK_ULONG)xts.GetFinalLength();
+        if (pLastEncryptedPart == NULL_PTR) {
+            *pulLastEncryptedPartLen = ulOutLen;
+            return CKR_OK;
+        }
+        if (*pulLastEncryptedPartLen < ulOutLen) {
+            *pulLastEncryptedPartLen = ulOutLen;
+            THROW_PKCS11_BUFFER_TOO_SMALL();
+        }
+
+        active = false;
+        *pulLastEncryptedPartLen = (CK_ULONG)xts.Final(pLastEncryptedPart);
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,32 @@
+#include "data.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include "helper.h"
+
+using namespace soft;
+
+soft::Data::Data()
+    : core::Data()
+{
+}
+
+void soft::Data::SetPath(const std::string& path)
+{
+    this->path = path;
+}
+
+CK_RV soft::Data::Destroy()
+{
+    try {
+        if (path.empty()) {
+            return CKR_OK;
+        }
+        if (unlink(path.c_str())) {
+            THROW_SOFT_EXCEPTION(errno, "unlink");
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
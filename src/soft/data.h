@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "../core/objects/data.h"
+
+namespace soft {
+
+    class Data : public core::Data {
+    public:
+        Data();
+
+        /**
+         * Links data object to the file of the token store
+         */
+        void SetPath(const std::string& path);
+
+        CK_RV Destroy();
+
+    protected:
+        std::string path;
+    };
+
+}
@@ -0,0 +1,413 @@
+#include "ec.h"
+#include "ec_montgomery.h"
+#include "helper.h"
+#include "random.h"
+#include "secret_key.h"
+#include "../core/crypto/sha.h"
+
+using namespace soft;
+
+#define EC_UNCOMPRESSED_POINT   0x04
+#define ASN1_OCTET_STRING       0x04
+
+/**
+ * Reads x || y of an uncompressed point. CKA_EC_POINT is DER OCTET STRING of the point, the
+ * public data of CKM_ECDH1_DERIVE is usually the point itself, both forms are accepted.
+ * Returns false if the data is not a point of the curve size
+ */
+static bool DecodePoint(const core::EcCurve* curve, CK_BYTE_PTR pData, CK_ULONG ulDataLen, Buffer* point)
+{
+    CK_ULONG ulPointLen = (CK_ULONG)(2 * curve->GetFieldBytes() + 1);
+    ASN1_ITEM item;
+    if (ulDataLen != ulPointLen &&
+        Asn1Read(pData, ulDataLen, &item) &&
+        item.tag == ASN1_OCTET_STRING &&
+        item.ulItemLen == ulDataLen) {
+        pData = item.pValue;
+        ulDataLen = item.ulValueLen;
+    }
+    if (ulDataLen != ulPointLen || pData[0] != EC_UNCOMPRESSED_POINT) {
+        return false;
+    }
+    point->assign(pData + 1, pData + ulDataLen);
+    return true;
+}
+
+/**
+ * DER OCTET STRING of the uncompressed point for CKA_EC_POINT
+ */
+static Buffer EncodePoint(const Buffer& point)
+{
+    size_t len = point.size() + 1;
+    Buffer res;
+    res.push_back(ASN1_OCTET_STRING);
+    if (len > 0x7F) {
+        res.push_back(0x81);
+    }
+    res.push_back((CK_BYTE)len);
+    res.push_back(EC_UNCOMPRESSED_POINT);
+    res.insert(res.end(), point.begin(), point.end());
+    return res;
+}
+
+static const core::EcCurve* GetObjectCurve(core::Object* object)
+{
+    Scoped<Buffer> params = object->ItemByType(CKA_EC_PARAMS)->ToBytes();
+    return core::EcCurve::FromParams(params->data(), params->size());
+}
+
+/**
+ * ANSI X9.63 KDF, hashes of secret || counter || shared data for counters from 1
+ */
+static void EcKdf(CK_MECHANISM_TYPE digestMechanism, CK_BYTE_PTR pbSecret, size_t secretLen, CK_BYTE_PTR pSharedData, CK_ULONG ulSharedDataLen, CK_BYTE_PTR pbKey, size_t keyLen)
+{
+    size_t hLen = core::Sha::GetDigestLength(digestMechanism);
+    CK_BYTE hash[64];
+    core::Sha sha;
+    for (uint32_t counter = 1; keyLen; counter++) {
+        CK_BYTE c[4] = {
+            (CK_BYTE)(counter >> 24), (CK_BYTE)(counter >> 16), (CK_BYTE)(counter >> 8), (CK_BYTE)counter
+        };
+        sha.Init(digestMechanism);
+        sha.Update(pbSecret, (CK_ULONG)secretLen);
+        sha.Update(c, sizeof(c));
+        if (ulSharedDataLen) {
+            sha.Update(pSharedData, ulSharedDataLen);
+        }
+        sha.Final(hash);
+
+        size_t part = keyLen < hLen ? keyLen : hLen;
+        memcpy(pbKey, hash, part);
+        pbKey += part;
+        keyLen -= part;
+    }
+    memset(hash, 0, sizeof(hash));
+}
+
+const core::EcCurve* soft::EcKey::GetCurve(
+    Scoped<core::Template>      publicTemplate,
+    std::string*                name
+)
+{
+    try {
+        Scoped<Buffer> params = publicTemplate->GetBytes(CKA_EC_PARAMS, true);
+        const core::EcCurve* curve = core::EcCurve::FromParams(params->data(), params->size());
+
+        *name = "ec:";
+        for (size_t i = 0; i < params->size(); i++) {
+            char hex[3];
+            sprintf(hex, "%02x", params->at(i));
+            *name += hex;
+        }
+        return curve;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::KeyPair> soft::EcKey::Generate(
+    CK_MECHANISM_PTR            pMechanism,
+    Scoped<core::Template>      publicTemplate,
+    Scoped<core::Template>      privateTemplate,
+    Scoped<core::KeyPairPool>   pool
+)
+{
+    try {
+        if (pMechanism->mechanism != CKM_EC_KEY_PAIR_GEN) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        Scoped<EcPrivateKey> privateKey(new EcPrivateKey());
+        privateKey->GenerateValues(privateTemplate->Get(), privateTemplate->Size());
+
+        Scoped<EcPublicKey> publicKey(new EcPublicKey());
+        publicKey->GenerateValues(publicTemplate->Get(), publicTemplate->Size());
+
+        std::string name;
+        const core::EcCurve* curve = GetCurve(publicTemplate, &name);
+
+        Scoped<core::Ec> ec;
+        if (pool) {
+            ec = std::static_pointer_cast<core::Ec>(pool->Take(name));
+        }
+        if (!ec) {
+            ec = core::Ec::Generate(curve, soft::GenerateRandom);
+        }
+
+        privateKey->Assign(ec);
+        privateKey->ItemByType(CKA_LOCAL)->To<core::AttributeBool>()->Set(true);
+        publicKey->Assign(ec);
+        publicKey->ItemByType(CKA_LOCAL)->To<core::AttributeBool>()->Set(true);
+
+        return Scoped<core::KeyPair>(new core::KeyPair(privateKey, publicKey));
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::EcKey::SetPool(
+    Scoped<core::Template>      publicTemplate,
+    CK_ULONG                    ulPoolSize,
+    Scoped<core::KeyPairPool>   pool
+)
+{
+    try {
+        std::string name;
+        const core::EcCurve* curve = GetCurve(publicTemplate, &name);
+
+        pool->Configure(name, ulPoolSize, [curve]() {
+            return Scoped<void>(core::Ec::Generate(curve, soft::GenerateRandom));
+        });
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::Object> soft::EcKey::DeriveKey(
+    CK_MECHANISM_PTR            pMechanism,
+    Scoped<core::Object>        baseKey,
+    Scoped<core::Template>      tmpl
+)
+{
+    try {
+        EcPrivateKey* ecKey = dynamic_cast<EcPrivateKey*>(baseKey.get());
+        MontPrivateKey* montKey = dynamic_cast<MontPrivateKey*>(baseKey.get());
+        if (!ecKey && !montKey) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_TYPE_INCONSISTENT, "baseKey is not EC private key");
+        }
+        if (!baseKey->ItemByType(CKA_DERIVE)->ToBool()) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_FUNCTION_NOT_PERMITTED, "Key doesn't support the operation");
+        }
+
+        if (pMechanism->mechanism != CKM_ECDH1_DERIVE) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+        if (pMechanism->pParameter == NULL_PTR || pMechanism->ulParameterLen != sizeof(CK_ECDH1_DERIVE_PARAMS)) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pMechanism->pParameter is not CK_ECDH1_DERIVE_PARAMS");
+        }
+        CK_ECDH1_DERIVE_PARAMS_PTR params = static_cast<CK_ECDH1_DERIVE_PARAMS_PTR>(pMechanism->pParameter);
+
+        CK_MECHANISM_TYPE kdfDigest;
+        switch (params->kdf) {
+        case CKD_NULL:
+            kdfDigest = 0;
+            if (params->ulSharedDataLen) {
+                THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "CKD_NULL doesn't allow shared data");
+            }
+            break;
+        case CKD_SHA1_KDF:
+            kdfDigest = CKM_SHA_1;
+            break;
+        case CKD_SHA256_KDF:
+            kdfDigest = CKM_SHA256;
+            break;
+        case CKD_SHA384_KDF:
+            kdfDigest = CKM_SHA384;
+            break;
+        case CKD_SHA512_KDF:
+            kdfDigest = CKM_SHA512;
+            break;
+        default:
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "Unsupported kdf");
+        }
+        if (params->ulSharedDataLen && params->pSharedData == NULL_PTR) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pSharedData is NULL");
+        }
+
+        // Public data of the peer, the secret has the field size
+        Scoped<core::Ec> ec;
+        Buffer point;
+        CK_BYTE_PTR pbPeerKey = NULL_PTR;
+        size_t secretLen;
+        if (ecKey) {
+            ec = ecKey->GetEc();
+            if (params->pPublicData == NULL_PTR ||
+                !DecodePoint(ec->GetCurve(), params->pPublicData, params->ulPublicDataLen, &point)) {
+                THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pPublicData is not EC point of the curve");
+            }
+            secretLen = ec->GetCurve()->GetFieldBytes();
+        }
+        else {
+            if (params->pPublicData) {
+                pbPeerKey = MontKey::DecodePoint(params->pPublicData, params->ulPublicDataLen);
+            }
+            if (!pbPeerKey) {
+                THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pPublicData is not X25519 public key");
+            }
+            secretLen = X25519_KEY_BYTES;
+        }
+
+        // Derived key
+        if (tmpl->GetNumber(CKA_CLASS, false, CKO_SECRET_KEY) != CKO_SECRET_KEY) {
+            THROW_PKCS11_TEMPLATE_INCONSISTENT();
+        }
+        CK_ULONG keyType = tmpl->GetNumber(CKA_KEY_TYPE, false, CKK_GENERIC_SECRET);
+        Scoped<core::SecretKey> derivedKey;
+        switch (keyType) {
+        case CKK_GENERIC_SECRET:
+            derivedKey = Scoped<GenericSecretKey>(new GenericSecretKey());
+            break;
+        case CKK_AES:
+            derivedKey = Scoped<AesKey>(new AesKey());
+            break;
+        default:
+            THROW_PKCS11_TEMPLATE_INCONSISTENT();
+        }
+
+        CK_ULONG ulValueLen = tmpl->GetNumber(CKA_VALUE_LEN, keyType != CKK_GENERIC_SECRET, (CK_ULONG)secretLen);
+        if (!ulValueLen ||
+            (!kdfDigest && ulValueLen > secretLen) ||
+            ulValueLen > GENERIC_SECRET_MAX_LENGTH ||
+            (keyType == CKK_AES && ulValueLen != 16 && ulValueLen != 24 && ulValueLen != 32)) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Wrong CKA_VALUE_LEN for ECDH");
+        }
+
+        std::vector<CK_ATTRIBUTE> attributes(tmpl->Get(), tmpl->Get() + tmpl->Size());
+        if (!tmpl->HasAttribute(CKA_VALUE_LEN)) {
+            CK_ATTRIBUTE valueLen = { CKA_VALUE_LEN, &ulValueLen, sizeof(ulValueLen) };
+            attributes.push_back(valueLen);
+        }
+        derivedKey->GenerateValues(attributes.data(), (CK_ULONG)attributes.size());
+
+        // The secret stays on the stack, the value is written to the attribute from it
+        CK_BYTE secret[EC_MAX_FIELD_BYTES];
+        if (ec) {
+            ec->Derive(point.data(), secret);
+        }
+        else if (!montKey->GetKey()->Derive(pbPeerKey, secret)) {
+            THROW_PKCS11_EXCEPTION(CKR_MECHANISM_PARAM_INVALID, "pPublicData is a point of small order");
+        }
+
+        core::AttributeBytes* value = derivedKey->ItemByType(CKA_VALUE)->To<core::AttributeBytes>();
+        if (kdfDigest) {
+            Buffer key(ulValueLen);
+            EcKdf(kdfDigest, secret, secretLen, params->pSharedData, params->ulSharedDataLen, key.data(), ulValueLen);
+            value->Set(key.data(), key.size());
+            memset(key.data(), 0, key.size());
+        }
+        else {
+            value->Set(secret + secretLen - ulValueLen, ulValueLen);
+        }
+        memset(secret, 0, sizeof(secret));
+
+        return derivedKey;
+    }
+    CATCH_EXCEPTION
+}
+
+// Private key
+
+soft::EcPrivateKey::EcPrivateKey()
+    : core::EcPrivateKey()
+{
+}
+
+void soft::EcPrivateKey::Assign(Scoped<core::Ec> ec)
+{
+    try {
+        {
+            std::lock_guard<std::mutex> lock(ecMutex);
+            this->ec = ec;
+        }
+
+        const Buffer& params = ec->GetCurve()->GetParams();
+        const Buffer& value = ec->GetPrivateValue();
+        ItemByType(CKA_EC_PARAMS)->To<core::AttributeBytes>()->Set((CK_BYTE_PTR)params.data(), params.size());
+        ItemByType(CKA_VALUE)->To<core::AttributeBytes>()->Set((CK_BYTE_PTR)value.data(), value.size());
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::EcPrivateKey::CreateValues(
+    CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+    CK_ULONG          ulCount     /* attributes in template */
+)
+{
+    try {
+        core::EcPrivateKey::CreateValues(pTemplate, ulCount);
+
+        GetObjectCurve(this);
+        if (ItemByType(CKA_VALUE)->ToBytes()->empty()) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "CKA_VALUE is empty");
+        }
+        // Checks the private value
+        GetEc();
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::Ec> soft::EcPrivateKey::GetEc()
+{
+    try {
+        std::lock_guard<std::mutex> lock(ecMutex);
+
+        if (!ec) {
+            Scoped<Buffer> value = ItemByType(CKA_VALUE)->ToBytes();
+            ec = Scoped<core::Ec>(new core::Ec(GetObjectCurve(this), *value, Buffer()));
+            memset(value->data(), 0, value->size());
+        }
+
+        return ec;
+    }
+    CATCH_EXCEPTION
+}
+
+// Public key
+
+soft::EcPublicKey::EcPublicKey()
+    : core::EcPublicKey()
+{
+}
+
+void soft::EcPublicKey::Assign(Scoped<core::Ec> ec)
+{
+    try {
+        {
+            std::lock_guard<std::mutex> lock(ecMutex);
+            this->ec = Scoped<core::Ec>(new core::Ec(ec->GetCurve(), ec->GetPoint()));
+        }
+
+        const Buffer& params = ec->GetCurve()->GetParams();
+        Buffer point = EncodePoint(ec->GetPoint());
+        ItemByType(CKA_EC_PARAMS)->To<core::AttributeBytes>()->Set((CK_BYTE_PTR)params.data(), params.size());
+        ItemByType(CKA_EC_POINT)->To<core::AttributeBytes>()->Set(point.data(), point.size());
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::EcPublicKey::CreateValues(
+    CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+    CK_ULONG          ulCount     /* attributes in template */
+)
+{
+    try {
+        core::EcPublicKey::CreateValues(pTemplate, ulCount);
+
+        // Checks the point, it's stored as DER OCTET STRING
+        Scoped<core::Ec> ec = GetEc();
+        Buffer point = EncodePoint(ec->GetPoint());
+        ItemByType(CKA_EC_POINT)->To<core::AttributeBytes>()->Set(point.data(), point.size());
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::Ec> soft::EcPublicKey::GetEc()
+{
+    try {
+        std::lock_guard<std::mutex> lock(ecMutex);
+
+        if (!ec) {
+            const core::EcCurve* curve = GetObjectCurve(this);
+            Scoped<Buffer> data = ItemByType(CKA_EC_POINT)->ToBytes();
+            Buffer point;
+            if (!DecodePoint(curve, data->data(), (CK_ULONG)data->size(), &point)) {
+                THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "CKA_EC_POINT is not EC point of the curve");
+            }
+            ec = Scoped<core::Ec>(new core::Ec(curve, point));
+        }
+
+        return ec;
+    }
+    CATCH_EXCEPTION
+}
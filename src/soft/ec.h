@@ -0,0 +1,98 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "../core/keypair.h"
+#include "../core/keypair_pool.h"
+#include "../core/objects/ec_key.h"
+#include "../core/crypto/ec.h"
+
+namespace soft {
+
+    class EcKey {
+    public:
+        /**
+         * CKM_EC_KEY_PAIR_GEN for the curve of CKA_EC_PARAMS. A key of the pool is used if
+         * the pool has the public key template configured. Pool can be empty
+         */
+        static Scoped<core::KeyPair> Generate(
+            CK_MECHANISM_PTR            pMechanism,
+            Scoped<core::Template>      publicTemplate,
+            Scoped<core::Template>      privateTemplate,
+            Scoped<core::KeyPairPool>   pool
+        );
+
+        /**
+         * Configures pool of CKM_EC_KEY_PAIR_GEN keys for the public key template
+         */
+        static void SetPool(
+            Scoped<core::Template>      publicTemplate,
+            CK_ULONG                    ulPoolSize,
+            Scoped<core::KeyPairPool>   pool
+        );
+
+        /**
+         * CKM_ECDH1_DERIVE with CKD_NULL or the ANSI X9.63 KDF of CKD_SHA1_KDF,
+         * CKD_SHA256_KDF, CKD_SHA384_KDF and CKD_SHA512_KDF. The base key is EC or X25519
+         * CKK_EC_MONTGOMERY key. The key is CKK_GENERIC_SECRET of field bytes unless the
+         * template sets CKA_KEY_TYPE and CKA_VALUE_LEN, a shorter key keeps the trailing bytes
+         * of the secret
+         */
+        static Scoped<core::Object> DeriveKey(
+            CK_MECHANISM_PTR            pMechanism,
+            Scoped<core::Object>        baseKey,
+            Scoped<core::Template>      tmpl
+        );
+
+    protected:
+        /**
+         * Returns curve of CKA_EC_PARAMS of the template and name of the pool configuration
+         */
+        static const core::EcCurve* GetCurve(
+            Scoped<core::Template>      publicTemplate,
+            std::string*                name
+        );
+    };
+
+    class EcPrivateKey : public core::EcPrivateKey {
+    public:
+        EcPrivateKey();
+
+        void Assign(Scoped<core::Ec> ec);
+
+        CK_RV CreateValues(
+            CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+            CK_ULONG          ulCount     /* attributes in template */
+        );
+
+        /**
+         * Returns EC key of the attributes. It is built on the first use and cached
+         */
+        Scoped<core::Ec> GetEc();
+
+    protected:
+        Scoped<core::Ec>    ec;
+        std::mutex          ecMutex;
+    };
+
+    class EcPublicKey : public core::EcPublicKey {
+    public:
+        EcPublicKey();
+
+        void Assign(Scoped<core::Ec> ec);
+
+        CK_RV CreateValues(
+            CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+            CK_ULONG          ulCount     /* attributes in template */
+        );
+
+        /**
+         * Returns EC key of the attributes. It is built on the first use and cached
+         */
+        Scoped<core::Ec> GetEc();
+
+    protected:
+        Scoped<core::Ec>    ec;
+        std::mutex          ecMutex;
+    };
+
+}
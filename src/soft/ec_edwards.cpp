@@ -0,0 +1,200 @@
+#include "ec_edwards.h"
+#include "helper.h"
+#include "random.h"
+
+using namespace soft;
+
+#define ASN1_OCTET_STRING       0x04
+
+// OID 1.3.101.112 and the printable string of PKCS#11 3.0
+static const CK_BYTE ED25519_OID[] = { 0x06, 0x03, 0x2b, 0x65, 0x70 };
+static const CK_BYTE ED25519_NAME[] = {
+    0x13, 0x0c, 'e', 'd', 'w', 'a', 'r', 'd', 's', '2', '5', '5', '1', '9'
+};
+
+/**
+ * DER OCTET STRING of the encoded point for CKA_EC_POINT
+ */
+static Buffer EncodePoint(const CK_BYTE* pbPoint)
+{
+    Buffer res;
+    res.push_back(ASN1_OCTET_STRING);
+    res.push_back(ED25519_KEY_BYTES);
+    res.insert(res.end(), pbPoint, pbPoint + ED25519_KEY_BYTES);
+    return res;
+}
+
+void soft::EdKey::CheckParams(
+    const Buffer&               params
+)
+{
+    if ((params.size() == sizeof(ED25519_OID) && !memcmp(params.data(), ED25519_OID, params.size())) ||
+        (params.size() == sizeof(ED25519_NAME) && !memcmp(params.data(), ED25519_NAME, params.size()))) {
+        return;
+    }
+    THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Unsupported Edwards curve");
+}
+
+Scoped<core::KeyPair> soft::EdKey::Generate(
+    CK_MECHANISM_PTR            pMechanism,
+    Scoped<core::Template>      publicTemplate,
+    Scoped<core::Template>      privateTemplate
+)
+{
+    try {
+        if (pMechanism->mechanism != CKM_EC_EDWARDS_KEY_PAIR_GEN) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        Scoped<EdPrivateKey> privateKey(new EdPrivateKey());
+        privateKey->GenerateValues(privateTemplate->Get(), privateTemplate->Size());
+
+        Scoped<EdPublicKey> publicKey(new EdPublicKey());
+        publicKey->GenerateValues(publicTemplate->Get(), publicTemplate->Size());
+
+        Scoped<Buffer> params = publicTemplate->GetBytes(CKA_EC_PARAMS, true);
+        CheckParams(*params);
+
+        Scoped<core::Ed25519> key = core::Ed25519::Generate(soft::GenerateRandom);
+
+        privateKey->ItemByType(CKA_EC_PARAMS)->To<core::AttributeBytes>()->Set(params->data(), params->size());
+        privateKey->Assign(key);
+        privateKey->ItemByType(CKA_LOCAL)->To<core::AttributeBool>()->Set(true);
+        publicKey->ItemByType(CKA_EC_PARAMS)->To<core::AttributeBytes>()->Set(params->data(), params->size());
+        publicKey->Assign(key);
+        publicKey->ItemByType(CKA_LOCAL)->To<core::AttributeBool>()->Set(true);
+
+        return Scoped<core::KeyPair>(new core::KeyPair(privateKey, publicKey));
+    }
+    CATCH_EXCEPTION
+}
+
+// Private key
+
+soft::EdPrivateKey::EdPrivateKey()
+    : core::EcPrivateKey()
+{
+    try {
+        ItemByType(CKA_KEY_TYPE)->To<core::AttributeNumber>()->Set(CKK_EC_EDWARDS);
+        ItemByType(CKA_KEY_GEN_MECHANISM)->To<core::AttributeNumber>()->Set(CKM_EC_EDWARDS_KEY_PAIR_GEN);
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::EdPrivateKey::Assign(Scoped<core::Ed25519> key)
+{
+    try {
+        {
+            std::lock_guard<std::mutex> lock(keyMutex);
+            this->key = key;
+        }
+
+        ItemByType(CKA_VALUE)->To<core::AttributeBytes>()->Set((CK_BYTE_PTR)key->GetSeed(), ED25519_KEY_BYTES);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::EdPrivateKey::CreateValues(
+    CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+    CK_ULONG          ulCount     /* attributes in template */
+)
+{
+    try {
+        core::EcPrivateKey::CreateValues(pTemplate, ulCount);
+
+        EdKey::CheckParams(*ItemByType(CKA_EC_PARAMS)->ToBytes());
+        if (ItemByType(CKA_VALUE)->ToBytes()->size() != ED25519_KEY_BYTES) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "CKA_VALUE is not Ed25519 seed");
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::Ed25519> soft::EdPrivateKey::GetKey()
+{
+    try {
+        std::lock_guard<std::mutex> lock(keyMutex);
+
+        if (!key) {
+            Scoped<Buffer> value = ItemByType(CKA_VALUE)->ToBytes();
+            key = core::Ed25519::FromSeed(value->data());
+            memset(value->data(), 0, value->size());
+        }
+
+        return key;
+    }
+    CATCH_EXCEPTION
+}
+
+// Public key
+
+soft::EdPublicKey::EdPublicKey()
+    : core::EcPublicKey()
+{
+    ItemByType(CKA_KEY_TYPE)->To<core::AttributeNumber>()->Set(CKK_EC_EDWARDS);
+    ItemByType(CKA_KEY_GEN_MECHANISM)->To<core::AttributeNumber>()->Set(CKM_EC_EDWARDS_KEY_PAIR_GEN);
+}
+
+void soft::EdPublicKey::Assign(Scoped<core::Ed25519> key)
+{
+    try {
+        {
+            std::lock_guard<std::mutex> lock(keyMutex);
+            this->key = core::Ed25519::FromPublicKey(key->GetPublicKey());
+        }
+
+        Buffer point = EncodePoint(key->GetPublicKey());
+        ItemByType(CKA_EC_POINT)->To<core::AttributeBytes>()->Set(point.data(), point.size());
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::EdPublicKey::CreateValues(
+    CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+    CK_ULONG          ulCount     /* attributes in template */
+)
+{
+    try {
+        core::EcPublicKey::CreateValues(pTemplate, ulCount);
+
+        EdKey::CheckParams(*ItemByType(CKA_EC_PARAMS)->ToBytes());
+        // Checks the point, it's stored as DER OCTET STRING
+        Scoped<core::Ed25519> key = GetKey();
+        Buffer point = EncodePoint(key->GetPublicKey());
+        ItemByType(CKA_EC_POINT)->To<core::AttributeBytes>()->Set(point.data(), point.size());
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::Ed25519> soft::EdPublicKey::GetKey()
+{
+    try {
+        std::lock_guard<std::mutex> lock(keyMutex);
+
+        if (!key) {
+            // The encoded point or DER OCTET STRING of it
+            Scoped<Buffer> data = ItemByType(CKA_EC_POINT)->ToBytes();
+            CK_BYTE_PTR pbPoint = data->data();
+            CK_ULONG ulPointLen = (CK_ULONG)data->size();
+            ASN1_ITEM item;
+            if (ulPointLen != ED25519_KEY_BYTES &&
+                Asn1Read(pbPoint, ulPointLen, &item) &&
+                item.tag == ASN1_OCTET_STRING &&
+                item.ulItemLen == ulPointLen) {
+                pbPoint = item.pValue;
+                ulPointLen = item.ulValueLen;
+            }
+            if (ulPointLen != ED25519_KEY_BYTES) {
+                THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "CKA_EC_POINT is not Ed25519 point");
+            }
+            key = core::Ed25519::FromPublicKey(pbPoint);
+        }
+
+        return key;
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "../core/keypair.h"
+#include "../core/objects/ec_key.h"
+#include "../core/crypto/curve25519.h"
+
+namespace soft {
+
+    class EdKey {
+    public:
+        /**
+         * CKM_EC_EDWARDS_KEY_PAIR_GEN of Ed25519. CKA_EC_PARAMS of the public key template
+         * is the OID 1.3.101.112 or the printable string "edwards25519"
+         */
+        static Scoped<core::KeyPair> Generate(
+            CK_MECHANISM_PTR            pMechanism,
+            Scoped<core::Template>      publicTemplate,
+            Scoped<core::Template>      privateTemplate
+        );
+
+        /**
+         * Throws CKR_ATTRIBUTE_VALUE_INVALID if CKA_EC_PARAMS is not of Ed25519
+         */
+        static void CheckParams(
+            const Buffer&               params
+        );
+    };
+
+    /**
+     * CKK_EC_EDWARDS private key, CKA_VALUE is the 32-byte seed
+     */
+    class EdPrivateKey : public core::EcPrivateKey {
+    public:
+        EdPrivateKey();
+
+        void Assign(Scoped<core::Ed25519> key);
+
+        CK_RV CreateValues(
+            CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+            CK_ULONG          ulCount     /* attributes in template */
+        );
+
+        /**
+         * Returns the key of the seed. It is built on the first use and cached
+         */
+        Scoped<core::Ed25519> GetKey();
+
+    protected:
+        Scoped<core::Ed25519>   key;
+        std::mutex              keyMutex;
+    };
+
+    /**
+     * CKK_EC_EDWARDS public key, CKA_EC_POINT is DER OCTET STRING of the 32-byte encoded point
+     */
+    class EdPublicKey : public core::EcPublicKey {
+    public:
+        EdPublicKey();
+
+        void Assign(Scoped<core::Ed25519> key);
+
+        CK_RV CreateValues(
+            CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+            CK_ULONG          ulCount     /* attributes in template */
+        );
+
+        /**
+         * Returns the key of the point. It is built on the first use and cached
+         */
+        Scoped<core::Ed25519> GetKey();
+
+    protected:
+        Scoped<core::Ed25519>   key;
+        std::mutex              keyMutex;
+    };
+
+}
@@ -0,0 +1,186 @@
+#include "ec_montgomery.h"
+#include "helper.h"
+#include "random.h"
+
+using namespace soft;
+
+#define ASN1_OCTET_STRING       0x04
+
+// OID 1.3.101.110 and the printable string of PKCS#11 3.0
+static const CK_BYTE X25519_OID[] = { 0x06, 0x03, 0x2b, 0x65, 0x6e };
+static const CK_BYTE X25519_NAME[] = {
+    0x13, 0x0a, 'c', 'u', 'r', 'v', 'e', '2', '5', '5', '1', '9'
+};
+
+/**
+ * DER OCTET STRING of the u-coordinate for CKA_EC_POINT
+ */
+static Buffer EncodePoint(const CK_BYTE* pbPoint)
+{
+    Buffer res;
+    res.push_back(ASN1_OCTET_STRING);
+    res.push_back(X25519_KEY_BYTES);
+    res.insert(res.end(), pbPoint, pbPoint + X25519_KEY_BYTES);
+    return res;
+}
+
+void soft::MontKey::CheckParams(
+    const Buffer&               params
+)
+{
+    if ((params.size() == sizeof(X25519_OID) && !memcmp(params.data(), X25519_OID, params.size())) ||
+        (params.size() == sizeof(X25519_NAME) && !memcmp(params.data(), X25519_NAME, params.size()))) {
+        return;
+    }
+    THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Unsupported Montgomery curve");
+}
+
+CK_BYTE_PTR soft::MontKey::DecodePoint(
+    CK_BYTE_PTR                 pData,
+    CK_ULONG                    ulDataLen
+)
+{
+    ASN1_ITEM item;
+    if (ulDataLen != X25519_KEY_BYTES &&
+        Asn1Read(pData, ulDataLen, &item) &&
+        item.tag == ASN1_OCTET_STRING &&
+        item.ulItemLen == ulDataLen) {
+        pData = item.pValue;
+        ulDataLen = item.ulValueLen;
+    }
+    return ulDataLen == X25519_KEY_BYTES ? pData : NULL_PTR;
+}
+
+Scoped<core::KeyPair> soft::MontKey::Generate(
+    CK_MECHANISM_PTR            pMechanism,
+    Scoped<core::Template>      publicTemplate,
+    Scoped<core::Template>      privateTemplate
+)
+{
+    try {
+        if (pMechanism->mechanism != CKM_EC_MONTGOMERY_KEY_PAIR_GEN) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        Scoped<MontPrivateKey> privateKey(new MontPrivateKey());
+        privateKey->GenerateValues(privateTemplate->Get(), privateTemplate->Size());
+
+        Scoped<MontPublicKey> publicKey(new MontPublicKey());
+        publicKey->GenerateValues(publicTemplate->Get(), publicTemplate->Size());
+
+        Scoped<Buffer> params = publicTemplate->GetBytes(CKA_EC_PARAMS, true);
+        CheckParams(*params);
+
+        Scoped<core::X25519> key = core::X25519::Generate(soft::GenerateRandom);
+
+        privateKey->ItemByType(CKA_EC_PARAMS)->To<core::AttributeBytes>()->Set(params->data(), params->size());
+        privateKey->Assign(key);
+        privateKey->ItemByType(CKA_LOCAL)->To<core::AttributeBool>()->Set(true);
+        publicKey->ItemByType(CKA_EC_PARAMS)->To<core::AttributeBytes>()->Set(params->data(), params->size());
+        publicKey->Assign(key);
+        publicKey->ItemByType(CKA_LOCAL)->To<core::AttributeBool>()->Set(true);
+
+        return Scoped<core::KeyPair>(new core::KeyPair(privateKey, publicKey));
+    }
+    CATCH_EXCEPTION
+}
+
+// Private key
+
+soft::MontPrivateKey::MontPrivateKey()
+    : core::EcPrivateKey()
+{
+    try {
+        ItemByType(CKA_KEY_TYPE)->To<core::AttributeNumber>()->Set(CKK_EC_MONTGOMERY);
+        ItemByType(CKA_KEY_GEN_MECHANISM)->To<core::AttributeNumber>()->Set(CKM_EC_MONTGOMERY_KEY_PAIR_GEN);
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::MontPrivateKey::Assign(Scoped<core::X25519> key)
+{
+    try {
+        {
+            std::lock_guard<std::mutex> lock(keyMutex);
+            this->key = key;
+        }
+
+        ItemByType(CKA_VALUE)->To<core::AttributeBytes>()->Set((CK_BYTE_PTR)key->GetPrivateKey(), X25519_KEY_BYTES);
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::MontPrivateKey::CreateValues(
+    CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+    CK_ULONG          ulCount     /* attributes in template */
+)
+{
+    try {
+        core::EcPrivateKey::CreateValues(pTemplate, ulCount);
+
+        MontKey::CheckParams(*ItemByType(CKA_EC_PARAMS)->ToBytes());
+        if (ItemByType(CKA_VALUE)->ToBytes()->size() != X25519_KEY_BYTES) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "CKA_VALUE is not X25519 private key");
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::X25519> soft::MontPrivateKey::GetKey()
+{
+    try {
+        std::lock_guard<std::mutex> lock(keyMutex);
+
+        if (!key) {
+            Scoped<Buffer> value = ItemByType(CKA_VALUE)->ToBytes();
+            key = core::X25519::FromPrivateKey(value->data());
+            memset(value->data(), 0, value->size());
+        }
+
+        return key;
+    }
+    CATCH_EXCEPTION
+}
+
+// Public key
+
+soft::MontPublicKey::MontPublicKey()
+    : core::EcPublicKey()
+{
+    ItemByType(CKA_KEY_TYPE)->To<core::AttributeNumber>()->Set(CKK_EC_MONTGOMERY);
+    ItemByType(CKA_KEY_GEN_MECHANISM)->To<core::AttributeNumber>()->Set(CKM_EC_MONTGOMERY_KEY_PAIR_GEN);
+}
+
+void soft::MontPublicKey::Assign(Scoped<core::X25519> key)
+{
+    try {
+        Buffer point = EncodePoint(key->GetPublicKey());
+        ItemByType(CKA_EC_POINT)->To<core::AttributeBytes>()->Set(point.data(), point.size());
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::MontPublicKey::CreateValues(
+    CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+    CK_ULONG          ulCount     /* attributes in template */
+)
+{
+    try {
+        core::EcPublicKey::CreateValues(pTemplate, ulCount);
+
+        MontKey::CheckParams(*ItemByType(CKA_EC_PARAMS)->ToBytes());
+        // Any u-coordinate is a point of the curve or its twist, it's stored as DER OCTET STRING
+        Scoped<Buffer> data = ItemByType(CKA_EC_POINT)->ToBytes();
+        CK_BYTE_PTR pbPoint = MontKey::DecodePoint(data->data(), (CK_ULONG)data->size());
+        if (!pbPoint) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "CKA_EC_POINT is not X25519 public key");
+        }
+        Buffer point = EncodePoint(pbPoint);
+        ItemByType(CKA_EC_POINT)->To<core::AttributeBytes>()->Set(point.data(), point.size());
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "../core/keypair.h"
+#include "../core/objects/ec_key.h"
+#include "../core/crypto/curve25519.h"
+
+namespace soft {
+
+    class MontKey {
+    public:
+        /**
+         * CKM_EC_MONTGOMERY_KEY_PAIR_GEN of X25519. CKA_EC_PARAMS of the public key template
+         * is the OID 1.3.101.110 or the printable string "curve25519"
+         */
+        static Scoped<core::KeyPair> Generate(
+            CK_MECHANISM_PTR            pMechanism,
+            Scoped<core::Template>      publicTemplate,
+            Scoped<core::Template>      privateTemplate
+        );
+
+        /**
+         * Throws CKR_ATTRIBUTE_VALUE_INVALID if CKA_EC_PARAMS is not of X25519
+         */
+        static void CheckParams(
+            const Buffer&               params
+        );
+
+        /**
+         * Returns the 32-byte u-coordinate of CKA_EC_POINT or of the public data of
+         * CKM_ECDH1_DERIVE, it's the coordinate or DER OCTET STRING of it. Returns NULL if
+         * the data has another length
+         */
+        static CK_BYTE_PTR DecodePoint(
+            CK_BYTE_PTR                 pData,
+            CK_ULONG                    ulDataLen
+        );
+    };
+
+    /**
+     * CKK_EC_MONTGOMERY private key, CKA_VALUE is the 32-byte private value
+     */
+    class MontPrivateKey : public core::EcPrivateKey {
+    public:
+        MontPrivateKey();
+
+        void Assign(Scoped<core::X25519> key);
+
+        CK_RV CreateValues(
+            CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+            CK_ULONG          ulCount     /* attributes in template */
+        );
+
+        /**
+         * Returns the key of the private value. It is built on the first use and cached
+         */
+        Scoped<core::X25519> GetKey();
+
+    protected:
+        Scoped<core::X25519>    key;
+        std::mutex              keyMutex;
+    };
+
+    /**
+     * CKK_EC_MONTGOMERY public key, CKA_EC_POINT is DER OCTET STRING of the u-coordinate
+     */
+    class MontPublicKey : public core::EcPublicKey {
+    public:
+        MontPublicKey();
+
+        CK_RV CreateValues(
+            CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+            CK_ULONG          ulCount     /* attributes in template */
+        );
+
+        void Assign(Scoped<core::X25519> key);
+    };
+
+}
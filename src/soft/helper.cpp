@@ -0,0 +1,148 @@
+#include "helper.h"
+
+#include <errno.h>
+#include <sys/random.h>
+
+using namespace soft;
+
+std::string soft::GetErrnoAsString
+(
+    int code,
+    const char* funcName
+)
+{
+    char message[1024];
+    snprintf(message, sizeof(message), "Error on %s %d. %s", funcName, code, strerror(code));
+
+    return std::string(message);
+}
+
+void soft::GetEntropy(CK_BYTE_PTR pbData, CK_ULONG ulDataLen)
+{
+    try {
+        while (ulDataLen) {
+            ssize_t read = getrandom(pbData, ulDataLen, 0);
+            if (read < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                THROW_SOFT_EXCEPTION(errno, "getrandom");
+            }
+            pbData += read;
+            ulDataLen -= read;
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<Buffer> soft::ReadFile(const std::string& path)
+{
+    try {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            THROW_SOFT_EXCEPTION(errno, "fopen");
+        }
+
+        Scoped<Buffer> res(new Buffer(0));
+        CK_BYTE chunk[4096];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            res->insert(res->end(), chunk, chunk + read);
+        }
+        bool failed = ferror(file);
+        fclose(file);
+        if (failed) {
+            THROW_SOFT_EXCEPTION(EIO, "fread");
+        }
+
+        return res;
+    }
+    CATCH_EXCEPTION
+}
+
+static int Base64Value(CK_BYTE c)
+{
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 26;
+    }
+    if (c >= '0' && c <= '9') {
+        return c - '0' + 52;
+    }
+    if (c == '+') {
+        return 62;
+    }
+    if (c == '/') {
+        return 63;
+    }
+    return -1;
+}
+
+Scoped<Buffer> soft::PemToDer(Scoped<Buffer> data)
+{
+    try {
+        std::string pem(data->begin(), data->end());
+        size_t begin = pem.find("-----BEGIN ");
+        if (begin == std::string::npos) {
+            return data;
+        }
+        begin = pem.find('\n', begin);
+        size_t end = pem.find("-----END ", begin);
+        if (begin == std::string::npos || end == std::string::npos) {
+            THROW_EXCEPTION("Wrong PEM format");
+        }
+
+        Scoped<Buffer> res(new Buffer(0));
+        CK_ULONG bits = 0;
+        int count = 0;
+        for (size_t i = begin; i < end; i++) {
+            int value = Base64Value(pem[i]);
+            if (value < 0) {
+                // skip new lines and padding
+                continue;
+            }
+            bits = (bits << 6) | value;
+            count += 6;
+            if (count >= 8) {
+                count -= 8;
+                res->push_back((CK_BYTE)(bits >> count));
+            }
+        }
+
+        return res;
+    }
+    CATCH_EXCEPTION
+}
+
+bool soft::Asn1Read(CK_BYTE_PTR pData, CK_ULONG ulDataLen, ASN1_ITEM* pItem)
+{
+    if (pData == NULL_PTR || ulDataLen < 2) {
+        return false;
+    }
+
+    CK_ULONG offset = 0;
+    pItem->tag = pData[offset++];
+    CK_ULONG length = pData[offset++];
+    if (length & 0x80) {
+        CK_ULONG octets = length & 0x7F;
+        if (octets == 0 || octets > sizeof(CK_ULONG) || offset + octets > ulDataLen) {
+            return false;
+        }
+        length = 0;
+        while (octets--) {
+            length = (length << 8) | pData[offset++];
+        }
+    }
+    if (length > ulDataLen - offset) {
+        return false;
+    }
+
+    pItem->pItem = pData;
+    pItem->ulItemLen = offset + length;
+    pItem->pValue = pData + offset;
+    pItem->ulValueLen = length;
+
+    return true;
+}
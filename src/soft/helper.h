@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "../core/excep.h"
+
+namespace soft {
+
+    std::string GetErrnoAsString(int code, const char* funcName);
+
+#define SOFT_EXCEPTION_NAME "SoftException"
+
+#define THROW_SOFT_EXCEPTION(code, funcName)                                        \
+throw Scoped<core::Exception>(new core::Pkcs11Exception(SOFT_EXCEPTION_NAME, CKR_FUNCTION_FAILED, GetErrnoAsString(code, funcName).c_str(), __FUNCTION__, __FILE__, __LINE__))
+
+    /**
+     * Fills the buffer with random bytes of the OS. It's the entropy source of the
+     * DRBG, other callers use GenerateRandom of random.h
+     */
+    void GetEntropy(CK_BYTE_PTR pbData, CK_ULONG ulDataLen);
+
+    /**
+     * Reads content of the file
+     */
+    Scoped<Buffer> ReadFile(const std::string& path);
+
+    /**
+     * Converts PEM to DER. Returns incoming data if it's not PEM
+     */
+    Scoped<Buffer> PemToDer(Scoped<Buffer> data);
+
+    /**
+     * DER encoded ASN.1 item
+     */
+    typedef struct ASN1_ITEM {
+        CK_BYTE         tag;
+        CK_BYTE_PTR     pItem;          /* begin of TLV */
+        CK_ULONG        ulItemLen;      /* length of TLV */
+        CK_BYTE_PTR     pValue;         /* begin of V */
+        CK_ULONG        ulValueLen;     /* length of V */
+    } ASN1_ITEM;
+
+    /**
+     * Reads the first ASN.1 item from DER data. Returns false if data is malformed
+     */
+    bool Asn1Read(CK_BYTE_PTR pData, CK_ULONG ulDataLen, ASN1_ITEM* pItem);
+
+}
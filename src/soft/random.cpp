@@ -0,0 +1,137 @@
+#include "random.h"
+#include "helper.h"
+
+#include "../core/crypto/drbg.h"
+#include "../core/crypto/sha.h"
+
+#include <atomic>
+#include <mutex>
+#include <pthread.h>
+
+using namespace soft;
+
+// Output generated ahead for small requests, such as IVs and nonces. A DRBG request
+// costs two key schedules, the buffer spreads them over many calls
+#define RANDOM_CACHE_LENGTH             4096
+// Longer requests are generated directly into the caller's buffer
+#define RANDOM_MAX_CACHED_REQUEST       256
+
+struct RANDOM_STATE {
+    core::CtrDrbg   drbg;
+    bool            instantiated;
+    // Fork generation the DRBG was seeded in
+    unsigned        generation;
+    CK_BYTE         cache[RANDOM_CACHE_LENGTH];
+    // Unused bytes at the end of cache
+    size_t          cacheLen;
+
+    RANDOM_STATE() :
+        instantiated(false),
+        generation(0),
+        cacheLen(0)
+    {
+    }
+
+    ~RANDOM_STATE()
+    {
+        memset(cache, 0, sizeof(cache));
+    }
+};
+
+static thread_local RANDOM_STATE randomState;
+
+// Incremented in the child process, so each thread reseeds on its next call and
+// the child doesn't repeat output of the parent
+static std::atomic<unsigned> randomForkGeneration(0);
+static std::once_flag randomAtFork;
+
+static void RandomForkChild()
+{
+    randomForkGeneration.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void RandomClearCache(
+    RANDOM_STATE&   state
+)
+{
+    memset(state.cache, 0, sizeof(state.cache));
+    state.cacheLen = 0;
+}
+
+static void RandomReseed(
+    RANDOM_STATE&   state,
+    const CK_BYTE*  pbAdditional
+)
+{
+    std::call_once(randomAtFork, []() {
+        pthread_atfork(NULL, NULL, RandomForkChild);
+    });
+
+    unsigned generation = randomForkGeneration.load(std::memory_order_relaxed);
+    CK_BYTE entropy[CTR_DRBG_SEED_LENGTH];
+    GetEntropy(entropy, sizeof(entropy));
+    if (state.instantiated) {
+        state.drbg.Reseed(entropy, pbAdditional);
+    }
+    else {
+        state.drbg.Instantiate(entropy, pbAdditional);
+        state.instantiated = true;
+    }
+    memset(entropy, 0, sizeof(entropy));
+
+    state.generation = generation;
+    RandomClearCache(state);
+}
+
+static void RandomGenerate(
+    RANDOM_STATE&   state,
+    CK_BYTE*        pbOut,
+    size_t          len
+)
+{
+    if (state.drbg.NeedsReseed()) {
+        RandomReseed(state, NULL);
+    }
+    state.drbg.Generate(pbOut, len, NULL);
+}
+
+void soft::GenerateRandom(CK_BYTE_PTR pbData, CK_ULONG ulDataLen)
+{
+    try {
+        RANDOM_STATE& state = randomState;
+        if (!state.instantiated || state.generation != randomForkGeneration.load(std::memory_order_relaxed)) {
+            RandomReseed(state, NULL);
+        }
+
+        if (ulDataLen <= RANDOM_MAX_CACHED_REQUEST) {
+            if (state.cacheLen < ulDataLen) {
+                RandomGenerate(state, state.cache, RANDOM_CACHE_LENGTH);
+                state.cacheLen = RANDOM_CACHE_LENGTH;
+            }
+            // Returned bytes are wiped, so the state doesn't keep past output
+            CK_BYTE* pbCached = state.cache + RANDOM_CACHE_LENGTH - state.cacheLen;
+            memcpy(pbData, pbCached, ulDataLen);
+            memset(pbCached, 0, ulDataLen);
+            state.cacheLen -= ulDataLen;
+            return;
+        }
+
+        while (ulDataLen) {
+            size_t len = ulDataLen < CTR_DRBG_MAX_REQUEST_LENGTH ? ulDataLen : CTR_DRBG_MAX_REQUEST_LENGTH;
+            RandomGenerate(state, pbData, len);
+            pbData += len;
+            ulDataLen -= (CK_ULONG)len;
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::SeedRandom(CK_BYTE_PTR pbSeed, CK_ULONG ulSeedLen)
+{
+    try {
+        Scoped<Buffer> additional = core::Sha::Digest(CKM_SHA384, pbSeed, ulSeedLen);
+        RandomReseed(randomState, additional->data());
+        memset(additional->data(), 0, additional->size());
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "../core/excep.h"
+
+namespace soft {
+
+    /**
+     * Fills the buffer from CTR_DRBG of the calling thread. The DRBG is instantiated
+     * from getrandom on the first use, it is reseeded after CTR_DRBG_RESEED_INTERVAL
+     * requests and in the child process after fork. Threads don't share state, so
+     * the call takes no locks
+     */
+    void GenerateRandom(CK_BYTE_PTR pbData, CK_ULONG ulDataLen);
+
+    /**
+     * Reseeds DRBG of the calling thread with fresh entropy. SHA-384 of the seed is
+     * the additional input of the reseed
+     */
+    void SeedRandom(CK_BYTE_PTR pbSeed, CK_ULONG ulSeedLen);
+
+}
@@ -0,0 +1,230 @@
+#include "rsa.h"
+#include "random.h"
+
+using namespace soft;
+
+static core::BigNum GetBigNum(core::Object* object, CK_ATTRIBUTE_TYPE type)
+{
+    Scoped<Buffer> bytes = object->ItemByType(type)->ToBytes();
+    core::BigNum res = core::BigNum::FromBytes(bytes->data(), bytes->size());
+    memset(bytes->data(), 0, bytes->size());
+    return res;
+}
+
+static void SetBigNum(core::Object* object, CK_ATTRIBUTE_TYPE type, const core::BigNum& value)
+{
+    Scoped<Buffer> bytes = value.ToBytes();
+    object->ItemByType(type)->To<core::AttributeBytes>()->Set(bytes->data(), bytes->size());
+    memset(bytes->data(), 0, bytes->size());
+}
+
+std::string soft::RsaKey::GetParameters(
+    Scoped<core::Template>      publicTemplate,
+    size_t*                     modulusBits,
+    core::BigNum*               publicExponent
+)
+{
+    try {
+        *modulusBits = publicTemplate->GetNumber(CKA_MODULUS_BITS, true);
+        if (*modulusBits < RSA_MIN_MODULUS_BITS || *modulusBits > RSA_MAX_MODULUS_BITS) {
+            THROW_PKCS11_EXCEPTION(CKR_KEY_SIZE_RANGE, "Wrong RSA modulus length");
+        }
+
+        Scoped<Buffer> exponent = publicTemplate->GetBytes(CKA_PUBLIC_EXPONENT, false);
+        *publicExponent = exponent->empty()
+            ? core::BigNum(RSA_DEFAULT_PUBLIC_EXPONENT)
+            : core::BigNum::FromBytes(exponent->data(), exponent->size());
+        if (!publicExponent->IsOdd() || publicExponent->GetBitLength() > 32 || core::BigNum::Compare(*publicExponent, core::BigNum(3)) < 0) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Public exponent must be odd, at least 3 and less than 2^32");
+        }
+
+        char name[64];
+        sprintf(name, "rsa:%u:%llx", (unsigned)*modulusBits, (unsigned long long)publicExponent->GetWords()[0]);
+        return name;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::KeyPair> soft::RsaKey::Generate(
+    CK_MECHANISM_PTR            pMechanism,
+    Scoped<core::Template>      publicTemplate,
+    Scoped<core::Template>      privateTemplate,
+    Scoped<core::KeyPairPool>   pool
+)
+{
+    try {
+        if (pMechanism->mechanism != CKM_RSA_PKCS_KEY_PAIR_GEN) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        Scoped<RsaPrivateKey> privateKey(new RsaPrivateKey());
+        privateKey->GenerateValues(privateTemplate->Get(), privateTemplate->Size());
+
+        Scoped<RsaPublicKey> publicKey(new RsaPublicKey());
+        publicKey->GenerateValues(publicTemplate->Get(), publicTemplate->Size());
+
+        size_t modulusBits;
+        core::BigNum publicExponent;
+        std::string name = GetParameters(publicTemplate, &modulusBits, &publicExponent);
+
+        // Templates are checked before, so a wrong template doesn't take key of the pool
+        Scoped<core::Rsa> rsa;
+        if (pool) {
+            rsa = std::static_pointer_cast<core::Rsa>(pool->Take(name));
+        }
+        if (!rsa) {
+            rsa = core::Rsa::Generate(modulusBits, publicExponent, soft::GenerateRandom);
+        }
+
+        privateKey->Assign(rsa);
+        privateKey->ItemByType(CKA_LOCAL)->To<core::AttributeBool>()->Set(true);
+        publicKey->Assign(rsa);
+        publicKey->ItemByType(CKA_LOCAL)->To<core::AttributeBool>()->Set(true);
+
+        return Scoped<core::KeyPair>(new core::KeyPair(privateKey, publicKey));
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::RsaKey::SetPool(
+    Scoped<core::Template>      publicTemplate,
+    CK_ULONG                    ulPoolSize,
+    Scoped<core::KeyPairPool>   pool
+)
+{
+    try {
+        size_t modulusBits;
+        core::BigNum publicExponent;
+        std::string name = GetParameters(publicTemplate, &modulusBits, &publicExponent);
+
+        pool->Configure(name, ulPoolSize, [modulusBits, publicExponent]() {
+            return Scoped<void>(core::Rsa::Generate(modulusBits, publicExponent, soft::GenerateRandom));
+        });
+    }
+    CATCH_EXCEPTION
+}
+
+soft::RsaPrivateKey::RsaPrivateKey()
+    : core::RsaPrivateKey()
+{
+}
+
+void soft::RsaPrivateKey::Assign(Scoped<core::Rsa> rsa)
+{
+    try {
+        {
+            std::lock_guard<std::mutex> lock(rsaMutex);
+            this->rsa = rsa;
+        }
+
+        SetBigNum(this, CKA_MODULUS, rsa->GetModulus());
+        SetBigNum(this, CKA_PUBLIC_EXPONENT, rsa->GetPublicExponent());
+        SetBigNum(this, CKA_PRIVATE_EXPONENT, rsa->GetPrivateExponent());
+        SetBigNum(this, CKA_PRIME_1, rsa->GetPrime1());
+        SetBigNum(this, CKA_PRIME_2, rsa->GetPrime2());
+        SetBigNum(this, CKA_EXPONENT_1, rsa->GetExponent1());
+        SetBigNum(this, CKA_EXPONENT_2, rsa->GetExponent2());
+        SetBigNum(this, CKA_COEFFICIENT, rsa->GetCoefficient());
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::RsaPrivateKey::CreateValues(
+    CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+    CK_ULONG          ulCount     /* attributes in template */
+)
+{
+    try {
+        core::RsaPrivateKey::CreateValues(pTemplate, ulCount);
+
+        Scoped<Buffer> modulus = ItemByType(CKA_MODULUS)->ToBytes();
+        size_t modulusBits = core::BigNum::FromBytes(modulus->data(), modulus->size()).GetBitLength();
+        if (modulusBits < RSA_MIN_MODULUS_BITS || modulusBits > RSA_MAX_MODULUS_BITS) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Wrong RSA modulus length");
+        }
+        if (ItemByType(CKA_PRIVATE_EXPONENT)->ToBytes()->empty()) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "CKA_PRIVATE_EXPONENT is empty");
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::Rsa> soft::RsaPrivateKey::GetRsa()
+{
+    try {
+        std::lock_guard<std::mutex> lock(rsaMutex);
+
+        if (!rsa) {
+            rsa = Scoped<core::Rsa>(new core::Rsa(
+                GetBigNum(this, CKA_MODULUS),
+                GetBigNum(this, CKA_PUBLIC_EXPONENT),
+                GetBigNum(this, CKA_PRIVATE_EXPONENT),
+                GetBigNum(this, CKA_PRIME_1),
+                GetBigNum(this, CKA_PRIME_2),
+                GetBigNum(this, CKA_EXPONENT_1),
+                GetBigNum(this, CKA_EXPONENT_2),
+                GetBigNum(this, CKA_COEFFICIENT)));
+        }
+
+        return rsa;
+    }
+    CATCH_EXCEPTION
+}
+
+soft::RsaPublicKey::RsaPublicKey()
+    : core::RsaPublicKey()
+{
+}
+
+void soft::RsaPublicKey::Assign(Scoped<core::Rsa> rsa)
+{
+    try {
+        {
+            std::lock_guard<std::mutex> lock(rsaMutex);
+            this->rsa = Scoped<core::Rsa>(new core::Rsa(rsa->GetModulus(), rsa->GetPublicExponent()));
+        }
+
+        SetBigNum(this, CKA_MODULUS, rsa->GetModulus());
+        SetBigNum(this, CKA_PUBLIC_EXPONENT, rsa->GetPublicExponent());
+        ItemByType(CKA_MODULUS_BITS)->To<core::AttributeNumber>()->Set(rsa->GetModulusBits());
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::RsaPublicKey::CreateValues(
+    CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+    CK_ULONG          ulCount     /* attributes in template */
+)
+{
+    try {
+        core::RsaPublicKey::CreateValues(pTemplate, ulCount);
+
+        Scoped<Buffer> modulus = ItemByType(CKA_MODULUS)->ToBytes();
+        size_t modulusBits = core::BigNum::FromBytes(modulus->data(), modulus->size()).GetBitLength();
+        if (modulusBits < RSA_MIN_MODULUS_BITS || modulusBits > RSA_MAX_MODULUS_BITS) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Wrong RSA modulus length");
+        }
+        ItemByType(CKA_MODULUS_BITS)->To<core::AttributeNumber>()->Set(modulusBits);
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::Rsa> soft::RsaPublicKey::GetRsa()
+{
+    try {
+        std::lock_guard<std::mutex> lock(rsaMutex);
+
+        if (!rsa) {
+            rsa = Scoped<core::Rsa>(new core::Rsa(
+                GetBigNum(this, CKA_MODULUS),
+                GetBigNum(this, CKA_PUBLIC_EXPONENT)));
+        }
+
+        return rsa;
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "../core/keypair.h"
+#include "../core/keypair_pool.h"
+#include "../core/objects/rsa_private_key.h"
+#include "../core/objects/rsa_public_key.h"
+#include "../core/crypto/rsa.h"
+
+namespace soft {
+
+#define RSA_DEFAULT_PUBLIC_EXPONENT 65537
+
+    class RsaKey {
+    public:
+        /**
+         * CKM_RSA_PKCS_KEY_PAIR_GEN. A key of the pool is used if the pool has the public key
+         * template configured, otherwise the key is generated in the calling thread. Pool
+         * can be empty
+         */
+        static Scoped<core::KeyPair> Generate(
+            CK_MECHANISM_PTR            pMechanism,
+            Scoped<core::Template>      publicTemplate,
+            Scoped<core::Template>      privateTemplate,
+            Scoped<core::KeyPairPool>   pool
+        );
+
+        /**
+         * Configures pool of CKM_RSA_PKCS_KEY_PAIR_GEN keys for the public key template
+         */
+        static void SetPool(
+            Scoped<core::Template>      publicTemplate,
+            CK_ULONG                    ulPoolSize,
+            Scoped<core::KeyPairPool>   pool
+        );
+
+    protected:
+        /**
+         * Reads CKA_MODULUS_BITS and CKA_PUBLIC_EXPONENT of the template. Public exponent
+         * is RSA_DEFAULT_PUBLIC_EXPONENT if the template doesn't have it. Returns name of
+         * the pool configuration
+         */
+        static std::string GetParameters(
+            Scoped<core::Template>      publicTemplate,
+            size_t*                     modulusBits,
+            core::BigNum*               publicExponent
+        );
+    };
+
+    class RsaPrivateKey : public core::RsaPrivateKey {
+    public:
+        RsaPrivateKey();
+
+        void Assign(Scoped<core::Rsa> rsa);
+
+        CK_RV CreateValues(
+            CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+            CK_ULONG          ulCount     /* attributes in template */
+        );
+
+        /**
+         * Returns RSA key of the attributes. It is built on the first use and cached, so
+         * Montgomery contexts and blinding of the key are kept between operations
+         */
+        Scoped<core::Rsa> GetRsa();
+
+    protected:
+        Scoped<core::Rsa>   rsa;
+        std::mutex          rsaMutex;
+    };
+
+    class RsaPublicKey : public core::RsaPublicKey {
+    public:
+        RsaPublicKey();
+
+        void Assign(Scoped<core::Rsa> rsa);
+
+        CK_RV CreateValues(
+            CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+            CK_ULONG          ulCount     /* attributes in template */
+        );
+
+        /**
+         * Returns RSA key of the attributes. It is built on the first use and cached, so
+         * Montgomery contexts and blinding of the key are kept between operations
+         */
+        Scoped<core::Rsa> GetRsa();
+
+    protected:
+        Scoped<core::Rsa>   rsa;
+        std::mutex          rsaMutex;
+    };
+
+}
@@ -0,0 +1,232 @@
+#include "secret_key.h"
+#include "helper.h"
+#include "random.h"
+
+using namespace soft;
+
+Scoped<core::SecretKey> soft::GenericSecretKey::Generate(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Template>  tmpl
+)
+{
+    try {
+        if (pMechanism->mechanism != CKM_GENERIC_SECRET_KEY_GEN) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        if (tmpl->GetNumber(CKA_KEY_TYPE, false, CKK_GENERIC_SECRET) != CKK_GENERIC_SECRET) {
+            THROW_PKCS11_TEMPLATE_INCONSISTENT();
+        }
+
+        Scoped<GenericSecretKey> key(new GenericSecretKey());
+        key->GenerateValues(tmpl->Get(), tmpl->Size());
+
+        CK_ULONG ulKeyLength = tmpl->GetNumber(CKA_VALUE_LEN, true, 0);
+        if (!ulKeyLength || ulKeyLength > GENERIC_SECRET_MAX_LENGTH) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Wrong CKA_VALUE_LEN for generic secret key");
+        }
+
+        Buffer value(ulKeyLength);
+        GenerateRandom(value.data(), ulKeyLength);
+        key->ItemByType(CKA_VALUE)->To<core::AttributeBytes>()->Set(value.data(), value.size());
+        memset(value.data(), 0, value.size());
+        key->ItemByType(CKA_LOCAL)->To<core::AttributeBool>()->Set(true);
+
+        return key;
+    }
+    CATCH_EXCEPTION
+}
+
+soft::GenericSecretKey::GenericSecretKey()
+    : core::GenericSecretKey()
+{
+}
+
+CK_RV soft::GenericSecretKey::CreateValues(
+    CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+    CK_ULONG          ulCount     /* attributes in template */
+)
+{
+    try {
+        core::GenericSecretKey::CreateValues(pTemplate, ulCount);
+
+        Scoped<Buffer> value = ItemByType(CKA_VALUE)->ToBytes();
+        if (value->empty()) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "CKA_VALUE is empty");
+        }
+        ItemByType(CKA_VALUE_LEN)->To<core::AttributeNumber>()->Set(value->size());
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::HmacPads> soft::GenericSecretKey::GetHmacPads(
+    CK_MECHANISM_TYPE digestMechanism
+)
+{
+    try {
+        std::lock_guard<std::mutex> lock(hmacPadsMutex);
+
+        Scoped<core::HmacPads> pads = hmacPads[digestMechanism];
+        if (!pads) {
+            Scoped<Buffer> value = ItemByType(CKA_VALUE)->ToBytes();
+            pads = Scoped<core::HmacPads>(new core::HmacPads(digestMechanism, value->data(), value->size()));
+            hmacPads[digestMechanism] = pads;
+        }
+
+        return pads;
+    }
+    CATCH_EXCEPTION
+}
+
+soft::AesKey::AesKey()
+    : core::AesKey()
+{
+}
+
+CK_RV soft::AesKey::CreateValues(
+    CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+    CK_ULONG          ulCount     /* attributes in template */
+)
+{
+    try {
+        core::AesKey::CreateValues(pTemplate, ulCount);
+
+        Scoped<Buffer> value = ItemByType(CKA_VALUE)->ToBytes();
+        switch (value->size()) {
+        case 16:
+        case 24:
+        case 32:
+            break;
+        default:
+            THROW_PKCS11_EXCEPTION(CKR_TEMPLATE_INCONSISTENT, "Wrong size for AES key. Must be 16, 24 or 32");
+        }
+        ItemByType(CKA_VALUE_LEN)->To<core::AttributeNumber>()->Set(value->size());
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::Aes> soft::AesKey::GetAes()
+{
+    try {
+        std::lock_guard<std::mutex> lock(aesMutex);
+
+        if (!aes) {
+            Scoped<Buffer> value = ItemByType(CKA_VALUE)->ToBytes();
+            aes = Scoped<core::Aes>(new core::Aes(value->data(), value->size()));
+        }
+
+        return aes;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::GcmKey> soft::AesKey::GetGcmKey()
+{
+    try {
+        Scoped<core::Aes> aes = GetAes();
+
+        std::lock_guard<std::mutex> lock(aesMutex);
+
+        if (!gcmKey) {
+            gcmKey = Scoped<core::GcmKey>(new core::GcmKey(aes));
+
+            Scoped<Buffer> value = ItemByType(CKA_VALUE)->ToBytes();
+            ShareInvocations(value->data(), (CK_ULONG)value->size());
+        }
+
+        return gcmKey;
+    }
+    CATCH_EXCEPTION
+}
+
+// IEEE 1619 requires different halves of the key
+static bool XtsHalvesDiffer(const Buffer& value)
+{
+    size_t half = value.size() / 2;
+    CK_BYTE diff = 0;
+    for (size_t i = 0; i < half; i++) {
+        diff |= value[i] ^ value[half + i];
+    }
+    return diff != 0;
+}
+
+Scoped<core::SecretKey> soft::AesXtsKey::Generate(
+    CK_MECHANISM_PTR        pMechanism,
+    Scoped<core::Template>  tmpl
+)
+{
+    try {
+        if (pMechanism->mechanism != CKM_AES_XTS_KEY_GEN) {
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        if (tmpl->GetNumber(CKA_KEY_TYPE, false, CKK_AES_XTS) != CKK_AES_XTS) {
+            THROW_PKCS11_TEMPLATE_INCONSISTENT();
+        }
+
+        Scoped<AesXtsKey> key(new AesXtsKey());
+        key->GenerateValues(tmpl->Get(), tmpl->Size());
+
+        CK_ULONG ulKeyLength = tmpl->GetNumber(CKA_VALUE_LEN, true, 0);
+        if (ulKeyLength != 32 && ulKeyLength != 64) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Wrong CKA_VALUE_LEN for XTS-AES key. Must be 32 or 64");
+        }
+
+        Buffer value(ulKeyLength);
+        do {
+            GenerateRandom(value.data(), ulKeyLength);
+        } while (!XtsHalvesDiffer(value));
+        key->ItemByType(CKA_VALUE)->To<core::AttributeBytes>()->Set(value.data(), value.size());
+        memset(value.data(), 0, value.size());
+        key->ItemByType(CKA_LOCAL)->To<core::AttributeBool>()->Set(true);
+
+        return key;
+    }
+    CATCH_EXCEPTION
+}
+
+soft::AesXtsKey::AesXtsKey()
+    : core::AesXtsKey()
+{
+}
+
+CK_RV soft::AesXtsKey::CreateValues(
+    CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+    CK_ULONG          ulCount     /* attributes in template */
+)
+{
+    try {
+        core::AesXtsKey::CreateValues(pTemplate, ulCount);
+
+        Scoped<Buffer> value = ItemByType(CKA_VALUE)->ToBytes();
+        if (value->size() != 32 && value->size() != 64) {
+            THROW_PKCS11_EXCEPTION(CKR_TEMPLATE_INCONSISTENT, "Wrong size for XTS-AES key. Must be 32 or 64");
+        }
+        if (!XtsHalvesDiffer(*value)) {
+            THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Halves of XTS-AES key must differ");
+        }
+        ItemByType(CKA_VALUE_LEN)->To<core::AttributeNumber>()->Set(value->size());
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::XtsKey> soft::AesXtsKey::GetXtsKey()
+{
+    try {
+        std::lock_guard<std::mutex> lock(xtsKeyMutex);
+
+        if (!xtsKey) {
+            Scoped<Buffer> value = ItemByType(CKA_VALUE)->ToBytes();
+            xtsKey = Scoped<core::XtsKey>(new core::XtsKey(value->data(), value->size()));
+        }
+
+        return xtsKey;
+    }
+    CATCH_EXCEPTION
+}
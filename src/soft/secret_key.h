@@ -0,0 +1,102 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "../core/objects/generic_secret_key.h"
+#include "../core/objects/aes_key.h"
+#include "../core/objects/aes_xts_key.h"
+#include "../core/crypto/hmac.h"
+#include "../core/crypto/aes.h"
+#include "../core/crypto/gcm.h"
+#include "../core/crypto/xts.h"
+
+namespace soft {
+
+#define GENERIC_SECRET_MAX_LENGTH   4096
+
+    class GenericSecretKey : public core::GenericSecretKey {
+    public:
+        /**
+         * CKM_GENERIC_SECRET_KEY_GEN, the template sets CKA_VALUE_LEN in bytes
+         */
+        static Scoped<core::SecretKey> Generate(
+            CK_MECHANISM_PTR        pMechanism,
+            Scoped<core::Template>  tmpl
+        );
+
+        GenericSecretKey();
+
+        CK_RV CreateValues(
+            CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+            CK_ULONG          ulCount     /* attributes in template */
+        );
+
+        /**
+         * Returns HMAC pads of the key for the digest mechanism. Pads are computed
+         * on the first use and cached
+         */
+        Scoped<core::HmacPads> GetHmacPads(
+            CK_MECHANISM_TYPE digestMechanism
+        );
+
+    protected:
+        std::map<CK_MECHANISM_TYPE, Scoped<core::HmacPads> > hmacPads;
+        std::mutex                                           hmacPadsMutex;
+    };
+
+    class AesKey : public core::AesKey {
+    public:
+        AesKey();
+
+        CK_RV CreateValues(
+            CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+            CK_ULONG          ulCount     /* attributes in template */
+        );
+
+        /**
+         * Returns key schedule. It is expanded on the first use and cached
+         */
+        Scoped<core::Aes> GetAes();
+
+        /**
+         * Returns GHASH tables of the key. They are computed on the first use and cached,
+         * the first use also shares the invocation counter with keys of the same value
+         */
+        Scoped<core::GcmKey> GetGcmKey();
+
+    protected:
+        Scoped<core::Aes>   aes;
+        Scoped<core::GcmKey> gcmKey;
+        std::mutex          aesMutex;
+    };
+
+    /**
+     * XTS-AES key of 32 or 64 bytes, two AES keys of the same size which must differ
+     */
+    class AesXtsKey : public core::AesXtsKey {
+    public:
+        /**
+         * CKM_AES_XTS_KEY_GEN, the template sets CKA_VALUE_LEN in bytes
+         */
+        static Scoped<core::SecretKey> Generate(
+            CK_MECHANISM_PTR        pMechanism,
+            Scoped<core::Template>  tmpl
+        );
+
+        AesXtsKey();
+
+        CK_RV CreateValues(
+            CK_ATTRIBUTE_PTR  pTemplate,  /* specifies attributes */
+            CK_ULONG          ulCount     /* attributes in template */
+        );
+
+        /**
+         * Returns key schedules of both halves. They are expanded on the first use and cached
+         */
+        Scoped<core::XtsKey> GetXtsKey();
+
+    protected:
+        Scoped<core::XtsKey> xtsKey;
+        std::mutex          xtsKeyMutex;
+    };
+
+}
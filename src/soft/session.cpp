@@ -0,0 +1,745 @@
+#include "session.h"
+
+#include "crypto.h"
+
+#include "certificate.h"
+#include "data.h"
+#include "secret_key.h"
+#include "rsa.h"
+#include "ec.h"
+#include "ec_edwards.h"
+#include "ec_montgomery.h"
+#include "random.h"
+#include "../core/crypto/workers.h"
+
+using namespace soft;
+
+// Ed25519 signatures checked by one multi-scalar multiplication of C_PV_VerifyBatch
+#define ED25519_BATCH_SIZE  64
+
+CK_RV soft::Session::Open
+(
+    CK_FLAGS              flags,         /* from CK_SESSION_INFO */
+    CK_VOID_PTR           pApplication,  /* passed to callback */
+    CK_NOTIFY             Notify,        /* callback function */
+    CK_SESSION_HANDLE_PTR phSession      /* gets session handle */
+)
+{
+    try {
+        core::Session::Open(flags,
+            pApplication,
+            Notify,
+            phSession);
+
+        digest = Scoped<CryptoDigest>(new CryptoDigest());
+        encrypt = Scoped<core::CryptoEncrypt>(new core::CryptoEncrypt(CRYPTO_ENCRYPT));
+        decrypt = Scoped<core::CryptoEncrypt>(new core::CryptoEncrypt(CRYPTO_DECRYPT));
+        sign = Scoped<core::CryptoSign>(new core::CryptoSign(CRYPTO_SIGN));
+        verify = Scoped<core::CryptoSign>(new core::CryptoSign(CRYPTO_VERIFY));
+
+        // Token objects are loaded by the slot's store
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::Session::Close()
+{
+    try {
+        objects.clear();
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::Object> soft::Session::CreateObject
+(
+    CK_ATTRIBUTE_PTR        pTemplate,   /* the object's template */
+    CK_ULONG                ulCount      /* attributes in template */
+)
+{
+    try {
+        core::Template tmpl(pTemplate, ulCount);
+
+        Scoped<core::Object> object;
+        switch (tmpl.GetNumber(CKA_CLASS, true)) {
+        case CKO_CERTIFICATE: {
+            switch (tmpl.GetNumber(CKA_CERTIFICATE_TYPE, true)) {
+            case CKC_X_509:
+                object = Scoped<X509Certificate>(new X509Certificate);
+                break;
+            default:
+                THROW_PKCS11_TEMPLATE_INCOMPLETE();
+            }
+            break;
+        }
+        case CKO_DATA: {
+            object = Scoped<Data>(new Data);
+            break;
+        }
+        case CKO_SECRET_KEY: {
+            switch (tmpl.GetNumber(CKA_KEY_TYPE, true)) {
+            case CKK_GENERIC_SECRET:
+                object = Scoped<GenericSecretKey>(new GenericSecretKey);
+                break;
+            case CKK_AES:
+                object = Scoped<AesKey>(new AesKey);
+                break;
+            case CKK_AES_XTS:
+                object = Scoped<AesXtsKey>(new AesXtsKey);
+                break;
+            default:
+                THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Unsupported key type");
+            }
+            break;
+        }
+        case CKO_PRIVATE_KEY: {
+            switch (tmpl.GetNumber(CKA_KEY_TYPE, true)) {
+            case CKK_RSA:
+                object = Scoped<RsaPrivateKey>(new RsaPrivateKey);
+                break;
+            case CKK_EC:
+                object = Scoped<EcPrivateKey>(new EcPrivateKey);
+                break;
+            case CKK_EC_EDWARDS:
+                object = Scoped<EdPrivateKey>(new EdPrivateKey);
+                break;
+            case CKK_EC_MONTGOMERY:
+                object = Scoped<MontPrivateKey>(new MontPrivateKey);
+                break;
+            default:
+                THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Unsupported key type");
+            }
+            break;
+        }
+        case CKO_PUBLIC_KEY: {
+            switch (tmpl.GetNumber(CKA_KEY_TYPE, true)) {
+            case CKK_RSA:
+                object = Scoped<RsaPublicKey>(new RsaPublicKey);
+                break;
+            case CKK_EC:
+                object = Scoped<EcPublicKey>(new EcPublicKey);
+                break;
+            case CKK_EC_EDWARDS:
+                object = Scoped<EdPublicKey>(new EdPublicKey);
+                break;
+            case CKK_EC_MONTGOMERY:
+                object = Scoped<MontPublicKey>(new MontPublicKey);
+                break;
+            default:
+                THROW_PKCS11_EXCEPTION(CKR_ATTRIBUTE_VALUE_INVALID, "Unsupported key type");
+            }
+            break;
+        }
+        default:
+            THROW_PKCS11_TEMPLATE_INCOMPLETE();
+        }
+
+        object->CreateValues(pTemplate, ulCount);
+
+        return object;
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::Object> soft::Session::CopyObject
+(
+    Scoped<core::Object>    object,      /* the object for copying */
+    CK_ATTRIBUTE_PTR        pTemplate,   /* template for new object */
+    CK_ULONG                ulCount      /* attributes in template */
+)
+{
+    try {
+        Scoped<core::Object> copy;
+        if (dynamic_cast<X509Certificate*>(object.get())) {
+            copy = Scoped<X509Certificate>(new X509Certificate());
+        }
+        else if (dynamic_cast<Data*>(object.get())) {
+            copy = Scoped<Data>(new Data());
+        }
+        else if (dynamic_cast<GenericSecretKey*>(object.get())) {
+            copy = Scoped<GenericSecretKey>(new GenericSecretKey());
+        }
+        else if (dynamic_cast<AesKey*>(object.get())) {
+            copy = Scoped<AesKey>(new AesKey());
+        }
+        else if (dynamic_cast<AesXtsKey*>(object.get())) {
+            copy = Scoped<AesXtsKey>(new AesXtsKey());
+        }
+        else if (dynamic_cast<RsaPrivateKey*>(object.get())) {
+            copy = Scoped<RsaPrivateKey>(new RsaPrivateKey());
+        }
+        else if (dynamic_cast<RsaPublicKey*>(object.get())) {
+            copy = Scoped<RsaPublicKey>(new RsaPublicKey());
+        }
+        else if (dynamic_cast<EcPrivateKey*>(object.get())) {
+            copy = Scoped<EcPrivateKey>(new EcPrivateKey());
+        }
+        else if (dynamic_cast<EcPublicKey*>(object.get())) {
+            copy = Scoped<EcPublicKey>(new EcPublicKey());
+        }
+        else if (dynamic_cast<EdPrivateKey*>(object.get())) {
+            copy = Scoped<EdPrivateKey>(new EdPrivateKey());
+        }
+        else if (dynamic_cast<EdPublicKey*>(object.get())) {
+            copy = Scoped<EdPublicKey>(new EdPublicKey());
+        }
+        else if (dynamic_cast<MontPrivateKey*>(object.get())) {
+            copy = Scoped<MontPrivateKey>(new MontPrivateKey());
+        }
+        else if (dynamic_cast<MontPublicKey*>(object.get())) {
+            copy = Scoped<MontPublicKey>(new MontPublicKey());
+        }
+        else {
+            THROW_PKCS11_EXCEPTION(CKR_FUNCTION_FAILED, "Object is not copyable");
+        }
+
+        copy->CopyValues(object, pTemplate, ulCount);
+        return copy;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::Session::GenerateKey
+(
+    CK_MECHANISM_PTR     pMechanism,
+    CK_ATTRIBUTE_PTR     pTemplate,
+    CK_ULONG             ulCount,
+    CK_OBJECT_HANDLE_PTR phKey
+)
+{
+    try {
+        core::Session::GenerateKey(
+            pMechanism,
+            pTemplate,
+            ulCount,
+            phKey
+        );
+
+        Scoped<core::Template> tmpl(new core::Template(pTemplate, ulCount));
+
+        Scoped<core::SecretKey> key;
+        switch (pMechanism->mechanism) {
+        case CKM_GENERIC_SECRET_KEY_GEN:
+            key = GenericSecretKey::Generate(
+                pMechanism,
+                tmpl
+            );
+            break;
+        case CKM_AES_XTS_KEY_GEN:
+            key = AesXtsKey::Generate(
+                pMechanism,
+                tmpl
+            );
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        objects.add(key);
+
+        *phKey = key->handle;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV soft::Session::GenerateKeyPair
+(
+    CK_MECHANISM_PTR     pMechanism,
+    CK_ATTRIBUTE_PTR     pPublicKeyTemplate,
+    CK_ULONG             ulPublicKeyAttributeCount,
+    CK_ATTRIBUTE_PTR     pPrivateKeyTemplate,
+    CK_ULONG             ulPrivateKeyAttributeCount,
+    CK_OBJECT_HANDLE_PTR phPublicKey,
+    CK_OBJECT_HANDLE_PTR phPrivateKey
+)
+{
+    try {
+        core::Session::GenerateKeyPair(
+            pMechanism,
+            pPublicKeyTemplate,
+            ulPublicKeyAttributeCount,
+            pPrivateKeyTemplate,
+            ulPrivateKeyAttributeCount,
+            phPublicKey,
+            phPrivateKey
+        );
+
+        Scoped<core::Template> publicTemplate(new core::Template(pPublicKeyTemplate, ulPublicKeyAttributeCount));
+        Scoped<core::Template> privateTemplate(new core::Template(pPrivateKeyTemplate, ulPrivateKeyAttributeCount));
+
+        Scoped<core::KeyPair> keyPair;
+        switch (pMechanism->mechanism) {
+        case CKM_RSA_PKCS_KEY_PAIR_GEN:
+            keyPair = RsaKey::Generate(
+                pMechanism,
+                publicTemplate,
+                privateTemplate,
+                keyPairPool
+            );
+            break;
+        case CKM_EC_KEY_PAIR_GEN:
+            keyPair = EcKey::Generate(
+                pMechanism,
+                publicTemplate,
+                privateTemplate,
+                keyPairPool
+            );
+            break;
+        case CKM_EC_EDWARDS_KEY_PAIR_GEN:
+            keyPair = EdKey::Generate(
+                pMechanism,
+                publicTemplate,
+                privateTemplate
+            );
+            break;
+        case CKM_EC_MONTGOMERY_KEY_PAIR_GEN:
+            keyPair = MontKey::Generate(
+                pMechanism,
+                publicTemplate,
+                privateTemplate
+            );
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        objects.add(keyPair->publicKey);
+        objects.add(keyPair->privateKey);
+
+        *phPublicKey = keyPair->publicKey->handle;
+        *phPrivateKey = keyPair->privateKey->handle;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV soft::Session::EncryptInit
+(
+    CK_MECHANISM_PTR  pMechanism,
+    CK_OBJECT_HANDLE  hKey
+)
+{
+    try {
+        core::Session::EncryptInit(
+            pMechanism,
+            hKey
+        );
+
+        if (encrypt->IsActive()) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+
+        switch (pMechanism->mechanism) {
+        case CKM_AES_ECB:
+        case CKM_AES_CBC:
+        case CKM_AES_CBC_PAD:
+            encrypt = Scoped<CryptoAesEncrypt>(new CryptoAesEncrypt(CRYPTO_ENCRYPT));
+            break;
+        case CKM_AES_CTR:
+            encrypt = Scoped<CryptoAesCtrEncrypt>(new CryptoAesCtrEncrypt(CRYPTO_ENCRYPT));
+            break;
+        case CKM_AES_XTS:
+            encrypt = Scoped<CryptoAesXtsEncrypt>(new CryptoAesXtsEncrypt(CRYPTO_ENCRYPT));
+            break;
+        case CKM_AES_GCM:
+            encrypt = Scoped<CryptoAesGCMEncrypt>(new CryptoAesGCMEncrypt(CRYPTO_ENCRYPT));
+            break;
+        case CKM_CHACHA20_POLY1305:
+            encrypt = Scoped<CryptoChaCha20Poly1305Encrypt>(new CryptoChaCha20Poly1305Encrypt(CRYPTO_ENCRYPT));
+            break;
+        case CKM_RSA_PKCS_OAEP:
+            encrypt = Scoped<CryptoRsaOAEPEncrypt>(new CryptoRsaOAEPEncrypt(CRYPTO_ENCRYPT));
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        return encrypt->Init(
+            pMechanism,
+            GetObject(hKey));
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV soft::Session::DecryptInit
+(
+    CK_MECHANISM_PTR  pMechanism,
+    CK_OBJECT_HANDLE  hKey
+)
+{
+    try {
+        core::Session::DecryptInit(
+            pMechanism,
+            hKey
+        );
+
+        if (decrypt->IsActive()) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+
+        switch (pMechanism->mechanism) {
+        case CKM_AES_ECB:
+        case CKM_AES_CBC:
+        case CKM_AES_CBC_PAD:
+            decrypt = Scoped<CryptoAesEncrypt>(new CryptoAesEncrypt(CRYPTO_DECRYPT));
+            break;
+        case CKM_AES_CTR:
+            decrypt = Scoped<CryptoAesCtrEncrypt>(new CryptoAesCtrEncrypt(CRYPTO_DECRYPT));
+            break;
+        case CKM_AES_XTS:
+            decrypt = Scoped<CryptoAesXtsEncrypt>(new CryptoAesXtsEncrypt(CRYPTO_DECRYPT));
+            break;
+        case CKM_AES_GCM:
+            decrypt = Scoped<CryptoAesGCMEncrypt>(new CryptoAesGCMEncrypt(CRYPTO_DECRYPT));
+            break;
+        case CKM_CHACHA20_POLY1305:
+            decrypt = Scoped<CryptoChaCha20Poly1305Encrypt>(new CryptoChaCha20Poly1305Encrypt(CRYPTO_DECRYPT));
+            break;
+        case CKM_RSA_PKCS_OAEP:
+            decrypt = Scoped<CryptoRsaOAEPEncrypt>(new CryptoRsaOAEPEncrypt(CRYPTO_DECRYPT));
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        return decrypt->Init(
+            pMechanism,
+            GetObject(hKey));
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV soft::Session::MessageEncryptInit
+(
+    CK_MECHANISM_PTR  pMechanism,
+    CK_OBJECT_HANDLE  hKey
+)
+{
+    try {
+        core::Session::MessageEncryptInit(
+            pMechanism,
+            hKey
+        );
+
+        switch (pMechanism->mechanism) {
+        case CKM_AES_GCM:
+            messageEncrypt = Scoped<CryptoAesGCMMessageEncrypt>(new CryptoAesGCMMessageEncrypt(CRYPTO_ENCRYPT));
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        return messageEncrypt->Init(
+            pMechanism,
+            GetObject(hKey));
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV soft::Session::MessageDecryptInit
+(
+    CK_MECHANISM_PTR  pMechanism,
+    CK_OBJECT_HANDLE  hKey
+)
+{
+    try {
+        core::Session::MessageDecryptInit(
+            pMechanism,
+            hKey
+        );
+
+        switch (pMechanism->mechanism) {
+        case CKM_AES_GCM:
+            messageDecrypt = Scoped<CryptoAesGCMMessageEncrypt>(new CryptoAesGCMMessageEncrypt(CRYPTO_DECRYPT));
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        return messageDecrypt->Init(
+            pMechanism,
+            GetObject(hKey));
+    }
+    CATCH_EXCEPTION;
+}
+
+/**
+ * Returns sign or verify operation of the mechanism
+ */
+static Scoped<core::CryptoSign> CreateSign(
+    CK_MECHANISM_TYPE mechanism,
+    CK_BBOOL          type
+)
+{
+    switch (mechanism) {
+    case CKM_SHA_1_HMAC:
+    case CKM_SHA256_HMAC:
+    case CKM_SHA384_HMAC:
+    case CKM_SHA512_HMAC:
+        return Scoped<CryptoHmacSign>(new CryptoHmacSign(type));
+    case CKM_RSA_PKCS:
+    case CKM_SHA1_RSA_PKCS:
+    case CKM_SHA256_RSA_PKCS:
+    case CKM_SHA384_RSA_PKCS:
+    case CKM_SHA512_RSA_PKCS:
+        return Scoped<CryptoRsaPKCS1Sign>(new CryptoRsaPKCS1Sign(type));
+    case CKM_RSA_PKCS_PSS:
+    case CKM_SHA1_RSA_PKCS_PSS:
+    case CKM_SHA256_RSA_PKCS_PSS:
+    case CKM_SHA384_RSA_PKCS_PSS:
+    case CKM_SHA512_RSA_PKCS_PSS:
+        return Scoped<CryptoRsaPSSSign>(new CryptoRsaPSSSign(type));
+    case CKM_ECDSA:
+    case CKM_ECDSA_SHA1:
+    case CKM_ECDSA_SHA256:
+    case CKM_ECDSA_SHA384:
+    case CKM_ECDSA_SHA512:
+        return Scoped<CryptoEcDsaSign>(new CryptoEcDsaSign(type));
+    case CKM_EDDSA:
+        return Scoped<CryptoEdDsaSign>(new CryptoEdDsaSign(type));
+    default:
+        THROW_PKCS11_MECHANISM_INVALID();
+    }
+}
+
+CK_RV soft::Session::SignInit
+(
+    CK_MECHANISM_PTR  pMechanism,
+    CK_OBJECT_HANDLE  hKey
+)
+{
+    try {
+        core::Session::SignInit(
+            pMechanism,
+            hKey
+        );
+
+        if (sign->IsActive()) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+
+        sign = CreateSign(pMechanism->mechanism, CRYPTO_SIGN);
+
+        return sign->Init(
+            pMechanism,
+            GetObject(hKey));
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV soft::Session::VerifyInit
+(
+    CK_MECHANISM_PTR  pMechanism,
+    CK_OBJECT_HANDLE  hKey
+)
+{
+    try {
+        core::Session::VerifyInit(
+            pMechanism,
+            hKey
+        );
+
+        if (verify->IsActive()) {
+            THROW_PKCS11_OPERATION_ACTIVE();
+        }
+
+        verify = CreateSign(pMechanism->mechanism, CRYPTO_VERIFY);
+
+        return verify->Init(
+            pMechanism,
+            GetObject(hKey));
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV soft::Session::VerifyBatch
+(
+    CK_PV_VERIFY_ITEM_PTR pItems,
+    CK_ULONG              ulItemCount,
+    CK_PV_RV_PTR          pResults
+)
+{
+    try {
+        // Operations are initialized on the calling thread, keys are looked up once
+        std::vector<Scoped<core::CryptoSign> > operations(ulItemCount);
+        CK_MECHANISM_TYPE checkedMechanism = 0;
+        bool checked = false;
+        for (CK_ULONG i = 0; i < ulItemCount; i++) {
+            CK_PV_VERIFY_ITEM& item = pItems[i];
+            try {
+                if ((item.pData == NULL_PTR && item.ulDataLen) || item.pSignature == NULL_PTR) {
+                    THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "pData or pSignature is NULL");
+                }
+                // Checks of core::Session::VerifyInit. Items of one mechanism are usual, the
+                // mechanism list is checked once for them
+                if (item.pMechanism == NULL_PTR) {
+                    THROW_PKCS11_EXCEPTION(CKR_MECHANISM_INVALID, "pMechanism is NULL");
+                }
+                if (!checked || checkedMechanism != item.pMechanism->mechanism) {
+                    CheckMechanismType(item.pMechanism->mechanism, CKF_VERIFY);
+                    checkedMechanism = item.pMechanism->mechanism;
+                    checked = true;
+                }
+                if (item.hKey == NULL_PTR) {
+                    THROW_PKCS11_EXCEPTION(CKR_ARGUMENTS_BAD, "hKey is NULL");
+                }
+
+                Scoped<core::CryptoSign> operation = CreateSign(item.pMechanism->mechanism, CRYPTO_VERIFY);
+                pResults[i] = operation->Init(item.pMechanism, GetObject(item.hKey));
+                operations[i] = operation;
+            }
+            catch (Scoped<core::Exception> e) {
+                pResults[i] = GetExceptionCode(e);
+            }
+        }
+
+        // Ed25519 signatures are checked together by chunks, items of a failed chunk are
+        // verified one by one
+        std::vector<std::vector<core::Ed25519::VERIFY_ITEM> > edChunks;
+        std::vector<std::vector<CK_ULONG> > edIndexes;
+        for (CK_ULONG i = 0; i < ulItemCount; i++) {
+            CryptoEdDsaSign* operation = dynamic_cast<CryptoEdDsaSign*>(operations[i].get());
+            core::Ed25519::VERIFY_ITEM edItem;
+            if (!operation ||
+                !operation->GetBatchItem(pItems[i].pData, pItems[i].ulDataLen, pItems[i].pSignature, pItems[i].ulSignatureLen, &edItem)) {
+                continue;
+            }
+            if (edChunks.empty() || edChunks.back().size() == ED25519_BATCH_SIZE) {
+                edChunks.push_back(std::vector<core::Ed25519::VERIFY_ITEM>());
+                edIndexes.push_back(std::vector<CK_ULONG>());
+            }
+            edChunks.back().push_back(edItem);
+            edIndexes.back().push_back(i);
+        }
+        auto edTask = [&](size_t c) {
+            if (edChunks[c].size() < 2) {
+                return;
+            }
+            try {
+                if (core::Ed25519::VerifyBatch(edChunks[c].data(), edChunks[c].size(), soft::GenerateRandom)) {
+                    for (size_t j = 0; j < edIndexes[c].size(); j++) {
+                        pResults[edIndexes[c][j]] = CKR_OK;
+                        operations[edIndexes[c][j]].reset();
+                    }
+                }
+            }
+            catch (Scoped<core::Exception>) {
+                // Items are verified one by one
+            }
+        };
+
+        auto task = [&](size_t i) {
+            if (!operations[i]) {
+                return;
+            }
+            CK_PV_VERIFY_ITEM& item = pItems[i];
+            try {
+                pResults[i] = operations[i]->Once(item.pData, item.ulDataLen, item.pSignature, item.ulSignatureLen);
+            }
+            catch (Scoped<core::Exception> e) {
+                pResults[i] = GetExceptionCode(e);
+            }
+            operations[i].reset();
+        };
+        if (core::WorkerPool::GetThreshold()) {
+            core::WorkerPool::Get().Run(edChunks.size(), edTask);
+            core::WorkerPool::Get().Run(ulItemCount, task);
+        }
+        else {
+            for (size_t c = 0; c < edChunks.size(); c++) {
+                edTask(c);
+            }
+            for (CK_ULONG i = 0; i < ulItemCount; i++) {
+                task(i);
+            }
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV soft::Session::DeriveKey
+(
+    CK_MECHANISM_PTR     pMechanism,
+    CK_OBJECT_HANDLE     hBaseKey,
+    CK_ATTRIBUTE_PTR     pTemplate,
+    CK_ULONG             ulAttributeCount,
+    CK_OBJECT_HANDLE_PTR phKey
+)
+{
+    try {
+        core::Session::DeriveKey(
+            pMechanism,
+            hBaseKey,
+            pTemplate,
+            ulAttributeCount,
+            phKey
+        );
+
+        Scoped<core::Object> baseKey = GetObject(hBaseKey);
+        Scoped<core::Template> tmpl(new core::Template(pTemplate, ulAttributeCount));
+
+        Scoped<core::Object> derivedKey;
+        switch (pMechanism->mechanism) {
+        case CKM_ECDH1_DERIVE:
+            derivedKey = EcKey::DeriveKey(
+                pMechanism,
+                baseKey,
+                tmpl
+            );
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        objects.add(derivedKey);
+
+        *phKey = derivedKey->handle;
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV soft::Session::SeedRandom(
+    CK_BYTE_PTR       pSeed,     /* the seed material */
+    CK_ULONG          ulSeedLen  /* length of seed material */
+)
+{
+    try {
+        core::Session::SeedRandom(
+            pSeed,
+            ulSeedLen
+        );
+
+        soft::SeedRandom(pSeed, ulSeedLen);
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
+
+CK_RV soft::Session::GenerateRandom(
+    CK_BYTE_PTR       pRandomData,  /* receives the random data */
+    CK_ULONG          ulRandomLen   /* # of bytes to generate */
+)
+{
+    try {
+        core::Session::GenerateRandom(
+            pRandomData,
+            ulRandomLen
+        );
+
+        soft::GenerateRandom(pRandomData, ulRandomLen);
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION
+}
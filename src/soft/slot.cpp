@@ -0,0 +1,121 @@
+#include "slot.h"
+#include "session.h"
+#include "store.h"
+#include "secret_key.h"
+#include "rsa.h"
+#include "ec.h"
+
+using namespace soft;
+
+soft::Slot::Slot() :
+    core::Slot()
+{
+    try {
+        SET_STRING(this->manufacturerID, "Soft Crypto", 32);
+        SET_STRING(this->description, "Soft Crypto", 64);
+        this->flags = CKF_TOKEN_INITIALIZED;
+        this->tokenInfo.flags |= CKF_RNG;
+        this->hardwareVersion.major = 0;
+        this->hardwareVersion.minor = 1;
+        this->firmwareVersion.major = 0;
+        this->firmwareVersion.minor = 1;
+
+        // Token objects
+        this->store = Scoped<core::Store>(new Store(Store::GetDefaultPath()));
+        // Key pairs generated ahead, configured by C_PV_SetKeyPairPool
+        this->keyPairPool = Scoped<core::KeyPairPool>(new core::KeyPairPool());
+
+        // Add mechanisms
+        //   SHA
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA_1, 0, 0, CKF_DIGEST)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA256, 0, 0, CKF_DIGEST)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA384, 0, 0, CKF_DIGEST)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA512, 0, 0, CKF_DIGEST)));
+        //   HMAC
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA_1_HMAC, 8, 4096, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA256_HMAC, 8, 4096, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA384_HMAC, 8, 4096, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA512_HMAC, 8, 4096, CKF_SIGN | CKF_VERIFY)));
+        //   AES
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_AES_ECB, 128, 256, CKF_ENCRYPT | CKF_DECRYPT)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_AES_CBC, 128, 256, CKF_ENCRYPT | CKF_DECRYPT)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_AES_CBC_PAD, 128, 256, CKF_ENCRYPT | CKF_DECRYPT)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_AES_CTR, 128, 256, CKF_ENCRYPT | CKF_DECRYPT)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_AES_XTS, 256, 512, CKF_ENCRYPT | CKF_DECRYPT)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_AES_XTS_KEY_GEN, 256, 512, CKF_GENERATE)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_AES_GCM, 128, 256, CKF_ENCRYPT | CKF_DECRYPT | CKF_MESSAGE_ENCRYPT | CKF_MESSAGE_DECRYPT)));
+        //   ChaCha20-Poly1305
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_CHACHA20_POLY1305, 32, 32, CKF_ENCRYPT | CKF_DECRYPT)));
+        //   Generic secret
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_GENERIC_SECRET_KEY_GEN, 8, GENERIC_SECRET_MAX_LENGTH * 8, CKF_GENERATE)));
+        //   RSA
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_RSA_PKCS_KEY_PAIR_GEN, RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS, CKF_GENERATE)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_RSA_PKCS, RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA1_RSA_PKCS, RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA256_RSA_PKCS, RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA384_RSA_PKCS, RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA512_RSA_PKCS, RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_RSA_PKCS_PSS, RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA1_RSA_PKCS_PSS, RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA256_RSA_PKCS_PSS, RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA384_RSA_PKCS_PSS, RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_SHA512_RSA_PKCS_PSS, RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_RSA_PKCS_OAEP, RSA_MIN_MODULUS_BITS, RSA_MAX_MODULUS_BITS, CKF_ENCRYPT | CKF_DECRYPT)));
+        //   EC
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_EC_KEY_PAIR_GEN, 256, 521, CKF_GENERATE)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_ECDSA, 256, 521, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_ECDSA_SHA1, 256, 521, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_ECDSA_SHA256, 256, 521, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_ECDSA_SHA384, 256, 521, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_ECDSA_SHA512, 256, 521, CKF_SIGN | CKF_VERIFY)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_ECDH1_DERIVE, 255, 521, CKF_DERIVE)));
+        //   Edwards
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_EC_EDWARDS_KEY_PAIR_GEN, 255, 255, CKF_GENERATE)));
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_EDDSA, 255, 255, CKF_SIGN | CKF_VERIFY)));
+        //   Montgomery
+        this->mechanisms.add(Scoped<core::Mechanism>(new core::Mechanism(CKM_EC_MONTGOMERY_KEY_PAIR_GEN, 255, 255, CKF_GENERATE)));
+    }
+    CATCH_EXCEPTION;
+}
+
+Scoped<core::Session> soft::Slot::CreateSession()
+{
+    try {
+        return Scoped<Session>(new Session());
+    }
+    CATCH_EXCEPTION;
+}
+
+CK_RV soft::Slot::SetKeyPairPool
+(
+    CK_MECHANISM_PTR     pMechanism,
+    CK_ATTRIBUTE_PTR     pPublicKeyTemplate,
+    CK_ULONG             ulPublicKeyAttributeCount,
+    CK_ULONG             ulPoolSize
+)
+{
+    try {
+        CheckKeyPairPool(
+            pMechanism,
+            pPublicKeyTemplate,
+            ulPublicKeyAttributeCount,
+            ulPoolSize
+        );
+
+        Scoped<core::Template> publicTemplate(new core::Template(pPublicKeyTemplate, ulPublicKeyAttributeCount));
+
+        switch (pMechanism->mechanism) {
+        case CKM_RSA_PKCS_KEY_PAIR_GEN:
+            RsaKey::SetPool(publicTemplate, ulPoolSize, keyPairPool);
+            break;
+        case CKM_EC_KEY_PAIR_GEN:
+            EcKey::SetPool(publicTemplate, ulPoolSize, keyPairPool);
+            break;
+        default:
+            THROW_PKCS11_MECHANISM_INVALID();
+        }
+
+        return CKR_OK;
+    }
+    CATCH_EXCEPTION;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "../core/slot.h"
+
+namespace soft {
+
+    class Slot : public core::Slot {
+    public:
+        Slot();
+
+        CK_RV SetKeyPairPool
+        (
+            CK_MECHANISM_PTR     pMechanism,                  /* key-gen mechanism */
+            CK_ATTRIBUTE_PTR     pPublicKeyTemplate,          /* template for pub. key */
+            CK_ULONG             ulPublicKeyAttributeCount,   /* # pub. attributes */
+            CK_ULONG             ulPoolSize                   /* # key pairs kept ready */
+        );
+
+    protected:
+        Scoped<core::Session> CreateSession();
+    };
+
+}
@@ -0,0 +1,230 @@
+#include "store.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <algorithm>
+#include <set>
+
+#include "helper.h"
+#include "certificate.h"
+#include "data.h"
+
+using namespace soft;
+
+#define PV_ENV_STORE "PV_PKCS11_STORE"
+#define STORE_DIR ".pvpkcs11"
+
+#define STORE_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static std::string GetExtension(const std::string& name)
+{
+    size_t pos = name.rfind('.');
+    if (pos == std::string::npos) {
+        return std::string("");
+    }
+    std::string ext = name.substr(pos + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+static std::string GetBaseName(const std::string& name)
+{
+    size_t pos = name.rfind('.');
+    if (pos == std::string::npos) {
+        return name;
+    }
+    return name.substr(0, pos);
+}
+
+std::string soft::Store::GetDefaultPath()
+{
+    const char* env = getenv(PV_ENV_STORE);
+    if (env && *env) {
+        return std::string(env);
+    }
+    std::string res("");
+    const char* home = getenv("HOME");
+    if (home) {
+        res += home;
+    }
+    res += "/";
+    res += STORE_DIR;
+    return res;
+}
+
+soft::Store::Store(const std::string& path) :
+    core::Store(),
+    path(path),
+    fd(-1),
+    wd(-1)
+{
+}
+
+soft::Store::~Store()
+{
+    Unwatch();
+}
+
+void soft::Store::Watch()
+{
+    try {
+        if (fd == -1) {
+            fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (fd == -1) {
+                THROW_SOFT_EXCEPTION(errno, "inotify_init1");
+            }
+        }
+        if (wd == -1) {
+            // directory can be created later, it's checked on the next Update
+            wd = inotify_add_watch(fd, path.c_str(), STORE_EVENTS);
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::Store::Unwatch()
+{
+    if (fd != -1) {
+        close(fd);
+    }
+    fd = -1;
+    wd = -1;
+}
+
+void soft::Store::Load()
+{
+    try {
+        RemoveObjects();
+
+        // watch before reading the directory, so changes made while loading are not lost
+        Watch();
+        if (wd == -1) {
+            return;
+        }
+
+        DIR* dir = opendir(path.c_str());
+        if (dir == NULL) {
+            return;
+        }
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            LoadFile(entry->d_name);
+        }
+        closedir(dir);
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::Store::Update()
+{
+    try {
+        if (wd == -1) {
+            Load();
+            return;
+        }
+
+        // collect names of changed files, a name can be reported more than once
+        std::set<std::string> names;
+        bool reload = false;
+        char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        while (true) {
+            ssize_t len = read(fd, events, sizeof(events));
+            if (len == -1) {
+                if (errno == EAGAIN) {
+                    break;
+                }
+                THROW_SOFT_EXCEPTION(errno, "read");
+            }
+            if (len == 0) {
+                break;
+            }
+            for (char* ptr = events; ptr < events + len;) {
+                struct inotify_event* event = (struct inotify_event*)ptr;
+                if (event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                    reload = true;
+                }
+                else if (event->len) {
+                    names.insert(event->name);
+                }
+                ptr += sizeof(struct inotify_event) + event->len;
+            }
+        }
+
+        if (reload) {
+            // directory was replaced or events were lost
+            Unwatch();
+            Load();
+            return;
+        }
+
+        for (std::set<std::string>::iterator it = names.begin(); it != names.end(); it++) {
+            LoadFile(*it);
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+void soft::Store::LoadFile(const std::string& name)
+{
+    try {
+        Scoped<core::Object> object;
+        try {
+            object = ReadFile(name);
+        }
+        catch (...) {
+            // file is not readable or has wrong format
+        }
+
+        if (object) {
+            AddObject(name, object);
+        }
+        else {
+            RemoveObject(name);
+        }
+    }
+    CATCH_EXCEPTION
+}
+
+Scoped<core::Object> soft::Store::ReadFile(const std::string& name)
+{
+    try {
+        if (name.empty() || name[0] == '.') {
+            return Scoped<core::Object>();
+        }
+
+        std::string filePath = path + "/" + name;
+        struct stat st;
+        if (stat(filePath.c_str(), &st) || !S_ISREG(st.st_mode)) {
+            return Scoped<core::Object>();
+        }
+
+        std::string ext = GetExtension(name);
+        std::string label = GetBaseName(name);
+        Scoped<core::Object> object;
+        if (ext == "cer" || ext == "crt" || ext == "der" || ext == "pem") {
+            Scoped<X509Certificate> cert(new X509Certificate);
+            cert->Assign(PemToDer(soft::ReadFile(filePath)));
+            cert->SetPath(filePath);
+            object = cert;
+        }
+        else if (ext == "p10" || ext == "csr") {
+            Scoped<Data> data(new Data);
+            Scoped<Buffer> value = PemToDer(soft::ReadFile(filePath));
+            data->ItemByType(CKA_VALUE)->To<core::AttributeBytes>()->Set(value->data(), value->size());
+            data->SetPath(filePath);
+            object = data;
+        }
+        else {
+            return Scoped<core::Object>();
+        }
+
+        object->ItemByType(CKA_TOKEN)->To<core::AttributeBool>()->Set(true);
+        object->ItemByType(CKA_LABEL)->To<core::AttributeBytes>()->Set((CK_BYTE_PTR)label.c_str(), label.length());
+
+        return object;
+    }
+    CATCH_EXCEPTION
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../stdafx.h"
+#include "../core/store.h"
+
+namespace soft {
+
+    /**
+     * Token objects kept as files in the store directory
+     *  - *.cer, *.crt, *.der, *.pem - X509 certificates (DER or PEM)
+     *  - *.p10, *.csr - certificate requests (CKO_DATA)
+     * Changes of the directory are tracked with inotify
+     */
+    class Store : public core::Store {
+    public:
+        Store(const std::string& path);
+        ~Store();
+
+        /**
+         * Returns directory from PV_PKCS11_STORE or ~/.pvpkcs11 by default
+         */
+        static std::string GetDefaultPath();
+
+    protected:
+        std::string path;
+        int         fd;     /* inotify instance */
+        int         wd;     /* watch of the store directory */
+
+        void Load();
+        void Update();
+
+        void Watch();
+        void Unwatch();
+
+        /**
+         * Adds, replaces or removes token object for the file of the store directory
+         */
+        void LoadFile(const std::string& name);
+
+        Scoped<core::Object> ReadFile(const std::string& name);
+    };
+
+}
@@ -21,12 +21,14 @@
 #endif // _WIN32
 
 #include "./pkcs11.h"
+#include "./pvpkcs11.h"
 
 #ifdef _WIN32
 #pragma pack(pop, cryptoki)
 #endif // _WIN32
 
 #include <stdio.h>
+#include <string.h>
 #include <memory>
 #include <vector>
 #include <string>
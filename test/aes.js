@@ -3,8 +3,10 @@ const pkcs11 = require("pkcs11js");
 const p11_crypto = require("node-webcrypto-p11");
 const ossl_crypto = require("node-webcrypto-ossl");
 const assert = require("assert");
+const crypto = require("crypto");
 
 const config = require("./config");
+const helper = require("./helper");
 
 context("EC", () => {
 
@@ -24,6 +26,389 @@ context("EC", () => {
         mod.C_Finalize();
     });
 
+    context("NIST vectors", () => {
+        // SP 800-38A, AES-128
+        const key = new Buffer("2b7e151628aed2a6abf7158809cf4f3c", "hex");
+        const data = new Buffer(
+            "6bc1bee22e409f96e93d7e117393172a" +
+            "ae2d8a571e03ac9c9eb76fac45af8e51" +
+            "30c81c46a35ce411e5fbc1191a0a52ef" +
+            "f69f2445df4f9b17ad2b417be66c3710", "hex");
+        let aesKey;
+
+        before(() => {
+            aesKey = helper.createSecretKey(mod, session, pkcs11.CKK_AES, key, [
+                { type: pkcs11.CKA_ENCRYPT, value: true },
+                { type: pkcs11.CKA_DECRYPT, value: true },
+            ]);
+        });
+
+        function check(mechanism, enc) {
+            mod.C_EncryptInit(session, mechanism, aesKey);
+            assert.equal(mod.C_Encrypt(session, data, new Buffer(128)).toString("hex"), enc);
+
+            // parts which are not aligned to blocks
+            mod.C_EncryptInit(session, mechanism, aesKey);
+            const parts = [
+                mod.C_EncryptUpdate(session, data.slice(0, 5), new Buffer(128)),
+                mod.C_EncryptUpdate(session, data.slice(5, 37), new Buffer(128)),
+                mod.C_EncryptUpdate(session, data.slice(37), new Buffer(128)),
+                mod.C_EncryptFinal(session, new Buffer(128)),
+            ];
+            assert.equal(Buffer.concat(parts).toString("hex"), enc);
+
+            mod.C_DecryptInit(session, mechanism, aesKey);
+            assert.equal(mod.C_Decrypt(session, new Buffer(enc, "hex"), new Buffer(128)).toString("hex"), data.toString("hex"));
+        }
+
+        it("AES-ECB", () => {
+            check({ mechanism: pkcs11.CKM_AES_ECB, parameter: null },
+                "3ad77bb40d7a3660a89ecaf32466ef97" +
+                "f5d3d58503b9699de785895a96fdbaaf" +
+                "43b1cd7f598ece23881b00e3ed030688" +
+                "7b0c785e27e8ad3f8223207104725dd4");
+        });
+
+        it("AES-CBC", () => {
+            check({ mechanism: pkcs11.CKM_AES_CBC, parameter: new Buffer("000102030405060708090a0b0c0d0e0f", "hex") },
+                "7649abac8119b246cee98e9b12e9197d" +
+                "5086cb9b507219ee95db113a917678b2" +
+                "73bed6b8e3c1743b7116e69e22229516" +
+                "3ff1caa1681fac09120eca307586e1a7");
+        });
+
+        it("AES-CTR", function () {
+            if (!helper.hasMechanism(mod, slot, pkcs11.CKM_AES_CTR)) {
+                this.skip();
+            }
+            const parameter = helper.struct([
+                ["ulong", 128],
+                ["bytes", new Buffer("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff", "hex")],
+            ]);
+            check({ mechanism: pkcs11.CKM_AES_CTR, parameter },
+                "874d6191b620e3261bef6864990db6ce" +
+                "9806f66b7970fdff8617187bb9fffdff" +
+                "5ae4df3edbd5d35e5b4f09020db03eab" +
+                "1e031dda2fbe03d1792170a0f3009cee");
+        });
+
+        it("AES-CTR counter doesn't wrap", function () {
+            if (!helper.hasMechanism(mod, slot, pkcs11.CKM_AES_CTR)) {
+                this.skip();
+            }
+            // two blocks are left in the 32-bit counter
+            const cb = new Buffer("000102030405060708090a0bfffffffe", "hex");
+            const mechanism = {
+                mechanism: pkcs11.CKM_AES_CTR,
+                parameter: helper.struct([
+                    ["ulong", 32],
+                    ["bytes", cb],
+                ]),
+            };
+
+            mod.C_EncryptInit(session, mechanism, aesKey);
+            const enc = mod.C_Encrypt(session, data.slice(0, 32), new Buffer(128));
+
+            const cipher = crypto.createCipheriv("aes-128-ctr", key, cb);
+            assert.equal(enc.toString("hex"), cipher.update(data.slice(0, 32)).toString("hex"));
+
+            mod.C_EncryptInit(session, mechanism, aesKey);
+            assert.throws(() => {
+                mod.C_Encrypt(session, data.slice(0, 33), new Buffer(128));
+            }, /CKR_DATA_LEN_RANGE:33/);
+        });
+    });
+
+    context("AES-GCM", () => {
+        // Test case 4 of the GCM specification
+        const key = new Buffer("feffe9928665731c6d6a8f9467308308", "hex");
+        const iv = new Buffer("cafebabefacedbaddecaf888", "hex");
+        const aad = new Buffer("feedfacedeadbeeffeedfacedeadbeefabaddad2", "hex");
+        const data = new Buffer(
+            "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72" +
+            "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39", "hex");
+        const enc =
+            "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e" +
+            "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091";
+        const tag = "5bc94fbc3221a5db94fae95ae7121a47";
+        let gcmKey;
+
+        before(function () {
+            if (!helper.hasMechanism(mod, slot, pkcs11.CKM_AES_GCM)) {
+                this.skip();
+            }
+            gcmKey = helper.createSecretKey(mod, session, pkcs11.CKK_AES, key, [
+                { type: pkcs11.CKA_ENCRYPT, value: true },
+                { type: pkcs11.CKA_DECRYPT, value: true },
+            ]);
+        });
+
+        it("encrypt/decrypt", () => {
+            const mechanism = {
+                mechanism: pkcs11.CKM_AES_GCM,
+                parameter: { type: pkcs11.CK_PARAMS_AES_GCM, iv, aad, tagBits: 128 },
+            };
+
+            mod.C_EncryptInit(session, mechanism, gcmKey);
+            const res = mod.C_Encrypt(session, data, new Buffer(128));
+            assert.equal(res.toString("hex"), enc + tag);
+
+            mod.C_EncryptInit(session, mechanism, gcmKey);
+            const parts = [
+                mod.C_EncryptUpdate(session, data.slice(0, 7), new Buffer(128)),
+                mod.C_EncryptUpdate(session, data.slice(7), new Buffer(128)),
+                mod.C_EncryptFinal(session, new Buffer(128)),
+            ];
+            assert.equal(Buffer.concat(parts).toString("hex"), enc + tag);
+
+            mod.C_DecryptInit(session, mechanism, gcmKey);
+            assert.equal(mod.C_Decrypt(session, res, new Buffer(128)).toString("hex"), data.toString("hex"));
+
+            res[0] ^= 1;
+            mod.C_DecryptInit(session, mechanism, gcmKey);
+            assert.throws(() => {
+                mod.C_Decrypt(session, res, new Buffer(128));
+            }, /CKR_ENCRYPTED_DATA_INVALID:64/);
+        });
+
+        context("message-based", () => {
+            let secondSession, secondKey;
+
+            before(() => {
+                secondSession = mod.C_OpenSession(slot, pkcs11.CKF_RW_SESSION | pkcs11.CKF_SERIAL_SESSION);
+                // a key object of the same value in another session
+                secondKey = helper.createSecretKey(mod, secondSession, pkcs11.CKK_AES, key, [
+                    { type: pkcs11.CKA_ENCRYPT, value: true },
+                ]);
+            });
+
+            after(() => {
+                mod.C_CloseSession(secondSession);
+            });
+
+            it("encrypt/decrypt", () => {
+                const ivCopy = new Buffer(iv);
+                const tagOut = new Buffer(16);
+
+                helper.C_MessageEncryptInit(session, pkcs11.CKM_AES_GCM, gcmKey);
+                const res = helper.C_EncryptMessage(session, helper.gcmMessageParams(ivCopy, 0, helper.CKG_NO_GENERATE, tagOut), aad, data);
+                helper.C_MessageEncryptFinal(session);
+
+                assert.equal(res.toString("hex"), enc);
+                assert.equal(tagOut.toString("hex"), tag);
+                assert.equal(ivCopy.toString("hex"), iv.toString("hex"));
+
+                helper.C_MessageDecryptInit(session, pkcs11.CKM_AES_GCM, gcmKey);
+                const dec = helper.C_DecryptMessage(session, helper.gcmMessageParams(iv, 0, helper.CKG_NO_GENERATE, tagOut), aad, res);
+                assert.equal(dec.toString("hex"), data.toString("hex"));
+
+                tagOut[15] ^= 1;
+                assert.throws(() => {
+                    helper.C_DecryptMessage(session, helper.gcmMessageParams(iv, 0, helper.CKG_NO_GENERATE, tagOut), aad, res);
+                }, (err) => err.code === helper.CKR_AEAD_DECRYPT_FAILED);
+                helper.C_MessageDecryptFinal(session);
+            });
+
+            function encryptMessages(sessionHandle, keyHandle, fixed, generator, count, ivs) {
+                helper.C_MessageEncryptInit(sessionHandle, pkcs11.CKM_AES_GCM, keyHandle);
+                for (let i = 0; i < count; i++) {
+                    const ivOut = Buffer.concat([fixed, new Buffer(12 - fixed.length).fill(0)]);
+                    const tagOut = new Buffer(16);
+                    const res = helper.C_EncryptMessage(sessionHandle, helper.gcmMessageParams(ivOut, fixed.length * 8, generator, tagOut), aad, data);
+
+                    assert.equal(ivOut.slice(0, fixed.length).toString("hex"), fixed.toString("hex"));
+                    ivs.push(ivOut.toString("hex"));
+
+                    // the generated IV is the one the message is encrypted with
+                    const decipher = crypto.createDecipheriv("aes-128-gcm", key, ivOut);
+                    decipher.setAAD(aad);
+                    decipher.setAuthTag(tagOut);
+                    assert.equal(Buffer.concat([decipher.update(res), decipher.final()]).toString("hex"), data.toString("hex"));
+                }
+                helper.C_MessageEncryptFinal(sessionHandle);
+            }
+
+            function assertUnique(ivs) {
+                const set = {};
+                ivs.forEach((value) => {
+                    assert.equal(set[value], undefined, `IV ${value} is repeated`);
+                    set[value] = true;
+                });
+            }
+
+            it("counter IV is unique across contexts and sessions", () => {
+                const fixed = new Buffer("01020304", "hex");
+                const ivs = [];
+
+                encryptMessages(session, gcmKey, fixed, helper.CKG_GENERATE_COUNTER, 20, ivs);
+                encryptMessages(session, gcmKey, fixed, helper.CKG_GENERATE_COUNTER, 20, ivs);
+                encryptMessages(secondSession, secondKey, fixed, helper.CKG_GENERATE_COUNTER, 20, ivs);
+                encryptMessages(session, gcmKey, fixed, helper.CKG_GENERATE_COUNTER, 20, ivs);
+
+                assertUnique(ivs);
+            });
+
+            it("random IV is unique", () => {
+                const ivs = [];
+
+                encryptMessages(session, gcmKey, new Buffer("0a0b", "hex"), helper.CKG_GENERATE, 50, ivs);
+                encryptMessages(secondSession, secondKey, new Buffer(0), helper.CKG_GENERATE, 50, ivs);
+
+                assertUnique(ivs);
+            });
+
+            it("IV without generated bits", () => {
+                helper.C_MessageEncryptInit(session, pkcs11.CKM_AES_GCM, gcmKey);
+                assert.throws(() => {
+                    helper.C_EncryptMessage(session, helper.gcmMessageParams(new Buffer(iv), 96, helper.CKG_GENERATE_COUNTER, new Buffer(16)), aad, data);
+                }, (err) => err.code === pkcs11.CKR_MECHANISM_PARAM_INVALID);
+                helper.C_MessageEncryptFinal(session);
+            });
+        });
+    });
+
+    context("AES-XTS", () => {
+        // Vector 2 of IEEE 1619
+        const key = new Buffer("1111111111111111111111111111111122222222222222222222222222222222", "hex");
+        const tweak = new Buffer("33333333330000000000000000000000", "hex");
+        const data = new Buffer("4444444444444444444444444444444444444444444444444444444444444444", "hex");
+        const enc = "c454185e6a16936e39334038acef838bfb186fff7480adc4289382ecd6d394f0";
+        let xtsKey;
+
+        before(function () {
+            if (!helper.hasMechanism(mod, slot, helper.CKM_AES_XTS)) {
+                this.skip();
+            }
+            xtsKey = helper.createSecretKey(mod, session, helper.CKK_AES_XTS, key, [
+                { type: pkcs11.CKA_ENCRYPT, value: true },
+                { type: pkcs11.CKA_DECRYPT, value: true },
+            ]);
+        });
+
+        it("encrypt/decrypt", () => {
+            const mechanism = { mechanism: helper.CKM_AES_XTS, parameter: tweak };
+
+            mod.C_EncryptInit(session, mechanism, xtsKey);
+            const res = mod.C_Encrypt(session, data, new Buffer(64));
+            assert.equal(res.toString("hex"), enc);
+
+            mod.C_DecryptInit(session, mechanism, xtsKey);
+            assert.equal(mod.C_Decrypt(session, res, new Buffer(64)).toString("hex"), data.toString("hex"));
+        });
+
+        it("data units", () => {
+            const parameter = helper.struct([
+                ["bytes", tweak],
+                ["ulong", data.length],
+            ]);
+            const mechanism = { mechanism: helper.CKM_AES_XTS, parameter };
+
+            mod.C_EncryptInit(session, mechanism, xtsKey);
+            const res = mod.C_Encrypt(session, Buffer.concat([data, data]), new Buffer(128));
+
+            // the second data unit is encrypted with the next tweak
+            const nextTweak = new Buffer(tweak);
+            nextTweak[0]++;
+            mod.C_EncryptInit(session, { mechanism: helper.CKM_AES_XTS, parameter: nextTweak }, xtsKey);
+            const next = mod.C_Encrypt(session, data, new Buffer(64));
+
+            assert.equal(res.toString("hex"), enc + next.toString("hex"));
+            assert.equal(next.toString("hex"), crypto.createCipheriv("aes-128-xts", key, nextTweak).update(data).toString("hex"));
+
+            mod.C_DecryptInit(session, mechanism, xtsKey);
+            assert.equal(mod.C_Decrypt(session, res, new Buffer(128)).toString("hex"), Buffer.concat([data, data]).toString("hex"));
+        });
+    });
+
+    context("Dual-function", () => {
+        const key = new Buffer("2b7e151628aed2a6abf7158809cf4f3c", "hex");
+        const iv = new Buffer("000102030405060708090a0b0c0d0e0f", "hex");
+        const mechanism = { mechanism: pkcs11.CKM_AES_CBC, parameter: iv };
+        const data = new Buffer(1000).fill("pvpkcs11");
+        let aesKey, hmacKey, enc;
+
+        before(() => {
+            aesKey = helper.createSecretKey(mod, session, pkcs11.CKK_AES, key, [
+                { type: pkcs11.CKA_ENCRYPT, value: true },
+                { type: pkcs11.CKA_DECRYPT, value: true },
+            ]);
+            hmacKey = helper.createSecretKey(mod, session, pkcs11.CKK_GENERIC_SECRET, key, [
+                { type: pkcs11.CKA_SIGN, value: true },
+                { type: pkcs11.CKA_VERIFY, value: true },
+            ]);
+            const cipher = crypto.createCipheriv("aes-128-cbc", key, iv);
+            cipher.setAutoPadding(false);
+            enc = cipher.update(data.slice(0, 992));
+        });
+
+        function parts(update, input) {
+            // the last part is 8 bytes, it leaves a partial block
+            return Buffer.concat([
+                update(session, input.slice(0, 100)),
+                update(session, input.slice(100, 992)),
+            ]);
+        }
+
+        it("DigestEncryptUpdate", () => {
+            mod.C_DigestInit(session, { mechanism: pkcs11.CKM_SHA256, parameter: null });
+            mod.C_EncryptInit(session, mechanism, aesKey);
+
+            const res = parts(helper.C_DigestEncryptUpdate, data);
+            mod.C_EncryptFinal(session, new Buffer(16));
+
+            assert.equal(res.toString("hex"), enc.toString("hex"));
+            assert.equal(mod.C_DigestFinal(session, new Buffer(32)).toString("hex"),
+                crypto.createHash("sha256").update(data.slice(0, 992)).digest("hex"));
+        });
+
+        it("DigestEncryptUpdate with empty part", () => {
+            mod.C_DigestInit(session, { mechanism: pkcs11.CKM_SHA256, parameter: null });
+            mod.C_EncryptInit(session, mechanism, aesKey);
+
+            const res = helper.C_DigestEncryptUpdate(session, new Buffer(0));
+            mod.C_EncryptFinal(session, new Buffer(16));
+
+            assert.equal(res.length, 0);
+            assert.equal(mod.C_DigestFinal(session, new Buffer(32)).toString("hex"),
+                crypto.createHash("sha256").digest("hex"));
+        });
+
+        it("DecryptDigestUpdate", () => {
+            mod.C_DecryptInit(session, mechanism, aesKey);
+            mod.C_DigestInit(session, { mechanism: pkcs11.CKM_SHA256, parameter: null });
+
+            const res = parts(helper.C_DecryptDigestUpdate, enc);
+            mod.C_DecryptFinal(session, new Buffer(16));
+
+            assert.equal(res.toString("hex"), data.slice(0, 992).toString("hex"));
+            assert.equal(mod.C_DigestFinal(session, new Buffer(32)).toString("hex"),
+                crypto.createHash("sha256").update(data.slice(0, 992)).digest("hex"));
+        });
+
+        it("SignEncryptUpdate", () => {
+            mod.C_SignInit(session, { mechanism: pkcs11.CKM_SHA256_HMAC, parameter: null }, hmacKey);
+            mod.C_EncryptInit(session, mechanism, aesKey);
+
+            const res = parts(helper.C_SignEncryptUpdate, data);
+            mod.C_EncryptFinal(session, new Buffer(16));
+
+            assert.equal(res.toString("hex"), enc.toString("hex"));
+            assert.equal(mod.C_SignFinal(session, new Buffer(32)).toString("hex"),
+                crypto.createHmac("sha256", key).update(data.slice(0, 992)).digest("hex"));
+        });
+
+        it("DecryptVerifyUpdate", () => {
+            mod.C_DecryptInit(session, mechanism, aesKey);
+            mod.C_VerifyInit(session, { mechanism: pkcs11.CKM_SHA256_HMAC, parameter: null }, hmacKey);
+
+            const res = parts(helper.C_DecryptVerifyUpdate, enc);
+            mod.C_DecryptFinal(session, new Buffer(16));
+
+            assert.equal(res.toString("hex"), data.slice(0, 992).toString("hex"));
+            assert.equal(mod.C_VerifyFinal(session, crypto.createHmac("sha256", key).update(data.slice(0, 992)).digest()), true);
+        });
+    });
+
     context("ossl vectors", () => {
 
         let p11, ossl;
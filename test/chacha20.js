@@ -0,0 +1,115 @@
+/// <reference types="mocha" />
+const pkcs11 = require("pkcs11js");
+const assert = require("assert");
+
+const config = require("./config");
+const helper = require("./helper");
+
+context("ChaCha20-Poly1305", () => {
+
+    let mod = new pkcs11.PKCS11();;
+    let slot, session;
+
+    before(() => {
+        mod.load(config.lib);
+        mod.C_Initialize();
+        const slots = mod.C_GetSlotList();
+        slot = slots[0];
+        session = mod.C_OpenSession(slot, pkcs11.CKF_RW_SESSION | pkcs11.CKF_SERIAL_SESSION);
+    });
+
+    after(() => {
+        mod.C_CloseAllSessions(slot);
+        mod.C_Finalize();
+    });
+
+    context("RFC 8439 vectors", () => {
+        // Section 2.8.2
+        const nonce = new Buffer("070000004041424344454647", "hex");
+        const aad = new Buffer("50515253c0c1c2c3c4c5c6c7", "hex");
+        const data = new Buffer("Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.");
+        const enc =
+            "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6" +
+            "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36" +
+            "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc" +
+            "3ff4def08e4b7a9de576d26586cec64b6116";
+        const tag = "1ae10b594f09e26a7e902ecbd0600691";
+        let key, mechanism;
+
+        before(function () {
+            if (!helper.hasMechanism(mod, slot, helper.CKM_CHACHA20_POLY1305)) {
+                this.skip();
+            }
+            key = helper.createSecretKey(mod, session, pkcs11.CKK_GENERIC_SECRET,
+                new Buffer("808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f", "hex"), [
+                    { type: pkcs11.CKA_ENCRYPT, value: true },
+                    { type: pkcs11.CKA_DECRYPT, value: true },
+                ]);
+            mechanism = {
+                mechanism: helper.CKM_CHACHA20_POLY1305,
+                parameter: helper.struct([
+                    ["pointer", nonce],
+                    ["ulong", nonce.length],
+                    ["pointer", aad],
+                    ["ulong", aad.length],
+                ]),
+            };
+        });
+
+        it("encrypt", () => {
+            mod.C_EncryptInit(session, mechanism, key);
+
+            const res = mod.C_Encrypt(session, data, new Buffer(256));
+
+            assert.equal(res.toString("hex"), enc + tag);
+        });
+
+        it("encrypt update", () => {
+            mod.C_EncryptInit(session, mechanism, key);
+
+            const parts = [
+                mod.C_EncryptUpdate(session, data.slice(0, 3), new Buffer(256)),
+                mod.C_EncryptUpdate(session, data.slice(3, 67), new Buffer(256)),
+                mod.C_EncryptUpdate(session, data.slice(67), new Buffer(256)),
+                mod.C_EncryptFinal(session, new Buffer(256)),
+            ];
+
+            assert.equal(Buffer.concat(parts).toString("hex"), enc + tag);
+        });
+
+        it("decrypt", () => {
+            mod.C_DecryptInit(session, mechanism, key);
+
+            const res = mod.C_Decrypt(session, new Buffer(enc + tag, "hex"), new Buffer(256));
+
+            assert.equal(res.toString(), data.toString());
+        });
+
+        it("decrypt with wrong tag", () => {
+            const wrong = new Buffer(enc + tag, "hex");
+            wrong[wrong.length - 1] ^= 1;
+
+            mod.C_DecryptInit(session, mechanism, key);
+            assert.throws(() => {
+                mod.C_Decrypt(session, wrong, new Buffer(256));
+            }, /CKR_ENCRYPTED_DATA_INVALID:64/);
+        });
+
+        it("wrong nonce length", () => {
+            const wrongMechanism = {
+                mechanism: helper.CKM_CHACHA20_POLY1305,
+                parameter: helper.struct([
+                    ["pointer", nonce],
+                    ["ulong", 11],
+                    ["pointer", null],
+                    ["ulong", 0],
+                ]),
+            };
+
+            assert.throws(() => {
+                mod.C_EncryptInit(session, wrongMechanism, key);
+            }, /CKR_MECHANISM_PARAM_INVALID:113/);
+        });
+    });
+
+});
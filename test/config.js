@@ -13,6 +13,10 @@ switch (os.platform()) {
         config.lib = "build/Debug/pvpkcs11.dll";
         break;
     }
+    case "linux": {
+        config.lib = "out/Debug_x64/lib/libpvpkcs11.so";
+        break;
+    }
 }
 
 module.exports = config;
\ No newline at end of file
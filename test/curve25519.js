@@ -0,0 +1,383 @@
+/// <reference types="mocha" />
+const pkcs11 = require("pkcs11js");
+const assert = require("assert");
+
+const config = require("./config");
+const helper = require("./helper");
+
+context("Curve25519", () => {
+
+    let mod = new pkcs11.PKCS11();;
+    let slot, session;
+
+    before(() => {
+        mod.load(config.lib);
+        mod.C_Initialize();
+        const slots = mod.C_GetSlotList();
+        slot = slots[0];
+        session = mod.C_OpenSession(slot, pkcs11.CKF_RW_SESSION | pkcs11.CKF_SERIAL_SESSION);
+    });
+
+    after(() => {
+        mod.C_CloseAllSessions(slot);
+        mod.C_Finalize();
+    });
+
+    // OIDs of edwards25519 and curve25519
+    const ED25519_PARAMS = new Buffer("06032b6570", "hex");
+    const X25519_PARAMS = new Buffer("06032b656e", "hex");
+
+    /**
+     * Returns DER OCTET STRING of the point
+     */
+    function encodePoint(point) {
+        return Buffer.concat([new Buffer([4, point.length]), point]);
+    }
+
+    function createEdKeys(seed, point) {
+        return {
+            privateKey: mod.C_CreateObject(session, [
+                { type: pkcs11.CKA_CLASS, value: pkcs11.CKO_PRIVATE_KEY },
+                { type: pkcs11.CKA_KEY_TYPE, value: helper.CKK_EC_EDWARDS },
+                { type: pkcs11.CKA_EC_PARAMS, value: ED25519_PARAMS },
+                { type: pkcs11.CKA_VALUE, value: seed },
+                { type: pkcs11.CKA_SIGN, value: true },
+            ]),
+            publicKey: mod.C_CreateObject(session, [
+                { type: pkcs11.CKA_CLASS, value: pkcs11.CKO_PUBLIC_KEY },
+                { type: pkcs11.CKA_KEY_TYPE, value: helper.CKK_EC_EDWARDS },
+                { type: pkcs11.CKA_EC_PARAMS, value: ED25519_PARAMS },
+                { type: pkcs11.CKA_EC_POINT, value: encodePoint(point) },
+                { type: pkcs11.CKA_VERIFY, value: true },
+            ]),
+        };
+    }
+
+    function eddsa(phFlag, context) {
+        const parameter = phFlag === undefined
+            ? null
+            : helper.struct([
+                ["byte", phFlag ? 1 : 0],
+                ["ulong", context ? context.length : 0],
+                ["pointer", context || null],
+            ]);
+        return { mechanism: helper.CKM_EDDSA, parameter };
+    }
+
+    context("Ed25519", () => {
+
+        before(function () {
+            if (!helper.hasMechanism(mod, slot, helper.CKM_EDDSA)) {
+                this.skip();
+            }
+        });
+
+        // RFC 8032, section 7
+        [
+            {
+                name: "TEST 1",
+                seed: "9d61b19deffd5a60ba844af492ec2cc44449c5697b326919703bac031cae7f60",
+                point: "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a",
+                data: "",
+                signature:
+                    "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e06522490155" +
+                    "5fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b",
+            },
+            {
+                name: "TEST 2",
+                seed: "4ccd089b28ff96da9db6c346ec114e0f5b8a319f35aba624da8cf6ed4fb8a6fb",
+                point: "3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c",
+                data: "72",
+                signature:
+                    "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da" +
+                    "085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00",
+            },
+            {
+                name: "TEST 3",
+                seed: "c5aa8df43f9f837bedb7442f31dcb7b166d38535076f094b85ce3a2e0b4458f7",
+                point: "fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025",
+                data: "af82",
+                signature:
+                    "6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac" +
+                    "18ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a",
+            },
+            {
+                name: "Ed25519ctx foo",
+                seed: "0305334e381af78f141cb666f6199f57bc3495335a256a95bd2a55bf546663f6",
+                point: "dfc9425e4f968f7f0c29f0259cf5f9aed6851c2bb4ad8bfb860cfee0ab248292",
+                data: "f726936d19c800494e3fdaff20b276a8",
+                phFlag: false,
+                context: "666f6f",
+                signature:
+                    "55a4cc2f70a54e04288c5f4cd1e45a7bb520b36292911876cada7323198dd87a" +
+                    "8b36950b95130022907a7fb7c4e9b2d5f6cca685a587b4b21f4b888e4e7edb0d",
+            },
+            {
+                name: "Ed25519ph abc",
+                seed: "833fe62409237b9d62ec77587520911e9a759cec1d19755b7da901b96dca3d42",
+                point: "ec172b93ad5e563bf4932c70e1245034c35467ef2efd4d64ebf819683467e2bf",
+                data: "616263",
+                phFlag: true,
+                signature:
+                    "98a70222f0b8121aa9d30f813d683f809e462b469c7ff87639499bb94e6dae41" +
+                    "31f85042463c2a355a2003d062adf5aaa10b8c61e636062aaad11c2a26083406",
+            },
+        ].forEach((vector) => {
+            context(vector.name, () => {
+                const data = new Buffer(vector.data, "hex");
+                const context = vector.context ? new Buffer(vector.context, "hex") : null;
+                let keys;
+
+                before(() => {
+                    keys = createEdKeys(new Buffer(vector.seed, "hex"), new Buffer(vector.point, "hex"));
+                });
+
+                it("sign", () => {
+                    mod.C_SignInit(session, eddsa(vector.phFlag, context), keys.privateKey);
+
+                    const signature = mod.C_Sign(session, data, new Buffer(64));
+
+                    assert.equal(signature.toString("hex"), vector.signature);
+                });
+
+                it("sign update", () => {
+                    mod.C_SignInit(session, eddsa(vector.phFlag, context), keys.privateKey);
+
+                    [data.slice(0, 1), data.slice(1)]
+                        .filter((part) => part.length)
+                        .forEach((part) => mod.C_SignUpdate(session, part));
+                    const signature = mod.C_SignFinal(session, new Buffer(64));
+
+                    assert.equal(signature.toString("hex"), vector.signature);
+                });
+
+                it("verify", () => {
+                    const signature = new Buffer(vector.signature, "hex");
+
+                    mod.C_VerifyInit(session, eddsa(vector.phFlag, context), keys.publicKey);
+                    assert.equal(mod.C_Verify(session, data, signature), true);
+
+                    signature[0] ^= 1;
+                    mod.C_VerifyInit(session, eddsa(vector.phFlag, context), keys.publicKey);
+                    assert.equal(mod.C_Verify(session, data, signature), false);
+                });
+            });
+        });
+
+        it("wrong context", () => {
+            const keys = createEdKeys(
+                new Buffer("0305334e381af78f141cb666f6199f57bc3495335a256a95bd2a55bf546663f6", "hex"),
+                new Buffer("dfc9425e4f968f7f0c29f0259cf5f9aed6851c2bb4ad8bfb860cfee0ab248292", "hex"));
+            const signature = new Buffer(
+                "55a4cc2f70a54e04288c5f4cd1e45a7bb520b36292911876cada7323198dd87a" +
+                "8b36950b95130022907a7fb7c4e9b2d5f6cca685a587b4b21f4b888e4e7edb0d", "hex");
+            const data = new Buffer("f726936d19c800494e3fdaff20b276a8", "hex");
+
+            mod.C_VerifyInit(session, eddsa(false, new Buffer("bar")), keys.publicKey);
+            assert.equal(mod.C_Verify(session, data, signature), false);
+
+            mod.C_VerifyInit(session, eddsa(), keys.publicKey);
+            assert.equal(mod.C_Verify(session, data, signature), false);
+        });
+
+        it("GenerateKeyPair", () => {
+            const keys = mod.C_GenerateKeyPair(session, { mechanism: helper.CKM_EC_EDWARDS_KEY_PAIR_GEN, parameter: null }, [
+                { type: pkcs11.CKA_EC_PARAMS, value: ED25519_PARAMS },
+                { type: pkcs11.CKA_VERIFY, value: true },
+            ], [
+                { type: pkcs11.CKA_SIGN, value: true },
+            ]);
+            const data = new Buffer("pvpkcs11");
+
+            const point = mod.C_GetAttributeValue(session, keys.publicKey, [
+                { type: pkcs11.CKA_EC_POINT },
+            ])[0].value;
+            assert.equal(point.length, 34);
+
+            mod.C_SignInit(session, eddsa(), keys.privateKey);
+            const signature = mod.C_Sign(session, data, new Buffer(64));
+
+            mod.C_VerifyInit(session, eddsa(), keys.publicKey);
+            assert.equal(mod.C_Verify(session, data, signature), true);
+        });
+    });
+
+    context("X25519", () => {
+
+        before(function () {
+            if (!helper.hasMechanism(mod, slot, helper.CKM_EC_MONTGOMERY_KEY_PAIR_GEN)) {
+                this.skip();
+            }
+        });
+
+        function createPrivateKey(value) {
+            return mod.C_CreateObject(session, [
+                { type: pkcs11.CKA_CLASS, value: pkcs11.CKO_PRIVATE_KEY },
+                { type: pkcs11.CKA_KEY_TYPE, value: helper.CKK_EC_MONTGOMERY },
+                { type: pkcs11.CKA_EC_PARAMS, value: X25519_PARAMS },
+                { type: pkcs11.CKA_VALUE, value },
+                { type: pkcs11.CKA_DERIVE, value: true },
+            ]);
+        }
+
+        function derive(privateKey, publicData) {
+            const key = mod.C_DeriveKey(
+                session,
+                {
+                    mechanism: pkcs11.CKM_ECDH1_DERIVE,
+                    parameter: {
+                        type: pkcs11.CK_PARAMS_EC_DH,
+                        kdf: pkcs11.CKD_NULL,
+                        publicData,
+                    },
+                },
+                privateKey,
+                [
+                    { type: pkcs11.CKA_CLASS, value: pkcs11.CKO_SECRET_KEY },
+                    { type: pkcs11.CKA_KEY_TYPE, value: pkcs11.CKK_GENERIC_SECRET },
+                    { type: pkcs11.CKA_SENSITIVE, value: false },
+                    { type: pkcs11.CKA_EXTRACTABLE, value: true },
+                ]);
+            return mod.C_GetAttributeValue(session, key, [
+                { type: pkcs11.CKA_VALUE },
+            ])[0].value;
+        }
+
+        it("RFC 7748 scalar multiplication", () => {
+            // Section 5.2
+            const key = createPrivateKey(new Buffer("a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4", "hex"));
+
+            const res = derive(key, new Buffer("e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c", "hex"));
+
+            assert.equal(res.toString("hex"), "c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552");
+        });
+
+        it("RFC 7748 Diffie-Hellman", () => {
+            // Section 6.1
+            const alice = createPrivateKey(new Buffer("77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a", "hex"));
+            const bob = createPrivateKey(new Buffer("5dab087e624a8a4b79e17f8b83800ee66f3bb1292618b6fd1c2f8b27ff88e0eb", "hex"));
+            const shared = "4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742";
+
+            // Bob's public key is raw, Alice's one is DER OCTET STRING
+            assert.equal(derive(alice, new Buffer("de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f", "hex")).toString("hex"), shared);
+            assert.equal(derive(bob, encodePoint(new Buffer("8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a", "hex"))).toString("hex"), shared);
+        });
+
+        it("GenerateKeyPair", () => {
+            function generate() {
+                const keys = mod.C_GenerateKeyPair(session, { mechanism: helper.CKM_EC_MONTGOMERY_KEY_PAIR_GEN, parameter: null }, [
+                    { type: pkcs11.CKA_EC_PARAMS, value: X25519_PARAMS },
+                ], [
+                    { type: pkcs11.CKA_DERIVE, value: true },
+                ]);
+                keys.point = mod.C_GetAttributeValue(session, keys.publicKey, [
+                    { type: pkcs11.CKA_EC_POINT },
+                ])[0].value;
+                return keys;
+            }
+
+            const alice = generate();
+            const bob = generate();
+
+            const res = derive(alice.privateKey, bob.point);
+            assert.equal(res.length, 32);
+            assert.equal(derive(bob.privateKey, alice.point).toString("hex"), res.toString("hex"));
+        });
+    });
+
+    context("C_PV_VerifyBatch", () => {
+        const data = new Buffer("pvpkcs11");
+        let items, edKeys;
+
+        function generate(mechanism, publicTemplate) {
+            return mod.C_GenerateKeyPair(session, { mechanism, parameter: null }, publicTemplate.concat([
+                { type: pkcs11.CKA_VERIFY, value: true },
+            ]), [
+                { type: pkcs11.CKA_SIGN, value: true },
+            ]);
+        }
+
+        function item(mechanism, parameter, keys) {
+            mod.C_SignInit(session, { mechanism, parameter }, keys.privateKey);
+            return {
+                mechanism,
+                parameter,
+                key: keys.publicKey,
+                data,
+                signature: mod.C_Sign(session, data, new Buffer(512)),
+            };
+        }
+
+        before(function () {
+            if (!helper.hasMechanism(mod, slot, helper.CKM_EDDSA)) {
+                this.skip();
+            }
+            const ed = edKeys = generate(helper.CKM_EC_EDWARDS_KEY_PAIR_GEN, [
+                { type: pkcs11.CKA_EC_PARAMS, value: ED25519_PARAMS },
+            ]);
+            const ec = generate(pkcs11.CKM_EC_KEY_PAIR_GEN, [
+                { type: pkcs11.CKA_EC_PARAMS, value: new Buffer("06082a8648ce3d030107", "hex") },
+            ]);
+            const rsa = generate(pkcs11.CKM_RSA_PKCS_KEY_PAIR_GEN, [
+                { type: pkcs11.CKA_MODULUS_BITS, value: 2048 },
+            ]);
+            items = [];
+            for (let i = 0; i < 4; i++) {
+                items.push(item(helper.CKM_EDDSA, null, ed));
+            }
+            items.push(item(helper.CKM_EDDSA, eddsa(false, new Buffer("ctx")).parameter, ed));
+            items.push(item(pkcs11.CKM_ECDSA_SHA256, null, ec));
+            items.push(item(pkcs11.CKM_SHA256_RSA_PKCS, null, rsa));
+        });
+
+        it("valid", () => {
+            const res = helper.C_PV_VerifyBatch(session, items);
+
+            assert.deepEqual(res, items.map(() => pkcs11.CKR_OK));
+        });
+
+        it("invalid items", () => {
+            const tampered = items.map((value) => Object.assign({}, value, { signature: new Buffer(value.signature) }));
+            tampered[1].signature[0] ^= 1;
+            tampered[5].signature[tampered[5].signature.length - 1] ^= 1;
+            tampered[6].data = new Buffer("other");
+
+            const res = helper.C_PV_VerifyBatch(session, tampered);
+
+            assert.deepEqual(res, [
+                pkcs11.CKR_OK,
+                pkcs11.CKR_SIGNATURE_INVALID,
+                pkcs11.CKR_OK,
+                pkcs11.CKR_OK,
+                pkcs11.CKR_OK,
+                pkcs11.CKR_SIGNATURE_INVALID,
+                pkcs11.CKR_SIGNATURE_INVALID,
+            ]);
+        });
+
+        it("wrong key", () => {
+            const wrong = items.slice(0, 2).concat([Object.assign({}, items[2], { key: items[5].key })]);
+
+            const res = helper.C_PV_VerifyBatch(session, wrong);
+
+            assert.equal(res[0], pkcs11.CKR_OK);
+            assert.equal(res[1], pkcs11.CKR_OK);
+            assert.notEqual(res[2], pkcs11.CKR_OK);
+        });
+
+        it("empty data and no key", () => {
+            const empty = new Buffer(0);
+            mod.C_SignInit(session, { mechanism: helper.CKM_EDDSA, parameter: null }, edKeys.privateKey);
+            const signature = mod.C_Sign(session, empty, new Buffer(64));
+            const batch = [
+                Object.assign({}, items[0], { data: empty, signature }),
+                Object.assign({}, items[0], { key: 0 }),
+            ];
+
+            const res = helper.C_PV_VerifyBatch(session, batch);
+
+            assert.deepEqual(res, [pkcs11.CKR_OK, pkcs11.CKR_ARGUMENTS_BAD]);
+        });
+    });
+
+});
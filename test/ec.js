@@ -96,6 +96,166 @@ context("EC", () => {
         });
     });
 
+    context("vectors", () => {
+        const data = new Buffer("pvpkcs11");
+
+        [
+            {
+                name: "P-256",
+                params: "06082a8648ce3d030107",
+                mechanism: "CKM_ECDSA_SHA256",
+                d:
+                    "57ca5a767b986700181ac971e9dc40cf3a1e28e2f8c77201e00f5acacf3f8819",
+                point:
+                    "04087cbfa619bb3f38080cf4b270bb20d7814bf993606ab1658ef0944d76c52b" +
+                    "8ba8dd90ae61d81713fc58c62e2d24a63e9735d85e4d4357af9b8c67c0a3b93b" +
+                    "75",
+                sig:
+                    "b7ee989f20cd5c817cbc49fc36d5b963c6bf79eea24daaa6a4ca3a67ec2ab59f" +
+                    "7a7dba35d8e587f4bd91ef09ca0072a09ef6cfe0d40a53804ca1373a0c861f0c",
+                peer:
+                    "04cbeca2df6672930be8f0b54a3c3bd99c6b0342508e372f62fd152c7b40801b" +
+                    "73fdbf9bb2da56acdcd2b062695df930156e851bb92e33d903763c4cec6f0f6b" +
+                    "69",
+                shared:
+                    "dd2713fc8b0ac15715b0ac827c0836967b89fd0fa69e937eb0ef2c0ae234c71e",
+            },
+            {
+                name: "P-384",
+                params: "06052b81040022",
+                mechanism: "CKM_ECDSA_SHA384",
+                d:
+                    "6deee066c315aacbd23ca6c8291a2cbfbf5bd93dec965ec52470c0634ad2923e" +
+                    "a34b86554bf86786b4c586cc8b6ff60b",
+                point:
+                    "04a88453372be32e75c4795443ef9b1e8932cfd01ef1de6b993fb1b6ca4e3fe9" +
+                    "807a80b8ad739a1caa6775435816f427f1044c73af4ff97807e77e9aa82885c1" +
+                    "5acff108469979c11c3352c8be07c03d1244043513f5e1717f4d3f8463726d77" +
+                    "d8",
+                sig:
+                    "f12996a8ca3d9f4ed6e7e77a7b37513f5b0c4a815ea4b65710179ef3981a3d0e" +
+                    "d8f6379d2e6339f128c4a44c7b98c03bf05b8413c28dcc15af394d9f344e3233" +
+                    "41de90a19491da1f89fe2bcac54af34e78c965357b224c2862ef4b33c6abe3fb",
+                peer:
+                    "0469c635ebc4998224b100a5b98bf928e8af825b81b3a06616347a73ea28c3e8" +
+                    "eab82d5291780e20167d755e7e6b5f5b92007e837be23969a3350138b7646a0b" +
+                    "82ad9f6ce1ef4ccd238e850770c8f2c114d0704403377d2e8ae666e7f752123c" +
+                    "22",
+                shared:
+                    "1af666a8f00ddb391a91917119611d8b181afd43cbba77891063f439b559bac7" +
+                    "feb6a32f0ebf6ebc73edbefda9d202ae",
+            },
+            {
+                name: "P-521",
+                params: "06052b81040023",
+                mechanism: "CKM_ECDSA_SHA512",
+                d:
+                    "0089b13ef2a914f5ace84ef60ede53357036fc7c06b3abfcc7224488c18a1876" +
+                    "7201fba9f461dbb92f1eb40a66c21897249c12631ff49dbda905b581034490ea" +
+                    "5599",
+                point:
+                    "0401c942abd1dc2ea6545c9531bb009c69398aebcdbcf32b9245ba81772d1137" +
+                    "980f748bfe981f7a3517a0b05fa4f5da6b92822fecacc6de7ebf463123ab3512" +
+                    "a0c8e3004259ee9aa6bd9f83ba0bb8766146e15d8a0b753dbb01417a88566386" +
+                    "557eb4f7c5ffb0282c8a2dcdeb5924ba61930ca83e23cb190070f61345b06118" +
+                    "341cf5f003",
+                sig:
+                    "01949cfb42bd992fafe264d8e2141a73b6c646935a48a41a9f6cd67df35b20e1" +
+                    "25c9bdbfb8ee116db34508b733b6dbb88bcc5e5d7aad6008c0de8a0cd308a4bf" +
+                    "75d300cdbe65f7f9cbb4f22f44880f9c1dbccb0cb3303926b5a6e4270a3dc672" +
+                    "f4801428a9bfcde102e5d3f5c31ccfa840a175a7c748072ccf6542f200ee727e" +
+                    "88ba2223",
+                peer:
+                    "0401f0803acf18188421b4515600213be10d20592a36eef199b2f28a62e49135" +
+                    "481176824032d73c1c27ab8e23f1773e019fdb04e3597840a168b669b30474fa" +
+                    "c08f4400585b053aa5f187dd582f76dd49a3ef4d0571156e6d4f87bf0cd85ef0" +
+                    "6e336231a0b091dc0fbd7089ccce3139ca81854c32f64458659a5d1dc9df0b25" +
+                    "e4c1d3284a",
+                shared:
+                    "017203aa6553965933a7672f55f87ee79026f1633caf6fdd334c5dd369510f34" +
+                    "b03a39154a5f57da21b0ef7b415111fd8d010d7a3db1a9908b9e4814a94fd69f" +
+                    "03cd",
+            },
+        ].forEach((vector) => {
+            context(vector.name, () => {
+                const params = new Buffer(vector.params, "hex");
+                const mechanism = { mechanism: pkcs11[vector.mechanism], parameter: null };
+                let privateKey, publicKey;
+
+                before(() => {
+                    const point = new Buffer(vector.point, "hex");
+                    privateKey = mod.C_CreateObject(session, [
+                        { type: pkcs11.CKA_CLASS, value: pkcs11.CKO_PRIVATE_KEY },
+                        { type: pkcs11.CKA_KEY_TYPE, value: pkcs11.CKK_EC },
+                        { type: pkcs11.CKA_EC_PARAMS, value: params },
+                        { type: pkcs11.CKA_VALUE, value: new Buffer(vector.d, "hex") },
+                        { type: pkcs11.CKA_SIGN, value: true },
+                        { type: pkcs11.CKA_DERIVE, value: true },
+                    ]);
+                    publicKey = mod.C_CreateObject(session, [
+                        { type: pkcs11.CKA_CLASS, value: pkcs11.CKO_PUBLIC_KEY },
+                        { type: pkcs11.CKA_KEY_TYPE, value: pkcs11.CKK_EC },
+                        { type: pkcs11.CKA_EC_PARAMS, value: params },
+                        // DER OCTET STRING of the point
+                        {
+                            type: pkcs11.CKA_EC_POINT,
+                            value: Buffer.concat([new Buffer(point.length < 0x80 ? [4, point.length] : [4, 0x81, point.length]), point]),
+                        },
+                        { type: pkcs11.CKA_VERIFY, value: true },
+                    ]);
+                });
+
+                it("verify", () => {
+                    const signature = new Buffer(vector.sig, "hex");
+
+                    mod.C_VerifyInit(session, mechanism, publicKey);
+                    assert.equal(mod.C_Verify(session, data, signature), true);
+
+                    signature[signature.length - 1] ^= 1;
+                    mod.C_VerifyInit(session, mechanism, publicKey);
+                    assert.equal(mod.C_Verify(session, data, signature), false);
+                });
+
+                it("sign", () => {
+                    mod.C_SignInit(session, mechanism, privateKey);
+                    const signature = mod.C_Sign(session, data, new Buffer(256));
+
+                    assert.equal(signature.length, vector.sig.length / 2);
+
+                    mod.C_VerifyInit(session, mechanism, publicKey);
+                    assert.equal(mod.C_Verify(session, data, signature), true);
+                    mod.C_VerifyInit(session, mechanism, publicKey);
+                    assert.equal(mod.C_Verify(session, new Buffer("other"), signature), false);
+                });
+
+                it("ECDH", () => {
+                    const key = mod.C_DeriveKey(
+                        session,
+                        {
+                            mechanism: pkcs11.CKM_ECDH1_DERIVE,
+                            parameter: {
+                                type: pkcs11.CK_PARAMS_EC_DH,
+                                kdf: pkcs11.CKD_NULL,
+                                publicData: new Buffer(vector.peer, "hex"),
+                            },
+                        },
+                        privateKey,
+                        [
+                            { type: pkcs11.CKA_CLASS, value: pkcs11.CKO_SECRET_KEY },
+                            { type: pkcs11.CKA_KEY_TYPE, value: pkcs11.CKK_GENERIC_SECRET },
+                            { type: pkcs11.CKA_SENSITIVE, value: false },
+                            { type: pkcs11.CKA_EXTRACTABLE, value: true },
+                        ]);
+
+                    const value = mod.C_GetAttributeValue(session, key, [
+                        { type: pkcs11.CKA_VALUE },
+                    ])[0].value;
+                    assert.equal(value.toString("hex"), vector.shared);
+                });
+            });
+        });
+    });
+
     context("ossl vectors", () => {
         let p11, ossl;
         before(() => {
@@ -0,0 +1,282 @@
+const pkcs11 = require("pkcs11js");
+const ffi = require("ffi-napi");
+const ref = require("ref-napi");
+const os = require("os");
+
+const config = require("./config");
+
+// Values of PKCS#11 3.0 and of the module which pkcs11js doesn't define
+const consts = {
+    CKK_AES_XTS: 0x00000035,
+    CKK_EC_EDWARDS: 0x00000040,
+    CKK_EC_MONTGOMERY: 0x00000041,
+
+    CKM_EC_EDWARDS_KEY_PAIR_GEN: 0x00001055,
+    CKM_EC_MONTGOMERY_KEY_PAIR_GEN: 0x00001056,
+    CKM_EDDSA: 0x00001057,
+    CKM_AES_XTS: 0x00001071,
+    CKM_CHACHA20_POLY1305: 0x00004021,
+
+    CKG_NO_GENERATE: 0x00000000,
+    CKG_GENERATE: 0x00000001,
+    CKG_GENERATE_COUNTER: 0x00000002,
+
+    CKR_AEAD_DECRYPT_FAILED: 0x00000035,
+};
+
+// Structures of the module are packed on Windows
+const PACKED = os.platform() === "win32";
+
+const CK_ULONG = ref.types.ulong;
+
+const FIELD_SIZES = {
+    byte: 1,
+    ulong: ref.sizeof.ulong,
+    pointer: ref.sizeof.pointer,
+};
+
+/**
+ * Returns memory of a C structure. Fields are [type, value], where type is "byte", "ulong",
+ * "pointer" (Buffer or null) or "bytes" (Buffer copied into the structure)
+ */
+function struct(fields) {
+    const offsets = [];
+    let size = 0;
+    let align = 1;
+    fields.forEach((field) => {
+        const fieldSize = field[0] === "bytes" ? field[1].length : FIELD_SIZES[field[0]];
+        const fieldAlign = PACKED || field[0] === "bytes" ? 1 : fieldSize;
+        size = Math.ceil(size / fieldAlign) * fieldAlign;
+        offsets.push(size);
+        size += fieldSize;
+        align = Math.max(align, fieldAlign);
+    });
+    size = Math.ceil(size / align) * align;
+
+    const buf = Buffer.alloc(size);
+    // Memory the structure points to must live as long as the structure
+    buf.refs = [];
+    fields.forEach((field, index) => {
+        const offset = offsets[index];
+        const value = field[1];
+        switch (field[0]) {
+            case "byte":
+                buf.writeUInt8(value, offset);
+                break;
+            case "ulong":
+                CK_ULONG.set(buf, offset, value);
+                break;
+            case "pointer":
+                if (value) {
+                    ref.writePointer(buf, offset, value);
+                    buf.refs.push(value);
+                }
+                break;
+            case "bytes":
+                value.copy(buf, offset);
+                break;
+        }
+    });
+    return buf;
+}
+
+/**
+ * Returns number of a pkcs11js handle
+ */
+function handle(value) {
+    return Buffer.isBuffer(value) ? CK_ULONG.get(value, 0) : value;
+}
+
+const lib = ffi.Library(config.lib, {
+    C_DigestEncryptUpdate: ["ulong", ["ulong", "pointer", "ulong", "pointer", "pointer"]],
+    C_DecryptDigestUpdate: ["ulong", ["ulong", "pointer", "ulong", "pointer", "pointer"]],
+    C_SignEncryptUpdate: ["ulong", ["ulong", "pointer", "ulong", "pointer", "pointer"]],
+    C_DecryptVerifyUpdate: ["ulong", ["ulong", "pointer", "ulong", "pointer", "pointer"]],
+    C_MessageEncryptInit: ["ulong", ["ulong", "pointer", "ulong"]],
+    C_EncryptMessage: ["ulong", ["ulong", "pointer", "ulong", "pointer", "ulong", "pointer", "ulong", "pointer", "pointer"]],
+    C_MessageEncryptFinal: ["ulong", ["ulong"]],
+    C_MessageDecryptInit: ["ulong", ["ulong", "pointer", "ulong"]],
+    C_DecryptMessage: ["ulong", ["ulong", "pointer", "ulong", "pointer", "ulong", "pointer", "ulong", "pointer", "pointer"]],
+    C_MessageDecryptFinal: ["ulong", ["ulong"]],
+    C_PV_SetKeyPairPool: ["ulong", ["ulong", "pointer", "pointer", "ulong", "ulong"]],
+    C_PV_GetKeyPairPoolInfo: ["ulong", ["ulong", "pointer"]],
+    C_PV_VerifyBatch: ["ulong", ["ulong", "pointer", "ulong", "pointer"]],
+});
+
+class Pkcs11Error extends Error {
+    constructor(name, code) {
+        super(`${name}:${code}`);
+        this.code = code;
+    }
+}
+
+function check(name, rv) {
+    if (rv) {
+        throw new Pkcs11Error(name, rv);
+    }
+}
+
+/**
+ * Returns CK_MECHANISM, parameter is a Buffer or null
+ */
+function mechanism(type, parameter) {
+    return struct([
+        ["ulong", type],
+        ["pointer", parameter || null],
+        ["ulong", parameter ? parameter.length : 0],
+    ]);
+}
+
+/**
+ * Calls a function of the form f(hSession, pIn, ulInLen, pOut, pulOutLen) and returns output
+ */
+function update(name, session, data) {
+    const len = ref.alloc(CK_ULONG, 0);
+    check(name, lib[name](handle(session), data, data.length, null, len));
+    const out = Buffer.alloc(len.deref());
+    check(name, lib[name](handle(session), data, data.length, out, len));
+    return out.slice(0, len.deref());
+}
+
+/**
+ * Returns CK_GCM_MESSAGE_PARAMS, iv and tag are updated by the module
+ */
+function gcmMessageParams(iv, ivFixedBits, ivGenerator, tag) {
+    return struct([
+        ["pointer", iv],
+        ["ulong", iv.length],
+        ["ulong", ivFixedBits],
+        ["ulong", ivGenerator],
+        ["pointer", tag],
+        ["ulong", tag.length * 8],
+    ]);
+}
+
+function message(name, session, params, aad, data) {
+    const len = ref.alloc(CK_ULONG, 0);
+    aad = aad || Buffer.alloc(0);
+    check(name, lib[name](handle(session), params, params.length, aad, aad.length, data, data.length, null, len));
+    const out = Buffer.alloc(len.deref());
+    check(name, lib[name](handle(session), params, params.length, aad, aad.length, data, data.length, out, len));
+    return out.slice(0, len.deref());
+}
+
+module.exports = Object.assign({
+    Pkcs11Error,
+    struct,
+    handle,
+    mechanism,
+
+    /**
+     * Returns true if the slot has the mechanism
+     */
+    hasMechanism(mod, slot, type) {
+        return mod.C_GetMechanismList(slot).indexOf(type) !== -1;
+    },
+
+    /**
+     * Creates a secret key of the value in the session
+     */
+    createSecretKey(mod, session, keyType, value, template) {
+        return mod.C_CreateObject(session, [
+            { type: pkcs11.CKA_CLASS, value: pkcs11.CKO_SECRET_KEY },
+            { type: pkcs11.CKA_KEY_TYPE, value: keyType },
+            { type: pkcs11.CKA_VALUE, value },
+        ].concat(template || []));
+    },
+
+    C_DigestEncryptUpdate(session, data) {
+        return update("C_DigestEncryptUpdate", session, data);
+    },
+
+    C_DecryptDigestUpdate(session, data) {
+        return update("C_DecryptDigestUpdate", session, data);
+    },
+
+    C_SignEncryptUpdate(session, data) {
+        return update("C_SignEncryptUpdate", session, data);
+    },
+
+    C_DecryptVerifyUpdate(session, data) {
+        return update("C_DecryptVerifyUpdate", session, data);
+    },
+
+    gcmMessageParams,
+
+    C_MessageEncryptInit(session, type, key) {
+        const mech = mechanism(type, null);
+        check("C_MessageEncryptInit", lib.C_MessageEncryptInit(handle(session), mech, handle(key)));
+    },
+
+    C_EncryptMessage(session, params, aad, data) {
+        return message("C_EncryptMessage", session, params, aad, data);
+    },
+
+    C_MessageEncryptFinal(session) {
+        check("C_MessageEncryptFinal", lib.C_MessageEncryptFinal(handle(session)));
+    },
+
+    C_MessageDecryptInit(session, type, key) {
+        const mech = mechanism(type, null);
+        check("C_MessageDecryptInit", lib.C_MessageDecryptInit(handle(session), mech, handle(key)));
+    },
+
+    C_DecryptMessage(session, params, aad, data) {
+        return message("C_DecryptMessage", session, params, aad, data);
+    },
+
+    C_MessageDecryptFinal(session) {
+        check("C_MessageDecryptFinal", lib.C_MessageDecryptFinal(handle(session)));
+    },
+
+    /**
+     * Pools key pairs of the mechanism, the public key template has CK_ULONG or Buffer values
+     */
+    C_PV_SetKeyPairPool(slot, type, publicTemplate, poolSize) {
+        const values = publicTemplate.map((attr) => {
+            return Buffer.isBuffer(attr.value) ? attr.value : ref.alloc(CK_ULONG, attr.value);
+        });
+        const template = Buffer.concat(publicTemplate.map((attr, index) => {
+            return struct([
+                ["ulong", attr.type],
+                ["pointer", values[index]],
+                ["ulong", values[index].length],
+            ]);
+        }));
+        template.refs = values;
+        const mech = mechanism(type, null);
+        check("C_PV_SetKeyPairPool", lib.C_PV_SetKeyPairPool(handle(slot), mech, template, publicTemplate.length, poolSize));
+    },
+
+    C_PV_GetKeyPairPoolInfo(slot) {
+        const info = Buffer.alloc(4 * ref.sizeof.ulong);
+        check("C_PV_GetKeyPairPoolInfo", lib.C_PV_GetKeyPairPoolInfo(handle(slot), info));
+        return {
+            hits: CK_ULONG.get(info, 0),
+            misses: CK_ULONG.get(info, ref.sizeof.ulong),
+            readyCount: CK_ULONG.get(info, 2 * ref.sizeof.ulong),
+            pendingCount: CK_ULONG.get(info, 3 * ref.sizeof.ulong),
+        };
+    },
+
+    /**
+     * Verifies items { mechanism, parameter, key, data, signature } and returns CK_RV of each
+     */
+    C_PV_VerifyBatch(session, items) {
+        const mechs = items.map((item) => mechanism(item.mechanism, item.parameter));
+        const list = Buffer.concat(items.map((item, index) => {
+            return struct([
+                ["pointer", mechs[index]],
+                ["ulong", handle(item.key)],
+                ["pointer", item.data],
+                ["ulong", item.data.length],
+                ["pointer", item.signature],
+                ["ulong", item.signature.length],
+            ]);
+        }));
+        list.refs = mechs.concat(items.map((item) => item.data), items.map((item) => item.signature));
+        const results = Buffer.alloc(items.length * ref.sizeof.ulong);
+        check("C_PV_VerifyBatch", lib.C_PV_VerifyBatch(handle(session), list, items.length, results));
+        return items.map((item, index) => CK_ULONG.get(results, index * ref.sizeof.ulong));
+    },
+}, consts);
@@ -3,8 +3,10 @@ const pkcs11 = require("pkcs11js");
 const p11_crypto = require("node-webcrypto-p11");
 const ossl_crypto = require("node-webcrypto-ossl");
 const assert = require("assert");
+const crypto = require("crypto");
 
 const config = require("./config");
+const helper = require("./helper");
 
 context("RSA", () => {
 
@@ -100,16 +102,18 @@ context("RSA", () => {
         });
         context("RSA-PSS", () => {
             [
-                "CKM_SHA1_RSA_PKCS_PSS",
-                "CKM_SHA256_RSA_PKCS_PSS",
-                "CKM_SHA384_RSA_PKCS_PSS",
-                "CKM_SHA512_RSA_PKCS_PSS"
+                ["CKM_SHA1_RSA_PKCS_PSS", "CKM_SHA_1", "CKG_MGF1_SHA1"],
+                ["CKM_SHA256_RSA_PKCS_PSS", "CKM_SHA256", "CKG_MGF1_SHA256"],
+                ["CKM_SHA384_RSA_PKCS_PSS", "CKM_SHA384", "CKG_MGF1_SHA384"],
+                ["CKM_SHA512_RSA_PKCS_PSS", "CKM_SHA512", "CKG_MGF1_SHA512"]
             ]
-                .forEach((mech) => {
+                .forEach((params) => {
+                    const mech = params[0];
                     it(mech, () => {
+                        // hashAlg is the hash of the mechanism
                         const parameter = {
-                            hashAlg: pkcs11.CKM_SHA_1,
-                            mgf: pkcs11.CKG_MGF1_SHA1,
+                            hashAlg: pkcs11[params[1]],
+                            mgf: pkcs11[params[2]],
                             saltLen: 12,
                             type: pkcs11.CK_PARAMS_RSA_PSS
                         };
@@ -135,6 +139,300 @@ context("RSA", () => {
         });
     });
 
+    context("GenerateKeyPair values", () => {
+        function toBigInt(buf) {
+            return BigInt("0x" + buf.toString("hex"));
+        }
+
+        function gcd(a, b) {
+            while (b) {
+                const t = a % b;
+                a = b;
+                b = t;
+            }
+            return a;
+        }
+
+        function generate(bits, exponent) {
+            const publicTemplate = [
+                { type: pkcs11.CKA_MODULUS_BITS, value: bits },
+                { type: pkcs11.CKA_VERIFY, value: true },
+            ];
+            if (exponent) {
+                publicTemplate.push({ type: pkcs11.CKA_PUBLIC_EXPONENT, value: exponent });
+            }
+            return mod.C_GenerateKeyPair(session, { mechanism: pkcs11.CKM_RSA_PKCS_KEY_PAIR_GEN, parameter: null }, publicTemplate, [
+                { type: pkcs11.CKA_SIGN, value: true },
+                { type: pkcs11.CKA_SENSITIVE, value: false },
+                { type: pkcs11.CKA_EXTRACTABLE, value: true },
+            ]);
+        }
+
+        function checkKey(keys, bits, exponent) {
+            const values = mod.C_GetAttributeValue(session, keys.privateKey, [
+                { type: pkcs11.CKA_MODULUS },
+                { type: pkcs11.CKA_PUBLIC_EXPONENT },
+                { type: pkcs11.CKA_PRIVATE_EXPONENT },
+                { type: pkcs11.CKA_PRIME_1 },
+                { type: pkcs11.CKA_PRIME_2 },
+                { type: pkcs11.CKA_EXPONENT_1 },
+                { type: pkcs11.CKA_EXPONENT_2 },
+                { type: pkcs11.CKA_COEFFICIENT },
+            ]).map((attr) => toBigInt(attr.value));
+            const n = values[0], e = values[1], d = values[2], p = values[3], q = values[4];
+            const lcm = (p - 1n) * (q - 1n) / gcd(p - 1n, q - 1n);
+
+            assert.equal(n.toString(2).length, bits);
+            assert.equal(e, exponent);
+            assert.equal(p * q, n);
+            assert.equal(d * e % lcm, 1n);
+            assert.equal(values[5], d % (p - 1n));
+            assert.equal(values[6], d % (q - 1n));
+            assert.equal(values[7] * q % p, 1n);
+
+            const publicValues = mod.C_GetAttributeValue(session, keys.publicKey, [
+                { type: pkcs11.CKA_MODULUS },
+                { type: pkcs11.CKA_LOCAL },
+            ]);
+            assert.equal(toBigInt(publicValues[0].value), n);
+            assert.equal(publicValues[1].value[0], 1);
+        }
+
+        [1024, 2048, 3072].forEach((bits) => {
+            it(`${bits}`, () => {
+                checkKey(generate(bits), bits, 65537n);
+            });
+        });
+
+        it("exponent 3", () => {
+            checkKey(generate(2048, new Buffer([3])), 2048, 3n);
+        });
+
+        it("even exponent", () => {
+            assert.throws(() => {
+                generate(2048, new Buffer([1, 0, 0]));
+            }, /CKR_ATTRIBUTE_VALUE_INVALID:19/);
+        });
+
+        it("pool", (done) => {
+            const publicTemplate = [
+                { type: pkcs11.CKA_MODULUS_BITS, value: 2048 },
+            ];
+            try {
+                helper.C_PV_SetKeyPairPool(slot, pkcs11.CKM_RSA_PKCS_KEY_PAIR_GEN, publicTemplate, 2);
+            }
+            catch (err) {
+                // the slot has no pool
+                assert.equal(err.code, pkcs11.CKR_FUNCTION_NOT_SUPPORTED);
+                done();
+                return;
+            }
+
+            const info = helper.C_PV_GetKeyPairPoolInfo(slot);
+            assert.equal(info.readyCount + info.pendingCount, 2);
+
+            function wait(attempts) {
+                const current = helper.C_PV_GetKeyPairPoolInfo(slot);
+                if (current.readyCount < 2 && attempts) {
+                    setTimeout(() => wait(attempts - 1), 100);
+                    return;
+                }
+                try {
+                    assert.equal(current.readyCount, 2);
+
+                    checkKey(generate(2048), 2048, 65537n);
+                    // other configuration
+                    checkKey(generate(2048, new Buffer([3])), 2048, 3n);
+
+                    assert.equal(helper.C_PV_GetKeyPairPoolInfo(slot).hits, info.hits + 1);
+
+                    helper.C_PV_SetKeyPairPool(slot, pkcs11.CKM_RSA_PKCS_KEY_PAIR_GEN, publicTemplate, 0);
+                    assert.equal(helper.C_PV_GetKeyPairPoolInfo(slot).readyCount, 0);
+                    done();
+                }
+                catch (err) {
+                    done(err);
+                }
+            }
+            wait(600);
+        });
+    });
+
+    context("vectors", () => {
+        // RSA-1024 key
+        const key = {
+            n: "d36f859533dc6e60a80dbded4191f514f125b07726cd92d0d9a23ce8c1028032" +
+                "ce79b19ef6b8a9967a6fa2e4ebaddcb10df6de208a1fd00ecf75b598d9063313" +
+                "732439d85a1cdaf2dcd6d46c908500206fb5281bbc9d3893824a6aed59ecf8ca" +
+                "b7073f2374685af39fef505f756b705a2fb26b1d4c2fb1d18660475a542e0e2d",
+            e: "010001",
+            d: "702bfd51bfd6d5544034322bfa1a864c9af724dcc1e05460aae590ace720fd84" +
+                "76d8472c8fb63e7a8ff0441a7112a73fe3a9b204cf62bb4df03081ac5a8f186e" +
+                "e4c8068075e9a0125022321746854bf0cea50593d243487dbdd6f52e8b553a5b" +
+                "7290ea9fd87bc95f8047029e64dabcd764209832fa640a9ae939897cb7089f9d",
+            p: "f84d2aeefd53048efd68d8718b5521eee9cc3b9f0cf889181726914cf0a517ff" +
+                "485c37c13b47a1e8c82bbdc98c9fd2d80d74c12d8fcd4de51ec2089a11bebe5f",
+            q: "d9fdbda11032f8def6c243fa8b6695e1bfd3d97df2430a6f82a31fec774d26f7" +
+                "1de8c98b6aecfa40d6603f83bbf9ff0d033c633bdeff41abf38be0798eaae6f3",
+            dp: "c51da5b6c23e7480fb658f665c414246032ed22a0ac70736abb23f6940251fee" +
+                "d647f72f1c5b5a8a8cd644bd4b38d9ce10a89e6f0818e8fcba353954ee3f69ab",
+            dq: "8f5730583664ae0d3ec923161e9008427777006eb6dcaa8204aeeb10fca9b8d3" +
+                "89d146a5ec5b837b1afc1307b6957ec6b9b7fdb0a2c3ca151d827ecaafab654d",
+            qi: "47163075f51b1d329a5d50278c150d05e602ffd7bc5a73ad4029b2a2fed0b45e" +
+                "3ab2a410ab28ca785ea737eb42fcc9d9975cb1ead33ef341c332e411d771c396",
+        };
+        const data = new Buffer("pvpkcs11");
+        let privateKey, publicKey, nodeKey;
+
+        before(() => {
+            const values = {};
+            Object.keys(key).forEach((name) => {
+                values[name] = new Buffer(key[name], "hex");
+            });
+            publicKey = mod.C_CreateObject(session, [
+                { type: pkcs11.CKA_CLASS, value: pkcs11.CKO_PUBLIC_KEY },
+                { type: pkcs11.CKA_KEY_TYPE, value: pkcs11.CKK_RSA },
+                { type: pkcs11.CKA_MODULUS, value: values.n },
+                { type: pkcs11.CKA_PUBLIC_EXPONENT, value: values.e },
+                { type: pkcs11.CKA_VERIFY, value: true },
+                { type: pkcs11.CKA_ENCRYPT, value: true },
+            ]);
+            privateKey = mod.C_CreateObject(session, [
+                { type: pkcs11.CKA_CLASS, value: pkcs11.CKO_PRIVATE_KEY },
+                { type: pkcs11.CKA_KEY_TYPE, value: pkcs11.CKK_RSA },
+                { type: pkcs11.CKA_MODULUS, value: values.n },
+                { type: pkcs11.CKA_PUBLIC_EXPONENT, value: values.e },
+                { type: pkcs11.CKA_PRIVATE_EXPONENT, value: values.d },
+                { type: pkcs11.CKA_PRIME_1, value: values.p },
+                { type: pkcs11.CKA_PRIME_2, value: values.q },
+                { type: pkcs11.CKA_EXPONENT_1, value: values.dp },
+                { type: pkcs11.CKA_EXPONENT_2, value: values.dq },
+                { type: pkcs11.CKA_COEFFICIENT, value: values.qi },
+                { type: pkcs11.CKA_SIGN, value: true },
+                { type: pkcs11.CKA_DECRYPT, value: true },
+            ]);
+            const jwk = { kty: "RSA" };
+            Object.keys(key).forEach((name) => {
+                jwk[name] = values[name].toString("base64").replace(/=/g, "").replace(/\+/g, "-").replace(/\//g, "_");
+            });
+            nodeKey = crypto.createPrivateKey({ key: jwk, format: "jwk" });
+        });
+
+        function pss(saltLen) {
+            return {
+                mechanism: pkcs11.CKM_SHA256_RSA_PKCS_PSS,
+                parameter: {
+                    hashAlg: pkcs11.CKM_SHA256,
+                    mgf: pkcs11.CKG_MGF1_SHA256,
+                    saltLen,
+                    type: pkcs11.CK_PARAMS_RSA_PSS
+                },
+            };
+        }
+
+        function oaep(label) {
+            return {
+                mechanism: pkcs11.CKM_RSA_PKCS_OAEP,
+                parameter: {
+                    hashAlg: pkcs11.CKM_SHA256,
+                    mgf: pkcs11.CKG_MGF1_SHA256,
+                    source: pkcs11.CKZ_DATA_SPECIFIED,
+                    sourceData: label || null,
+                    type: pkcs11.CK_PARAMS_RSA_OAEP
+                },
+            };
+        }
+
+        it("RSA-PKCS1 SHA-256", () => {
+            const mechanism = { mechanism: pkcs11.CKM_SHA256_RSA_PKCS, parameter: null };
+
+            mod.C_SignInit(session, mechanism, privateKey);
+            assert.equal(mod.C_Sign(session, data, new Buffer(128)).toString("hex"),
+                "42a3add7053cb81754f0c772a6f5c202c9dd0008aada03a506079d126f0d00c6" +
+                "42b4158f63217ad711b5cc90f5912f7c6f3ecac1acb76c1f294ee15f485abce8" +
+                "5463e60ca25322b5f2fe7be2cd486f82c580ca2b9c683f34f81915e0e42cddd1" +
+                "cc2956481eb3f1f06e23dc7c2839d58ab48e97bba46d778b3d1d5a6798af89d1");
+        });
+
+        it("RSA-PSS SHA-256 without salt", () => {
+            // the signature doesn't depend on random salt
+            mod.C_SignInit(session, pss(0), privateKey);
+            assert.equal(mod.C_Sign(session, data, new Buffer(128)).toString("hex"),
+                "2662da110ce924eacc8cfa434dcde2c8f944c542704fd47adec4a1ee980f0608" +
+                "38efa100c217bdaee9c4e89e3c015a28634d1a3103cb4b52db8b00ad079e7647" +
+                "89c6c101ceebe7d061c1a0623863f8881332cf7cb85dafe9bd48201e879c9282" +
+                "0ba4b7a8e642a455352fecec93e14777aabc3558b2888ffd5a8e51d6d0db6098");
+        });
+
+        it("RSA-PSS SHA-256 verify", () => {
+            const signature = new Buffer(
+                "5bf1a48d5b4a8bcc5daa6446720e64a30190821d187ec8b562513a26a8aaf3bf" +
+                "f9eb78a888aa21d249ca84a9e8d47f08fbf65808ca9af0c13e0ea36ffc98e7a3" +
+                "3ad8c71bcbb501905e26ac1a82e7b284de8726a04098e1c129ca08db157ec9f0" +
+                "2d7c508ce322d3dec35f19046d15ed2a459839d3498d233d29474670196a0eb0", "hex");
+
+            mod.C_VerifyInit(session, pss(32), publicKey);
+            assert.equal(mod.C_Verify(session, data, signature), true);
+
+            mod.C_VerifyInit(session, pss(20), publicKey);
+            assert.equal(mod.C_Verify(session, data, signature), false);
+
+            signature[10] ^= 1;
+            mod.C_VerifyInit(session, pss(32), publicKey);
+            assert.equal(mod.C_Verify(session, data, signature), false);
+        });
+
+        it("RSA-PSS SHA-256 sign", () => {
+            mod.C_SignInit(session, pss(32), privateKey);
+            const signature = mod.C_Sign(session, data, new Buffer(128));
+
+            assert.equal(crypto.verify("sha256", data, {
+                key: nodeKey,
+                padding: crypto.constants.RSA_PKCS1_PSS_PADDING,
+                saltLength: 32,
+            }, signature), true);
+        });
+
+        it("RSA-OAEP SHA-256 decrypt", () => {
+            mod.C_DecryptInit(session, oaep(), privateKey);
+            assert.equal(mod.C_Decrypt(session, new Buffer(
+                "ce152d89e465fd3752160fefd86cc935b19f5cc1e837e4eacc6d14c56a256832" +
+                "808381c7eff86fd7ec5677be1030fe759533e25be9d4a6470a9d41cfa0721858" +
+                "027c65acdd3974f85d97815bcfcef06e2bc409ac3833b2717a021918085f33ca" +
+                "6983437db695060a2e834271fd64aaec8c5b5e66539d84fec4217d214871d4bf", "hex"), new Buffer(128)).toString(), data.toString());
+
+            mod.C_DecryptInit(session, oaep(new Buffer("label")), privateKey);
+            assert.equal(mod.C_Decrypt(session, new Buffer(
+                "d0060f96630e64d990b3338eba71d28b885ea1e99337a1850f68f32f63e783a9" +
+                "e411b85b09fac04f2fef71a3b12aeca6371ddc90f44f53c5dc23849da8b98ca1" +
+                "45991e4fcc4c3648d5a20a8bb1ff16e6550acd500bd0077ab4ea8ae4d26a0602" +
+                "c693722a7096754f458d3af393cef14c8567ddad7da00e0d4f9a1ac720b06f46", "hex"), new Buffer(128)).toString(), data.toString());
+        });
+
+        it("RSA-OAEP SHA-256 wrong label", () => {
+            mod.C_DecryptInit(session, oaep(new Buffer("other")), privateKey);
+            assert.throws(() => {
+                mod.C_Decrypt(session, new Buffer(
+                    "d0060f96630e64d990b3338eba71d28b885ea1e99337a1850f68f32f63e783a9" +
+                    "e411b85b09fac04f2fef71a3b12aeca6371ddc90f44f53c5dc23849da8b98ca1" +
+                    "45991e4fcc4c3648d5a20a8bb1ff16e6550acd500bd0077ab4ea8ae4d26a0602" +
+                    "c693722a7096754f458d3af393cef14c8567ddad7da00e0d4f9a1ac720b06f46", "hex"), new Buffer(128));
+            }, /CKR_ENCRYPTED_DATA_INVALID:64/);
+        });
+
+        it("RSA-OAEP SHA-256 encrypt", () => {
+            mod.C_EncryptInit(session, oaep(new Buffer("label")), publicKey);
+            const enc = mod.C_Encrypt(session, data, new Buffer(128));
+
+            assert.equal(crypto.privateDecrypt({
+                key: nodeKey,
+                padding: crypto.constants.RSA_PKCS1_OAEP_PADDING,
+                oaepHash: "sha256",
+                oaepLabel: new Buffer("label"),
+            }, enc).toString(), data.toString());
+        });
+    });
+
     context("ossl vectors", () => {
         let p11, ossl;
         before(() => {
@@ -1,6 +1,7 @@
 /// <reference types="mocha" />
 const pkcs11 = require("pkcs11js");
 const assert = require("assert");
+const os = require("os");
 
 const config = require("./config");
 
@@ -69,7 +70,46 @@ context("Slot", () => {
                 assert.equal(hex1 !== buf.toString("hex"), true);
                 assert.equal(random.toString("hex"), buf.toString("hex"));
             });
+            it("generate random of different lengths", () => {
+                [1, 15, 16, 17, 255, 256, 257, 4095, 4096, 4097, 100000].forEach((length) => {
+                    const first = mod.C_GenerateRandom(session, new Buffer(length).fill(0));
+                    const second = mod.C_GenerateRandom(session, new Buffer(length).fill(0));
+
+                    assert.equal(first.length, length);
+                    if (length >= 16) {
+                        assert.notEqual(first.toString("hex"), second.toString("hex"));
+                        assert.notEqual(first.toString("hex"), new Buffer(length).fill(0).toString("hex"));
+                    }
+                });
+            });
+            it("small requests don't repeat", () => {
+                const values = {};
+                for (let i = 0; i < 2000; i++) {
+                    const value = mod.C_GenerateRandom(session, new Buffer(16)).toString("hex");
+                    assert.equal(values[value], undefined);
+                    values[value] = true;
+                }
+            });
+            it("all byte values", () => {
+                const random = mod.C_GenerateRandom(session, new Buffer(65536));
+                const counts = new Array(256).fill(0);
+                for (let i = 0; i < random.length; i++) {
+                    counts[random[i]]++;
+                }
+                // 256 on average
+                counts.forEach((count) => {
+                    assert.equal(count > 150 && count < 380, true);
+                });
+            });
             it("seed random", () => {
+                if (os.platform() === "linux") {
+                    // mixed into the next reseed
+                    mod.C_SeedRandom(session, new Buffer(10));
+
+                    const random = mod.C_GenerateRandom(session, new Buffer(32));
+                    assert.notEqual(random.toString("hex"), new Buffer(32).fill(0).toString("hex"));
+                    return;
+                }
                 assert.throws(() => {
                     const seed = mod.C_SeedRandom(session, new Buffer(10));
                 }, /CKR_FUNCTION_NOT_SUPPORTED:84/);
@@ -40,6 +40,13 @@ context("RSA", () => {
 
             assert.equal("47f7d821cad2070ebef455e5d0506d6d944bb2cb", digest.toString("hex"));
         });
+        it("SHA-1 once empty", () => {
+            mod.C_DigestInit(session, { mechanism: pkcs11.CKM_SHA_1, parameter: null });
+
+            const digest = mod.C_Digest(session, new Buffer(0), new Buffer(256));
+
+            assert.equal("da39a3ee5e6b4b0d3255bfef95601890afd80709", digest.toString("hex"));
+        });
         it("SHA-256", () => {
             mod.C_DigestInit(session, { mechanism: pkcs11.CKM_SHA256, parameter: null });
 
@@ -72,4 +79,68 @@ context("RSA", () => {
         });
     })
 
+    context("HMAC", () => {
+        // Test case 2 of RFC 2202 and RFC 4231
+        const data = new Buffer("what do ya want for nothing?");
+        let key;
+
+        before(function () {
+            if (mod.C_GetMechanismList(slot).indexOf(pkcs11.CKM_SHA256_HMAC) === -1) {
+                this.skip();
+            }
+            key = mod.C_CreateObject(session, [
+                { type: pkcs11.CKA_CLASS, value: pkcs11.CKO_SECRET_KEY },
+                { type: pkcs11.CKA_KEY_TYPE, value: pkcs11.CKK_GENERIC_SECRET },
+                { type: pkcs11.CKA_VALUE, value: new Buffer("Jefe") },
+                { type: pkcs11.CKA_SIGN, value: true },
+                { type: pkcs11.CKA_VERIFY, value: true },
+            ]);
+        });
+
+        [
+            ["CKM_SHA_1_HMAC", "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79"],
+            ["CKM_SHA256_HMAC", "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843"],
+            ["CKM_SHA384_HMAC", "af45d2e376484031617f78d2b58a6b1b9c7ef464f5a01b47e42ec3736322445e8e2240ca5e69e2c78b3239ecfab21649"],
+            ["CKM_SHA512_HMAC", "164b7a7bfcf819e2e395fbe73b56e0a387bd64222e831fd610270cd7ea2505549758bf75c05a994a6d034f65f8f0e6fdcaeab1a34d4a6b4b636e070a38bce737"],
+        ]
+            .forEach((vector) => {
+                const mechanism = { mechanism: pkcs11[vector[0]], parameter: null };
+
+                it(`${vector[0]} once`, () => {
+                    mod.C_SignInit(session, mechanism, key);
+
+                    const signature = mod.C_Sign(session, data, new Buffer(64));
+
+                    assert.equal(signature.toString("hex"), vector[1]);
+                });
+
+                it(`${vector[0]} update`, () => {
+                    mod.C_SignInit(session, mechanism, key);
+
+                    mod.C_SignUpdate(session, data.slice(0, 10));
+                    mod.C_SignUpdate(session, data.slice(10));
+
+                    const signature = mod.C_SignFinal(session, new Buffer(64));
+
+                    assert.equal(signature.toString("hex"), vector[1]);
+                });
+
+                it(`${vector[0]} verify`, () => {
+                    const signature = new Buffer(vector[1], "hex");
+
+                    mod.C_VerifyInit(session, mechanism, key);
+                    assert.equal(mod.C_Verify(session, data, signature), true);
+
+                    signature[0] ^= 1;
+                    mod.C_VerifyInit(session, mechanism, key);
+                    assert.equal(mod.C_Verify(session, data, signature), false);
+
+                    mod.C_VerifyInit(session, mechanism, key);
+                    assert.throws(() => {
+                        mod.C_Verify(session, data, signature.slice(0, 10));
+                    }, /CKR_SIGNATURE_LEN_RANGE:193/);
+                });
+            });
+    });
+
 });
\ No newline at end of file